@@ -49,6 +49,25 @@ enum ExposureState
      READOUT = 3
 }
 
+/**
+ * Enumeration describing the status of the detector cooler.
+ * <ul>
+ * <li><b>OFF</b> The cooler is off.
+ * <li><b>AMBIENT</b> The detector is at ambient temperature.
+ * <li><b>OK</b> The detector temperature has stabilised at the target temperature.
+ * <li><b>RAMPING</b> The detector temperature is changing towards the target temperature.
+ * <li><b>UNKNOWN</b> The cooler status could not be determined.
+ * </ul>
+ */
+enum CoolerStatus
+{
+	OFF = 0,
+	AMBIENT = 1,
+	OK = 2,
+	RAMPING = 3,
+	UNKNOWN = 4
+}
+
 /**
  * Enumeration to configure the readout speed of the detector.
  * <ul>
@@ -92,6 +111,289 @@ struct ImageData
        3: i32 y_size;
 }
 
+/**
+ * Structure containing read out data from the camera, packed into a single binary blob.
+ * <ul> 
+ * <li><b>data</b> The actual read out data, as packed little-endian 16-bit unsigned pixels 
+ *                 (2 bytes per pixel, x_size*y_size pixels, row-major order).
+ * <li><b>x_size</b> The X (horizontal) dimension of the image data, in binned pixels.
+ * <li><b>y_size</b> The Y (vertical) dimension of the image data, in binned pixels.
+ * <li><b>xbin</b> The X (horizontal) binning used when the image data was read out.
+ * <li><b>ybin</b> The Y (vertical) binning used when the image data was read out.
+ * <li><b>frame_sequence</b> A sequence number incremented every time the camera reads out a new image 
+ *                           into the image buffer. Zero means no image has been read out yet.
+ * </ul>
+ */
+struct ImageDataBinary
+{
+       1: binary data;
+       2: i32 x_size;
+       3: i32 y_size;
+       4: i8 xbin;
+       5: i8 ybin;
+       6: i64 frame_sequence;
+}
+
+/**
+ * Structure containing a region of the last image read out by the camera, returned by get_image_region.
+ * The region is given in both the binned pixels of the image (as returned by get_image_data_binary, i.e. after any
+ * re-orientation), and in the unbinned pixels of the detector (as used by set_window, i.e. before re-orientation).
+ * <ul>
+ * <li><b>data</b> The region's pixels, as packed little-endian 16-bit unsigned pixels 
+ *                 (2 bytes per pixel, x_size*y_size pixels, row-major order).
+ * <li><b>x_size</b> The number of pixels in each row of data. This is width/step rounded up.
+ * <li><b>y_size</b> The number of rows of data. This is height/step rounded up.
+ * <li><b>x0</b> The first column of the region in the image, in binned pixels (starting from 0).
+ * <li><b>y0</b> The first row of the region in the image, in binned pixels (starting from 0).
+ * <li><b>width</b> The number of columns in the region, in binned pixels. The requested region is clipped to
+ *                  the image, so this can be less than the width requested.
+ * <li><b>height</b> The number of rows in the region, in binned pixels. Again this can be less than requested.
+ * <li><b>step</b> The subsampling step: every step'th pixel of every step'th row of the region is returned.
+ * <li><b>detector_x_start</b> The first detector column the region was read out from, in unbinned pixels
+ *                             (starting from 1).
+ * <li><b>detector_y_start</b> The first detector row the region was read out from, in unbinned pixels
+ *                             (starting from 1).
+ * <li><b>detector_x_end</b> The last detector column the region was read out from, in unbinned pixels.
+ * <li><b>detector_y_end</b> The last detector row the region was read out from, in unbinned pixels.
+ * <li><b>xbin</b> The X (horizontal) binning used when the image was read out.
+ * <li><b>ybin</b> The Y (vertical) binning used when the image was read out.
+ * <li><b>frame_sequence</b> The frame sequence number of the image the region was taken from.
+ * </ul>
+ */
+struct ImageRegion
+{
+       1: binary data;
+       2: i32 x_size;
+       3: i32 y_size;
+       4: i32 x0;
+       5: i32 y0;
+       6: i32 width;
+       7: i32 height;
+       8: i32 step;
+       9: i32 detector_x_start;
+       10: i32 detector_y_start;
+       11: i32 detector_x_end;
+       12: i32 detector_y_end;
+       13: i8 xbin;
+       14: i8 ybin;
+       15: i64 frame_sequence;
+}
+
+/**
+ * Enumeration of the codecs get_image_data_compressed can compress image data with, to reduce the bytes sent over
+ * slow links. Every codec is lossless. The image is compressed in tiles (bands of whole rows), which the server
+ * compresses in parallel, each tile being compressed independently.
+ * <ul>
+ * <li><b>NONE</b> No compression. Each tile is the tile's packed little-endian 16-bit unsigned pixels.
+ * <li><b>SHUFFLE_LZ4</b> The tile's pixels are byte shuffled (all the low bytes, followed by all the high bytes),
+ *     and then compressed using the LZ4 block format. Fast, but a lower compression ratio than the others.
+ * <li><b>RICE</b> The tile's pixels are Rice coded, as in FITS tile compression (RICE_1, with a block size of 32,
+ *     and BZERO = 32768, i.e. the pixels have 32768 subtracted before they are coded as signed 16-bit values).
+ * <li><b>SHUFFLE_ZSTD</b> The tile's pixels are byte shuffled, as SHUFFLE_LZ4, and then compressed as a
+ *     Zstandard frame.
+ * </ul>
+ * @see CompressedImageData
+ */
+enum ImageCodec
+{
+	NONE = 0,
+	SHUFFLE_LZ4 = 1,
+	RICE = 2,
+	SHUFFLE_ZSTD = 3
+}
+
+/**
+ * Structure containing compressed image data, returned by get_image_data_compressed.
+ * The image is split into tiles of tile_rows rows (the last tile may have fewer rows), each compressed independently
+ * with the codec, and the compressed tiles are concatenated in order in data.
+ * <ul>
+ * <li><b>codec</b> The ImageCodec the tiles were compressed with.
+ * <li><b>x_size</b> The X (horizontal) dimension of the image data, in binned pixels.
+ * <li><b>y_size</b> The Y (vertical) dimension of the image data, in binned pixels.
+ * <li><b>xbin</b> The X (horizontal) binning used when the image data was read out.
+ * <li><b>ybin</b> The Y (vertical) binning used when the image data was read out.
+ * <li><b>frame_sequence</b> The frame sequence number of the image.
+ * <li><b>tile_rows</b> The number of image rows in each tile.
+ * <li><b>tile_sizes</b> The size of each compressed tile in data, in bytes.
+ * <li><b>data</b> The compressed tiles. Decompressed, each tile is the tile's packed little-endian 16-bit
+ *                 unsigned pixels, row-major order.
+ * </ul>
+ * @see ImageCodec
+ */
+struct CompressedImageData
+{
+       1: ImageCodec codec;
+       2: i32 x_size;
+       3: i32 y_size;
+       4: i8 xbin;
+       5: i8 ybin;
+       6: i64 frame_sequence;
+       7: i32 tile_rows;
+       8: list<i32> tile_sizes;
+       9: binary data;
+}
+
+/**
+ * Enumeration of how get_preview stretches the (downsampled) image into the 0..255 range of the preview.
+ * Pixels at or below the black level become 0, pixels at or above the white level become 255.
+ * <ul>
+ * <li><b>ZSCALE</b> A linear stretch between the IRAF zscale limits, which show the sky background and faint
+ *     objects well, whatever the exposure level.
+ * <li><b>PERCENTILE</b> A linear stretch between the 0.5 and 99.5 percentile pixel values.
+ * <li><b>ASINH</b> An inverse hyperbolic sine stretch from the 0.5 percentile to the maximum pixel value,
+ *     which shows the faint sky and the cores of bright stars in the same preview.
+ * </ul>
+ * @see Preview
+ */
+enum PreviewStretch
+{
+	ZSCALE = 0,
+	PERCENTILE = 1,
+	ASINH = 2
+}
+
+/**
+ * Enumeration of how get_preview downsamples the image, each preview pixel being made from a factor x factor
+ * block of image pixels.
+ * <ul>
+ * <li><b>AVERAGE</b> The mean of the block, which reduces the noise.
+ * <li><b>MAX</b> The maximum of the block, so hot pixels, cosmic rays and small stars do not disappear.
+ * </ul>
+ * @see Preview
+ */
+enum PreviewDownsample
+{
+	AVERAGE = 0,
+	MAX = 1
+}
+
+/**
+ * Enumeration of the formats get_preview can return the preview in.
+ * <ul>
+ * <li><b>RAW</b> The preview's 8-bit pixels, width*height bytes in row-major order.
+ * <li><b>PNG</b> A PNG encoded 8-bit greyscale image.
+ * </ul>
+ * @see Preview
+ */
+enum PreviewFormat
+{
+	RAW = 0,
+	PNG = 1
+}
+
+/**
+ * Structure containing an 8-bit preview of the last image read out by the camera, returned by get_preview.
+ * <ul>
+ * <li><b>data</b> The preview, either raw 8-bit pixels or PNG encoded (see format).
+ * <li><b>width</b> The number of columns in the preview.
+ * <li><b>height</b> The number of rows in the preview.
+ * <li><b>factor</b> The downsampling factor: each preview pixel is made from a factor x factor block of binned
+ *                   image pixels (the blocks on the right and bottom edges may be smaller).
+ * <li><b>format</b> The PreviewFormat of data.
+ * <li><b>black_level</b> The (downsampled) pixel value mapped to 0 in the preview.
+ * <li><b>white_level</b> The (downsampled) pixel value mapped to 255 in the preview.
+ * <li><b>frame_sequence</b> The frame sequence number of the image the preview was made from.
+ * </ul>
+ * @see PreviewStretch
+ * @see PreviewDownsample
+ * @see PreviewFormat
+ */
+struct Preview
+{
+       1: binary data;
+       2: i32 width;
+       3: i32 height;
+       4: i32 factor;
+       5: PreviewFormat format;
+       6: double black_level;
+       7: double white_level;
+       8: i64 frame_sequence;
+}
+
+/**
+ * Structure containing the statistics of a region of an image, computed from the region's histogram.
+ * <ul>
+ * <li><b>name</b> The name of the region ("image" for the whole image).
+ * <li><b>x0</b> The first column of the region in the image, in binned pixels (starting from 0).
+ * <li><b>y0</b> The first row of the region in the image, in binned pixels (starting from 0).
+ * <li><b>width</b> The number of columns in the region. The configured region is clipped to the image, so this
+ *                  can be less than configured (or zero, if the region is outside the image).
+ * <li><b>height</b> The number of rows in the region. Again this can be less than configured.
+ * <li><b>pixel_count</b> The number of pixels in the region. The remaining statistics are zero if this is zero.
+ * <li><b>min</b> The minimum pixel value.
+ * <li><b>max</b> The maximum pixel value.
+ * <li><b>mean</b> The mean pixel value.
+ * <li><b>median</b> The (exact) median pixel value.
+ * <li><b>stddev</b> The (population) standard deviation of the pixel values.
+ * <li><b>saturated_count</b> The number of pixels at or above the saturation level.
+ * </ul>
+ * @see ImageStatistics
+ */
+struct RegionStatistics
+{
+       1: string name;
+       2: i32 x0;
+       3: i32 y0;
+       4: i32 width;
+       5: i32 height;
+       6: i64 pixel_count;
+       7: i32 min;
+       8: i32 max;
+       9: double mean;
+       10: double median;
+       11: double stddev;
+       12: i64 saturated_count;
+}
+
+/**
+ * Structure containing the statistics of a read out image, computed by the camera server as each frame is read out
+ * and returned by get_image_statistics.
+ * <ul>
+ * <li><b>frame_sequence</b> The frame sequence number of the image.
+ * <li><b>saturation_level</b> The pixel value at or above which a pixel is counted as saturated.
+ * <li><b>image</b> The statistics of the whole image.
+ * <li><b>regions</b> The statistics of each region (e.g. an overscan or bias strip) configured in the camera
+ *                    server's config file.
+ * <li><b>histogram</b> The histogram of the whole image: the number of pixels with each value from 0 to 65535.
+ *                      This is empty unless it was asked for.
+ * </ul>
+ * @see RegionStatistics
+ */
+struct ImageStatistics
+{
+       1: i64 frame_sequence;
+       2: i32 saturation_level;
+       3: RegionStatistics image;
+       4: list<RegionStatistics> regions;
+       5: list<i32> histogram;
+}
+
+/**
+ * Structure describing one of the frames held in the camera server's frame history.
+ * <ul>
+ * <li><b>frame_id</b> The frame's id, the same as the frame_sequence number returned in ImageDataBinary.
+ *                     Frame ids increase monotonically.
+ * <li><b>x_size</b> The number of binned columns in the frame.
+ * <li><b>y_size</b> The number of binned rows in the frame.
+ * <li><b>xbin</b> The X (horizontal) binning used when the frame was read out.
+ * <li><b>ybin</b> The Y (vertical) binning used when the frame was read out.
+ * <li><b>exposure_length</b> The exposure length of the frame in milliseconds (zero for a bias).
+ * <li><b>start_time</b> The time the exposure started, in milliseconds since the epoch (1970-01-01T00:00:00 UTC).
+ * <li><b>filename</b> The FITS filename the frame was saved to, or an empty string if it was not (or not yet) saved.
+ * </ul>
+ */
+struct FrameInfo
+{
+	1: i64 frame_id;
+	2: i32 x_size;
+	3: i32 y_size;
+	4: i8 xbin;
+	5: i8 ybin;
+	6: i32 exposure_length;
+	7: i64 start_time;
+	8: string filename;
+}
+
 /**
  * Structure containing the pixel positions of a sub-window to read out.
  * <ul>
@@ -124,9 +426,27 @@ struct CameraWindow
  * <li><b>ccd_temperature</b> In degrees centigrade.
  * <li><b>readout_speed</b> The currently configured readout speed of the camera.
  * <li><b>gain</b> The currently configured gain of the camera.
+ * <li><b>exposure_index</b> The number of frames completed (read out) so far in the current/last 
+ *                           multbias / multdark / multrun.
+ * <li><b>exposure_count</b> The total number of frames to be taken in the current/last multbias / multdark / multrun.
+ * <li><b>duty_cycle</b> The measured duty cycle of the current/last multbias / multdark / multrun: the total measured
+ *                       exposure length of the frames read out so far, divided by the wall clock time since the first
+ *                       frame was started (between 0 and 1).
+ * <li><b>cooler_status</b> The status of the detector cooler, sampled with the ccd_temperature.
+ * <li><b>frame_exposure_length</b> The mean measured exposure length of the frames read out so far in the
+ *                                  current/last multbias / multdark / multrun, in milliseconds (zero for biases).
+ * <li><b>frame_readout_length</b> The mean measured readout length of the frames read out so far in the
+ *                                 current/last multbias / multdark / multrun, in milliseconds.
+ * <li><b>exposure_error</b> The first error that occured acquiring or processing the frames of the current/last 
+ *                           expose / bias / dark / multbias / multdark / multrun, or an empty string if there has
+ *                           been no error. A multbias / multdark / multrun stops taking frames after an error.
  * </ul>
+ * The camera state is sampled in the background by the camera server, so the ccd_temperature / cooler_status
+ * can be up to a sample period old. The elapsed / remaining exposure lengths are computed when the state is 
+ * requested.
  * @see CameraWindow
  * @see ExposureState
+ * @see CoolerStatus
  * @see ReadoutSpeed
  * @see Gain
  */
@@ -144,6 +464,121 @@ struct CameraState
 	10: double ccd_temperature;
 	11: ReadoutSpeed readout_speed;
 	12: Gain gain;
+	13: i32 exposure_index;
+	14: i32 exposure_count;
+	15: double duty_cycle;
+	16: CoolerStatus cooler_status;
+	17: string exposure_error;
+	18: double frame_exposure_length;
+	19: double frame_readout_length;
+}
+
+/**
+ * Enumeration to specify the resolution of the temperature history returned by get_temperature_history.
+ * <ul>
+ * <li><b>RAW</b> Every temperature sample taken by the camera server (one per telemetry period).
+ * <li><b>TEN_SECONDS</b> The samples rolled up into 10 second intervals.
+ * <li><b>ONE_MINUTE</b> The samples rolled up into 1 minute intervals.
+ * </ul>
+ */
+enum TemperatureResolution
+{
+	RAW = 0,
+	TEN_SECONDS = 1,
+	ONE_MINUTE = 2
+}
+
+/**
+ * Structure containing a series of CCD temperature samples, as packed columns of little-endian binary values
+ * (one value per sample in each column, in increasing time order).
+ * <ul>
+ * <li><b>resolution</b> The resolution of the series.
+ * <li><b>sample_count</b> The number of samples in the series.
+ * <li><b>start_time</b> The time of the first sample, in milliseconds since the epoch (1970-01-01T00:00:00 UTC).
+ * <li><b>time_offsets</b> The time of each sample, as unsigned 32-bit offsets in milliseconds from start_time.
+ *     For TEN_SECONDS and ONE_MINUTE samples this is the start of the interval.
+ * <li><b>temperatures</b> The (mean) CCD temperature of each sample, as 32-bit floats, in degrees centigrade.
+ * <li><b>min_temperatures</b> The minimum CCD temperature in each sample's interval, as 32-bit floats. 
+ *     The same as temperatures for RAW samples.
+ * <li><b>max_temperatures</b> The maximum CCD temperature in each sample's interval, as 32-bit floats. 
+ *     The same as temperatures for RAW samples.
+ * <li><b>target_temperatures</b> The cooler's target temperature at each sample (the end of the interval), 
+ *     as 32-bit floats, in degrees centigrade.
+ * <li><b>cooler_status</b> The CoolerStatus at each sample (the end of the interval), one byte per sample.
+ * <li><b>last_time</b> The time of the last sample, in milliseconds since the epoch. This can be passed as
+ *     the since argument of the next get_temperature_history call to just retrieve newer samples.
+ * </ul>
+ * @see TemperatureResolution
+ * @see CoolerStatus
+ */
+struct TemperatureHistory
+{
+	1: TemperatureResolution resolution;
+	2: i32 sample_count;
+	3: i64 start_time;
+	4: binary time_offsets;
+	5: binary temperatures;
+	6: binary min_temperatures;
+	7: binary max_temperatures;
+	8: binary target_temperatures;
+	9: binary cooler_status;
+	10: i64 last_time;
+}
+
+/**
+ * Enumeration of the phases of a frame's acquisition that are time stamped in an ExposureTiming.
+ * <ul>
+ * <li><b>REQUEST</b> The request for the exposure was accepted (for the second and subsequent frames of a
+ *     multrun / multbias / multdark, when the camera server started acquiring the frame).
+ * <li><b>SETUP</b> The shutter and exposure length had been set up.
+ * <li><b>START</b> The acquisition had been started.
+ * <li><b>ACQUIRED</b> The camera reported the acquisition was complete.
+ * <li><b>READOUT</b> The image had been read out of the camera.
+ * <li><b>ORIENT</b> The image had been flipped / rotated into the configured orientation.
+ * <li><b>HEADER</b> The FITS headers for the image had been built.
+ * <li><b>SAVE_OPEN</b> The FITS image file had been opened.
+ * <li><b>SAVE_WRITE</b> The FITS headers and image data had been written.
+ * <li><b>SAVE_CLOSE</b> The FITS image file had been closed.
+ * <li><b>PUBLISHED</b> The image was published to clients: for a saved image, once the FITS image had been
+ *     flushed and renamed into place, otherwise once the image was available to get_image_data.
+ * </ul>
+ * @see ExposureTiming
+ */
+enum ExposureTimingPhase
+{
+	REQUEST = 0,
+	SETUP = 1,
+	START = 2,
+	ACQUIRED = 3,
+	READOUT = 4,
+	ORIENT = 5,
+	HEADER = 6,
+	SAVE_OPEN = 7,
+	SAVE_WRITE = 8,
+	SAVE_CLOSE = 9,
+	PUBLISHED = 10
+}
+
+/**
+ * Structure describing when each phase of a frame's acquisition was reached, returned by get_exposure_timings.
+ * The phases are time stamped with a monotonic clock, so the phase times are not affected by the system clock
+ * being adjusted.
+ * <ul>
+ * <li><b>frame_id</b> The frame sequence number of the frame, as returned in list_frames / get_image_data_binary.
+ * <li><b>exposure_length</b> The exposure length of the frame, in milliseconds (zero for a bias).
+ * <li><b>start_time</b> The start time of the exposure, in milliseconds since the epoch (1970-01-01T00:00:00 UTC).
+ * <li><b>phase_times</b> The time each phase was reached, indexed by ExposureTimingPhase, as an offset in
+ *     microseconds from the REQUEST phase. A phase that was not reached (or does not apply to the frame,
+ *     for instance the save phases of an image that was not saved) has a time of -1.
+ * </ul>
+ * @see ExposureTimingPhase
+ */
+struct ExposureTiming
+{
+	1: i64 frame_id;
+	2: i32 exposure_length;
+	3: i64 start_time;
+	4: list<i64> phase_times;
 }
 
 /**
@@ -167,13 +602,49 @@ exception CameraException
  * <li><b>add_fits_header</b> Add an individual FITS header to the CameraService's internal list, which will be
  *                             be added to the next FITS image genreated by a readout.
  * <li><b>clear_fits_headers</b> Remove all the current FITS headers from the CameraService's internal list.
+ * <li><b>create_fits_header_set</b> Create an immutable FITS header set, containing the CameraService's internal list
+ *     of FITS headers plus a list of FITS headers, and return it's header set id. This allows the headers of a whole
+ *     sequence of exposures to be prepared in advance.
+ * <li><b>delete_fits_header_set</b> Delete a FITS header set created by create_fits_header_set.
   * <li><b>set_exposure_length</b> Set the exposure length (in milliseconds) to use for dark and exposure frames.
  * <li><b>start_expose</b> Start a thread to take a single exposure of a specified exposure length (in ms).
+ * <li><b>start_expose_with_header_set</b> Start a thread to take a single exposure, saving the image with the
+ *     FITS headers in a header set created by create_fits_header_set (a header set id of 0 means the
+ *     CameraService's internal list of FITS headers, as start_expose).
  * <li><b>start_bias</b> Start a thread to take a single bias frame.
  * <li><b>start_dark</b> Start a thread to take a single dark frame of a specified exposure length (in ms).
+ * <li><b>start_multrun</b> Start a thread to take a series of exposures, each of a specified exposure length (in ms).
+ * <li><b>start_multbias</b> Start a thread to take a series of bias frames.
+ * <li><b>start_multdark</b> Start a thread to take a series of dark frames, each of a specified exposure length (in ms).
  * <li><b>abort_exposure</b> Abort (stop) a currently running multbias / multdark / multrun
+ * <li><b>wait_for_exposure</b> Block until the current exposure / multbias / multdark / multrun has read out a frame
+ *     or finished, or a timeout (in ms) expires. Returns false if the timeout expired first. The server limits the
+ *     timeout to the "wait_for_exposure.max_timeout" config value (5000 ms by default), so a waiting client
+ *     only holds one of the server's worker threads for a bounded time. Longer timeouts are shortened to this
+ *     limit (not rejected), so clients wanting to wait longer should call wait_for_exposure again while it
+ *     returns false. If the exposure has finished with an error (see CameraState exposure_error), a
+ *     CameraException containing the error is thrown.
  * <li><b>get_state</b> Get the current state of the camera / configuration / multbias / multdark / multrun.
+ * <li><b>get_temperature_history</b> Get the CCD temperature / cooler status samples taken after a time
+ *     (in milliseconds since the epoch, 0 for all of them) at a specified resolution.
  * <li><b>get_image_data</b> Get a copy of the last image read out by the camera. 
+ * <li><b>get_image_data_binary</b> Get a copy of the last image read out by the camera, as packed little-endian
+ *                                  unsigned 16-bit pixels.
+ * <li><b>get_image_region</b> Get a copy of a region (x0, y0, w, h in binned pixels) of the last image read out by
+ *     the camera, subsampled by taking every step'th pixel, as packed little-endian unsigned 16-bit pixels.
+ * <li><b>get_preview</b> Get an 8-bit preview of the last image read out by the camera, downsampled to fit within
+ *     max_width x max_height pixels and stretched, as raw 8-bit pixels or PNG encoded.
+ * <li><b>get_image_statistics</b> Get the statistics of a frame in the frame history with the specified frame_id
+ *     (or of the last image read out by the camera if frame_id is 0), optionally with the image's histogram.
+ * <li><b>get_image_codecs</b> Get the list of ImageCodec the server can compress image data with.
+ * <li><b>get_image_data_compressed</b> Get a copy of a frame in the frame history with the specified frame_id
+ *     (or of the last image read out by the camera if frame_id is 0), compressed with an ImageCodec.
+ * <li><b>list_frames</b> Get a list describing the frames held in the frame history (the last few frames read out),
+ *     in increasing frame_id order.
+ * <li><b>get_image_data_by_id</b> Get a copy of a frame in the frame history with the specified frame_id, 
+ *     as packed little-endian unsigned 16-bit pixels.
+ * <li><b>get_exposure_timings</b> Get the time each phase of the acquisition of the last few frames was reached,
+ *     in increasing frame_id order.
  * <li><b>get_last_image_filename</b> Get the filename of the last FITS image written to disk.
  * <li><b>cool_down</b> Cool down the camera to it's operating temperature.
  * <li><b>warm_up</b> Warm up the camera to ambient temperature.
@@ -184,6 +655,21 @@ exception CameraException
  * @see FitsHeaderCard
  * @see ExposureType
  * @see CameraState
+ * @see TemperatureResolution
+ * @see TemperatureHistory
+ * @see ImageData
+ * @see ImageDataBinary
+ * @see ImageRegion
+ * @see PreviewStretch
+ * @see PreviewDownsample
+ * @see PreviewFormat
+ * @see Preview
+ * @see RegionStatistics
+ * @see ImageStatistics
+ * @see ImageCodec
+ * @see CompressedImageData
+ * @see FrameInfo
+ * @see ExposureTiming
  */
 service CameraService
 {
@@ -196,13 +682,34 @@ service CameraService
 	void add_fits_header(1: string keyword, 2: FitsCardType valtype,
 	     3: string value,4: string comment) throws (1: CameraException e);
 	void clear_fits_headers() throws (1: CameraException e);
+	i64 create_fits_header_set(1: list<FitsHeaderCard> fits_header) throws (1: CameraException e);
+	void delete_fits_header_set(1: i64 header_set_id) throws (1: CameraException e);
 	void set_exposure_length(1: i32 exposure_length) throws (1: CameraException e);
 	void start_expose(1: bool save_image) throws (1: CameraException e);
+	void start_expose_with_header_set(1: bool save_image, 2: i64 header_set_id) throws (1: CameraException e);
 	void start_bias() throws (1: CameraException e);
 	void start_dark() throws (1: CameraException e);
+	void start_multrun(1: i32 exposure_count, 2: i32 exposure_length, 3: bool save_images) throws (1: CameraException e);
+	void start_multbias(1: i32 exposure_count) throws (1: CameraException e);
+	void start_multdark(1: i32 exposure_count, 2: i32 exposure_length) throws (1: CameraException e);
 	void abort_exposure() throws (1: CameraException e);
+	bool wait_for_exposure(1: i32 timeout_ms) throws (1: CameraException e);
 	CameraState get_state() throws (1: CameraException e);
+	TemperatureHistory get_temperature_history(1: i64 since, 2: TemperatureResolution resolution)
+	     throws (1: CameraException e);
         ImageData get_image_data() throws (1: CameraException e);
+	ImageDataBinary get_image_data_binary() throws (1: CameraException e);
+	ImageRegion get_image_region(1: i32 x0, 2: i32 y0, 3: i32 w, 4: i32 h, 5: i32 step)
+	     throws (1: CameraException e);
+	Preview get_preview(1: i32 max_width, 2: i32 max_height, 3: PreviewStretch stretch,
+	     4: PreviewDownsample downsample, 5: PreviewFormat format) throws (1: CameraException e);
+	ImageStatistics get_image_statistics(1: i64 frame_id, 2: bool include_histogram) throws (1: CameraException e);
+	list<ImageCodec> get_image_codecs() throws (1: CameraException e);
+	CompressedImageData get_image_data_compressed(1: i64 frame_id, 2: ImageCodec codec)
+	     throws (1: CameraException e);
+	list<FrameInfo> list_frames() throws (1: CameraException e);
+	ImageDataBinary get_image_data_by_id(1: i64 frame_id) throws (1: CameraException e);
+	list<ExposureTiming> get_exposure_timings() throws (1: CameraException e);
 	string get_last_image_filename() throws (1: CameraException e);
 	void cool_down() throws (1: CameraException e);
 	void warm_up() throws (1: CameraException e);
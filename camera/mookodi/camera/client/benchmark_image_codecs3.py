@@ -0,0 +1,110 @@
+#!/usr/bin/env python3
+"""
+Command line tool to benchmark the image codecs supported by the MookodiCameraServer's get_image_data_compressed
+call. A bias, a dark and an exposure (sky) frame are taken (by the camera, or the emulator), and each frame is
+downloaded uncompressed using get_image_data_binary, and then with every codec supported by both the server and
+this client. For each download the compression ratio, the time taken by the call (compression on the server plus
+the transfer), the time taken to decompress the image, and the overall latency are printed. The latency over a
+slower link (such as the link between the dome and the control room) is estimated by adding the time taken to
+transfer the compressed bytes at the link speed, which assumes this tool is run close to the server.
+
+./benchmark_image_codecs3.py [--exposure_length <ms>] [--repeat <count>] [--link_speed <Mbit/s>]
+
+Parameters:
+<exposure_length> The exposure length of the dark and sky frames in milliseconds (default 1000).
+<repeat> The number of times each frame is downloaded with each codec, the fastest download is reported
+         (default 3).
+<link_speed> The speed of the link to estimate the latency over, in megabits per second (default 10).
+"""
+import argparse
+import sys
+import time
+from array import array
+from mookodi.camera.client.client import Client
+from mookodi.camera.client.camera_interface.ttypes import ImageCodec
+from mookodi.camera.client.image_codec import supported_codecs, decompress_image
+
+# parse command line arguments
+parser = argparse.ArgumentParser()
+parser.add_argument("--exposure_length", type=int, default=1000,
+                    help="The exposure length of the dark and sky frames in milliseconds.")
+parser.add_argument("--repeat", type=int, default=3, help="The number of times each frame is downloaded.")
+parser.add_argument("--link_speed", type=float, default=10.0,
+                    help="The link speed to estimate the latency over, in megabits per second.")
+args = parser.parse_args()
+
+
+def take_frame(c, frame_type):
+    """
+    Take a bias, dark or sky frame, and wait for it to be read out.
+    """
+    if frame_type == "bias":
+        c.start_bias()
+    elif frame_type == "dark":
+        c.set_exposure_length(args.exposure_length)
+        c.start_dark()
+    else:
+        c.set_exposure_length(args.exposure_length)
+        c.start_expose(False)
+    while c.get_state().exposure_in_progress:
+        c.wait_for_exposure(1000)
+
+
+def download_binary(c):
+    """
+    Download the last image uncompressed, returning the time taken and the pixels.
+    """
+    start_time = time.monotonic()
+    image_data = c.get_image_data_binary()
+    call_time = time.monotonic() - start_time
+    pixel_list = array('H')
+    pixel_list.frombytes(image_data.data)
+    if sys.byteorder == 'big':
+        pixel_list.byteswap()
+    return call_time, pixel_list
+
+
+def download_compressed(c, codec):
+    """
+    Download the last image compressed with a codec, returning the compressed size, the call time,
+    the decompression time and the pixels.
+    """
+    start_time = time.monotonic()
+    compressed = c.get_image_data_compressed(0, codec)
+    call_time = time.monotonic() - start_time
+    pixel_list = decompress_image(compressed)
+    decompress_time = time.monotonic() - start_time - call_time
+    return len(compressed.data), call_time, decompress_time, pixel_list
+
+
+# Create client
+c = Client()
+codecs = [codec for codec in c.get_image_codecs() if codec in supported_codecs()]
+print ("Frame Codec        Ratio   Call(ms) Decompress(ms) Latency(ms) Latency@" + repr(args.link_speed) +
+       "Mbit/s(ms)")
+for frame_type in ["bias", "dark", "sky"]:
+    take_frame(c, frame_type)
+    best_call_time = None
+    for i in range(args.repeat):
+        call_time, pixel_list = download_binary(c)
+        if (best_call_time is None) or (call_time < best_call_time):
+            best_call_time = call_time
+    image_bytes = len(pixel_list) * 2
+    link_time = (image_bytes * 8.0) / (args.link_speed * 1.0e6)
+    print ("{:<6s}{:<13s}{:5.2f}{:11.1f}{:15.1f}{:12.1f}{:20.1f}".format(frame_type, "BINARY", 1.0,
+           best_call_time * 1000.0, 0.0, best_call_time * 1000.0, link_time * 1000.0))
+    for codec in codecs:
+        best = None
+        for i in range(args.repeat):
+            compressed_bytes, call_time, decompress_time, decompressed_pixel_list = download_compressed(c, codec)
+            if decompressed_pixel_list != pixel_list:
+                print ("Codec " + ImageCodec._VALUES_TO_NAMES[codec] + " returned a different " + frame_type +
+                       " image.")
+            if (best is None) or ((call_time + decompress_time) < (best[1] + best[2])):
+                best = (compressed_bytes, call_time, decompress_time)
+        compressed_bytes, call_time, decompress_time = best
+        # over the slow link, the compressed bytes take longer to transfer than measured here
+        link_latency = call_time + decompress_time + ((compressed_bytes * 8.0) / (args.link_speed * 1.0e6))
+        print ("{:<6s}{:<13s}{:5.2f}{:11.1f}{:15.1f}{:12.1f}{:20.1f}".format(frame_type,
+               ImageCodec._VALUES_TO_NAMES[codec], image_bytes / max(compressed_bytes, 1), call_time * 1000.0,
+               decompress_time * 1000.0, (call_time + decompress_time) * 1000.0, link_latency * 1000.0))
@@ -0,0 +1,39 @@
+#!/usr/bin/env python3
+"""
+Command line tool to create a FITS header set on the MookodiCameraServer. The header set contains the server's
+current list of FITS headers plus the specified headers, and does not change when the list is subsequently changed.
+The printed header set id can be passed to start_expose3.py --header_set_id.
+
+./create_fits_header_set3.py [--header <keyword> <type> <value> <comment>]...
+
+Parameters:
+--header adds a FITS header to the header set. <type> is one of: STRING INTEGER DOUBLE.
+"""
+import argparse
+from mookodi.camera.client.client import Client
+from mookodi.camera.client.camera_interface.ttypes import FitsCardType, FitsHeaderCard
+
+
+# parse command line arguments
+parser = argparse.ArgumentParser()
+parser.add_argument("--header", nargs=4, action='append', default=[],
+                    metavar=('KEYWORD', 'TYPE', 'VALUE', 'COMMENT'),
+                    help="Add a FITS header to the header set. TYPE is one of: STRING INTEGER DOUBLE.")
+args = parser.parse_args()
+
+fits_header = []
+for keyword, card_type, value, comment in args.header:
+    if card_type == 'STRING':
+        valtype = FitsCardType.STRING
+    elif card_type == 'DOUBLE':
+        valtype = FitsCardType.FLOAT
+    elif card_type == 'INTEGER':
+        valtype = FitsCardType.INTEGER
+    else:
+        raise Exception('Illegal type ' + card_type + ' specified.')
+    fits_header.append(FitsHeaderCard(key=keyword, valtype=valtype, val=value, comment=comment))
+
+# Create client and create the header set
+c= Client()
+header_set_id = c.create_fits_header_set(fits_header)
+print ("FITS header set id: " + repr(header_set_id))
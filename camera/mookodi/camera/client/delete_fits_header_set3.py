@@ -0,0 +1,17 @@
+#!/usr/bin/env python3
+"""
+Command line tool to delete a FITS header set created by create_fits_header_set3.py.
+
+./delete_fits_header_set3.py <header set id>
+"""
+import argparse
+from mookodi.camera.client.client import Client
+
+# parse command line arguments
+parser = argparse.ArgumentParser()
+parser.add_argument("header_set_id", type=int,help="The header set id returned by create_fits_header_set3.py.")
+args = parser.parse_args()
+
+# Create client and delete the header set
+c= Client()
+c.delete_fits_header_set(args.header_set_id)
@@ -0,0 +1,29 @@
+#!/usr/bin/env python3
+"""
+Command line tool to retrieve the timelines of the last few frames acquired by the MookodiCameraServer, using the
+get_exposure_timings call, and print them out as a table. Each phase is printed as the time in milliseconds since
+the exposure request was accepted, or '-' if the frame did not reach that phase (e.g. unsaved frames).
+
+./get_exposure_timings3.py
+"""
+from datetime import datetime, timezone
+from mookodi.camera.client.client import Client
+from mookodi.camera.client.camera_interface.ttypes import ExposureTimingPhase
+
+# Create client
+c = Client()
+timings = c.get_exposure_timings()
+print ("Returned timings for " + repr(len(timings)) + " frames.")
+phase_names = [ExposureTimingPhase._VALUES_TO_NAMES[phase] for phase in sorted(ExposureTimingPhase._VALUES_TO_NAMES)]
+print (format("FRAME", ">8") + " " + format("EXPTIME", ">8") + " " + format("START", "<26") + " " +
+       " ".join(format(name, ">10") for name in phase_names))
+for timing in timings:
+    start_time = datetime.fromtimestamp(timing.start_time / 1000.0, tz=timezone.utc)
+    phase_times = []
+    for phase_time in timing.phase_times:
+        if phase_time < 0:
+            phase_times.append(format("-", ">10"))
+        else:
+            phase_times.append(format(phase_time / 1000.0, ">10.3f"))
+    print (format(timing.frame_id, ">8") + " " + format(timing.exposure_length, ">8") + " " +
+           format(start_time.isoformat(timespec="milliseconds"), "<26") + " " + " ".join(phase_times))
@@ -0,0 +1,43 @@
+#!/usr/bin/env python3
+"""
+Command line tool to retrieve the last taken image from the MookodiCameraServer's image buffer, using the
+packed binary get_image_data_binary call. Some simple stats are done on the buffer and an attempt is made to display it.
+"""
+import argparse
+import sys
+from array import array
+from PIL import Image
+from mookodi.camera.client.client import Client
+from mookodi.camera.client.camera_interface.ttypes import ImageDataBinary
+
+# parse command line arguments
+parser = argparse.ArgumentParser()
+parser.add_argument("--scale_image", type=int, default=1, help="Scale the pixel values.")
+args = parser.parse_args()
+
+# Create client
+c = Client()
+image_data = c.get_image_data_binary()
+x_size = image_data.x_size
+y_size = image_data.y_size
+print ("Image data has size: X = " + repr(image_data.x_size) + ", Y = "+ repr(image_data.y_size) + ".")
+print ("Image data has binning: X = " + repr(image_data.xbin) + ", Y = "+ repr(image_data.ybin) + ".")
+print ("Image data has frame sequence number " + repr(image_data.frame_sequence) + ".")
+if (image_data.data is not None) and (len(image_data.data) > 0):
+    # The data is packed little-endian unsigned 16-bit pixels
+    pixel_list = array('H')
+    pixel_list.frombytes(image_data.data)
+    if sys.byteorder == 'big':
+        pixel_list.byteswap()
+    print ("Image data has " + repr(len(pixel_list)) + " pixels.")
+    print ("Minimum pixel value is " + repr(min(pixel_list)))
+    print ("Maximum pixel value is " + repr(max(pixel_list)))
+    print ("Mean pixel value is " + repr(sum(pixel_list)/len(pixel_list)))
+    print ("Scale image by " + repr(args.scale_image))
+    # 'I;16' is 16-bit unsigned little-endian, which is what the server returns
+    output_image = Image.frombytes('I;16', (x_size, y_size), image_data.data).convert('I')
+    # rescale to 0..255
+    output_image = output_image.point(lambda pixel_value: pixel_value * args.scale_image * 255 / 65536).convert('L')
+    output_image.show()
+else:
+    print ("There is no image data.")
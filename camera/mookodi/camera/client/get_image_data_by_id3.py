@@ -0,0 +1,38 @@
+#!/usr/bin/env python3
+"""
+Command line tool to retrieve a frame from the MookodiCameraServer's frame history by frame id, using the
+packed binary get_image_data_by_id call. Some simple stats are done on the buffer.
+
+./get_image_data_by_id3.py <frame_id>
+
+Parameters:
+<frame_id> The id of the frame to retrieve, as listed by list_frames3.py.
+"""
+import argparse
+import sys
+from array import array
+from mookodi.camera.client.client import Client
+
+# parse command line arguments
+parser = argparse.ArgumentParser()
+parser.add_argument("frame_id", type=int, help="The id of the frame to retrieve.")
+args = parser.parse_args()
+
+# Create client
+c = Client()
+image_data = c.get_image_data_by_id(args.frame_id)
+print ("Image data has size: X = " + repr(image_data.x_size) + ", Y = "+ repr(image_data.y_size) + ".")
+print ("Image data has binning: X = " + repr(image_data.xbin) + ", Y = "+ repr(image_data.ybin) + ".")
+print ("Image data has frame sequence number " + repr(image_data.frame_sequence) + ".")
+if (image_data.data is not None) and (len(image_data.data) > 0):
+    # The data is packed little-endian unsigned 16-bit pixels
+    pixel_list = array('H')
+    pixel_list.frombytes(image_data.data)
+    if sys.byteorder == 'big':
+        pixel_list.byteswap()
+    print ("Image data has " + repr(len(pixel_list)) + " pixels.")
+    print ("Minimum pixel value is " + repr(min(pixel_list)))
+    print ("Maximum pixel value is " + repr(max(pixel_list)))
+    print ("Mean pixel value is " + repr(sum(pixel_list)/len(pixel_list)))
+else:
+    print ("There is no image data.")
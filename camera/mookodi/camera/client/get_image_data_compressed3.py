@@ -0,0 +1,48 @@
+#!/usr/bin/env python3
+"""
+Command line tool to retrieve an image from the MookodiCameraServer compressed, using the get_image_data_compressed
+call, to reduce the time taken to transfer it over a slow link. The image is decompressed and some simple stats
+are done on it.
+
+./get_image_data_compressed3.py [--frame_id <frame_id>] [--codec <codec>]
+
+Parameters:
+<frame_id> The id of the frame to retrieve, as listed by list_frames3.py (default 0, the last image read out).
+<codec> The codec to compress the image with: NONE, SHUFFLE_LZ4, RICE or SHUFFLE_ZSTD. By default the best codec
+        supported by both the server and this client is used.
+"""
+import argparse
+import time
+from mookodi.camera.client.client import Client
+from mookodi.camera.client.camera_interface.ttypes import ImageCodec
+from mookodi.camera.client.image_codec import choose_codec, decompress_image
+
+# parse command line arguments
+parser = argparse.ArgumentParser()
+parser.add_argument("--frame_id", type=int, default=0, help="The id of the frame to retrieve (0 for the last image).")
+parser.add_argument("--codec", choices=ImageCodec._NAMES_TO_VALUES.keys(), help="The codec to compress the image with.")
+args = parser.parse_args()
+
+# Create client
+c = Client()
+if args.codec is not None:
+    codec = ImageCodec._NAMES_TO_VALUES[args.codec]
+else:
+    codec = choose_codec(c.get_image_codecs())
+start_time = time.monotonic()
+compressed = c.get_image_data_compressed(args.frame_id, codec)
+transfer_time = time.monotonic() - start_time
+pixel_list = decompress_image(compressed)
+decompress_time = time.monotonic() - start_time - transfer_time
+print ("Image data has size: X = " + repr(compressed.x_size) + ", Y = "+ repr(compressed.y_size) + ".")
+print ("Image data has binning: X = " + repr(compressed.xbin) + ", Y = "+ repr(compressed.ybin) + ".")
+print ("Image data has frame sequence number " + repr(compressed.frame_sequence) + ".")
+print ("Image data was compressed with " + ImageCodec._VALUES_TO_NAMES[compressed.codec] + " in " +
+       repr(len(compressed.tile_sizes)) + " tiles of " + repr(compressed.tile_rows) + " rows, to " +
+       repr(len(compressed.data)) + " bytes (ratio " +
+       "{:.2f}".format((len(pixel_list) * 2) / max(len(compressed.data), 1)) + ").")
+print ("Transfer took " + "{:.1f}".format(transfer_time * 1000.0) + " ms, decompression took " +
+       "{:.1f}".format(decompress_time * 1000.0) + " ms.")
+print ("Minimum pixel value is " + repr(min(pixel_list)))
+print ("Maximum pixel value is " + repr(max(pixel_list)))
+print ("Mean pixel value is " + repr(sum(pixel_list)/len(pixel_list)))
@@ -0,0 +1,46 @@
+#!/usr/bin/env python3
+"""
+Command line tool to retrieve a region of the last image read out by the MookodiCameraServer, using the
+get_image_region call, without transferring the whole frame. Some simple stats are done on the region.
+
+./get_image_region3.py <x0> <y0> <w> <h> [--step <step>]
+
+Parameters:
+<x0> <y0> The first column and row of the region, in binned image pixels (starting from 0).
+<w> <h> The width and height of the region, in binned image pixels.
+<step> Optionally subsample the region, returning every step'th pixel of every step'th row (default 1).
+"""
+import argparse
+import sys
+from array import array
+from mookodi.camera.client.client import Client
+
+# parse command line arguments
+parser = argparse.ArgumentParser()
+parser.add_argument("x0", type=int, help="The first column of the region, in binned pixels.")
+parser.add_argument("y0", type=int, help="The first row of the region, in binned pixels.")
+parser.add_argument("w", type=int, help="The width of the region, in binned pixels.")
+parser.add_argument("h", type=int, help="The height of the region, in binned pixels.")
+parser.add_argument("--step", type=int, default=1, help="Return every step'th pixel of every step'th row.")
+args = parser.parse_args()
+
+# Create client
+c = Client()
+region = c.get_image_region(args.x0, args.y0, args.w, args.h, args.step)
+print ("Region has size: X = " + repr(region.x_size) + ", Y = "+ repr(region.y_size) + ".")
+print ("Region covers image pixels X = " + repr(region.x0) + " .. " + repr(region.x0 + region.width - 1) +
+       ", Y = " + repr(region.y0) + " .. " + repr(region.y0 + region.height - 1) + ", step " + repr(region.step) +
+       ".")
+print ("Region was read out from detector pixels X = " + repr(region.detector_x_start) + " .. " +
+       repr(region.detector_x_end) + ", Y = " + repr(region.detector_y_start) + " .. " +
+       repr(region.detector_y_end) + ".")
+print ("Region has binning: X = " + repr(region.xbin) + ", Y = "+ repr(region.ybin) + ".")
+print ("Region has frame sequence number " + repr(region.frame_sequence) + ".")
+# The data is packed little-endian unsigned 16-bit pixels
+pixel_list = array('H')
+pixel_list.frombytes(region.data)
+if sys.byteorder == 'big':
+    pixel_list.byteswap()
+print ("Minimum pixel value is " + repr(min(pixel_list)))
+print ("Maximum pixel value is " + repr(max(pixel_list)))
+print ("Mean pixel value is " + repr(sum(pixel_list)/len(pixel_list)))
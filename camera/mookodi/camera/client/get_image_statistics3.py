@@ -0,0 +1,38 @@
+#!/usr/bin/env python3
+"""
+Command line tool to retrieve the statistics of the last image read out by the MookodiCameraServer (or of a frame
+from the server's frame history), and of each configured statistics region, using the get_image_statistics call,
+and print them out. Optionally the image's histogram is retrieved and saved to a file.
+
+./get_image_statistics3.py [--frame_id <frame_id>] [--histogram <filename>]
+
+Parameters:
+<frame_id> The id of the frame to get the statistics of, as returned by list_frames3.py (default 0, the last image).
+<filename> A file to save the image's histogram in, one "<pixel value> <count>" line for each non-empty bin.
+"""
+import argparse
+from mookodi.camera.client.client import Client
+
+# parse command line arguments
+parser = argparse.ArgumentParser()
+parser.add_argument("--frame_id", type=int, default=0,
+                    help="The id of the frame to get the statistics of, or 0 for the last image.")
+parser.add_argument("--histogram", help="A file to save the image's histogram in.")
+args = parser.parse_args()
+
+# Create client
+c = Client()
+statistics = c.get_image_statistics(args.frame_id, args.histogram is not None)
+print ("Statistics of frame sequence number " + repr(statistics.frame_sequence) + ", saturation level " +
+       repr(statistics.saturation_level) + ":")
+print ("Region     X0    Y0    Width Height Pixels     Min   Max   Mean      Median    StdDev    Saturated")
+for region in [statistics.image] + statistics.regions:
+    print ("{:<10} {:<5} {:<5} {:<5} {:<6} {:<10} {:<5} {:<5} {:<9.2f} {:<9.1f} {:<9.2f} {}".format(
+        region.name, region.x0, region.y0, region.width, region.height, region.pixel_count, region.min, region.max,
+        region.mean, region.median, region.stddev, region.saturated_count))
+if args.histogram is not None:
+    with open(args.histogram, "w") as histogram_file:
+        for value, count in enumerate(statistics.histogram):
+            if count > 0:
+                histogram_file.write(repr(value) + " " + repr(count) + "\n")
+    print ("Histogram saved to " + args.histogram + ".")
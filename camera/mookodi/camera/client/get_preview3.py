@@ -0,0 +1,57 @@
+#!/usr/bin/env python3
+"""
+Command line tool to retrieve an 8-bit preview of the last image read out by the MookodiCameraServer, using the
+get_preview call, and save it to a file. PNG previews are saved as they are returned, RAW previews are saved as
+a binary PGM file.
+
+./get_preview3.py [--max_width <max_width>] [--max_height <max_height>] [--stretch <stretch>]
+                  [--downsample <downsample>] [--format <format>] [--output <filename>]
+
+Parameters:
+<max_width> The maximum number of columns in the preview (default 512).
+<max_height> The maximum number of rows in the preview (default 512).
+<stretch> How to stretch the preview: ZSCALE, PERCENTILE or ASINH (default ZSCALE).
+<downsample> How to downsample the image: AVERAGE or MAX (default AVERAGE).
+<format> The format to retrieve the preview in: RAW or PNG (default PNG).
+<filename> The file to save the preview in (default preview.png or preview.pgm, depending on the format).
+"""
+import argparse
+import time
+from mookodi.camera.client.client import Client
+from mookodi.camera.client.camera_interface.ttypes import PreviewStretch, PreviewDownsample, PreviewFormat
+
+# parse command line arguments
+parser = argparse.ArgumentParser()
+parser.add_argument("--max_width", type=int, default=512, help="The maximum number of columns in the preview.")
+parser.add_argument("--max_height", type=int, default=512, help="The maximum number of rows in the preview.")
+parser.add_argument("--stretch", choices=PreviewStretch._NAMES_TO_VALUES.keys(), default="ZSCALE",
+                    help="How to stretch the preview.")
+parser.add_argument("--downsample", choices=PreviewDownsample._NAMES_TO_VALUES.keys(), default="AVERAGE",
+                    help="How to downsample the image.")
+parser.add_argument("--format", choices=PreviewFormat._NAMES_TO_VALUES.keys(), default="PNG",
+                    help="The format to retrieve the preview in.")
+parser.add_argument("--output", help="The file to save the preview in.")
+args = parser.parse_args()
+
+# Create client
+c = Client()
+start_time = time.monotonic()
+preview = c.get_preview(args.max_width, args.max_height, PreviewStretch._NAMES_TO_VALUES[args.stretch],
+                        PreviewDownsample._NAMES_TO_VALUES[args.downsample],
+                        PreviewFormat._NAMES_TO_VALUES[args.format])
+transfer_time = time.monotonic() - start_time
+print ("Preview has size: X = " + repr(preview.width) + ", Y = " + repr(preview.height) +
+       ", downsampled by a factor of " + repr(preview.factor) + ".")
+print ("Preview has frame sequence number " + repr(preview.frame_sequence) + ".")
+print ("Preview black level is " + repr(preview.black_level) + ", white level is " + repr(preview.white_level) + ".")
+print ("Preview is " + repr(len(preview.data)) + " bytes, and took " + "{:.1f}".format(transfer_time * 1000.0) +
+       " ms.")
+if preview.format == PreviewFormat.PNG:
+    filename = args.output if args.output is not None else "preview.png"
+    data = preview.data
+else:
+    filename = args.output if args.output is not None else "preview.pgm"
+    data = ("P5\n" + repr(preview.width) + " " + repr(preview.height) + "\n255\n").encode("ascii") + preview.data
+with open(filename, "wb") as preview_file:
+    preview_file.write(data)
+print ("Preview saved to " + filename + ".")
@@ -6,6 +6,7 @@ from mookodi.camera.client.client import Client
 from mookodi.camera.client.camera_interface.ttypes import ExposureState
 from mookodi.camera.client.camera_interface.ttypes import ReadoutSpeed
 from mookodi.camera.client.camera_interface.ttypes import Gain
+from mookodi.camera.client.camera_interface.ttypes import CoolerStatus
 
 # Create client
 c= Client()
@@ -19,8 +20,15 @@ print ("Exposure Length:" + repr(s.exposure_length)+ " ms.")
 print ("Elapsed Exposure Length:" + repr(s.elapsed_exposure_length)+ " ms.")
 print ("Remaining Exposure Length:" + repr(s.remaining_exposure_length)+ " ms.")
 print ("Exposure In Progress:" +repr(s.exposure_in_progress)+".")
+print ("Exposure Index:" + repr(s.exposure_index) + " of " + repr(s.exposure_count) + ".")
+print ("Duty Cycle:" + repr(round(s.duty_cycle*100.0,1)) + " %.")
+print ("Frame Exposure Length:" + repr(round(s.frame_exposure_length,1)) + " ms.")
+print ("Frame Readout Length:" + repr(round(s.frame_readout_length,1)) + " ms.")
 print ("Exposure State:"+ ExposureState._VALUES_TO_NAMES[s.exposure_state])
 print ("Exposure State:"+ repr(s.exposure_state))
 print ("CCD Temperature:" + repr(s.ccd_temperature)+ " C.")
+print ("Cooler Status:"+ CoolerStatus._VALUES_TO_NAMES[s.cooler_status])
 print ("Readout Speed:"+ ReadoutSpeed._VALUES_TO_NAMES[s.readout_speed])
 print ("Gain:"+ Gain._VALUES_TO_NAMES[s.gain])
+if s.exposure_error:
+    print ("Exposure Error:" + s.exposure_error)
@@ -0,0 +1,41 @@
+#!/usr/bin/env python3
+"""
+Command line tool to retrieve the CCD temperature history held by the MookodiCameraServer, using the
+get_temperature_history call, and print it out. The history is returned as packed little-endian columns.
+
+./get_temperature_history3.py [--since <ms since the epoch>] [--resolution RAW|TEN_SECONDS|ONE_MINUTE]
+"""
+import argparse
+import struct
+from datetime import datetime, timezone
+from mookodi.camera.client.client import Client
+from mookodi.camera.client.camera_interface.ttypes import TemperatureResolution
+from mookodi.camera.client.camera_interface.ttypes import CoolerStatus
+
+# parse command line arguments
+parser = argparse.ArgumentParser()
+parser.add_argument("--since", type=int, default=0,
+                    help="Only return samples after this time, in milliseconds since the epoch (default all).")
+parser.add_argument("--resolution", default="RAW", choices=TemperatureResolution._NAMES_TO_VALUES.keys(),
+                    help="The resolution of the returned samples.")
+args = parser.parse_args()
+
+# Create client
+c = Client()
+history = c.get_temperature_history(args.since, TemperatureResolution._NAMES_TO_VALUES[args.resolution])
+count = history.sample_count
+print ("Temperature history has " + repr(count) + " " + TemperatureResolution._VALUES_TO_NAMES[history.resolution] +
+       " samples, last sample time " + repr(history.last_time) + ".")
+if count > 0:
+    # The columns are packed little-endian: unsigned 32-bit time offsets (ms), 32-bit floats and status bytes
+    time_offsets = struct.unpack("<%dI" % count, history.time_offsets)
+    temperatures = struct.unpack("<%df" % count, history.temperatures)
+    min_temperatures = struct.unpack("<%df" % count, history.min_temperatures)
+    max_temperatures = struct.unpack("<%df" % count, history.max_temperatures)
+    target_temperatures = struct.unpack("<%df" % count, history.target_temperatures)
+    for i in range(count):
+        sample_time = datetime.fromtimestamp((history.start_time + time_offsets[i]) / 1000.0, tz=timezone.utc)
+        print (sample_time.isoformat() + " " + format(temperatures[i], ".2f") + " C (" +
+               format(min_temperatures[i], ".2f") + " .. " + format(max_temperatures[i], ".2f") + "), target " +
+               format(target_temperatures[i], ".2f") + " C, cooler " +
+               CoolerStatus._VALUES_TO_NAMES[history.cooler_status[i]] + ".")
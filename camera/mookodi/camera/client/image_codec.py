@@ -0,0 +1,219 @@
+"""
+Decoder for the compressed image data returned by the MookodiCameraServer's get_image_data_compressed call.
+
+The server splits the image into tiles of tile_rows rows, compresses each tile independently with an ImageCodec,
+and concatenates the compressed tiles. Decompressed, each tile is the tile's pixels as 16-bit unsigned integers.
+
+* NONE: The tile's packed little-endian pixels.
+* SHUFFLE_LZ4: The tile's pixels byte shuffled (all the low bytes, then all the high bytes), LZ4 block compressed.
+  Decoding needs the lz4 package (pip3 install lz4).
+* RICE: The tile's pixels, minus 32768, Rice coded as in FITS tile compression (RICE_1, block size 32).
+  This is decoded by astropy's Rice decoder if astropy is installed, otherwise by a (slow) pure python decoder.
+* SHUFFLE_ZSTD: The tile's pixels byte shuffled, as a Zstandard frame.
+  Decoding needs the zstandard package (pip3 install zstandard).
+"""
+import sys
+from array import array
+from mookodi.camera.client.camera_interface.ttypes import ImageCodec
+
+try:
+    import lz4.block
+except ImportError:
+    lz4 = None
+try:
+    import zstandard
+except ImportError:
+    zstandard = None
+try:
+    from astropy.io.fits.hdu.compressed._codecs import Rice1
+except ImportError:
+    try:
+        from astropy.io.fits._tiled_compression.codecs import Rice1
+    except ImportError:
+        Rice1 = None
+
+# The block size used by the RICE codec
+RICE_BLOCK_SIZE = 32
+
+
+def supported_codecs():
+    """
+    Return the list of ImageCodec this python installation can decode.
+    """
+    codecs = [ImageCodec.NONE, ImageCodec.RICE]
+    if lz4 is not None:
+        codecs.append(ImageCodec.SHUFFLE_LZ4)
+    if zstandard is not None:
+        codecs.append(ImageCodec.SHUFFLE_ZSTD)
+    return codecs
+
+
+def choose_codec(server_codecs):
+    """
+    Choose the best codec to download images with, from the list of ImageCodec returned by the server's
+    get_image_codecs call: the codec with the best compression ratio that can be decoded quickly.
+    The pure python Rice decoder is too slow to be chosen, although it can still be asked for explicitly.
+    """
+    preferred = [ImageCodec.SHUFFLE_ZSTD]
+    if Rice1 is not None:
+        preferred.append(ImageCodec.RICE)
+    preferred.append(ImageCodec.SHUFFLE_LZ4)
+    for codec in preferred:
+        if (codec in server_codecs) and (codec in supported_codecs()):
+            return codec
+    return ImageCodec.NONE
+
+
+def decompress_image(compressed):
+    """
+    Decompress a CompressedImageData returned by get_image_data_compressed.
+    Returns an array('H') of x_size * y_size pixels (in row-major order, host byte order).
+    Raises a ValueError if the compressed data is malformed, or the codec can not be decoded.
+    """
+    if compressed.codec not in supported_codecs():
+        raise ValueError("Can not decode image codec " + repr(compressed.codec) + ".")
+    if (compressed.x_size < 1) or (compressed.y_size < 1) or (compressed.tile_rows < 1):
+        raise ValueError("Illegal image size " + repr(compressed.x_size) + "x" + repr(compressed.y_size) +
+                         " with " + repr(compressed.tile_rows) + " rows per tile.")
+    tile_count = (compressed.y_size + compressed.tile_rows - 1) // compressed.tile_rows
+    if len(compressed.tile_sizes) != tile_count:
+        raise ValueError("Expected " + repr(tile_count) + " tiles, but there are " +
+                         repr(len(compressed.tile_sizes)) + " tile sizes.")
+    if (min(compressed.tile_sizes) < 0) or (sum(compressed.tile_sizes) != len(compressed.data)):
+        raise ValueError("The tile sizes do not match the " + repr(len(compressed.data)) + " bytes of data.")
+    pixels = array('H')
+    offset = 0
+    for tile_index in range(tile_count):
+        row_count = min(compressed.tile_rows, compressed.y_size - (tile_index * compressed.tile_rows))
+        pixel_count = row_count * compressed.x_size
+        tile = compressed.data[offset:offset + compressed.tile_sizes[tile_index]]
+        offset += compressed.tile_sizes[tile_index]
+        pixels.extend(_decompress_tile(tile, compressed.codec, pixel_count))
+    return pixels
+
+
+def _decompress_tile(tile, codec, pixel_count):
+    """
+    Decompress one tile, returning an array('H') of pixel_count pixels.
+    """
+    byte_count = pixel_count * 2
+    if codec == ImageCodec.NONE:
+        if len(tile) != byte_count:
+            raise ValueError("Uncompressed tile has " + repr(len(tile)) + " bytes, expected " +
+                             repr(byte_count) + ".")
+        return _from_little_endian(tile)
+    if codec == ImageCodec.SHUFFLE_LZ4:
+        try:
+            shuffled = lz4.block.decompress(tile, uncompressed_size=byte_count)
+        except lz4.block.LZ4BlockError as e:
+            raise ValueError("LZ4 failed to decompress a tile: " + str(e))
+        return _unshuffle(shuffled, pixel_count)
+    if codec == ImageCodec.SHUFFLE_ZSTD:
+        try:
+            shuffled = zstandard.ZstdDecompressor().decompress(tile, max_output_size=byte_count)
+        except zstandard.ZstdError as e:
+            raise ValueError("Zstandard failed to decompress a tile: " + str(e))
+        return _unshuffle(shuffled, pixel_count)
+    if Rice1 is not None:
+        # astropy returns the signed (pixel - 32768) values, as native 16-bit integers
+        signed_pixels = Rice1(blocksize=RICE_BLOCK_SIZE, bytepix=2, tilesize=pixel_count).decode(tile)
+        return array('H', (signed_pixels.view('uint16') ^ 0x8000).tobytes())
+    return _rice_decode(tile, pixel_count)
+
+
+def _from_little_endian(data):
+    """
+    Convert packed little-endian 16-bit unsigned pixels into an array('H').
+    """
+    pixels = array('H')
+    pixels.frombytes(data)
+    if sys.byteorder == 'big':
+        pixels.byteswap()
+    return pixels
+
+
+def _unshuffle(shuffled, pixel_count):
+    """
+    Undo the byte shuffle: the first pixel_count bytes are the pixels' low bytes, the rest the high bytes.
+    """
+    if len(shuffled) != pixel_count * 2:
+        raise ValueError("Tile decompressed to " + repr(len(shuffled)) + " bytes, expected " +
+                         repr(pixel_count * 2) + ".")
+    data = bytearray(pixel_count * 2)
+    data[0::2] = shuffled[:pixel_count]
+    data[1::2] = shuffled[pixel_count:]
+    return _from_little_endian(data)
+
+
+def _rice_decode(tile, pixel_count):
+    """
+    Pure python Rice decoder, the same algorithm as CFITSIO's fits_rdecomp_short. The tile starts with the first
+    pixel (16 bits), followed by blocks of RICE_BLOCK_SIZE pixel differences. Each block starts with a 4 bit code:
+    0 means every difference in the block is zero, 15 means each difference is stored in 16 bits, otherwise the
+    code is the number of low bits (fs) stored after each difference's high bits, which are stored in unary.
+    The differences are mapped to unsigned values (0, -1, 1, -2 ... become 0, 1, 2, 3 ...).
+    Finally 32768 is added back to each pixel.
+    """
+    fsbits = 4
+    fsmax = 14
+    bbits = 16
+    pixels = array('H', bytes(pixel_count * 2))
+    try:
+        lastpix = (tile[0] << 8) | tile[1]
+        position = 2
+        # the bit buffer: b holds the nbits bits not yet decoded
+        b = tile[position]
+        position += 1
+        nbits = 8
+        i = 0
+        while i < pixel_count:
+            imax = min(i + RICE_BLOCK_SIZE, pixel_count)
+            nbits -= fsbits
+            while nbits < 0:
+                b = (b << 8) | tile[position]
+                position += 1
+                nbits += 8
+            fs = (b >> nbits) - 1
+            b &= (1 << nbits) - 1
+            if fs < 0:
+                for k in range(i, imax):
+                    pixels[k] = lastpix
+                i = imax
+                continue
+            for k in range(i, imax):
+                if fs == fsmax:
+                    nbits -= bbits
+                    while nbits < 0:
+                        b = (b << 8) | tile[position]
+                        position += 1
+                        nbits += 8
+                    diff = b >> nbits
+                    b &= (1 << nbits) - 1
+                else:
+                    # count the leading zeros of the unary coded high bits
+                    while b == 0:
+                        nbits += 8
+                        b = tile[position]
+                        position += 1
+                    nzero = nbits - b.bit_length()
+                    nbits -= nzero + 1
+                    b ^= 1 << nbits
+                    nbits -= fs
+                    while nbits < 0:
+                        b = (b << 8) | tile[position]
+                        position += 1
+                        nbits += 8
+                    diff = (nzero << fs) | (b >> nbits)
+                    b &= (1 << nbits) - 1
+                if (diff & 1) == 0:
+                    diff = diff >> 1
+                else:
+                    diff = ~(diff >> 1)
+                lastpix = (diff + lastpix) & 0xffff
+                pixels[k] = lastpix
+            i = imax
+    except IndexError:
+        raise ValueError("Rice decoding hit the end of the " + repr(len(tile)) + " byte tile.")
+    for k in range(pixel_count):
+        pixels[k] ^= 0x8000
+    return pixels
@@ -0,0 +1,19 @@
+#!/usr/bin/env python3
+"""
+Command line tool to list the frames currently held in the MookodiCameraServer's frame history.
+Each frame can be retrieved using get_image_data_by_id3.py <frame_id>.
+"""
+from datetime import datetime, timezone
+from mookodi.camera.client.client import Client
+
+# Create client
+c = Client()
+frames = c.list_frames()
+print ("The frame history contains " + repr(len(frames)) + " frames.")
+for frame in frames:
+    start_time = datetime.fromtimestamp(frame.start_time / 1000.0, tz=timezone.utc)
+    print ("Frame " + repr(frame.frame_id) + ": size " + repr(frame.x_size) + " x " + repr(frame.y_size) +
+           ", binning " + repr(frame.xbin) + " x " + repr(frame.ybin) +
+           ", exposure length " + repr(frame.exposure_length) + " ms" +
+           ", started " + start_time.isoformat() +
+           ", filename '" + frame.filename + "'.")
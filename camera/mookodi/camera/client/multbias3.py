@@ -1,10 +1,10 @@
 #!/usr/bin/env python3
 """
 Command line tool to tell MookodiCameraServer to take a series of bias frames.
-The previously configured readout speed, gain, window and binning are used. The command loops over the exposure count,
-calls start_bias() to start the camera taking each bias frame, 
-and then uses get_state() to determine when the bias has been taken,
-and uses get_last_image_filename() to retrieve the FITS image filename generated.
+The previously configured readout speed, gain, window and binning are used. 
+The command calls start_multbias() to start the camera taking the whole series of bias frames in one server thread, 
+and then uses get_state() to monitor the progress of the multbias (exposure_index / exposure_count),
+and uses get_last_image_filename() to retrieve the FITS image filename generated as each bias completes.
 The command returns after MookodiCameraServer has finished taking the bias frames.
 
 ./multbias3.py <exposure count>
@@ -22,14 +22,16 @@ parser = argparse.ArgumentParser()
 parser.add_argument("exposure_count", type=int,help="The number of bias frames to take")
 args = parser.parse_args()
 
-# Create client and loop over start_bias, waiting for each to complete before starting the next
+# Create client and start the multbias, monitoring it until it completes
 c= Client()
-for i in range(args.exposure_count):
-    c.start_bias()
-    done = False
-    while done == False:
-        time.sleep(1)
-        state = c.get_state()
-        done = state.exposure_in_progress == False
-    filename = c.get_last_image_filename()
-    print ("Bias Image "+repr(i)+": "+filename)
+c.start_multbias(args.exposure_count)
+done = False
+last_exposure_index = 0
+while done == False:
+    time.sleep(1)
+    state = c.get_state()
+    if state.exposure_index != last_exposure_index:
+        filename = c.get_last_image_filename()
+        print ("Bias Image "+repr(state.exposure_index-1)+": "+filename)
+        last_exposure_index = state.exposure_index
+    done = state.exposure_in_progress == False
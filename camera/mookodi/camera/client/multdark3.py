@@ -2,10 +2,9 @@
 """
 Command line tool to tell MookodiCameraServer to start taking a series of dark frames.
 The previously configured readout speed, gain, window and binning are used. 
-The command sets the exposure length to use, loops over the exposure count,
-calls start_dark() to start the camera taking each dark frame, 
-and then uses get_state() to determine when the dark has been taken,
-and uses get_last_image_filename() to retrieve the FITS image filename generated. 
+The command calls start_multdark() to start the camera taking the whole series of dark frames in one server thread, 
+and then uses get_state() to monitor the progress of the multdark (exposure_index / exposure_count),
+and uses get_last_image_filename() to retrieve the FITS image filename generated as each dark completes. 
 The command returns after MookodiCameraServer has finished taking the dark frames.
 
 ./multdark3.py <exposure count> <exposure length>
@@ -28,22 +27,23 @@ args = parser.parse_args()
 
 # Create client and start multdark
 c= Client()
-c.set_exposure_length(args.exposure_length)
-for i in range(args.exposure_count):
-    print ("Starting Dark "+repr(i)+" with exposure length "+repr(args.exposure_length))
-    c.start_dark()
-    done = False
-    loop_count = 0
-    while done == False:
-        time.sleep(1)
-        state = c.get_state()
-        if( (loop_count % 10) == 0):
-            print ("Exposure Index:" + repr(i) + " of " + repr(args.exposure_count) + ".")
-            print ("Exposure In Progress:" + repr(state.exposure_in_progress)+ ".")
-            print ("Exposure State:" + ExposureState._VALUES_TO_NAMES[state.exposure_state] + ".")
-            print ("Elapsed Exposure Length:" + repr(state.elapsed_exposure_length)+ " ms.")
-            print ("Remaining Exposure Length:" + repr(state.remaining_exposure_length)+ " ms.")
-        done = state.exposure_in_progress == False
-        loop_count += 1
-    filename = c.get_last_image_filename()
-    print ("Dark Image "+repr(i)+": "+filename)
+print ("Starting multdark of "+repr(args.exposure_count)+" darks with exposure length "+repr(args.exposure_length))
+c.start_multdark(args.exposure_count,args.exposure_length)
+done = False
+loop_count = 0
+last_exposure_index = 0
+while done == False:
+    time.sleep(1)
+    state = c.get_state()
+    if( (loop_count % 10) == 0):
+        print ("Exposure Index:" + repr(state.exposure_index) + " of " + repr(state.exposure_count) + ".")
+        print ("Exposure In Progress:" + repr(state.exposure_in_progress)+ ".")
+        print ("Exposure State:" + ExposureState._VALUES_TO_NAMES[state.exposure_state] + ".")
+        print ("Elapsed Exposure Length:" + repr(state.elapsed_exposure_length)+ " ms.")
+        print ("Remaining Exposure Length:" + repr(state.remaining_exposure_length)+ " ms.")
+    if state.exposure_index != last_exposure_index:
+        filename = c.get_last_image_filename()
+        print ("Dark Image "+repr(state.exposure_index-1)+": "+filename)
+        last_exposure_index = state.exposure_index
+    done = state.exposure_in_progress == False
+    loop_count += 1
@@ -2,10 +2,11 @@
 """
 Command line tool to tell MookodiCameraServer to take a series of exposures.
 The previously configured readout speed, gain, window and binning are used. 
-The command sets the exposure length to use, loops over the exposure count,
-calls start_expose() to start the camera taking each frame, 
-and then uses get_state() to determine when the frame has been taken,
-and uses get_last_image_filename() to retrieve the FITS image filename generated. 
+The command calls start_multrun() to start the camera taking the whole series of frames in one server thread, 
+and then uses get_state() to monitor the progress of the multrun (exposure_index / exposure_count),
+and uses get_last_image_filename() to retrieve the FITS image filename generated as each frame completes. 
+The measured duty cycle (exposure time / wall clock time), and the mean measured exposure and readout length of
+each frame, are printed when the multrun finishes.
 The command returns after MookodiCameraServer has finished taking the images.
 
 ./multrun3.py <exposure count> <exposure length>
@@ -27,22 +28,30 @@ args = parser.parse_args()
 
 # Create client and start multrun
 c= Client()
-c.set_exposure_length(args.exposure_length)
-for i in range(args.exposure_count):
-    print ("Starting image "+repr(i)+" with exposure length "+repr(args.exposure_length))
-    c.start_expose(True)
-    done = False
-    loop_count = 0
-    while done == False:
-        time.sleep(1)
-        state = c.get_state()
-        if( (loop_count % 10) == 0):
-            print ("Exposure Index:" + repr(i) + " of " + repr(args.exposure_count) + ".")
-            print ("Exposure In Progress:" + repr(state.exposure_in_progress)+ ".")
-            print ("Exposure State:" + ExposureState._VALUES_TO_NAMES[state.exposure_state] + ".")
-            print ("Elapsed Exposure Length:" + repr(state.elapsed_exposure_length)+ " ms.")
-            print ("Remaining Exposure Length:" + repr(state.remaining_exposure_length)+ " ms.")
-        done = state.exposure_in_progress == False
-        loop_count += 1
-    filename = c.get_last_image_filename()
-    print ("Image "+repr(i)+": "+filename)
+print ("Starting multrun of "+repr(args.exposure_count)+" images with exposure length "+repr(args.exposure_length))
+c.start_multrun(args.exposure_count,args.exposure_length,True)
+done = False
+loop_count = 0
+last_exposure_index = 0
+while done == False:
+    time.sleep(1)
+    state = c.get_state()
+    if( (loop_count % 10) == 0):
+        print ("Exposure Index:" + repr(state.exposure_index) + " of " + repr(state.exposure_count) + ".")
+        print ("Exposure In Progress:" + repr(state.exposure_in_progress)+ ".")
+        print ("Exposure State:" + ExposureState._VALUES_TO_NAMES[state.exposure_state] + ".")
+        print ("Elapsed Exposure Length:" + repr(state.elapsed_exposure_length)+ " ms.")
+        print ("Remaining Exposure Length:" + repr(state.remaining_exposure_length)+ " ms.")
+        print ("Duty Cycle:" + repr(round(state.duty_cycle*100.0,1)) + " %.")
+    if state.exposure_index != last_exposure_index:
+        filename = c.get_last_image_filename()
+        print ("Image "+repr(state.exposure_index-1)+": "+filename)
+        last_exposure_index = state.exposure_index
+    done = state.exposure_in_progress == False
+    loop_count += 1
+print ("Multrun finished after "+repr(state.exposure_index)+" images with a duty cycle of "+
+       repr(round(state.duty_cycle*100.0,1))+" %.")
+print ("Mean frame exposure length "+repr(round(state.frame_exposure_length,1))+" ms, readout length "+
+       repr(round(state.frame_readout_length,1))+" ms.")
+if state.exposure_error:
+    print ("Multrun failed:" + state.exposure_error)
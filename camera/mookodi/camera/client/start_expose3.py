@@ -2,11 +2,13 @@
 """
 Command line tool to take a single exposure.
 
-./start_expose3.py <exposure length> [--save_image]
+./start_expose3.py <exposure length> [--save_image] [--header_set_id <header set id>]
 
 Parameters:
 <exposure length> is the exposure length in milliseconds.
 --save_image is an optional parameter, that if specified, causes the resulting image to be saved to disk.
+--header_set_id is an optional parameter, the id of a FITS header set created by create_fits_header_set3.py
+  to save the image with. If not specified, the server's current list of FITS headers is used.
 """
 import argparse
 from mookodi.camera.client.client import Client
@@ -15,9 +17,14 @@ from mookodi.camera.client.client import Client
 parser = argparse.ArgumentParser()
 parser.add_argument("exposure_length", type=int,help="The length of the exposure in milliseconds")
 parser.add_argument("--save_image", default=False, action='store_true',help="Save the acquired image in a FITS file.")
+parser.add_argument("--header_set_id", type=int, default=0,
+                    help="The id of a FITS header set (from create_fits_header_set3.py) to save the image with.")
 args = parser.parse_args()
 
 # Create client and start expose
 c= Client()
 c.set_exposure_length(args.exposure_length)
-c.start_expose(args.save_image)
+if args.header_set_id == 0:
+    c.start_expose(args.save_image)
+else:
+    c.start_expose_with_header_set(args.save_image,args.header_set_id)
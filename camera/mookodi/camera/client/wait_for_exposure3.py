@@ -0,0 +1,32 @@
+#!/usr/bin/env python3
+"""
+Command line tool to block until the exposure/multrun currently running on the MookodiCameraServer
+has read out a frame or finished, or the timeout expires. The server limits how long each wait_for_exposure call
+blocks, so we call it again until the timeout has expired.
+
+./wait_for_exposure3.py <timeout>
+
+Parameters:
+<timeout> specifies the maximum length of time to wait in milliseconds.
+"""
+import argparse
+import time
+from mookodi.camera.client.client import Client
+
+# parse command line arguments
+parser = argparse.ArgumentParser()
+parser.add_argument("timeout", type=int,help="The maximum length of time to wait in milliseconds")
+args = parser.parse_args()
+
+# Create client
+c= Client()
+end_time = time.monotonic() + (args.timeout / 1000.0)
+done = c.wait_for_exposure(args.timeout)
+while (not done) and (time.monotonic() < end_time):
+    done = c.wait_for_exposure(max(0, int((end_time - time.monotonic()) * 1000.0)))
+if done:
+    state = c.get_state()
+    print ("Exposure Index:" + repr(state.exposure_index) + " of " + repr(state.exposure_count) + ".")
+    print ("Exposure In Progress:" + repr(state.exposure_in_progress)+ ".")
+else:
+    print ("Timed out after "+repr(args.timeout)+" ms.")
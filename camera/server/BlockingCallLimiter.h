@@ -0,0 +1,115 @@
+/**
+ * @file
+ * @brief BlockingCallLimiter.h declares a counter limiting how many thrift calls that can hold on to a server worker
+ *        thread for a long time (wait_for_exposure, and the full frame image downloads) are in progress at once,
+ *        so some worker threads are always free to serve abort_exposure and get_state.
+ * @author Chris Mottram
+ * @version $Id$
+ */
+#ifndef BLOCKINGCALLLIMITER_H
+#define BLOCKINGCALLLIMITER_H
+#include <atomic>
+
+/**
+ * The default maximum number of blocking calls in progress at once, used if the "server.blocking_call_limit"
+ * config keyword is not present. With the default of 4 server worker threads, this leaves 2 threads free.
+ */
+#define DEFAULT_BLOCKING_CALL_LIMIT (2)
+
+/**
+ * Counts the blocking calls in progress, and refuses to start another once the limit has been reached.
+ * The camera's blocking methods take a slot using a BlockingCallSlot, and fail straight away (rather than queueing
+ * for a worker thread) if none is free. try_acquire / release never block.
+ * @see BlockingCallSlot
+ */
+class BlockingCallLimiter
+{
+  public:
+	/**
+	 * Constructor. The limit is DEFAULT_BLOCKING_CALL_LIMIT until set_limit is called.
+	 * @see #DEFAULT_BLOCKING_CALL_LIMIT
+	 */
+	BlockingCallLimiter() : mLimit(DEFAULT_BLOCKING_CALL_LIMIT), mCount(0) {}
+	BlockingCallLimiter(const BlockingCallLimiter &) = delete;
+	BlockingCallLimiter & operator=(const BlockingCallLimiter &) = delete;
+	/**
+	 * Set the maximum number of blocking calls in progress at once.
+	 * @param limit The limit, at least 1 (smaller limits are set to 1).
+	 */
+	void set_limit(int limit) { mLimit = (limit > 0) ? limit : 1; }
+	/**
+	 * Return the maximum number of blocking calls in progress at once.
+	 */
+	int get_limit() const { return mLimit; }
+	/**
+	 * Return the number of blocking calls in progress. This is only a snapshot.
+	 */
+	int get_count() const { return mCount; }
+	/**
+	 * Try to start a blocking call.
+	 * @return true if the call can go ahead (and release must be called when it finishes), false if the limit
+	 *         has already been reached.
+	 */
+	bool try_acquire()
+	{
+		if(mCount.fetch_add(1)+1 > mLimit)
+		{
+			mCount.fetch_sub(1);
+			return false;
+		}
+		return true;
+	}
+	/**
+	 * Finish a blocking call started with a successful try_acquire.
+	 */
+	void release() { mCount.fetch_sub(1); }
+  private:
+	/**
+	 * The maximum number of blocking calls in progress at once.
+	 */
+	std::atomic<int> mLimit;
+	/**
+	 * The number of blocking calls in progress.
+	 */
+	std::atomic<int> mCount;
+};
+
+/**
+ * Takes a slot in a BlockingCallLimiter for the lifetime of a blocking call, releasing it when it goes out of scope
+ * (including when the call throws an exception).
+ * @see BlockingCallLimiter
+ */
+class BlockingCallSlot
+{
+  public:
+	/**
+	 * Constructor. Try to take a slot in the limiter.
+	 * @param limiter The limiter to take a slot in.
+	 */
+	explicit BlockingCallSlot(BlockingCallLimiter &limiter) : mLimiter(limiter), mAcquired(limiter.try_acquire()) {}
+	BlockingCallSlot(const BlockingCallSlot &) = delete;
+	BlockingCallSlot & operator=(const BlockingCallSlot &) = delete;
+	/**
+	 * Destructor. Release the slot, if one was taken.
+	 */
+	~BlockingCallSlot()
+	{
+		if(mAcquired)
+			mLimiter.release();
+	}
+	/**
+	 * Return whether a slot was taken, i.e. whether the blocking call can go ahead.
+	 */
+	bool acquired() const { return mAcquired; }
+  private:
+	/**
+	 * The limiter the slot was taken in.
+	 */
+	BlockingCallLimiter &mLimiter;
+	/**
+	 * Whether a slot was taken.
+	 */
+	bool mAcquired;
+};
+
+#endif
@@ -7,6 +7,7 @@
  */
 #include "CameraConfig.h"
 #include "Camera.h"
+#include <algorithm>
 #include <thread>
 #include <vector>
 #include <chrono>
@@ -16,13 +17,18 @@
 #include <boost/program_options.hpp>
 #include "log4cxx/logger.h"
 
+#include <errno.h>
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
 
 #include "ccd_exposure.h"
 #include "ccd_fits_filename.h"
 #include "ccd_fits_header.h"
+#include "ccd_fits_writer.h"
+#include "ccd_frame_ring.h"
 #include "ccd_general.h"
+#include "ccd_orientation.h"
 #include "ccd_setup.h"
 #include "ccd_temperature.h"
 
@@ -48,6 +54,61 @@ using namespace log4cxx;
  * The length of an error buffer to use when retrieving errors from the CCD library.
  */
 #define ERROR_BUFFER_LENGTH  (1024)
+/**
+ * The default number of frames to keep in the frame history, used if "frame_history.length" is not configured.
+ */
+#define DEFAULT_FRAME_HISTORY_LENGTH         (8)
+/**
+ * The default amount of memory (in megabytes) the frame history is allowed to use, used if 
+ * "frame_history.memory_budget" is not configured.
+ */
+#define DEFAULT_FRAME_HISTORY_MEMORY_BUDGET  (256)
+
+/**
+ * The default number of image buffers in the buffer pool, in addition to one per frame history entry, 
+ * used if "buffer_pool.spare_count" is not configured. These are used whilst clients are downloading frames.
+ */
+#define DEFAULT_BUFFER_POOL_SPARE_COUNT      (2)
+/**
+ * The default maximum number of images queued to be saved before the exposure threads block, 
+ * used if "fits.writer.queue_length" is not configured.
+ */
+#define DEFAULT_FITS_WRITER_QUEUE_LENGTH     (4)
+/**
+ * The default number of FITS writer threads, used if "fits.writer.thread_count" is not configured.
+ */
+#define DEFAULT_FITS_WRITER_THREAD_COUNT     (1)
+/**
+ * The default number of buffers in the reduced image buffer pool, used if "reduction.buffer_count" is not configured.
+ * A reduced frame is held from when it is reduced until it has been saved, so this is enough for the frame being
+ * reduced, a full FITS writer queue, and one frame being saved by each writer thread.
+ */
+#define DEFAULT_REDUCTION_BUFFER_COUNT       (1+DEFAULT_FITS_WRITER_QUEUE_LENGTH+DEFAULT_FITS_WRITER_THREAD_COUNT)
+/**
+ * The default number of read out frames that can be waiting to be processed (re-oriented, published and saved),
+ * whilst the detector acquires the next frame. Used if "frame_pipeline.length" is not in the config file.
+ */
+#define DEFAULT_FRAME_PIPELINE_LENGTH        (2)
+/**
+ * The maximum number of FITS header sets that can have been created by create_fits_header_set (and not yet deleted)
+ * at once.
+ */
+#define MAX_FITS_HEADER_SET_COUNT            (256)
+/**
+ * The default maximum age of the cached CCD temperature sample used for the CCDTEMP FITS header, in seconds.
+ * Used if "fits.temperature.max_age" is not in the config file.
+ */
+#define DEFAULT_TEMPERATURE_MAX_AGE          (10.0)
+/**
+ * The default period between camera state (telemetry) samples, in milliseconds.
+ * Used if "telemetry.period" is not in the config file.
+ */
+#define DEFAULT_TELEMETRY_PERIOD             (1000)
+/**
+ * The default maximum length of time (in milliseconds) a wait_for_exposure call can block a server worker thread.
+ * Used if "wait_for_exposure.max_timeout" is not in the config file.
+ */
+#define DEFAULT_WAIT_FOR_EXPOSURE_MAX_TIMEOUT (5000)
 
 /**
  * Logger instance for the Andor Camera (Camera.cpp).
@@ -58,19 +119,108 @@ static LoggerPtr logger(Logger::getLogger("mookodi.camera.server.Camera"));
 static void ccd_log_to_log4cxx(char *sub_system,char *source_filename,char *function,
 			   int level,char *category,char *string);
 static void ngatastro_log_to_log4cxx(int level,char *string);
+static void image_buf_to_binary(std::shared_ptr<ImageBuffer> image_buf,ImageDataBinary &img_data);
+static std::string exception_to_error(const std::exception &e);
 
 /**
- * Constructor for the Camera object.
+ * Constructor for the Camera object. We initialise the shared memory frame ring handle, which is not
+ * created until initialize is called (and then only if it is enabled in the config file). We also initialise
+ * the image and reduced image buffer pools, which are created by initialize, and the frame pipeline state
+ * (the processing stage is started by initialize). We create an empty client FITS header set, and start the created header set ids at one.
+ * No exposure series has been started (or has failed) yet.
+ * The telemetry thread is not started until initialize is called.
+ * @see Camera::mFrameRingEnabled
+ * @see Camera::mFrameRing
+ * @see Camera::mBufferPool
+ * @see Camera::mImageBufferAllocationCount
+ * @see Camera::mReducedBufferPool
+ * @see Camera::mReducedImageAllocationCount
+ * @see Camera::mFramePipelineStopping
+ * @see Camera::mFramesPendingCount
+ * @see Camera::mDutyCycle
+ * @see Camera::mFrameExposureLength
+ * @see Camera::mFrameReadoutLength
+ * @see Camera::mExposureSeriesId
+ * @see Camera::mExposureErrorSeriesId
+ * @see Camera::mExposureError
+ * @see Camera::mFitsHeader
+ * @see Camera::mNextFitsHeaderSetId
+ * @see Camera::mTemperatureMaxAge
+ * @see Camera::mTelemetryStopping
+ * @see Camera::mTelemetrySampleRequested
+ * @see Camera::mTelemetryPeriod
+ * @see Camera::mWaitForExposureMaxTimeout
+ * @see Camera::mFitsTimingsEnabled
+ * @see Camera::mFitsStatisticsEnabled
+ * @see Camera::mReductionEnabled
+ * @see Camera::mRequestTime
+ * @see CCD_Frame_Ring_Initialise
+ * @see CCD_Setup_Buffer_Pool_Initialise
  */
 Camera::Camera()
 {
+	mFrameRingEnabled = false;
+	CCD_Frame_Ring_Initialise(&mFrameRing);
+	CCD_Setup_Buffer_Pool_Initialise(&mBufferPool);
+	mImageBufferAllocationCount = 0;
+	CCD_Setup_Buffer_Pool_Initialise(&mReducedBufferPool);
+	mReducedImageAllocationCount = 0;
+	mFramePipelineStopping = false;
+	mFramesPendingCount = 0;
+	mDutyCycle = 0.0;
+	mFrameExposureLength = 0.0;
+	mFrameReadoutLength = 0.0;
+	mExposureSeriesId = 0;
+	mExposureErrorSeriesId = 0;
+	mExposureError = "";
+	mFitsHeader = std::make_shared<FitsHeaderSet>();
+	mNextFitsHeaderSetId = 1;
+	mTemperatureMaxAge = DEFAULT_TEMPERATURE_MAX_AGE;
+	mTelemetryStopping = false;
+	mTelemetrySampleRequested = false;
+	mTelemetryPeriod = DEFAULT_TELEMETRY_PERIOD;
+	mTemperatureHistoryLastTime = 0;
+	mWaitForExposureMaxTimeout = DEFAULT_WAIT_FOR_EXPOSURE_MAX_TIMEOUT;
+	mFitsTimingsEnabled = false;
+	mFitsStatisticsEnabled = false;
+	mReductionEnabled = false;
+	mRequestTime.tv_sec = 0;
+	mRequestTime.tv_nsec = 0;
 }
 
 /**
- * Destructor for the Camera object. Does nothing.
+ * Destructor for the Camera object. We stop the telemetry thread, and then the processing stage (which processes 
+ * any frames already read out), and then the FITS writer queue, which saves any queued images, as the queued frames
+ * and images hold buffers from the image buffer pool.
+ * If the shared memory frame ring was created, we close (and unlink) it.
+ * We release the frame history and last image buffers, returning them to the image buffer pool, and then 
+ * destroy the pool, and the reduced image buffer pool.
+ * @see Camera::mFrameRingEnabled
+ * @see Camera::mFrameRing
+ * @see Camera::mFrameHistory
+ * @see Camera::mImageBuf
+ * @see Camera::mBufferPool
+ * @see Camera::mReducedBufferPool
+ * @see Camera::stop_telemetry
+ * @see Camera::stop_frame_pipeline
+ * @see Camera::mFitsWriterQueue
+ * @see FitsWriterQueue::stop
+ * @see CCD_Frame_Ring_Close
+ * @see CCD_Setup_Buffer_Pool_Destroy
  */
 Camera::~Camera()
 {
+	stop_telemetry();
+	stop_frame_pipeline();
+	mFitsWriterQueue.stop();
+	if(mFrameRingEnabled)
+		CCD_Frame_Ring_Close(&mFrameRing);
+	mFrameHistory.clear();
+	mImageBuf = nullptr;
+	if(!CCD_Setup_Buffer_Pool_Destroy(&mBufferPool))
+		create_ccd_library_exception();
+	if(!CCD_Setup_Buffer_Pool_Destroy(&mReducedBufferPool))
+		create_ccd_library_exception();
 }
 
 /**
@@ -102,21 +252,52 @@ void Camera::set_config(CameraConfig & config)
  *     and the instument component of the data directory "fits.data_dir.instrument",
  *     from the config file values in mCameraConfig, and use them to initialise FITS filename generation using 
  *     CCD_Fits_Filename_Initialise.
- * <li>We initialise the FITS headers (stored in mFitsHeader) using CCD_Fits_Header_Initialise.
+ * <li>We initialise the client FITS headers (mFitsHeader) to a new empty header set, and delete any header sets
+ *     created by create_fits_header_set (mFitsHeaderSets).
  * <li>We setup the cached image data (used to configure the CCD windowing/binning). Some of the
  *     values are read from the config object ("ccd.ncols" / "ccd.nrows").
  * <li>We configure the detector readout dimensions to the cached ones using CCD_Setup_Dimensions.
  * <li>We configure how the read out images are flipped after readout, by retrieving from config the 
  *     "ccd.image.flip.x" / "ccd.image.flip.y" booleans and using CCD_Setup_Set_Flip_X / CCD_Setup_Set_Flip_Y 
  *     to configure the CCD library appropriately.
+ * <li>If the optional "ccd.image.orientation" string is present in the config file, we parse it using 
+ *     CCD_Orientation_Parse (one of none, flip_x, flip_y, rotate_180, transpose, rotate_90, rotate_270 or 
+ *     transverse) and use CCD_Setup_Set_Orientation to configure the CCD library, overriding the flips.
+ * <li>We retrieve the optional maximum age of the cached temperature used for the CCDTEMP FITS header
+ *     ("fits.temperature.max_age", defaulting to DEFAULT_TEMPERATURE_MAX_AGE seconds) into mTemperatureMaxAge.
+ * <li>We call initialize_static_fits_headers and update_camera_fits_headers to precompute the camera FITS headers.
+ * <li>We retrieve the optional maximum length of time a wait_for_exposure call can block 
+ *     ("wait_for_exposure.max_timeout", defaulting to DEFAULT_WAIT_FOR_EXPOSURE_MAX_TIMEOUT milliseconds) into
+ *     mWaitForExposureMaxTimeout.
+ * <li>We retrieve the optional maximum number of blocking calls in progress at once
+ *     ("server.blocking_call_limit", defaulting to DEFAULT_BLOCKING_CALL_LIMIT) and set mBlockingCalls' limit.
  * <li>We initialise mCachedExposureLength to zero.
+ * <li>We initialise mAbort to FALSE, and mExposureIndex / mExposureCount to zero.
  * <li>We initialise mImageBufNCols / mImageBufNRows to zero.
- * <li>We initialise mLastImageFilename to an  empty string.
+ * <li>We initialise mImageBufXBin / mImageBufYBin to one, and mImageFrameSequence to zero.
+ * <li>We initialise mImageBufXStart / mImageBufYStart to one, and mImageBufOrientation to CCD_ORIENTATION_NONE.
+ * <li>We initialise mLastImageFilename to an  empty string, and mLastImageFrameSequence to zero.
+ * <li>We call initialize_frame_ring to create the shared memory frame ring, if it is enabled.
+ * <li>We call initialize_frame_history to preallocate the frame history ring.
+ * <li>We call initialize_exposure_timings to size the ring of frame timelines returned by get_exposure_timings.
+ * <li>We call initialize_image_codecs to configure how get_image_data_compressed compresses images.
+ * <li>We call initialize_preview to configure how many threads get_preview uses.
+ * <li>We call initialize_image_statistics to configure the statistics computed for each read out frame.
+ * <li>We call initialize_reduction to load the master calibration frames, if in-server reduction is enabled.
+ * <li>We call initialize_fits_writer to start the background FITS writer queue.
+ * <li>We call initialize_frame_pipeline to start the processing stage, that processes each frame whilst the 
+ *     next one is being acquired.
+ * <li>We call initialize_telemetry to start the telemetry thread, that samples the camera state for get_state.
  * </ul>
  * If a CCD library routine fails we call create_ccd_library_exception to create a CameraException that is then thrown.
  * @see #CONFIG_CAMERA_SECTION
  * @see Camera::mCameraConfig
  * @see Camera::mFitsHeader
+ * @see Camera::mFitsHeaderSets
+ * @see Camera::mTemperatureMaxAge
+ * @see Camera::mWaitForExposureMaxTimeout
+ * @see Camera::initialize_static_fits_headers
+ * @see Camera::update_camera_fits_headers
  * @see Camera::mCachedNCols
  * @see Camera::mCachedNRows
  * @see Camera::mCachedHBin
@@ -125,11 +306,31 @@ void Camera::set_config(CameraConfig & config)
  * @see Camera::mCachedWindow
  * @see Camera::mCachedExposureLength
  * @see Camera::mExposureInProgress
+ * @see Camera::mAbort
+ * @see Camera::mExposureIndex
+ * @see Camera::mExposureCount
  * @see Camera::mImageBufNCols
  * @see Camera::mImageBufNRows
+ * @see Camera::mImageBufXBin
+ * @see Camera::mImageBufYBin
+ * @see Camera::mImageBufXStart
+ * @see Camera::mImageBufYStart
+ * @see Camera::mImageBufOrientation
+ * @see Camera::mImageFrameSequence
  * @see Camera::mLastImageFilename
+ * @see Camera::mLastImageFrameSequence
  * @see Camera::set_readout_speed
  * @see Camera::set_gain
+ * @see Camera::initialize_frame_ring
+ * @see Camera::initialize_frame_history
+ * @see Camera::initialize_exposure_timings
+ * @see Camera::initialize_image_codecs
+ * @see Camera::initialize_preview
+ * @see Camera::initialize_image_statistics
+ * @see Camera::initialize_reduction
+ * @see Camera::initialize_fits_writer
+ * @see Camera::initialize_frame_pipeline
+ * @see Camera::initialize_telemetry
  * @see Camera::create_ccd_library_exception
  * @see CameraConfig::get_config_string
  * @see CameraConfig::get_config_int
@@ -147,6 +348,8 @@ void Camera::set_config(CameraConfig & config)
  * @see CCD_Setup_Dimensions
  * @see CCD_Setup_Set_Flip_X
  * @see CCD_Setup_Set_Flip_Y
+ * @see CCD_Setup_Set_Orientation
+ * @see CCD_Orientation_Parse
  * @see CCD_Fits_Filename_Initialise
  * @see CCD_Fits_Header_Initialise
  * @see NGAT_Astro_Set_Log_Handler_Function
@@ -161,7 +364,9 @@ void Camera::initialize()
 	char fits_data_dir_telescope[32];
 	char fits_data_dir_instrument[32];
 	char instrument_code[32];
-	int retval,flip_x,flip_y,shutter_open_time,shutter_close_time;
+	char orientation_string[32];
+	enum CCD_ORIENTATION orientation;
+	int retval,flip_x,flip_y,shutter_open_time,shutter_close_time,blocking_call_limit;
 	
 	cout << "Initialising Camera." << endl;
 	LOG4CXX_INFO(logger,"Initialising Camera.");
@@ -215,11 +420,11 @@ void Camera::initialize()
 		throw ce;
 	}
 	/* initialise FITS header data */
-	retval = CCD_Fits_Header_Initialise(&mFitsHeader);
-	if(retval == FALSE)
 	{
-		ce = create_ccd_library_exception();
-		throw ce;
+		std::lock_guard<std::recursive_mutex> fits_header_lock(mFitsHeaderMutex);
+
+		mFitsHeader = std::make_shared<FitsHeaderSet>();
+		mFitsHeaderSets.clear();
 	}
 	/* setup cached image dimension data */
 	mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,"ccd.ncols",&mCachedNCols);
@@ -264,234 +469,1279 @@ void Camera::initialize()
 		ce = create_ccd_library_exception();
 		throw ce;
 	}
+	/* the optional orientation overrides the flips, and allows rotations / transposes */
+	try
+	{
+		mCameraConfig.get_config_string(CONFIG_CAMERA_SECTION,"ccd.image.orientation",orientation_string,32);
+	}
+	catch(CameraException &e)
+	{
+		strcpy(orientation_string,"");
+	}
+	if(strlen(orientation_string) > 0)
+	{
+		retval = CCD_Orientation_Parse(orientation_string,&orientation);
+		if(retval == FALSE)
+		{
+			ce = create_ccd_library_exception();
+			throw ce;
+		}
+		retval = CCD_Setup_Set_Orientation(orientation);
+		if(retval == FALSE)
+		{
+			ce = create_ccd_library_exception();
+			throw ce;
+		}
+		cout << "Read out images will be re-oriented using " << CCD_Orientation_To_String(orientation) <<
+			"." << endl;
+		LOG4CXX_INFO(logger,"Read out images will be re-oriented using " <<
+			     CCD_Orientation_To_String(orientation) << ".");
+	}
+	/* precompute the camera FITS headers */
+	try
+	{
+		mCameraConfig.get_config_double(CONFIG_CAMERA_SECTION,"fits.temperature.max_age",&mTemperatureMaxAge);
+	}
+	catch(CameraException &e)
+	{
+		mTemperatureMaxAge = DEFAULT_TEMPERATURE_MAX_AGE;
+	}
+	initialize_static_fits_headers();
+	update_camera_fits_headers();
+	try
+	{
+		mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,"wait_for_exposure.max_timeout",
+					     &mWaitForExposureMaxTimeout);
+	}
+	catch(CameraException &e)
+	{
+		mWaitForExposureMaxTimeout = DEFAULT_WAIT_FOR_EXPOSURE_MAX_TIMEOUT;
+	}
+	if(mWaitForExposureMaxTimeout < 1)
+		mWaitForExposureMaxTimeout = DEFAULT_WAIT_FOR_EXPOSURE_MAX_TIMEOUT;
+	try
+	{
+		mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,"server.blocking_call_limit",&blocking_call_limit);
+	}
+	catch(CameraException &e)
+	{
+		blocking_call_limit = DEFAULT_BLOCKING_CALL_LIMIT;
+	}
+	if(blocking_call_limit < 1)
+		blocking_call_limit = DEFAULT_BLOCKING_CALL_LIMIT;
+	mBlockingCalls.set_limit(blocking_call_limit);
 	/* initialise camera status variables */
 	mExposureInProgress = FALSE;
+	mAbort = FALSE;
+	mExposureIndex = 0;
+	mExposureCount = 0;
 	mCachedExposureLength = 0;
 	mImageBufNCols = 0;
 	mImageBufNRows = 0;
+	mImageBufXBin = 1;
+	mImageBufYBin = 1;
+	mImageBufXStart = 1;
+	mImageBufYStart = 1;
+	mImageBufOrientation = CCD_ORIENTATION_NONE;
+	mImageFrameSequence = 0;
 	mLastImageFilename = "";
+	mLastImageFrameSequence = 0;
+	/* optionally publish read out frames into shared memory */
+	initialize_frame_ring();
+	/* keep the last few read out frames */
+	initialize_frame_history();
+	/* keep the timelines of the last few frames */
+	initialize_exposure_timings();
+	/* configure image compression for slow links */
+	initialize_image_codecs();
+	/* configure quick look previews */
+	initialize_preview();
+	/* configure the statistics computed for each read out frame */
+	initialize_image_statistics();
+	/* optionally reduce each saved frame with the master calibration frames */
+	initialize_reduction();
+	/* save FITS images in the background */
+	initialize_fits_writer();
+	/* process each read out frame whilst the next one is acquired */
+	initialize_frame_pipeline();
+	/* sample the camera state in the background */
+	initialize_telemetry();
 }
 
 /**
- * Set the binning to use when reading out the CCD.
+ * Create the POSIX shared memory frame ring, that read out frames are published into so co-located
+ * consumers (e.g. a quick-look display or the reduction pipeline) can get them without copying them through thrift.
  * <ul>
- * <li>We set the cached binning variables mCachedHBin and mCachedVBin to the input parameters.
- * <li>We call CCD_Setup_Dimensions with the cached detector binning/window dimensions to configure
- *     the detector to the new dimensions.
+ * <li>We retrieve the "frame_ring.enable" boolean from the config file. If it is not present we treat the
+ *     frame ring as disabled, so older config files still work.
+ * <li>If the frame ring is enabled, we retrieve the shared memory segment name "frame_ring.name" and the
+ *     number of frame slots "frame_ring.slot_count" from the config file.
+ * <li>We close any previously created frame ring (initialize may be called more than once).
+ * <li>We call CCD_Frame_Ring_Create to create the ring, with slots large enough for an unbinned full frame 
+ *     (mCachedNCols x mCachedNRows).
  * </ul>
- * If CCD_Setup_Dimensions fails we call create_ccd_library_exception to create a CameraException that is then thrown.
- * @param xbin The binning to use in the X/horizontal direction. Should be at least 1.
- * @param ybin The binning to use in the Y/vertical direction. Should be at least 1.
+ * If CCD_Frame_Ring_Create fails we call create_ccd_library_exception to create a CameraException that is then thrown.
+ * @see #CONFIG_CAMERA_SECTION
+ * @see Camera::mCameraConfig
  * @see Camera::mCachedNCols
  * @see Camera::mCachedNRows
- * @see Camera::mCachedHBin
- * @see Camera::mCachedVBin
- * @see Camera::mCachedWindowFlags
- * @see Camera::mCachedWindow
+ * @see Camera::mFrameRingEnabled
+ * @see Camera::mFrameRing
  * @see Camera::create_ccd_library_exception
- * @see logger
- * @see LOG4CXX_INFO
- * @see CameraException
- * @see CCD_Setup_Dimensions
+ * @see CameraConfig::get_config_boolean
+ * @see CameraConfig::get_config_string
+ * @see CameraConfig::get_config_int
+ * @see CCD_Frame_Ring_Create
+ * @see CCD_Frame_Ring_Close
  */
-void Camera::set_binning(const int8_t xbin, const int8_t ybin)
+void Camera::initialize_frame_ring()
 {
 	CameraException ce;
-	int retval;
-	
-	cout << "Set binning to " << int(xbin) << ", " << int(ybin) << endl;
-	LOG4CXX_INFO(logger,"Set binning to " << int(xbin) << ", " << int(ybin));
-	mCachedHBin = xbin;
-	mCachedVBin = ybin;
-	cout << "Configure CCD using ncols " << mCachedNCols << ", nrows " << mCachedNRows <<
-		" binning ( " << mCachedHBin << ", " << mCachedVBin <<
-		" ), Use Window " << mCachedWindowFlags <<
-		", Window (" << mCachedWindow.X_Start << "," << mCachedWindow.Y_Start << "," <<
-		mCachedWindow.X_End << "," << mCachedWindow.Y_End << ")." << endl;
-	LOG4CXX_INFO(logger,"Configure CCD using ncols " << mCachedNCols << ", nrows " << mCachedNRows <<
-		" binning ( " << mCachedHBin << ", " << mCachedVBin <<
-		" ), Use Window " << mCachedWindowFlags <<
-		", Window (" << mCachedWindow.X_Start << "," << mCachedWindow.Y_Start << "," <<
-		mCachedWindow.X_End << "," << mCachedWindow.Y_End << ").");
-	retval = CCD_Setup_Dimensions(mCachedNCols,mCachedNRows,mCachedHBin,mCachedVBin,mCachedWindowFlags,
-				      mCachedWindow);
+	char frame_ring_name[CCD_FRAME_RING_NAME_LENGTH];
+	int retval,frame_ring_enable,slot_count;
+
+	if(mFrameRingEnabled)
+	{
+		CCD_Frame_Ring_Close(&mFrameRing);
+		mFrameRingEnabled = false;
+	}
+	try
+	{
+		mCameraConfig.get_config_boolean(CONFIG_CAMERA_SECTION,"frame_ring.enable",&frame_ring_enable);
+	}
+	catch(CameraException &e)
+	{
+		frame_ring_enable = FALSE;
+	}
+	if(frame_ring_enable == FALSE)
+	{
+		cout << "Shared memory frame ring is disabled." << endl;
+		LOG4CXX_INFO(logger,"Shared memory frame ring is disabled.");
+		return;
+	}
+	mCameraConfig.get_config_string(CONFIG_CAMERA_SECTION,"frame_ring.name",frame_ring_name,
+					CCD_FRAME_RING_NAME_LENGTH);
+	mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,"frame_ring.slot_count",&slot_count);
+	cout << "Creating shared memory frame ring " << frame_ring_name << " with " << slot_count << " slots." << endl;
+	LOG4CXX_INFO(logger,"Creating shared memory frame ring " << frame_ring_name << " with " << slot_count <<
+		     " slots.");
+	retval = CCD_Frame_Ring_Create(&mFrameRing,frame_ring_name,slot_count,
+				       ((size_t)mCachedNCols)*((size_t)mCachedNRows));
 	if(retval == FALSE)
 	{
 		ce = create_ccd_library_exception();
 		throw ce;
 	}
+	mFrameRingEnabled = true;
 }
 
 /**
- * Set the window (region of interest) to use when reading out the CCD.
+ * Configure the timelines kept of each frame's acquisition.
  * <ul>
- * <li>We set mCachedWindowFlags to true, to tell CCD_Setup_Dimensions to use the window.
- * <li>We setup the cached window mCachedWindow based on the input parameters.
- * <li>We call CCD_Setup_Dimensions with the cached detector binning/window dimensions to configure
- *     the detector to the new dimensions.
+ * <li>We retrieve the optional "exposure_timings.length" integer from the config file (defaulting to
+ *     EXPOSURE_TIMING_DEFAULT_LENGTH), the number of frame timelines returned by get_exposure_timings, and set the
+ *     length of mExposureTimings (which empties it).
+ * <li>We retrieve the optional "fits.timings.enable" boolean from the config file (defaulting to false) into
+ *     mFitsTimingsEnabled, which determines whether the phase durations are saved as FITS headers.
  * </ul>
- * If CCD_Setup_Dimensions fails we call create_ccd_library_exception to create a CameraException that is then thrown.
- * @param x_start The start X pixel position of the sub-window. Should be at least 1, 
- *        and less than the X size of the detector.
- * @param y_start The start Y pixel position of the sub-window. Should be at least 1, 
- *        and less than the Y size of the detector.
- * @param x_end The end X pixel position of the sub-window. Should be at least 1, 
- *        less than the X size of the detector, and greater than x_start.
- * @param y_end The end Y pixel position of the sub-window. Should be at least 1, 
- *        less than the Y size of the detector, and greater than y_start.
- * @see Camera::mCachedNCols
- * @see Camera::mCachedNRows
- * @see Camera::mCachedHBin
- * @see Camera::mCachedVBin
- * @see Camera::mCachedWindowFlags
- * @see Camera::mCachedWindow
- * @see Camera::create_ccd_library_exception
- * @see logger
- * @see LOG4CXX_INFO
- * @see CameraException
- * @see CCD_Setup_Dimensions
+ * @see #CONFIG_CAMERA_SECTION
+ * @see #EXPOSURE_TIMING_DEFAULT_LENGTH
+ * @see Camera::mCameraConfig
+ * @see Camera::mExposureTimings
+ * @see Camera::mFitsTimingsEnabled
+ * @see CameraConfig::get_config_int
+ * @see CameraConfig::get_config_boolean
+ * @see ExposureTimingRing::set_length
  */
-void Camera::set_window(const int32_t x_start, const int32_t y_start, const int32_t x_end, const int32_t y_end)
+void Camera::initialize_exposure_timings()
 {
-	CameraException ce;
-	int retval;
+	int timings_length,fits_timings_enable;
 
-	cout << "Set window to start position ( " << x_start << ", " << y_start <<
-		" ), end position ( " << x_end << ", " << y_end << " )."<< endl;
-	LOG4CXX_INFO(logger,"Set window to start position ( " << x_start << ", " << y_start <<
-		     " ), end position ( " << x_end << ", " << y_end << " ).");
-	mCachedWindowFlags = true;
-	mCachedWindow.X_Start = x_start;
-	mCachedWindow.Y_Start = y_start;
-	mCachedWindow.X_End = x_end;
-	mCachedWindow.Y_End = y_end;
-	cout << "Configure CCD using ncols " << mCachedNCols << ", nrows " << mCachedNRows <<
-		" binning ( " << mCachedHBin << ", " << mCachedVBin <<
-		" ), Use Window " << mCachedWindowFlags <<
-		", Window (" << mCachedWindow.X_Start << "," << mCachedWindow.Y_Start << "," <<
-		mCachedWindow.X_End << "," << mCachedWindow.Y_End << ")." << endl;
-	LOG4CXX_INFO(logger,"Configure CCD using ncols " << mCachedNCols << ", nrows " << mCachedNRows <<
-		     " binning ( " << mCachedHBin << ", " << mCachedVBin <<
-		     " ), Use Window " << mCachedWindowFlags <<
-		     ", Window (" << mCachedWindow.X_Start << "," << mCachedWindow.Y_Start << "," <<
-		     mCachedWindow.X_End << "," << mCachedWindow.Y_End << ").");
-	retval = CCD_Setup_Dimensions(mCachedNCols,mCachedNRows,mCachedHBin,mCachedVBin,mCachedWindowFlags,
-				      mCachedWindow);
-	if(retval == FALSE)
+	try
 	{
-		ce = create_ccd_library_exception();
-		throw ce;
+		mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,"exposure_timings.length",&timings_length);
+	}
+	catch(CameraException &e)
+	{
+		timings_length = EXPOSURE_TIMING_DEFAULT_LENGTH;
+	}
+	if(timings_length < 1)
+		timings_length = 1;
+	try
+	{
+		mCameraConfig.get_config_boolean(CONFIG_CAMERA_SECTION,"fits.timings.enable",&fits_timings_enable);
+	}
+	catch(CameraException &e)
+	{
+		fits_timings_enable = FALSE;
 	}
+	mFitsTimingsEnabled = (fits_timings_enable == TRUE);
+	cout << "Keeping the timelines of the last " << timings_length << " frames, FITS timing headers " <<
+		(mFitsTimingsEnabled ? "enabled" : "disabled") << "." << endl;
+	LOG4CXX_INFO(logger,"Keeping the timelines of the last " << timings_length << " frames, FITS timing headers " <<
+		     (mFitsTimingsEnabled ? "enabled" : "disabled") << ".");
+	mExposureTimings.set_length(timings_length);
 }
 
 /**
- * Clear a previously set sub-window i.e. re-configure the deterctor to read out full-frame.
+ * Configure how get_image_data_compressed compresses images (mImageCodecConfig).
  * <ul>
- * <li>We set mCachedWindowFlags to false, to tell CCD_Setup_Dimensions to not use the window data.
- * <li>We call CCD_Setup_Dimensions with the cached detector binning/window dimensions to configure
- *     the detector to the new dimensions.
+ * <li>We retrieve the optional "image_codec.tile_rows" integer from the config file (defaulting to
+ *     IMAGE_CODEC_DEFAULT_TILE_ROWS), the number of image rows in each independently compressed tile.
+ * <li>We retrieve the optional "image_codec.thread_count" integer from the config file (defaulting to
+ *     IMAGE_CODEC_DEFAULT_THREAD_COUNT), the number of threads the tiles are compressed by.
+ * <li>We retrieve the optional "image_codec.zstd_level" integer from the config file (defaulting to
+ *     IMAGE_CODEC_DEFAULT_ZSTD_LEVEL), the Zstandard compression level used by the SHUFFLE_ZSTD codec.
  * </ul>
- * If CCD_Setup_Dimensions fails we call create_ccd_library_exception to create a CameraException that is then thrown.
- * @see Camera::mCachedNCols
- * @see Camera::mCachedNRows
- * @see Camera::mCachedHBin
- * @see Camera::mCachedVBin
- * @see Camera::mCachedWindowFlags
- * @see Camera::mCachedWindow
- * @see Camera::create_ccd_library_exception
- * @see logger
- * @see LOG4CXX_INFO
- * @see CCD_Setup_Dimensions
+ * The tile rows and thread count are forced to be at least one.
+ * @see #CONFIG_CAMERA_SECTION
+ * @see #IMAGE_CODEC_DEFAULT_TILE_ROWS
+ * @see #IMAGE_CODEC_DEFAULT_THREAD_COUNT
+ * @see #IMAGE_CODEC_DEFAULT_ZSTD_LEVEL
+ * @see Camera::mCameraConfig
+ * @see Camera::mImageCodecConfig
+ * @see CameraConfig::get_config_int
  */
-void Camera::clear_window()
+void Camera::initialize_image_codecs()
 {
-	CameraException ce;
-	int retval;
-
-	cout << "Clear window." << endl;
-	LOG4CXX_INFO(logger,"Clear window.");
-	mCachedWindowFlags = false;
-	cout << "Configure CCD using ncols " << mCachedNCols << ", nrows " << mCachedNRows <<
-		" binning ( " << mCachedHBin << ", " << mCachedVBin <<
-		" ), Use Window " << mCachedWindowFlags <<
-		", Window (" << mCachedWindow.X_Start << "," << mCachedWindow.Y_Start << "," <<
-		mCachedWindow.X_End << "," << mCachedWindow.Y_End << ")." << endl;
-	LOG4CXX_INFO(logger,"Configure CCD using ncols " << mCachedNCols << ", nrows " << mCachedNRows <<
-		" binning ( " << mCachedHBin << ", " << mCachedVBin <<
-		" ), Use Window " << mCachedWindowFlags <<
-		", Window (" << mCachedWindow.X_Start << "," << mCachedWindow.Y_Start << "," <<
-		     mCachedWindow.X_End << "," << mCachedWindow.Y_End << ").");
-	retval = CCD_Setup_Dimensions(mCachedNCols,mCachedNRows,mCachedHBin,mCachedVBin,mCachedWindowFlags,
-				      mCachedWindow);
-	if(retval == FALSE)
+	try
 	{
-		ce = create_ccd_library_exception();
-		throw ce;
+		mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,"image_codec.tile_rows",
+					     &(mImageCodecConfig.mTileRows));
+	}
+	catch(CameraException &e)
+	{
+		mImageCodecConfig.mTileRows = IMAGE_CODEC_DEFAULT_TILE_ROWS;
+	}
+	try
+	{
+		mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,"image_codec.thread_count",
+					     &(mImageCodecConfig.mThreadCount));
 	}
+	catch(CameraException &e)
+	{
+		mImageCodecConfig.mThreadCount = IMAGE_CODEC_DEFAULT_THREAD_COUNT;
+	}
+	try
+	{
+		mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,"image_codec.zstd_level",
+					     &(mImageCodecConfig.mZstdLevel));
+	}
+	catch(CameraException &e)
+	{
+		mImageCodecConfig.mZstdLevel = IMAGE_CODEC_DEFAULT_ZSTD_LEVEL;
+	}
+	mImageCodecConfig.mTileRows = std::max(mImageCodecConfig.mTileRows,1);
+	mImageCodecConfig.mThreadCount = std::max(mImageCodecConfig.mThreadCount,1);
+	cout << "Compressing images in tiles of " << mImageCodecConfig.mTileRows << " rows using " <<
+		mImageCodecConfig.mThreadCount << " threads, zstd level " << mImageCodecConfig.mZstdLevel << "." << endl;
+	LOG4CXX_INFO(logger,"Compressing images in tiles of " << mImageCodecConfig.mTileRows << " rows using " <<
+		     mImageCodecConfig.mThreadCount << " threads, zstd level " << mImageCodecConfig.mZstdLevel << ".");
 }
 
 /**
- * Set the readout speed of the camera (either SLOW or FAST).
- * <ul>
- * <li>We retrieve the horizontal shift speed index from the config (mCameraConfig), using the camera section key
- *     "ccd.readout_speed.hs_speed_index.SLOW|FAST".
- * <li>We retrieve the vertical shift speed index from the config (mCameraConfig), using the camera section key
- *     "ccd.readout_speed.vs_speed_index.SLOW|FAST".
- * <li>We configure the camera's horizontal shift speed by calling. CCD_Setup_Set_HS_Speed.
- * <li>We configure the camera's vertical shift speed by calling. CCD_Setup_Set_VS_Speed.
- * <li>We update mCachedReadoutSpeed to reflect the newly configured readout speed.
- * </ul>
- * If an error occurs configuring the camera or retrieving the config, a CameraException is thrown.
- * @param speed The readout speed, of type ReadoutSpeed.
- * @see Camera::mCameraConfig
- * @see Camera::mCachedReadoutSpeed
+ * Configure how get_preview renders previews. We retrieve the optional "preview.thread_count" integer from the
+ * config file (defaulting to IMAGE_PREVIEW_DEFAULT_THREAD_COUNT), the number of threads used to downsample and
+ * stretch an image, into mPreviewThreadCount, which is forced to be at least one.
  * @see #CONFIG_CAMERA_SECTION
- * @see Camera::create_ccd_library_exception
- * @see logger
- * @see LOG4CXX_INFO
- * @see LOG4CXX_DEBUG
- * @see ReadoutSpeed
- * @see CCD_Setup_Set_HS_Speed
- * @see CCD_Setup_Set_VS_Speed
+ * @see #IMAGE_PREVIEW_DEFAULT_THREAD_COUNT
+ * @see Camera::mCameraConfig
+ * @see Camera::mPreviewThreadCount
+ * @see CameraConfig::get_config_int
  */
-void Camera::set_readout_speed(const ReadoutSpeed::type speed)
+void Camera::initialize_preview()
 {
-	CameraException ce;
-	std::string keyword;
-	int retval;
-	int hs_speed_index,vs_speed_index;
-	
-	cout << "Set readout speed to " << to_string(speed) << "." << endl;
-	LOG4CXX_INFO(logger,"Set readout speed to " << to_string(speed) << ".");
-	/* Get the horizontal and vertical shift speeds configured for this readout speed */
-	keyword = "ccd.readout_speed.hs_speed_index."+to_string(speed);
-	mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,keyword.c_str(),&hs_speed_index);
-	keyword = "ccd.readout_speed.vs_speed_index."+to_string(speed);
-	mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,keyword.c_str(),&vs_speed_index);
-	/* configure the camera appropriately */
-	LOG4CXX_DEBUG(logger,"Using horizontal shift speed index " << std::to_string(hs_speed_index) << ".");
-	retval = CCD_Setup_Set_HS_Speed(hs_speed_index);
-	if(retval == FALSE)
+	try
 	{
-		ce = create_ccd_library_exception();
-		throw ce;
+		mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,"preview.thread_count",&mPreviewThreadCount);
 	}
-	LOG4CXX_DEBUG(logger,"Using vertical shift speed index " << std::to_string(vs_speed_index) << ".");
-	retval = CCD_Setup_Set_VS_Speed(vs_speed_index);
-	if(retval == FALSE)
+	catch(CameraException &e)
 	{
-		ce = create_ccd_library_exception();
-		throw ce;
+		mPreviewThreadCount = IMAGE_PREVIEW_DEFAULT_THREAD_COUNT;
 	}
-	/* we update the cached value, used for status */
-	mCachedReadoutSpeed = speed;
-	LOG4CXX_INFO(logger,"Readout speed set to " << to_string(speed) << ".");
+	mPreviewThreadCount = std::max(mPreviewThreadCount,1);
+	cout << "Rendering previews using " << mPreviewThreadCount << " threads." << endl;
+	LOG4CXX_INFO(logger,"Rendering previews using " << mPreviewThreadCount << " threads.");
 }
 
 /**
- * Set the gain of the camera.
+ * Configure how the statistics of each read out frame are computed (mFrameStatisticsConfig), and whether they are
+ * saved as FITS headers.
  * <ul>
- * <li>We convert the gain_number gain factor to a pre amp gain index as follows (for an Andor iKon M934);
+ * <li>We retrieve the optional "image_statistics.thread_count" integer from the config file (defaulting to
+ *     FRAME_STATISTICS_DEFAULT_THREAD_COUNT), the number of threads a frame is histogrammed by, which is forced to
+ *     be at least one.
+ * <li>We retrieve the optional "image_statistics.saturation_level" integer from the config file (defaulting to
+ *     FRAME_STATISTICS_DEFAULT_SATURATION_LEVEL), the pixel value at or above which a pixel is counted as saturated.
+ * <li>We retrieve up to FRAME_STATISTICS_MAX_REGION_COUNT regions (e.g. the overscan) to compute statistics of,
+ *     numbered from 1. For each region we retrieve the "image_statistics.region.<n>.name" string, stopping at the
+ *     first region without a name, and the "image_statistics.region.<n>.x0", "image_statistics.region.<n>.y0",
+ *     "image_statistics.region.<n>.width" and "image_statistics.region.<n>.height" integers, which are required.
+ *     The region is in binned pixels of the re-oriented image (starting from 0), and is clipped to each image.
+ * <li>We retrieve the optional "fits.statistics.enable" boolean from the config file (defaulting to false) into
+ *     mFitsStatisticsEnabled, which determines whether the statistics are saved as FITS headers.
+ * </ul>
+ * @see #CONFIG_CAMERA_SECTION
+ * @see #FRAME_STATISTICS_DEFAULT_THREAD_COUNT
+ * @see #FRAME_STATISTICS_DEFAULT_SATURATION_LEVEL
+ * @see #FRAME_STATISTICS_MAX_REGION_COUNT
+ * @see Camera::mCameraConfig
+ * @see Camera::mFrameStatisticsConfig
+ * @see Camera::mFitsStatisticsEnabled
+ * @see CameraConfig::get_config_string
+ * @see CameraConfig::get_config_int
+ * @see CameraConfig::get_config_boolean
+ */
+void Camera::initialize_image_statistics()
+{
+	FrameStatisticsRegion region;
+	std::string keyword_root;
+	char region_name[32];
+	int fits_statistics_enable;
+
+	try
+	{
+		mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,"image_statistics.thread_count",
+					     &(mFrameStatisticsConfig.mThreadCount));
+	}
+	catch(CameraException &e)
+	{
+		mFrameStatisticsConfig.mThreadCount = FRAME_STATISTICS_DEFAULT_THREAD_COUNT;
+	}
+	mFrameStatisticsConfig.mThreadCount = std::max(mFrameStatisticsConfig.mThreadCount,1);
+	try
+	{
+		mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,"image_statistics.saturation_level",
+					     &(mFrameStatisticsConfig.mSaturationLevel));
+	}
+	catch(CameraException &e)
+	{
+		mFrameStatisticsConfig.mSaturationLevel = FRAME_STATISTICS_DEFAULT_SATURATION_LEVEL;
+	}
+	mFrameStatisticsConfig.mRegions.clear();
+	for(int region_number = 1; region_number <= FRAME_STATISTICS_MAX_REGION_COUNT; region_number++)
+	{
+		keyword_root = "image_statistics.region."+std::to_string(region_number)+".";
+		try
+		{
+			mCameraConfig.get_config_string(CONFIG_CAMERA_SECTION,(keyword_root+"name").c_str(),region_name,32);
+		}
+		catch(CameraException &e)
+		{
+			break;
+		}
+		region.mName = region_name;
+		mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,(keyword_root+"x0").c_str(),&(region.mX0));
+		mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,(keyword_root+"y0").c_str(),&(region.mY0));
+		mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,(keyword_root+"width").c_str(),&(region.mWidth));
+		mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,(keyword_root+"height").c_str(),&(region.mHeight));
+		mFrameStatisticsConfig.mRegions.push_back(region);
+		cout << "Computing the statistics of region " << region_number << " (" << region.mName << ") at " <<
+			region.mX0 << "," << region.mY0 << " of size " << region.mWidth << "x" << region.mHeight << "." <<
+			endl;
+		LOG4CXX_INFO(logger,"Computing the statistics of region " << region_number << " (" << region.mName <<
+			     ") at " << region.mX0 << "," << region.mY0 << " of size " << region.mWidth << "x" <<
+			     region.mHeight << ".");
+	}
+	try
+	{
+		mCameraConfig.get_config_boolean(CONFIG_CAMERA_SECTION,"fits.statistics.enable",&fits_statistics_enable);
+	}
+	catch(CameraException &e)
+	{
+		fits_statistics_enable = FALSE;
+	}
+	mFitsStatisticsEnabled = (fits_statistics_enable == TRUE);
+	cout << "Computing frame statistics using " << mFrameStatisticsConfig.mThreadCount <<
+		" threads, saturation level " << mFrameStatisticsConfig.mSaturationLevel << ", FITS statistics headers " <<
+		(mFitsStatisticsEnabled ? "enabled" : "disabled") << "." << endl;
+	LOG4CXX_INFO(logger,"Computing frame statistics using " << mFrameStatisticsConfig.mThreadCount <<
+		     " threads, saturation level " << mFrameStatisticsConfig.mSaturationLevel <<
+		     ", FITS statistics headers " << (mFitsStatisticsEnabled ? "enabled" : "disabled") << ".");
+}
+
+/**
+ * Configure the optional in-server reduction stage, which applies the basic CCD reductions (master bias
+ * subtraction, exposure-scaled dark subtraction and flat field division) to each saved open shutter frame, and
+ * saves the reduced frame alongside the raw one. This does in the processing stage what
+ * ReductionController.reduce_ccd_image does in the pipelines, without re-reading the raw FITS image.
+ * <ul>
+ * <li>We retrieve the optional "reduction.enable" boolean from the config file (defaulting to false) into
+ *     mReductionEnabled. If reduction is not enabled, we return.
+ * <li>We retrieve the optional "reduction.thread_count" integer from the config file (defaulting to
+ *     FRAME_REDUCTION_DEFAULT_THREAD_COUNT).
+ * <li>We retrieve the "reduction.bias", "reduction.dark" and "reduction.flat" master frame filenames from the
+ *     config file, which are required when reduction is enabled.
+ * <li>We load the master frames into mFrameCalibration using frame_reduction_load_calibration. If they cannot be
+ *     loaded we throw a CameraException.
+ * <li>We start the reduction worker pool mReductionPool with that many threads, so frames are reduced without 
+ *     creating threads.
+ * <li>We retrieve the optional "reduction.buffer_count" integer from the config file (defaulting to
+ *     DEFAULT_REDUCTION_BUFFER_COUNT, and forced to be at least one), and call initialize_buffer_pool to create
+ *     mReducedBufferPool with that many buffers, each large enough to hold a full frame reduced image.
+ * </ul>
+ * @see #CONFIG_CAMERA_SECTION
+ * @see #DEFAULT_REDUCTION_BUFFER_COUNT
+ * @see #FRAME_REDUCTION_POOL_BUFFER_LENGTH
+ * @see #FRAME_REDUCTION_DEFAULT_THREAD_COUNT
+ * @see Camera::mCameraConfig
+ * @see Camera::mReductionEnabled
+ * @see Camera::mReductionPool
+ * @see Camera::mFrameCalibration
+ * @see Camera::mReducedBufferPool
+ * @see Camera::mCachedNCols
+ * @see Camera::mCachedNRows
+ * @see Camera::initialize_buffer_pool
+ * @see CameraConfig::get_config_string
+ * @see CameraConfig::get_config_int
+ * @see CameraConfig::get_config_boolean
+ * @see frame_reduction_load_calibration
+ * @see FrameReductionPool::start
+ */
+void Camera::initialize_reduction()
+{
+	CameraException ce;
+	std::string error_message;
+	char bias_filename[256];
+	char dark_filename[256];
+	char flat_filename[256];
+	int reduction_enable,thread_count,buffer_count;
+
+	try
+	{
+		mCameraConfig.get_config_boolean(CONFIG_CAMERA_SECTION,"reduction.enable",&reduction_enable);
+	}
+	catch(CameraException &e)
+	{
+		reduction_enable = FALSE;
+	}
+	mReductionEnabled = (reduction_enable == TRUE);
+	if(!mReductionEnabled)
+	{
+		cout << "In-server frame reduction disabled." << endl;
+		LOG4CXX_INFO(logger,"In-server frame reduction disabled.");
+		return;
+	}
+	try
+	{
+		mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,"reduction.thread_count",&thread_count);
+	}
+	catch(CameraException &e)
+	{
+		thread_count = FRAME_REDUCTION_DEFAULT_THREAD_COUNT;
+	}
+	mCameraConfig.get_config_string(CONFIG_CAMERA_SECTION,"reduction.bias",bias_filename,256);
+	mCameraConfig.get_config_string(CONFIG_CAMERA_SECTION,"reduction.dark",dark_filename,256);
+	mCameraConfig.get_config_string(CONFIG_CAMERA_SECTION,"reduction.flat",flat_filename,256);
+	if(!frame_reduction_load_calibration(bias_filename,dark_filename,flat_filename,mFrameCalibration,
+					     error_message))
+	{
+		ce.message = "Failed to load the master calibration frames:"+error_message;
+		LOG4CXX_ERROR(logger,"initialize_reduction:" << ce.message);
+		throw ce;
+	}
+	mReductionPool.start(thread_count);
+	cout << "Reducing saved frames using " << mReductionPool.get_thread_count() << " threads, with master bias " <<
+		bias_filename << ", dark " << dark_filename << " (" << mFrameCalibration.mDarkExposureLength <<
+		" s) and flat " << flat_filename << " of size " << mFrameCalibration.mNCols << "x" <<
+		mFrameCalibration.mNRows << "." << endl;
+	LOG4CXX_INFO(logger,"Reducing saved frames using " << mReductionPool.get_thread_count() <<
+		     " threads, with master bias " << bias_filename << ", dark " << dark_filename << " (" <<
+		     mFrameCalibration.mDarkExposureLength << " s) and flat " << flat_filename << " of size " <<
+		     mFrameCalibration.mNCols << "x" << mFrameCalibration.mNRows << ".");
+	try
+	{
+		mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,"reduction.buffer_count",&buffer_count);
+	}
+	catch(CameraException &e)
+	{
+		buffer_count = DEFAULT_REDUCTION_BUFFER_COUNT;
+	}
+	buffer_count = std::max(buffer_count,1);
+	initialize_buffer_pool(&mReducedBufferPool,"reduced image",buffer_count,
+			       FRAME_REDUCTION_POOL_BUFFER_LENGTH(((size_t)mCachedNCols)*((size_t)mCachedNRows)));
+}
+
+/**
+ * Start the FITS writer queue (mFitsWriterQueue), whose writer threads save the images queued by the frame
+ * processing stage using queue_fits_image, so the camera can start the next exposure whilst the last one is written
+ * to disk.
+ * <ul>
+ * <li>We retrieve the optional "fits.native_writer" boolean from the config file (defaulting to false), which selects
+ *     whether images are saved with the CCD library's native FITS writer (CCD_Fits_Writer_Save) or CFITSIO
+ *     (CCD_Exposure_Save).
+ * <li>We retrieve the optional "fits.writer.queue_length" and "fits.writer.thread_count" integers from the config
+ *     file, defaulting to DEFAULT_FITS_WRITER_QUEUE_LENGTH / DEFAULT_FITS_WRITER_THREAD_COUNT.
+ * <li>We retrieve the optional "fits.writer.sync" string from the config file (defaulting to "file"), and parse it
+ *     using FitsWriterQueue::sync_policy_from_string. This determines whether each image (and it's directory) is
+ *     flushed to disk before it is published.
+ * <li>Several writer threads can only use CFITSIO at once if it was built reentrant. CFITSIO is used to save the
+ *     images unless the native writer is selected, and always to save reduced images (mReductionEnabled). If either
+ *     applies, more than one writer thread is configured, and fits_is_reentrant says CFITSIO is not reentrant,
+ *     we log a warning and use one writer thread.
+ * <li>We stop any previously started writer threads (initialize may be called more than once), which saves 
+ *     any queued images.
+ * <li>We start the writer threads, with a publish callback that calls set_last_image_filename, so
+ *     get_last_image_filename only ever returns the filename of a completely written FITS image. The callback then
+ *     time stamps the published phase of the image's timeline (which the writer thread has added the save phases
+ *     to), and merges it into the frame's timeline in mExposureTimings.
+ * </ul>
+ * If the sync policy is not recognised a CameraException is thrown.
+ * @see #CONFIG_CAMERA_SECTION
+ * @see #DEFAULT_FITS_WRITER_QUEUE_LENGTH
+ * @see #DEFAULT_FITS_WRITER_THREAD_COUNT
+ * @see Camera::mCameraConfig
+ * @see Camera::mFitsWriterQueue
+ * @see Camera::mReductionEnabled
+ * @see Camera::set_last_image_filename
+ * @see Camera::mExposureTimings
+ * @see CameraConfig::get_config_boolean
+ * @see CameraConfig::get_config_int
+ * @see CameraConfig::get_config_string
+ * @see FitsWriterQueue::sync_policy_from_string
+ * @see ExposureTimingRing::merge_timeline
+ * @see CCD_Exposure_Timeline_Mark
+ * @see FitsWriterQueue::stop
+ * @see FitsWriterQueue::start
+ */
+void Camera::initialize_fits_writer()
+{
+	CameraException ce;
+	enum FitsWriterSyncPolicy sync_policy;
+	char sync_policy_string[32];
+	int native_writer,queue_length,thread_count;
+
+	try
+	{
+		mCameraConfig.get_config_boolean(CONFIG_CAMERA_SECTION,"fits.native_writer",&native_writer);
+	}
+	catch(CameraException &e)
+	{
+		native_writer = FALSE;
+	}
+	try
+	{
+		mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,"fits.writer.queue_length",&queue_length);
+	}
+	catch(CameraException &e)
+	{
+		queue_length = DEFAULT_FITS_WRITER_QUEUE_LENGTH;
+	}
+	try
+	{
+		mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,"fits.writer.thread_count",&thread_count);
+	}
+	catch(CameraException &e)
+	{
+		thread_count = DEFAULT_FITS_WRITER_THREAD_COUNT;
+	}
+	try
+	{
+		mCameraConfig.get_config_string(CONFIG_CAMERA_SECTION,"fits.writer.sync",sync_policy_string,32);
+	}
+	catch(CameraException &e)
+	{
+		strcpy(sync_policy_string,"file");
+	}
+	if(!FitsWriterQueue::sync_policy_from_string(sync_policy_string,&sync_policy))
+	{
+		ce.message = std::string("Illegal fits.writer.sync policy '")+sync_policy_string+
+			"' (should be none, file or directory).";
+		LOG4CXX_ERROR(logger,"initialize_fits_writer:" << ce.message);
+		throw ce;
+	}
+	if((queue_length < 1)||(thread_count < 1))
+	{
+		ce.message = "Illegal fits.writer.queue_length (" + std::to_string(queue_length) +
+			") or fits.writer.thread_count (" + std::to_string(thread_count) + ").";
+		LOG4CXX_ERROR(logger,"initialize_fits_writer:" << ce.message);
+		throw ce;
+	}
+	if((thread_count > 1)&&((native_writer == FALSE)||mReductionEnabled)&&(fits_is_reentrant() == 0))
+	{
+		cout << "CFITSIO is not reentrant: using one FITS writer thread rather than " << thread_count << "." <<
+			endl;
+		LOG4CXX_WARN(logger,"initialize_fits_writer:CFITSIO is not reentrant: using one FITS writer thread "
+			     "rather than " << thread_count << ".");
+		thread_count = 1;
+	}
+	cout << "Saving FITS images using " << ((native_writer == TRUE) ? "the native FITS writer" : "CFITSIO") <<
+		" with sync policy " << sync_policy_string << "." << endl;
+	LOG4CXX_INFO(logger,"Saving FITS images using " <<
+		     ((native_writer == TRUE) ? "the native FITS writer" : "CFITSIO") <<
+		     " with sync policy " << sync_policy_string << ".");
+	mFitsWriterQueue.stop();
+	mFitsWriterQueue.start(queue_length,thread_count,sync_policy,(native_writer == TRUE),
+			       [this](const std::string &filename,int64_t frame_sequence,
+				      const struct CCD_Exposure_Timeline_Struct &timeline)
+			       {
+				       struct CCD_Exposure_Timeline_Struct published_timeline = timeline;
+
+				       set_last_image_filename(filename.c_str(),frame_sequence);
+				       CCD_Exposure_Timeline_Mark(&published_timeline,CCD_EXPOSURE_TIMELINE_PUBLISHED);
+				       mExposureTimings.merge_timeline(frame_sequence,published_timeline);
+			       });
+}
+
+/**
+ * Start the processing stage of the frame pipeline. The exposure threads (the acquisition stage) only drive the
+ * detector: as soon as a frame has been read out they hand it to the processing stage (frame_processing_thread)
+ * through the lock-free single-producer / single-consumer queue mFramePipeline, and start acquiring the next frame
+ * into another image buffer. The processing stage re-orients, publishes and saves each frame at the same time.
+ * <ul>
+ * <li>We retrieve the optional "frame_pipeline.length" integer from the config file (defaulting to
+ *     DEFAULT_FRAME_PIPELINE_LENGTH), the number of read out frames that can be waiting to be processed before
+ *     the acquisition stage blocks.
+ * <li>We call CCD_Exposure_Defer_Orientation_Set, so the CCD library leaves re-orienting the read out
+ *     images to the processing stage.
+ * <li>We stop any previously started processing stage (initialize may be called more than once) using
+ *     stop_frame_pipeline.
+ * <li>We create mFramePipeline, and initialise the mFramePipelineFree / mFramePipelineFilled semaphores
+ *     used to block the stages when the queue is full / empty.
+ * <li>We start mFrameProcessingThread running frame_processing_thread.
+ * </ul>
+ * If the pipeline length is illegal or a semaphore cannot be created a CameraException is thrown.
+ * @see #CONFIG_CAMERA_SECTION
+ * @see #DEFAULT_FRAME_PIPELINE_LENGTH
+ * @see Camera::mCameraConfig
+ * @see Camera::mFramePipeline
+ * @see Camera::mFramePipelineFree
+ * @see Camera::mFramePipelineFilled
+ * @see Camera::mFramePipelineStopping
+ * @see Camera::mFramesPendingCount
+ * @see Camera::mFrameProcessingThread
+ * @see Camera::stop_frame_pipeline
+ * @see Camera::frame_processing_thread
+ * @see Camera::create_ccd_library_exception
+ * @see CameraConfig::get_config_int
+ * @see CCD_Exposure_Defer_Orientation_Set
+ */
+void Camera::initialize_frame_pipeline()
+{
+	CameraException ce;
+	int pipeline_length;
+
+	try
+	{
+		mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,"frame_pipeline.length",&pipeline_length);
+	}
+	catch(CameraException &e)
+	{
+		pipeline_length = DEFAULT_FRAME_PIPELINE_LENGTH;
+	}
+	if(pipeline_length < 1)
+	{
+		ce.message = "Illegal frame_pipeline.length (" + std::to_string(pipeline_length) + ").";
+		LOG4CXX_ERROR(logger,"initialize_frame_pipeline:" << ce.message);
+		throw ce;
+	}
+	if(!CCD_Exposure_Defer_Orientation_Set(TRUE))
+	{
+		ce = create_ccd_library_exception();
+		throw ce;
+	}
+	stop_frame_pipeline();
+	mFramePipeline.reset(new SpscQueue<AcquiredFrame>(pipeline_length));
+	if(sem_init(&mFramePipelineFree,0,pipeline_length) != 0)
+	{
+		ce.message = std::string("Failed to create frame pipeline semaphore:") + strerror(errno);
+		LOG4CXX_ERROR(logger,"initialize_frame_pipeline:" << ce.message);
+		throw ce;
+	}
+	if(sem_init(&mFramePipelineFilled,0,0) != 0)
+	{
+		ce.message = std::string("Failed to create frame pipeline semaphore:") + strerror(errno);
+		LOG4CXX_ERROR(logger,"initialize_frame_pipeline:" << ce.message);
+		sem_destroy(&mFramePipelineFree);
+		throw ce;
+	}
+	mFramePipelineStopping = false;
+	mFramesPendingCount = 0;
+	mFrameProcessingThread = std::thread(&Camera::frame_processing_thread,this);
+	cout << "Processing read out frames on a separate thread, with up to " << pipeline_length <<
+		" frames waiting to be processed." << endl;
+	LOG4CXX_INFO(logger,"Processing read out frames on a separate thread, with up to " << pipeline_length <<
+		     " frames waiting to be processed.");
+}
+
+/**
+ * Stop the processing stage of the frame pipeline, if it has been started. This must only be called when
+ * no exposure thread is running.
+ * <ul>
+ * <li>We set mFramePipelineStopping, and post mFramePipelineFilled to wake frame_processing_thread.
+ *     It processes any frames left in mFramePipeline before exiting.
+ * <li>We join mFrameProcessingThread.
+ * <li>We destroy the semaphores and mFramePipeline.
+ * </ul>
+ * @see Camera::mFramePipeline
+ * @see Camera::mFramePipelineFree
+ * @see Camera::mFramePipelineFilled
+ * @see Camera::mFramePipelineStopping
+ * @see Camera::mFrameProcessingThread
+ * @see Camera::frame_processing_thread
+ */
+void Camera::stop_frame_pipeline()
+{
+	if(!mFrameProcessingThread.joinable())
+		return;
+	mFramePipelineStopping = true;
+	sem_post(&mFramePipelineFilled);
+	mFrameProcessingThread.join();
+	sem_destroy(&mFramePipelineFree);
+	sem_destroy(&mFramePipelineFilled);
+	mFramePipeline.reset();
+}
+
+/**
+ * Start the telemetry thread, that samples the camera state for get_state.
+ * <ul>
+ * <li>We retrieve the period between samples in milliseconds, "telemetry.period", from the config file.
+ *     If it is not present we use DEFAULT_TELEMETRY_PERIOD.
+ * <li>We stop any previously started telemetry thread (initialize may be called more than once).
+ * <li>We take the first sample using sample_camera_state, so get_state has a sample as soon as we return.
+ * <li>We start mTelemetryThread running telemetry_thread.
+ * </ul>
+ * @see #DEFAULT_TELEMETRY_PERIOD
+ * @see #CONFIG_CAMERA_SECTION
+ * @see Camera::mCameraConfig
+ * @see Camera::mTelemetryPeriod
+ * @see Camera::mTelemetryStopping
+ * @see Camera::mTelemetrySampleRequested
+ * @see Camera::mTelemetryThread
+ * @see Camera::stop_telemetry
+ * @see Camera::sample_camera_state
+ * @see Camera::telemetry_thread
+ * @see CameraConfig::get_config_int
+ */
+void Camera::initialize_telemetry()
+{
+	CameraException ce;
+	int telemetry_period;
+
+	try
+	{
+		mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,"telemetry.period",&telemetry_period);
+	}
+	catch(CameraException &e)
+	{
+		telemetry_period = DEFAULT_TELEMETRY_PERIOD;
+	}
+	if(telemetry_period < 1)
+	{
+		ce.message = "Illegal telemetry.period (" + std::to_string(telemetry_period) + ").";
+		LOG4CXX_ERROR(logger,"initialize_telemetry:" << ce.message);
+		throw ce;
+	}
+	stop_telemetry();
+	mTelemetryPeriod = telemetry_period;
+	mTelemetryStopping = false;
+	mTelemetrySampleRequested = false;
+	sample_camera_state(true);
+	mTelemetryThread = std::thread(&Camera::telemetry_thread,this);
+	cout << "Sampling the camera state every " << mTelemetryPeriod << " ms." << endl;
+	LOG4CXX_INFO(logger,"Sampling the camera state every " << mTelemetryPeriod << " ms.");
+}
+
+/**
+ * Stop the telemetry thread, if it has been started. We set mTelemetryStopping (whilst holding mTelemetryMutex),
+ * signal mTelemetryCondition to wake the thread, and join it.
+ * @see Camera::mTelemetryThread
+ * @see Camera::mTelemetryMutex
+ * @see Camera::mTelemetryCondition
+ * @see Camera::mTelemetryStopping
+ */
+void Camera::stop_telemetry()
+{
+	if(!mTelemetryThread.joinable())
+		return;
+	{
+		std::lock_guard<std::mutex> lock(mTelemetryMutex);
+		mTelemetryStopping = true;
+	}
+	mTelemetryCondition.notify_all();
+	mTelemetryThread.join();
+}
+
+/**
+ * Preallocate the frame history ring, which keeps the last few read out frames so clients can retrieve them
+ * using get_image_data_by_id.
+ * <ul>
+ * <li>We retrieve the number of frames to keep, "frame_history.length", and the maximum amount of memory 
+ *     in megabytes the history can use, "frame_history.memory_budget", from the config file. 
+ *     If they are not present we use DEFAULT_FRAME_HISTORY_LENGTH / DEFAULT_FRAME_HISTORY_MEMORY_BUDGET.
+ * <li>We reduce the number of frames if an unbinned full frame (mCachedNCols x mCachedNRows) 
+ *     times the number of frames exceeds the memory budget. We always keep at least one frame.
+ * <li>We lock mImageBufMutex, and clear mFrameHistory, returning it's buffers to the image buffer pool.
+ * <li>We call initialize_buffer_pool to create a pool of full frame image buffers, with one buffer for each
+ *     frame in the history and "buffer_pool.spare_count" (or DEFAULT_BUFFER_POOL_SPARE_COUNT) spare buffers for 
+ *     use whilst clients are downloading frames.
+ * <li>We lock mImageBufMutex.
+ * <li>We resize mFrameHistory to the number of frames, and take a full frame image buffer for each entry out of
+ *     the pool using allocate_image_buffer. Each entry's frame_id is set to zero (empty).
+ * <li>We reset mFrameHistoryIndex to zero.
+ * </ul>
+ * @see #DEFAULT_FRAME_HISTORY_LENGTH
+ * @see #DEFAULT_FRAME_HISTORY_MEMORY_BUDGET
+ * @see #DEFAULT_BUFFER_POOL_SPARE_COUNT
+ * @see #CONFIG_CAMERA_SECTION
+ * @see Camera::mCameraConfig
+ * @see Camera::mCachedNCols
+ * @see Camera::mCachedNRows
+ * @see Camera::mImageBufMutex
+ * @see Camera::mFrameHistory
+ * @see Camera::mFrameHistoryIndex
+ * @see Camera::initialize_buffer_pool
+ * @see Camera::allocate_image_buffer
+ * @see CameraConfig::get_config_int
+ */
+void Camera::initialize_frame_history()
+{
+	size_t frame_length,max_history_length;
+	int history_length,memory_budget,spare_count;
+
+	try
+	{
+		mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,"frame_history.length",&history_length);
+	}
+	catch(CameraException &e)
+	{
+		history_length = DEFAULT_FRAME_HISTORY_LENGTH;
+	}
+	try
+	{
+		mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,"frame_history.memory_budget",&memory_budget);
+	}
+	catch(CameraException &e)
+	{
+		memory_budget = DEFAULT_FRAME_HISTORY_MEMORY_BUDGET;
+	}
+	try
+	{
+		mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,"buffer_pool.spare_count",&spare_count);
+	}
+	catch(CameraException &e)
+	{
+		spare_count = DEFAULT_BUFFER_POOL_SPARE_COUNT;
+	}
+	if(spare_count < 0)
+		spare_count = 0;
+	frame_length = ((size_t)mCachedNCols)*((size_t)mCachedNRows);
+	max_history_length = (((size_t)memory_budget)*1024*1024)/(frame_length*sizeof(uint16_t));
+	if(((size_t)history_length) > max_history_length)
+		history_length = max_history_length;
+	if(history_length < 1)
+		history_length = 1;
+	cout << "Allocating a frame history of " << history_length << " frames of " << frame_length << 
+		" pixels (memory budget " << memory_budget << " Mb)." << endl;
+	LOG4CXX_INFO(logger,"Allocating a frame history of " << history_length << " frames of " << frame_length << 
+		     " pixels (memory budget " << memory_budget << " Mb).");
+	{
+		std::lock_guard<std::mutex> lock(mImageBufMutex);
+
+		mFrameHistory.clear();
+	}
+	initialize_buffer_pool(&mBufferPool,"image",history_length+spare_count,frame_length);
+	{
+		std::lock_guard<std::mutex> lock(mImageBufMutex);
+
+		mFrameHistory.resize(history_length);
+		for(FrameHistoryEntry &entry : mFrameHistory)
+		{
+			entry.mInfo.frame_id = 0;
+			entry.mImageBuf = allocate_image_buffer();
+		}
+		mFrameHistoryIndex = 0;
+	}
+}
+
+/**
+ * Create a pool of image buffers: the pool of image buffers the exposure threads read out into (mBufferPool), or the
+ * pool of buffers the processing stage reduces frames into (mReducedBufferPool).
+ * <ul>
+ * <li>We retrieve the "buffer_pool.huge_pages" and "buffer_pool.lock" booleans from the config file, 
+ *     defaulting to false and true respectively if they are not present.
+ * <li>If the pool has already been created (initialize may be called more than once), we try to destroy it
+ *     using CCD_Setup_Buffer_Pool_Destroy. If some of it's buffers are still in use (e.g. the last image, a
+ *     client download, or a reduced frame still being saved) we keep the existing pool.
+ * <li>We create the pool using CCD_Setup_Buffer_Pool_Create, with CCD_SETUP_BUFFER_POOL_FLAG_HUGE_PAGE / 
+ *     CCD_SETUP_BUFFER_POOL_FLAG_LOCK set from the config.
+ * </ul>
+ * If CCD_Setup_Buffer_Pool_Create fails we call create_ccd_library_exception to create a CameraException that
+ * is then thrown.
+ * @param pool The pool to create.
+ * @param description A description of the pool's buffers, to log.
+ * @param buffer_count The number of buffers in the pool.
+ * @param buffer_pixel_count The number of (unsigned short) pixels in each buffer, normally an unbinned full frame,
+ *        so any binning or window can be read out into the buffers.
+ * @see #CONFIG_CAMERA_SECTION
+ * @see Camera::mCameraConfig
+ * @see Camera::mBufferPool
+ * @see Camera::mReducedBufferPool
+ * @see Camera::create_ccd_library_exception
+ * @see CameraConfig::get_config_boolean
+ * @see CCD_Setup_Buffer_Pool_Destroy
+ * @see CCD_Setup_Buffer_Pool_Create
+ * @see logger
+ * @see LOG4CXX_INFO
+ * @see LOG4CXX_WARN
+ */
+void Camera::initialize_buffer_pool(struct CCD_Setup_Buffer_Pool_Struct *pool,const char *description,
+				    int buffer_count,size_t buffer_pixel_count)
+{
+	CameraException ce;
+	int huge_pages,lock_pages,flags;
+
+	try
+	{
+		mCameraConfig.get_config_boolean(CONFIG_CAMERA_SECTION,"buffer_pool.huge_pages",&huge_pages);
+	}
+	catch(CameraException &e)
+	{
+		huge_pages = FALSE;
+	}
+	try
+	{
+		mCameraConfig.get_config_boolean(CONFIG_CAMERA_SECTION,"buffer_pool.lock",&lock_pages);
+	}
+	catch(CameraException &e)
+	{
+		lock_pages = TRUE;
+	}
+	if(pool->Memory != NULL)
+	{
+		if(!CCD_Setup_Buffer_Pool_Destroy(pool))
+		{
+			ce = create_ccd_library_exception();
+			cerr << "Keeping the existing " << description << " buffer pool:" << ce.message << endl;
+			LOG4CXX_WARN(logger,"Keeping the existing " << description << " buffer pool:" << ce.message);
+			return;
+		}
+	}
+	flags = 0;
+	if(huge_pages)
+		flags |= CCD_SETUP_BUFFER_POOL_FLAG_HUGE_PAGE;
+	if(lock_pages)
+		flags |= CCD_SETUP_BUFFER_POOL_FLAG_LOCK;
+	if(!CCD_Setup_Buffer_Pool_Create(pool,buffer_count,buffer_pixel_count,flags))
+	{
+		ce = create_ccd_library_exception();
+		throw ce;
+	}
+	cout << "Created the " << description << " buffer pool of " << buffer_count << " buffers of " <<
+		buffer_pixel_count << " pixels (huge pages " << pool->Is_Huge_Page << ", locked " << pool->Is_Locked <<
+		")." << endl;
+	LOG4CXX_INFO(logger,"Created the " << description << " buffer pool of " << buffer_count << " buffers of " <<
+		     buffer_pixel_count << " pixels (huge pages " << pool->Is_Huge_Page << ", locked " <<
+		     pool->Is_Locked << ").");
+}
+
+/**
+ * Set the binning to use when reading out the CCD.
+ * <ul>
+ * <li>We lock mExposureMutex, so the setup cannot be changed by two thrift threads at once, or whilst an
+ *     exposure is being started. If an exposure is in progress we throw an exception, as the detector
+ *     dimensions / speeds cannot be changed whilst it is exposing.
+ * <li>We set the cached binning variables mCachedHBin and mCachedVBin to the input parameters.
+ * <li>We call CCD_Setup_Dimensions with the cached detector binning/window dimensions to configure
+ *     the detector to the new dimensions.
+ * <li>We call update_camera_fits_headers to recompute the camera FITS headers for the new dimensions.
+ * <li>We release mExposureMutex, and call sample_camera_state to publish the new setup to get_state.
+ * </ul>
+ * If CCD_Setup_Dimensions fails we call create_ccd_library_exception to create a CameraException that is then thrown.
+ * @param xbin The binning to use in the X/horizontal direction. Should be at least 1.
+ * @param ybin The binning to use in the Y/vertical direction. Should be at least 1.
+ * @see Camera::mCachedNCols
+ * @see Camera::mCachedNRows
+ * @see Camera::mCachedHBin
+ * @see Camera::mCachedVBin
+ * @see Camera::mCachedWindowFlags
+ * @see Camera::mCachedWindow
+ * @see Camera::create_ccd_library_exception
+ * @see logger
+ * @see LOG4CXX_INFO
+ * @see Camera::update_camera_fits_headers
+ * @see Camera::sample_camera_state
+ * @see CameraException
+ * @see CCD_Setup_Dimensions
+ * @see Camera::mExposureMutex
+ * @see Camera::mExposureInProgress
+ */
+void Camera::set_binning(const int8_t xbin, const int8_t ybin)
+{
+	CameraException ce;
+	int retval;
+	
+	cout << "Set binning to " << int(xbin) << ", " << int(ybin) << endl;
+	LOG4CXX_INFO(logger,"Set binning to " << int(xbin) << ", " << int(ybin));
+	{
+		std::lock_guard<std::mutex> lock(mExposureMutex);
+
+		if(mExposureInProgress == TRUE)
+		{
+			ce.message = "set_binning failed: Exposure in progress.";
+			LOG4CXX_ERROR(logger,"set_binning: Throwing exception:" + ce.message);
+			throw ce;
+		}
+		mCachedHBin = xbin;
+		mCachedVBin = ybin;
+		cout << "Configure CCD using ncols " << mCachedNCols << ", nrows " << mCachedNRows <<
+			" binning ( " << mCachedHBin << ", " << mCachedVBin <<
+			" ), Use Window " << mCachedWindowFlags <<
+			", Window (" << mCachedWindow.X_Start << "," << mCachedWindow.Y_Start << "," <<
+			mCachedWindow.X_End << "," << mCachedWindow.Y_End << ")." << endl;
+		LOG4CXX_INFO(logger,"Configure CCD using ncols " << mCachedNCols << ", nrows " << mCachedNRows <<
+			" binning ( " << mCachedHBin << ", " << mCachedVBin <<
+			" ), Use Window " << mCachedWindowFlags <<
+			", Window (" << mCachedWindow.X_Start << "," << mCachedWindow.Y_Start << "," <<
+			mCachedWindow.X_End << "," << mCachedWindow.Y_End << ").");
+		retval = CCD_Setup_Dimensions(mCachedNCols,mCachedNRows,mCachedHBin,mCachedVBin,
+					      mCachedWindowFlags,mCachedWindow);
+		if(retval == FALSE)
+		{
+			ce = create_ccd_library_exception();
+			throw ce;
+		}
+		update_camera_fits_headers();
+	}
+	sample_camera_state(false);
+}
+
+/**
+ * Set the window (region of interest) to use when reading out the CCD.
+ * <ul>
+ * <li>We lock mExposureMutex, so the setup cannot be changed by two thrift threads at once, or whilst an
+ *     exposure is being started. If an exposure is in progress we throw an exception, as the detector
+ *     dimensions / speeds cannot be changed whilst it is exposing.
+ * <li>We set mCachedWindowFlags to true, to tell CCD_Setup_Dimensions to use the window.
+ * <li>We setup the cached window mCachedWindow based on the input parameters.
+ * <li>We call CCD_Setup_Dimensions with the cached detector binning/window dimensions to configure
+ *     the detector to the new dimensions.
+ * <li>We call update_camera_fits_headers to recompute the camera FITS headers for the new dimensions.
+ * <li>We release mExposureMutex, and call sample_camera_state to publish the new setup to get_state.
+ * </ul>
+ * If CCD_Setup_Dimensions fails we call create_ccd_library_exception to create a CameraException that is then thrown.
+ * @param x_start The start X pixel position of the sub-window. Should be at least 1, 
+ *        and less than the X size of the detector.
+ * @param y_start The start Y pixel position of the sub-window. Should be at least 1, 
+ *        and less than the Y size of the detector.
+ * @param x_end The end X pixel position of the sub-window. Should be at least 1, 
+ *        less than the X size of the detector, and greater than x_start.
+ * @param y_end The end Y pixel position of the sub-window. Should be at least 1, 
+ *        less than the Y size of the detector, and greater than y_start.
+ * @see Camera::mCachedNCols
+ * @see Camera::mCachedNRows
+ * @see Camera::mCachedHBin
+ * @see Camera::mCachedVBin
+ * @see Camera::mCachedWindowFlags
+ * @see Camera::mCachedWindow
+ * @see Camera::create_ccd_library_exception
+ * @see logger
+ * @see LOG4CXX_INFO
+ * @see Camera::update_camera_fits_headers
+ * @see Camera::sample_camera_state
+ * @see CameraException
+ * @see CCD_Setup_Dimensions
+ * @see Camera::mExposureMutex
+ * @see Camera::mExposureInProgress
+ */
+void Camera::set_window(const int32_t x_start, const int32_t y_start, const int32_t x_end, const int32_t y_end)
+{
+	CameraException ce;
+	int retval;
+
+	cout << "Set window to start position ( " << x_start << ", " << y_start <<
+		" ), end position ( " << x_end << ", " << y_end << " )."<< endl;
+	LOG4CXX_INFO(logger,"Set window to start position ( " << x_start << ", " << y_start <<
+		     " ), end position ( " << x_end << ", " << y_end << " ).");
+	{
+		std::lock_guard<std::mutex> lock(mExposureMutex);
+
+		if(mExposureInProgress == TRUE)
+		{
+			ce.message = "set_window failed: Exposure in progress.";
+			LOG4CXX_ERROR(logger,"set_window: Throwing exception:" + ce.message);
+			throw ce;
+		}
+		mCachedWindowFlags = true;
+		mCachedWindow.X_Start = x_start;
+		mCachedWindow.Y_Start = y_start;
+		mCachedWindow.X_End = x_end;
+		mCachedWindow.Y_End = y_end;
+		cout << "Configure CCD using ncols " << mCachedNCols << ", nrows " << mCachedNRows <<
+			" binning ( " << mCachedHBin << ", " << mCachedVBin <<
+			" ), Use Window " << mCachedWindowFlags <<
+			", Window (" << mCachedWindow.X_Start << "," << mCachedWindow.Y_Start << "," <<
+			mCachedWindow.X_End << "," << mCachedWindow.Y_End << ")." << endl;
+		LOG4CXX_INFO(logger,"Configure CCD using ncols " << mCachedNCols << ", nrows " << mCachedNRows <<
+			     " binning ( " << mCachedHBin << ", " << mCachedVBin <<
+			     " ), Use Window " << mCachedWindowFlags <<
+			     ", Window (" << mCachedWindow.X_Start << "," << mCachedWindow.Y_Start << "," <<
+			     mCachedWindow.X_End << "," << mCachedWindow.Y_End << ").");
+		retval = CCD_Setup_Dimensions(mCachedNCols,mCachedNRows,mCachedHBin,mCachedVBin,
+					      mCachedWindowFlags,mCachedWindow);
+		if(retval == FALSE)
+		{
+			ce = create_ccd_library_exception();
+			throw ce;
+		}
+		update_camera_fits_headers();
+	}
+	sample_camera_state(false);
+}
+
+/**
+ * Clear a previously set sub-window i.e. re-configure the deterctor to read out full-frame.
+ * <ul>
+ * <li>We lock mExposureMutex, so the setup cannot be changed by two thrift threads at once, or whilst an
+ *     exposure is being started. If an exposure is in progress we throw an exception, as the detector
+ *     dimensions / speeds cannot be changed whilst it is exposing.
+ * <li>We set mCachedWindowFlags to false, to tell CCD_Setup_Dimensions to not use the window data.
+ * <li>We call CCD_Setup_Dimensions with the cached detector binning/window dimensions to configure
+ *     the detector to the new dimensions.
+ * <li>We call update_camera_fits_headers to recompute the camera FITS headers for the new dimensions.
+ * <li>We release mExposureMutex, and call sample_camera_state to publish the new setup to get_state.
+ * </ul>
+ * If CCD_Setup_Dimensions fails we call create_ccd_library_exception to create a CameraException that is then thrown.
+ * @see Camera::mCachedNCols
+ * @see Camera::mCachedNRows
+ * @see Camera::mCachedHBin
+ * @see Camera::mCachedVBin
+ * @see Camera::mCachedWindowFlags
+ * @see Camera::mCachedWindow
+ * @see Camera::create_ccd_library_exception
+ * @see logger
+ * @see LOG4CXX_INFO
+ * @see Camera::update_camera_fits_headers
+ * @see Camera::sample_camera_state
+ * @see CCD_Setup_Dimensions
+ * @see Camera::mExposureMutex
+ * @see Camera::mExposureInProgress
+ */
+void Camera::clear_window()
+{
+	CameraException ce;
+	int retval;
+
+	cout << "Clear window." << endl;
+	LOG4CXX_INFO(logger,"Clear window.");
+	{
+		std::lock_guard<std::mutex> lock(mExposureMutex);
+
+		if(mExposureInProgress == TRUE)
+		{
+			ce.message = "clear_window failed: Exposure in progress.";
+			LOG4CXX_ERROR(logger,"clear_window: Throwing exception:" + ce.message);
+			throw ce;
+		}
+		mCachedWindowFlags = false;
+		cout << "Configure CCD using ncols " << mCachedNCols << ", nrows " << mCachedNRows <<
+			" binning ( " << mCachedHBin << ", " << mCachedVBin <<
+			" ), Use Window " << mCachedWindowFlags <<
+			", Window (" << mCachedWindow.X_Start << "," << mCachedWindow.Y_Start << "," <<
+			mCachedWindow.X_End << "," << mCachedWindow.Y_End << ")." << endl;
+		LOG4CXX_INFO(logger,"Configure CCD using ncols " << mCachedNCols << ", nrows " << mCachedNRows <<
+			" binning ( " << mCachedHBin << ", " << mCachedVBin <<
+			" ), Use Window " << mCachedWindowFlags <<
+			", Window (" << mCachedWindow.X_Start << "," << mCachedWindow.Y_Start << "," <<
+			     mCachedWindow.X_End << "," << mCachedWindow.Y_End << ").");
+		retval = CCD_Setup_Dimensions(mCachedNCols,mCachedNRows,mCachedHBin,mCachedVBin,
+					      mCachedWindowFlags,mCachedWindow);
+		if(retval == FALSE)
+		{
+			ce = create_ccd_library_exception();
+			throw ce;
+		}
+		update_camera_fits_headers();
+	}
+	sample_camera_state(false);
+}
+
+/**
+ * Set the readout speed of the camera (either SLOW or FAST).
+ * <ul>
+ * <li>We lock mExposureMutex, so the setup cannot be changed by two thrift threads at once, or whilst an
+ *     exposure is being started. If an exposure is in progress we throw an exception, as the detector
+ *     dimensions / speeds cannot be changed whilst it is exposing.
+ * <li>We retrieve the horizontal shift speed index from the config (mCameraConfig), using the camera section key
+ *     "ccd.readout_speed.hs_speed_index.SLOW|FAST".
+ * <li>We retrieve the vertical shift speed index from the config (mCameraConfig), using the camera section key
+ *     "ccd.readout_speed.vs_speed_index.SLOW|FAST".
+ * <li>We configure the camera's horizontal shift speed by calling. CCD_Setup_Set_HS_Speed.
+ * <li>We configure the camera's vertical shift speed by calling. CCD_Setup_Set_VS_Speed.
+ * <li>We update mCachedReadoutSpeed to reflect the newly configured readout speed.
+ * <li>We call update_camera_fits_headers to recompute the camera FITS headers for the new readout speed.
+ * <li>We release mExposureMutex, and call sample_camera_state to publish the new readout speed to get_state.
+ * </ul>
+ * If an error occurs configuring the camera or retrieving the config, a CameraException is thrown.
+ * @param speed The readout speed, of type ReadoutSpeed.
+ * @see Camera::mCameraConfig
+ * @see Camera::mCachedReadoutSpeed
+ * @see #CONFIG_CAMERA_SECTION
+ * @see Camera::create_ccd_library_exception
+ * @see logger
+ * @see LOG4CXX_INFO
+ * @see LOG4CXX_DEBUG
+ * @see ReadoutSpeed
+ * @see Camera::update_camera_fits_headers
+ * @see Camera::sample_camera_state
+ * @see CCD_Setup_Set_HS_Speed
+ * @see CCD_Setup_Set_VS_Speed
+ * @see Camera::mExposureMutex
+ * @see Camera::mExposureInProgress
+ */
+void Camera::set_readout_speed(const ReadoutSpeed::type speed)
+{
+	CameraException ce;
+	std::string keyword;
+	int retval;
+	int hs_speed_index,vs_speed_index;
+	
+	cout << "Set readout speed to " << to_string(speed) << "." << endl;
+	LOG4CXX_INFO(logger,"Set readout speed to " << to_string(speed) << ".");
+	{
+		std::lock_guard<std::mutex> lock(mExposureMutex);
+
+		if(mExposureInProgress == TRUE)
+		{
+			ce.message = "set_readout_speed failed: Exposure in progress.";
+			LOG4CXX_ERROR(logger,"set_readout_speed: Throwing exception:" + ce.message);
+			throw ce;
+		}
+		/* Get the horizontal and vertical shift speeds configured for this readout speed */
+		keyword = "ccd.readout_speed.hs_speed_index."+to_string(speed);
+		mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,keyword.c_str(),&hs_speed_index);
+		keyword = "ccd.readout_speed.vs_speed_index."+to_string(speed);
+		mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,keyword.c_str(),&vs_speed_index);
+		/* configure the camera appropriately */
+		LOG4CXX_DEBUG(logger,"Using horizontal shift speed index " << std::to_string(hs_speed_index) << ".");
+		retval = CCD_Setup_Set_HS_Speed(hs_speed_index);
+		if(retval == FALSE)
+		{
+			ce = create_ccd_library_exception();
+			throw ce;
+		}
+		LOG4CXX_DEBUG(logger,"Using vertical shift speed index " << std::to_string(vs_speed_index) << ".");
+		retval = CCD_Setup_Set_VS_Speed(vs_speed_index);
+		if(retval == FALSE)
+		{
+			ce = create_ccd_library_exception();
+			throw ce;
+		}
+		/* we update the cached value, used for status */
+		mCachedReadoutSpeed = speed;
+		update_camera_fits_headers();
+	}
+	sample_camera_state(false);
+	LOG4CXX_INFO(logger,"Readout speed set to " << to_string(speed) << ".");
+}
+
+/**
+ * Set the gain of the camera.
+ * <ul>
+ * <li>We lock mExposureMutex, so the setup cannot be changed by two thrift threads at once, or whilst an
+ *     exposure is being started. If an exposure is in progress we throw an exception, as the detector
+ *     dimensions / speeds cannot be changed whilst it is exposing.
+ * <li>We convert the gain_number gain factor to a pre amp gain index as follows (for an Andor iKon M934);
  *     <ul>
  *     <li><b>Pre-amp gain index     "gain factor"  Gain (gain_number)</b>
  *     <li>0                      1.0            ONE
@@ -499,1294 +1749,3816 @@ void Camera::set_readout_speed(const ReadoutSpeed::type speed)
  *     <li>2                      4.0            FOUR
  *     </ul>
  * <li>We call CCD_Setup_Set_Pre_Amp_Gain to configure the camera's gain.
+ * <li>We update mCachedGain to reflect the newly configured gain.
+ * <li>We call update_camera_fits_headers to recompute the camera FITS headers for the new gain.
+ * <li>We release mExposureMutex, and call sample_camera_state to publish the new gain to get_state.
+ * </ul>
+ * @param gain_number The gain factor to configure the camera with of type Gain.
+ * @see Gain
+ * @see CCD_Setup_Set_Pre_Amp_Gain
+ * @see #mCachedGain
+ * @see Camera::update_camera_fits_headers
+ * @see Camera::sample_camera_state
+ * @see logger
+ * @see LOG4CXX_ERROR
+ * @see Camera::mExposureMutex
+ * @see Camera::mExposureInProgress
+ */
+void Camera::set_gain(const Gain::type gain_number)
+{
+	CameraException ce;
+	int retval,pre_amp_gain_index;
+	
+	cout << "Set gain to " << to_string(gain_number) << "." << endl;
+	LOG4CXX_INFO(logger,"Set gain to " << to_string(gain_number) << ".");
+	{
+		std::lock_guard<std::mutex> lock(mExposureMutex);
+
+		if(mExposureInProgress == TRUE)
+		{
+			ce.message = "set_gain failed: Exposure in progress.";
+			LOG4CXX_ERROR(logger,"set_gain: Throwing exception:" + ce.message);
+			throw ce;
+		}
+		/* CCD_Setup_Set_Pre_Amp_Gain takes a pre amp gain index, which according to
+		** test_andor_readout_speed_gains.c has the following values for an Andor iKon M934:
+		** Pre-amp gain index     "gain factor"  Gain (gain_number)
+		** 0                      1.0            ONE
+		** 1                      2.0            TWO
+		** 2                      4.0            FOUR
+		*/
+		switch(gain_number)
+		{
+			case Gain::ONE:
+				pre_amp_gain_index = 0;
+				break;
+			case Gain::TWO:
+				pre_amp_gain_index = 1;
+				break;
+			case Gain::FOUR:
+				pre_amp_gain_index = 2;
+				break;
+			default:
+				ce.message = "set_gain: gain_number "+ to_string(gain_number) +" is not supported.";
+				LOG4CXX_ERROR(logger,"set_gain: Throwing exception:" + ce.message);
+				throw ce;
+				break;
+		}
+		LOG4CXX_DEBUG(logger,"Gain " << to_string(gain_number) << " has pre-amp gain index of " <<
+			      std::to_string(pre_amp_gain_index) << ".");
+		retval = CCD_Setup_Set_Pre_Amp_Gain(pre_amp_gain_index);
+		if(retval == FALSE)
+		{
+			ce = create_ccd_library_exception();
+			throw ce;
+		}
+		/* update the cached gain value (used for status serving */
+		mCachedGain = gain_number;
+		update_camera_fits_headers();
+	}
+	sample_camera_state(false);
+	LOG4CXX_INFO(logger,"Gain now set to " << to_string(gain_number) <<
+		     " , pre-amp gain index " << std::to_string(pre_amp_gain_index) <<".");
+}
+
+/**
+ * Add a list of  FITS header to the list of FITS headers to be saved to FITS images.
+ * If A FITS header with the specified keyword already exists in the list of headers, it's contents are updated.
+ * mFitsHeaderMutex is held whilst the whole list is added, so an image cannot be started with only some of the
+ * cards added.
+ * @param fits_info The list of FITS header cards to add to the FITS header.
+ * @see FitsHeaderCard
+ * @see Camera::mFitsHeaderMutex
+ * @see logger
+ * @see LOG4CXX_INFO
+ * @see Camera::add_fits_header
+ */
+void Camera::set_fits_headers(const std::vector<FitsHeaderCard> & fits_info)
+{
+	std::lock_guard<std::recursive_mutex> lock(mFitsHeaderMutex);
+
+	cout << "Set FITS headers." << endl;
+	LOG4CXX_INFO(logger,"Set FITS headers.");
+	for (auto it = begin(fits_info); it != end(fits_info); ++it )
+	{
+		add_fits_header(it->key,it->valtype,it->val,it->comment);
+	}
+}
+
+/**
+ * Add a FITS header to the list of FITS headers to be saved to FITS images.
+ * If A FITS header with the specified keyword already exists in the list of headers, it's contents are updated.
+ * The header is added to the client FITS headers returned by get_writable_fits_header, so any frame already
+ * started keeps the headers it was started with.
+ * @param keyword The FITS header card keyword.
+ * @param valtype What kind of value this header takes, of type FitsCardType.
+ * @param value A string representation of the value.
+ * @param comment A string containing a comment for this header.
+ * @see FitsCardType
+ * @see Camera::mFitsHeader
+ * @see Camera::mFitsHeaderMutex
+ * @see Camera::get_writable_fits_header
+ * @see Camera::add_fits_header_card
+ * @see logger
+ * @see LOG4CXX_INFO
+ */
+void Camera::add_fits_header(const std::string & keyword, const FitsCardType::type valtype,const std::string & value,
+			 const std::string & comment)
+{
+	cout << "Add FITS header " << keyword  << " of type " << to_string(valtype) << " and value " << value << endl;
+	LOG4CXX_INFO(logger,"Add FITS header " << keyword  << " of type " << to_string(valtype) <<
+		     " and value " << value );
+	std::lock_guard<std::recursive_mutex> lock(mFitsHeaderMutex);
+	add_fits_header_card(&(get_writable_fits_header()->mFitsHeader),keyword,valtype,value,comment);
+}
+
+/**
+ * Entry point to a routine to clear out FITS headers. If a frame holds a snapshot of the client FITS headers,
+ * we replace them with a new empty header set (leaving the frame's snapshot alone), otherwise we clear them.
+ * @see Camera::mFitsHeader
+ * @see Camera::mFitsHeaderMutex
+ * @see Camera::create_ccd_library_exception
+ * @see logger
+ * @see LOG4CXX_INFO
+ * @see CCD_Fits_Header_Clear
+ */
+void Camera::clear_fits_headers()
+{
+	CameraException ce;
+	int retval;
+	
+	cout << "Clear FITS headers." << endl;
+	LOG4CXX_INFO(logger,"Clear FITS headers.");
+	std::lock_guard<std::recursive_mutex> lock(mFitsHeaderMutex);
+	if(mFitsHeader.use_count() > 1)
+	{
+		mFitsHeader = std::make_shared<FitsHeaderSet>();
+		return;
+	}
+	retval = CCD_Fits_Header_Clear(&(mFitsHeader->mFitsHeader));
+	if(retval == FALSE)
+	{
+		ce = create_ccd_library_exception();
+		throw ce;
+	}	
+}
+
+/**
+ * Thrift entry point to create an immutable FITS header set, that can be saved into the images taken by
+ * start_expose_with_header_set. This allows a client to prepare the FITS headers of a whole sequence of exposures
+ * before it starts them.
+ * <ul>
+ * <li>We lock mFitsHeaderMutex.
+ * <li>We check fewer than MAX_FITS_HEADER_SET_COUNT header sets already exist, otherwise we throw an exception.
+ * <li>We create a new header set, and copy the current client FITS headers (mFitsHeader) into it using
+ *     CCD_Fits_Header_Copy.
+ * <li>We add each of the specified cards to it using add_fits_header_card (updating any existing card with the
+ *     same keyword).
+ * <li>We add it to mFitsHeaderSets with the next header set id (mNextFitsHeaderSetId), and return the id.
+ * </ul>
+ * @param fits_info The list of FITS header cards to add to the current client FITS headers, to make the header set.
+ * @return The header set id of the new header set, to pass to start_expose_with_header_set.
+ * @see #MAX_FITS_HEADER_SET_COUNT
+ * @see FitsHeaderCard
+ * @see Camera::FitsHeaderSet
+ * @see Camera::mFitsHeader
+ * @see Camera::mFitsHeaderSets
+ * @see Camera::mNextFitsHeaderSetId
+ * @see Camera::mFitsHeaderMutex
+ * @see Camera::add_fits_header_card
+ * @see Camera::delete_fits_header_set
+ * @see Camera::start_expose_with_header_set
+ * @see Camera::create_ccd_library_exception
+ * @see CCD_Fits_Header_Copy
+ */
+int64_t Camera::create_fits_header_set(const std::vector<FitsHeaderCard> & fits_info)
+{
+	std::shared_ptr<FitsHeaderSet> header_set;
+	CameraException ce;
+	int64_t header_set_id;
+
+	std::lock_guard<std::recursive_mutex> lock(mFitsHeaderMutex);
+	if(mFitsHeaderSets.size() >= MAX_FITS_HEADER_SET_COUNT)
+	{
+		ce.message = "create_fits_header_set: Too many FITS header sets ("+
+			std::to_string(mFitsHeaderSets.size())+").";
+		LOG4CXX_ERROR(logger,"create_fits_header_set: Throwing exception:" + ce.message);
+		throw ce;
+	}
+	header_set = std::make_shared<FitsHeaderSet>();
+	if(!CCD_Fits_Header_Copy(&(header_set->mFitsHeader),mFitsHeader->mFitsHeader))
+	{
+		ce = create_ccd_library_exception();
+		throw ce;
+	}
+	for (auto it = begin(fits_info); it != end(fits_info); ++it )
+	{
+		add_fits_header_card(&(header_set->mFitsHeader),it->key,it->valtype,it->val,it->comment);
+	}
+	header_set_id = mNextFitsHeaderSetId++;
+	mFitsHeaderSets[header_set_id] = header_set;
+	cout << "Created FITS header set " << header_set_id << " with " << header_set->mFitsHeader.Card_Count <<
+		" cards." << endl;
+	LOG4CXX_INFO(logger,"Created FITS header set " << header_set_id << " with " <<
+		     header_set->mFitsHeader.Card_Count << " cards.");
+	return header_set_id;
+}
+
+/**
+ * Thrift entry point to delete a FITS header set created by create_fits_header_set. Any exposure already started
+ * with the header set still saves it's images with it.
+ * @param header_set_id The header set id returned by create_fits_header_set.
+ * @see Camera::mFitsHeaderSets
+ * @see Camera::mFitsHeaderMutex
+ * @see Camera::create_fits_header_set
+ */
+void Camera::delete_fits_header_set(const int64_t header_set_id)
+{
+	CameraException ce;
+
+	cout << "Delete FITS header set " << header_set_id << "." << endl;
+	LOG4CXX_INFO(logger,"Delete FITS header set " << header_set_id << ".");
+	std::lock_guard<std::recursive_mutex> lock(mFitsHeaderMutex);
+	if(mFitsHeaderSets.erase(header_set_id) == 0)
+	{
+		ce.message = "delete_fits_header_set: No FITS header set with id "+std::to_string(header_set_id)+".";
+		LOG4CXX_ERROR(logger,"delete_fits_header_set: Throwing exception:" + ce.message);
+		throw ce;
+	}
+}
+
+/**
+ * Thrift entry point to set the exposure length to use for subsequent darks and exposures.
+ * @param exposure_length The exposure length to use, in milliseconds.
+ * @see Camera::mCachedExposureLength
+ */
+void Camera::set_exposure_length(const int32_t exposure_length)
+{
+	CameraException ce;
+
+	cout << "Setting exposure length to " << exposure_length << "ms a." << endl;
+	LOG4CXX_INFO(logger,"Setting exposure length to  " << exposure_length << "ms.");
+	if(exposure_length < 0)
+	{
+		ce.message = "set_exposure_length: exposure length " + std::to_string((int)exposure_length) +
+			" is too small.";
+		LOG4CXX_ERROR(logger,ce.message);
+		throw ce;
+	}
+	mCachedExposureLength = exposure_length;
+}
+
+/**
+ * thrift entry point to take an exposure with the camera. The client FITS headers (mFitsHeader) when the exposure
+ * is started are saved into the image. This calls start_expose_with_header_set with a header set id of 0.
+ * @param save_image A boolean, if true save the image in a FITS filename, otherwise don't 
+ *        (the image data can be retrieved using the get_image_data method).
+ * @see Camera::start_expose_with_header_set
+ */
+void Camera::start_expose(const bool save_image)
+{
+	start_expose_with_header_set(save_image,0);
+}
+
+/**
+ * thrift entry point to take an exposure with the camera, saving the image with the FITS headers in a header set.
+ * <ul>
+ * <li>We retrieve a snapshot of the specified header set using get_fits_header_snapshot (which throws an exception
+ *     if the header set does not exist). A header set id of 0 means the current client FITS headers (mFitsHeader),
+ *     so client FITS headers changed after this call are saved in the next exposure's image, not this one.
+ * <li>We call begin_exposure_series to check no exposure is already in progress, and start a new exposure series.
+ * <li>A new thread running an instance of expose_thread is started, using mCachedExposureLength as the exposure length,
+ *     and the header set snapshot.
+ * </ul>
+ * @param save_image A boolean, if true save the image in a FITS filename, otherwise don't 
+ *        (the image data can be retrieved using the get_image_data method).
+ * @param header_set_id The id of a header set created by create_fits_header_set, or 0 to use the client FITS 
+ *        headers.
+ * @see Camera::expose_thread
+ * @see Camera::get_image_data
+ * @see Camera::get_fits_header_snapshot
+ * @see Camera::create_fits_header_set
+ * @see Camera::mCachedExposureLength
+ * @see Camera::begin_exposure_series
+ * @see logger
+ * @see LOG4CXX_INFO
+ * @see LOG4CXX_ERROR
+ */
+void Camera::start_expose_with_header_set(const bool save_image,const int64_t header_set_id)
+{
+	std::shared_ptr<const FitsHeaderSet> fits_header_set;
+
+	cout << "Starting expose thread with exposure length " << mCachedExposureLength <<
+		"ms, save_image " << save_image << " and FITS header set " << header_set_id << "." << endl;
+	LOG4CXX_INFO(logger,"Starting expose thread with exposure length " << mCachedExposureLength <<
+		     "ms, save_image " << save_image << " and FITS header set " << header_set_id << ".");
+	fits_header_set = get_fits_header_snapshot(header_set_id);
+	begin_exposure_series("start_expose",1);
+	std::thread thrd(&Camera::expose_thread, this, mCachedExposureLength, save_image, fits_header_set);
+	thrd.detach();
+}
+
+/**
+ * thrift entry point to start taking a  bias frame. 
+ * <ul>
+ * <li>We call begin_exposure_series to check no exposure is already in progress, and start a new exposure series.
+ * <li>A new thread running an instance of bias_thread is started.
+ * </ul>
+ * @see Camera::begin_exposure_series
+ * @see Camera::bias_thread
+ * @see logger
+ * @see LOG4CXX_INFO
+ * @see LOG4CXX_ERROR
+ */
+void Camera::start_bias()
+{
+	cout << "Starting bias thread." << endl;
+	LOG4CXX_INFO(logger,"Starting bias thread.");
+	begin_exposure_series("start_bias",1);
+	std::thread thrd(&Camera::bias_thread, this);
+	thrd.detach();
+}
+
+/**
+ * thrift entry point to start taking a dark frame. 
+ * <ul>
+ * <li>We call begin_exposure_series to check no exposure is already in progress, and start a new exposure series.
+ * <li>A new thread running an instance of dark_thread is started, using mCachedExposureLength as the exposure length.
+ * </ul>
+ * @see Camera::mCachedExposureLength
+ * @see Camera::begin_exposure_series
+ * @see Camera::dark_thread
+ * @see logger
+ * @see LOG4CXX_INFO
+ * @see LOG4CXX_ERROR
+ */
+void Camera::start_dark()
+{
+	cout << "Starting dark thread with exposure length " << mCachedExposureLength << "ms." << endl;
+	LOG4CXX_INFO(logger,"Starting dark thread exposure length " << mCachedExposureLength << "ms.");
+	begin_exposure_series("start_dark",1);
+	std::thread thrd(&Camera::dark_thread, this, mCachedExposureLength);
+	thrd.detach();
+}
+
+/**
+ * thrift entry point to start taking a series of exposures (a multrun). The whole series is taken by one
+ * thread (multrun_thread), each frame being started as soon as the previous one has been read out (and saved).
+ * <ul>
+ * <li>We check the exposure_count is at least 1, and the exposure_length is at least 1 ms, 
+ *     and if not throw an exception.
+ * <li>We call begin_exposure_series to check no exposure is already in progress, and start a new exposure series.
+ * <li>A new thread running an instance of multrun_thread is started, with the shutter opened for each frame.
+ * </ul>
+ * @param exposure_count The number of frames to take. Must be at least 1.
+ * @param exposure_length The exposure length of each frame in milliseconds. Must be at least 1 ms.
+ * @param save_images A boolean, if true save each image in a FITS filename, otherwise don't 
+ *        (the last image data can be retrieved using the get_image_data method).
+ * @see Camera::multrun_thread
+ * @see Camera::begin_exposure_series
+ * @see logger
+ * @see LOG4CXX_INFO
+ * @see LOG4CXX_ERROR
+ */
+void Camera::start_multrun(const int32_t exposure_count,const int32_t exposure_length,const bool save_images)
+{
+	CameraException ce;
+
+	cout << "Starting multrun thread with exposure count " << exposure_count << ", exposure length " <<
+		exposure_length << "ms and save_images " << save_images << "." << endl;
+	LOG4CXX_INFO(logger,"Starting multrun thread with exposure count " << exposure_count << ", exposure length " <<
+		     exposure_length << "ms and save_images " << save_images << ".");
+	if(exposure_count < 1)
+	{
+		ce.message = "start_multrun failed: exposure count " + std::to_string((int)exposure_count) +
+			" is too small.";
+		LOG4CXX_ERROR(logger,"start_multrun: Throwing exception:" + ce.message);
+		throw ce;
+	}
+	if(exposure_length < 1)
+	{
+		ce.message = "start_multrun failed: exposure length " + std::to_string((int)exposure_length) +
+			" is too small.";
+		LOG4CXX_ERROR(logger,"start_multrun: Throwing exception:" + ce.message);
+		throw ce;
+	}
+	begin_exposure_series("start_multrun",exposure_count);
+	std::thread thrd(&Camera::multrun_thread, this, exposure_count, exposure_length, true, save_images);
+	thrd.detach();
+}
+
+/**
+ * thrift entry point to start taking a series of bias frames (a multbias). Each frame is saved to a FITS image.
+ * <ul>
+ * <li>We check the exposure_count is at least 1, and if not throw an exception.
+ * <li>We call begin_exposure_series to check no exposure is already in progress, and start a new exposure series.
+ * <li>A new thread running an instance of multrun_thread is started, with an exposure length of zero 
+ *     and the shutter kept closed.
+ * </ul>
+ * @param exposure_count The number of bias frames to take. Must be at least 1.
+ * @see Camera::multrun_thread
+ * @see Camera::begin_exposure_series
+ * @see logger
+ * @see LOG4CXX_INFO
+ * @see LOG4CXX_ERROR
+ */
+void Camera::start_multbias(const int32_t exposure_count)
+{
+	CameraException ce;
+
+	cout << "Starting multbias thread with exposure count " << exposure_count << "." << endl;
+	LOG4CXX_INFO(logger,"Starting multbias thread with exposure count " << exposure_count << ".");
+	if(exposure_count < 1)
+	{
+		ce.message = "start_multbias failed: exposure count " + std::to_string((int)exposure_count) +
+			" is too small.";
+		LOG4CXX_ERROR(logger,"start_multbias: Throwing exception:" + ce.message);
+		throw ce;
+	}
+	begin_exposure_series("start_multbias",exposure_count);
+	std::thread thrd(&Camera::multrun_thread, this, exposure_count, 0, false, true);
+	thrd.detach();
+}
+
+/**
+ * thrift entry point to start taking a series of dark frames (a multdark). Each frame is saved to a FITS image.
+ * <ul>
+ * <li>We check the exposure_count is at least 1, and the exposure_length is at least 1 ms, 
+ *     and if not throw an exception.
+ * <li>We call begin_exposure_series to check no exposure is already in progress, and start a new exposure series.
+ * <li>A new thread running an instance of multrun_thread is started, with the shutter kept closed.
+ * </ul>
+ * @param exposure_count The number of dark frames to take. Must be at least 1.
+ * @param exposure_length The exposure length of each dark frame in milliseconds. Must be at least 1 ms.
+ * @see Camera::multrun_thread
+ * @see Camera::begin_exposure_series
+ * @see logger
+ * @see LOG4CXX_INFO
+ * @see LOG4CXX_ERROR
+ */
+void Camera::start_multdark(const int32_t exposure_count,const int32_t exposure_length)
+{
+	CameraException ce;
+
+	cout << "Starting multdark thread with exposure count " << exposure_count << " and exposure length " <<
+		exposure_length << "ms." << endl;
+	LOG4CXX_INFO(logger,"Starting multdark thread with exposure count " << exposure_count <<
+		     " and exposure length " << exposure_length << "ms.");
+	if(exposure_count < 1)
+	{
+		ce.message = "start_multdark failed: exposure count " + std::to_string((int)exposure_count) +
+			" is too small.";
+		LOG4CXX_ERROR(logger,"start_multdark: Throwing exception:" + ce.message);
+		throw ce;
+	}
+	if(exposure_length < 1)
+	{
+		ce.message = "start_multdark failed: exposure length " + std::to_string((int)exposure_length) +
+			" is too small.";
+		LOG4CXX_ERROR(logger,"start_multdark: Throwing exception:" + ce.message);
+		throw ce;
+	}
+	begin_exposure_series("start_multdark",exposure_count);
+	std::thread thrd(&Camera::multrun_thread, this, exposure_count, exposure_length, false, true);
+	thrd.detach();
+}
+
+/**
+ * Start a new exposure series, called by the start_* methods before they start the exposure thread.
+ * <ul>
+ * <li>We lock mExposureMutex, so two clients cannot both start an exposure.
+ * <li>We check whether an exposure is already in progress and if so return an exception.
+ * <li>We set mExposureInProgress to true to indicate an exposure is in progress.
+ * <li>We reset mAbort to FALSE here, before the thread is started, so an abort_exposure that arrives after
+ *     the start_* method returns (but before the thread starts exposing) is not lost.
+ * <li>We increment mExposureSeriesId, the id of the new exposure series, that it's frames and any error are
+ *     recorded against.
+ * <li>We time stamp the request being accepted (CLOCK_MONOTONIC) in mRequestTime, the start of the first frame's
+ *     timeline.
+ * <li>We set mExposureIndex to 0 and mExposureCount to exposure_count.
+ * </ul>
+ * @param method_name The name of the calling start_* method, used in the exception message.
+ * @param exposure_count The number of frames in the series (1 for an expose / bias / dark).
+ * @see Camera::mExposureMutex
+ * @see Camera::mExposureInProgress
+ * @see Camera::mAbort
+ * @see Camera::mRequestTime
+ * @see Camera::mExposureSeriesId
+ * @see Camera::mExposureIndex
+ * @see Camera::mExposureCount
+ * @see logger
+ * @see LOG4CXX_ERROR
+ */
+void Camera::begin_exposure_series(const char *method_name,int exposure_count)
+{
+	CameraException ce;
+
+	std::lock_guard<std::mutex> lock(mExposureMutex);
+	if(mExposureInProgress == TRUE)
+	{
+		ce.message = std::string(method_name)+" failed: Exposure already in progress.";
+		LOG4CXX_ERROR(logger,std::string(method_name)+": Throwing exception:" + ce.message);
+		throw ce;
+	}
+	mExposureInProgress = TRUE;
+	mAbort = FALSE;
+	mExposureSeriesId++;
+	clock_gettime(CLOCK_MONOTONIC,&mRequestTime);
+	mExposureIndex = 0;
+	mExposureCount = exposure_count;
+}
+
+/**
+ * Abort a running expose/dark/bias/multbias/multdark/multrun. 
+ * This sets mAbort to TRUE (to stop a multbias/multdark/multrun between frames, or an expose/bias/dark whose
+ * thread has not started exposing yet), and
+ * calls CCD_Exposure_Abort to attempt to stop a running expose/dark/bias. CCD_Exposure_Abort also cancels
+ * the CCD library's wait for the Andor acquisition to complete, so the exposure thread notices the abort immediately.
+ * If CCD_Exposure_Abort fails we call create_ccd_library_exception to create a CameraException that is then thrown.
+ * @see Camera::mAbort
+ * @see Camera::create_ccd_library_exception
+ * @see logger
+ * @see LOG4CXX_INFO
+ * @see CCD_Exposure_Abort
+ */
+void Camera::abort_exposure()
+{
+	CameraException ce;
+	int retval;
+	
+	cout << "Abort exposure." << endl;
+	LOG4CXX_INFO(logger,"Abort exposure.");
+	mAbort = TRUE;
+	retval = CCD_Exposure_Abort();
+	if(retval == FALSE)
+	{
+		ce = create_ccd_library_exception();
+		throw ce;
+	}	
+}
+
+/**
+ * Check a blocking call (wait_for_exposure or one of the full frame image downloads) got a slot in mBlockingCalls,
+ * and fail it straight away if it did not. The server's worker threads are shared by all calls, so without this
+ * enough blocking calls could take every worker thread, and abort_exposure / get_state would queue behind them.
+ * @param slot The BlockingCallSlot the calling method took in mBlockingCalls.
+ * @param method_name The name of the calling method, used in the exception message.
+ * @exception CameraException Thrown if the slot was not acquired (too many blocking calls are in progress).
+ * @see Camera::mBlockingCalls
+ * @see BlockingCallSlot
+ * @see logger
+ * @see LOG4CXX_ERROR
+ * @see CameraException
+ */
+void Camera::check_blocking_call_slot(const BlockingCallSlot &slot,const char *method_name)
+{
+	CameraException ce;
+
+	if(slot.acquired() == false)
+	{
+		ce.message = std::string(method_name)+" failed: Too many blocking calls in progress (limit "+
+			std::to_string(mBlockingCalls.get_limit())+"), try again later.";
+		LOG4CXX_ERROR(logger,std::string(method_name)+": Throwing exception:" + ce.message);
+		throw ce;
+	}
+}
+
+/**
+ * thrift entry point to block until the current exposure/bias/dark/multrun has read out a frame or finished,
+ * rather than having to poll get_state.
+ * <ul>
+ * <li>We call check_blocking_call_slot to fail straight away if too many blocking calls are already in progress.
+ * <li>We limit timeout_ms to mWaitForExposureMaxTimeout, so a waiting client cannot hold on to one of the 
+ *     server's worker threads (and stop abort_exposure / get_state being served) for longer than that.
+ *     Clients that want to wait longer should call wait_for_exposure again when it returns false.
+ * <li>We take a copy of mImageFrameSequence, so we can tell when a new frame has been read out.
+ * <li>We lock mExposureMutex and wait on mExposureCondition, for at most timeout_ms milliseconds, 
+ *     until either mExposureInProgress is FALSE and mFramesPendingCount is zero (the processing stage has finished
+ *     with the exposure's frames), or mImageFrameSequence has changed (a new frame has been read out and published).
+ *     The exposure threads call notify_exposure_waiters to wake us when either of these happen.
+ * <li>If the exposure series has finished, we call get_exposure_error to see whether it failed, and if so
+ *     throw a CameraException containing the error.
+ * </ul>
+ * If no exposure is in progress when this method is called, it returns true immediately (or throws an exception, if
+ * the last exposure series failed).
+ * @param timeout_ms The maximum length of time to wait, in milliseconds. Must be at least 0. Timeouts longer
+ *        than mWaitForExposureMaxTimeout are shortened to mWaitForExposureMaxTimeout.
+ * @return We return true if a new frame was read out, or the exposure finished successfully,
+ *         and false if the timeout expired first. get_state can then be used to retrieve details.
+ * @see Camera::mWaitForExposureMaxTimeout
+ * @see Camera::mExposureSeriesId
+ * @see Camera::get_exposure_error
+ * @see Camera::mExposureInProgress
+ * @see Camera::mFramesPendingCount
+ * @see Camera::mImageFrameSequence
+ * @see Camera::mExposureMutex
+ * @see Camera::mExposureCondition
+ * @see Camera::notify_exposure_waiters
+ * @see Camera::mBlockingCalls
+ * @see Camera::check_blocking_call_slot
+ * @see logger
+ * @see LOG4CXX_INFO
+ * @see LOG4CXX_ERROR
+ */
+bool Camera::wait_for_exposure(const int32_t timeout_ms)
+{
+	BlockingCallSlot slot(mBlockingCalls);
+	CameraException ce;
+	std::string exposure_error;
+	int64_t frame_sequence;
+	int32_t wait_length;
+	bool retval;
+
+	cout << "Wait for exposure with timeout " << timeout_ms << " ms." << endl;
+	LOG4CXX_INFO(logger,"Wait for exposure with timeout " << timeout_ms << " ms.");
+	check_blocking_call_slot(slot,"wait_for_exposure");
+	if(timeout_ms < 0)
+	{
+		ce.message = "wait_for_exposure failed: timeout " + std::to_string((int)timeout_ms) +
+			" ms is too small.";
+		LOG4CXX_ERROR(logger,"wait_for_exposure: Throwing exception:" + ce.message);
+		throw ce;
+	}
+	/* don't tie up a server worker thread for too long */
+	wait_length = std::min(timeout_ms,(int32_t)mWaitForExposureMaxTimeout);
+	std::unique_lock<std::mutex> lock(mExposureMutex);
+	frame_sequence = mImageFrameSequence;
+	retval = mExposureCondition.wait_for(lock,std::chrono::milliseconds(wait_length),
+			[this,frame_sequence]{return ((mExposureInProgress == FALSE)&&(mFramesPendingCount == 0))||
+					(mImageFrameSequence != frame_sequence);});
+	cout << "Wait for exposure returned " << retval << " with exposure in progress " << 
+		mExposureInProgress << " and frame sequence " << mImageFrameSequence << "." << endl;
+	LOG4CXX_INFO(logger,"Wait for exposure returned " << retval << " with exposure in progress " << 
+		     mExposureInProgress << " and frame sequence " << mImageFrameSequence << ".");
+	if((mExposureInProgress == FALSE)&&(mFramesPendingCount == 0))
+	{
+		exposure_error = get_exposure_error(mExposureSeriesId);
+		if(exposure_error.empty() == false)
+		{
+			ce.message = "wait_for_exposure failed: The exposure failed: " + exposure_error;
+			LOG4CXX_ERROR(logger,"wait_for_exposure: Throwing exception:" + ce.message);
+			throw ce;
+		}
+	}
+	return retval;
+}
+
+/**
+ * Get the current state of the camera. This never calls the CCD library or the Andor driver, so it is quick and 
+ * does not interfere with exposures, however often clients poll it.
+ * <ul>
+ * <li>We take a reference to the latest camera state sample (mCameraState) using std::atomic_load,
+ *     and copy it's state (the detector setup, exposure length and state, CCD temperature, cooler status, 
+ *     readout speed and gain, see sample_camera_state).
+ * <li>If the sample was taken whilst the detector was exposing, we call clock_gettime to get a current timestamp,
+ *     and use it and the sampled exposure start time to interpolate the elapsed_exposure_length and 
+ *     remaining_exposure_length.
+ * <li>We fill in the exposure_in_progress status from mExposureInProgress, and mFramesPendingCount (the last
+ *     exposure is still in progress until the processing stage has finished with it's frames).
+ * <li>We fill in the exposure_index and exposure_count status from mExposureIndex and mExposureCount.
+ * <li>We fill in the duty_cycle, frame_exposure_length and frame_readout_length status from mDutyCycle,
+ *     mFrameExposureLength and mFrameReadoutLength.
+ * <li>We fill in the exposure_error status, using get_exposure_error to retrieve any error recorded against the
+ *     current/last exposure series (mExposureSeriesId).
+ * </ul>
+ * If no sample has been taken yet (the camera has not been initialised), a CameraException is thrown.
+ * @param state An instance of CameraState that we set the member values to the current status.
+ * @see Camera::CameraStateSample
+ * @see Camera::mCameraState
+ * @see Camera::sample_camera_state
+ * @see Camera::mExposureInProgress
+ * @see Camera::mFramesPendingCount
+ * @see Camera::mExposureIndex
+ * @see Camera::mExposureCount
+ * @see Camera::mDutyCycle
+ * @see Camera::mFrameExposureLength
+ * @see Camera::mFrameReadoutLength
+ * @see Camera::mExposureSeriesId
+ * @see Camera::get_exposure_error
+ * @see logger
+ * @see LOG4CXX_DEBUG
+ * @see CCD_EXPOSURE_STATUS
+ * @see CCD_GENERAL_ONE_SECOND_MS
+ * @see CameraState
+ */
+void Camera::get_state(CameraState &state)
+{
+	std::shared_ptr<const CameraStateSample> sample;
+	CameraException ce;
+	struct timespec current_time;
+	
+	sample = std::atomic_load(&mCameraState);
+	if(sample == nullptr)
+	{
+		ce.message = "get_state failed:The camera state has not been sampled (the camera is not initialised).";
+		LOG4CXX_ERROR(logger,"get_state: Throwing exception:" + ce.message);
+		throw ce;
+	}
+	state = sample->mState;
+	if(sample->mExposureStatus == CCD_EXPOSURE_STATUS_EXPOSE)
+	{
+		clock_gettime(CLOCK_REALTIME,&current_time);
+		/* fdifftime returns difference between timestamps in seconds.
+		** exposure_length state is in milliseconds. */
+		state.elapsed_exposure_length = fdifftime(current_time,sample->mExposureStartTime)*
+			((double)CCD_GENERAL_ONE_SECOND_MS);
+		state.remaining_exposure_length = state.exposure_length-state.elapsed_exposure_length;
+		/* check we have not already reached the end of the exposure,
+		** but not started reading out yet */
+		if(state.elapsed_exposure_length > state.exposure_length)
+		{
+			state.elapsed_exposure_length = state.exposure_length;
+			state.remaining_exposure_length = 0;
+		}
+	}
+	state.exposure_in_progress = (mExposureInProgress == TRUE)||(mFramesPendingCount > 0);
+	state.exposure_index = mExposureIndex;
+	state.exposure_count = mExposureCount;
+	state.duty_cycle = mDutyCycle;
+	state.frame_exposure_length = mFrameExposureLength;
+	state.frame_readout_length = mFrameReadoutLength;
+	state.exposure_error = get_exposure_error(mExposureSeriesId);
+	LOG4CXX_DEBUG(logger,"get_state: exposure_state:" << to_string(state.exposure_state) <<
+		      ":elapsed exposure length:" << state.elapsed_exposure_length <<
+		      ":remaining exposure length:" << state.remaining_exposure_length <<
+		      ":exposure_in_progress:" << state.exposure_in_progress <<
+		      ":exposure_index:" << state.exposure_index << ":exposure_count:" << state.exposure_count <<
+		      ":ccd temperature:" << state.ccd_temperature << " C.");
+}
+
+/**
+ * Get the CCD temperature samples taken after a time, at a specified resolution. The samples are added by the 
+ * telemetry thread whenever the temperature has been read from the camera, whilst the detector is idle or exposing
+ * (see sample_camera_state), and kept in the fixed memory temperature history mTemperatureHistory, so this never 
+ * calls the CCD library or the Andor driver. The temperature is not read whilst the detector is reading out, or
+ * whilst it is exposing on cameras that cannot report it then, so there may be gaps during a multrun.
+ * <ul>
+ * <li>We check the resolution is a legal TemperatureResolution, and throw a CameraException if it is not.
+ * <li>We call mTemperatureHistory's get_history method to pack the samples into the returned TemperatureHistory.
+ * </ul>
+ * @param history A TemperatureHistory to fill in with the samples.
+ * @param since Only samples taken after this time (in milliseconds since the epoch) are returned. For the 
+ *        TEN_SECONDS and ONE_MINUTE resolutions, only intervals starting after this time are returned, and only 
+ *        once they have ended. Pass 0 for all the samples held, or the last_time of the previous call to just get 
+ *        the newer samples.
+ * @param resolution The resolution of the samples to return (RAW / TEN_SECONDS / ONE_MINUTE).
+ * @see Camera::mTemperatureHistory
+ * @see Camera::sample_camera_state
+ * @see TemperatureHistoryRing::get_history
+ * @see TemperatureHistory
+ * @see TemperatureResolution
+ * @see logger
+ * @see LOG4CXX_ERROR
+ * @see LOG4CXX_DEBUG
+ */
+void Camera::get_temperature_history(TemperatureHistory &history,const int64_t since,
+				     const TemperatureResolution::type resolution)
+{
+	CameraException ce;
+
+	if((resolution != TemperatureResolution::RAW)&&(resolution != TemperatureResolution::TEN_SECONDS)&&
+	   (resolution != TemperatureResolution::ONE_MINUTE))
+	{
+		ce.message = "get_temperature_history failed:Illegal resolution "+std::to_string((int)resolution)+".";
+		LOG4CXX_ERROR(logger,"get_temperature_history: Throwing exception:" + ce.message);
+		throw ce;
+	}
+	mTemperatureHistory.get_history(since,resolution,history);
+	LOG4CXX_DEBUG(logger,"get_temperature_history: since:" << since << ":resolution:" << to_string(resolution) <<
+		      ":returned " << history.sample_count << " samples.");
+}
+
+/**
+ * The telemetry thread. Until stop_telemetry sets mTelemetryStopping, we call sample_camera_state to sample the
+ * camera state (including the CCD temperature), and then wait on mTelemetryCondition for mTelemetryPeriod 
+ * milliseconds, or until request_telemetry_sample asks for a new sample.
+ * @see Camera::mTelemetryMutex
+ * @see Camera::mTelemetryCondition
+ * @see Camera::mTelemetryStopping
+ * @see Camera::mTelemetrySampleRequested
+ * @see Camera::mTelemetryPeriod
+ * @see Camera::sample_camera_state
+ * @see Camera::initialize_telemetry
+ */
+void Camera::telemetry_thread()
+{
+	std::unique_lock<std::mutex> lock(mTelemetryMutex);
+
+	while(!mTelemetryStopping)
+	{
+		mTelemetrySampleRequested = false;
+		lock.unlock();
+		sample_camera_state(true);
+		lock.lock();
+		mTelemetryCondition.wait_for(lock,std::chrono::milliseconds(mTelemetryPeriod),
+					     [this]{return mTelemetryStopping||mTelemetrySampleRequested;});
+	}
+}
+
+/**
+ * Ask the telemetry thread to sample the camera state straight away, rather than at the end of the current
+ * sample period. This is called when the exposure state changes (notify_exposure_waiters), and when the
+ * cooler is turned on or off, so get_state reflects the change quickly. It does not wait for the sample to be taken.
+ * @see Camera::mTelemetryMutex
+ * @see Camera::mTelemetryCondition
+ * @see Camera::mTelemetrySampleRequested
+ * @see Camera::telemetry_thread
+ */
+void Camera::request_telemetry_sample()
+{
+	{
+		std::lock_guard<std::mutex> lock(mTelemetryMutex);
+		mTelemetrySampleRequested = true;
+	}
+	mTelemetryCondition.notify_one();
+}
+
+/**
+ * Sample the camera state, and publish it for get_state as a new immutable CameraStateSample in mCameraState.
+ * This is called by the telemetry thread every sample period, and by the thrift threads that change the 
+ * detector setup (set_binning / set_window / clear_window / set_readout_speed / set_gain), so get_state reflects
+ * the new setup straight away.
+ * <ul>
+ * <li>We lock mCameraStateMutex, so samples are published in the order they are taken.
+ * <li>We lock mExposureMutex, as the setup methods change the detector setup whilst holding it. 
+ *     mExposureMutex is always locked after mCameraStateMutex, never before.
+ * <li>We call various CCD_Setup library routines to get the currently configured image dimensions 
+ *     (CCD_Setup_Get_Bin_X / CCD_Setup_Get_Bin_Y / CCD_Setup_Is_Window / 
+ *     CCD_Setup_Get_Horizontal_Start / CCD_Setup_Get_Vertical_Start / 
+ *     CCD_Setup_Get_Horizontal_End / CCD_Setup_Get_Vertical_End).
+ * <li>We set the readout speed and gain from mCachedReadoutSpeed and mCachedGain, and release mExposureMutex.
+ * <li>We call CCD_Exposure_Status_Get to get the CCD library's exposure status, and then 
+ *     CCD_Exposure_Length_Get / CCD_Exposure_Start_Time_Get to get the exposure length and start time.
+ * <li>Based on the exposure status we set the exposure_state, and the elapsed_exposure_length and 
+ *     remaining_exposure_length of an exposure that is not exposing (get_state interpolates them whilst the 
+ *     detector is exposing).
+ * <li>If read_temperature is true, and the detector is not reading out, we retrieve the current CCD
+ *     temperature and cooler status using CCD_Temperature_Get. This includes whilst the detector is exposing, 
+ *     so the telemetry thread keeps the temperature history (and the cached temperature get_frame_temperature 
+ *     puts in each frame's FITS headers) going during a multrun, without the acquisition thread calling the driver.
+ *     If the camera cannot report it's temperature whilst acquiring (CCD_Temperature_Get returns an unknown
+ *     status), or read_temperature is false, or the detector is reading out, we use the cached temperature 
+ *     from the last time the temperature was read (CCD_Temperature_Get_Cached_Temperature). 
+ *     If this fails we log the error and keep the temperature and cooler status of the previous sample.
+ * <li>If the temperature was read from the camera, we add it to the temperature history mTemperatureHistory,
+ *     with the current time and the target temperature (CCD_Temperature_Target_Temperature_Get). If we used
+ *     the cached temperature, we add it to the history with it's cache date stamp, if it has been read
+ *     since the last sample in the history (mTemperatureHistoryLastTime).
+ * <li>We publish the sample in mCameraState using std::atomic_store.
+ * </ul>
+ * @param read_temperature Whether to read the temperature from the camera, if it is not exposing or reading out.
+ *        Otherwise the last temperature read from the camera is used.
+ * @see Camera::CameraStateSample
+ * @see Camera::mCameraState
+ * @see Camera::mCameraStateMutex
+ * @see Camera::mExposureMutex
+ * @see Camera::mCachedReadoutSpeed
+ * @see Camera::mCachedGain
+ * @see Camera::create_ccd_library_exception
+ * @see CCD_EXPOSURE_STATUS
+ * @see CCD_Exposure_Length_Get
+ * @see CCD_Exposure_Status_Get
+ * @see CCD_Exposure_Start_Time_Get
+ * @see CCD_Setup_Get_Bin_X
+ * @see CCD_Setup_Get_Bin_Y
+ * @see CCD_Setup_Is_Window
+ * @see CCD_Setup_Get_Horizontal_Start
+ * @see CCD_Setup_Get_Vertical_Start
+ * @see CCD_Setup_Get_Horizontal_End
+ * @see CCD_Setup_Get_Vertical_End
+ * @see CCD_TEMPERATURE_STATUS
+ * @see CCD_Temperature_Get
+ * @see CCD_Temperature_Get_Cached_Temperature
+ * @see CCD_Temperature_Target_Temperature_Get
+ * @see CoolerStatus
+ * @see Camera::mTemperatureHistory
+ * @see Camera::mTemperatureHistoryLastTime
+ * @see Camera::get_frame_temperature
+ * @see TemperatureHistoryRing::add_sample
+ */
+void Camera::sample_camera_state(bool read_temperature)
+{
+	std::shared_ptr<CameraStateSample> sample = std::make_shared<CameraStateSample>();
+	std::shared_ptr<const CameraStateSample> last_sample;
+	CameraException ce;
+	enum CCD_TEMPERATURE_STATUS temperature_status;
+	struct timespec cache_date_stamp,sample_time;
+	double target_temperature;
+	int64_t history_time;
+	bool temperature_read;
+	int retval;
+
+	std::lock_guard<std::mutex> lock(mCameraStateMutex);
+	/* The detector setup, and the cached readout speed and gain, are changed by the setup methods whilst 
+	** holding mExposureMutex. */
+	{
+		std::lock_guard<std::mutex> exposure_lock(mExposureMutex);
+
+		sample->mState.xbin = CCD_Setup_Get_Bin_X();
+		sample->mState.ybin = CCD_Setup_Get_Bin_Y();
+		sample->mState.use_window = CCD_Setup_Is_Window();
+		sample->mState.window.x_start = CCD_Setup_Get_Horizontal_Start();
+		sample->mState.window.y_start = CCD_Setup_Get_Vertical_Start();
+		sample->mState.window.x_end = CCD_Setup_Get_Horizontal_End();
+		sample->mState.window.y_end = CCD_Setup_Get_Vertical_End();
+		sample->mState.readout_speed = mCachedReadoutSpeed;
+		sample->mState.gain = mCachedGain;
+	}
+	/* get the exposure status first, so the exposure length and start time are for the sampled exposure */
+	sample->mExposureStatus = CCD_Exposure_Status_Get();
+	sample->mState.exposure_length = CCD_Exposure_Length_Get();
+	CCD_Exposure_Start_Time_Get(&(sample->mExposureStartTime));
+	sample->mState.elapsed_exposure_length = 0;
+	sample->mState.remaining_exposure_length = 0;
+	switch(sample->mExposureStatus)
+	{
+		case CCD_EXPOSURE_STATUS_NONE:
+			sample->mState.exposure_state = ExposureState::IDLE;
+			break;
+		case CCD_EXPOSURE_STATUS_WAIT_START:
+			sample->mState.exposure_state = ExposureState::SETUP;
+			break;
+		case CCD_EXPOSURE_STATUS_EXPOSE:
+			/* get_state interpolates the elapsed / remaining exposure length */
+			sample->mState.exposure_state = ExposureState::EXPOSING;
+			break;
+		case CCD_EXPOSURE_STATUS_READOUT:
+			sample->mState.exposure_state = ExposureState::READOUT;
+			sample->mState.elapsed_exposure_length = sample->mState.exposure_length;
+			break;
+		default:
+			/* we could throw an exception here */
+			break;
+	}/* end switch */
+	/* we don't talk to the driver whilst the detector is reading out. The temperature is in degrees centigrade. */
+	temperature_read = read_temperature && (sample->mExposureStatus != CCD_EXPOSURE_STATUS_READOUT);
+	if(temperature_read)
+	{
+		retval = CCD_Temperature_Get(&(sample->mState.ccd_temperature),&temperature_status);
+		/* some cameras cannot report their temperature whilst acquiring, use the cached temperature */
+		if((retval == TRUE)&&(temperature_status == CCD_TEMPERATURE_STATUS_UNKNOWN)&&
+		   (sample->mExposureStatus == CCD_EXPOSURE_STATUS_EXPOSE))
+			temperature_read = false;
+	}
+	if(!temperature_read)
+	{
+		retval = CCD_Temperature_Get_Cached_Temperature(&(sample->mState.ccd_temperature),&temperature_status,
+								&cache_date_stamp);
+	}
+	if(retval == TRUE)
+	{
+		switch(temperature_status)
+		{
+			case CCD_TEMPERATURE_STATUS_OFF:
+				sample->mState.cooler_status = CoolerStatus::OFF;
+				break;
+			case CCD_TEMPERATURE_STATUS_AMBIENT:
+				sample->mState.cooler_status = CoolerStatus::AMBIENT;
+				break;
+			case CCD_TEMPERATURE_STATUS_OK:
+				sample->mState.cooler_status = CoolerStatus::OK;
+				break;
+			case CCD_TEMPERATURE_STATUS_RAMPING:
+				sample->mState.cooler_status = CoolerStatus::RAMPING;
+				break;
+			default:
+				sample->mState.cooler_status = CoolerStatus::UNKNOWN;
+				break;
+		}
+		/* only temperatures actually read from the camera go into the temperature history. A cached
+		** temperature is added, with the time it was read, if it was read since the last sample
+		** (e.g. between the frames of a multrun) */
+		if(temperature_read)
+			clock_gettime(CLOCK_REALTIME,&sample_time);
+		else
+			sample_time = cache_date_stamp;
+		history_time = (((int64_t)sample_time.tv_sec)*CCD_GENERAL_ONE_SECOND_MS)+
+			(sample_time.tv_nsec/CCD_GENERAL_ONE_MILLISECOND_NS);
+		if(temperature_read||((sample_time.tv_sec != 0)&&(history_time > mTemperatureHistoryLastTime)))
+		{
+			if(CCD_Temperature_Target_Temperature_Get(&target_temperature) == FALSE)
+				target_temperature = 0.0;
+			mTemperatureHistory.add_sample(history_time,sample->mState.ccd_temperature,target_temperature,
+						       sample->mState.cooler_status);
+			mTemperatureHistoryLastTime = history_time;
+		}
+	}
+	else
+	{
+		/* create_ccd_library_exception logs the error. Keep the last sampled temperature */
+		ce = create_ccd_library_exception();
+		last_sample = std::atomic_load(&mCameraState);
+		if(last_sample != nullptr)
+		{
+			sample->mState.ccd_temperature = last_sample->mState.ccd_temperature;
+			sample->mState.cooler_status = last_sample->mState.cooler_status;
+		}
+		else
+		{
+			sample->mState.ccd_temperature = 0.0;
+			sample->mState.cooler_status = CoolerStatus::UNKNOWN;
+		}
+	}
+	std::atomic_store(&mCameraState,std::shared_ptr<const CameraStateSample>(sample));
+}
+
+/**
+ * Get a copy of the image data. We lock mImageBufMutex only long enough to take a reference to the current
+ * mImageBuf and it's dimensions, the pixel data is copied after the lock has been released.
+ * @param img_data An ImageData instance to fill in with the returned image data.
+ * @see Camera::mImageBufMutex
+ * @see Camera::mImageBuf
+ * @see Camera::mImageBufNCols
+ * @see Camera::mImageBufNRows
+ * @see Camera::mBlockingCalls
+ * @see Camera::check_blocking_call_slot
+ * @see logger
+ * @see LOG4CXX_INFO
+ * @see ImageData
+ */
+void Camera::get_image_data(ImageData &img_data)
+{
+	BlockingCallSlot slot(mBlockingCalls);
+	std::shared_ptr<ImageBuffer> image_buf;
+
+	cout << "Get image data." << endl;
+	LOG4CXX_INFO(logger,"Get image data.");
+	check_blocking_call_slot(slot,"get_image_data");
+	{
+		std::lock_guard<std::mutex> lock(mImageBufMutex);
+
+		image_buf = mImageBuf;
+		img_data.x_size = mImageBufNCols;
+		img_data.y_size = mImageBufNRows;
+	}
+	if(image_buf != nullptr)
+		img_data.data.assign(image_buf->begin(),image_buf->end());
+	else
+		img_data.data.clear();
+}
+
+/**
+ * Get a copy of the image data, as a packed binary blob of little-endian unsigned 16-bit pixels.
+ * This is much quicker to serialise/de-serialise than get_image_data, as the pixels are copied into
+ * the thrift binary data with one memory copy, rather than being converted to a list of i32s one pixel at a time.
+ * <ul>
+ * <li>We lock mImageBufMutex, take a reference to the current mImageBuf and copy the image metadata 
+ *     (dimensions, binning and frame_sequence), and then unlock mImageBufMutex. The (large) pixel copy is done 
+ *     outside the lock, so it does not hold up the exposure threads.
+ * <li>We copy the contents of the image buffer into img_data.data as raw bytes (2 bytes per pixel), 
+ *     little-endian, using image_buf_to_binary.
+ * <li>We set the image dimensions from mImageBufNCols / mImageBufNRows.
+ * <li>We set the binning from mImageBufXBin / mImageBufYBin.
+ * <li>We set the frame_sequence from mImageFrameSequence.
+ * </ul>
+ * @param img_data An ImageDataBinary instance to fill in with the returned image data.
+ * @see Camera::mImageBuf
+ * @see Camera::mImageBufNCols
+ * @see Camera::mImageBufNRows
+ * @see Camera::mImageBufXBin
+ * @see Camera::mImageBufYBin
+ * @see Camera::mImageFrameSequence
+ * @see Camera::mImageBufMutex
+ * @see image_buf_to_binary
+ * @see Camera::mBlockingCalls
+ * @see Camera::check_blocking_call_slot
+ * @see logger
+ * @see LOG4CXX_INFO
+ * @see ImageDataBinary
+ */
+void Camera::get_image_data_binary(ImageDataBinary &img_data)
+{
+	BlockingCallSlot slot(mBlockingCalls);
+	std::shared_ptr<ImageBuffer> image_buf;
+
+	cout << "Get image data binary." << endl;
+	LOG4CXX_INFO(logger,"Get image data binary.");
+	check_blocking_call_slot(slot,"get_image_data_binary");
+	{
+		std::lock_guard<std::mutex> lock(mImageBufMutex);
+
+		image_buf = mImageBuf;
+		img_data.x_size = mImageBufNCols;
+		img_data.y_size = mImageBufNRows;
+		img_data.xbin = mImageBufXBin;
+		img_data.ybin = mImageBufYBin;
+		img_data.frame_sequence = mImageFrameSequence;
+	}
+	image_buf_to_binary(image_buf,img_data);
+}
+
+/**
+ * Get a copy of a region of the last image read out, optionally subsampled, as packed little-endian unsigned 16-bit
+ * pixels. Only the region is copied, so a small cutout around a star costs a few kilobytes rather than a
+ * full frame transfer.
+ * <ul>
+ * <li>We lock mImageBufMutex, take a reference to the current mImageBuf and copy the image metadata 
+ *     (dimensions, binning, readout window start, orientation and frame_sequence), and then unlock mImageBufMutex.
+ * <li>If no image has been read out yet, we throw a CameraException.
+ * <li>We check the region and clip it to the image using image_region_clip, throwing a CameraException if the
+ *     region is illegal or does not overlap the image.
+ * <li>We work out the area of the detector (in unbinned pixels) the region was read out from,
+ *     using image_region_set_detector_area.
+ * <li>We copy the region's pixels into region.data using image_region_copy.
+ * </ul>
+ * @param region An ImageRegion instance to fill in with the returned region.
+ * @param x0 The first column of the region in the image, in binned pixels (starting from 0).
+ * @param y0 The first row of the region in the image, in binned pixels (starting from 0).
+ * @param w The number of columns in the region, in binned pixels.
+ * @param h The number of rows in the region, in binned pixels.
+ * @param step The subsampling step: every step'th pixel of every step'th row of the region is returned.
+ * @see Camera::mImageBuf
+ * @see Camera::mImageBufNCols
+ * @see Camera::mImageBufNRows
+ * @see Camera::mImageBufXBin
+ * @see Camera::mImageBufYBin
+ * @see Camera::mImageBufXStart
+ * @see Camera::mImageBufYStart
+ * @see Camera::mImageBufOrientation
+ * @see Camera::mImageFrameSequence
+ * @see Camera::mImageBufMutex
+ * @see image_region_clip
+ * @see image_region_set_detector_area
+ * @see image_region_copy
+ * @see Camera::mBlockingCalls
+ * @see Camera::check_blocking_call_slot
+ * @see logger
+ * @see LOG4CXX_DEBUG
+ * @see ImageRegion
+ * @see CameraException
+ */
+void Camera::get_image_region(ImageRegion &region,const int32_t x0,const int32_t y0,const int32_t w,const int32_t h,
+			      const int32_t step)
+{
+	BlockingCallSlot slot(mBlockingCalls);
+	CameraException ce;
+	std::shared_ptr<ImageBuffer> image_buf;
+	enum CCD_ORIENTATION orientation;
+	int ncols,nrows,xbin,ybin,x_start,y_start;
+
+	LOG4CXX_DEBUG(logger,"Get image region " << x0 << "," << y0 << " " << w << "x" << h << " step " << step << ".");
+	check_blocking_call_slot(slot,"get_image_region");
+	{
+		std::lock_guard<std::mutex> lock(mImageBufMutex);
+
+		image_buf = mImageBuf;
+		ncols = mImageBufNCols;
+		nrows = mImageBufNRows;
+		xbin = mImageBufXBin;
+		ybin = mImageBufYBin;
+		x_start = mImageBufXStart;
+		y_start = mImageBufYStart;
+		orientation = mImageBufOrientation;
+		region.frame_sequence = mImageFrameSequence;
+	}
+	if(image_buf == nullptr)
+	{
+		ce.message = "No image has been read out.";
+		LOG4CXX_ERROR(logger,"get_image_region:" << ce.message);
+		throw ce;
+	}
+	if(!image_region_clip(ncols,nrows,x0,y0,w,h,step,region,ce.message))
+	{
+		LOG4CXX_ERROR(logger,"get_image_region:" << ce.message);
+		throw ce;
+	}
+	image_region_set_detector_area(region,orientation,ncols,nrows,xbin,ybin,x_start,y_start);
+	image_region_copy(image_buf->data(),ncols,region);
+}
+
+/**
+ * Get an 8-bit preview of the last image read out, downsampled to fit within max_width x max_height pixels and
+ * stretched, for quick look displays. This is much smaller than the image, and quicker to render on the server
+ * than on the client.
+ * <ul>
+ * <li>We lock mImageBufMutex, take a reference to the current mImageBuf and copy the image dimensions and
+ *     mImageFrameSequence, and then unlock mImageBufMutex, so the preview is rendered outside the lock.
+ * <li>If no image has been read out we throw a CameraException.
+ * <li>We render the preview using image_preview_create with mPreviewThreadCount threads, throwing a CameraException
+ *     if it fails (for instance an illegal maximum size, or an unsupported stretch, downsample or format).
+ * </ul>
+ * @param preview A Preview instance to fill in with the preview.
+ * @param max_width The maximum number of columns in the preview.
+ * @param max_height The maximum number of rows in the preview.
+ * @param stretch The PreviewStretch to use.
+ * @param downsample The PreviewDownsample to use.
+ * @param format The PreviewFormat to return the preview in.
+ * @see Camera::mImageBuf
+ * @see Camera::mImageBufNCols
+ * @see Camera::mImageBufNRows
+ * @see Camera::mImageFrameSequence
+ * @see Camera::mImageBufMutex
+ * @see Camera::mPreviewThreadCount
+ * @see image_preview_create
+ * @see Camera::mBlockingCalls
+ * @see Camera::check_blocking_call_slot
+ * @see logger
+ * @see LOG4CXX_DEBUG
+ * @see Preview
+ * @see CameraException
+ */
+void Camera::get_preview(Preview &preview,const int32_t max_width,const int32_t max_height,
+			 const PreviewStretch::type stretch,const PreviewDownsample::type downsample,
+			 const PreviewFormat::type format)
+{
+	BlockingCallSlot slot(mBlockingCalls);
+	CameraException ce;
+	std::shared_ptr<ImageBuffer> image_buf;
+	int ncols,nrows;
+
+	LOG4CXX_DEBUG(logger,"Get preview of maximum size " << max_width << "x" << max_height << " with stretch " <<
+		      to_string(stretch) << ", downsample " << to_string(downsample) << " and format " <<
+		      to_string(format) << ".");
+	check_blocking_call_slot(slot,"get_preview");
+	{
+		std::lock_guard<std::mutex> lock(mImageBufMutex);
+
+		image_buf = mImageBuf;
+		ncols = mImageBufNCols;
+		nrows = mImageBufNRows;
+		preview.frame_sequence = mImageFrameSequence;
+	}
+	if(image_buf == nullptr)
+	{
+		ce.message = "No image has been read out.";
+		LOG4CXX_ERROR(logger,"get_preview:" << ce.message);
+		throw ce;
+	}
+	if(!image_preview_create(image_buf->data(),ncols,nrows,max_width,max_height,stretch,downsample,format,
+				 mPreviewThreadCount,preview,ce.message))
+	{
+		LOG4CXX_ERROR(logger,"get_preview:" << ce.message);
+		throw ce;
+	}
+}
+
+/**
+ * Get the statistics (minimum, maximum, mean, median, standard deviation and saturated pixel count) of an image,
+ * and of each configured region of it, and optionally it's histogram. These are computed once, when the frame is
+ * processed (process_frame), so this does not touch the pixels.
+ * <ul>
+ * <li>We lock mImageBufMutex. If frame_id is zero we take a reference to mImageStatistics, otherwise we search
+ *     mFrameHistory for a frame with the specified frame_id, and take a reference to it's statistics. We then unlock
+ *     mImageBufMutex, so the statistics are copied outside the lock.
+ * <li>If there are no statistics (no image has been read out, or the frame is not in the frame history) we throw
+ *     a CameraException.
+ * <li>We copy the statistics. Unless include_histogram is set, we clear the (65536 bin) histogram, so it is not
+ *     sent to the client.
+ * </ul>
+ * @param statistics An ImageStatistics instance to fill in with the image's statistics.
+ * @param frame_id The id of the frame to return the statistics of, as returned by list_frames or in the 
+ *        frame_sequence of get_image_data_binary, or zero for the last image read out.
+ * @param include_histogram Whether to return the image's histogram.
+ * @see Camera::mImageStatistics
+ * @see Camera::mImageBufMutex
+ * @see Camera::mFrameHistory
+ * @see Camera::process_frame
+ * @see logger
+ * @see LOG4CXX_DEBUG
+ * @see ImageStatistics
+ * @see CameraException
+ */
+void Camera::get_image_statistics(ImageStatistics &statistics,const int64_t frame_id,const bool include_histogram)
+{
+	CameraException ce;
+	std::shared_ptr<const ImageStatistics> frame_statistics;
+
+	LOG4CXX_DEBUG(logger,"Get image statistics for frame " << frame_id << (include_histogram ? " with" : " without") <<
+		      " histogram.");
+	{
+		std::lock_guard<std::mutex> lock(mImageBufMutex);
+
+		if(frame_id == 0)
+			frame_statistics = mImageStatistics;
+		else
+		{
+			for(const FrameHistoryEntry &entry : mFrameHistory)
+			{
+				if((entry.mInfo.frame_id == frame_id)&&(frame_id > 0))
+				{
+					frame_statistics = entry.mStatistics;
+					break;
+				}
+			}
+		}
+	}
+	if(frame_statistics == nullptr)
+	{
+		if(frame_id == 0)
+			ce.message = "No image has been read out.";
+		else
+			ce.message = "Frame " + std::to_string(frame_id) + " is not in the frame history.";
+		LOG4CXX_ERROR(logger,"get_image_statistics:" << ce.message);
+		throw ce;
+	}
+	statistics = *frame_statistics;
+	if(!include_histogram)
+		statistics.histogram.clear();
+}
+
+/**
+ * Return the list of codecs get_image_data_compressed can compress images with, so clients can pick the best
+ * codec they can decode.
+ * @param codecs On return of this method, the list of ImageCodec supported.
+ * @see image_codec_list
+ * @see logger
+ * @see LOG4CXX_DEBUG
+ * @see ImageCodec
+ */
+void Camera::get_image_codecs(std::vector<ImageCodec::type> &codecs)
+{
+	LOG4CXX_DEBUG(logger,"Get image codecs.");
+	image_codec_list(codecs);
+}
+
+/**
+ * Get a copy of an image, compressed with a codec, to reduce the time taken to transfer it over a slow link.
+ * <ul>
+ * <li>We check the codec is supported using image_codec_is_supported, throwing a CameraException if it is not.
+ * <li>We lock mImageBufMutex. If frame_id is zero we take a reference to the current mImageBuf and copy the image
+ *     metadata (dimensions, binning and frame_sequence), otherwise we search mFrameHistory for a frame with the
+ *     specified frame_id, and take a reference to it's image buffer and copy it's metadata. We then unlock
+ *     mImageBufMutex, so the image is compressed outside the lock.
+ * <li>If there is no image (no image has been read out, or the frame is not in the frame history) we throw 
+ *     a CameraException.
+ * <li>We compress the image in tiles, in parallel, using image_codec_compress with mImageCodecConfig, throwing
+ *     a CameraException if it fails.
+ * </ul>
+ * @param compressed A CompressedImageData instance to fill in with the compressed image.
+ * @param frame_id The id of the frame to return, as returned by list_frames or in the frame_sequence of 
+ *        get_image_data_binary, or zero for the last image read out.
+ * @param codec The ImageCodec to compress the image with.
+ * @see Camera::mImageBuf
+ * @see Camera::mImageBufNCols
+ * @see Camera::mImageBufNRows
+ * @see Camera::mImageBufXBin
+ * @see Camera::mImageBufYBin
+ * @see Camera::mImageFrameSequence
+ * @see Camera::mImageBufMutex
+ * @see Camera::mFrameHistory
+ * @see Camera::mImageCodecConfig
+ * @see image_codec_is_supported
+ * @see image_codec_compress
+ * @see Camera::mBlockingCalls
+ * @see Camera::check_blocking_call_slot
+ * @see logger
+ * @see LOG4CXX_INFO
+ * @see CompressedImageData
+ * @see CameraException
+ */
+void Camera::get_image_data_compressed(CompressedImageData &compressed,const int64_t frame_id,
+				       const ImageCodec::type codec)
+{
+	BlockingCallSlot slot(mBlockingCalls);
+	CameraException ce;
+	std::shared_ptr<ImageBuffer> image_buf;
+	int ncols,nrows;
+
+	cout << "Get image data for frame " << frame_id << " compressed with codec " << to_string(codec) << "." <<
+		endl;
+	LOG4CXX_INFO(logger,"Get image data for frame " << frame_id << " compressed with codec " << to_string(codec) <<
+		     ".");
+	check_blocking_call_slot(slot,"get_image_data_compressed");
+	if(!image_codec_is_supported(codec))
+	{
+		ce.message = "Unsupported image codec " + std::to_string((int)codec) + ".";
+		LOG4CXX_ERROR(logger,"get_image_data_compressed:" << ce.message);
+		throw ce;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mImageBufMutex);
+
+		if(frame_id == 0)
+		{
+			image_buf = mImageBuf;
+			ncols = mImageBufNCols;
+			nrows = mImageBufNRows;
+			compressed.xbin = mImageBufXBin;
+			compressed.ybin = mImageBufYBin;
+			compressed.frame_sequence = mImageFrameSequence;
+		}
+		else
+		{
+			for(const FrameHistoryEntry &entry : mFrameHistory)
+			{
+				if((entry.mInfo.frame_id == frame_id)&&(frame_id > 0))
+				{
+					image_buf = entry.mImageBuf;
+					ncols = entry.mInfo.x_size;
+					nrows = entry.mInfo.y_size;
+					compressed.xbin = entry.mInfo.xbin;
+					compressed.ybin = entry.mInfo.ybin;
+					compressed.frame_sequence = entry.mInfo.frame_id;
+					break;
+				}
+			}
+		}
+	}
+	if(image_buf == nullptr)
+	{
+		if(frame_id == 0)
+			ce.message = "No image has been read out.";
+		else
+			ce.message = "Frame " + std::to_string(frame_id) + " is not in the frame history.";
+		LOG4CXX_ERROR(logger,"get_image_data_compressed:" << ce.message);
+		throw ce;
+	}
+	if(!image_codec_compress(image_buf->data(),ncols,nrows,codec,mImageCodecConfig,compressed,ce.message))
+	{
+		LOG4CXX_ERROR(logger,"get_image_data_compressed:" << ce.message);
+		throw ce;
+	}
+}
+
+/**
+ * Return a list describing the frames currently held in the frame history. 
+ * We lock mImageBufMutex whilst copying the FrameInfo of each non-empty slot in mFrameHistory, and then 
+ * sort the list into increasing frame_id order.
+ * @param frames On return of this method, a list of FrameInfo, one per frame in the frame history.
+ * @see Camera::mImageBufMutex
+ * @see Camera::mFrameHistory
+ * @see logger
+ * @see LOG4CXX_INFO
+ * @see FrameInfo
+ */
+void Camera::list_frames(std::vector<FrameInfo> &frames)
+{
+	cout << "List frames." << endl;
+	LOG4CXX_INFO(logger,"List frames.");
+	frames.clear();
+	{
+		std::lock_guard<std::mutex> lock(mImageBufMutex);
+
+		for(const FrameHistoryEntry &entry : mFrameHistory)
+		{
+			if(entry.mInfo.frame_id > 0)
+				frames.push_back(entry.mInfo);
+		}
+	}
+	std::sort(frames.begin(),frames.end(),
+		  [](const FrameInfo &a,const FrameInfo &b){return a.frame_id < b.frame_id;});
+}
+
+/**
+ * Get a copy of a frame held in the frame history, as a packed binary blob of little-endian unsigned 16-bit pixels.
+ * <ul>
+ * <li>We lock mImageBufMutex, search mFrameHistory for a frame with the specified frame_id, and if it is found
+ *     take a reference to it's image buffer and copy it's metadata into img_data. We then unlock mImageBufMutex.
+ *     Holding a reference to the buffer stops acquire_image_buffer re-using it whilst we copy it.
+ * <li>If the frame was not found (it was never read out, or has dropped out of the history) we throw 
+ *     a CameraException.
+ * <li>We copy the pixels into img_data using image_buf_to_binary.
+ * </ul>
+ * @param img_data An ImageDataBinary instance to fill in with the returned image data.
+ * @param frame_id The id of the frame to return, as returned by list_frames or in the frame_sequence of 
+ *        get_image_data_binary.
+ * @see Camera::mImageBufMutex
+ * @see Camera::mFrameHistory
+ * @see Camera::acquire_image_buffer
+ * @see image_buf_to_binary
+ * @see Camera::mBlockingCalls
+ * @see Camera::check_blocking_call_slot
+ * @see logger
+ * @see LOG4CXX_INFO
+ * @see ImageDataBinary
+ * @see CameraException
+ */
+void Camera::get_image_data_by_id(ImageDataBinary &img_data,const int64_t frame_id)
+{
+	BlockingCallSlot slot(mBlockingCalls);
+	CameraException ce;
+	std::shared_ptr<ImageBuffer> image_buf;
+
+	cout << "Get image data for frame " << frame_id << "." << endl;
+	LOG4CXX_INFO(logger,"Get image data for frame " << frame_id << ".");
+	check_blocking_call_slot(slot,"get_image_data_by_id");
+	{
+		std::lock_guard<std::mutex> lock(mImageBufMutex);
+
+		for(const FrameHistoryEntry &entry : mFrameHistory)
+		{
+			if((entry.mInfo.frame_id == frame_id)&&(frame_id > 0))
+			{
+				image_buf = entry.mImageBuf;
+				img_data.x_size = entry.mInfo.x_size;
+				img_data.y_size = entry.mInfo.y_size;
+				img_data.xbin = entry.mInfo.xbin;
+				img_data.ybin = entry.mInfo.ybin;
+				img_data.frame_sequence = entry.mInfo.frame_id;
+				break;
+			}
+		}
+	}
+	if(image_buf == nullptr)
+	{
+		ce.message = "Frame " + std::to_string(frame_id) + " is not in the frame history.";
+		LOG4CXX_ERROR(logger,"get_image_data_by_id:" << ce.message);
+		throw ce;
+	}
+	image_buf_to_binary(image_buf,img_data);
+}
+
+/**
+ * Return the timelines of the last few frames acquired (mExposureTimings), in increasing frame_id order.
+ * Each ExposureTiming holds the time each phase of the frame's acquisition was reached, as an offset in microseconds
+ * from the request being accepted (or -1 if the phase was not reached, for instance the save phases of an
+ * unsaved frame, or of a frame still being saved). The phases are time stamped with CLOCK_MONOTONIC.
+ * @param timings On return of this method, a list of ExposureTiming, one per frame timeline kept.
+ * @see Camera::mExposureTimings
+ * @see ExposureTimingRing::get_timings
+ * @see logger
+ * @see LOG4CXX_DEBUG
+ * @see ExposureTiming
+ */
+void Camera::get_exposure_timings(std::vector<ExposureTiming> &timings)
+{
+	LOG4CXX_DEBUG(logger,"Get exposure timings.");
+	mExposureTimings.get_timings(timings);
+}
+
+/**
+ * Return the image filename of the last FITS image saved by the camera server. Images are saved in the background
+ * by the FITS writer queue, and the filename is only updated once the image has been completely written, so
+ * this never returns the filename of a partially written image.
+ * @param filename On return of this method, the filename will contain a string representation of 
+ *                 the last FITS image filename saved by the camera server.
+ * @see Camera::mLastImageFilename
+ * @see Camera::mLastImageFilenameMutex
+ */
+void Camera::get_last_image_filename(std::string &filename)
+{
+	std::lock_guard<std::mutex> lock(mLastImageFilenameMutex);
+
+	filename = mLastImageFilename;
+}
+
+/**
+ * Start cooling down the camera.
+ * <ul>
+ * <li>We retrieve the target temperature from the config file object mCameraConfig,
+ *     "ccd.target_temperature" value.
+ * <li>We set the target temperature using CCD_Temperature_Set.
+ * <li>We turn the cooler on using CCD_Temperature_Cooler_On.
+ * <li>We call request_telemetry_sample, so get_state reports the new cooler status quickly.
+ * </ul>
+ * If setting the CCD temperature fails the method can throw a CameraException 
+ * (created using create_ccd_library_exception).
+ * @see Camera::mCameraConfig
+ * @see Camera::create_ccd_library_exception
+ * @see Camera::request_telemetry_sample
+ * @see logger
+ * @see LOG4CXX_INFO
+ * @see CCD_Temperature_Set
+ * @see CCD_Temperature_Cooler_On
+ */
+void Camera::cool_down()
+{
+	CameraException ce;
+	double target_temperature;
+	int retval;
+
+	cout << "Cool down the camera." << endl;
+	LOG4CXX_INFO(logger,"Cool down the camera.");
+	/* get the target temperature */
+	mCameraConfig.get_config_double(CONFIG_CAMERA_SECTION,"ccd.target_temperature",&target_temperature);
+	LOG4CXX_INFO(logger,"Camera temperature setpoint is " << target_temperature << ".");
+	/* set the camera set-point */
+	retval = CCD_Temperature_Set(target_temperature); 
+	if(retval == FALSE)
+	{
+		ce = create_ccd_library_exception();
+		throw ce;
+	}
+	/* turn the cooler on */
+	retval = CCD_Temperature_Cooler_On();
+	if(retval == FALSE)
+	{
+		ce = create_ccd_library_exception();
+		throw ce;
+	}	
+	request_telemetry_sample();
+}
+
+/**
+ * Start warming up the camera.
+ * <ul>
+ * <li>We turn the cooler off using CCD_Temperature_Cooler_Off.
+ * <li>We call request_telemetry_sample, so get_state reports the new cooler status quickly.
+ * </ul>
+ * Note we do _not_ set the temperature to a warm setpoint, this camera's firmware will not 
+ * allow us to call SetTemperature with a warm value (i.e. 10 C).
+ * If turning the cooler off fails the method can throw a CameraException 
+ * (created using create_ccd_library_exception).
+ * @see Camera::create_ccd_library_exception
+ * @see Camera::request_telemetry_sample
+ * @see logger
+ * @see LOG4CXX_INFO
+ * @see CCD_Temperature_Cooler_Off
+ */
+void Camera::warm_up()
+{
+	CameraException ce;
+	int retval;
+
+	cout << "Warm up the camera." << endl;
+	LOG4CXX_INFO(logger,"Warm up the camera.");
+	/* turn the cooler off */
+	retval = CCD_Temperature_Cooler_Off();
+	if(retval == FALSE)
+	{
+		ce = create_ccd_library_exception();
+		throw ce;
+	}	
+	request_telemetry_sample();
+}
+
+/**
+ * This method is run as a separate thread to take a single exposure. This is the acquisition stage of the frame
+ * pipeline, it only drives the detector: the read out frame is re-oriented, published and saved by the processing
+ * stage (frame_processing_thread), so the next exposure can be started as soon as this one has been read out.
+ * <ul>
+ * <li>We set mExposureInProgress to TRUE to show we are doing an exposure.
+ *     start_expose should already have set this to TRUE.
+ * <li>If mAbort has been set (abort_exposure was called after start_expose returned), we throw an exception
+ *     rather than taking the frame.
+ * <li>We get the length of the image buffer we need by calling CCD_Setup_Get_Buffer_Length.
+ * <li>We call begin_frame to get a free image buffer of that length, and record the current detector setup
+ *     (binning, window, orientation, readout speed and gain) and the FITS header snapshot against the frame.
+ * <li>We set the start_time to zero, so the exposure starts immediately.
+ * <li>We call CCD_Exposure_Expose with the exposure length parameter to tell the camera to take an
+ *     exposure of the required length, and read out the image and store it in the frame's image buffer.
+ * <li>We increment mExposureIndex, and call hand_off_frame to hand the frame to the processing stage.
+ *     The processing stage re-orients the image, publishes it (publish_image) and, if save_image is true,
+ *     queues it to be saved to the next FITS filename by the FITS writer queue.
+ * <li>We call hand_off_end_of_exposure, so the processing stage waits for the saved image to be published
+ *     before the exposure is reported as finished.
+ * <li>We set mExposureInProgress to FALSE to show the detector is free to start another exposure.
+ * <li>We call notify_exposure_waiters (whether the exposure succeeded or not), to wake any clients
+ *     blocked in wait_for_exposure.
  * </ul>
- * @param gain_number The gain factor to configure the camera with of type Gain.
- * @see Gain
- * @see CCD_Setup_Set_Pre_Amp_Gain
- * @see #mCachedGain
+ * If any of the CCD library calls fail, we use create_ccd_library_exception to create a
+ * CameraException with a suitable error message, and then throw the exception. mExposureInProgress is reset to FALSE.
+ * Unless the exposure was aborted (mAbort is set), the error is recorded against the exposure series
+ * (mExposureSeriesId) using set_exposure_error, so it is returned by get_state and wait_for_exposure.
+ * @param exposure_length The length of one exposure in milliseconds. Should be at least 1.
+ * @param save_image A boolean, if true the acquired image is saved to a FITS file,
+ *        otherwise the acquired data is left in mImageBuf to potentially be accessed by  get_image_data.
+ * @param fits_header_set The FITS header set to save the image with, or nullptr to take a snapshot of the
+ *        client FITS headers when the exposure starts.
+ * @see Camera::mExposureInProgress
+ * @see Camera::mExposureIndex
+ * @see Camera::begin_frame
+ * @see Camera::hand_off_frame
+ * @see Camera::hand_off_end_of_exposure
+ * @see Camera::frame_processing_thread
+ * @see Camera::notify_exposure_waiters
+ * @see Camera::create_ccd_library_exception
  * @see logger
- * @see LOG4CXX_ERROR
+ * @see LOG4CXX_INFO
+ * @see CCD_Exposure_Expose
+ * @see CCD_Setup_Get_Buffer_Length
  */
-void Camera::set_gain(const Gain::type gain_number)
+void Camera::expose_thread(int32_t exposure_length, bool save_image,
+			   std::shared_ptr<const FitsHeaderSet> fits_header_set)
 {
 	CameraException ce;
-	int retval,pre_amp_gain_index;
-	
-	cout << "Set gain to " << to_string(gain_number) << "." << endl;
-	LOG4CXX_INFO(logger,"Set gain to " << to_string(gain_number) << ".");
-	/* CCD_Setup_Set_Pre_Amp_Gain takes a pre amp gain index, which according to test_andor_readout_speed_gains.c
-	** has the following values for an Andor iKon M934:
-	** Pre-amp gain index     "gain factor"  Gain (gain_number)
-	** 0                      1.0            ONE
-	** 1                      2.0            TWO
-	** 2                      4.0            FOUR
-	*/
-	switch(gain_number)
-	{
-		case Gain::ONE:
-			pre_amp_gain_index = 0;
-			break;
-		case Gain::TWO:
-			pre_amp_gain_index = 1;
-			break;
-		case Gain::FOUR:
-			pre_amp_gain_index = 2;
-			break;
-		default:
-			ce.message = "set_gain: gain_number "+ to_string(gain_number) +" is not supported.";
-			LOG4CXX_ERROR(logger,"set_gain: Throwing exception:" + ce.message);
+	struct timespec start_time;
+	AcquiredFrame frame = {};
+	size_t image_buffer_length = 0;
+	int64_t series_id;
+	int retval;
+
+	/* the series this thread is taking, set by the start_* method before the thread was started */
+	series_id = mExposureSeriesId;
+	try
+	{
+		cout << "expose thread with exposure length " << exposure_length <<
+			" ms and save_image " << save_image << "." << endl;
+		LOG4CXX_INFO(logger,"expose thread with exposure length " << exposure_length <<
+			     " ms and save_image " << save_image << ".");
+		/* already set to TRUE in start_expose, so this should not be necessary */
+		mExposureInProgress = TRUE;
+		/* abort_exposure was called after the start_expose call returned, but before we started exposing */
+		if(mAbort)
+		{
+			ce.message = "expose_thread: Aborted before the exposure was started.";
 			throw ce;
-			break;
+		}
+		/* setup image buffer */
+		retval = CCD_Setup_Get_Buffer_Length(&image_buffer_length);
+		if(retval == FALSE)
+		{
+			ce = create_ccd_library_exception();
+			throw ce;
+		}
+		begin_frame(frame,image_buffer_length,exposure_length,true,save_image,fits_header_set);
+		/* start time is now */
+		start_time.tv_sec = 0;
+		start_time.tv_nsec = 0;
+		/* take the image */
+		retval = CCD_Exposure_Expose(TRUE,start_time,exposure_length,(void*)(frame.mImageBuf->data()),
+					     image_buffer_length);
+		if(retval == FALSE)
+		{
+			ce = create_ccd_library_exception();
+			throw ce;
+		}
+		/* a new image has been read out, hand it to the processing stage to be re-oriented, published
+		** and saved, whilst the detector is free to take the next exposure */
+		mExposureIndex++;
+		hand_off_frame(frame);
+		hand_off_end_of_exposure();
+		mExposureInProgress = FALSE;
 	}
-	LOG4CXX_DEBUG(logger,"Gain " << to_string(gain_number) << " has pre-amp gain index of " <<
-		      std::to_string(pre_amp_gain_index) << ".");
-	retval = CCD_Setup_Set_Pre_Amp_Gain(pre_amp_gain_index);
-	if(retval == FALSE)
+	catch(TException&e)
 	{
-		ce = create_ccd_library_exception();
-		throw ce;
+		if(mAbort == FALSE)
+			set_exposure_error(series_id,exception_to_error(e));
+		hand_off_end_of_exposure();
+		mExposureInProgress = FALSE;
+		cerr << "expose_thread: Caught TException: " << e.what() << "." << endl;
+		LOG4CXX_ERROR(logger,"expose_thread:Caught TException: " << e.what() << ".");
 	}
-	/* update the cached gain value (used for status serving */
-	mCachedGain = gain_number;
-	LOG4CXX_INFO(logger,"Gain now set to " << to_string(gain_number) <<
-		     " , pre-amp gain index " << std::to_string(pre_amp_gain_index) <<".");
+	catch(exception& e)
+	{
+		if(mAbort == FALSE)
+			set_exposure_error(series_id,exception_to_error(e));
+		hand_off_end_of_exposure();
+		mExposureInProgress = FALSE;
+		cerr << "expose_thread:Caught Exception: " << e.what()  << "." << endl;
+		LOG4CXX_FATAL(logger,"expose_thread:Caught Exception: " << e.what()  << ".");
+	}
+	/* wake any clients blocked in wait_for_exposure */
+	notify_exposure_waiters();
 }
 
 /**
- * Add a list of  FITS header to the list of FITS headers to be saved to FITS images.
- * If A FITS header with the specified keyword already exists in the list of headers, it's contents are updated.
- * @param fits_info The list of FITS header cards to add to the FITS header.
- * @see FitsHeaderCard
+ * This method is run as a separate thread to actually take a bias frame. This is the acquisition stage of the
+ * frame pipeline, the read out frame is re-oriented, published and saved by the processing stage
+ * (frame_processing_thread).
+ * <ul>
+ * <li>We set mExposureInProgress to TRUE to show we are doing an exposure.
+ *     start_bias should already have set this to TRUE.
+ * <li>If mAbort has been set (abort_exposure was called after start_bias returned), we throw an exception
+ *     rather than taking the frame.
+ * <li>We get the length of the image buffer we need by calling CCD_Setup_Get_Buffer_Length.
+ * <li>We call begin_frame to get a free image buffer of that length, and record the current detector setup
+ *     against the frame. Bias frames are always saved.
+ * <li>We call CCD_Exposure_Bias to tell the camera to take a
+ *     bias frame, and read out the image and store it in the frame's image buffer.
+ * <li>We increment mExposureIndex, and call hand_off_frame to hand the frame to the processing stage,
+ *     which re-orients, publishes and saves it.
+ * <li>We call hand_off_end_of_exposure, so the processing stage waits for the saved image to be published
+ *     before the bias is reported as finished.
+ * <li>We set mExposureInProgress to FALSE to show the detector is free to start another exposure.
+ * <li>We call notify_exposure_waiters (whether the exposure succeeded or not), to wake any clients
+ *     blocked in wait_for_exposure.
+ * </ul>
+ * If any of the CCD library calls fail, we use create_ccd_library_exception to create a
+ * CameraException with a suitable error message, and then throw the exception. mExposureInProgress is reset to FALSE.
+ * Unless the exposure was aborted (mAbort is set), the error is recorded against the exposure series
+ * (mExposureSeriesId) using set_exposure_error, so it is returned by get_state and wait_for_exposure.
+ * @see Camera::mExposureInProgress
+ * @see Camera::mExposureIndex
+ * @see Camera::begin_frame
+ * @see Camera::hand_off_frame
+ * @see Camera::hand_off_end_of_exposure
+ * @see Camera::frame_processing_thread
+ * @see Camera::notify_exposure_waiters
+ * @see Camera::create_ccd_library_exception
  * @see logger
  * @see LOG4CXX_INFO
- * @see Camera::add_fits_header
+ * @see CCD_Exposure_Bias
+ * @see CCD_Setup_Get_Buffer_Length
  */
-void Camera::set_fits_headers(const std::vector<FitsHeaderCard> & fits_info)
+void Camera::bias_thread()
 {
-	cout << "Set FITS headers." << endl;
-	LOG4CXX_INFO(logger,"Set FITS headers.");
-	for (auto it = begin(fits_info); it != end(fits_info); ++it )
+	CameraException ce;
+	AcquiredFrame frame = {};
+	size_t image_buffer_length = 0;
+	int64_t series_id;
+	int retval;
+
+	/* the series this thread is taking, set by the start_* method before the thread was started */
+	series_id = mExposureSeriesId;
+	try
 	{
-		add_fits_header(it->key,it->valtype,it->val,it->comment);
+		cout << "bias thread started." << endl;
+		LOG4CXX_INFO(logger,"bias thread started.");
+		/* already set to TRUE in start_bias, so this should not be necessary */
+		mExposureInProgress = TRUE;
+		/* abort_exposure was called after the start_bias call returned, but before we started exposing */
+		if(mAbort)
+		{
+			ce.message = "bias_thread: Aborted before the exposure was started.";
+			throw ce;
+		}
+		/* setup image buffer */
+		retval = CCD_Setup_Get_Buffer_Length(&image_buffer_length);
+		if(retval == FALSE)
+		{
+			ce = create_ccd_library_exception();
+			throw ce;
+		}
+		begin_frame(frame,image_buffer_length,0,false,true);
+		/* take the image */
+		retval = CCD_Exposure_Bias((void*)(frame.mImageBuf->data()),image_buffer_length);
+		if(retval == FALSE)
+		{
+			ce = create_ccd_library_exception();
+			throw ce;
+		}
+		/* a new image has been read out, hand it to the processing stage to be re-oriented, published
+		** and saved, whilst the detector is free to take the next exposure */
+		mExposureIndex++;
+		hand_off_frame(frame);
+		hand_off_end_of_exposure();
+		mExposureInProgress = FALSE;
+	}
+	catch(TException&e)
+	{
+		if(mAbort == FALSE)
+			set_exposure_error(series_id,exception_to_error(e));
+		hand_off_end_of_exposure();
+		mExposureInProgress = FALSE;
+		cerr << "bias_thread: Caught TException: " << e.what() << "." << endl;
+		LOG4CXX_ERROR(logger,"bias_thread: Caught TException: " << e.what() << ".");
+	}
+	catch(exception& e)
+	{
+		if(mAbort == FALSE)
+			set_exposure_error(series_id,exception_to_error(e));
+		hand_off_end_of_exposure();
+		mExposureInProgress = FALSE;
+		cerr << "bias_thread: Caught Exception: " << e.what()  << "." << endl;
+		LOG4CXX_FATAL(logger,"bias_thread: Caught Exception: " << e.what()  << ".");
 	}
+	/* wake any clients blocked in wait_for_exposure */
+	notify_exposure_waiters();
 }
 
 /**
- * Add a FITS header to the list of FITS headers to be saved to FITS images.
- * If A FITS header with the specified keyword already exists in the list of headers, it's contents are updated.
- * @param keyword The FITS header card keyword.
- * @param valtype What kind of value this header takes, of type FitsCardType.
- * @param value A string representation of the value.
- * @param comment A string containing a comment for this header.
- * @see FitsCardType
- * @see Camera::mFitsHeader
+ * This method is run as a separate thread to take a dark frame. This is the acquisition stage of the frame
+ * pipeline, the read out frame is re-oriented, published and saved by the processing stage
+ * (frame_processing_thread).
+ * <ul>
+ * <li>We set mExposureInProgress to TRUE to show we are doing an exposure.
+ *     start_dark should already have set this to TRUE.
+ * <li>If mAbort has been set (abort_exposure was called after start_dark returned), we throw an exception
+ *     rather than taking the frame.
+ * <li>We get the length of the image buffer we need by calling CCD_Setup_Get_Buffer_Length.
+ * <li>We call begin_frame to get a free image buffer of that length, and record the current detector setup
+ *     against the frame. Dark frames are always saved.
+ * <li>We set the start_time to zero, so the exposure starts immediately.
+ * <li>We call CCD_Exposure_Expose with the exposure length parameter to tell the camera to take a
+ *     dark exposure of the required length, and read out the image and store it in the frame's image buffer.
+ * <li>We increment mExposureIndex, and call hand_off_frame to hand the frame to the processing stage,
+ *     which re-orients, publishes and saves it.
+ * <li>We call hand_off_end_of_exposure, so the processing stage waits for the saved image to be published
+ *     before the dark is reported as finished.
+ * <li>We set mExposureInProgress to FALSE to show the detector is free to start another exposure.
+ * <li>We call notify_exposure_waiters (whether the exposure succeeded or not), to wake any clients
+ *     blocked in wait_for_exposure.
+ * </ul>
+ * If any of the CCD library calls fail, we use create_ccd_library_exception to create a
+ * CameraException with a suitable error message, and then throw the exception. mExposureInProgress is reset to FALSE.
+ * Unless the exposure was aborted (mAbort is set), the error is recorded against the exposure series
+ * (mExposureSeriesId) using set_exposure_error, so it is returned by get_state and wait_for_exposure.
+ * @param exposure_length The length of one exposure in milliseconds. Should be at least 1.
+ * @see Camera::mExposureInProgress
+ * @see Camera::mExposureIndex
+ * @see Camera::begin_frame
+ * @see Camera::hand_off_frame
+ * @see Camera::hand_off_end_of_exposure
+ * @see Camera::frame_processing_thread
+ * @see Camera::notify_exposure_waiters
  * @see Camera::create_ccd_library_exception
  * @see logger
  * @see LOG4CXX_INFO
- * @see LOG4CXX_ERROR
- * @see CCD_Fits_Header_Add_Int
- * @see CCD_Fits_Header_Add_Float
- * @see CCD_Fits_Header_Add_String
+ * @see CCD_Exposure_Expose
+ * @see CCD_Setup_Get_Buffer_Length
  */
-void Camera::add_fits_header(const std::string & keyword, const FitsCardType::type valtype,const std::string & value,
-			 const std::string & comment)
+void Camera::dark_thread(int32_t exposure_length)
 {
 	CameraException ce;
-	int retval,ivalue;
-	double dvalue;
-	
-	cout << "Add FITS header " << keyword  << " of type " << to_string(valtype) << " and value " << value << endl;
-	LOG4CXX_INFO(logger,"Add FITS header " << keyword  << " of type " << to_string(valtype) <<
-		     " and value " << value );
-	switch(valtype)
+	struct timespec start_time;
+	AcquiredFrame frame = {};
+	size_t image_buffer_length = 0;
+	int64_t series_id;
+	int retval;
+
+	/* the series this thread is taking, set by the start_* method before the thread was started */
+	series_id = mExposureSeriesId;
+	try
 	{
-		case FitsCardType::INTEGER:
-			retval = sscanf(value.c_str(),"%d",&ivalue);
-			if(retval != 1)
-			{
-				ce.message = "add_fits_header: Failed to parse string "+ value +" to an integer ("+
-					std::to_string(retval) +").";
-				LOG4CXX_ERROR(logger,"add_fits_header: Throwing exception:" + ce.message);
-				throw ce;
-			}
-			retval = CCD_Fits_Header_Add_Int(&mFitsHeader,(char*)(keyword.c_str()),ivalue,
-							 (char*)(comment.c_str()));
-			if(retval == FALSE)
-			{
-				ce = create_ccd_library_exception();
-				throw ce;
-			}	
-			break;
-		case FitsCardType::FLOAT:
-			retval = sscanf(value.c_str(),"%lf",&dvalue);
-			if(retval != 1)
+		cout << "dark thread with exposure length " << exposure_length << "ms." << endl;
+		LOG4CXX_INFO(logger,"dark thread with exposure length " << exposure_length << "ms.");
+		/* already set to TRUE in start_expose, so this should not be necessary */
+		mExposureInProgress = TRUE;
+		/* abort_exposure was called after the start_dark call returned, but before we started exposing */
+		if(mAbort)
+		{
+			ce.message = "dark_thread: Aborted before the exposure was started.";
+			throw ce;
+		}
+		/* setup image buffer */
+		retval = CCD_Setup_Get_Buffer_Length(&image_buffer_length);
+		if(retval == FALSE)
+		{
+			ce = create_ccd_library_exception();
+			throw ce;
+		}
+		begin_frame(frame,image_buffer_length,exposure_length,false,true);
+		/* start time is now */
+		start_time.tv_sec = 0;
+		start_time.tv_nsec = 0;
+		/* take the image */
+		retval = CCD_Exposure_Expose(FALSE,start_time,exposure_length,(void*)(frame.mImageBuf->data()),
+					     image_buffer_length);
+		if(retval == FALSE)
+		{
+			ce = create_ccd_library_exception();
+			throw ce;
+		}
+		/* a new image has been read out, hand it to the processing stage to be re-oriented, published
+		** and saved, whilst the detector is free to take the next exposure */
+		mExposureIndex++;
+		hand_off_frame(frame);
+		hand_off_end_of_exposure();
+		mExposureInProgress = FALSE;
+	}
+	catch(TException&e)
+	{
+		if(mAbort == FALSE)
+			set_exposure_error(series_id,exception_to_error(e));
+		hand_off_end_of_exposure();
+		mExposureInProgress = FALSE;
+		cerr << "dark_thread: Caught TException: " << e.what() << "." << endl;
+		LOG4CXX_ERROR(logger,"dark_thread: Caught TException: " << e.what() << ".");
+	}
+	catch(exception& e)
+	{
+		if(mAbort == FALSE)
+			set_exposure_error(series_id,exception_to_error(e));
+		hand_off_end_of_exposure();
+		mExposureInProgress = FALSE;
+		cerr << "dark_thread: Caught Exception: " << e.what()  << "." << endl;
+		LOG4CXX_FATAL(logger,"dark_thread: Caught Exception: " << e.what()  << ".");
+	}
+	/* wake any clients blocked in wait_for_exposure */
+	notify_exposure_waiters();
+}
+
+/**
+ * This method is run as a separate thread to take a series of frames (a multbias, multdark or multrun).
+ * The whole series is taken in this one thread, which is the acquisition stage of the frame pipeline: as soon as
+ * frame N has been read out it is handed to the processing stage (frame_processing_thread), which re-orients,
+ * publishes and saves it whilst this thread is already acquiring frame N+1 into another image buffer.
+ * <ul>
+ * <li>We set mExposureInProgress to TRUE to show we are doing an exposure.
+ *     start_multrun / start_multbias / start_multdark should already have set this to TRUE.
+ * <li>We set mExposureIndex to 0, set mExposureCount to exposure_count and reset mDutyCycle, mFrameExposureLength
+ *     and mFrameReadoutLength. mAbort has already been reset by the start_* method, and is not reset here, so an
+ *     abort before this thread started is honoured.
+ * <li>We get the length of the image buffer each frame needs by calling CCD_Setup_Get_Buffer_Length.
+ * <li>We record the start time of the series.
+ * <li>We loop over the number of frames to take:
+ *     <ul>
+ *     <li>We call begin_frame to get a free image buffer to read out into, and record the current detector setup
+ *         against the frame.
+ *     <li>If open_shutter is FALSE and exposure_length is zero we call CCD_Exposure_Bias to take a bias frame,
+ *         otherwise we call CCD_Exposure_Expose with the open_shutter and exposure_length parameters,
+ *         to take an exposure/dark and store it in the frame's image buffer.
+ *     <li>We retrieve the time stamps of the frame's acquisition phases using CCD_Exposure_Timeline_Get, and add
+ *         the measured exposure length (start to acquired phases, zero for a bias) and readout length (acquired to
+ *         readout phases) to the totals for the series.
+ *     <li>We increment mExposureIndex, and call hand_off_frame to hand the frame to the processing stage.
+ *         The processing stage re-orients the image, publishes it (publish_image) and, if save_images is true,
+ *         queues it to be saved to the next FITS filename by the FITS writer queue.
+ *         hand_off_frame only blocks if the processing stage has fallen more than a pipeline length behind.
+ *     <li>We update mDutyCycle, the measured exposure length of the frames read out so far divided by the time
+ *         since the series was started, and the mean measured exposure and readout lengths per frame
+ *         (mFrameExposureLength and mFrameReadoutLength).
+ *     <li>If mAbort has been set (by abort_exposure), or processing one of this series' frames has failed
+ *         (get_exposure_error returns an error for the series), we stop taking frames.
+ *     </ul>
+ * <li>We log the measured duty cycle, and mean exposure and readout lengths.
+ * <li>We call hand_off_end_of_exposure, so the processing stage waits for the saved images to be published
+ *     before the series is reported as finished.
+ * <li>We set mExposureInProgress to FALSE to show the detector is free to start another exposure.
+ * <li>We call notify_exposure_waiters (whether the exposure succeeded or not), to wake any clients
+ *     blocked in wait_for_exposure.
+ * </ul>
+ * If any of the CCD library calls fail, we use create_ccd_library_exception to create a
+ * CameraException with a suitable error message, and then throw the exception. mExposureInProgress is reset to FALSE.
+ * Unless the exposure was aborted (mAbort is set), the error is recorded against the exposure series
+ * (mExposureSeriesId) using set_exposure_error, so it is returned by get_state and wait_for_exposure.
+ * @param exposure_count The number of frames to take. Should be at least 1.
+ * @param exposure_length The length of each exposure in milliseconds. Should be at least 1
+ *        for exposures and darks, and zero for biases.
+ * @param open_shutter A boolean, true to open the shutter during each exposure, false to keep it closed
+ *        (for biases and darks).
+ * @param save_images A boolean, if true each acquired image is saved to a FITS file,
+ *        otherwise the last acquired image is left in mImageBuf to potentially be accessed by get_image_data.
+ * @see Camera::mExposureInProgress
+ * @see Camera::mAbort
+ * @see Camera::mExposureIndex
+ * @see Camera::mExposureCount
+ * @see Camera::mDutyCycle
+ * @see Camera::mFrameExposureLength
+ * @see Camera::mFrameReadoutLength
+ * @see Camera::mExposureSeriesId
+ * @see Camera::set_exposure_error
+ * @see Camera::get_exposure_error
+ * @see Camera::begin_frame
+ * @see Camera::hand_off_frame
+ * @see Camera::hand_off_end_of_exposure
+ * @see Camera::frame_processing_thread
+ * @see Camera::notify_exposure_waiters
+ * @see Camera::create_ccd_library_exception
+ * @see logger
+ * @see LOG4CXX_INFO
+ * @see CCD_Exposure_Bias
+ * @see CCD_Exposure_Expose
+ * @see CCD_Exposure_Timeline_Get
+ * @see CCD_Setup_Get_Buffer_Length
+ */
+void Camera::multrun_thread(int32_t exposure_count,int32_t exposure_length,bool open_shutter,bool save_images)
+{
+	CameraException ce;
+	std::chrono::steady_clock::time_point multrun_start_time;
+	struct CCD_Exposure_Timeline_Struct timeline;
+	struct timespec start_time;
+	AcquiredFrame frame = {};
+	size_t image_buffer_length = 0;
+	double elapsed_length,total_exposure_length,total_readout_length;
+	int64_t series_id;
+	int retval;
+
+	/* the series this thread is taking, set by the start_* method before the thread was started */
+	series_id = mExposureSeriesId;
+	try
+	{
+		cout << "multrun thread with exposure count " << exposure_count << ", exposure length " <<
+			exposure_length << " ms, open_shutter " << open_shutter << " and save_images " <<
+			save_images << "." << endl;
+		LOG4CXX_INFO(logger,"multrun thread with exposure count " << exposure_count << ", exposure length " <<
+			     exposure_length << " ms, open_shutter " << open_shutter << " and save_images " <<
+			     save_images << ".");
+		/* already set to TRUE in start_multrun etc, so this should not be necessary */
+		mExposureInProgress = TRUE;
+		mExposureIndex = 0;
+		mExposureCount = exposure_count;
+		mDutyCycle = 0.0;
+		mFrameExposureLength = 0.0;
+		mFrameReadoutLength = 0.0;
+		total_exposure_length = 0.0;
+		total_readout_length = 0.0;
+		/* setup image buffer */
+		retval = CCD_Setup_Get_Buffer_Length(&image_buffer_length);
+		if(retval == FALSE)
+		{
+			ce = create_ccd_library_exception();
+			throw ce;
+		}
+		multrun_start_time = std::chrono::steady_clock::now();
+		while((mExposureIndex < exposure_count)&&(mAbort == FALSE)&&(get_exposure_error(series_id).empty()))
+		{
+			LOG4CXX_INFO(logger,"multrun thread starting frame " << (mExposureIndex+1) << " of " <<
+				     exposure_count << ".");
+			/* read out into a free buffer, whilst the processing stage works on the previous frame */
+			begin_frame(frame,image_buffer_length,exposure_length,open_shutter,save_images);
+			/* take the image */
+			if((open_shutter == false)&&(exposure_length == 0))
 			{
-				ce.message = "add_fits_header: Failed to parse string "+ value +" to a double ("+
-					std::to_string(retval) +").";
-				LOG4CXX_ERROR(logger,"add_fits_header: Throwing exception:" + ce.message);
-				throw ce;
+				retval = CCD_Exposure_Bias((void*)(frame.mImageBuf->data()),image_buffer_length);
 			}
-			retval = CCD_Fits_Header_Add_Float(&mFitsHeader,(char*)(keyword.c_str()),dvalue,
-							   (char*)(comment.c_str()));
-			if(retval == FALSE)
+			else
 			{
-				ce = create_ccd_library_exception();
-				throw ce;
-			}	
-			break;
-		case FitsCardType::STRING:
-			retval = CCD_Fits_Header_Add_String(&mFitsHeader,(char*)(keyword.c_str()),(char*)(value.c_str()),
-							    (char*)(comment.c_str()));
+				/* start time is now */
+				start_time.tv_sec = 0;
+				start_time.tv_nsec = 0;
+				retval = CCD_Exposure_Expose(open_shutter,start_time,exposure_length,
+							     (void*)(frame.mImageBuf->data()),image_buffer_length);
+			}
 			if(retval == FALSE)
 			{
 				ce = create_ccd_library_exception();
 				throw ce;
-			}	
-			break;
-		default:
-			break;
+			}
+			/* measure how long the detector spent exposing and reading out the frame */
+			CCD_Exposure_Timeline_Get(&timeline);
+			if(exposure_length > 0)
+			{
+				total_exposure_length += fdifftime(timeline.Phase_Time[CCD_EXPOSURE_TIMELINE_ACQUIRED],
+								   timeline.Phase_Time[CCD_EXPOSURE_TIMELINE_START])*
+					((double)CCD_GENERAL_ONE_SECOND_MS);
+			}
+			total_readout_length += fdifftime(timeline.Phase_Time[CCD_EXPOSURE_TIMELINE_READOUT],
+							  timeline.Phase_Time[CCD_EXPOSURE_TIMELINE_ACQUIRED])*
+				((double)CCD_GENERAL_ONE_SECOND_MS);
+			/* a new image has been read out, hand it to the processing stage to be re-oriented,
+			** published and saved, and go straight on to the next frame */
+			mExposureIndex++;
+			hand_off_frame(frame);
+			elapsed_length = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-
+										 multrun_start_time).count();
+			if(elapsed_length > 0.0)
+				mDutyCycle = total_exposure_length/elapsed_length;
+			mFrameExposureLength = total_exposure_length/((double)mExposureIndex);
+			mFrameReadoutLength = total_readout_length/((double)mExposureIndex);
+		}/* end while */
+		if(mAbort)
+		{
+			cout << "multrun thread aborted after " << mExposureIndex << " of " << exposure_count <<
+				" frames." << endl;
+			LOG4CXX_INFO(logger,"multrun thread aborted after " << mExposureIndex << " of " <<
+				     exposure_count << " frames.");
+		}
+		else if(mExposureIndex < exposure_count)
+		{
+			cout << "multrun thread stopped after " << mExposureIndex << " of " << exposure_count <<
+				" frames, as processing a frame failed." << endl;
+			LOG4CXX_INFO(logger,"multrun thread stopped after " << mExposureIndex << " of " <<
+				     exposure_count << " frames, as processing a frame failed.");
+		}
+		cout << "multrun thread acquired " << mExposureIndex << " frames with a duty cycle of " <<
+			(mDutyCycle*100.0) << "%, a mean exposure length of " << mFrameExposureLength <<
+			" ms and a mean readout length of " << mFrameReadoutLength << " ms." << endl;
+		LOG4CXX_INFO(logger,"multrun thread acquired " << mExposureIndex << " frames with a duty cycle of " <<
+			     (mDutyCycle*100.0) << "%, a mean exposure length of " << mFrameExposureLength <<
+			     " ms and a mean readout length of " << mFrameReadoutLength << " ms.");
+		/* the processing stage reports the series finished once the saved images have been published */
+		hand_off_end_of_exposure();
+		mExposureInProgress = FALSE;
+	}
+	catch(TException&e)
+	{
+		if(mAbort == FALSE)
+			set_exposure_error(series_id,exception_to_error(e));
+		hand_off_end_of_exposure();
+		mExposureInProgress = FALSE;
+		cerr << "multrun_thread: Caught TException: " << e.what() << "." << endl;
+		LOG4CXX_ERROR(logger,"multrun_thread:Caught TException: " << e.what() << ".");
 	}
+	catch(exception& e)
+	{
+		if(mAbort == FALSE)
+			set_exposure_error(series_id,exception_to_error(e));
+		hand_off_end_of_exposure();
+		mExposureInProgress = FALSE;
+		cerr << "multrun_thread: Caught Exception: " << e.what()  << "." << endl;
+		LOG4CXX_FATAL(logger,"multrun_thread: Caught Exception: " << e.what()  << ".");
+	}
+	/* wake any clients blocked in wait_for_exposure */
+	notify_exposure_waiters();
 }
 
 /**
- * Entry point to a routine to clear out FITS headers.
- * @see Camera::mFitsHeader
- * @see Camera::create_ccd_library_exception
- * @see logger
- * @see LOG4CXX_INFO
- * @see CCD_Fits_Header_Clear
+ * Start acquiring a new frame: get a free image buffer to read out into, and record the current detector setup
+ * against the frame. The setup is recorded before the exposure starts, as it is used by the processing stage
+ * (to re-orient the image and generate the FITS headers) after the detector may have been reconfigured.
+ * <ul>
+ * <li>We get a free image buffer of image_buffer_length pixels using acquire_image_buffer.
+ * <li>We record the binned dimensions of the frame as read out (CCD_Setup_Get_Binned_NCols /
+ *     CCD_Setup_Get_Binned_NRows), and once re-oriented (CCD_Setup_Get_Image_NCols / CCD_Setup_Get_Image_NRows).
+ *     These are the dimensions of the sub-window if one has been set.
+ * <li>We record the binning, readout window start and orientation from the CCD library.
+ * <li>We record the exposure length, whether the shutter is opened and whether the frame is to be saved.
+ *     The start time and temperature are filled in by hand_off_frame once the frame has been read out.
+ * <li>We record the exposure series the frame is taken in (mExposureSeriesId).
+ * <li>We clear the frame's timeline, and set it's request phase: for the first frame of an exposure
+ *     (mExposureIndex is zero) to the time the request was accepted (mRequestTime), otherwise to now.
+ * <li>If the frame is to be saved, we record the FITS header set it is saved with: fits_header_set if one was
+ *     specified, otherwise a snapshot of the current client FITS headers (get_fits_header_snapshot with an id of 0).
+ *     Clients can then change the client FITS headers for the next frame whilst this one is acquired and saved.
+ *     We also take a reference to the precomputed camera FITS headers for the current setup (mCameraFitsHeader),
+ *     whilst holding mCameraFitsHeaderMutex.
+ * </ul>
+ * @param frame The frame to fill in.
+ * @param image_buffer_length The number of pixels the image buffer has to hold (CCD_Setup_Get_Buffer_Length).
+ * @param exposure_length The exposure length in milliseconds (zero for a bias).
+ * @param open_shutter Whether the shutter is opened for the frame (false for a bias or dark).
+ * @param save_image Whether the frame is to be saved to a FITS image.
+ * @param fits_header_set The FITS header set to save the frame with, or nullptr (the default) to use a snapshot of
+ *        the client FITS headers.
+ * @see Camera::AcquiredFrame
+ * @see Camera::acquire_image_buffer
+ * @see Camera::get_fits_header_snapshot
+ * @see Camera::hand_off_frame
+ * @see Camera::mCameraFitsHeader
+ * @see Camera::mCameraFitsHeaderMutex
+ * @see Camera::mExposureIndex
+ * @see Camera::mExposureSeriesId
+ * @see Camera::mRequestTime
+ * @see CCD_Setup_Get_Binned_NCols
+ * @see CCD_Setup_Get_Binned_NRows
+ * @see CCD_Setup_Get_Image_NCols
+ * @see CCD_Setup_Get_Image_NRows
+ * @see CCD_Setup_Get_Bin_X
+ * @see CCD_Setup_Get_Bin_Y
+ * @see CCD_Setup_Get_Horizontal_Start
+ * @see CCD_Setup_Get_Vertical_Start
+ * @see CCD_Setup_Get_Orientation
+ * @see CCD_Exposure_Timeline_Clear
+ * @see CCD_Exposure_Timeline_Mark
  */
-void Camera::clear_fits_headers()
+void Camera::begin_frame(AcquiredFrame &frame,size_t image_buffer_length,int32_t exposure_length,bool open_shutter,
+			 bool save_image,std::shared_ptr<const FitsHeaderSet> fits_header_set)
 {
-	CameraException ce;
-	int retval;
-	
-	cout << "Clear FITS headers." << endl;
-	LOG4CXX_INFO(logger,"Clear FITS headers.");
-	retval = CCD_Fits_Header_Clear(&mFitsHeader);
-	if(retval == FALSE)
+	frame.mImageBuf = acquire_image_buffer(image_buffer_length);
+	frame.mImageBufferLength = image_buffer_length;
+	frame.mBinnedNCols = CCD_Setup_Get_Binned_NCols();
+	frame.mBinnedNRows = CCD_Setup_Get_Binned_NRows();
+	frame.mNCols = CCD_Setup_Get_Image_NCols();
+	frame.mNRows = CCD_Setup_Get_Image_NRows();
+	frame.mXBin = CCD_Setup_Get_Bin_X();
+	frame.mYBin = CCD_Setup_Get_Bin_Y();
+	frame.mXStart = CCD_Setup_Get_Horizontal_Start();
+	frame.mYStart = CCD_Setup_Get_Vertical_Start();
+	frame.mOrientation = CCD_Setup_Get_Orientation();
+	frame.mTemperature = 0.0;
+	frame.mStartTime.tv_sec = 0;
+	frame.mStartTime.tv_nsec = 0;
+	frame.mExposureLength = exposure_length;
+	frame.mOpenShutter = open_shutter;
+	frame.mSaveImage = save_image;
+	frame.mSeriesId = mExposureSeriesId;
+	CCD_Exposure_Timeline_Clear(&(frame.mTimeline));
+	if(mExposureIndex == 0)
+		frame.mTimeline.Phase_Time[CCD_EXPOSURE_TIMELINE_REQUEST] = mRequestTime;
+	else
+		CCD_Exposure_Timeline_Mark(&(frame.mTimeline),CCD_EXPOSURE_TIMELINE_REQUEST);
+	if(!save_image)
 	{
-		ce = create_ccd_library_exception();
-		throw ce;
-	}	
+		frame.mFitsHeaderSet = nullptr;
+		frame.mCameraFitsHeaderSet = nullptr;
+		return;
+	}
+	if(fits_header_set != nullptr)
+		frame.mFitsHeaderSet = fits_header_set;
+	else
+		frame.mFitsHeaderSet = get_fits_header_snapshot(0);
+	std::lock_guard<std::mutex> lock(mCameraFitsHeaderMutex);
+	frame.mCameraFitsHeaderSet = mCameraFitsHeader;
 }
 
 /**
- * Thrift entry point to set the exposure length to use for subsequent darks and exposures.
- * @param exposure_length The exposure length to use, in milliseconds.
- * @see Camera::mCachedExposureLength
+ * Hand a read out frame from the acquisition stage (an exposure thread) to the processing stage
+ * (frame_processing_thread).
+ * <ul>
+ * <li>We retrieve the frame's exposure start time using CCD_Exposure_Start_Time_Get, and the time stamps of
+ *     the exposure's setup to readout phases into the frame's timeline using CCD_Exposure_Timeline_Get.
+ * <li>We retrieve the CCD temperature for the CCDTEMP FITS header using get_frame_temperature. This returns the
+ *     cached temperature sample (kept up to date by the telemetry thread), so the acquisition thread does not
+ *     call the driver between frames. We do this for frames that are not saved as well, but only a saved frame 
+ *     fails if the temperature cannot be retrieved.
+ * <li>We increment mFramesPendingCount, so the exposure is still reported as in progress until the
+ *     frame has been processed.
+ * <li>We wait on mFramePipelineFree for a free slot in mFramePipeline. This only blocks if the processing
+ *     stage has fallen behind.
+ * <li>We push the frame onto mFramePipeline (moving the image buffer reference into the queue), and post
+ *     mFramePipelineFilled to wake the processing stage.
+ * </ul>
+ * If the temperature for a saved frame cannot be retrieved, the CameraException thrown by get_frame_temperature is
+ * rethrown, and the frame is not handed off.
+ * @param frame The read out frame, filled in by begin_frame. It's image buffer reference is moved into the queue.
+ * @see Camera::AcquiredFrame
+ * @see Camera::begin_frame
+ * @see Camera::mFramePipeline
+ * @see Camera::mFramePipelineFree
+ * @see Camera::mFramePipelineFilled
+ * @see Camera::mFramesPendingCount
+ * @see Camera::create_ccd_library_exception
+ * @see Camera::get_frame_temperature
+ * @see CCD_Exposure_Start_Time_Get
+ * @see CCD_Exposure_Timeline_Get
  */
-void Camera::set_exposure_length(const int32_t exposure_length)
+void Camera::hand_off_frame(AcquiredFrame &frame)
 {
-	CameraException ce;
-
-	cout << "Setting exposure length to " << exposure_length << "ms a." << endl;
-	LOG4CXX_INFO(logger,"Setting exposure length to  " << exposure_length << "ms.");
-	if(exposure_length < 0)
+	CCD_Exposure_Start_Time_Get(&(frame.mStartTime));
+	CCD_Exposure_Timeline_Get(&(frame.mTimeline));
+	try
 	{
-		ce.message = "set_exposure_length: exposure length " + std::to_string((int)exposure_length) +
-			" is too small.";
-		LOG4CXX_ERROR(logger,ce.message);
-		throw ce;
+		frame.mTemperature = get_frame_temperature();
 	}
-	mCachedExposureLength = exposure_length;
+	catch(CameraException &e)
+	{
+		/* get_frame_temperature has logged the error */
+		if(frame.mSaveImage)
+			throw;
+	}
+	mFramesPendingCount++;
+	while((sem_wait(&mFramePipelineFree) != 0)&&(errno == EINTR))
+		;
+	/* we own a free slot, so this cannot fail */
+	mFramePipeline->try_push(frame);
+	sem_post(&mFramePipelineFilled);
 }
 
 /**
- * thrift entry point to take an exposure with the camera.
- * <ul>
- * <li>We check whether an exposure is already in progress and if so return an exception.
- * <li>We set mExposureInProgress to true to indicate an exposure is in progress.
- * <li>A new thread running an instance of expose_thread is started, using mCachedExposureLength as the exposure length.
- * </ul>
- * @param exposure_length The exposure length of each frame in milliseconds. Must be at least 1 ms.
- * @param save_image A boolean, if true save the image in a FITS filename, otherwise don't 
- *        (the image data can be retrieved using the get_image_data method).
- * @see Camera::expose_thread
- * @see Camera::get_image_data
- * @see Camera::mCachedExposureLength
- * @see Camera::mExposureInProgress
+ * Get the CCD temperature to record against a read out frame (for the CCDTEMP FITS header).
+ * We retrieve the CCD library's cached temperature sample using CCD_Temperature_Get_Cached_Temperature. 
+ * The telemetry thread (sample_camera_state) keeps this up to date, including whilst the detector is exposing,
+ * so this never calls the driver, and does not hold up the next frame. If the sample is older than 
+ * mTemperatureMaxAge seconds (for instance the camera cannot report it's temperature whilst acquiring), we log a
+ * warning and call request_telemetry_sample, so the telemetry thread reads the temperature as soon as it can.
+ * If no temperature has been read yet, or the cached sample cannot be retrieved, we call
+ * create_ccd_library_exception (or fill in ce.message) to create a CameraException that is then thrown.
+ * @return The CCD temperature, in degrees centigrade.
+ * @see Camera::mTemperatureMaxAge
+ * @see Camera::sample_camera_state
+ * @see Camera::request_telemetry_sample
+ * @see Camera::create_ccd_library_exception
+ * @see CCD_Temperature_Get_Cached_Temperature
  * @see logger
- * @see LOG4CXX_INFO
+ * @see LOG4CXX_WARN
  * @see LOG4CXX_ERROR
  */
-void Camera::start_expose(const bool save_image)
+double Camera::get_frame_temperature()
 {
 	CameraException ce;
+	enum CCD_TEMPERATURE_STATUS temperature_status;
+	struct timespec cache_date_stamp,current_time;
+	double temperature,age;
 
-	cout << "Starting expose thread with exposure length " << mCachedExposureLength <<
-		"ms and save_image " << save_image << "." << endl;
-	LOG4CXX_INFO(logger,"Starting expose thread with exposure length " << mCachedExposureLength <<
-		     "ms and save_image " << save_image << ".");
-	if(mExposureInProgress == TRUE)
+	if(CCD_Temperature_Get_Cached_Temperature(&temperature,&temperature_status,&cache_date_stamp) == FALSE)
 	{
-		ce.message = "start_expose failed: Exposure already in progress.";
-		LOG4CXX_ERROR(logger,"start_expose: Throwing exception:" + ce.message);
+		ce = create_ccd_library_exception();
 		throw ce;
 	}
-	mExposureInProgress = TRUE;
-	std::thread thrd(&Camera::expose_thread, this, mCachedExposureLength, save_image);
-	thrd.detach();
+	if(cache_date_stamp.tv_sec == 0)
+	{
+		ce.message = "get_frame_temperature failed: The CCD temperature has not been read yet.";
+		LOG4CXX_ERROR(logger,"get_frame_temperature: Throwing exception:" + ce.message);
+		throw ce;
+	}
+	clock_gettime(CLOCK_REALTIME,&current_time);
+	age = fdifftime(current_time,cache_date_stamp);
+	if(age > mTemperatureMaxAge)
+	{
+		LOG4CXX_WARN(logger,"get_frame_temperature: The cached CCD temperature is " << age << 
+			     " seconds old, requesting a new telemetry sample.");
+		request_telemetry_sample();
+	}
+	return temperature;
 }
 
 /**
- * thrift entry point to start taking a  bias frame. 
- * <ul>
- * <li>We check whether an exposure is already in progress and if so return an exception.
- * <li>We set mExposureInProgress to true to indicate an exposure is in progress.
- * <li>A new thread running an instance of bias_thread is started.
- * </ul>
- * @see Camera::mExposureInProgress
- * @see Camera::bias_thread
- * @see logger
- * @see LOG4CXX_INFO
- * @see LOG4CXX_ERROR
+ * Tell the processing stage (frame_processing_thread) that the current expose / bias / dark / multrun has finished
+ * acquiring frames. We push an end of exposure marker (an AcquiredFrame with a NULL image buffer) onto
+ * mFramePipeline, in the same way as hand_off_frame. When the processing stage reaches the marker, it waits for the
+ * FITS writer queue to publish the exposure's saved images, so an exposure is only reported as finished
+ * (by get_state / wait_for_exposure) once all it's images are available.
+ * @see Camera::AcquiredFrame
+ * @see Camera::hand_off_frame
+ * @see Camera::mFramePipeline
+ * @see Camera::mFramePipelineFree
+ * @see Camera::mFramePipelineFilled
+ * @see Camera::mFramesPendingCount
  */
-void Camera::start_bias()
+void Camera::hand_off_end_of_exposure()
 {
-	CameraException ce;
+	AcquiredFrame frame = {};
 
-	cout << "Starting bias thread." << endl;
-	LOG4CXX_INFO(logger,"Starting bias thread.");
-	if(mExposureInProgress == TRUE)
-	{
-		ce.message = "start_bias failed: Exposure already in progress.";
-		LOG4CXX_ERROR(logger,"start_bias: Throwing exception:" + ce.message);
-		throw ce;
-	}
-	mExposureInProgress = TRUE;
-	std::thread thrd(&Camera::bias_thread, this);
-	thrd.detach();
+	frame.mImageBuf = nullptr;
+	frame.mSeriesId = mExposureSeriesId;
+	mFramesPendingCount++;
+	while((sem_wait(&mFramePipelineFree) != 0)&&(errno == EINTR))
+		;
+	/* we own a free slot, so this cannot fail */
+	mFramePipeline->try_push(frame);
+	sem_post(&mFramePipelineFilled);
 }
 
 /**
- * thrift entry point to start taking a dark frame. 
+ * This method is run as a separate thread (started by initialize_frame_pipeline) for the lifetime of the camera,
+ * and is the processing stage of the frame pipeline.
  * <ul>
- * <li>We check whether an exposure is already in progress and if so return an exception.
- * <li>We set mExposureInProgress to true to indicate an exposure is in progress.
- * <li>A new thread running an instance of dark_thread is started, using mCachedExposureLength as the exposure length.
+ * <li>We loop, waiting on mFramePipelineFilled for a frame to be handed off by the acquisition stage:
+ *     <ul>
+ *     <li>We pop the frame off mFramePipeline and post mFramePipelineFree, freeing it's slot for the
+ *         acquisition stage. If there was no frame, we have been woken by stop_frame_pipeline and exit.
+ *     <li>If the frame has an image buffer we call process_frame to re-orient, publish and save it.
+ *     <li>Otherwise this is the end of exposure marker, and we call flush on mFitsWriterQueue to wait until
+ *         the exposure's saved images have been written and published.
+ *     <li>If processing fails, we log the error and record it against the frame's exposure series 
+ *         (set_exposure_error with the frame's mSeriesId). A multrun taking that series then stops acquiring frames,
+ *         and the error is returned by get_state / wait_for_exposure. We do not set mAbort, as by the time the
+ *         frame is processed a new series may have been started, which must not be stopped.
+ *     <li>We release our reference to the image buffer, decrement mFramesPendingCount, and call
+ *         notify_exposure_waiters to wake any clients blocked in wait_for_exposure.
+ *     </ul>
  * </ul>
- * @see Camera::mCachedExposureLength
- * @see Camera::mExposureInProgress
- * @see Camera::dark_thread
+ * @see Camera::initialize_frame_pipeline
+ * @see Camera::stop_frame_pipeline
+ * @see Camera::mFramePipeline
+ * @see Camera::mFramePipelineFree
+ * @see Camera::mFramePipelineFilled
+ * @see Camera::mFramePipelineStopping
+ * @see Camera::mFramesPendingCount
+ * @see Camera::mFitsWriterQueue
+ * @see Camera::AcquiredFrame
+ * @see Camera::set_exposure_error
+ * @see Camera::process_frame
+ * @see Camera::notify_exposure_waiters
+ * @see FitsWriterQueue::flush
  * @see logger
- * @see LOG4CXX_INFO
  * @see LOG4CXX_ERROR
  */
-void Camera::start_dark()
+void Camera::frame_processing_thread()
 {
-	CameraException ce;
+	AcquiredFrame frame = {};
 
-	cout << "Starting dark thread with exposure length " << mCachedExposureLength << "ms." << endl;
-	LOG4CXX_INFO(logger,"Starting dark thread exposure length " << mCachedExposureLength << "ms.");
-	if(mExposureInProgress == TRUE)
+	while(true)
 	{
-		ce.message = "start_dark failed: Exposure already in progress.";
-		LOG4CXX_ERROR(logger,"start_dark: Throwing exception:" + ce.message);
-		throw ce;
+		while((sem_wait(&mFramePipelineFilled) != 0)&&(errno == EINTR))
+			;
+		if(!mFramePipeline->try_pop(frame))
+		{
+			/* woken by stop_frame_pipeline, with no frames left to process */
+			if(mFramePipelineStopping)
+				break;
+			continue;
+		}
+		sem_post(&mFramePipelineFree);
+		try
+		{
+			if(frame.mImageBuf != nullptr)
+			{
+				process_frame(frame);
+			}
+			else
+			{
+				/* end of the exposure, wait for the saved images to be published, so they can be
+				** retrieved once the exposure has finished */
+				mFitsWriterQueue.flush();
+			}
+		}
+		catch(TException&e)
+		{
+			/* stop the acquisition stage taking any more frames of this series */
+			set_exposure_error(frame.mSeriesId,exception_to_error(e));
+			cerr << "frame_processing_thread: Caught TException: " << e.what() << "." << endl;
+			LOG4CXX_ERROR(logger,"frame_processing_thread:Caught TException: " << e.what() << ".");
+		}
+		catch(exception& e)
+		{
+			set_exposure_error(frame.mSeriesId,exception_to_error(e));
+			cerr << "frame_processing_thread: Caught Exception: " << e.what()  << "." << endl;
+			LOG4CXX_FATAL(logger,"frame_processing_thread: Caught Exception: " << e.what()  << ".");
+		}
+		/* release our reference to the image buffer, the frame history / writer queue keep their own */
+		frame.mImageBuf = nullptr;
+		mFramesPendingCount--;
+		/* wake any clients blocked in wait_for_exposure */
+		notify_exposure_waiters();
 	}
-	mExposureInProgress = TRUE;
-	std::thread thrd(&Camera::dark_thread, this, mCachedExposureLength);
-	thrd.detach();
 }
 
 /**
- * Abort a running expose/dark/bias. 
- * This calls CCD_Exposure_Abort to attempt to stop a running expose/dark/bias.
- * If CCD_Exposure_Abort fails we call create_ccd_library_exception to create a CameraException that is then thrown.
+ * Process a read out frame. This is called by the processing stage (frame_processing_thread), whilst the
+ * acquisition stage is acquiring the next frame.
+ * <ul>
+ * <li>If the frame's orientation is not CCD_ORIENTATION_NONE, we call CCD_Orientation_Apply to flip / rotate /
+ *     transpose the image data in place (the CCD library has been told to leave this to us by
+ *     CCD_Exposure_Defer_Orientation_Set). We then time stamp the orient phase of the frame's timeline.
+ * <li>We compute the statistics of the re-oriented image (and of the configured regions) using
+ *     frame_statistics_compute with mFrameStatisticsConfig, into the frame's mStatistics. This is done here,
+ *     rather than by get_image_statistics, so each frame's pixels are only scanned once, whilst the next frame is
+ *     being acquired. If this fails the error is logged, and the frame is published and saved without statistics.
+ * <li>We call publish_image to make the new image (and it's statistics) available to get_image_data. 
+ *     publish_image also increments mImageFrameSequence, publishes the image into the shared memory frame ring 
+ *     (if enabled) and wakes any clients blocked in wait_for_exposure.
+ * <li>If the frame is not to be saved, it has now been published, so we time stamp the published phase of the
+ *     frame's timeline and add it to mExposureTimings.
+ * <li>If the frame is to be saved we then do the following:
+ *     <ul>
+ *     <li>We increment the FITS filename run number by calling CCD_Fits_Filename_Next_Run.
+ *     <li>We call CCD_Fits_Filename_Get_Filename to generate a FITS filename.
+ *     <li>If in-server reduction is enabled (mReductionEnabled) and the shutter was opened for the frame, we
+ *         reduce the re-oriented image with the master calibration frames (mFrameCalibration) into a float32
+ *         image using frame_reduction_apply, into the frame's mReducedImage, a buffer from the reduced image buffer
+ *         pool (allocate_reduced_image). This is done here, whilst the
+ *         next frame is acquired, from the image still in memory, rather than by re-reading the saved FITS image.
+ *         If this fails (for instance the frame's binning or window does not match the master frames) the error is
+ *         logged, and only the raw frame is saved.
+ *     <li>We call queue_fits_image to queue the image to be saved to the generated FITS filename
+ *         by the FITS writer queue, with the FITS header snapshot taken when the frame was started.
+ *         Once the image has been written, the writer calls set_last_image_filename to update mLastImageFilename.
+ *         queue_fits_image adds the frame's timeline to mExposureTimings, and queues the reduced image (if any) to be
+ *         saved alongside the raw one.
+ *     </ul>
+ * </ul>
+ * If any of the CCD library calls fail, we use create_ccd_library_exception to create a
+ * CameraException with a suitable error message, and then throw the exception.
+ * @param frame The read out frame.
+ * @see Camera::AcquiredFrame
+ * @see Camera::publish_image
+ * @see Camera::queue_fits_image
  * @see Camera::create_ccd_library_exception
- * @see logger
- * @see LOG4CXX_INFO
- * @see CCD_Exposure_Abort
+ * @see Camera::mExposureTimings
+ * @see Camera::mFrameStatisticsConfig
+ * @see Camera::mReductionEnabled
+ * @see Camera::mReductionPool
+ * @see Camera::mFrameCalibration
+ * @see Camera::allocate_reduced_image
+ * @see frame_statistics_compute
+ * @see frame_reduction_apply
+ * @see ExposureTimingRing::add_timeline
+ * @see CCD_Exposure_Timeline_Mark
+ * @see CCD_Orientation_Apply
+ * @see CCD_Exposure_Defer_Orientation_Set
+ * @see CCD_Fits_Filename_Next_Run
+ * @see CCD_Fits_Filename_Get_Filename
  */
-void Camera::abort_exposure()
+void Camera::process_frame(AcquiredFrame &frame)
 {
 	CameraException ce;
+	std::shared_ptr<ImageStatistics> statistics;
+	std::string error_message;
+	char filename[256];
+	int64_t frame_sequence;
 	int retval;
-	
-	cout << "Abort exposure." << endl;
-	LOG4CXX_INFO(logger,"Abort exposure.");
-	retval = CCD_Exposure_Abort();
-	if(retval == FALSE)
+
+	/* if required, flip / rotate the data */
+	if(frame.mOrientation != CCD_ORIENTATION_NONE)
 	{
-		ce = create_ccd_library_exception();
-		throw ce;
-	}	
+		retval = CCD_Orientation_Apply(frame.mOrientation,frame.mBinnedNCols,frame.mBinnedNRows,
+					       frame.mImageBuf->data());
+		if(retval == FALSE)
+		{
+			ce = create_ccd_library_exception();
+			throw ce;
+		}
+	}
+	CCD_Exposure_Timeline_Mark(&(frame.mTimeline),CCD_EXPOSURE_TIMELINE_ORIENT);
+	/* compute the image statistics, whilst the next frame is acquired */
+	statistics = std::make_shared<ImageStatistics>();
+	if(!frame_statistics_compute(frame.mImageBuf->data(),frame.mNCols,frame.mNRows,mFrameStatisticsConfig,
+				     *statistics,error_message))
+	{
+		cerr << "process_frame:Failed to compute the image statistics:" << error_message << endl;
+		LOG4CXX_ERROR(logger,"process_frame:Failed to compute the image statistics:" << error_message);
+		statistics = nullptr;
+	}
+	/* make the new image available to get_image_data */
+	frame_sequence = publish_image(frame.mImageBuf,frame.mNCols,frame.mNRows,frame.mXBin,frame.mYBin,
+				       frame.mXStart,frame.mYStart,frame.mOrientation,frame.mExposureLength,
+				       frame.mStartTime,statistics);
+	frame.mStatistics = statistics;
+	frame.mReducedImage = nullptr;
+	if(!frame.mSaveImage)
+	{
+		CCD_Exposure_Timeline_Mark(&(frame.mTimeline),CCD_EXPOSURE_TIMELINE_PUBLISHED);
+		mExposureTimings.add_timeline(frame_sequence,frame.mExposureLength,frame.mStartTime,frame.mTimeline);
+	}
+	else
+	{
+		/* increment the filename run number */
+		retval = CCD_Fits_Filename_Next_Run();
+		if(retval == FALSE)
+		{
+			ce = create_ccd_library_exception();
+			throw ce;
+		}
+		/* get the filename to save to */
+		retval = CCD_Fits_Filename_Get_Filename(filename,256);
+		if(retval == FALSE)
+		{
+			ce = create_ccd_library_exception();
+			throw ce;
+		}
+		/* reduce the image with the master calibration frames, whilst the next frame is acquired */
+		if(mReductionEnabled&&frame.mOpenShutter)
+		{
+			frame.mReducedImage = allocate_reduced_image(((size_t)frame.mNCols)*((size_t)frame.mNRows));
+			if(!frame_reduction_apply(frame.mImageBuf->data(),frame.mNCols,frame.mNRows,
+						  ((double)frame.mExposureLength)/((double)CCD_GENERAL_ONE_SECOND_MS),
+						  mFrameCalibration,mReductionPool,frame.mReducedImage.get(),
+						  error_message))
+			{
+				cerr << "process_frame:Failed to reduce frame " << frame_sequence << ":" << error_message << endl;
+				LOG4CXX_ERROR(logger,"process_frame:Failed to reduce frame " << frame_sequence << ":" <<
+					      error_message);
+				frame.mReducedImage = nullptr;
+			}
+		}
+		/* queue the image to be saved by the FITS writer queue, which publishes
+		** the filename (set_last_image_filename) once the image has been written */
+		retval = queue_fits_image(filename,frame,frame_sequence);
+		if(retval == FALSE)
+		{
+			ce = create_ccd_library_exception();
+			throw ce;
+		}
+	}/* end if save_image */
 }
 
-/**
- * Get the current state of the camera.
- * <ul>
- * <li>We call various CCD_Setup library routines to get the currently configured image dimensions 
- *     (CCD_Setup_Get_Bin_X / CCD_Setup_Get_Bin_Y / CCD_Setup_Is_Window / 
- *     CCD_Setup_Get_Horizontal_Start / CCD_Setup_Get_Vertical_Start / 
- *     CCD_Setup_Get_Horizontal_End / CCD_Setup_Get_Vertical_End).
- * <li>We call CCD_Exposure_Length_Get to get the current exposure length.
- * <li>We fill in the exposure_in_progress status from mExposureInProgress.
- * <li>We call CCD_Exposure_Start_Time_Get to get a timestamp of when the last exposure started.
- * <li>We call clock_gettime to get a current timestamp.
- * <li>We call CCD_Exposure_Status_Get to get the CCD library's exposure status.
- * <li>Based on the exposure status, exposure length, exposure start time and current time, we set 
- *     the status's exposure_state, elapsed_exposure_length and remaining_exposure_length state.
- * <li>Based on the exposure status, we either retrieve the current CCD temperature using CCD_Temperature_Get, or if
- *     the detector is currently exposing or reading out, a cached temperature using 
- *     CCD_Temperature_Get_Cached_Temperature.
- * <li>We set the readout speed status to mCachedReadoutSpeed.
- * <li>We set the gain status to mCachedGain.
- * </ul>
- * If retrieving the CCD temperature fails the method can throw a CameraException 
- * (created using create_ccd_library_exception).
- * @param state An instance of CameraState that we set the member values to the current status.
- * @see Camera::mCachedNCols
- * @see Camera::mCachedNRows
- * @see Camera::mCachedHBin
- * @see Camera::mCachedVBin
- * @see Camera::mCachedWindowFlags
- * @see Camera::mCachedWindow
- * @see Camera::mCachedReadoutSpeed
- * @see Camera::mCachedGain
- * @see Camera::mExposureInProgress
- * @see Camera::create_ccd_library_exception
- * @see logger
- * @see LOG4CXX_INFO
- * @see CCD_EXPOSURE_STATUS
- * @see CCD_Exposure_Length_Get
- * @see CCD_Exposure_Status_Get
- * @see CCD_GENERAL_ONE_SECOND_MS
- * @see CCD_Setup_Get_Bin_X
- * @see CCD_Setup_Get_Bin_Y
- * @see CCD_Setup_Is_Window
- * @see CCD_Setup_Get_Horizontal_Start
- * @see CCD_Setup_Get_Vertical_Start
- * @see CCD_Setup_Get_Horizontal_End
- * @see CCD_Setup_Get_Vertical_End
- * @see CCD_TEMPERATURE_STATUS
- * @see CCD_Temperature_Get
- * @see CCD_Temperature_Get_Cached_Temperature
- * @see CameraState
+/**
+ * Get an image buffer for an exposure thread to read out into. 
+ * <ul>
+ * <li>We lock mImageBufMutex.
+ * <li>We look at the frame history slot the next frame will be published into (mFrameHistoryIndex, the oldest frame).
+ *     If that slot's buffer is referenced only by the frame history (it is not the latest image in mImageBuf, and 
+ *     no client is downloading it), we take the buffer out of the slot and mark the slot empty, as that frame is 
+ *     about to be overwritten.
+ * <li>We unlock mImageBufMutex.
+ * <li>If we could not re-use the oldest frame's buffer (for instance a client is still downloading it), 
+ *     we get a spare buffer using allocate_image_buffer. The exposure therefore never waits for a download to 
+ *     finish, and the client keeps a valid copy of the frame it is downloading. The client's buffer goes back 
+ *     into the pool when it has finished with it.
+ * <li>We set the buffer's length to image_buffer_length pixels. The buffers are full frame size, 
+ *     so this never reallocates.
+ * </ul>
+ * @param image_buffer_length The number of pixels the buffer has to hold.
+ * @return A buffer that no-one else is referencing, that can be read out into.
+ * @see Camera::mImageBufMutex
+ * @see Camera::mFrameHistory
+ * @see Camera::mFrameHistoryIndex
+ * @see Camera::allocate_image_buffer
+ * @see ImageBuffer::resize
+ * @see logger
+ * @see LOG4CXX_DEBUG
  */
-void Camera::get_state(CameraState &state)
+std::shared_ptr<ImageBuffer> Camera::acquire_image_buffer(size_t image_buffer_length)
 {
-	CameraException ce;
-	enum CCD_EXPOSURE_STATUS ccd_library_exposure_status;
-	enum CCD_TEMPERATURE_STATUS temperature_status;
-	struct timespec start_time,current_time,cache_date_stamp;
-	int retval;
-	
-	cout << "Get camera state." << endl;
-	LOG4CXX_INFO(logger,"Get camera state.");
-	state.xbin = CCD_Setup_Get_Bin_X();
-	state.ybin = CCD_Setup_Get_Bin_Y();
-	LOG4CXX_DEBUG(logger,"get_state: X bin:" << int(state.xbin) << ":Y Bin:" << int(state.ybin));
-	state.use_window = CCD_Setup_Is_Window();
-	state.window.x_start = CCD_Setup_Get_Horizontal_Start();
-	state.window.y_start = CCD_Setup_Get_Vertical_Start();
-	state.window.x_end = CCD_Setup_Get_Horizontal_End();
-	state.window.y_end = CCD_Setup_Get_Vertical_End();
-	LOG4CXX_DEBUG(logger,"get_state: use_window:" << state.use_window <<
-		      ":x start:" << state.window.x_start << ":y start:" << state.window.y_start <<
-		      ":x end:" << state.window.x_end << ":y end:" << state.window.y_end);
-	state.exposure_length = CCD_Exposure_Length_Get();
-	LOG4CXX_DEBUG(logger,"get_state: exposure_length:" << state.exposure_length);
-	state.exposure_in_progress = mExposureInProgress;
-	LOG4CXX_DEBUG(logger,"get_state: exposure_in_progress:" << state.exposure_in_progress);
-	CCD_Exposure_Start_Time_Get(&start_time);
-	clock_gettime(CLOCK_REALTIME,&current_time);
-	ccd_library_exposure_status = CCD_Exposure_Status_Get();
-	switch(ccd_library_exposure_status)
+	std::shared_ptr<ImageBuffer> image_buf;
+
 	{
-		case CCD_EXPOSURE_STATUS_NONE:
-			state.exposure_state = ExposureState::IDLE;
-			state.elapsed_exposure_length = 0;
-			state.remaining_exposure_length = 0;
-			break;
-		case CCD_EXPOSURE_STATUS_WAIT_START:
-			state.exposure_state = ExposureState::SETUP;
-			state.elapsed_exposure_length = 0;
-			state.remaining_exposure_length = 0;
-			break;
-		case CCD_EXPOSURE_STATUS_EXPOSE:
-			state.exposure_state = ExposureState::EXPOSING;
-			/* fdifftime returns difference between timestamps in seconds.
-			** exposure_length state is in milliseconds. */
-			state.elapsed_exposure_length = fdifftime(current_time,start_time)*
-				((double)CCD_GENERAL_ONE_SECOND_MS);
-			state.remaining_exposure_length = state.exposure_length-state.elapsed_exposure_length;
-			/* check we have not already reached the end of the exposure,
-			** but not started reading out yet */
-			if(state.elapsed_exposure_length > state.exposure_length)
+		std::lock_guard<std::mutex> lock(mImageBufMutex);
+
+		if(mFrameHistory.size() > 0)
+		{
+			FrameHistoryEntry &entry = mFrameHistory[mFrameHistoryIndex];
+
+			/* only re-use the buffer if no-one else has a reference to it */
+			if((entry.mImageBuf != nullptr)&&(entry.mImageBuf.use_count() == 1))
 			{
-				state.elapsed_exposure_length = state.exposure_length;
-				state.remaining_exposure_length = 0;
+				image_buf = std::move(entry.mImageBuf);
+				entry.mImageBuf = nullptr;
+				entry.mStatistics = nullptr;
+				entry.mInfo.frame_id = 0;
 			}
-			break;
-		case CCD_EXPOSURE_STATUS_READOUT:
-			state.exposure_state = ExposureState::READOUT;
-			state.elapsed_exposure_length = state.exposure_length;
-			state.remaining_exposure_length = 0;
-			break;
-		default:
-			/* we could throw an exception here */
-			break;
-	}/* end switch */
-	LOG4CXX_DEBUG(logger,"get_state: exposure_state:" << to_string(state.exposure_state) <<
-		      ":elapsed exposure length:" << state.elapsed_exposure_length <<
-		      ":remaining exposure length:" << state.remaining_exposure_length);
-	/* we can only get the current temperature when the detector is not exposing or reading out 
-	** The temperature is in degrees centigrade. */
-	switch(ccd_library_exposure_status)
+		}
+	}
+	if(image_buf == nullptr)
 	{
-		case CCD_EXPOSURE_STATUS_NONE:
-		case CCD_EXPOSURE_STATUS_WAIT_START:
-			retval = CCD_Temperature_Get(&(state.ccd_temperature),&temperature_status);
-			if(retval == FALSE)
-			{
-				ce = create_ccd_library_exception();
-				throw ce;
-			}	
-			break;
-		case CCD_EXPOSURE_STATUS_EXPOSE:
-		case CCD_EXPOSURE_STATUS_READOUT:
-			retval = CCD_Temperature_Get_Cached_Temperature(&(state.ccd_temperature),&temperature_status,
-									&cache_date_stamp);
-			if(retval == FALSE)
-			{
-				ce = create_ccd_library_exception();
-				throw ce;
-			}	
-			break;
-		default:
-			/* we could throw an exception here */
-			break;	
-	}/* end switch */
-	LOG4CXX_DEBUG(logger,"get_state: ccd temperature:" << state.ccd_temperature << " C");
-	/* Set readout speed and gain from cached values */
-	state.readout_speed = mCachedReadoutSpeed;
-	state.gain = mCachedGain;
-	LOG4CXX_DEBUG(logger,"get_state: readout speed:" << to_string(state.readout_speed) <<
-		      ":gain:" << to_string(state.gain));
+		LOG4CXX_DEBUG(logger,"acquire_image_buffer:Oldest frame buffer in use, using a spare buffer for " <<
+			      image_buffer_length << " pixels.");
+		image_buf = allocate_image_buffer();
+	}
+	image_buf->resize(image_buffer_length);
+	return image_buf;
 }
 
 /**
- * Get a copy of the image data.
- * @param img_data An ImageData instance to fill in with the returned image data.
- * @see Camera::mImageBuf
- * @see Camera::mImageBufNCols
- * @see Camera::mImageBufNRows
+ * Get a full frame image buffer, preferably out of the image buffer pool.
+ * <ul>
+ * <li>We try to take a buffer out of mBufferPool using CCD_Setup_Buffer_Pool_Get. If we succeed we wrap it in an
+ *     ImageBuffer, which returns it to the pool when the last reference to it is released.
+ * <li>Otherwise (all the buffers are in use) we allocate a new full frame ImageBuffer (mCachedNCols x mCachedNRows),
+ *     and increment mImageBufferAllocationCount. This should not happen if the pool's "buffer_pool.spare_count"
+ *     is large enough for the number of concurrent client downloads.
+ * </ul>
+ * @return A new image buffer.
+ * @see Camera::mBufferPool
+ * @see Camera::mImageBufferAllocationCount
+ * @see Camera::mCachedNCols
+ * @see Camera::mCachedNRows
+ * @see ImageBuffer
+ * @see CCD_Setup_Buffer_Pool_Get
  * @see logger
- * @see LOG4CXX_INFO
- * @see ImageData
+ * @see LOG4CXX_WARN
  */
-void Camera::get_image_data(ImageData &img_data)
+std::shared_ptr<ImageBuffer> Camera::allocate_image_buffer()
 {
-	cout << "Get image data." << endl;
-	LOG4CXX_INFO(logger,"Get image data.");
-	std::vector<int16_t>::const_iterator first = mImageBuf.begin();
-	std::vector<int16_t>::const_iterator last = mImageBuf.end();
-	img_data.data.assign(first, last);
-	img_data.x_size = mImageBufNCols;
-	img_data.y_size = mImageBufNRows;
+	unsigned short *buffer = NULL;
+
+	if((mBufferPool.Memory != NULL)&&CCD_Setup_Buffer_Pool_Get(&mBufferPool,&buffer))
+		return std::make_shared<ImageBuffer>(&mBufferPool,buffer);
+	mImageBufferAllocationCount++;
+	LOG4CXX_WARN(logger,"allocate_image_buffer:Image buffer pool exhausted, allocating image buffer " << 
+		     mImageBufferAllocationCount << " outside the pool.");
+	return std::make_shared<ImageBuffer>(((size_t)mCachedNCols)*((size_t)mCachedNRows));
 }
 
 /**
- * Return the image filename of the last FITS image saved by the camera server.
- * @param filename On return of this method, the filename will contain a string representation of 
- *                 the last FITS image filename saved by the camera server.
- * @see Camera::mLastImageFilename
+ * Get a buffer for the processing stage to reduce a frame into, preferably out of the reduced image buffer pool.
+ * <ul>
+ * <li>We try to take a buffer out of mReducedBufferPool using frame_reduction_buffer_get. The buffer is returned to
+ *     the pool when the last reference to it is released (once the FITS writer queue has saved the reduced frame).
+ * <li>Otherwise (all the buffers are in use) we allocate a new buffer, and increment mReducedImageAllocationCount.
+ *     This should not happen if the pool's "reduction.buffer_count" is large enough for the FITS writer queue.
+ * </ul>
+ * @param pixel_count The number of pixels in the reduced frame.
+ * @return A new reduced image buffer, of at least pixel_count floats.
+ * @see Camera::mReducedBufferPool
+ * @see Camera::mReducedImageAllocationCount
+ * @see frame_reduction_buffer_get
+ * @see logger
+ * @see LOG4CXX_WARN
  */
-void Camera::get_last_image_filename(std::string &filename)
+std::shared_ptr<float[]> Camera::allocate_reduced_image(size_t pixel_count)
 {
-	filename = mLastImageFilename;
+	std::shared_ptr<float[]> reduced_image;
+
+	reduced_image = frame_reduction_buffer_get(&mReducedBufferPool,pixel_count);
+	if(reduced_image != nullptr)
+		return reduced_image;
+	mReducedImageAllocationCount++;
+	LOG4CXX_WARN(logger,"allocate_reduced_image:Reduced image buffer pool exhausted, allocating reduced image " << 
+		     mReducedImageAllocationCount << " outside the pool.");
+	reduced_image.reset(new float[pixel_count]);
+	return reduced_image;
 }
 
 /**
- * Start cooling down the camera.
+ * Make a newly read out image available to get_image_data / get_image_data_binary. 
  * <ul>
- * <li>We retrieve the target temperature from the config file object mCameraConfig,
- *     "ccd.target_temperature" value.
- * <li>We set the target temperature using CCD_Temperature_Set.
- * <li>We turn the cooler on using CCD_Temperature_Cooler_On.
+ * <li>We lock mImageBufMutex.
+ * <li>We replace mImageBuf with image_buf. Any client in the middle of downloading the previous image keeps 
+ *     its own reference to it, so we never have to wait for (or copy under the lock) a large image download.
+ * <li>We update mImageBufNCols / mImageBufNRows / mImageBufXBin / mImageBufYBin / mImageBufXStart / 
+ *     mImageBufYStart / mImageBufOrientation to match the new image.
+ * <li>We increment mImageFrameSequence, and keep a copy of the new value to return (as the frame id).
+ * <li>We set the frame_sequence of the image's statistics, and replace mImageStatistics with them.
+ * <li>We store image_buf, the image statistics and the image metadata in the frame history slot at
+ *     mFrameHistoryIndex (replacing the oldest frame), and advance mFrameHistoryIndex.
+ * <li>We unlock mImageBufMutex.
+ * <li>If mFrameRingEnabled is true, we fill in a CCD_Frame_Ring_Frame_Struct describing the image, 
+ *     and call CCD_Frame_Ring_Publish to copy the image into the shared memory frame ring. We hold mFrameRingMutex
+ *     whilst doing so, as the FITS writer threads also update the ring (set_last_image_filename). A failure here is
+ *     logged but not thrown, as the image is still available through get_image_data.
+ * <li>We call notify_exposure_waiters to wake any clients blocked in wait_for_exposure.
  * </ul>
- * If setting the CCD temperature fails the method can throw a CameraException 
- * (created using create_ccd_library_exception).
- * @see Camera::mCameraConfig
- * @see Camera::create_ccd_library_exception
- * @see logger
- * @see LOG4CXX_INFO
- * @see CCD_Temperature_Set
- * @see CCD_Temperature_Cooler_On
+ * @param image_buf The image buffer containing the newly read out image. This must not be written to after this call.
+ * @param ncols The number of binned columns in the image.
+ * @param nrows The number of binned rows in the image.
+ * @param xbin The horizontal binning used to read out the image.
+ * @param ybin The vertical binning used to read out the image.
+ * @param x_start The first detector column (unbinned, starting from 1) of the readout window.
+ * @param y_start The first detector row (unbinned, starting from 1) of the readout window.
+ * @param orientation How the image was re-oriented after it was read out.
+ * @param exposure_length The exposure length of the image in milliseconds (zero for a bias).
+ * @param start_time The start time of the exposure, as retrieved by hand_off_frame when the frame was read out.
+ * @param statistics The statistics of the image, or NULL if they could not be computed. Their frame_sequence is set
+ *        to the frame sequence number allocated to the new image, and they must not be written to after this call.
+ * @return The frame sequence number allocated to the new image.
+ * @see Camera::mImageBufMutex
+ * @see Camera::mImageBuf
+ * @see Camera::mImageBufNCols
+ * @see Camera::mImageBufNRows
+ * @see Camera::mImageBufXBin
+ * @see Camera::mImageBufYBin
+ * @see Camera::mImageBufXStart
+ * @see Camera::mImageBufYStart
+ * @see Camera::mImageBufOrientation
+ * @see Camera::mImageFrameSequence
+ * @see Camera::mImageStatistics
+ * @see Camera::mFrameHistory
+ * @see Camera::mFrameHistoryIndex
+ * @see Camera::mFrameRingEnabled
+ * @see Camera::mFrameRing
+ * @see Camera::mFrameRingMutex
+ * @see Camera::notify_exposure_waiters
+ * @see Camera::hand_off_frame
+ * @see CCD_Frame_Ring_Publish
+ * @see CCD_General_Error_To_String
  */
-void Camera::cool_down()
+int64_t Camera::publish_image(std::shared_ptr<ImageBuffer> image_buf,int ncols,int nrows,int xbin,int ybin,
+			      int x_start,int y_start,enum CCD_ORIENTATION orientation,int32_t exposure_length,
+			      struct timespec start_time,std::shared_ptr<ImageStatistics> statistics)
 {
-	CameraException ce;
-	double target_temperature;
+	struct CCD_Frame_Ring_Frame_Struct frame;
+	char error_buffer[ERROR_BUFFER_LENGTH];
+	int64_t frame_sequence;
 	int retval;
 
-	cout << "Cool down the camera." << endl;
-	LOG4CXX_INFO(logger,"Cool down the camera.");
-	/* get the target temperature */
-	mCameraConfig.get_config_double(CONFIG_CAMERA_SECTION,"ccd.target_temperature",&target_temperature);
-	LOG4CXX_INFO(logger,"Camera temperature setpoint is " << target_temperature << ".");
-	/* set the camera set-point */
-	retval = CCD_Temperature_Set(target_temperature); 
-	if(retval == FALSE)
 	{
-		ce = create_ccd_library_exception();
-		throw ce;
+		std::lock_guard<std::mutex> lock(mImageBufMutex);
+
+		mImageBuf = image_buf;
+		mImageBufNCols = ncols;
+		mImageBufNRows = nrows;
+		mImageBufXBin = xbin;
+		mImageBufYBin = ybin;
+		mImageBufXStart = x_start;
+		mImageBufYStart = y_start;
+		mImageBufOrientation = orientation;
+		frame_sequence = ++mImageFrameSequence;
+		if(statistics != nullptr)
+			statistics->frame_sequence = frame_sequence;
+		mImageStatistics = statistics;
+		/* replace the oldest frame in the frame history */
+		if(mFrameHistory.size() > 0)
+		{
+			FrameHistoryEntry &entry = mFrameHistory[mFrameHistoryIndex];
+
+			entry.mImageBuf = image_buf;
+			entry.mStatistics = statistics;
+			entry.mInfo.frame_id = frame_sequence;
+			entry.mInfo.x_size = ncols;
+			entry.mInfo.y_size = nrows;
+			entry.mInfo.xbin = xbin;
+			entry.mInfo.ybin = ybin;
+			entry.mInfo.exposure_length = exposure_length;
+			entry.mInfo.start_time = (((int64_t)start_time.tv_sec)*CCD_GENERAL_ONE_SECOND_MS)+
+				(start_time.tv_nsec/CCD_GENERAL_ONE_MILLISECOND_NS);
+			entry.mInfo.filename = "";
+			mFrameHistoryIndex = (mFrameHistoryIndex+1)%mFrameHistory.size();
+		}
 	}
-	/* turn the cooler on */
-	retval = CCD_Temperature_Cooler_On();
-	if(retval == FALSE)
+	if(mFrameRingEnabled)
 	{
-		ce = create_ccd_library_exception();
-		throw ce;
-	}	
+		frame.Sequence_Number = frame_sequence;
+		frame.NCols = ncols;
+		frame.NRows = nrows;
+		frame.Bin_X = xbin;
+		frame.Bin_Y = ybin;
+		frame.Exposure_Length = exposure_length;
+		frame.Start_Time = start_time;
+		{
+			std::lock_guard<std::mutex> lock(mFrameRingMutex);
+
+			retval = CCD_Frame_Ring_Publish(&mFrameRing,&frame,image_buf->data(),
+							((size_t)ncols)*((size_t)nrows));
+			if(retval == FALSE)
+				CCD_General_Error_To_String(error_buffer);
+		}
+		if(retval == FALSE)
+		{
+			cerr << "publish_image:Failed to publish frame " << frame_sequence << " into the frame ring:" <<
+				error_buffer << endl;
+			LOG4CXX_ERROR(logger,"publish_image:Failed to publish frame " << frame_sequence <<
+				      " into the frame ring:" << error_buffer);
+		}
+	}
+	notify_exposure_waiters();
+	return frame_sequence;
 }
 
 /**
- * Start warming up the camera.
+ * Queue a read out image to be saved to a FITS file by the FITS writer queue (mFitsWriterQueue).
  * <ul>
- * <li>We turn the cooler off using CCD_Temperature_Cooler_Off.
+ * <li>We create a new FitsWriterJob, holding a reference to the frame's image buffer.
+ * <li>We copy the FITS header set snapshot taken when the frame was started (the frame's mFitsHeaderSet) into the
+ *     job using CCD_Fits_Header_Copy. The snapshot is never modified, so we do not need to lock mFitsHeaderMutex,
+ *     and clients can change the client FITS headers whilst we do this.
+ * <li>We call add_camera_fits_headers to add the internally generated camera FITS headers for the frame to
+ *     the job's FITS headers.
+ * <li>If the frame has been reduced (the frame's mReducedImage is not NULL), we hand the reduced image to the job,
+ *     to be saved to the FITS filename with FRAME_REDUCTION_FILENAME_SUFFIX in place of it's '.fits' extension.
+ *     The reduced image is saved with a copy of the raw image's FITS headers (CCD_Fits_Header_Copy), with the
+ *     reduction FITS headers added (frame_reduction_add_fits_headers). If the headers cannot be created the error
+ *     is logged, and only the raw image is saved.
+ * <li>We copy the frame's timeline into the job, and time stamp it's header phase. We add the timeline to
+ *     mExposureTimings now, as the writer threads merge the save and published phases into it once the image has
+ *     been written.
+ * <li>We push the job onto mFitsWriterQueue. This blocks if the queue is full, until the writer threads 
+ *     have caught up.
  * </ul>
- * Note we do _not_ set the temperature to a warm setpoint, this camera's firmware will not 
- * allow us to call SetTemperature with a warm value (i.e. 10 C).
- * If turning the cooler off fails the method can throw a CameraException 
- * (created using create_ccd_library_exception).
- * @see Camera::create_ccd_library_exception
- * @see logger
- * @see LOG4CXX_INFO
- * @see CCD_Temperature_Cooler_Off
+ * @param filename The FITS filename to save the image to.
+ * @param frame The read out (and re-oriented) frame.
+ * @param frame_sequence The frame sequence number of the image, as returned by publish_image.
+ * @return The routine returns TRUE on success, and FALSE on failure, in which case a CCD library error
+ *         has been set.
+ * @see Camera::mFitsWriterQueue
+ * @see Camera::add_camera_fits_headers
+ * @see Camera::AcquiredFrame
+ * @see Camera::FitsHeaderSet
+ * @see Camera::mExposureTimings
+ * @see FitsWriterJob
+ * @see FitsWriterQueue::push
+ * @see ExposureTimingRing::add_timeline
+ * @see #FRAME_REDUCTION_FILENAME_SUFFIX
+ * @see frame_reduction_add_fits_headers
+ * @see CCD_Fits_Header_Copy
+ * @see CCD_Exposure_Timeline_Mark
  */
-void Camera::warm_up()
+int Camera::queue_fits_image(char *filename,const AcquiredFrame &frame,int64_t frame_sequence)
 {
-	CameraException ce;
+	std::unique_ptr<FitsWriterJob> job(new FitsWriterJob());
+	std::string error_message;
+	std::string::size_type extension_index;
+	char error_buffer[1024];
 	int retval;
 
-	cout << "Warm up the camera." << endl;
-	LOG4CXX_INFO(logger,"Warm up the camera.");
-	/* turn the cooler off */
-	retval = CCD_Temperature_Cooler_Off();
-	if(retval == FALSE)
+	job->mImageBuf = frame.mImageBuf;
+	job->mImageBufferLength = frame.mImageBufferLength;
+	job->mNCols = frame.mNCols;
+	job->mNRows = frame.mNRows;
+	job->mFilename = filename;
+	job->mFrameSequence = frame_sequence;
+	if(frame.mFitsHeaderSet != nullptr)
 	{
-		ce = create_ccd_library_exception();
-		throw ce;
-	}	
+		retval = CCD_Fits_Header_Copy(&(job->mFitsHeader),frame.mFitsHeaderSet->mFitsHeader);
+		if(retval == FALSE)
+			return FALSE;
+	}
+	add_camera_fits_headers(&(job->mFitsHeader),frame);
+	if(frame.mReducedImage != nullptr)
+	{
+		job->mReducedFilename = job->mFilename;
+		extension_index = job->mReducedFilename.rfind(".fits");
+		if(extension_index != std::string::npos)
+			job->mReducedFilename.erase(extension_index);
+		job->mReducedFilename += FRAME_REDUCTION_FILENAME_SUFFIX;
+		if(CCD_Fits_Header_Copy(&(job->mReducedFitsHeader),job->mFitsHeader) == FALSE)
+		{
+			CCD_General_Error_To_String(error_buffer);
+			error_message = error_buffer;
+			retval = FALSE;
+		}
+		else
+			retval = frame_reduction_add_fits_headers(&(job->mReducedFitsHeader),mFrameCalibration,error_message);
+		if(retval)
+			job->mReducedImage = frame.mReducedImage;
+		else
+		{
+			cerr << "queue_fits_image:Failed to create the reduced FITS headers for " << filename << ":" <<
+				error_message << endl;
+			LOG4CXX_ERROR(logger,"queue_fits_image:Failed to create the reduced FITS headers for " << filename <<
+				      ":" << error_message);
+		}
+	}
+	job->mTimeline = frame.mTimeline;
+	CCD_Exposure_Timeline_Mark(&(job->mTimeline),CCD_EXPOSURE_TIMELINE_HEADER);
+	mExposureTimings.add_timeline(frame_sequence,frame.mExposureLength,frame.mStartTime,job->mTimeline);
+	mFitsWriterQueue.push(std::move(job));
+	return TRUE;
 }
 
 /**
- * This method is run as a separate thread to take a single exposure.
- * <ul>
- * <li>We set mExposureInProgress to TRUE to show we are doing an exposure. 
- *     start_expose should already have set this to TRUE.
- * <li>We get the length of the image buffer we need by calling CCD_Setup_Get_Buffer_Length, 
- *     and then resize mImageBuf to suit.
- * <li>We also get the number of binned columns and rows in the image by calling 
- *     CCD_Setup_Get_NCols / CCD_Setup_Get_Bin_X / CCD_Setup_Get_NRows / CCD_Setup_Get_Bin_Y.
- * <li>We set the start_time to zero, so the exposure starts immediately.
- * <li>We call CCD_Exposure_Expose with the exposure length parameter to tell the camera to take an 
- *     exposure of the required length, and read out the image and store it in mImageBuf.
- * <li>If save_image is true we then do the following:
- *     <ul>
- *     <li>We increment the FITS filename run number by calling CCD_Fits_Filename_Next_Run.
- *     <li>We call CCD_Fits_Filename_Get_Filename to generate a FITS filename.
- *     <li>We call add_camera_fits_headers to add the internally generated camera FITS headers to mFitsHeader.
- *     <li>We call CCD_Exposure_Save to save the read out data in mImageBuf to the generated FITS filename with the 
- *         FITS headers from mFitsHeader.
- *     <li>We update mLastImageFilename with the newly saved FITS filename, 
- *         and add the filename to the mImageFilenameList list.
- *     </ul>
- * <li>We set mExposureInProgress to FALSE to show the exposure code has finished.
- * </ul>
- * If any of the CCD library calls fail, we use create_ccd_library_exception to create a 
- * CameraException with a suitable error message, and then throw the exception. mExposureInProgress is reset to FALSE.
- * @param exposure_length The length of one exposure in milliseconds. Should be at least 1.
- * @param save_image A boolean, if true the acquired image is saved to a FITS file, 
- *        otherwise the acquired data is left in mImageBuf to potentially be accessed by  get_image_data.
- * @see Camera::mImageBuf
- * @see Camera::mImageBufNCols
- * @see Camera::mImageBufNRows
- * @see Camera::mExposureInProgress
+ * Update mLastImageFilename with the newly saved FITS image filename, whilst holding mLastImageFilenameMutex.
+ * This is called by the FITS writer queue's writer threads, once the image has been completely written
+ * and renamed into place. With more than one writer thread images can finish saving out of order, so
+ * mLastImageFilename is only updated if frame_sequence is later than mLastImageFrameSequence.
+ * We also record the filename against the frame in the frame history (whilst holding mImageBufMutex), and if the
+ * shared memory frame ring is enabled, against the frame in the ring using CCD_Frame_Ring_Filename_Set (whilst
+ * holding mFrameRingMutex, so we do not update the slot at the same time as publish_image).
+ * @param filename The FITS image filename.
+ * @param frame_sequence The frame sequence number of the saved image, as returned by publish_image.
  * @see Camera::mLastImageFilename
- * @see Camera::mFitsHeader
- * @see Camera::add_camera_fits_headers
- * @see Camera::create_ccd_library_exception
- * @see logger
- * @see LOG4CXX_INFO
- * @see CCD_Exposure_Expose
- * @see CCD_Exposure_Save
- * @see CCD_Fits_Filename_Next_Run
- * @see CCD_Fits_Filename_Get_Filename
- * @see CCD_Setup_Get_Buffer_Length
- * @see CCD_Setup_Get_NCols
- * @see CCD_Setup_Get_Bin_X
- * @see CCD_Setup_Get_NRows
- * @see CCD_Setup_Get_Bin_Y
+ * @see Camera::mLastImageFrameSequence
+ * @see Camera::mLastImageFilenameMutex
+ * @see Camera::mImageBufMutex
+ * @see Camera::mFrameHistory
+ * @see Camera::mFrameRingEnabled
+ * @see Camera::mFrameRing
+ * @see Camera::mFrameRingMutex
+ * @see CCD_Frame_Ring_Filename_Set
  */
-void Camera::expose_thread(int32_t exposure_length, bool save_image)
+void Camera::set_last_image_filename(const char *filename,int64_t frame_sequence)
 {
-	CameraException ce;
-	struct timespec start_time;
-	char filename[256];
-	size_t image_buffer_length = 0;
-	int retval,binned_ncols,binned_nrows;
+	int retval;
 
-	try
 	{
-		cout << "expose thread with exposure length " << exposure_length <<
-			" ms and save_image " << save_image << "." << endl;
-		LOG4CXX_INFO(logger,"expose thread with exposure length " << exposure_length <<
-			     " ms and save_image " << save_image << ".");
-		/* already set to TRUE in start_expose, so this should not be necessary */
-		mExposureInProgress = TRUE;
-		/* setup image buffer */
-		retval = CCD_Setup_Get_Buffer_Length(&image_buffer_length);
-		if(retval == FALSE)
+		std::lock_guard<std::mutex> lock(mLastImageFilenameMutex);
+
+		if(frame_sequence > mLastImageFrameSequence)
 		{
-			mExposureInProgress = FALSE;
-			ce = create_ccd_library_exception();
-			throw ce;
-		}	
-		mImageBuf.resize(image_buffer_length);
-		binned_ncols = CCD_Setup_Get_NCols()/CCD_Setup_Get_Bin_X();
-		binned_nrows = CCD_Setup_Get_NRows()/CCD_Setup_Get_Bin_Y();
-		mImageBufNCols = binned_ncols;
-		mImageBufNRows = binned_nrows;
-		/* start time is now */
-		start_time.tv_sec = 0;
-		start_time.tv_nsec = 0;
-		/* take the image */
-		retval = CCD_Exposure_Expose(TRUE,start_time,exposure_length,(void*)(mImageBuf.data()),
-					     image_buffer_length);
-		if(retval == FALSE)
+			mLastImageFilename = filename;
+			mLastImageFrameSequence = frame_sequence;
+		}
+	}
+	{
+		std::lock_guard<std::mutex> lock(mImageBufMutex);
+
+		for(FrameHistoryEntry &entry : mFrameHistory)
 		{
-			mExposureInProgress = FALSE;
-			ce = create_ccd_library_exception();
-			throw ce;
+			if(entry.mInfo.frame_id == frame_sequence)
+				entry.mInfo.filename = filename;
+		}
+	}
+	if(mFrameRingEnabled)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mFrameRingMutex);
+
+			retval = CCD_Frame_Ring_Filename_Set(&mFrameRing,frame_sequence,filename);
 		}
-		if(save_image)
+		if(retval == FALSE)
 		{
-			/* increment the filename run number */
-			retval = CCD_Fits_Filename_Next_Run();
+			LOG4CXX_ERROR(logger,"set_last_image_filename:Failed to set filename of frame " << frame_sequence <<
+				      " in the frame ring.");
+		}
+	}
+}
+
+/**
+ * Record an error that occured acquiring or processing a frame of an exposure series. Only the first error of a
+ * series is kept, as later errors are usually a consequence of it. An error for an older series than the one
+ * already recorded is ignored.
+ * @param series_id The id of the exposure series the error occured in (mExposureSeriesId when the series was
+ *        started, AcquiredFrame::mSeriesId for a frame).
+ * @param error A description of the error.
+ * @see Camera::mExposureErrorSeriesId
+ * @see Camera::mExposureError
+ * @see Camera::mExposureErrorMutex
+ */
+void Camera::set_exposure_error(int64_t series_id,const std::string &error)
+{
+	std::lock_guard<std::mutex> lock(mExposureErrorMutex);
+
+	if(series_id > mExposureErrorSeriesId)
+	{
+		mExposureErrorSeriesId = series_id;
+		mExposureError = error;
+	}
+}
+
+/**
+ * Get the error recorded against an exposure series.
+ * @param series_id The id of the exposure series.
+ * @return The first error that occured acquiring or processing the series' frames, or an empty string if
+ *         none has been recorded.
+ * @see Camera::mExposureErrorSeriesId
+ * @see Camera::mExposureError
+ * @see Camera::mExposureErrorMutex
+ */
+std::string Camera::get_exposure_error(int64_t series_id)
+{
+	std::lock_guard<std::mutex> lock(mExposureErrorMutex);
+
+	if(series_id != mExposureErrorSeriesId)
+		return "";
+	return mExposureError;
+}
+
+/**
+ * Wake any clients blocked in wait_for_exposure. This is called by publish_image each time a frame is published
+ * (after incrementing mImageFrameSequence), by the exposure threads when they finish (after setting 
+ * mExposureInProgress to FALSE), and by the processing stage each time it finishes with a frame (after decrementing
+ * mFramesPendingCount).
+ * We lock and unlock mExposureMutex before notifying, so a client that has just tested its wait condition
+ * cannot miss the notification. As the exposure state has changed, we also call request_telemetry_sample so the
+ * camera state returned by get_state is re-sampled.
+ * @see Camera::mExposureMutex
+ * @see Camera::mExposureCondition
+ * @see Camera::wait_for_exposure
+ * @see Camera::request_telemetry_sample
+ */
+void Camera::notify_exposure_waiters()
+{
+	{
+		std::lock_guard<std::mutex> lock(mExposureMutex);
+	}
+	mExposureCondition.notify_all();
+	request_telemetry_sample();
+}
+
+/**
+ * Add a FITS header card to a list of FITS headers, parsing the value according to it's type.
+ * If A FITS header with the specified keyword already exists in the list of headers, it's contents are updated.
+ * @param fits_header The address of the list of FITS headers to add the card to.
+ * @param keyword The FITS header card keyword.
+ * @param valtype What kind of value this header takes, of type FitsCardType.
+ * @param value A string representation of the value.
+ * @param comment A string containing a comment for this header.
+ * @see FitsCardType
+ * @see Camera::create_ccd_library_exception
+ * @see logger
+ * @see LOG4CXX_ERROR
+ * @see CCD_Fits_Header_Add_Int
+ * @see CCD_Fits_Header_Add_Float
+ * @see CCD_Fits_Header_Add_String
+ */
+void Camera::add_fits_header_card(struct Fits_Header_Struct *fits_header,const std::string & keyword,
+				  const FitsCardType::type valtype,const std::string & value,const std::string & comment)
+{
+	CameraException ce;
+	int retval,ivalue;
+	double dvalue;
+	
+	switch(valtype)
+	{
+		case FitsCardType::INTEGER:
+			retval = sscanf(value.c_str(),"%d",&ivalue);
+			if(retval != 1)
+			{
+				ce.message = "add_fits_header: Failed to parse string "+ value +" to an integer ("+
+					std::to_string(retval) +").";
+				LOG4CXX_ERROR(logger,"add_fits_header: Throwing exception:" + ce.message);
+				throw ce;
+			}
+			retval = CCD_Fits_Header_Add_Int(fits_header,(char*)(keyword.c_str()),ivalue,
+							 (char*)(comment.c_str()));
 			if(retval == FALSE)
 			{
-				mExposureInProgress = FALSE;
 				ce = create_ccd_library_exception();
 				throw ce;
+			}	
+			break;
+		case FitsCardType::FLOAT:
+			retval = sscanf(value.c_str(),"%lf",&dvalue);
+			if(retval != 1)
+			{
+				ce.message = "add_fits_header: Failed to parse string "+ value +" to a double ("+
+					std::to_string(retval) +").";
+				LOG4CXX_ERROR(logger,"add_fits_header: Throwing exception:" + ce.message);
+				throw ce;
 			}
-			/* get the filename to save to */
-			retval = CCD_Fits_Filename_Get_Filename(filename,256);
+			retval = CCD_Fits_Header_Add_Float(fits_header,(char*)(keyword.c_str()),dvalue,
+							   (char*)(comment.c_str()));
 			if(retval == FALSE)
 			{
-				mExposureInProgress = FALSE;
 				ce = create_ccd_library_exception();
 				throw ce;
-			}
-			/* Add internally generated FITS headers to mFitsHeader */
-			add_camera_fits_headers(exposure_length);
-			/* save the image */
-			retval = CCD_Exposure_Save(filename,(void*)(mImageBuf.data()),image_buffer_length,
-						   binned_ncols,binned_nrows,mFitsHeader);
+			}	
+			break;
+		case FitsCardType::STRING:
+			retval = CCD_Fits_Header_Add_String(fits_header,(char*)(keyword.c_str()),(char*)(value.c_str()),
+							    (char*)(comment.c_str()));
 			if(retval == FALSE)
 			{
-				mExposureInProgress = FALSE;
 				ce = create_ccd_library_exception();
 				throw ce;
-			}
-			/* update last image filename */
-			mLastImageFilename = filename;
-		}/* end if save_image */
-		mExposureInProgress = FALSE;
-	}
-	catch(TException&e)
-	{
-		mExposureInProgress = FALSE;
-		cerr << "expose_thread: Caught TException: " << e.what() << "." << endl;
-		LOG4CXX_ERROR(logger,"expose_thread:Caught TException: " << e.what() << ".");
+			}	
+			break;
+		default:
+			break;
 	}
-	catch(exception& e)
-	{
-		mExposureInProgress = FALSE;
-		cerr << "expose_thread:Caught Exception: " << e.what()  << "." << endl;
-		LOG4CXX_FATAL(logger,"expose_thread:Caught Exception: " << e.what()  << ".");
-	}		
 }
 
 /**
- * This method is run as a separate thread to actually take a bias frame.
- * <ul>
- * <li>We set mExposureInProgress to TRUE to show we are doing an exposure. 
- *     start_bias should already have set this to TRUE.
- * <li>We get the length of the image buffer we need by calling CCD_Setup_Get_Buffer_Length, 
- *     and then resize mImageBuf to suit.
- * <li>We also get the number of binned columns and rows in the image by calling 
- *     CCD_Setup_Get_NCols / CCD_Setup_Get_Bin_X / CCD_Setup_Get_NRows / CCD_Setup_Get_Bin_Y.
- * <li>We call CCD_Exposure_Bias to tell the camera to take a
- *     bias frame, and read out the image and store it in mImageBuf.
- * <li>We increment the FITS filename run number by calling CCD_Fits_Filename_Next_Run.
- * <li>We call CCD_Fits_Filename_Get_Filename to generate a FITS filename.
- * <li>We call add_camera_fits_headers to add the internally generated camera FITS headers to mFitsHeader.
- * <li>We call CCD_Exposure_Save to save the read out data in mImageBuf to the generated FITS filename with the 
- *     FITS headers from mFitsHeader.
- * <li>We update mLastImageFilename with the newly saved FITS filename.
- * <li>We set mExposureInProgress to FALSE to show we have finished taking biases.
- * </ul>
- * If any of the CCD library calls fail, we use create_ccd_library_exception to create a 
- * CameraException with a suitable error message, and then throw the exception. mExposureInProgress is reset to FALSE.
- * @param exposure_count The number of bias exposures to take. Should be at least 1.
- * @see Camera::mImageBuf
- * @see Camera::mImageBufNCols
- * @see Camera::mImageBufNRows
- * @see Camera::mExposureInProgress
- * @see Camera::mLastImageFilename
+ * Return the client FITS headers (mFitsHeader) ready to be modified. If a frame still holds a snapshot of them
+ * (the header set is shared), we first replace mFitsHeader with a copy (made using CCD_Fits_Header_Copy),
+ * so the snapshot is not changed. mFitsHeaderMutex must be held by the caller, whilst the headers are modified.
+ * @return The client FITS headers, that are not shared with any frame.
  * @see Camera::mFitsHeader
- * @see Camera::add_camera_fits_headers
+ * @see Camera::mFitsHeaderMutex
+ * @see Camera::FitsHeaderSet
  * @see Camera::create_ccd_library_exception
- * @see logger
- * @see LOG4CXX_INFO
- * @see CCD_Exposure_Bias
- * @see CCD_Exposure_Save
- * @see CCD_Fits_Filename_Next_Run
- * @see CCD_Fits_Filename_Get_Filename
- * @see CCD_Setup_Get_Buffer_Length
- * @see CCD_Setup_Get_NCols
- * @see CCD_Setup_Get_Bin_X
- * @see CCD_Setup_Get_NRows
- * @see CCD_Setup_Get_Bin_Y
+ * @see CCD_Fits_Header_Copy
  */
-void Camera::bias_thread()
+std::shared_ptr<Camera::FitsHeaderSet> Camera::get_writable_fits_header()
 {
+	std::shared_ptr<FitsHeaderSet> header_set;
 	CameraException ce;
-	char filename[256];
-	size_t image_buffer_length = 0;
-	int retval,binned_ncols,binned_nrows;
 
-	try
+	if(mFitsHeader.use_count() > 1)
 	{
-		cout << "bias thread started." << endl;
-		LOG4CXX_INFO(logger,"bias thread started.");
-		/* already set to TRUE in start_bias, so this should not be necessary */
-		mExposureInProgress = TRUE;
-		/* setup image buffer */
-		retval = CCD_Setup_Get_Buffer_Length(&image_buffer_length);
-		if(retval == FALSE)
-		{
-			mExposureInProgress = FALSE;
-			ce = create_ccd_library_exception();
-			throw ce;
-		}	
-		mImageBuf.resize(image_buffer_length);
-		binned_ncols = CCD_Setup_Get_NCols()/CCD_Setup_Get_Bin_X();
-		binned_nrows = CCD_Setup_Get_NRows()/CCD_Setup_Get_Bin_Y();
-		mImageBufNCols = binned_ncols;
-		mImageBufNRows = binned_nrows;
-		/* take the image */
-		retval = CCD_Exposure_Bias((void*)(mImageBuf.data()),image_buffer_length);
-		if(retval == FALSE)
-		{
-			mExposureInProgress = FALSE;
-			ce = create_ccd_library_exception();
-			throw ce;
-		}
-		/* increment the filename run number */
-		retval = CCD_Fits_Filename_Next_Run();
-		if(retval == FALSE)
-		{
-			mExposureInProgress = FALSE;
-			ce = create_ccd_library_exception();
-			throw ce;
-		}
-		/* get the filename to save to */
-		retval = CCD_Fits_Filename_Get_Filename(filename,256);
-		if(retval == FALSE)
+		header_set = std::make_shared<FitsHeaderSet>();
+		if(!CCD_Fits_Header_Copy(&(header_set->mFitsHeader),mFitsHeader->mFitsHeader))
 		{
-			mExposureInProgress = FALSE;
 			ce = create_ccd_library_exception();
 			throw ce;
 		}
-		/* Add internally generated FITS headers to mFitsHeader */
-		add_camera_fits_headers(0);
-		/* save the image */
-		retval = CCD_Exposure_Save(filename,(void*)(mImageBuf.data()),image_buffer_length,
-					   binned_ncols,binned_nrows,mFitsHeader);
-		if(retval == FALSE)
-		{
-			mExposureInProgress = FALSE;
-			ce = create_ccd_library_exception();
-			throw ce;
-		}
-		/* update last image filename */
-		mLastImageFilename = filename;
-		mExposureInProgress = FALSE;
+		mFitsHeader = header_set;
 	}
-	catch(TException&e)
+	return mFitsHeader;
+}
+
+/**
+ * Return a snapshot of a FITS header set, that is not changed by clients whilst it is held. 
+ * This only takes a reference to the header set, whilst holding mFitsHeaderMutex.
+ * @param header_set_id The id of a header set created by create_fits_header_set, or 0 for the current
+ *        client FITS headers (mFitsHeader).
+ * @return The header set. If no header set with the specified id exists, a CameraException is thrown.
+ * @see Camera::mFitsHeader
+ * @see Camera::mFitsHeaderSets
+ * @see Camera::mFitsHeaderMutex
+ * @see Camera::get_writable_fits_header
+ */
+std::shared_ptr<const Camera::FitsHeaderSet> Camera::get_fits_header_snapshot(int64_t header_set_id)
+{
+	CameraException ce;
+
+	std::lock_guard<std::recursive_mutex> lock(mFitsHeaderMutex);
+	if(header_set_id == 0)
+		return mFitsHeader;
+	auto it = mFitsHeaderSets.find(header_set_id);
+	if(it == mFitsHeaderSets.end())
 	{
-		mExposureInProgress = FALSE;
-		cerr << "bias_thread: Caught TException: " << e.what() << "." << endl;
-		LOG4CXX_ERROR(logger,"bias_thread: Caught TException: " << e.what() << ".");
+		ce.message = "No FITS header set with id "+std::to_string(header_set_id)+".";
+		LOG4CXX_ERROR(logger,"get_fits_header_snapshot: Throwing exception:" + ce.message);
+		throw ce;
 	}
-	catch(exception& e)
-	{
-		mExposureInProgress = FALSE;
-		cerr << "bias_thread: Caught Exception: " << e.what()  << "." << endl;
-		LOG4CXX_FATAL(logger,"bias_thread: Caught Exception: " << e.what()  << ".");
-	}		
+	return it->second;
 }
 
 /**
- * This method is run as a separate thread to take a dark frame.
+ * Create the camera FITS headers that do not change once the camera has been initialised, and store them in
+ * mStaticFitsHeader. Headers added are:
  * <ul>
- * <li>We set mExposureInProgress to TRUE to show we are doing an exposure. 
- *     start_dark should already have set this to TRUE.
- * <li>We get the length of the image buffer we need by calling CCD_Setup_Get_Buffer_Length, 
- *     and then resize mImageBuf to suit.
- * <li>We also get the number of binned columns and rows in the image by calling 
- *     CCD_Setup_Get_NCols / CCD_Setup_Get_Bin_X / CCD_Setup_Get_NRows / CCD_Setup_Get_Bin_Y.
- * <li>We set the start_time to zero, so the exposure starts immediately.
- * <li>We call CCD_Exposure_Expose with the exposure length parameter to tell the camera to take a
- *     dark exposure of the required length, and read out the image and store it in mImageBuf.
- * <li>We increment the FITS filename run number by calling CCD_Fits_Filename_Next_Run.
- * <li>We call CCD_Fits_Filename_Get_Filename to generate a FITS filename.
- * <li>We call add_camera_fits_headers to add the internally generated camera FITS headers to mFitsHeader.
- * <li>We call CCD_Exposure_Save to save the read out data in mImageBuf to the generated FITS filename 
- *     with the FITS headers from mFitsHeader.
- * <li>We update mLastImageFilename with the newly saved FITS filename.
- * <li>We set mExposureInProgress to FALSE, to show we have finished taking darks.
+ * <li><b>HEAD</b> The camera head model name, retrieved from the CCD library using 
+ *                 CCD_Setup_Get_Camera_Head_Model_Name.
+ * <li><b>SERNO</b> The camera head serial number, retrieved from the CCD library using 
+ *                  CCD_Setup_Get_Camera_Serial_Number.
  * </ul>
- * If any of the CCD library calls fail, we use create_ccd_library_exception to create a 
- * CameraException with a suitable error message, and then throw the exception. mExposureInProgress is reset to FALSE.
- * @param exposure_count The number of dark exposures to take. Should be at least 1.
- * @param exposure_length The length of one exposure in milliseconds. Should be at least 1.
- * @see Camera::mImageBuf
- * @see Camera::mImageBufNCols
- * @see Camera::mImageBufNRows
- * @see Camera::mExposureInProgress
- * @see Camera::mLastImageFilename
- * @see Camera::mFitsHeader
- * @see Camera::add_camera_fits_headers
+ * This is called by initialize, once the camera has been started up.
+ * @see Camera::mStaticFitsHeader
+ * @see Camera::FitsHeaderSet
+ * @see Camera::update_camera_fits_headers
  * @see Camera::create_ccd_library_exception
- * @see logger
- * @see LOG4CXX_INFO
- * @see CCD_Exposure_Expose
- * @see CCD_Exposure_Save
- * @see CCD_Fits_Filename_Next_Run
- * @see CCD_Fits_Filename_Get_Filename
- * @see CCD_Setup_Get_Buffer_Length
- * @see CCD_Setup_Get_NCols
- * @see CCD_Setup_Get_Bin_X
- * @see CCD_Setup_Get_NRows
- * @see CCD_Setup_Get_Bin_Y
+ * @see CCD_Fits_Header_Add_String
+ * @see CCD_Fits_Header_Add_Int
+ * @see CCD_Setup_Get_Camera_Head_Model_Name
+ * @see CCD_Setup_Get_Camera_Serial_Number
  */
-void Camera::dark_thread(int32_t exposure_length)
+void Camera::initialize_static_fits_headers()
 {
+	std::shared_ptr<FitsHeaderSet> header_set = std::make_shared<FitsHeaderSet>();
 	CameraException ce;
-	struct timespec start_time;
-	char filename[256];
-	size_t image_buffer_length = 0;
-	int retval,binned_ncols,binned_nrows;
+	char camera_head_model_name[128];
+	int retval;
 
-	try
+	/* HEAD string CCD camera head string DU8201_UVB etc */
+	retval = CCD_Setup_Get_Camera_Head_Model_Name(camera_head_model_name,128);
+	if(retval == FALSE)
 	{
-		cout << "dark thread with exposure length " << exposure_length << "ms." << endl;
-		LOG4CXX_INFO(logger,"dark thread with exposure length " << exposure_length << "ms.");
-		/* already set to TRUE in start_expose, so this should not be necessary */
-		mExposureInProgress = TRUE;
-		/* setup image buffer */
-		retval = CCD_Setup_Get_Buffer_Length(&image_buffer_length);
-		if(retval == FALSE)
-		{
-			mExposureInProgress = FALSE;
-			ce = create_ccd_library_exception();
-			throw ce;
-		}	
-		mImageBuf.resize(image_buffer_length);
-		binned_ncols = CCD_Setup_Get_NCols()/CCD_Setup_Get_Bin_X();
-		binned_nrows = CCD_Setup_Get_NRows()/CCD_Setup_Get_Bin_Y();
-		mImageBufNCols = binned_ncols;
-		mImageBufNRows = binned_nrows;
-		/* start time is now */
-		start_time.tv_sec = 0;
-		start_time.tv_nsec = 0;
-		/* take the image */
-		retval = CCD_Exposure_Expose(FALSE,start_time,exposure_length,(void*)(mImageBuf.data()),
-					     image_buffer_length);
-		if(retval == FALSE)
-		{
-			mExposureInProgress = FALSE;
-			ce = create_ccd_library_exception();
-			throw ce;
-		}
-		/* increment the filename run number */
-		retval = CCD_Fits_Filename_Next_Run();
-		if(retval == FALSE)
-		{
-			mExposureInProgress = FALSE;
-			ce = create_ccd_library_exception();
-			throw ce;
-		}
-		/* get the filename to save to */
-		retval = CCD_Fits_Filename_Get_Filename(filename,256);
-		if(retval == FALSE)
-		{
-			mExposureInProgress = FALSE;
-			ce = create_ccd_library_exception();
-			throw ce;
-		}
-		/* Add internally generated FITS headers to mFitsHeader */
-		add_camera_fits_headers(exposure_length);
-		/* save the image */
-		retval = CCD_Exposure_Save(filename,(void*)(mImageBuf.data()),image_buffer_length,
-					   binned_ncols,binned_nrows,mFitsHeader);
-		if(retval == FALSE)
-		{
-			mExposureInProgress = FALSE;
-			ce = create_ccd_library_exception();
-			throw ce;
-		}
-		/* update last image filename */
-		mLastImageFilename = filename;
-		mExposureInProgress = FALSE;
-	}
-	catch(TException&e)
+		ce = create_ccd_library_exception();
+		throw ce;
+	}		
+	retval = CCD_Fits_Header_Add_String(&(header_set->mFitsHeader),"HEAD",camera_head_model_name,
+					    "Camera head model name");
+	if(retval == FALSE)
 	{
-		mExposureInProgress = FALSE;
-		cerr << "dark_thread: Caught TException: " << e.what() << "." << endl;
-		LOG4CXX_ERROR(logger,"dark_thread:Caught TException: " << e.what() << ".");
+		ce = create_ccd_library_exception();
+		throw ce;
 	}
-	catch(exception& e)
+	/* SERNO camera serial number */
+	retval = CCD_Fits_Header_Add_Int(&(header_set->mFitsHeader),"SERNO",CCD_Setup_Get_Camera_Serial_Number(),
+					 "Camera serial number");
+	if(retval == FALSE)
 	{
-		mExposureInProgress = FALSE;
-		cerr << "dark_thread: Caught Exception: " << e.what()  << "." << endl;
-		LOG4CXX_FATAL(logger,"dark_thread: Caught Exception: " << e.what()  << ".");
-	}		
+		ce = create_ccd_library_exception();
+		throw ce;
+	}
+	mStaticFitsHeader = header_set;
 }
 
 /**
- * Method to add some of the internal FITS headers generated from within the camera to mFitsHeader,
- * which are then saved to the generated FITS images. Headers added are:
+ * Recompute the precomputed camera FITS headers (mCameraFitsHeader) for the current detector setup. This is called
+ * by initialize, and by set_binning / set_window / clear_window / set_readout_speed / set_gain whenever the setup
+ * is changed, so the headers do not have to be generated for every frame. A new header set is created (frames
+ * already started keep a reference to the old one), containing a copy of the static headers (mStaticFitsHeader)
+ * plus:
  * <ul>
- * <li><b>EXPTIME</b> Length of exposure in seconds.
- * <li><b>EXPOSURE</b> Length of exposure in seconds.
  * <li><b>HBIN</b> Horizontal / X binning, retrieved from the CCD library using CCD_Setup_Get_Bin_X.
  * <li><b>VBIN</b> Vertical / Y binning, retrieved from the CCD library using CCD_Setup_Get_Bin_Y.
- * <li><b>CCDTEMP</b> The camera temperature in degrees Kelvin, this is retrieved from the camera in degrees centigrade 
- *                   using CCD_Temperature_Get, and then has DEGREES_CENTIGRADE_TO_KELVIN added to it.
- * <li><b>HEAD</b> The camera head model name, retrieved from the CCD library using 
- *                 CCD_Setup_Get_Camera_Head_Model_Name.
- * <li><b>SERNO</b> The camera head serial number, retrieved from the CCD library using 
- *                  CCD_Setup_Get_Camera_Serial_Number.
- * <li><b>FLIPX</b> A boolean, whether we have flipped the readout in the Horizontal / X direction, 
+ * <li><b>FLIPX</b> A boolean, whether we flip the readout in the Horizontal / X direction, 
  *                  retrieved from the CCD library using CCD_Setup_Get_Flip_X.
- * <li><b>FLIPY</b> A boolean, whether we have flipped the readout in the Vertical / Y direction, 
+ * <li><b>FLIPY</b> A boolean, whether we flip the readout in the Vertical / Y direction, 
  *                  retrieved from the CCD library using CCD_Setup_Get_Flip_Y.
- * <li><b>IMGRECT / SUBRECT</b> We figure out the active image area. If we are windowing (mCachedWindowFlags is true), 
- *        we use the image dimensions in mCachedWindow. If we are not windowing (mCachedWindowFlags is false), 
+ * <li><b>ORIENT</b> A string, how the readout is re-oriented (e.g. rotate_90), retrieved from the CCD library 
+ *                  using CCD_Setup_Get_Orientation.
+ * <li><b>IMGRECT / SUBRECT</b> We figure out the active image area. If the detector is windowed 
+ *        (mCachedWindowFlags is true), we use the window dimensions (mCachedWindow). If it is not windowed,
  *        we use mCachedNCols,mCachedNRows. We construct a string "sx, sy, ex, ey" 
  *        and set the "IMGRECT" and "SUBRECT" headers to this value.
- * <li><b>UTSTART</b> We retrieve the start exposure timestamp using CCD_Exposure_Start_Time_Get. We use 
- *                   CCD_Fits_Header_TimeSpec_To_UtStart_String to format the string.
- * <li><b>DATE-OBS</b> We retrieve the start exposure timestamp using CCD_Exposure_Start_Time_Get. We use 
- *                   CCD_Fits_Header_TimeSpec_To_Date_Obs_String to format the string.
- * <li><b>MJD</b> We retrieve the modified julian date from the start exposure timestamp using 
- *                NGAT_Astro_Timespec_To_MJD, and add it as a float.
  * <li><b>VSHIFT</b> The vertical shift speed in microseconds/pixel, retrieved from the CCD library using 
  *                   CCD_Setup_Get_VS_Speed.
+ * <li><b>VSHIFTI</b> The vertical shift speed index, retrieved from the CCD library using 
+ *                    CCD_Setup_Get_VS_Speed_Index.
  * <li><b>HSHIFT</b> The horizontal shift speed im MHz, retrieved from the CCD library using CCD_Setup_Get_HS_Speed.
  * <li><b>HSHIFTI</b> The horizontal shift speed index used to configure the horizontal shift speed, 
  *                    retrieved from the CCD library using CCD_Setup_Get_HS_Speed_Index.
- * <li><b>PREGAIN</b> The pre-amp gain setting (as a string) used to configure the gain, retrieved from mCachedGain.
+ * <li><b>PREGAIN</b> The pre-amp gain setting (as a string) used to configure the gain, from mCachedGain.
  * <li><b>GAIN</b> The Gain in e/ADU of the current setup, retrieved from the config file using the pre-amp gain index 
  *                 (CCD_Setup_Get_Pre_Amp_Gain_Index) and the horizontal shift speed index.
  * </ul>
- * @param exposure_length The exposure length, in milliseconds, of this image.
- * @see Camera::create_ccd_library_exception
- * @see Camera::create_ngatastro_library_exception
- * @see Camera::mFitsHeader
+ * Whilst initialize is configuring the initial readout speed and gain the static headers have not been created
+ * yet, and we do nothing: initialize calls this method again once the detector setup is complete.
+ * Apart from initialize, this is only called by the setup methods (set_binning / set_window / clear_window /
+ * set_readout_speed / set_gain) whilst holding mExposureMutex, so the setup cannot change whilst the headers
+ * are being computed.
+ * The new header set replaces mCameraFitsHeader whilst holding mCameraFitsHeaderMutex.
+ * @see Camera::mStaticFitsHeader
+ * @see Camera::mCameraFitsHeader
+ * @see Camera::mCameraFitsHeaderMutex
+ * @see Camera::FitsHeaderSet
  * @see Camera::mCachedNCols
  * @see Camera::mCachedNRows
  * @see Camera::mCachedWindowFlags
  * @see Camera::mCachedWindow
- * @see Camera::mCameraConfig
  * @see Camera::mCachedGain
- * @see DEGREES_CENTIGRADE_TO_KELVIN
- * @see CCD_Exposure_Start_Time_Get
+ * @see Camera::mCameraConfig
+ * @see Camera::create_ccd_library_exception
+ * @see CCD_Fits_Header_Copy
  * @see CCD_Fits_Header_Add_String
  * @see CCD_Fits_Header_Add_Float
  * @see CCD_Fits_Header_Add_Int
  * @see CCD_Fits_Header_Add_Logical
  * @see CCD_Fits_Header_Add_Units
- * @see CCD_Fits_Header_TimeSpec_To_UtStart_String
- * @see CCD_Fits_Header_TimeSpec_To_Date_Obs_String
  * @see CCD_Setup_Get_Bin_X
  * @see CCD_Setup_Get_Bin_Y
  * @see CCD_Setup_Get_Flip_X
  * @see CCD_Setup_Get_Flip_Y
- * @see CCD_Setup_Get_Camera_Head_Model_Name
- * @see CCD_Setup_Get_Camera_Serial_Number
- * @see CCD_TEMPERATURE_STATUS
- * @see CCD_Temperature_Get
+ * @see CCD_Setup_Get_Orientation
+ * @see CCD_Orientation_To_String
  * @see CCD_Setup_Get_VS_Speed
  * @see CCD_Setup_Get_VS_Speed_Index
  * @see CCD_Setup_Get_HS_Speed
  * @see CCD_Setup_Get_HS_Speed_Index
  * @see CCD_Setup_Get_Pre_Amp_Gain_Index
- * @see NGAT_Astro_Timespec_To_MJD
  */
-void Camera::add_camera_fits_headers(int32_t exposure_length)
+void Camera::update_camera_fits_headers()
 {
-	CameraException ce;
-	enum CCD_TEMPERATURE_STATUS temperature_status;
-	struct timespec start_time;
+	std::shared_ptr<FitsHeaderSet> header_set;
+	struct Fits_Header_Struct *fits_header = NULL;
+	CameraException ce;
 	std::string gain_string;
-	char camera_head_model_name[128];
 	char img_rect_buff[128];
-	char time_string[32];
 	char gain_keyword_string[32];
-	double temperature,mjd,gain;
-	float vs_speed,hs_speed;
-	int retval,xs,ys,xe,ye,vs_speed_index,hs_speed_index,pre_amp_gain_index;
-	
-	/* EXPTIME  double in secs */
-	retval = CCD_Fits_Header_Add_Float(&mFitsHeader,"EXPTIME",
-					   ((double)exposure_length)/((double)CCD_GENERAL_ONE_SECOND_MS),
-					   "Exposure length in decimal seconds");
+	double gain;
+	int retval,xs,ys,xe,ye;
+
+	if(mStaticFitsHeader == nullptr)
+		return;
+	header_set = std::make_shared<FitsHeaderSet>();
+	fits_header = &(header_set->mFitsHeader);
+	retval = CCD_Fits_Header_Copy(fits_header,mStaticFitsHeader->mFitsHeader);
 	if(retval == FALSE)
 	{
 		ce = create_ccd_library_exception();
 		throw ce;
 	}
-	retval = CCD_Fits_Header_Add_Units(&mFitsHeader,"EXPTIME","s");
+	/* HBIN */
+	retval = CCD_Fits_Header_Add_Int(fits_header,"HBIN",CCD_Setup_Get_Bin_X(),"Horizontal/X binning");
 	if(retval == FALSE)
 	{
 		ce = create_ccd_library_exception();
 		throw ce;
-	}	
-	/* EXPOSURE double in secs */
-	retval = CCD_Fits_Header_Add_Float(&mFitsHeader,"EXPOSURE",
-					   ((double)exposure_length)/((double)CCD_GENERAL_ONE_SECOND_MS),
-					   "Exposure length in decimal seconds");
+	}		
+	/* VBIN */
+	retval = CCD_Fits_Header_Add_Int(fits_header,"VBIN",CCD_Setup_Get_Bin_Y(),"Vertical/Y binning");
 	if(retval == FALSE)
 	{
 		ce = create_ccd_library_exception();
 		throw ce;
-	}
-	retval = CCD_Fits_Header_Add_Units(&mFitsHeader,"EXPOSURE","s");
+	}		
+	/* BINNING vxh ! */
+	/* GAINVAL */
+	/* SGAIN CCD Mode GAIN (Faint)*/
+	/* SRDNOISE CCD Mode RDNoise (Slow) */
+	/* NOISEADU */
+	/* NOISEEL */
+	/* FLIPX */
+	retval = CCD_Fits_Header_Add_Logical(fits_header,"FLIPX",CCD_Setup_Get_Flip_X(),
+					     "Camera readout flipped horizontally");
 	if(retval == FALSE)
 	{
 		ce = create_ccd_library_exception();
 		throw ce;
 	}
-	/* retrieve start of exposure timestamp */
-	CCD_Exposure_Start_Time_Get(&start_time);
-	/* UTSTART HH:MM:SS */
-	CCD_Fits_Header_TimeSpec_To_UtStart_String(start_time,time_string);
-	retval = CCD_Fits_Header_Add_String(&mFitsHeader,"UTSTART",time_string,"Start time of the observation");
+	/* FLIPY */
+	retval = CCD_Fits_Header_Add_Logical(fits_header,"FLIPY",CCD_Setup_Get_Flip_Y(),
+					     "Camera readout flipped vertically");
 	if(retval == FALSE)
 	{
 		ce = create_ccd_library_exception();
 		throw ce;
 	}
-	/* LCSTART HH:MM:SS */
-	/* DATE-OBS YYYY-MM-DD */
-	/* DATE-OBS YYYY-MM-DDTHH:MM:SS.sss */
-	CCD_Fits_Header_TimeSpec_To_Date_Obs_String(start_time,time_string);
-	retval = CCD_Fits_Header_Add_String(&mFitsHeader,"DATE-OBS",time_string,"Start time of the observation");
+	/* ORIENT */
+	retval = CCD_Fits_Header_Add_String(fits_header,"ORIENT",CCD_Orientation_To_String(CCD_Setup_Get_Orientation()),
+					    "Camera readout orientation");
 	if(retval == FALSE)
 	{
 		ce = create_ccd_library_exception();
 		throw ce;
 	}
-	/* MJD */
-	retval = NGAT_Astro_Timespec_To_MJD(start_time,FALSE,&mjd);
+	/* Note IMGRECT / SUBRECT may need to be modified to account for read out flipping */
+	/* IMGRECT 1, 1024, 1024, 1 */
+	/* SUBRECT 1, 1024, 1024, 1 */
+	if(mCachedWindowFlags)
+	{
+		xs = mCachedWindow.X_Start;
+		ys = mCachedWindow.Y_Start;
+		xe = mCachedWindow.X_End;
+		ye = mCachedWindow.Y_End;
+	}
+	else
+	{
+		xs = 1;
+		ys = 1;
+		xe = mCachedNCols;
+		ye = mCachedNRows;
+	}
+	sprintf(img_rect_buff,"%d, %d, %d, %d",xs,ys,xe,ye);
+	retval = CCD_Fits_Header_Add_String(fits_header,"IMGRECT",img_rect_buff,"Imaging area");
 	if(retval == FALSE)
 	{
-		ce = create_ngatastro_library_exception();
+		ce = create_ccd_library_exception();
 		throw ce;
 	}
-	retval = CCD_Fits_Header_Add_Float(&mFitsHeader,"MJD",mjd,"Modified Julian Date");
+	retval = CCD_Fits_Header_Add_String(fits_header,"SUBRECT",img_rect_buff,"Sub-maging area");
 	if(retval == FALSE)
 	{
 		ce = create_ccd_library_exception();
 		throw ce;
 	}
-	
-	/* HBIN */
-	retval = CCD_Fits_Header_Add_Int(&mFitsHeader,"HBIN",CCD_Setup_Get_Bin_X(),"Horizontal/X binning");
+	/* VSHIFT */
+	retval = CCD_Fits_Header_Add_Float(fits_header,"VSHIFT",(double)CCD_Setup_Get_VS_Speed(),
+					   "vertical shift speed");
 	if(retval == FALSE)
 	{
 		ce = create_ccd_library_exception();
 		throw ce;
-	}		
-	/* VBIN */
-	retval = CCD_Fits_Header_Add_Int(&mFitsHeader,"VBIN",CCD_Setup_Get_Bin_X(),"Vertical/Y binning");
+	}
+	retval = CCD_Fits_Header_Add_Units(fits_header,"VSHIFT","us/pixel");
 	if(retval == FALSE)
 	{
 		ce = create_ccd_library_exception();
 		throw ce;
-	}		
-	/* BINNING vxh ! */
-	/* GAINVAL */
-	/* SGAIN CCD Mode GAIN (Faint)*/
-	/* SRDNOISE CCD Mode RDNoise (Slow) */
-	/* NOISEADU */
-	/* NOISEEL */
-	/* CCDTEMP double Kelvin */
-	retval = CCD_Temperature_Get(&temperature,&temperature_status);
+	}
+	/* VSHIFTI */
+	retval = CCD_Fits_Header_Add_Int(fits_header,"VSHIFTI",CCD_Setup_Get_VS_Speed_Index(),
+					 "vertical shift speed index");
 	if(retval == FALSE)
 	{
 		ce = create_ccd_library_exception();
 		throw ce;
-	}		
-	retval = CCD_Fits_Header_Add_Float(&mFitsHeader,"CCDTEMP",temperature+DEGREES_CENTIGRADE_TO_KELVIN,
-					   "CCD temperature");
+	}
+	/* HSHIFT */
+	retval = CCD_Fits_Header_Add_Float(fits_header,"HSHIFT",(double)CCD_Setup_Get_HS_Speed(),
+					   "horizontal shift speed");
 	if(retval == FALSE)
 	{
 		ce = create_ccd_library_exception();
 		throw ce;
 	}
-	retval = CCD_Fits_Header_Add_Units(&mFitsHeader,"CCDTEMP","Kelvin");
+	retval = CCD_Fits_Header_Add_Units(fits_header,"HSHIFT","MHz");
 	if(retval == FALSE)
 	{
 		ce = create_ccd_library_exception();
 		throw ce;
 	}
-	/* RUN-NO */
-	/* HEAD string CCD camera head string DU8201_UVB etc */
-	retval = CCD_Setup_Get_Camera_Head_Model_Name(camera_head_model_name,128);
+	/* HSHIFTI */
+	retval = CCD_Fits_Header_Add_Int(fits_header,"HSHIFTI",CCD_Setup_Get_HS_Speed_Index(),
+					 "horizontal shift speed index");
 	if(retval == FALSE)
 	{
 		ce = create_ccd_library_exception();
 		throw ce;
-	}		
-	retval = CCD_Fits_Header_Add_String(&mFitsHeader,"HEAD",camera_head_model_name,"Camera head model name");
+	}
+	/* PREGAIN */
+	gain_string = to_string(mCachedGain);
+	retval = CCD_Fits_Header_Add_String(fits_header,"PREGAIN",gain_string.c_str(),"pre-amp gain factor");
 	if(retval == FALSE)
 	{
 		ce = create_ccd_library_exception();
 		throw ce;
 	}
-	/* SERNO camera serial number */
-	retval = CCD_Fits_Header_Add_Int(&mFitsHeader,"SERNO",CCD_Setup_Get_Camera_Serial_Number(),
-					 "Camera serial number");
+	/* GAIN */
+	/* we get the camera gain from the config file, where it is indexed by the horizontal readout speed and
+	** the pre-amp gain index: ccd.gain.<horizontal shift speed index>.<pre-amp gain index> = <gain in e/adu> */
+	sprintf(gain_keyword_string,"ccd.gain.%d.%d",CCD_Setup_Get_HS_Speed_Index(),
+		CCD_Setup_Get_Pre_Amp_Gain_Index());
+	mCameraConfig.get_config_double(CONFIG_CAMERA_SECTION,gain_keyword_string,&gain);
+	retval = CCD_Fits_Header_Add_Float(fits_header,"GAIN",(double)gain,"Camera Gain");
 	if(retval == FALSE)
 	{
 		ce = create_ccd_library_exception();
 		throw ce;
 	}
-	/* FLIPX */
-	retval = CCD_Fits_Header_Add_Logical(&mFitsHeader,"FLIPX",CCD_Setup_Get_Flip_X(),
-					     "Camera readout flipped horizontally");
+	retval = CCD_Fits_Header_Add_Units(fits_header,"GAIN","e/ADU");
 	if(retval == FALSE)
 	{
 		ce = create_ccd_library_exception();
 		throw ce;
 	}
-	/* FLIPY */
-	retval = CCD_Fits_Header_Add_Logical(&mFitsHeader,"FLIPY",CCD_Setup_Get_Flip_Y(),
-					     "Camera readout flipped vertically");
+	std::lock_guard<std::mutex> lock(mCameraFitsHeaderMutex);
+	mCameraFitsHeader = header_set;
+}
+
+/**
+ * Method to add the internal FITS headers generated from within the camera to an image's FITS headers,
+ * which are then saved to the generated FITS images. Only the headers that change every frame are generated here,
+ * from the exposure length, start time and temperature recorded against the frame when it was read out
+ * (hand_off_frame). Headers added are:
+ * <ul>
+ * <li><b>EXPTIME</b> Length of exposure in seconds.
+ * <li><b>EXPOSURE</b> Length of exposure in seconds.
+ * <li><b>UTSTART</b> The start exposure timestamp, recorded using CCD_Exposure_Start_Time_Get. We use 
+ *                   CCD_Fits_Header_TimeSpec_To_UtStart_String to format the string.
+ * <li><b>DATE-OBS</b> The start exposure timestamp, recorded using CCD_Exposure_Start_Time_Get. We use 
+ *                   CCD_Fits_Header_TimeSpec_To_Date_Obs_String to format the string.
+ * <li><b>MJD</b> We retrieve the modified julian date from the start exposure timestamp using 
+ *                NGAT_Astro_Timespec_To_MJD, and add it as a float.
+ * <li><b>CCDTEMP</b> The camera temperature in degrees Kelvin. This is the cached temperature sample in degrees
+ *                   centigrade recorded when the frame was read out (get_frame_temperature), with 
+ *                   DEGREES_CENTIGRADE_TO_KELVIN added to it.
+ * <li><b>TSETUP / TACQUIRE / TREADOUT / TPROCESS</b> If mFitsTimingsEnabled is set, the durations in milliseconds
+ *                   of the frame's request to acquisition start, acquisition, readout and processing (re-orientation)
+ *                   phases, from the frame's timeline (add_timing_fits_header).
+ * <li><b>STATMIN / STATMAX / STATMEAN / STATMED / STATSTD / SATURATE / SATCOUNT / R&lt;n&gt;...</b> If
+ *                   mFitsStatisticsEnabled is set, the statistics of the frame and of each configured region of it,
+ *                   computed by process_frame (add_statistics_fits_headers).
+ * </ul>
+ * We then merge in the precomputed camera FITS headers describing the setup the frame was read out with 
+ * (the frame's mCameraFitsHeaderSet, see update_camera_fits_headers) using CCD_Fits_Header_Merge.
+ * @param fits_header The address of the image's FITS headers to add the camera FITS headers to.
+ * @param frame The read out frame, including the exposure length and the setup it was acquired with.
+ * @see Camera::AcquiredFrame
+ * @see Camera::begin_frame
+ * @see Camera::hand_off_frame
+ * @see Camera::get_frame_temperature
+ * @see Camera::update_camera_fits_headers
+ * @see Camera::create_ccd_library_exception
+ * @see Camera::create_ngatastro_library_exception
+ * @see Camera::mFitsTimingsEnabled
+ * @see Camera::add_timing_fits_header
+ * @see Camera::mFitsStatisticsEnabled
+ * @see Camera::add_statistics_fits_headers
+ * @see DEGREES_CENTIGRADE_TO_KELVIN
+ * @see CCD_Exposure_Start_Time_Get
+ * @see CCD_Fits_Header_Add_String
+ * @see CCD_Fits_Header_Add_Float
+ * @see CCD_Fits_Header_Add_Units
+ * @see CCD_Fits_Header_Merge
+ * @see CCD_Fits_Header_TimeSpec_To_UtStart_String
+ * @see CCD_Fits_Header_TimeSpec_To_Date_Obs_String
+ * @see NGAT_Astro_Timespec_To_MJD
+ */
+void Camera::add_camera_fits_headers(struct Fits_Header_Struct *fits_header,const AcquiredFrame &frame)
+{
+	CameraException ce;
+	struct timespec start_time;
+	char time_string[32];
+	double mjd;
+	int retval;
+	
+	/* EXPTIME  double in secs */
+	retval = CCD_Fits_Header_Add_Float(fits_header,"EXPTIME",
+					   ((double)frame.mExposureLength)/((double)CCD_GENERAL_ONE_SECOND_MS),
+					   "Exposure length in decimal seconds");
 	if(retval == FALSE)
 	{
 		ce = create_ccd_library_exception();
 		throw ce;
 	}
-	/* Note IMGRECT / SUBRECT may need to be modified to account for read out flipping */
-	/* IMGRECT 1, 1024, 1024, 1 */
-	/* SUBRECT 1, 1024, 1024, 1 */
-	if(mCachedWindowFlags)
+	retval = CCD_Fits_Header_Add_Units(fits_header,"EXPTIME","s");
+	if(retval == FALSE)
 	{
-		xs = mCachedWindow.X_Start;
-		ys = mCachedWindow.Y_Start;
-		xe = mCachedWindow.X_End;
-		ye = mCachedWindow.Y_End;
-	}
-	else
+		ce = create_ccd_library_exception();
+		throw ce;
+	}	
+	/* EXPOSURE double in secs */
+	retval = CCD_Fits_Header_Add_Float(fits_header,"EXPOSURE",
+					   ((double)frame.mExposureLength)/((double)CCD_GENERAL_ONE_SECOND_MS),
+					   "Exposure length in decimal seconds");
+	if(retval == FALSE)
 	{
-		xs = 1;
-		ys = 1;
-		xe = mCachedNCols;
-		ye = mCachedNRows;
+		ce = create_ccd_library_exception();
+		throw ce;
 	}
-	sprintf(img_rect_buff,"%d, %d, %d, %d",xs,ys,xe,ye);
-	retval = CCD_Fits_Header_Add_String(&mFitsHeader,"IMGRECT",img_rect_buff,"Imaging area");
+	retval = CCD_Fits_Header_Add_Units(fits_header,"EXPOSURE","s");
 	if(retval == FALSE)
 	{
 		ce = create_ccd_library_exception();
 		throw ce;
 	}
-	retval = CCD_Fits_Header_Add_String(&mFitsHeader,"SUBRECT",img_rect_buff,"Sub-maging area");
+	/* start of exposure timestamp, recorded when the frame was read out */
+	start_time = frame.mStartTime;
+	/* UTSTART HH:MM:SS */
+	CCD_Fits_Header_TimeSpec_To_UtStart_String(start_time,time_string);
+	retval = CCD_Fits_Header_Add_String(fits_header,"UTSTART",time_string,"Start time of the observation");
 	if(retval == FALSE)
 	{
 		ce = create_ccd_library_exception();
 		throw ce;
 	}
-	/* VSHIFT */
-	vs_speed = CCD_Setup_Get_VS_Speed();
-	retval = CCD_Fits_Header_Add_Float(&mFitsHeader,"VSHIFT",(double)vs_speed,"vertical shift speed");
+	/* LCSTART HH:MM:SS */
+	/* DATE-OBS YYYY-MM-DD */
+	/* DATE-OBS YYYY-MM-DDTHH:MM:SS.sss */
+	CCD_Fits_Header_TimeSpec_To_Date_Obs_String(start_time,time_string);
+	retval = CCD_Fits_Header_Add_String(fits_header,"DATE-OBS",time_string,"Start time of the observation");
 	if(retval == FALSE)
 	{
 		ce = create_ccd_library_exception();
 		throw ce;
 	}
-	retval = CCD_Fits_Header_Add_Units(&mFitsHeader,"VSHIFT","us/pixel");
+	/* MJD */
+	retval = NGAT_Astro_Timespec_To_MJD(start_time,FALSE,&mjd);
 	if(retval == FALSE)
 	{
-		ce = create_ccd_library_exception();
+		ce = create_ngatastro_library_exception();
 		throw ce;
 	}
-	/* VSHIFTI */
-	vs_speed_index = CCD_Setup_Get_VS_Speed_Index();
-	retval = CCD_Fits_Header_Add_Int(&mFitsHeader,"VSHIFTI",vs_speed_index,"vertical shift speed index");
+	retval = CCD_Fits_Header_Add_Float(fits_header,"MJD",mjd,"Modified Julian Date");
 	if(retval == FALSE)
 	{
 		ce = create_ccd_library_exception();
 		throw ce;
 	}
-	/* HSHIFT */
-	hs_speed = CCD_Setup_Get_HS_Speed();
-	retval = CCD_Fits_Header_Add_Float(&mFitsHeader,"HSHIFT",(double)hs_speed,"horizontal shift speed");
+	/* CCDTEMP double Kelvin */
+	retval = CCD_Fits_Header_Add_Float(fits_header,"CCDTEMP",frame.mTemperature+DEGREES_CENTIGRADE_TO_KELVIN,
+					   "CCD temperature");
 	if(retval == FALSE)
 	{
 		ce = create_ccd_library_exception();
 		throw ce;
 	}
-	retval = CCD_Fits_Header_Add_Units(&mFitsHeader,"HSHIFT","MHz");
+	retval = CCD_Fits_Header_Add_Units(fits_header,"CCDTEMP","Kelvin");
 	if(retval == FALSE)
 	{
 		ce = create_ccd_library_exception();
 		throw ce;
 	}
-	/* HSHIFTI */
-	hs_speed_index = CCD_Setup_Get_HS_Speed_Index();
-	retval = CCD_Fits_Header_Add_Int(&mFitsHeader,"HSHIFTI",hs_speed_index,"horizontal shift speed index");
+	/* the duration of each phase of the frame's acquisition, up to it's processing */
+	if(mFitsTimingsEnabled)
+	{
+		add_timing_fits_header(fits_header,"TSETUP",frame.mTimeline,CCD_EXPOSURE_TIMELINE_REQUEST,
+				       CCD_EXPOSURE_TIMELINE_START,"Request to acquisition start time");
+		add_timing_fits_header(fits_header,"TACQUIRE",frame.mTimeline,CCD_EXPOSURE_TIMELINE_START,
+				       CCD_EXPOSURE_TIMELINE_ACQUIRED,"Acquisition time");
+		add_timing_fits_header(fits_header,"TREADOUT",frame.mTimeline,CCD_EXPOSURE_TIMELINE_ACQUIRED,
+				       CCD_EXPOSURE_TIMELINE_READOUT,"Readout time");
+		add_timing_fits_header(fits_header,"TPROCESS",frame.mTimeline,CCD_EXPOSURE_TIMELINE_READOUT,
+				       CCD_EXPOSURE_TIMELINE_ORIENT,"Readout to re-oriented time");
+	}
+	/* the statistics of the frame, and of it's configured regions */
+	if(mFitsStatisticsEnabled&&(frame.mStatistics != nullptr))
+		add_statistics_fits_headers(fits_header,*(frame.mStatistics));
+	/* RUN-NO */
+	/* the precomputed headers describing the camera and it's setup */
+	if(frame.mCameraFitsHeaderSet != nullptr)
+	{
+		retval = CCD_Fits_Header_Merge(fits_header,frame.mCameraFitsHeaderSet->mFitsHeader);
+		if(retval == FALSE)
+		{
+			ce = create_ccd_library_exception();
+			throw ce;
+		}
+	}
+}
+
+/**
+ * Add a FITS header containing the time between two phases of a frame's timeline, in milliseconds.
+ * If either phase was not reached, the header is not added.
+ * @param fits_header The address of the image's FITS headers to add the header to.
+ * @param keyword The keyword of the FITS header.
+ * @param timeline The frame's timeline.
+ * @param from_phase The phase the duration starts at.
+ * @param to_phase The phase the duration ends at.
+ * @param comment The comment of the FITS header.
+ * @see Camera::create_ccd_library_exception
+ * @see ExposureTimingRing::get_phase_interval
+ * @see CCD_Fits_Header_Add_Float
+ * @see CCD_Fits_Header_Add_Units
+ */
+void Camera::add_timing_fits_header(struct Fits_Header_Struct *fits_header,const char *keyword,
+				    const struct CCD_Exposure_Timeline_Struct &timeline,
+				    enum CCD_EXPOSURE_TIMELINE_PHASE from_phase,enum CCD_EXPOSURE_TIMELINE_PHASE to_phase,
+				    const char *comment)
+{
+	CameraException ce;
+	int64_t interval;
+	int retval;
+
+	interval = ExposureTimingRing::get_phase_interval(timeline,from_phase,to_phase);
+	if(interval < 0)
+		return;
+	retval = CCD_Fits_Header_Add_Float(fits_header,(char*)keyword,
+					   ((double)interval)/((double)CCD_GENERAL_ONE_MILLISECOND_MICROSECOND),
+					   (char*)comment);
 	if(retval == FALSE)
 	{
 		ce = create_ccd_library_exception();
 		throw ce;
 	}
-	/* PREGAIN */
-	gain_string = to_string(mCachedGain);
-	retval = CCD_Fits_Header_Add_String(&mFitsHeader,"PREGAIN",gain_string.c_str(),"pre-amp gain factor");
+	retval = CCD_Fits_Header_Add_Units(fits_header,(char*)keyword,"ms");
 	if(retval == FALSE)
 	{
 		ce = create_ccd_library_exception();
 		throw ce;
 	}
-	/* GAIN */
-	/* we get the camera gain from the config file, where it is indexed by the horizontal readout speed and
-	** the pre-amp gain index: ccd.gain.<horizontal shift speed index>.<pre-amp gain index> = <gain in e/adu> */
-	pre_amp_gain_index = CCD_Setup_Get_Pre_Amp_Gain_Index();
-	sprintf(gain_keyword_string,"ccd.gain.%d.%d",hs_speed_index,pre_amp_gain_index);
-	mCameraConfig.get_config_double(CONFIG_CAMERA_SECTION,gain_keyword_string,&gain);
-	retval = CCD_Fits_Header_Add_Float(&mFitsHeader,"GAIN",(double)gain,"Camera Gain");
+}
+
+/**
+ * Add FITS headers containing the statistics of a frame, and of each configured region of it.
+ * Headers added are:
+ * <ul>
+ * <li><b>STATMIN / STATMAX</b> The minimum / maximum pixel value in the frame.
+ * <li><b>STATMEAN / STATMED / STATSTD</b> The mean, median and (population) standard deviation of the pixel values.
+ * <li><b>SATURATE</b> The pixel value at or above which a pixel is counted as saturated.
+ * <li><b>SATCOUNT</b> The number of saturated pixels in the frame.
+ * <li><b>R&lt;n&gt;NAME</b> The name of the n'th region (numbered from 1), followed by the same statistics of it,
+ *     <b>R&lt;n&gt;MIN / R&lt;n&gt;MAX / R&lt;n&gt;MEAN / R&lt;n&gt;MED / R&lt;n&gt;STD / R&lt;n&gt;SAT</b>.
+ *     If the region lies outside the frame it has no pixels, and only it's name is added.
+ * </ul>
+ * @param fits_header The address of the image's FITS headers to add the headers to.
+ * @param statistics The frame's statistics, computed by process_frame.
+ * @see Camera::add_statistics_fits_header
+ * @see Camera::process_frame
+ * @see Camera::create_ccd_library_exception
+ * @see CCD_Fits_Header_Add_String
+ * @see ImageStatistics
+ */
+void Camera::add_statistics_fits_headers(struct Fits_Header_Struct *fits_header,const ImageStatistics &statistics)
+{
+	CameraException ce;
+	std::string keyword_root;
+	int retval;
+
+	add_statistics_fits_header(fits_header,"STATMIN",statistics.image.min,"Minimum pixel value","ADU");
+	add_statistics_fits_header(fits_header,"STATMAX",statistics.image.max,"Maximum pixel value","ADU");
+	add_statistics_fits_header(fits_header,"STATMEAN",statistics.image.mean,"Mean pixel value","ADU");
+	add_statistics_fits_header(fits_header,"STATMED",statistics.image.median,"Median pixel value","ADU");
+	add_statistics_fits_header(fits_header,"STATSTD",statistics.image.stddev,"Standard deviation of pixel values",
+				   "ADU");
+	add_statistics_fits_header(fits_header,"SATURATE",statistics.saturation_level,"Saturation level","ADU");
+	add_statistics_fits_header(fits_header,"SATCOUNT",(int)statistics.image.saturated_count,
+				   "Number of saturated pixels",NULL);
+	for(size_t i = 0; i < statistics.regions.size(); i++)
+	{
+		const RegionStatistics &region = statistics.regions[i];
+
+		keyword_root = "R"+std::to_string(i+1);
+		retval = CCD_Fits_Header_Add_String(fits_header,(keyword_root+"NAME").c_str(),region.name.c_str(),
+						    ("Name of statistics region "+std::to_string(i+1)).c_str());
+		if(retval == FALSE)
+		{
+			ce = create_ccd_library_exception();
+			throw ce;
+		}
+		if(region.pixel_count == 0)
+			continue;
+		add_statistics_fits_header(fits_header,keyword_root+"MIN",region.min,
+					   "Minimum pixel value in "+region.name,"ADU");
+		add_statistics_fits_header(fits_header,keyword_root+"MAX",region.max,
+					   "Maximum pixel value in "+region.name,"ADU");
+		add_statistics_fits_header(fits_header,keyword_root+"MEAN",region.mean,
+					   "Mean pixel value in "+region.name,"ADU");
+		add_statistics_fits_header(fits_header,keyword_root+"MED",region.median,
+					   "Median pixel value in "+region.name,"ADU");
+		add_statistics_fits_header(fits_header,keyword_root+"STD",region.stddev,
+					   "Standard deviation of pixel values in "+region.name,"ADU");
+		add_statistics_fits_header(fits_header,keyword_root+"SAT",(int)region.saturated_count,
+					   "Number of saturated pixels in "+region.name,NULL);
+	}
+}
+
+/**
+ * Add an integer FITS header containing one of a frame's statistics.
+ * @param fits_header The address of the image's FITS headers to add the header to.
+ * @param keyword The keyword of the FITS header.
+ * @param value The value of the FITS header.
+ * @param comment The comment of the FITS header.
+ * @param units The units of the FITS header, or NULL if it has no units.
+ * @see Camera::add_statistics_fits_headers
+ * @see Camera::create_ccd_library_exception
+ * @see CCD_Fits_Header_Add_Int
+ * @see CCD_Fits_Header_Add_Units
+ */
+void Camera::add_statistics_fits_header(struct Fits_Header_Struct *fits_header,const std::string &keyword,int value,
+					const std::string &comment,const char *units)
+{
+	CameraException ce;
+	int retval;
+
+	retval = CCD_Fits_Header_Add_Int(fits_header,keyword.c_str(),value,comment.c_str());
 	if(retval == FALSE)
 	{
 		ce = create_ccd_library_exception();
 		throw ce;
 	}
-	retval = CCD_Fits_Header_Add_Units(&mFitsHeader,"GAIN","e/ADU");
+	if(units != NULL)
+	{
+		retval = CCD_Fits_Header_Add_Units(fits_header,keyword.c_str(),units);
+		if(retval == FALSE)
+		{
+			ce = create_ccd_library_exception();
+			throw ce;
+		}
+	}
+}
+
+/**
+ * Add a floating point FITS header containing one of a frame's statistics.
+ * @param fits_header The address of the image's FITS headers to add the header to.
+ * @param keyword The keyword of the FITS header.
+ * @param value The value of the FITS header.
+ * @param comment The comment of the FITS header.
+ * @param units The units of the FITS header, or NULL if it has no units.
+ * @see Camera::add_statistics_fits_headers
+ * @see Camera::create_ccd_library_exception
+ * @see CCD_Fits_Header_Add_Float
+ * @see CCD_Fits_Header_Add_Units
+ */
+void Camera::add_statistics_fits_header(struct Fits_Header_Struct *fits_header,const std::string &keyword,
+					double value,const std::string &comment,const char *units)
+{
+	CameraException ce;
+	int retval;
+
+	retval = CCD_Fits_Header_Add_Float(fits_header,keyword.c_str(),value,comment.c_str());
 	if(retval == FALSE)
 	{
 		ce = create_ccd_library_exception();
 		throw ce;
 	}
+	if(units != NULL)
+	{
+		retval = CCD_Fits_Header_Add_Units(fits_header,keyword.c_str(),units);
+		if(retval == FALSE)
+		{
+			ce = create_ccd_library_exception();
+			throw ce;
+		}
+	}
 }
 
 /**
@@ -1923,3 +5695,40 @@ static void ngatastro_log_to_log4cxx(int level,char *string)
 	}
 }
 	
+
+/**
+ * Copy an image buffer into the data of an ImageDataBinary, as raw bytes (2 bytes per pixel).
+ * On a big-endian host we byte swap each pixel so the returned data is always little-endian.
+ * If image_buf is NULL (no image has been read out) the data is cleared.
+ * @param image_buf The image buffer to copy.
+ * @param img_data The ImageDataBinary to copy the pixels into.
+ * @see ImageDataBinary
+ */
+static void image_buf_to_binary(std::shared_ptr<ImageBuffer> image_buf,ImageDataBinary &img_data)
+{
+	if(image_buf != nullptr)
+		img_data.data.assign((const char*)(image_buf->data()),image_buf->size()*sizeof(uint16_t));
+	else
+		img_data.data.clear();
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	for(size_t i = 0; i < img_data.data.size(); i += 2)
+		std::swap(img_data.data[i],img_data.data[i+1]);
+#endif
+}
+
+/**
+ * Get a description of an exception, to record as an exposure series error (Camera::set_exposure_error).
+ * For a CameraException we return it's message, as the thrift generated what() wraps the message in text
+ * describing the exception type.
+ * @param e The exception.
+ * @return A description of the error.
+ * @see Camera::set_exposure_error
+ */
+static std::string exception_to_error(const std::exception &e)
+{
+	const CameraException *camera_exception = dynamic_cast<const CameraException*>(&e);
+
+	if(camera_exception != nullptr)
+		return camera_exception->message;
+	return e.what();
+}
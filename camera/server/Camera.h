@@ -7,11 +7,34 @@
 #ifndef CAMERA_H
 #define CAMERA_H
 #include "CameraService.h"
+#include "BlockingCallLimiter.h"
 #include "CameraConfig.h"
+#include "ExposureTimingRing.h"
+#include "FitsWriterQueue.h"
+#include "FrameReduction.h"
+#include "FrameStatistics.h"
+#include "ImageBuffer.h"
+#include "ImageCodec.h"
+#include "ImagePreview.h"
+#include "ImageRegion.h"
+#include "SpscQueue.h"
+#include "TemperatureHistoryRing.h"
 #include <log4cxx/logger.h>
 #include <boost/program_options.hpp>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <time.h>
+#include <semaphore.h>
+#include "ccd_exposure.h"
 #include "ccd_fits_header.h"
+#include "ccd_frame_ring.h"
+#include "ccd_orientation.h"
 #include "ccd_setup.h"
+#include "ccd_temperature.h"
 
 using std::string;
 using std::vector;
@@ -38,17 +61,39 @@ class Camera : virtual public CameraServiceIf
     void add_fits_header(const std::string & keyword, const FitsCardType::type valtype,const std::string & value,
 			 const std::string & comment);
     void clear_fits_headers();
+    int64_t create_fits_header_set(const std::vector<FitsHeaderCard> & fits_info);
+    void delete_fits_header_set(const int64_t header_set_id);
     
     // Take and process exposures
     void set_exposure_length(const int32_t exposure_length);
     void start_expose(const bool save_image);
+    void start_expose_with_header_set(const bool save_image,const int64_t header_set_id);
     void start_bias();
     void start_dark();
+    void start_multrun(const int32_t exposure_count,const int32_t exposure_length,const bool save_images);
+    void start_multbias(const int32_t exposure_count);
+    void start_multdark(const int32_t exposure_count,const int32_t exposure_length);
     void abort_exposure();
+    bool wait_for_exposure(const int32_t timeout_ms);
     
     // Return state and data
     void get_state(CameraState &state);
+    void get_temperature_history(TemperatureHistory &history,const int64_t since,
+				 const TemperatureResolution::type resolution);
     void get_image_data(ImageData& img_data);
+    void get_image_data_binary(ImageDataBinary& img_data);
+    void get_image_region(ImageRegion& region,const int32_t x0,const int32_t y0,const int32_t w,const int32_t h,
+			  const int32_t step);
+    void get_preview(Preview &preview,const int32_t max_width,const int32_t max_height,
+		     const PreviewStretch::type stretch,const PreviewDownsample::type downsample,
+		     const PreviewFormat::type format);
+    void get_image_statistics(ImageStatistics &statistics,const int64_t frame_id,const bool include_histogram);
+    void get_image_codecs(std::vector<ImageCodec::type> &codecs);
+    void get_image_data_compressed(CompressedImageData &compressed,const int64_t frame_id,
+				   const ImageCodec::type codec);
+    void list_frames(std::vector<FrameInfo> &frames);
+    void get_image_data_by_id(ImageDataBinary& img_data,const int64_t frame_id);
+    void get_exposure_timings(std::vector<ExposureTiming> &timings);
     void get_last_image_filename(std::string &filename);
 
     //Camera temperature control
@@ -56,11 +101,185 @@ class Camera : virtual public CameraServiceIf
     void warm_up();
     
   private:
+    /**
+     * Structure holding one read out frame in the frame history ring (mFrameHistory).
+     * <ul>
+     * <li><b>mInfo</b> The frame's metadata, as returned by list_frames. A frame_id of zero means the slot is empty.
+     * <li><b>mImageBuf</b> The frame's image buffer. This may be shared with mImageBuf (for the latest frame)
+     *     and with clients downloading the frame.
+     * <li><b>mStatistics</b> The frame's statistics, computed when it was processed. This may be shared with
+     *     mImageStatistics (for the latest frame).
+     * </ul>
+     */
+    struct FrameHistoryEntry
+    {
+	    FrameInfo mInfo;
+	    std::shared_ptr<ImageBuffer> mImageBuf;
+	    std::shared_ptr<const ImageStatistics> mStatistics;
+    };
+    /**
+     * Structure holding a set of FITS headers. A set is never modified once it has been shared: the client's FITS
+     * headers (mFitsHeader) are copied on write whilst an exposure holds a snapshot of them, and the header sets
+     * created by create_fits_header_set are never modified. The header list is freed when the last reference to the
+     * set is released.
+     * @see Camera::mFitsHeader
+     * @see Camera::mFitsHeaderSets
+     */
+    struct FitsHeaderSet
+    {
+	    FitsHeaderSet() { CCD_Fits_Header_Initialise(&mFitsHeader); }
+	    ~FitsHeaderSet() { CCD_Fits_Header_Free(&mFitsHeader); }
+	    FitsHeaderSet(const FitsHeaderSet &) = delete;
+	    FitsHeaderSet & operator=(const FitsHeaderSet &) = delete;
+	    /**
+	     * The list of FITS header cards.
+	     */
+	    struct Fits_Header_Struct mFitsHeader;
+    };
+    /**
+     * Structure holding one read out frame, handed from the acquisition stage (the exposure threads) to the
+     * processing stage (frame_processing_thread) through mFramePipeline. Everything the processing stage needs
+     * is captured when the frame is read out, as by the time the frame is processed the detector may already be
+     * taking the next frame, possibly with a different setup.
+     * <ul>
+     * <li><b>mImageBuf</b> The image buffer the frame was read out into, as read out (not yet re-oriented).
+     *     A NULL buffer marks the end of an expose / bias / dark / multrun (hand_off_end_of_exposure), after which
+     *     the processing stage waits for the FITS writer queue to publish the saved images.
+     * <li><b>mImageBufferLength</b> The number of pixels in the image buffer.
+     * <li><b>mBinnedNCols / mBinnedNRows</b> The binned dimensions of the frame as read out.
+     * <li><b>mNCols / mNRows</b> The binned dimensions of the frame once it has been re-oriented.
+     * <li><b>mXBin / mYBin</b> The binning the frame was read out with.
+     * <li><b>mXStart / mYStart</b> The first detector column / row (unbinned, starting from 1) of the readout
+     *     window the frame was read out with (CCD_Setup_Get_Horizontal_Start / CCD_Setup_Get_Vertical_Start).
+     * <li><b>mOrientation</b> How the frame has to be re-oriented (CCD_Setup_Get_Orientation).
+     * <li><b>mTemperature</b> The CCD temperature in degrees centigrade, the cached temperature sample when the
+     *     frame was read out, kept up to date by the telemetry thread (get_frame_temperature).
+     * <li><b>mStartTime</b> The start time of the exposure (CCD_Exposure_Start_Time_Get).
+     * <li><b>mExposureLength</b> The exposure length in milliseconds (zero for a bias).
+     * <li><b>mOpenShutter</b> Whether the shutter was opened for the frame (false for a bias or dark).
+     * <li><b>mSaveImage</b> Whether the frame is to be saved to a FITS image.
+     * <li><b>mFitsHeaderSet</b> If the frame is to be saved, the snapshot of the client FITS headers taken when the
+     *     frame was started, that the camera's own FITS headers are added to when it is saved.
+     * <li><b>mCameraFitsHeaderSet</b> If the frame is to be saved, the precomputed camera FITS headers
+     *     (mCameraFitsHeader) describing the setup the frame was read out with.
+     * <li><b>mTimeline</b> The time stamps (CLOCK_MONOTONIC) of the phases of the frame's acquisition. The request
+     *     phase is set by begin_frame, the CCD library's phases (setup to readout) are retrieved by hand_off_frame,
+     *     and the remaining phases are time stamped as the frame is processed, saved and published.
+     * <li><b>mStatistics</b> The frame's statistics, computed by process_frame once the frame has been re-oriented.
+     * <li><b>mReducedImage</b> If in-server reduction is enabled, the reduced (float32) frame computed by
+     *     process_frame, saved alongside the raw frame. NULL if the frame was not reduced.
+     * <li><b>mSeriesId</b> The id of the exposure series (mExposureSeriesId) the frame was taken in, so an error
+     *     processing the frame is reported against that series, even if another series has since been started.
+     * </ul>
+     * @see Camera::mFramePipeline
+     * @see Camera::frame_processing_thread
+     */
+    struct AcquiredFrame
+    {
+	    std::shared_ptr<ImageBuffer> mImageBuf;
+	    size_t mImageBufferLength;
+	    int mBinnedNCols;
+	    int mBinnedNRows;
+	    int mNCols;
+	    int mNRows;
+	    int mXBin;
+	    int mYBin;
+	    int mXStart;
+	    int mYStart;
+	    enum CCD_ORIENTATION mOrientation;
+	    double mTemperature;
+	    struct timespec mStartTime;
+	    int32_t mExposureLength;
+	    bool mOpenShutter;
+	    bool mSaveImage;
+	    std::shared_ptr<const FitsHeaderSet> mFitsHeaderSet;
+	    std::shared_ptr<const FitsHeaderSet> mCameraFitsHeaderSet;
+	    struct CCD_Exposure_Timeline_Struct mTimeline;
+	    std::shared_ptr<const ImageStatistics> mStatistics;
+	    std::shared_ptr<float[]> mReducedImage;
+	    int64_t mSeriesId;
+    };
+    /**
+     * Structure holding an immutable sample of the camera state, published by sample_camera_state (in mCameraState)
+     * and copied by get_state, so get_state never has to call the CCD library or the Andor driver.
+     * <ul>
+     * <li><b>mState</b> The camera state when the sample was taken. The elapsed / remaining exposure lengths
+     *     of an exposure in progress are interpolated by get_state, and exposure_in_progress / exposure_index / 
+     *     exposure_count / duty_cycle are filled in by get_state.
+     * <li><b>mExposureStatus</b> The CCD library's exposure status when the sample was taken.
+     * <li><b>mExposureStartTime</b> The start time of the current/last exposure, used to interpolate the
+     *     elapsed exposure length.
+     * </ul>
+     * @see Camera::mCameraState
+     * @see Camera::sample_camera_state
+     * @see Camera::get_state
+     */
+    struct CameraStateSample
+    {
+	    CameraState mState;
+	    enum CCD_EXPOSURE_STATUS mExposureStatus;
+	    struct timespec mExposureStartTime;
+    };
     // Private methods
-    void expose_thread(int32_t exposure_length, bool save_image);
+    void expose_thread(int32_t exposure_length, bool save_image,
+		       std::shared_ptr<const FitsHeaderSet> fits_header_set);
     void bias_thread();
     void dark_thread(int32_t exposure_length);
-    void add_camera_fits_headers(int32_t exposure_length);
+    void begin_exposure_series(const char *method_name,int exposure_count);
+    void check_blocking_call_slot(const BlockingCallSlot &slot,const char *method_name);
+    void multrun_thread(int32_t exposure_count,int32_t exposure_length,bool open_shutter,bool save_images);
+    void initialize_frame_ring();
+    void initialize_frame_history();
+    void initialize_exposure_timings();
+    void initialize_image_codecs();
+    void initialize_preview();
+    void initialize_image_statistics();
+    void initialize_reduction();
+    void initialize_fits_writer();
+    void initialize_frame_pipeline();
+    void stop_frame_pipeline();
+    void initialize_buffer_pool(struct CCD_Setup_Buffer_Pool_Struct *pool,const char *description,int buffer_count,
+				size_t buffer_pixel_count);
+    std::shared_ptr<float[]> allocate_reduced_image(size_t pixel_count);
+    std::shared_ptr<ImageBuffer> allocate_image_buffer();
+    std::shared_ptr<ImageBuffer> acquire_image_buffer(size_t image_buffer_length);
+    void begin_frame(AcquiredFrame &frame,size_t image_buffer_length,int32_t exposure_length,bool open_shutter,
+		     bool save_image,
+		     std::shared_ptr<const FitsHeaderSet> fits_header_set = nullptr);
+    void hand_off_frame(AcquiredFrame &frame);
+    double get_frame_temperature();
+    void hand_off_end_of_exposure();
+    void frame_processing_thread();
+    void process_frame(AcquiredFrame &frame);
+    int64_t publish_image(std::shared_ptr<ImageBuffer> image_buf,int ncols,int nrows,int xbin,int ybin,
+			  int x_start,int y_start,enum CCD_ORIENTATION orientation,int32_t exposure_length,
+			  struct timespec start_time,std::shared_ptr<ImageStatistics> statistics);
+    int queue_fits_image(char *filename,const AcquiredFrame &frame,int64_t frame_sequence);
+    void set_last_image_filename(const char *filename,int64_t frame_sequence);
+    void set_exposure_error(int64_t series_id,const std::string &error);
+    std::string get_exposure_error(int64_t series_id);
+    void notify_exposure_waiters();
+    void initialize_telemetry();
+    void stop_telemetry();
+    void telemetry_thread();
+    void request_telemetry_sample();
+    void sample_camera_state(bool read_temperature);
+    void add_fits_header_card(struct Fits_Header_Struct *fits_header,const std::string & keyword,
+			      const FitsCardType::type valtype,const std::string & value,const std::string & comment);
+    std::shared_ptr<FitsHeaderSet> get_writable_fits_header();
+    std::shared_ptr<const FitsHeaderSet> get_fits_header_snapshot(int64_t header_set_id);
+    void initialize_static_fits_headers();
+    void update_camera_fits_headers();
+    void add_camera_fits_headers(struct Fits_Header_Struct *fits_header,const AcquiredFrame &frame);
+    void add_timing_fits_header(struct Fits_Header_Struct *fits_header,const char *keyword,
+				const struct CCD_Exposure_Timeline_Struct &timeline,
+				enum CCD_EXPOSURE_TIMELINE_PHASE from_phase,enum CCD_EXPOSURE_TIMELINE_PHASE to_phase,
+				const char *comment);
+    void add_statistics_fits_headers(struct Fits_Header_Struct *fits_header,const ImageStatistics &statistics);
+    void add_statistics_fits_header(struct Fits_Header_Struct *fits_header,const std::string &keyword,int value,
+				    const std::string &comment,const char *units);
+    void add_statistics_fits_header(struct Fits_Header_Struct *fits_header,const std::string &keyword,
+				    double value,const std::string &comment,const char *units);
     CameraException create_ccd_library_exception();
     CameraException create_ngatastro_library_exception();
     /**
@@ -68,11 +287,334 @@ class Camera : virtual public CameraServiceIf
      */
     CameraConfig mCameraConfig;
     /**
-     * The variable used to hold FITS header data, used by the CCD library to write FITS headers into read out images.
-     * @see Fits_Header_Struct
-     * @see CCD_Fits_Header_Initialise
+     * The client's FITS headers (set by set_fits_headers / add_fits_header / clear_fits_headers), that are saved
+     * into each FITS image started with the default header set (header set id 0). Each frame takes a snapshot
+     * (a reference) of the current set when it starts, so the set is copied on write (get_writable_fits_header)
+     * if a frame still holds it. Clients can therefore stage the headers for the next frame whilst the current one
+     * is being taken and saved.
+     * @see Camera::FitsHeaderSet
+     * @see Camera::mFitsHeaderMutex
+     * @see Camera::get_writable_fits_header
+     * @see Camera::get_fits_header_snapshot
+     */
+    std::shared_ptr<FitsHeaderSet> mFitsHeader;
+    /**
+     * The header sets created by create_fits_header_set (and not yet deleted by delete_fits_header_set), indexed
+     * by header set id. These are immutable, so can be shared by any number of frames.
+     * @see Camera::FitsHeaderSet
+     * @see Camera::mFitsHeaderMutex
+     * @see #MAX_FITS_HEADER_SET_COUNT
+     */
+    std::map<int64_t,std::shared_ptr<const FitsHeaderSet>> mFitsHeaderSets;
+    /**
+     * The header set id to give the next header set created by create_fits_header_set. Header set ids start at 1,
+     * and are never reused (0 means the client's FITS headers in mFitsHeader).
+     * @see Camera::mFitsHeaderSets
+     */
+    int64_t mNextFitsHeaderSetId;
+    /**
+     * Mutex protecting mFitsHeader, mFitsHeaderSets and mNextFitsHeaderSetId, which are modified by clients whilst
+     * the exposure threads take snapshots of them. It is only held whilst a set is modified, or a reference to one
+     * is taken, and not whilst images are saved.
+     * This is recursive as set_fits_headers calls add_fits_header.
+     * @see Camera::mFitsHeader
+     * @see Camera::mFitsHeaderSets
+     */
+    std::recursive_mutex mFitsHeaderMutex;
+    /**
+     * The camera FITS headers that do not change once the camera has been initialised (HEAD / SERNO),
+     * created by initialize_static_fits_headers.
+     * @see Camera::initialize_static_fits_headers
+     * @see Camera::update_camera_fits_headers
+     */
+    std::shared_ptr<const FitsHeaderSet> mStaticFitsHeader;
+    /**
+     * The precomputed camera FITS headers saved in each image: the static headers (mStaticFitsHeader) plus the
+     * headers that depend on the detector setup (binning, window, orientation, readout speed and gain). This is
+     * replaced by update_camera_fits_headers whenever the setup is changed, and each saved frame takes a
+     * reference to it when it is started (begin_frame). Protected by mCameraFitsHeaderMutex.
+     * @see Camera::update_camera_fits_headers
+     * @see Camera::add_camera_fits_headers
+     */
+    std::shared_ptr<const FitsHeaderSet> mCameraFitsHeader;
+    /**
+     * Mutex protecting mCameraFitsHeader, which is replaced by the set_binning / set_window / clear_window /
+     * set_readout_speed / set_gain thrift threads whilst the exposure threads take references to it.
+     * @see Camera::mCameraFitsHeader
+     */
+    std::mutex mCameraFitsHeaderMutex;
+    /**
+     * The maximum age of the cached CCD temperature sample used for the CCDTEMP FITS header, in seconds.
+     * If the cached sample is older than this, a warning is logged and the telemetry thread is asked for a new one.
+     * Set from the optional "fits.temperature.max_age" config keyword.
+     * @see Camera::get_frame_temperature
+     */
+    double mTemperatureMaxAge;
+    /**
+     * The maximum length of time a wait_for_exposure call blocks, in milliseconds. Longer timeouts are shortened to
+     * this, so a few waiting clients cannot tie up all of the server's worker threads.
+     * Set from the optional "wait_for_exposure.max_timeout" config keyword.
+     * @see Camera::wait_for_exposure
+     */
+    int mWaitForExposureMaxTimeout;
+    /**
+     * Limits how many blocking calls (wait_for_exposure and the full frame image downloads) are in progress at once,
+     * so some of the server's worker threads are always free to serve abort_exposure and get_state.
+     * The limit is set from the optional "server.blocking_call_limit" config keyword.
+     * @see Camera::check_blocking_call_slot
+     */
+    BlockingCallLimiter mBlockingCalls;
+    /**
+     * If true, the durations of the phases of each frame's acquisition up to it's processing (TSETUP, TACQUIRE,
+     * TREADOUT, TPROCESS) are saved as FITS headers. Set from the optional "fits.timings.enable" config keyword.
+     * @see Camera::initialize_exposure_timings
+     * @see Camera::add_camera_fits_headers
+     */
+    bool mFitsTimingsEnabled;
+    /**
+     * If true, the statistics of each frame (and of each configured region of it) are saved as FITS headers.
+     * Set from the optional "fits.statistics.enable" config keyword.
+     * @see Camera::initialize_image_statistics
+     * @see Camera::add_statistics_fits_headers
+     */
+    bool mFitsStatisticsEnabled;
+    /**
+     * The FITS writer queue, whose writer threads save the images queued by the frame processing stage.
+     * @see Camera::initialize_fits_writer
+     * @see Camera::queue_fits_image
+     * @see FitsWriterQueue
+     */
+    FitsWriterQueue mFitsWriterQueue;
+    /**
+     * The lock-free single-producer / single-consumer queue the exposure threads (the acquisition stage) hand read
+     * out frames to the processing stage (frame_processing_thread) through. Only one exposure thread runs at
+     * a time, so there is only ever one producer. Created by initialize_frame_pipeline.
+     * @see Camera::AcquiredFrame
+     * @see Camera::hand_off_frame
+     * @see Camera::frame_processing_thread
+     * @see SpscQueue
+     */
+    std::unique_ptr<SpscQueue<AcquiredFrame>> mFramePipeline;
+    /**
+     * Semaphore counting the free slots in mFramePipeline. The acquisition stage waits on it before pushing a frame,
+     * so it blocks (rather than spinning) when the processing stage has fallen behind.
+     * @see Camera::mFramePipeline
+     */
+    sem_t mFramePipelineFree;
+    /**
+     * Semaphore counting the frames in mFramePipeline. The processing stage waits on it before popping a frame,
+     * so it sleeps whilst there is nothing to process. It is also posted by stop_frame_pipeline to wake the
+     * processing stage so it can exit.
+     * @see Camera::mFramePipeline
+     */
+    sem_t mFramePipelineFilled;
+    /**
+     * A boolean, set by stop_frame_pipeline to tell the processing stage to exit once mFramePipeline is empty.
+     * @see Camera::stop_frame_pipeline
+     */
+    std::atomic<bool> mFramePipelineStopping;
+    /**
+     * The processing stage thread, running frame_processing_thread. It is not joinable if the frame pipeline has
+     * not been started.
+     * @see Camera::initialize_frame_pipeline
+     * @see Camera::stop_frame_pipeline
+     */
+    std::thread mFrameProcessingThread;
+    /**
+     * The number of read out frames (and end of exposure markers) handed to the processing stage that have not been
+     * processed yet. The end of exposure marker is only processed once the exposure's FITS images are published. An exposure is still 
+     * reported as in progress by get_state and wait_for_exposure whilst this is non-zero, even though the detector
+     * is free to start the next exposure.
+     * @see Camera::hand_off_frame
+     * @see Camera::hand_off_end_of_exposure
+     * @see Camera::frame_processing_thread
+     */
+    std::atomic<int> mFramesPendingCount;
+    /**
+     * The measured duty cycle of the current/last multrun / multdark / multbias: the total measured exposure length
+     * of the frames read out so far divided by the wall clock time since the first frame was started, between 0 and 1.
+     * The exposure length of each frame is measured from it's timeline (start to acquired phases), and is zero for
+     * a bias.
+     * @see Camera::multrun_thread
+     */
+    std::atomic<double> mDutyCycle;
+    /**
+     * The mean measured exposure length of the frames read out so far in the current/last multrun / multdark /
+     * multbias, in milliseconds: the time from StartAcquisition returning to the camera reporting the acquisition
+     * was complete (zero for a bias).
+     * @see Camera::multrun_thread
+     */
+    std::atomic<double> mFrameExposureLength;
+    /**
+     * The mean measured readout length of the frames read out so far in the current/last multrun / multdark /
+     * multbias, in milliseconds: the time from the camera reporting the acquisition was complete to
+     * GetAcquiredData16 returning the image.
+     * @see Camera::multrun_thread
+     */
+    std::atomic<double> mFrameReadoutLength;
+    /**
+     * The id of the current/last exposure series (an expose / bias / dark / multbias / multdark / multrun).
+     * It is incremented by the start_* methods (whilst holding mExposureMutex) before the exposure thread is started,
+     * and recorded against each frame (AcquiredFrame::mSeriesId), so errors are recorded against the series 
+     * they occured in.
+     * @see Camera::AcquiredFrame
+     * @see Camera::set_exposure_error
+     * @see Camera::get_exposure_error
+     */
+    std::atomic<int64_t> mExposureSeriesId;
+    /**
+     * The id of the exposure series mExposureError describes, or zero if no series has failed.
+     * Protected by mExposureErrorMutex.
+     * @see Camera::mExposureError
+     * @see Camera::set_exposure_error
+     */
+    int64_t mExposureErrorSeriesId;
+    /**
+     * The first error that occured acquiring or processing the frames of exposure series mExposureErrorSeriesId.
+     * It is returned by get_state (exposure_error), and by wait_for_exposure (as a CameraException) once the
+     * series has finished. Protected by mExposureErrorMutex.
+     * @see Camera::mExposureErrorSeriesId
+     * @see Camera::set_exposure_error
+     * @see Camera::get_exposure_error
+     */
+    std::string mExposureError;
+    /**
+     * Mutex protecting mExposureErrorSeriesId and mExposureError. No other mutex is locked whilst it is held, so
+     * it can be locked whilst holding mExposureMutex, and get_state does not wait for a detector setup change.
+     * @see Camera::set_exposure_error
+     * @see Camera::get_exposure_error
+     */
+    std::mutex mExposureErrorMutex;
+    /**
+     * The last sample of the camera state, published by sample_camera_state and copied by get_state. It is only
+     * accessed using std::atomic_load / std::atomic_store, so get_state never blocks, and a sample is never
+     * modified once it has been published.
+     * @see Camera::CameraStateSample
+     * @see Camera::sample_camera_state
+     * @see Camera::get_state
+     */
+    std::shared_ptr<const CameraStateSample> mCameraState;
+    /**
+     * Mutex serialising the threads publishing mCameraState (the telemetry thread, and the thrift threads 
+     * changing the detector setup), so a sample is never replaced by an older one. get_state does not lock it.
+     * @see Camera::sample_camera_state
+     */
+    std::mutex mCameraStateMutex;
+    /**
+     * The telemetry thread, running telemetry_thread, that samples the camera state every mTelemetryPeriod 
+     * milliseconds. It is not joinable if telemetry has not been started.
+     * @see Camera::initialize_telemetry
+     * @see Camera::stop_telemetry
+     */
+    std::thread mTelemetryThread;
+    /**
+     * Mutex used with mTelemetryCondition, protecting mTelemetryStopping and mTelemetrySampleRequested.
+     * @see Camera::telemetry_thread
+     */
+    std::mutex mTelemetryMutex;
+    /**
+     * Condition variable the telemetry thread waits on between samples. It is signalled by stop_telemetry, and by
+     * request_telemetry_sample when the exposure state changes.
+     * @see Camera::telemetry_thread
+     * @see Camera::request_telemetry_sample
+     */
+    std::condition_variable mTelemetryCondition;
+    /**
+     * A boolean, set by stop_telemetry to tell the telemetry thread to exit.
+     * @see Camera::stop_telemetry
+     */
+    bool mTelemetryStopping;
+    /**
+     * A boolean, set by request_telemetry_sample to make the telemetry thread take a sample straight away.
+     * @see Camera::request_telemetry_sample
      */
-    struct Fits_Header_Struct mFitsHeader;
+    bool mTelemetrySampleRequested;
+    /**
+     * The period between telemetry samples, in milliseconds. 
+     * Set from the optional "telemetry.period" config keyword.
+     * @see Camera::initialize_telemetry
+     * @see #DEFAULT_TELEMETRY_PERIOD
+     */
+    int mTelemetryPeriod;
+    /**
+     * The history of CCD temperature samples, added to by sample_camera_state whenever the temperature has been
+     * read from the camera since the last sample (by the telemetry thread whilst the detector is idle or exposing),
+     * and returned by get_temperature_history.
+     * @see Camera::sample_camera_state
+     * @see Camera::get_frame_temperature
+     * @see Camera::get_temperature_history
+     * @see TemperatureHistoryRing
+     */
+    TemperatureHistoryRing mTemperatureHistory;
+    /**
+     * The time of the last sample added to mTemperatureHistory, in milliseconds since the epoch, so a cached
+     * temperature reading is only added once. Only used by sample_camera_state, whilst holding mCameraStateMutex.
+     * @see Camera::mTemperatureHistory
+     * @see Camera::sample_camera_state
+     */
+    int64_t mTemperatureHistoryLastTime;
+    /**
+     * The timelines of the last few frames acquired, added to by the processing stage and the FITS writer threads,
+     * and returned by get_exposure_timings. It's length is set from the optional "exposure_timings.length"
+     * config keyword.
+     * @see Camera::initialize_exposure_timings
+     * @see Camera::process_frame
+     * @see Camera::queue_fits_image
+     * @see Camera::get_exposure_timings
+     * @see ExposureTimingRing
+     */
+    ExposureTimingRing mExposureTimings;
+    /**
+     * How get_image_data_compressed compresses images (tile size, thread count and Zstandard compression level).
+     * Set from the optional "image_codec.tile_rows", "image_codec.thread_count" and "image_codec.zstd_level"
+     * config keywords.
+     * @see Camera::initialize_image_codecs
+     * @see Camera::get_image_data_compressed
+     * @see ImageCodecConfig
+     */
+    ImageCodecConfig mImageCodecConfig;
+    /**
+     * The number of threads get_preview uses to downsample and stretch an image. Set from the optional
+     * "preview.thread_count" config keyword.
+     * @see Camera::initialize_preview
+     * @see Camera::get_preview
+     * @see #IMAGE_PREVIEW_DEFAULT_THREAD_COUNT
+     */
+    int mPreviewThreadCount;
+    /**
+     * How the statistics of each frame are computed (thread count, saturation level and regions). Set from the
+     * optional "image_statistics.thread_count", "image_statistics.saturation_level" and 
+     * "image_statistics.region.<n>.*" config keywords.
+     * @see Camera::initialize_image_statistics
+     * @see Camera::process_frame
+     * @see FrameStatisticsConfig
+     */
+    FrameStatisticsConfig mFrameStatisticsConfig;
+    /**
+     * If true, each saved open shutter frame is reduced with the master calibration frames (mFrameCalibration) by
+     * the processing stage, and the reduced frame saved alongside the raw one. Set from the optional
+     * "reduction.enable" config keyword.
+     * @see Camera::initialize_reduction
+     * @see Camera::process_frame
+     */
+    bool mReductionEnabled;
+    /**
+     * The worker pool each frame's rows are split between when it is reduced, started in initialize_reduction
+     * with the number of threads in the optional "reduction.thread_count" config keyword.
+     * @see Camera::initialize_reduction
+     * @see Camera::process_frame
+     * @see FrameReductionPool
+     * @see #FRAME_REDUCTION_DEFAULT_THREAD_COUNT
+     */
+    FrameReductionPool mReductionPool;
+    /**
+     * The master bias, dark and flat frames each frame is reduced with, loaded from the "reduction.bias",
+     * "reduction.dark" and "reduction.flat" config keywords when reduction is enabled.
+     * @see Camera::initialize_reduction
+     * @see Camera::process_frame
+     * @see FrameCalibration
+     */
+    FrameCalibration mFrameCalibration;
     /**
      * A cached copy of the number of unbinned imaging columns on the detector. Used for setting the camera readout area
      * dimension configuration.
@@ -85,17 +627,21 @@ class Camera : virtual public CameraServiceIf
     int mCachedNRows;
     /**
      * A cached copy of the current horizontal binning of the detector. Used for setting the camera readout area
-     * dimension configuration.
+     * dimension configuration. Only changed whilst holding mExposureMutex.
+     * @see Camera::mExposureMutex
      */
     int mCachedHBin;
     /**
      * A cached copy of the current vertical binning of the detector. Used for setting the camera readout area
-     * dimension configuration.
+     * dimension configuration. Only changed whilst holding mExposureMutex.
+     * @see Camera::mExposureMutex
      */
     int mCachedVBin;
     /**
      * A cached copy of the window flags. This is really a boolean, if true we use the mCachedWindow to
      * configure the detector readout, otherwise we use mCachedNCols/mCachedNRows (i.e. full frame).
+     * Only changed whilst holding mExposureMutex.
+     * @see Camera::mExposureMutex
      * @see Camera::mCachedWindow
      * @see Camera::mCachedNCols
      * @see Camera::mCachedNRows
@@ -103,18 +649,23 @@ class Camera : virtual public CameraServiceIf
     int mCachedWindowFlags;
     /**
      * A cached copy of the sub-window on the detector to read out. This is only used if mCachedWindowFlags
-     * is true.
+     * is true. Only changed whilst holding mExposureMutex.
+     * @see Camera::mExposureMutex
      * @see CCD_Setup_Window_Struct
      * @see Camera::mCachedWindowFlags
      */
     struct CCD_Setup_Window_Struct mCachedWindow;
     /**
      * A cached copy of the readout speed last used to configure the camera. Used for status retrieval.
+     * Only accessed whilst holding mExposureMutex.
+     * @see Camera::mExposureMutex
      * @see ReadoutSpeed
      */
     ReadoutSpeed::type mCachedReadoutSpeed;
     /**
      * A cached copy of the gain last used to configure the camera. Used for status retrieval.
+     * Only accessed whilst holding mExposureMutex.
+     * @see Camera::mExposureMutex
      * @see Gain
      */
     Gain::type mCachedGain;
@@ -126,13 +677,74 @@ class Camera : virtual public CameraServiceIf
     /**
      * A boolean, if TRUE an exposure/multrun is in progress. This is distinct from the camera ExposureState,
      * which reflects whether the andor camera is exposing, and is true whenever a dark/bias/expose/multrun thread
-     * is running.
+     * is running. It is reset as soon as the last frame has been handed to the processing stage, so the next
+     * exposure can be started whilst the last frame is still being processed (see mFramesPendingCount).
+     * This is atomic as it is read by status calls and set by the exposure threads without a lock,
+     * start_* methods test and set it whilst holding mExposureMutex.
+     * @see Camera::mExposureMutex
+     */
+    std::atomic<int> mExposureInProgress;
+    /**
+     * The time (CLOCK_MONOTONIC) the last expose / bias / dark / multrun request was accepted, set by the start_*
+     * methods whilst holding mExposureMutex. begin_frame uses it as the request phase of the first frame's timeline.
+     * @see Camera::begin_frame
+     */
+    struct timespec mRequestTime;
+    /**
+     * A boolean, set to TRUE by abort_exposure, and reset to FALSE by the start_* methods (in begin_exposure_series)
+     * whilst holding mExposureMutex, before the exposure thread is started (the exposure threads never reset it).
+     * This is checked before a single exposure is started, and between frames of a multbias/multdark/multrun,
+     * as the CCD library abort flag is reset at the start of each frame.
+     * @see Camera::abort_exposure
+     * @see Camera::begin_exposure_series
+     * @see Camera::multrun_thread
+     * @see Camera::mExposureMutex
+     */
+    std::atomic<int> mAbort;
+    /**
+     * The number of frames completed (read out) so far in the current/last multbias/multdark/multrun.
+     * @see Camera::multrun_thread
+     */
+    std::atomic<int> mExposureIndex;
+    /**
+     * The total number of frames to take in the current/last multbias/multdark/multrun.
+     * @see Camera::multrun_thread
+     */
+    std::atomic<int> mExposureCount;
+    /**
+     * Mutex used with mExposureCondition, to let wait_for_exposure block until an exposure thread
+     * reads out a frame or finishes. The start_* methods hold it whilst testing and setting mExposureInProgress,
+     * and the setup methods (set_binning / set_window / clear_window / set_readout_speed / set_gain) hold it 
+     * whilst changing the cached detector setup (mCachedHBin etc) and recomputing the camera FITS headers.
+     * @see Camera::mExposureCondition
+     * @see Camera::wait_for_exposure
+     * @see Camera::notify_exposure_waiters
+     */
+    std::mutex mExposureMutex;
+    /**
+     * Condition variable signalled (by notify_exposure_waiters) each time an exposure thread
+     * reads out a frame or finishes, used to wake any clients blocked in wait_for_exposure.
+     * @see Camera::mExposureMutex
+     * @see Camera::wait_for_exposure
+     * @see Camera::notify_exposure_waiters
+     */
+    std::condition_variable mExposureCondition;
+    /**
+     * Mutex protecting mImageBuf and the associated image metadata (mImageBufNCols / mImageBufNRows / 
+     * mImageBufXBin / mImageBufYBin / mImageBufXStart / mImageBufYStart / mImageBufOrientation /
+     * mImageFrameSequence / mImageStatistics), so they are always updated and read together.
+     * It is only held to swap or copy the buffer reference, never whilst copying pixel data.
+     * @see Camera::publish_image
      */
-    int mExposureInProgress;
+    std::mutex mImageBufMutex;
     /**
-     * The image buffer, used to hold read-out images.
+     * The image buffer holding the last read-out image. The exposure threads read out into a new buffer and then
+     * replace this reference (using publish_image), so clients downloading the previous image can keep 
+     * using it without holding any lock. This is NULL until the first image has been read out.
+     * @see Camera::mImageBufMutex
+     * @see Camera::publish_image
      */
-    std::vector<int16_t> mImageBuf;
+    std::shared_ptr<ImageBuffer> mImageBuf;
     /**
      * A cached copy of the number of binned columns (x dimension) of data in the image buffer.
      */
@@ -141,9 +753,138 @@ class Camera : virtual public CameraServiceIf
      * A cached copy of the number of binned rows (y dimension) of data in the image buffer.
      */
     int mImageBufNRows;
+    /**
+     * A cached copy of the horizontal binning used to read out the data in the image buffer.
+     */
+    int mImageBufXBin;
+    /**
+     * A cached copy of the vertical binning used to read out the data in the image buffer.
+     */
+    int mImageBufYBin;
+    /**
+     * A cached copy of the first detector column (unbinned, starting from 1) of the readout window the data in
+     * the image buffer was read out with.
+     * @see Camera::get_image_region
+     */
+    int mImageBufXStart;
+    /**
+     * A cached copy of the first detector row (unbinned, starting from 1) of the readout window the data in
+     * the image buffer was read out with.
+     * @see Camera::get_image_region
+     */
+    int mImageBufYStart;
+    /**
+     * A cached copy of how the data in the image buffer was re-oriented after it was read out.
+     * @see Camera::get_image_region
+     */
+    enum CCD_ORIENTATION mImageBufOrientation;
+    /**
+     * A sequence number, incremented each time a new image is read out into the image buffer.
+     * This is zero if no image has been read out yet.
+     */
+    std::atomic<int64_t> mImageFrameSequence;
+    /**
+     * The statistics of the image in the image buffer, returned by get_image_statistics. This is replaced
+     * (by publish_image) with the image buffer, and is NULL until the first image has been read out.
+     * Protected by mImageBufMutex.
+     * @see Camera::mImageBufMutex
+     * @see Camera::publish_image
+     * @see Camera::get_image_statistics
+     */
+    std::shared_ptr<const ImageStatistics> mImageStatistics;
+    /**
+     * The frame history ring, holding the last few read out frames (and their metadata), so clients can
+     * retrieve a frame they missed using get_image_data_by_id. The ring's buffers are preallocated by
+     * initialize_frame_history, and re-used by acquire_image_buffer once a frame has dropped out of the history
+     * and no client is downloading it. Protected by mImageBufMutex.
+     * @see Camera::FrameHistoryEntry
+     * @see Camera::mImageBufMutex
+     * @see Camera::initialize_frame_history
+     * @see Camera::acquire_image_buffer
+     * @see Camera::publish_image
+     */
+    std::vector<FrameHistoryEntry> mFrameHistory;
+    /**
+     * The index in mFrameHistory of the slot the next frame will be published into (the oldest frame).
+     * Protected by mImageBufMutex.
+     * @see Camera::mFrameHistory
+     */
+    size_t mFrameHistoryIndex;
     /**
      * A string holding the last FITS image filename generated by a multrun/bias/dark.
+     * @see Camera::mLastImageFilenameMutex
+     * @see Camera::mLastImageFrameSequence
      */
     std::string mLastImageFilename;
+    /**
+     * The frame sequence number of the image saved to mLastImageFilename (zero if no image has been saved).
+     * The writer threads can finish saving images out of order, so mLastImageFilename is only replaced by
+     * the filename of a later frame. Protected by mLastImageFilenameMutex.
+     * @see Camera::mLastImageFilename
+     * @see Camera::set_last_image_filename
+     */
+    int64_t mLastImageFrameSequence;
+    /**
+     * Mutex protecting mLastImageFilename and mLastImageFrameSequence.
+     * @see Camera::set_last_image_filename
+     * @see Camera::get_last_image_filename
+     */
+    std::mutex mLastImageFilenameMutex;
+    /**
+     * A boolean, true if read out frames are also published into the POSIX shared memory frame ring mFrameRing,
+     * for co-located consumers. Set from the "frame_ring.enable" config keyword.
+     * @see Camera::initialize_frame_ring
+     */
+    bool mFrameRingEnabled;
+    /**
+     * The handle of the shared memory frame ring read out frames are published into, if mFrameRingEnabled is true.
+     * Frames are published by the frame processing thread, and their filenames are set by the FITS writer threads.
+     * Both update the ring slot sequence locks, which only support one writer, so both are done whilst holding
+     * mFrameRingMutex.
+     * @see Camera::initialize_frame_ring
+     * @see Camera::publish_image
+     * @see Camera::set_last_image_filename
+     * @see Camera::mFrameRingMutex
+     */
+    struct CCD_Frame_Ring_Struct mFrameRing;
+    /**
+     * Mutex held whilst writing to mFrameRing (CCD_Frame_Ring_Publish and CCD_Frame_Ring_Filename_Set), so
+     * only one thread at a time updates a ring slot.
+     * @see Camera::mFrameRing
+     * @see Camera::publish_image
+     * @see Camera::set_last_image_filename
+     */
+    std::mutex mFrameRingMutex;
+    /**
+     * The CCD library pool of preallocated, aligned (and optionally locked / huge page backed) full frame
+     * image buffers the exposure threads read out into, so a series of exposures never allocates image memory
+     * or page faults on it. The frame history buffers come from this pool.
+     * @see Camera::initialize_buffer_pool
+     * @see Camera::allocate_image_buffer
+     * @see ImageBuffer
+     */
+    struct CCD_Setup_Buffer_Pool_Struct mBufferPool;
+    /**
+     * The number of image buffers allocated outside mBufferPool, because all the pool's buffers were in use 
+     * (e.g. by clients downloading frames). This stays at zero if the pool is large enough.
+     * @see Camera::allocate_image_buffer
+     */
+    std::atomic<int64_t> mImageBufferAllocationCount;
+    /**
+     * The CCD library pool of preallocated full frame buffers the processing stage reduces frames into, when
+     * in-server reduction is enabled. Each buffer is held by the FITS writer queue until the reduced frame has been
+     * saved, so the number of buffers is set from the optional "reduction.buffer_count" config keyword
+     * like "buffer_pool.spare_count".
+     * @see Camera::initialize_reduction
+     * @see Camera::allocate_reduced_image
+     * @see frame_reduction_buffer_get
+     */
+    struct CCD_Setup_Buffer_Pool_Struct mReducedBufferPool;
+    /**
+     * The number of reduced image buffers allocated outside mReducedBufferPool, because all the pool's buffers were
+     * in use (the FITS writer queue has fallen behind). This stays at zero if the pool is large enough.
+     * @see Camera::allocate_reduced_image
+     */
+    std::atomic<int64_t> mReducedImageAllocationCount;
 };    
 #endif
@@ -10,6 +10,8 @@
 #include "EmulatedCamera.h"
 
 #include <sys/prctl.h>
+#include <thrift/concurrency/ThreadManager.h>
+#include <thrift/concurrency/ThreadFactory.h>
 #include <thrift/protocol/TBinaryProtocol.h>
 #include <thrift/protocol/TCompactProtocol.h>
 #include <thrift/server/TSimpleServer.h>
@@ -31,6 +33,7 @@
 
 
 using namespace ::apache::thrift;
+using namespace ::apache::thrift::concurrency;
 using namespace ::apache::thrift::protocol;
 using namespace ::apache::thrift::transport;
 using namespace ::apache::thrift::server;
@@ -57,6 +60,21 @@ const std::string DEFAULT_CONFIG_FILE = "/mookodi/conf/mkd.cfg";
  * Default logging configuration file.
  */
 const std::string DEFAULT_LOGGING_CONFIG_FILE = "log4cxx.properties";
+/**
+ * The configuration file section to retrieve the server configuration from ("Camera").
+ */
+#define CONFIG_CAMERA_SECTION ("Camera")
+/**
+ * The default number of worker threads used to process thrift requests, used if the "server.thread_count"
+ * keyword is not present in the config file.
+ */
+const int DEFAULT_THREAD_COUNT = 4;
+/**
+ * The number of worker threads always left free for quick requests (such as abort_exposure and get_state)
+ * when "server.blocking_call_limit" blocking calls are in progress. server.thread_count is raised to at least
+ * the blocking call limit plus this.
+ */
+const int MIN_FREE_THREAD_COUNT = 2;
 /**
  * Logger instance for the main program (CameraServer.cpp).
  */
@@ -112,13 +130,29 @@ int process_options(int argc, char **argv, po::variables_map &vm)
  * @param argv An array of strings, each one containing a command line option.
  * @return The return error code from the program, usually 0 if the program is finishing successfully, and 
  *         non-zero if a fatal error occurs.
+ * The thrift requests are processed by a pool of worker threads, rather than by the server's I/O thread,
+ * so a slow request (e.g. an image download, or cool_down) does not stop other clients getting status or aborting.
+ * The number of worker threads is retrieved from the "server.thread_count" keyword in the "Camera" section 
+ * of the config file, or DEFAULT_THREAD_COUNT is used if it is not present.
+ * Blocking calls (wait_for_exposure and the full frame image downloads) each hold a worker thread until they return.
+ * The camera fails any blocking call made whilst "server.blocking_call_limit" (default DEFAULT_BLOCKING_CALL_LIMIT)
+ * of them are already in progress. server.thread_count must therefore be at least the blocking call limit plus
+ * MIN_FREE_THREAD_COUNT, so abort_exposure and get_state never queue behind blocking calls. Smaller thread counts
+ * are raised to this, with a warning.
+ * @see #CONFIG_CAMERA_SECTION
+ * @see #DEFAULT_THREAD_COUNT
+ * @see #MIN_FREE_THREAD_COUNT
+ * @see #DEFAULT_BLOCKING_CALL_LIMIT
  * @see CameraServiceIf
  * @see EmulatedCamera
  * @see Camera
+ * @see CameraConfig::get_config_int
  */
 int main(int argc, char **argv) 
 {
 	CameraConfig config;
+	int thread_count = DEFAULT_THREAD_COUNT;
+	int blocking_call_limit = DEFAULT_BLOCKING_CALL_LIMIT;
 	
 	try
 	{
@@ -152,6 +186,42 @@ int main(int argc, char **argv)
 		std::cout << "Loading configuration..." << std::endl;
 		LOG4CXX_INFO(logger,"Loading configuration ...");
 		config.load_config();
+		try
+		{
+			config.get_config_int(CONFIG_CAMERA_SECTION,"server.thread_count",&thread_count);
+		}
+		catch(CameraException &e)
+		{
+			std::cout << "server.thread_count not configured, using default." << std::endl;
+			LOG4CXX_INFO(logger,"server.thread_count not configured, using default.");
+			thread_count = DEFAULT_THREAD_COUNT;
+		}
+		if(thread_count < 1)
+		{
+			std::cerr << "Illegal server.thread_count " << thread_count << ", using default." << std::endl;
+			LOG4CXX_ERROR(logger,"Illegal server.thread_count " << thread_count << ", using default.");
+			thread_count = DEFAULT_THREAD_COUNT;
+		}
+		try
+		{
+			config.get_config_int(CONFIG_CAMERA_SECTION,"server.blocking_call_limit",&blocking_call_limit);
+		}
+		catch(CameraException &e)
+		{
+			blocking_call_limit = DEFAULT_BLOCKING_CALL_LIMIT;
+		}
+		if(blocking_call_limit < 1)
+			blocking_call_limit = DEFAULT_BLOCKING_CALL_LIMIT;
+		if(thread_count < blocking_call_limit+MIN_FREE_THREAD_COUNT)
+		{
+			std::cerr << "server.thread_count " << thread_count << " is too small for " <<
+				"server.blocking_call_limit " << blocking_call_limit << ", using " <<
+				blocking_call_limit+MIN_FREE_THREAD_COUNT << "." << std::endl;
+			LOG4CXX_WARN(logger,"server.thread_count " << thread_count << " is too small for " <<
+				     "server.blocking_call_limit " << blocking_call_limit << ", using " <<
+				     blocking_call_limit+MIN_FREE_THREAD_COUNT << ".");
+			thread_count = blocking_call_limit+MIN_FREE_THREAD_COUNT;
+		}
 		
 		// Set up the server
 		if (vm.count("emulate_camera"))
@@ -176,7 +246,13 @@ int main(int argc, char **argv)
 		}
 		shared_ptr<TProcessor> processor(new CameraServiceProcessor(handler));
 		shared_ptr<TNonblockingServerTransport> serverTransport(new TNonblockingServerSocket(port));
-		TNonblockingServer server(processor, serverTransport);
+		// Worker thread pool to process requests
+		std::cout << "Starting " << thread_count << " worker threads." << std::endl;
+		LOG4CXX_INFO(logger,"Starting " << thread_count << " worker threads.");
+		shared_ptr<ThreadManager> threadManager = ThreadManager::newSimpleThreadManager(thread_count);
+		threadManager->threadFactory(shared_ptr<ThreadFactory>(new ThreadFactory()));
+		threadManager->start();
+		TNonblockingServer server(processor, serverTransport, threadManager);
 
 		//Serve
 		server.serve();
@@ -2,19 +2,29 @@
  * @file
  * @brief EmulatedCamera.cpp provides an implementation of the camera detector thrift interface. This implementation
  *        just prints out details of the thrift API call to stdout. There is some basic exposure emulation
- *        so get_status states change in a potentially sensible manner.
+ *        so get_status states change in a potentially sensible manner, and emulated multruns can be saved
+ *        (and reduced) as the camera server does, so the frame pipeline can be tested without a camera.
  * @author Chris Mottram
  * @version $Id$
  */
 #include "CameraConfig.h"
 #include "EmulatedCamera.h"
+#include <algorithm>
 #include <thread>
 #include <vector>
 #include <chrono>
 #include <fstream>
 #include <iostream>
 #include <boost/program_options.hpp>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
 #include "log4cxx/logger.h"
+#include "ccd_fits_header.h"
+#include "ccd_fits_writer.h"
+#include "ccd_frame_ring.h"
+#include "ccd_general.h"
+#include "ccd_setup.h"
 
 using std::cout, std::cerr, std::endl;
 using namespace log4cxx;
@@ -31,6 +41,44 @@ using namespace log4cxx;
  * Maximum pixel binning in Y.
  */
 #define MAX_Y_BINNING            (16)
+/**
+ * The default number of frames kept in the frame history, used if "frame_history.length" is not configured.
+ */
+#define DEFAULT_FRAME_HISTORY_LENGTH (8)
+/**
+ * The default maximum length of time (in milliseconds) a wait_for_exposure call can block, 
+ * used if "wait_for_exposure.max_timeout" is not configured.
+ */
+#define DEFAULT_WAIT_FOR_EXPOSURE_MAX_TIMEOUT (5000)
+/**
+ * The default number of emulated frames that can be waiting to be processed whilst the next frame is emulated,
+ * used if "frame_pipeline.length" is not configured.
+ */
+#define DEFAULT_FRAME_PIPELINE_LENGTH         (2)
+/**
+ * The default length of time (in milliseconds) the emulated readout of a multbias/multdark/multrun frame takes,
+ * used if "emulation.readout_length" is not configured.
+ */
+#define DEFAULT_EMULATION_READOUT_LENGTH      (1000)
+/**
+ * The default length of time (in milliseconds) the processing stage takes to process each emulated frame,
+ * used if "emulation.processing_length" is not configured.
+ */
+#define DEFAULT_EMULATION_PROCESSING_LENGTH   (0)
+/**
+ * The default number of buffers in the reduced image buffer pool, used if "reduction.buffer_count" is not configured.
+ * The emulated processing stage saves each reduced frame before processing the next, so it only needs one.
+ */
+#define DEFAULT_REDUCTION_BUFFER_COUNT        (1)
+/**
+ * The prefix of the filenames emulated frames are saved to, in the "emulation.data_dir" directory.
+ */
+#define EMULATION_FILENAME_PREFIX             ("EMU_")
+/**
+ * The filename the camera emulator returned from get_last_image_filename before it saved frames, still returned
+ * if no emulated frame has been saved.
+ */
+#define EMULATION_DEFAULT_LAST_IMAGE_FILENAME ("/data/lesedi/mkd/2021/0413/MKD_20210413.0001.fits")
 
 /**
  * Logger instance for the emulated camera (EmulatedCamera.cpp).
@@ -38,17 +86,74 @@ using namespace log4cxx;
 static LoggerPtr logger(Logger::getLogger("mookodi.camera.server.EmulatedCamera"));
 
 /**
- * Constructor for the EmulatedCamera object. 
+ * Constructor for the EmulatedCamera object. We initialise the shared memory frame ring handle, which is not
+ * created until initialize is called (and then only if it is enabled in the config file). We start the emulated
+ * FITS header set ids at one. We initialise the frame pipeline state (the processing stage is started by initialize),
+ * and no exposure is in progress. Emulated frames are not saved or reduced, and the reduced image buffer pool is
+ * not created, until initialize is called.
+ * @see EmulatedCamera::mFrameRingEnabled
+ * @see EmulatedCamera::mFrameRing
+ * @see EmulatedCamera::mNextFitsHeaderSetId
+ * @see EmulatedCamera::mFramePipelineStopping
+ * @see EmulatedCamera::mFramesPendingCount
+ * @see EmulatedCamera::mReductionEnabled
+ * @see EmulatedCamera::mReducedBufferPool
+ * @see EmulatedCamera::mReducedImageAllocationCount
+ * @see CCD_Frame_Ring_Initialise
+ * @see CCD_Setup_Buffer_Pool_Initialise
  */
 EmulatedCamera::EmulatedCamera()
 {
+	mFrameRingEnabled = false;
+	CCD_Frame_Ring_Initialise(&mFrameRing);
+	mNextFitsHeaderSetId = 1;
+	mWaitForExposureMaxTimeout = DEFAULT_WAIT_FOR_EXPOSURE_MAX_TIMEOUT;
+	mReadoutLength = DEFAULT_EMULATION_READOUT_LENGTH;
+	mProcessingLength = DEFAULT_EMULATION_PROCESSING_LENGTH;
+	mFramePipelineStopping = false;
+	mFramesPendingCount = 0;
+	mAbort = false;
+	mState.exposure_in_progress = FALSE;
+	mReductionEnabled = false;
+	CCD_Setup_Buffer_Pool_Initialise(&mReducedBufferPool);
+	mReducedImageAllocationCount = 0;
 }
 
 /**
- * Destructor for the Camera object. Does nothing.
+ * Destructor for the Camera object.
+ * <ul>
+ * <li>We set mAbort to stop any emulated exposure in progress, and wait on mExposureCondition until it has finished
+ *     (mState's exposure_in_progress is FALSE) and the processing stage has processed all it's frames
+ *     (mFramesPendingCount is zero).
+ * <li>We call stop_frame_pipeline to stop the processing stage.
+ * <li>If the shared memory frame ring was created, we close (and unlink) it.
+ * <li>We destroy the reduced image buffer pool. The processing stage has stopped, so none of it's buffers are in use.
+ * </ul>
+ * @see EmulatedCamera::mAbort
+ * @see EmulatedCamera::mState
+ * @see EmulatedCamera::mExposureMutex
+ * @see EmulatedCamera::mExposureCondition
+ * @see EmulatedCamera::mFramesPendingCount
+ * @see EmulatedCamera::stop_frame_pipeline
+ * @see EmulatedCamera::mFrameRingEnabled
+ * @see EmulatedCamera::mFrameRing
+ * @see EmulatedCamera::mReducedBufferPool
+ * @see CCD_Frame_Ring_Close
+ * @see CCD_Setup_Buffer_Pool_Destroy
  */
 EmulatedCamera::~EmulatedCamera()
 {
+	mAbort = true;
+	{
+		std::unique_lock<std::mutex> lock(mExposureMutex);
+
+		mExposureCondition.wait(lock,[this]{return (mState.exposure_in_progress == FALSE)&&
+					(mFramesPendingCount == 0);});
+	}
+	stop_frame_pipeline();
+	if(mFrameRingEnabled)
+		CCD_Frame_Ring_Close(&mFrameRing);
+	CCD_Setup_Buffer_Pool_Destroy(&mReducedBufferPool);
 }
 
 /**
@@ -64,14 +169,70 @@ void EmulatedCamera::set_config(CameraConfig & config)
 /**
  * Initialisation method for the emulated camera object. This does the following:
  * <ul>
- * <li>We setup the cached state.
+ * <li>We setup the cached state, including exposure_index and exposure_count.
  * <li>We set mAbort to false.
  * <li>We initialise mImageBufNCols/mImageBufNRows to 0.
+ * <li>We initialise mImageBufXBin/mImageBufYBin to 1, and mImageFrameSequence to 0.
+ * <li>We initialise mImageBufXStart/mImageBufYStart to 1.
+ * <li>We call initialize_frame_ring to create the shared memory frame ring, if it is enabled.
+ * <li>We retrieve the number of frames to keep in the frame history from the optional "frame_history.length" 
+ *     config keyword (defaulting to DEFAULT_FRAME_HISTORY_LENGTH), and clear the frame history.
+ * <li>We retrieve the maximum length of time wait_for_exposure blocks from the optional 
+ *     "wait_for_exposure.max_timeout" config keyword (defaulting to DEFAULT_WAIT_FOR_EXPOSURE_MAX_TIMEOUT).
+ * <li>We retrieve the maximum number of blocking calls in progress at once from the optional 
+ *     "server.blocking_call_limit" config keyword (defaulting to DEFAULT_BLOCKING_CALL_LIMIT), and set 
+ *     mBlockingCalls' limit.
+ * <li>We retrieve how long the emulated readout of a multbias/multdark/multrun frame takes, and how long the
+ *     processing stage takes to process it, from the optional "emulation.readout_length" and
+ *     "emulation.processing_length" config keywords (defaulting to DEFAULT_EMULATION_READOUT_LENGTH and
+ *     DEFAULT_EMULATION_PROCESSING_LENGTH).
+ * <li>We retrieve the directory emulated multbias/multdark/multrun frames are saved into from the optional
+ *     "emulation.data_dir" config keyword (if it is not present, frames are not saved), and clear the last saved
+ *     image filename.
+ * <li>We call initialize_reduction to load the master calibration frames saved multrun frames are reduced with,
+ *     if reduction is enabled.
+ * <li>We call initialize_frame_pipeline to start the processing stage.
+ * <li>We retrieve how images are compressed by get_image_data_compressed from the optional "image_codec.tile_rows",
+ *     "image_codec.thread_count" and "image_codec.zstd_level" config keywords (each defaulting to the
+ *     ImageCodecConfig default).
+ * <li>We retrieve the number of threads get_preview uses from the optional "preview.thread_count" config keyword
+ *     (defaulting to IMAGE_PREVIEW_DEFAULT_THREAD_COUNT).
+ * <li>We retrieve how get_image_statistics computes image statistics from the optional 
+ *     "image_statistics.thread_count" and "image_statistics.saturation_level" config keywords (each defaulting to
+ *     the FrameStatisticsConfig default), and up to FRAME_STATISTICS_MAX_REGION_COUNT regions from the
+ *     "image_statistics.region.<n>.name", ".x0", ".y0", ".width" and ".height" config keywords, stopping at the
+ *     first region without a name.
  * </ul>
+ * @see #DEFAULT_FRAME_HISTORY_LENGTH
+ * @see #DEFAULT_WAIT_FOR_EXPOSURE_MAX_TIMEOUT
+ * @see #DEFAULT_EMULATION_READOUT_LENGTH
+ * @see #DEFAULT_EMULATION_PROCESSING_LENGTH
+ * @see #IMAGE_PREVIEW_DEFAULT_THREAD_COUNT
+ * @see #FRAME_STATISTICS_MAX_REGION_COUNT
+ * @see EmulatedCamera::mImageCodecConfig
+ * @see EmulatedCamera::mPreviewThreadCount
+ * @see EmulatedCamera::mFrameStatisticsConfig
  * @see EmulatedCamera::mState
+ * @see EmulatedCamera::initialize_frame_ring
+ * @see EmulatedCamera::mFrameHistory
+ * @see EmulatedCamera::mFrameHistoryLength
+ * @see EmulatedCamera::mWaitForExposureMaxTimeout
+ * @see EmulatedCamera::mBlockingCalls
+ * @see EmulatedCamera::mReadoutLength
+ * @see EmulatedCamera::mProcessingLength
+ * @see EmulatedCamera::mDataDirectory
+ * @see EmulatedCamera::mLastImageFilename
+ * @see EmulatedCamera::initialize_reduction
+ * @see EmulatedCamera::initialize_frame_pipeline
  */
 void EmulatedCamera::initialize()
 {
+	FrameStatisticsRegion region;
+	std::string keyword_root;
+	char region_name[32];
+	char data_directory[256];
+	int blocking_call_limit;
+
 	mState.xbin = 1;
 	mState.ybin = 1;
 	mState.use_window = false;
@@ -87,9 +248,163 @@ void EmulatedCamera::initialize()
 	mState.ccd_temperature = 0.0;
 	mState.readout_speed = ReadoutSpeed::SLOW;
 	mState.gain = Gain::ONE;
+	mState.exposure_index = 0;
+	mState.exposure_count = 0;
+	mState.duty_cycle = 0.0;
+	mState.frame_exposure_length = 0.0;
+	mState.frame_readout_length = 0.0;
+	mState.cooler_status = CoolerStatus::OFF;
 	mAbort = false;
 	mImageBufNCols = 0;
 	mImageBufNRows = 0;
+	mImageBufXBin = 1;
+	mImageBufYBin = 1;
+	mImageBufXStart = 1;
+	mImageBufYStart = 1;
+	mImageFrameSequence = 0;
+	initialize_frame_ring();
+	try
+	{
+		mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,"frame_history.length",&mFrameHistoryLength);
+	}
+	catch(CameraException &e)
+	{
+		mFrameHistoryLength = DEFAULT_FRAME_HISTORY_LENGTH;
+	}
+	if(mFrameHistoryLength < 1)
+		mFrameHistoryLength = 1;
+	try
+	{
+		mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,"wait_for_exposure.max_timeout",
+					     &mWaitForExposureMaxTimeout);
+	}
+	catch(CameraException &e)
+	{
+		mWaitForExposureMaxTimeout = DEFAULT_WAIT_FOR_EXPOSURE_MAX_TIMEOUT;
+	}
+	if(mWaitForExposureMaxTimeout < 1)
+		mWaitForExposureMaxTimeout = DEFAULT_WAIT_FOR_EXPOSURE_MAX_TIMEOUT;
+	try
+	{
+		mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,"server.blocking_call_limit",&blocking_call_limit);
+	}
+	catch(CameraException &e)
+	{
+		blocking_call_limit = DEFAULT_BLOCKING_CALL_LIMIT;
+	}
+	if(blocking_call_limit < 1)
+		blocking_call_limit = DEFAULT_BLOCKING_CALL_LIMIT;
+	mBlockingCalls.set_limit(blocking_call_limit);
+	try
+	{
+		mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,"emulation.readout_length",&mReadoutLength);
+	}
+	catch(CameraException &e)
+	{
+		mReadoutLength = DEFAULT_EMULATION_READOUT_LENGTH;
+	}
+	try
+	{
+		mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,"emulation.processing_length",&mProcessingLength);
+	}
+	catch(CameraException &e)
+	{
+		mProcessingLength = DEFAULT_EMULATION_PROCESSING_LENGTH;
+	}
+	try
+	{
+		mCameraConfig.get_config_string(CONFIG_CAMERA_SECTION,"emulation.data_dir",data_directory,256);
+		mDataDirectory = data_directory;
+	}
+	catch(CameraException &e)
+	{
+		mDataDirectory = "";
+	}
+	{
+		std::lock_guard<std::mutex> lock(mLastImageFilenameMutex);
+
+		mLastImageFilename = "";
+	}
+	initialize_reduction();
+	initialize_frame_pipeline();
+	{
+		std::lock_guard<std::mutex> lock(mImageBufMutex);
+
+		mFrameHistory.clear();
+	}
+	mImageCodecConfig = ImageCodecConfig();
+	try
+	{
+		mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,"image_codec.tile_rows",
+					     &(mImageCodecConfig.mTileRows));
+	}
+	catch(CameraException &e)
+	{
+		/* keep the default */
+	}
+	try
+	{
+		mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,"image_codec.thread_count",
+					     &(mImageCodecConfig.mThreadCount));
+	}
+	catch(CameraException &e)
+	{
+		/* keep the default */
+	}
+	try
+	{
+		mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,"image_codec.zstd_level",
+					     &(mImageCodecConfig.mZstdLevel));
+	}
+	catch(CameraException &e)
+	{
+		/* keep the default */
+	}
+	try
+	{
+		mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,"preview.thread_count",&mPreviewThreadCount);
+	}
+	catch(CameraException &e)
+	{
+		mPreviewThreadCount = IMAGE_PREVIEW_DEFAULT_THREAD_COUNT;
+	}
+	mFrameStatisticsConfig = FrameStatisticsConfig();
+	try
+	{
+		mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,"image_statistics.thread_count",
+					     &(mFrameStatisticsConfig.mThreadCount));
+	}
+	catch(CameraException &e)
+	{
+		/* keep the default */
+	}
+	try
+	{
+		mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,"image_statistics.saturation_level",
+					     &(mFrameStatisticsConfig.mSaturationLevel));
+	}
+	catch(CameraException &e)
+	{
+		/* keep the default */
+	}
+	for(int region_number = 1; region_number <= FRAME_STATISTICS_MAX_REGION_COUNT; region_number++)
+	{
+		keyword_root = "image_statistics.region."+std::to_string(region_number)+".";
+		try
+		{
+			mCameraConfig.get_config_string(CONFIG_CAMERA_SECTION,(keyword_root+"name").c_str(),region_name,32);
+		}
+		catch(CameraException &e)
+		{
+			break;
+		}
+		region.mName = region_name;
+		mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,(keyword_root+"x0").c_str(),&(region.mX0));
+		mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,(keyword_root+"y0").c_str(),&(region.mY0));
+		mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,(keyword_root+"width").c_str(),&(region.mWidth));
+		mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,(keyword_root+"height").c_str(),&(region.mHeight));
+		mFrameStatisticsConfig.mRegions.push_back(region);
+	}
 	cout << "Detector initialised" << endl;
 	LOG4CXX_INFO(logger,"Detector initialised.");
 }
@@ -141,21 +456,22 @@ void EmulatedCamera::set_binning(const int8_t xbin, const int8_t ybin)
  *     and if so we throw an out of range camera exception.
  * <li>We check whether the y_start pixel position is less than 1 or greater than the nrows,
  *     and if so we throw an out of range camera exception.
- * <li>We check whether the x_end pixel position is less than 1, greater than the ncols config file value,
- *     or less than or equal to x_start, and if so we throw an out of range camera exception.
- * <li>We check whether the y_end pixel position is less than 1, greater than the nrows config file value,
- *     or less than or equal to y_start, and if so we throw an out of range camera exception.
+ * <li>We check whether the x_end pixel position is less than x_start, or greater than the ncols config file value,
+ *     and if so we throw an out of range camera exception.
+ * <li>We check whether the y_end pixel position is less than y_start, or greater than the nrows config file value,
+ *     and if so we throw an out of range camera exception.
  * <li>We set mState's use_window to true, and set mState's window pixel values to the x_start, y_start, x_end 
  *     and y_end parameters.
  * </ul>
+ * The window positions are unbinned and inclusive, starting at 1, as for the real camera (CCD_Setup_Dimensions).
  * @param x_start The start X pixel position of the sub-window. Should be at least 1, 
- *        and less than the X size of the detector.
+ *        and no more than the X size of the detector.
  * @param y_start The start Y pixel position of the sub-window. Should be at least 1, 
- *        and less than the Y size of the detector.
- * @param x_end The end X pixel position of the sub-window. Should be at least 1, 
- *        less than the X size of the detector, and greater than x_start.
- * @param y_end The end Y pixel position of the sub-window. Should be at least 1, 
- *        less than the Y size of the detector, and greater than y_start.
+ *        and no more than the Y size of the detector.
+ * @param x_end The end X pixel position of the sub-window. Should be at least x_start, 
+ *        and no more than the X size of the detector.
+ * @param y_end The end Y pixel position of the sub-window. Should be at least y_start, 
+ *        and no more than the Y size of the detector.
  * @see EmulatedCamera::mCameraConfig
  * @see EmulatedCamera::mState
  * @see CameraException
@@ -173,25 +489,25 @@ void EmulatedCamera::set_window(const int32_t x_start,const int32_t y_start,cons
 	mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,"ccd.ncols",&ncols);
 	mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,"ccd.nrows",&nrows);
 	// check window is legal
-	if((x_start < 0)||(x_start >= ncols))
+	if((x_start < 1)||(x_start > ncols))
 	{
 		ce.message = "Window x_start position "+ std::to_string(x_start) +" out of range 1 .. "+
 			std::to_string(ncols)+".";
 		throw ce;
 	}
-	if((y_start < 0)||(y_start >= nrows))
+	if((y_start < 1)||(y_start > nrows))
 	{
 		ce.message = "Window y_start position "+ std::to_string(y_start) +" out of range 1 .. "+
 			std::to_string(nrows)+".";
 		throw ce;
 	}
-	if((x_end < 0)||(x_end >= ncols)||(x_end <= x_start))
+	if((x_end < x_start)||(x_end > ncols))
 	{
 		ce.message = "Window x_end position "+ std::to_string(x_end) +" out of range "+
 			std::to_string(x_start)+" .. "+std::to_string(ncols)+".";
 		throw ce;
 	}
-	if((y_end < 0)||(y_end >= nrows)||(y_end <= y_start))
+	if((y_end < y_start)||(y_end > nrows))
 	{
 		ce.message = "Window y_end position "+ std::to_string(y_end) +" out of range "+
 			std::to_string(y_start)+" .. "+std::to_string(nrows)+".";
@@ -281,6 +597,47 @@ void EmulatedCamera::clear_fits_headers()
 	LOG4CXX_INFO(logger,"Clear FITS headers.");
 }
 
+/**
+ * Emulate creating a FITS header set. The headers are not stored, we just return a new header set id.
+ * @param fits_info The list of FITS header cards to add to the header set.
+ * @return The header set id of the new header set.
+ * @see EmulatedCamera::mFitsHeaderSetIds
+ * @see EmulatedCamera::mNextFitsHeaderSetId
+ * @see EmulatedCamera::mFitsHeaderMutex
+ */
+int64_t EmulatedCamera::create_fits_header_set(const std::vector<FitsHeaderCard> & fits_info)
+{
+	std::lock_guard<std::mutex> lock(mFitsHeaderMutex);
+	int64_t header_set_id;
+
+	header_set_id = mNextFitsHeaderSetId++;
+	mFitsHeaderSetIds.insert(header_set_id);
+	cout << "Created FITS header set " << header_set_id << " with " << fits_info.size() << " cards." << endl;
+	LOG4CXX_INFO(logger,"Created FITS header set " << header_set_id << " with " << fits_info.size() << " cards.");
+	return header_set_id;
+}
+
+/**
+ * Emulate deleting a FITS header set created by create_fits_header_set.
+ * @param header_set_id The header set id returned by create_fits_header_set. If no header set with this id
+ *        exists, a CameraException is thrown.
+ * @see EmulatedCamera::mFitsHeaderSetIds
+ * @see EmulatedCamera::mFitsHeaderMutex
+ */
+void EmulatedCamera::delete_fits_header_set(const int64_t header_set_id)
+{
+	std::lock_guard<std::mutex> lock(mFitsHeaderMutex);
+	CameraException ce;
+
+	cout << "Delete FITS header set " << header_set_id << "." << endl;
+	LOG4CXX_INFO(logger,"Delete FITS header set " << header_set_id << ".");
+	if(mFitsHeaderSetIds.erase(header_set_id) == 0)
+	{
+		ce.message = "delete_fits_header_set: No FITS header set with id "+std::to_string(header_set_id)+".";
+		throw ce;
+	}
+}
+
 /**
  * Thrift entry point to set the exposure length to use for subsequent darks and exposures.
  * @param exposure_length The exposure length to use, in milliseconds.
@@ -328,10 +685,37 @@ void EmulatedCamera::start_expose(const bool save_image)
 		throw ce;
 	}
 	mState.exposure_in_progress = TRUE;
+	mState.exposure_index = 0;
+	mState.exposure_count = 1;
 	std::thread thrd(&EmulatedCamera::expose_thread, this, mState.exposure_length, save_image);
 	thrd.detach();
 }
 
+/**
+ * thrift entry point to take an exposure with the camera, saving the image with the FITS headers in a header set.
+ * We check the header set exists (a header set id of 0 means the current FITS headers), and then call start_expose.
+ * @param save_image A boolean, if true save the image in a FITS filename, otherwise don't.
+ * @param header_set_id The id of a header set created by create_fits_header_set, or 0.
+ * @see EmulatedCamera::mFitsHeaderSetIds
+ * @see EmulatedCamera::start_expose
+ */
+void EmulatedCamera::start_expose_with_header_set(const bool save_image,const int64_t header_set_id)
+{
+	CameraException ce;
+
+	if(header_set_id != 0)
+	{
+		std::lock_guard<std::mutex> lock(mFitsHeaderMutex);
+
+		if(mFitsHeaderSetIds.count(header_set_id) == 0)
+		{
+			ce.message = "No FITS header set with id "+std::to_string(header_set_id)+".";
+			throw ce;
+		}
+	}
+	start_expose(save_image);
+}
+
 /**
  * thrift entry point to start taking a bias frame. We set mState's exposure_in_progress to TRUE to show
  * a bias is in progress. A new thread running an instance of bias_thread is started.
@@ -346,6 +730,8 @@ void EmulatedCamera::start_bias()
 	cout << "Starting bias thread." << endl;
 	LOG4CXX_INFO(logger,"Starting bias thread.");
 	mState.exposure_in_progress = TRUE;
+	mState.exposure_index = 0;
+	mState.exposure_count = 1;
 	std::thread thrd(&EmulatedCamera::bias_thread, this);
 	thrd.detach();
 }
@@ -369,13 +755,117 @@ void EmulatedCamera::start_dark()
 	cout << "Starting dark thread with exposure length " << mState.exposure_length << "ms." << endl;
 	LOG4CXX_INFO(logger,"Starting dark thread with exposure length " << mState.exposure_length << "ms.");
 	mState.exposure_in_progress = TRUE;
+	mState.exposure_index = 0;
+	mState.exposure_count = 1;
 	std::thread thrd(&EmulatedCamera::dark_thread, this, mState.exposure_length);
 	thrd.detach();
 }
 
+/**
+ * thrift entry point to start taking a series of exposures (a multrun). We check the parameters are sensible, 
+ * reset mAbort (so an abort_exposure after this returns is honoured), set mState's exposure_in_progress to TRUE
+ * to show a multrun is in progress, and a new thread running an instance of multrun_thread is started.
+ * @param exposure_count The number of frames to take. Must be at least 1.
+ * @param exposure_length The exposure length of each frame in milliseconds. Must be at least 1 ms.
+ * @param save_images A boolean, if true save each image in a FITS filename (if "emulation.data_dir" is configured).
+ * @see EmulatedCamera::mState
+ * @see EmulatedCamera::multrun_thread
+ * @see CameraException
+ */
+void EmulatedCamera::start_multrun(const int32_t exposure_count,const int32_t exposure_length,const bool save_images)
+{
+	CameraException ce;
+
+	if(exposure_count < 1)
+	{
+		ce.message = "Exposure count "+ std::to_string(exposure_count) +" too small.";
+		throw ce;
+	}
+	if(exposure_length < 1)
+	{
+		ce.message = "Exposure length "+ std::to_string(exposure_length) +" too small.";
+		throw ce;
+	}
+	cout << "Starting multrun thread with exposure count " << exposure_count << " and exposure length " <<
+		exposure_length << "ms." << endl;
+	LOG4CXX_INFO(logger,"Starting multrun thread with exposure count " << exposure_count <<
+		     " and exposure length " << exposure_length << "ms.");
+	mAbort = false;
+	mState.exposure_in_progress = TRUE;
+	mState.exposure_index = 0;
+	mState.exposure_count = exposure_count;
+	std::thread thrd(&EmulatedCamera::multrun_thread, this, exposure_count, exposure_length, true, save_images);
+	thrd.detach();
+}
+
+/**
+ * thrift entry point to start taking a series of bias frames (a multbias). We check the parameters are sensible, 
+ * reset mAbort (so an abort_exposure after this returns is honoured), set mState's exposure_in_progress to TRUE
+ * to show a multbias is in progress, and a new thread running an instance of multrun_thread (with an exposure
+ * length of zero, and the shutter closed) is started.
+ * @param exposure_count The number of frames to take. Must be at least 1.
+ * @see EmulatedCamera::mState
+ * @see EmulatedCamera::multrun_thread
+ * @see CameraException
+ */
+void EmulatedCamera::start_multbias(const int32_t exposure_count)
+{
+	CameraException ce;
+
+	if(exposure_count < 1)
+	{
+		ce.message = "Exposure count "+ std::to_string(exposure_count) +" too small.";
+		throw ce;
+	}
+	cout << "Starting multbias thread with exposure count " << exposure_count << "." << endl;
+	LOG4CXX_INFO(logger,"Starting multbias thread with exposure count " << exposure_count << ".");
+	mAbort = false;
+	mState.exposure_in_progress = TRUE;
+	mState.exposure_index = 0;
+	mState.exposure_count = exposure_count;
+	std::thread thrd(&EmulatedCamera::multrun_thread, this, exposure_count, 0, false, true);
+	thrd.detach();
+}
+
+/**
+ * thrift entry point to start taking a series of dark frames (a multdark). We check the parameters are sensible, 
+ * reset mAbort (so an abort_exposure after this returns is honoured), set mState's exposure_in_progress to TRUE
+ * to show a multdark is in progress, and a new thread running an instance of multrun_thread (with the shutter closed)
+ * is started.
+ * @param exposure_count The number of frames to take. Must be at least 1.
+ * @param exposure_length The exposure length of each frame in milliseconds. Must be at least 1 ms.
+ * @see EmulatedCamera::mState
+ * @see EmulatedCamera::multrun_thread
+ * @see CameraException
+ */
+void EmulatedCamera::start_multdark(const int32_t exposure_count,const int32_t exposure_length)
+{
+	CameraException ce;
+
+	if(exposure_count < 1)
+	{
+		ce.message = "Exposure count "+ std::to_string(exposure_count) +" too small.";
+		throw ce;
+	}
+	if(exposure_length < 1)
+	{
+		ce.message = "Exposure length "+ std::to_string(exposure_length) +" too small.";
+		throw ce;
+	}
+	cout << "Starting multdark thread with exposure count " << exposure_count << " and exposure length " <<
+		exposure_length << "ms." << endl;
+	LOG4CXX_INFO(logger,"Starting multdark thread with exposure count " << exposure_count <<
+		     " and exposure length " << exposure_length << "ms.");
+	mAbort = false;
+	mState.exposure_in_progress = TRUE;
+	mState.exposure_index = 0;
+	mState.exposure_count = exposure_count;
+	std::thread thrd(&EmulatedCamera::multrun_thread, this, exposure_count, exposure_length, false, true);
+	thrd.detach();
+}
 
 /**
- * Abort a running expose/dark/bias. 
+ * Abort a running expose/dark/bias/multbias/multdark/multrun. 
  * This set mAbort to true.
  * @see EmulatedCamera::mAbort
  */
@@ -387,15 +877,116 @@ void EmulatedCamera::abort_exposure()
 }
 
 /**
- * Get the current state of the camera. Here we set state to the mState member variable.
+ * Fail a blocking call (wait_for_exposure or one of the full frame image downloads) straight away if it did not get
+ * a slot in mBlockingCalls, as in the camera server.
+ * @param slot The BlockingCallSlot the calling method took in mBlockingCalls.
+ * @param method_name The name of the calling method, used in the exception message.
+ * @exception CameraException Thrown if the slot was not acquired (too many blocking calls are in progress).
+ * @see EmulatedCamera::mBlockingCalls
+ * @see BlockingCallSlot
+ * @see CameraException
+ */
+void EmulatedCamera::check_blocking_call_slot(const BlockingCallSlot &slot,const char *method_name)
+{
+	CameraException ce;
+
+	if(slot.acquired() == false)
+	{
+		ce.message = std::string(method_name)+" failed: Too many blocking calls in progress (limit "+
+			std::to_string(mBlockingCalls.get_limit())+"), try again later.";
+		LOG4CXX_ERROR(logger,std::string(method_name)+": Throwing exception:" + ce.message);
+		throw ce;
+	}
+}
+
+/**
+ * Block until the emulated exposure/bias/dark/multrun has read out a frame or finished, or timeout_ms
+ * milliseconds have elapsed. We wait on mExposureCondition until either mState.exposure_in_progress is FALSE and
+ * the processing stage has processed all the exposure's frames (mFramesPendingCount is zero), 
+ * or mImageFrameSequence has changed. As in the camera server, the wait is limited to mWaitForExposureMaxTimeout.
+ * @param timeout_ms The maximum length of time to wait, in milliseconds. Must be at least 0.
+ * @return We return true if a new frame was read out, or the exposure finished, and false if the timeout expired first.
+ * @see EmulatedCamera::mState
+ * @see EmulatedCamera::mImageFrameSequence
+ * @see EmulatedCamera::mFramesPendingCount
+ * @see EmulatedCamera::mWaitForExposureMaxTimeout
+ * @see EmulatedCamera::mExposureMutex
+ * @see EmulatedCamera::mExposureCondition
+ * @see EmulatedCamera::notify_exposure_waiters
+ * @see EmulatedCamera::mBlockingCalls
+ * @see EmulatedCamera::check_blocking_call_slot
+ */
+bool EmulatedCamera::wait_for_exposure(const int32_t timeout_ms)
+{
+	BlockingCallSlot slot(mBlockingCalls);
+	CameraException ce;
+	int64_t frame_sequence;
+	int32_t wait_length;
+	bool retval;
+
+	cout << "Wait for exposure with timeout " << timeout_ms << " ms." << endl;
+	LOG4CXX_INFO(logger,"Wait for exposure with timeout " << timeout_ms << " ms.");
+	check_blocking_call_slot(slot,"wait_for_exposure");
+	if(timeout_ms < 0)
+	{
+		ce.message = "wait_for_exposure failed: timeout " + std::to_string((int)timeout_ms) +
+			" ms is too small.";
+		LOG4CXX_ERROR(logger,"wait_for_exposure: Throwing exception:" + ce.message);
+		throw ce;
+	}
+	wait_length = std::min(timeout_ms,(int32_t)mWaitForExposureMaxTimeout);
+	std::unique_lock<std::mutex> lock(mExposureMutex);
+	frame_sequence = mImageFrameSequence;
+	retval = mExposureCondition.wait_for(lock,std::chrono::milliseconds(wait_length),
+			[this,frame_sequence]{return ((mState.exposure_in_progress == FALSE)&&(mFramesPendingCount == 0))||
+					(mImageFrameSequence != frame_sequence);});
+	cout << "Wait for exposure returned " << retval << "." << endl;
+	LOG4CXX_INFO(logger,"Wait for exposure returned " << retval << ".");
+	return retval;
+}
+
+/**
+ * Get the current state of the camera. Here we add the emulated temperature to the temperature history,
+ * and set state to the mState member variable. As in the camera server, the exposure is still in progress until 
+ * the processing stage has processed all it's frames (mFramesPendingCount is zero).
  * @param state An instance of CameraState that we set the member values to the current status.
  * @see EmulatedCamera::mState
+ * @see EmulatedCamera::mFramesPendingCount
+ * @see EmulatedCamera::add_temperature_history
  */
 void EmulatedCamera::get_state(CameraState &state)
 {
 	cout << "Get camera state." << endl;
 	LOG4CXX_INFO(logger,"Get camera state.");
+	add_temperature_history();
 	state = mState;
+	state.exposure_in_progress = (mState.exposure_in_progress == TRUE)||(mFramesPendingCount > 0);
+}
+
+/**
+ * Get the emulated CCD temperature samples taken after a time, at a specified resolution.
+ * If the resolution is not a legal TemperatureResolution, a CameraException is thrown.
+ * @param history A TemperatureHistory to fill in with the samples.
+ * @param since Only samples taken after this time (in milliseconds since the epoch) are returned.
+ * @param resolution The resolution of the samples to return (RAW / TEN_SECONDS / ONE_MINUTE).
+ * @see EmulatedCamera::mTemperatureHistory
+ * @see TemperatureHistoryRing::get_history
+ */
+void EmulatedCamera::get_temperature_history(TemperatureHistory &history,const int64_t since,
+					     const TemperatureResolution::type resolution)
+{
+	CameraException ce;
+
+	cout << "Get temperature history since " << since << " at resolution " << resolution << "." << endl;
+	LOG4CXX_INFO(logger,"Get temperature history since " << since << " at resolution " << resolution << ".");
+	if((resolution != TemperatureResolution::RAW)&&(resolution != TemperatureResolution::TEN_SECONDS)&&
+	   (resolution != TemperatureResolution::ONE_MINUTE))
+	{
+		ce.message = "get_temperature_history failed:Illegal resolution "+std::to_string((int)resolution)+".";
+		LOG4CXX_ERROR(logger,"get_temperature_history: Throwing exception:" + ce.message);
+		throw ce;
+	}
+	mTemperatureHistory.get_history(since,resolution,history);
 }
 
 /**
@@ -405,121 +996,500 @@ void EmulatedCamera::get_state(CameraState &state)
  * @see EmulatedCamera::mImageBufNCols
  * @see EmulatedCamera::mImageBufNRows
  * @see ImageData
+ * @see EmulatedCamera::mBlockingCalls
+ * @see EmulatedCamera::check_blocking_call_slot
  */
 void EmulatedCamera::get_image_data(ImageData &img_data)
 {
+	BlockingCallSlot slot(mBlockingCalls);
 	cout << "Get image data." << endl;
 	LOG4CXX_INFO(logger,"Get image data.");
-	std::vector<int32_t>::const_iterator first = mImageBuf.begin();
-	std::vector<int32_t>::const_iterator last = mImageBuf.end();
+	check_blocking_call_slot(slot,"get_image_data");
+	std::lock_guard<std::mutex> lock(mImageBufMutex);
+	std::vector<uint16_t>::const_iterator first = mImageBuf.begin();
+	std::vector<uint16_t>::const_iterator last = mImageBuf.end();
 	img_data.data.assign(first, last);
 	img_data.x_size = mImageBufNCols;
 	img_data.y_size = mImageBufNRows;
 }
 
 /**
- * Return the image filename of the last FITS image saved by the camera server.
- * @param filename On return of this method, the filename will contain a string representation of 
- *                 the last FITS image filename saved by the camera server.
+ * Get a copy of the image data, as a packed binary blob of little-endian unsigned 16-bit pixels.
+ * The image buffer is copied into img_data.data with one memory copy (byte swapped on a big-endian host).
+ * @param img_data An ImageDataBinary instance to fill in with the returned image data.
+ * @see EmulatedCamera::mImageBuf
+ * @see EmulatedCamera::mImageBufNCols
+ * @see EmulatedCamera::mImageBufNRows
+ * @see EmulatedCamera::mImageBufXBin
+ * @see EmulatedCamera::mImageBufYBin
+ * @see EmulatedCamera::mImageFrameSequence
+ * @see ImageDataBinary
+ * @see EmulatedCamera::mBlockingCalls
+ * @see EmulatedCamera::check_blocking_call_slot
  */
-void EmulatedCamera::get_last_image_filename(std::string &filename)
+void EmulatedCamera::get_image_data_binary(ImageDataBinary &img_data)
 {
-	/* TODO */
-	filename = "/data/lesedi/mkd/2021/0413/MKD_20210413.0001.fits";
+	BlockingCallSlot slot(mBlockingCalls);
+	cout << "Get image data binary." << endl;
+	LOG4CXX_INFO(logger,"Get image data binary.");
+	check_blocking_call_slot(slot,"get_image_data_binary");
+	std::lock_guard<std::mutex> lock(mImageBufMutex);
+	img_data.data.assign((const char*)(mImageBuf.data()),mImageBuf.size()*sizeof(uint16_t));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	for(size_t i = 0; i < img_data.data.size(); i += 2)
+		std::swap(img_data.data[i],img_data.data[i+1]);
+#endif
+	img_data.x_size = mImageBufNCols;
+	img_data.y_size = mImageBufNRows;
+	img_data.xbin = mImageBufXBin;
+	img_data.ybin = mImageBufYBin;
+	img_data.frame_sequence = mImageFrameSequence;
 }
 
 /**
- * thrift entry point to start cooling down the camera. 
- * We retrieve the target temperature from the config file object mCameraConfig,
- * "ccd.target_temperature" value, and set the mState.ccd_temperature to this to emulate a cooled CCD.
- * @see EmulatedCamera::mCameraConfig
- * @see EmulatedCamera::mState
+ * Get a copy of a region of the emulated image data, optionally subsampled, as packed little-endian unsigned 16-bit
+ * pixels. The emulated image is never re-oriented.
+ * If no image has been emulated yet, or the region is illegal or does not overlap the image, we throw a
+ * CameraException.
+ * @param region An ImageRegion instance to fill in with the returned region.
+ * @param x0 The first column of the region in the image, in binned pixels (starting from 0).
+ * @param y0 The first row of the region in the image, in binned pixels (starting from 0).
+ * @param w The number of columns in the region, in binned pixels.
+ * @param h The number of rows in the region, in binned pixels.
+ * @param step The subsampling step: every step'th pixel of every step'th row of the region is returned.
+ * @see EmulatedCamera::mImageBuf
+ * @see EmulatedCamera::mImageBufMutex
+ * @see image_region_clip
+ * @see image_region_set_detector_area
+ * @see image_region_copy
+ * @see ImageRegion
+ * @see CameraException
+ * @see EmulatedCamera::mBlockingCalls
+ * @see EmulatedCamera::check_blocking_call_slot
  */
-void EmulatedCamera::cool_down()
+void EmulatedCamera::get_image_region(ImageRegion &region,const int32_t x0,const int32_t y0,const int32_t w,
+				      const int32_t h,const int32_t step)
 {
-	double target_temperature;
+	BlockingCallSlot slot(mBlockingCalls);
+	CameraException ce;
 
-	cout << "Cool down the camera." << endl;
-	LOG4CXX_INFO(logger,"Cool down the camera.");
-	mCameraConfig.get_config_double(CONFIG_CAMERA_SECTION,"ccd.target_temperature",&target_temperature);
-	mState.ccd_temperature = target_temperature;
-	cout << "Camera temperature setpoint is " << mState.ccd_temperature << "." << endl;
-	LOG4CXX_INFO(logger,"Camera temperature setpoint is " << mState.ccd_temperature << ".");
+	cout << "Get image region " << x0 << "," << y0 << " " << w << "x" << h << " step " << step << "." << endl;
+	LOG4CXX_INFO(logger,"Get image region " << x0 << "," << y0 << " " << w << "x" << h << " step " << step << ".");
+	check_blocking_call_slot(slot,"get_image_region");
+	std::lock_guard<std::mutex> lock(mImageBufMutex);
+	if(mImageFrameSequence == 0)
+	{
+		ce.message = "No image has been read out.";
+		LOG4CXX_ERROR(logger,"get_image_region:" << ce.message);
+		throw ce;
+	}
+	if(!image_region_clip(mImageBufNCols,mImageBufNRows,x0,y0,w,h,step,region,ce.message))
+	{
+		LOG4CXX_ERROR(logger,"get_image_region:" << ce.message);
+		throw ce;
+	}
+	image_region_set_detector_area(region,CCD_ORIENTATION_NONE,mImageBufNCols,mImageBufNRows,mImageBufXBin,
+				       mImageBufYBin,mImageBufXStart,mImageBufYStart);
+	image_region_copy(mImageBuf.data(),mImageBufNCols,region);
+	region.frame_sequence = mImageFrameSequence;
 }
 
 /**
- * thrift entry point to start warming up the camera. 
- * We set the mState.ccd_temperature to 10.0 to emulate the CCD warmed up.
- * @see EmulatedCamera::mState
+ * Get an 8-bit preview of the emulated image data, downsampled to fit within max_width x max_height pixels and
+ * stretched. The preview is rendered whilst holding mImageBufMutex, as the emulated image buffer is not reference
+ * counted. If no image has been read out, or the preview fails to render, we throw a CameraException.
+ * @param preview A Preview instance to fill in with the preview.
+ * @param max_width The maximum number of columns in the preview.
+ * @param max_height The maximum number of rows in the preview.
+ * @param stretch The PreviewStretch to use.
+ * @param downsample The PreviewDownsample to use.
+ * @param format The PreviewFormat to return the preview in.
+ * @see EmulatedCamera::mImageBuf
+ * @see EmulatedCamera::mImageBufMutex
+ * @see EmulatedCamera::mPreviewThreadCount
+ * @see image_preview_create
+ * @see Preview
+ * @see CameraException
+ * @see EmulatedCamera::mBlockingCalls
+ * @see EmulatedCamera::check_blocking_call_slot
  */
-void EmulatedCamera::warm_up()
+void EmulatedCamera::get_preview(Preview &preview,const int32_t max_width,const int32_t max_height,
+				 const PreviewStretch::type stretch,const PreviewDownsample::type downsample,
+				 const PreviewFormat::type format)
 {
-	cout << "Warm up the camera." << endl;
-	LOG4CXX_INFO(logger,"Warm up the camera.");
-	mState.ccd_temperature = 10.0;
-	cout << "Camera warmed up to " << mState.ccd_temperature << " C." << endl;
-	LOG4CXX_INFO(logger,"Camera warmed up to " << mState.ccd_temperature << " C.");
+	BlockingCallSlot slot(mBlockingCalls);
+	CameraException ce;
+
+	LOG4CXX_DEBUG(logger,"Get preview of maximum size " << max_width << "x" << max_height << " with stretch " <<
+		      to_string(stretch) << ", downsample " << to_string(downsample) << " and format " <<
+		      to_string(format) << ".");
+	check_blocking_call_slot(slot,"get_preview");
+	std::lock_guard<std::mutex> lock(mImageBufMutex);
+	if(mImageFrameSequence == 0)
+	{
+		ce.message = "No image has been read out.";
+		LOG4CXX_ERROR(logger,"get_preview:" << ce.message);
+		throw ce;
+	}
+	if(!image_preview_create(mImageBuf.data(),mImageBufNCols,mImageBufNRows,max_width,max_height,stretch,
+				 downsample,format,mPreviewThreadCount,preview,ce.message))
+	{
+		LOG4CXX_ERROR(logger,"get_preview:" << ce.message);
+		throw ce;
+	}
+	preview.frame_sequence = mImageFrameSequence;
 }
 
 /**
- * Thread to emulate the taking of an image.
- * <ul>
- * <li>We use mState.use_window to determine whether to are reading out a window or full frame,
- *     and based on that use either mState.window or mCameraConfig config value "ccd.ncols"/mCameraConfig config value "ccd.nrows" 
- *     to calculate the image dimensions.
- * <li>We compute the total number of pixels in the readout image using the data calculated.
- * <li>We intialise mState's exposure_length to the expose_thread's exposure_length parameter.
- * <li>We initialise mAbort to false.
- * <li>We set mState's exposure_state to exposing, 
- *     elapsed_exposure_length to 0 and remaining_exposure_length to the exposure_length parameter.
- * <li>We enter a while loop, while mState's remaining_exposure_length is greater than 0 and mAbort is false:
- *     <ul>
- *     <li>We sleep for 1 second.
- *     <li>We decrement mState's remaining_exposure_length by 1000 ms.
- *     <li>We increment mState's elapsed_exposure_length by 1000 ms.
+ * Get the statistics of the emulated image data (if frame_id is zero), or of a frame held in the emulated frame
+ * history, and of each configured region of it, and optionally it's histogram. The emulated camera does not
+ * process it's frames as they are read out, so the statistics are computed when they are requested, whilst holding
+ * mImageBufMutex, as the emulated image buffers are not reference counted. If there is no such image, or the
+ * statistics fail to compute, we throw a CameraException.
+ * @param statistics An ImageStatistics instance to fill in with the image's statistics.
+ * @param frame_id The id of the frame to return the statistics of, or zero for the last emulated image.
+ * @param include_histogram Whether to return the image's histogram.
+ * @see EmulatedCamera::mImageBuf
+ * @see EmulatedCamera::mImageBufMutex
+ * @see EmulatedCamera::mFrameHistory
+ * @see EmulatedCamera::mFrameStatisticsConfig
+ * @see frame_statistics_compute
+ * @see ImageStatistics
+ * @see CameraException
+ */
+void EmulatedCamera::get_image_statistics(ImageStatistics &statistics,const int64_t frame_id,
+					  const bool include_histogram)
+{
+	CameraException ce;
+	const std::vector<uint16_t> *image_buf = NULL;
+	int ncols,nrows;
+
+	LOG4CXX_DEBUG(logger,"Get image statistics for frame " << frame_id << (include_histogram ? " with" : " without") <<
+		      " histogram.");
+	std::lock_guard<std::mutex> lock(mImageBufMutex);
+	if(frame_id == 0)
+	{
+		if(mImageFrameSequence == 0)
+		{
+			ce.message = "No image has been read out.";
+			LOG4CXX_ERROR(logger,"get_image_statistics:" << ce.message);
+			throw ce;
+		}
+		image_buf = &mImageBuf;
+		ncols = mImageBufNCols;
+		nrows = mImageBufNRows;
+		statistics.frame_sequence = mImageFrameSequence;
+	}
+	else
+	{
+		for(const FrameHistoryEntry &entry : mFrameHistory)
+		{
+			if(entry.mInfo.frame_id == frame_id)
+			{
+				image_buf = &(entry.mImageBuf);
+				ncols = entry.mInfo.x_size;
+				nrows = entry.mInfo.y_size;
+				statistics.frame_sequence = entry.mInfo.frame_id;
+				break;
+			}
+		}
+		if(image_buf == NULL)
+		{
+			ce.message = "Frame " + std::to_string(frame_id) + " is not in the frame history.";
+			LOG4CXX_ERROR(logger,"get_image_statistics:" << ce.message);
+			throw ce;
+		}
+	}
+	if(!frame_statistics_compute(image_buf->data(),ncols,nrows,mFrameStatisticsConfig,statistics,ce.message))
+	{
+		LOG4CXX_ERROR(logger,"get_image_statistics:" << ce.message);
+		throw ce;
+	}
+	if(!include_histogram)
+		statistics.histogram.clear();
+}
+
+/**
+ * Return the list of codecs get_image_data_compressed can compress images with.
+ * @param codecs On return of this method, the list of ImageCodec supported.
+ * @see image_codec_list
+ * @see ImageCodec
+ */
+void EmulatedCamera::get_image_codecs(std::vector<ImageCodec::type> &codecs)
+{
+	cout << "Get image codecs." << endl;
+	LOG4CXX_INFO(logger,"Get image codecs.");
+	image_codec_list(codecs);
+}
+
+/**
+ * Get a copy of the emulated image data (if frame_id is zero), or of a frame held in the emulated frame history,
+ * compressed with a codec. The image is compressed whilst holding mImageBufMutex, as the emulated image buffers
+ * are not reference counted. If the codec is not supported, there is no such image, or the image fails to compress,
+ * we throw a CameraException.
+ * @param compressed A CompressedImageData instance to fill in with the compressed image.
+ * @param frame_id The id of the frame to return, or zero for the last emulated image.
+ * @param codec The ImageCodec to compress the image with.
+ * @see EmulatedCamera::mImageBuf
+ * @see EmulatedCamera::mImageBufMutex
+ * @see EmulatedCamera::mFrameHistory
+ * @see EmulatedCamera::mImageCodecConfig
+ * @see image_codec_compress
+ * @see CompressedImageData
+ * @see CameraException
+ * @see EmulatedCamera::mBlockingCalls
+ * @see EmulatedCamera::check_blocking_call_slot
+ */
+void EmulatedCamera::get_image_data_compressed(CompressedImageData &compressed,const int64_t frame_id,
+					       const ImageCodec::type codec)
+{
+	BlockingCallSlot slot(mBlockingCalls);
+	CameraException ce;
+
+	cout << "Get image data for frame " << frame_id << " compressed with codec " << to_string(codec) << "." <<
+		endl;
+	LOG4CXX_INFO(logger,"Get image data for frame " << frame_id << " compressed with codec " << to_string(codec) <<
+		     ".");
+	check_blocking_call_slot(slot,"get_image_data_compressed");
+	std::lock_guard<std::mutex> lock(mImageBufMutex);
+	if(frame_id == 0)
+	{
+		if(mImageFrameSequence == 0)
+		{
+			ce.message = "No image has been read out.";
+			LOG4CXX_ERROR(logger,"get_image_data_compressed:" << ce.message);
+			throw ce;
+		}
+		if(!image_codec_compress(mImageBuf.data(),mImageBufNCols,mImageBufNRows,codec,mImageCodecConfig,
+					 compressed,ce.message))
+		{
+			LOG4CXX_ERROR(logger,"get_image_data_compressed:" << ce.message);
+			throw ce;
+		}
+		compressed.xbin = mImageBufXBin;
+		compressed.ybin = mImageBufYBin;
+		compressed.frame_sequence = mImageFrameSequence;
+		return;
+	}
+	for(const FrameHistoryEntry &entry : mFrameHistory)
+	{
+		if(entry.mInfo.frame_id == frame_id)
+		{
+			if(!image_codec_compress(entry.mImageBuf.data(),entry.mInfo.x_size,entry.mInfo.y_size,codec,
+						 mImageCodecConfig,compressed,ce.message))
+			{
+				LOG4CXX_ERROR(logger,"get_image_data_compressed:" << ce.message);
+				throw ce;
+			}
+			compressed.xbin = entry.mInfo.xbin;
+			compressed.ybin = entry.mInfo.ybin;
+			compressed.frame_sequence = entry.mInfo.frame_id;
+			return;
+		}
+	}
+	ce.message = "Frame " + std::to_string(frame_id) + " is not in the frame history.";
+	LOG4CXX_ERROR(logger,"get_image_data_compressed:" << ce.message);
+	throw ce;
+}
+
+/**
+ * Return a list describing the frames currently held in the emulated frame history, oldest first.
+ * @param frames On return of this method, a list of FrameInfo, one per frame in the frame history.
+ * @see EmulatedCamera::mFrameHistory
+ * @see FrameInfo
+ */
+void EmulatedCamera::list_frames(std::vector<FrameInfo> &frames)
+{
+	cout << "List frames." << endl;
+	LOG4CXX_INFO(logger,"List frames.");
+	std::lock_guard<std::mutex> lock(mImageBufMutex);
+	frames.clear();
+	for(const FrameHistoryEntry &entry : mFrameHistory)
+		frames.push_back(entry.mInfo);
+}
+
+/**
+ * Get a copy of a frame held in the emulated frame history, as a packed binary blob of little-endian 
+ * unsigned 16-bit pixels. If the frame is not in the history we throw a CameraException.
+ * @param img_data An ImageDataBinary instance to fill in with the returned image data.
+ * @param frame_id The id of the frame to return.
+ * @see EmulatedCamera::mFrameHistory
+ * @see ImageDataBinary
+ * @see CameraException
+ * @see EmulatedCamera::mBlockingCalls
+ * @see EmulatedCamera::check_blocking_call_slot
+ */
+void EmulatedCamera::get_image_data_by_id(ImageDataBinary &img_data,const int64_t frame_id)
+{
+	BlockingCallSlot slot(mBlockingCalls);
+	CameraException ce;
+
+	cout << "Get image data for frame " << frame_id << "." << endl;
+	LOG4CXX_INFO(logger,"Get image data for frame " << frame_id << ".");
+	check_blocking_call_slot(slot,"get_image_data_by_id");
+	std::lock_guard<std::mutex> lock(mImageBufMutex);
+	for(const FrameHistoryEntry &entry : mFrameHistory)
+	{
+		if(entry.mInfo.frame_id == frame_id)
+		{
+			img_data.data.assign((const char*)(entry.mImageBuf.data()),
+					     entry.mImageBuf.size()*sizeof(uint16_t));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+			for(size_t i = 0; i < img_data.data.size(); i += 2)
+				std::swap(img_data.data[i],img_data.data[i+1]);
+#endif
+			img_data.x_size = entry.mInfo.x_size;
+			img_data.y_size = entry.mInfo.y_size;
+			img_data.xbin = entry.mInfo.xbin;
+			img_data.ybin = entry.mInfo.ybin;
+			img_data.frame_sequence = entry.mInfo.frame_id;
+			return;
+		}
+	}
+	ce.message = "Frame " + std::to_string(frame_id) + " is not in the frame history.";
+	LOG4CXX_ERROR(logger,"get_image_data_by_id:" << ce.message);
+	throw ce;
+}
+
+/**
+ * Get the timelines of the last few frames acquired. The emulated camera does not time stamp the phases of it's
+ * emulated exposures, so an empty list is returned.
+ * @param timings A vector, on return empty.
+ * @see ExposureTiming
+ */
+void EmulatedCamera::get_exposure_timings(std::vector<ExposureTiming> &timings)
+{
+	cout << "Get exposure timings." << endl;
+	LOG4CXX_INFO(logger,"Get exposure timings.");
+	timings.clear();
+}
+
+/**
+ * Return the image filename of the last FITS image saved by the camera emulator's processing stage. If no emulated
+ * frame has been saved (e.g. "emulation.data_dir" is not configured), EMULATION_DEFAULT_LAST_IMAGE_FILENAME is
+ * returned.
+ * @param filename On return of this method, the filename will contain a string representation of 
+ *                 the last FITS image filename saved by the camera emulator.
+ * @see #EMULATION_DEFAULT_LAST_IMAGE_FILENAME
+ * @see EmulatedCamera::mLastImageFilename
+ * @see EmulatedCamera::mLastImageFilenameMutex
+ * @see EmulatedCamera::save_frame
+ */
+void EmulatedCamera::get_last_image_filename(std::string &filename)
+{
+	std::lock_guard<std::mutex> lock(mLastImageFilenameMutex);
+
+	if(mLastImageFilename.empty())
+		filename = EMULATION_DEFAULT_LAST_IMAGE_FILENAME;
+	else
+		filename = mLastImageFilename;
+}
+
+/**
+ * thrift entry point to start cooling down the camera. 
+ * We retrieve the target temperature from the config file object mCameraConfig,
+ * "ccd.target_temperature" value, and set the mState.ccd_temperature to this (and the mState.cooler_status to OK)
+ * to emulate a cooled CCD, and add the new temperature to the temperature history.
+ * @see EmulatedCamera::mCameraConfig
+ * @see EmulatedCamera::mState
+ * @see EmulatedCamera::add_temperature_history
+ */
+void EmulatedCamera::cool_down()
+{
+	double target_temperature;
+
+	cout << "Cool down the camera." << endl;
+	LOG4CXX_INFO(logger,"Cool down the camera.");
+	mCameraConfig.get_config_double(CONFIG_CAMERA_SECTION,"ccd.target_temperature",&target_temperature);
+	mState.ccd_temperature = target_temperature;
+	mState.cooler_status = CoolerStatus::OK;
+	add_temperature_history();
+	cout << "Camera temperature setpoint is " << mState.ccd_temperature << "." << endl;
+	LOG4CXX_INFO(logger,"Camera temperature setpoint is " << mState.ccd_temperature << ".");
+}
+
+/**
+ * thrift entry point to start warming up the camera. 
+ * We set the mState.ccd_temperature to 10.0 (and the mState.cooler_status to OFF) to emulate the CCD warmed up,
+ * and add the new temperature to the temperature history.
+ * @see EmulatedCamera::mState
+ * @see EmulatedCamera::add_temperature_history
+ */
+void EmulatedCamera::warm_up()
+{
+	cout << "Warm up the camera." << endl;
+	LOG4CXX_INFO(logger,"Warm up the camera.");
+	mState.ccd_temperature = 10.0;
+	mState.cooler_status = CoolerStatus::OFF;
+	add_temperature_history();
+	cout << "Camera warmed up to " << mState.ccd_temperature << " C." << endl;
+	LOG4CXX_INFO(logger,"Camera warmed up to " << mState.ccd_temperature << " C.");
+}
+
+/**
+ * Thread to emulate the taking of an image.
+ * <ul>
+ * <li>We call get_readout_dimensions to calculate the (windowed and binned) image dimensions.
+ * <li>We compute the total number of pixels in the readout image using the data calculated.
+ * <li>We intialise mState's exposure_length to the expose_thread's exposure_length parameter.
+ * <li>We initialise mAbort to false, and record the exposure start time (for the frame ring and frame history).
+ * <li>We set mState's exposure_state to exposing, 
+ *     elapsed_exposure_length to 0 and remaining_exposure_length to the exposure_length parameter.
+ * <li>We enter a while loop, while mState's remaining_exposure_length is greater than 0 and mAbort is false:
+ *     <ul>
+ *     <li>We sleep for 1 second.
+ *     <li>We decrement mState's remaining_exposure_length by 1000 ms.
+ *     <li>We increment mState's elapsed_exposure_length by 1000 ms.
  *     </ul>
  * <li>We check whether mAbort is set true, and if so reset mState's exposure_state to idle and exit the thread.
  * <li>We set mState's exposure_state to readout, and sleep for a second to emulate the readout.
- * <li>We resize mImageBuf to the computed total number of pixels in the readout image.
- * <li>We loop over the image dimensions setting the pixel value in mImageBuf.
+ * <li>We resize an EmulatedFrame's image to the computed total number of pixels in the readout image, and loop 
+ *     over the image dimensions setting each pixel value.
+ * <li>If save_image is true and "emulation.data_dir" is configured (mDataDirectory), we save the frame (with the
+ *     id it will be published with) using save_frame, as the real camera saves an exposure's image.
+ * <li>We swap the frame's image into mImageBuf, record the binning in mImageBufXBin/mImageBufYBin, the window
+ *     start in mImageBufXStart/mImageBufYStart, increment mImageFrameSequence,
+ *     call publish_frame_ring to publish the emulated image into the shared memory frame ring,
+ *     and call add_frame_history to add it (and the saved filename, if any) to the frame history.
+ * <li>We increment mState's exposure_index.
  * <li>We sleep for another second.
  * <li>We check whether mAbort is set true, and if so reset mState's exposure_state to idle and exit the thread.
  * <li>We reset mState's exposure_state to idle.
  * </ul>
  * @param exposure_length The length of the exposure in milliseconds. Should be at least 1.
- * @param save_image A boolean, whether to save the taken image to disc - ignored by the camera emulator.
+ * @param save_image A boolean, whether to save the taken image to disc (if "emulation.data_dir" is configured).
  * @see EmulatedCamera::mState
  * @see EmulatedCamera::mCameraConfig
  * @see EmulatedCamera::mAbort
+ * @see EmulatedCamera::EmulatedFrame
+ * @see EmulatedCamera::mDataDirectory
+ * @see EmulatedCamera::save_frame
  * @see EmulatedCamera::mImageBuf
  * @see EmulatedCamera::mImageBufNCols
  * @see EmulatedCamera::mImageBufNRows
+ * @see EmulatedCamera::mImageFrameSequence
+ * @see EmulatedCamera::get_readout_dimensions
+ * @see EmulatedCamera::publish_frame_ring
+ * @see EmulatedCamera::add_frame_history
  */
 void EmulatedCamera::expose_thread(int32_t exposure_length, bool save_image)
 {
+	EmulatedFrame frame;
+	std::string filename;
 	int reg_width;
 	int reg_height;
 	int total_pixels;
+	struct timespec start_time;
 
 	mState.exposure_in_progress = TRUE;
 	// setup image dimensions
-	if(mState.use_window)
-	{
-		reg_width = (mState.window.x_end - mState.window.x_start)+1;
-		reg_height = (mState.window.y_end - mState.window.y_start)+1; 	
-	}
-	else
-	{
-		mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,"ccd.ncols",&reg_width);
-		mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,"ccd.nrows",&reg_height);
-	}
-	mImageBufNCols = reg_width;
-	mImageBufNRows = reg_height;
+	get_readout_dimensions(&reg_width,&reg_height);
 	total_pixels = reg_width * reg_height;
  	cout << "expose thread with exposure length " << exposure_length << "ms." << endl;
 	LOG4CXX_INFO(logger,"expose thread with exposure length " << exposure_length << "ms.");
 	mState.exposure_length = exposure_length;
 	mAbort = false;
+	clock_gettime(CLOCK_REALTIME,&start_time);
 	mState.exposure_state = ExposureState::EXPOSING;
 	mState.elapsed_exposure_length = 0;
 	mState.remaining_exposure_length = exposure_length;
@@ -539,6 +1509,7 @@ void EmulatedCamera::expose_thread(int32_t exposure_length, bool save_image)
 	{
 		mState.exposure_in_progress = FALSE;
 		mState.exposure_state = ExposureState::IDLE;
+		notify_exposure_waiters();
 		return;
 	}
 	// Simulate the readout
@@ -546,14 +1517,43 @@ void EmulatedCamera::expose_thread(int32_t exposure_length, bool save_image)
 	LOG4CXX_INFO(logger,"Starting readout");
 	mState.exposure_state = ExposureState::READOUT;
 	std::this_thread::sleep_for(std::chrono::seconds(1));   
-	mImageBuf.resize(total_pixels);
+	frame.mImageBuf.resize(total_pixels);
 	for (int i = 0; i < reg_height; i++)
 	{
 		for (int j = 0; j < reg_width; j++)
 		{
-			mImageBuf[i*reg_width+j] = (i*j) * pow(2, 14) / total_pixels;
+			frame.mImageBuf[i*reg_width+j] = (i*j) * pow(2, 14) / total_pixels;
 		}
 	}
+	frame.mNCols = reg_width;
+	frame.mNRows = reg_height;
+	frame.mXBin = mState.xbin;
+	frame.mYBin = mState.ybin;
+	frame.mXStart = mState.use_window ? mState.window.x_start : 1;
+	frame.mYStart = mState.use_window ? mState.window.y_start : 1;
+	frame.mExposureLength = exposure_length;
+	frame.mStartTime = start_time;
+	frame.mOpenShutter = true;
+	frame.mSaveImage = save_image;
+	/* no other acquisition thread runs during an expose, so the frame will be published with the next id */
+	if(frame.mSaveImage&&(mDataDirectory.empty() == false))
+		filename = save_frame(frame,mImageFrameSequence+1);
+	{
+		std::lock_guard<std::mutex> lock(mImageBufMutex);
+
+		mImageBuf.swap(frame.mImageBuf);
+		mImageBufNCols = frame.mNCols;
+		mImageBufNRows = frame.mNRows;
+		mImageBufXBin = frame.mXBin;
+		mImageBufYBin = frame.mYBin;
+		mImageBufXStart = frame.mXStart;
+		mImageBufYStart = frame.mYStart;
+		mImageFrameSequence++;
+		publish_frame_ring(exposure_length,start_time);
+		add_frame_history(exposure_length,start_time,filename);
+	}
+	mState.exposure_index++;
+	notify_exposure_waiters();
 	std::this_thread::sleep_for(std::chrono::seconds(1));
 	// We're done
 	cout << "Exposure complete." << endl;
@@ -562,10 +1562,12 @@ void EmulatedCamera::expose_thread(int32_t exposure_length, bool save_image)
 	{
 		mState.exposure_in_progress = FALSE;
 		mState.exposure_state = ExposureState::IDLE;
+		notify_exposure_waiters();
 		return;
 	}
 	mState.exposure_in_progress = FALSE;
 	mState.exposure_state = ExposureState::IDLE;
+	notify_exposure_waiters();
 	cout << "Expose complete" << endl;
 	LOG4CXX_INFO(logger,"Expose complete");
 }
@@ -573,17 +1575,20 @@ void EmulatedCamera::expose_thread(int32_t exposure_length, bool save_image)
 /**
  * Thread to emulate the taking of a bias image.
  * <ul>
- * <li>We use mState.use_window to determine whether to are reading out a window or full frame,
- *     and based on that use either mState.window or mCameraConfig config value "ccd.ncols" /"ccd.nrows" 
- *     to calculate the image dimensions.
+ * <li>We call get_readout_dimensions to calculate the (windowed and binned) image dimensions.
  * <li>We compute the total number of pixels in the readout image using the data calculated.
  * <li>We intialise mState's exposure_length and exposure_index to 0.
- * <li>We initialise mAbort to false.
+ * <li>We initialise mAbort to false, and record the exposure start time (for the frame ring and frame history).
  * <li>We set mState's exposure_state to exposing, elapsed_exposure_length and remaining_exposure_length to 0.
  * <li>We check whether mAbort is set true, and if so reset mState's exposure_state to idle and exit the thread.
  * <li>We set mState's exposure_state to readout, and sleep for a second to emulate the readout.
  * <li>We resize mImageBuf to the computed total number of pixels in the readout image.
  * <li>We loop over the image dimensions setting the pixel value in mImageBuf.
+ * <li>We record the binning in mImageBufXBin/mImageBufYBin, the window start in mImageBufXStart/mImageBufYStart,
+ *     increment mImageFrameSequence,
+ *     call publish_frame_ring to publish the emulated image into the shared memory frame ring,
+ *     and call add_frame_history to add it to the frame history.
+ * <li>We increment mState's exposure_index.
  * <li>We sleep for another second.
  * <li>We check whether mAbort is set true, and if so reset mState's exposure_state to idle and exit the thread.
  * <li>We reset mState's exposure_state to idle.
@@ -594,32 +1599,27 @@ void EmulatedCamera::expose_thread(int32_t exposure_length, bool save_image)
  * @see EmulatedCamera::mImageBuf
  * @see EmulatedCamera::mImageBufNCols
  * @see EmulatedCamera::mImageBufNRows
+ * @see EmulatedCamera::mImageFrameSequence
+ * @see EmulatedCamera::get_readout_dimensions
+ * @see EmulatedCamera::publish_frame_ring
+ * @see EmulatedCamera::add_frame_history
  */
 void EmulatedCamera::bias_thread()
 {
 	int reg_width;
 	int reg_height;
 	int total_pixels;
+	struct timespec start_time;
 
 	mState.exposure_in_progress = TRUE;
 	// setup image dimensions
-	if(mState.use_window)
-	{
-		reg_width = (mState.window.x_end - mState.window.x_start)+1;
-		reg_height = (mState.window.y_end - mState.window.y_start)+1; 	
-	}
-	else
-	{
-		mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,"ccd.ncols",&reg_width);
-		mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,"ccd.nrows",&reg_height);
-	}
-	mImageBufNCols = reg_width;
-	mImageBufNRows = reg_height;
+	get_readout_dimensions(&reg_width,&reg_height);
 	total_pixels = reg_width * reg_height;
  	cout << "Starting bias thread." << endl;
 	LOG4CXX_INFO(logger,"Starting bias thread.");
 	mState.exposure_length = 0;
 	mAbort = false;
+	clock_gettime(CLOCK_REALTIME,&start_time);
 	mState.exposure_state = ExposureState::EXPOSING;
 	mState.elapsed_exposure_length = 0;
 	mState.remaining_exposure_length = 0;
@@ -627,6 +1627,7 @@ void EmulatedCamera::bias_thread()
 	{
 		mState.exposure_in_progress = FALSE;
 		mState.exposure_state = ExposureState::IDLE;
+		notify_exposure_waiters();
 		return;
 	}
 	// Simulate the readout
@@ -634,14 +1635,29 @@ void EmulatedCamera::bias_thread()
 	LOG4CXX_INFO(logger,"Starting readout");
 	mState.exposure_state = ExposureState::READOUT;
 	std::this_thread::sleep_for(std::chrono::seconds(1));   
-	mImageBuf.resize(total_pixels);
-	for (int i = 0; i < reg_height; i++)
 	{
-		for (int j = 0; j < reg_width; j++)
+		std::lock_guard<std::mutex> lock(mImageBufMutex);
+
+		mImageBuf.resize(total_pixels);
+		for (int i = 0; i < reg_height; i++)
 		{
-			mImageBuf[i*reg_width+j] = (i*j) * pow(2, 14) / total_pixels;
+			for (int j = 0; j < reg_width; j++)
+			{
+				mImageBuf[i*reg_width+j] = (i*j) * pow(2, 14) / total_pixels;
+			}
 		}
+		mImageBufNCols = reg_width;
+		mImageBufNRows = reg_height;
+		mImageBufXBin = mState.xbin;
+		mImageBufYBin = mState.ybin;
+		mImageBufXStart = mState.use_window ? mState.window.x_start : 1;
+		mImageBufYStart = mState.use_window ? mState.window.y_start : 1;
+		mImageFrameSequence++;
+		publish_frame_ring(0,start_time);
+		add_frame_history(0,start_time,"");
 	}
+	mState.exposure_index++;
+	notify_exposure_waiters();
 	std::this_thread::sleep_for(std::chrono::seconds(1));
 	// We're done
 	cout << "Bias complete." << endl;
@@ -650,10 +1666,12 @@ void EmulatedCamera::bias_thread()
 	{
 		mState.exposure_in_progress = FALSE;
 		mState.exposure_state = ExposureState::IDLE;
+		notify_exposure_waiters();
 		return;
 	}
 	mState.exposure_in_progress = FALSE;
 	mState.exposure_state = ExposureState::IDLE;
+	notify_exposure_waiters();
 	cout << "bias complete" << endl;
 	LOG4CXX_INFO(logger,"bias complete");
 }
@@ -661,12 +1679,10 @@ void EmulatedCamera::bias_thread()
 /**
  * Thread to emulate the taking of a dark image.
  * <ul>
- * <li>We use mState.use_window to determine whether to are reading out a window or full frame,
- *     and based on that use either mState.window or mCameraConfig config values "ccd.ncols"/"ccd.nrows" 
- *     to calculate the image dimensions.
+ * <li>We call get_readout_dimensions to calculate the (windowed and binned) image dimensions.
  * <li>We compute the total number of pixels in the readout image using the data calculated.
  * <li>We intialise mState's exposure_length to the dark_thread exposure_length parameter.
- * <li>We initialise mAbort to false.
+ * <li>We initialise mAbort to false, and record the exposure start time (for the frame ring and frame history).
  * <li>We set mState's exposure_state to exposing, exposure_index to the for loops index, 
  *     elapsed_exposure_length to 0 and remaining_exposure_length to the exposure_length parameter.
  * <li>We enter a while loop, while mState's remaining_exposure_length is greater than 0 and mAbort is false:
@@ -679,6 +1695,11 @@ void EmulatedCamera::bias_thread()
  * <li>We set mState's exposure_state to readout, and sleep for a second to emulate the readout.
  * <li>We resize mImageBuf to the computed total number of pixels in the readout image.
  * <li>We loop over the image dimensions setting the pixel value in mImageBuf.
+ * <li>We record the binning in mImageBufXBin/mImageBufYBin, the window start in mImageBufXStart/mImageBufYStart,
+ *     increment mImageFrameSequence,
+ *     call publish_frame_ring to publish the emulated image into the shared memory frame ring,
+ *     and call add_frame_history to add it to the frame history.
+ * <li>We increment mState's exposure_index.
  * <li>We sleep for another second.
  * <li>We check whether mAbort is set true, and if so reset mState's exposure_state to idle and exit the thread.
  * <li>We reset mState's exposure_state to idle.
@@ -690,32 +1711,27 @@ void EmulatedCamera::bias_thread()
  * @see EmulatedCamera::mImageBuf
  * @see EmulatedCamera::mImageBufNCols
  * @see EmulatedCamera::mImageBufNRows
+ * @see EmulatedCamera::mImageFrameSequence
+ * @see EmulatedCamera::get_readout_dimensions
+ * @see EmulatedCamera::publish_frame_ring
+ * @see EmulatedCamera::add_frame_history
  */
 void EmulatedCamera::dark_thread(int32_t exposure_length)
 {
 	int reg_width;
 	int reg_height;
 	int total_pixels;
+	struct timespec start_time;
 
 	mState.exposure_in_progress = TRUE;
 	// setup image dimensions
-	if(mState.use_window)
-	{
-		reg_width = (mState.window.x_end - mState.window.x_start)+1;
-		reg_height = (mState.window.y_end - mState.window.y_start)+1; 	
-	}
-	else
-	{
-		mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,"ccd.ncols",&reg_width);
-		mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,"ccd.nrows",&reg_height);
-	}
-	mImageBufNCols = reg_width;
-	mImageBufNRows = reg_height;
+	get_readout_dimensions(&reg_width,&reg_height);
 	total_pixels = reg_width * reg_height;
  	cout << "dark thread with exposure length " << exposure_length << "ms." << endl;
 	LOG4CXX_INFO(logger,"dark thread with  exposure length " << exposure_length << "ms.");
 	mState.exposure_length = exposure_length;
 	mAbort = false;
+	clock_gettime(CLOCK_REALTIME,&start_time);
 	mState.exposure_state = ExposureState::EXPOSING;
 	mState.elapsed_exposure_length = 0;
 	mState.remaining_exposure_length = exposure_length;
@@ -735,6 +1751,7 @@ void EmulatedCamera::dark_thread(int32_t exposure_length)
 	{
 		mState.exposure_in_progress = FALSE;
 		mState.exposure_state = ExposureState::IDLE;
+		notify_exposure_waiters();
 		return;
 	}
 	// Simulate the readout
@@ -742,14 +1759,29 @@ void EmulatedCamera::dark_thread(int32_t exposure_length)
 	LOG4CXX_INFO(logger,"Starting readout");
 	mState.exposure_state = ExposureState::READOUT;
 	std::this_thread::sleep_for(std::chrono::seconds(1));   
-	mImageBuf.resize(total_pixels);
-	for (int i = 0; i < reg_height; i++)
 	{
-		for (int j = 0; j < reg_width; j++)
+		std::lock_guard<std::mutex> lock(mImageBufMutex);
+
+		mImageBuf.resize(total_pixels);
+		for (int i = 0; i < reg_height; i++)
 		{
-			mImageBuf[i*reg_width+j] = (i*j) * pow(2, 14) / total_pixels;
+			for (int j = 0; j < reg_width; j++)
+			{
+				mImageBuf[i*reg_width+j] = (i*j) * pow(2, 14) / total_pixels;
+			}
 		}
+		mImageBufNCols = reg_width;
+		mImageBufNRows = reg_height;
+		mImageBufXBin = mState.xbin;
+		mImageBufYBin = mState.ybin;
+		mImageBufXStart = mState.use_window ? mState.window.x_start : 1;
+		mImageBufYStart = mState.use_window ? mState.window.y_start : 1;
+		mImageFrameSequence++;
+		publish_frame_ring(exposure_length,start_time);
+		add_frame_history(exposure_length,start_time,"");
 	}
+	mState.exposure_index++;
+	notify_exposure_waiters();
 	std::this_thread::sleep_for(std::chrono::seconds(1));
 	// We're done
 	cout << "Dark exposure complete." << endl;
@@ -758,11 +1790,835 @@ void EmulatedCamera::dark_thread(int32_t exposure_length)
 	{
 		mState.exposure_in_progress = FALSE;
 		mState.exposure_state = ExposureState::IDLE;
+		notify_exposure_waiters();
 		return;
 	}
 	mState.exposure_in_progress = FALSE;
 	mState.exposure_state = ExposureState::IDLE;
+	notify_exposure_waiters();
 	cout << "dark complete" << endl;
 	LOG4CXX_INFO(logger,"dark complete");
 }
 
+/**
+ * Thread to emulate the taking of a series of frames (a multbias, multdark or multrun). This is the acquisition stage
+ * of the emulated frame pipeline: as soon as frame N has been emulated it is handed to the processing stage
+ * (frame_processing_thread), which publishes it whilst this thread is already emulating frame N+1.
+ * <ul>
+ * <li>We intialise mState's exposure_length to the multrun_thread exposure_length parameter.
+ * <li>We initialise mState's exposure_index to 0, exposure_count to the exposure_count parameter, and duty_cycle,
+ *     frame_exposure_length and frame_readout_length to 0. mAbort has already been reset by the start_* method,
+ *     and is not reset here, so an abort before this thread started is honoured.
+ * <li>We record the start time of the series.
+ * <li>We loop over the number of frames to take, while mAbort is false:
+ *     <ul>
+ *     <li>We call get_readout_dimensions to calculate the (windowed and binned) image dimensions.
+ *     <li>We record the exposure start time. We set mState's exposure_state to exposing, 
+ *         elapsed_exposure_length to 0 and remaining_exposure_length to the exposure_length parameter.
+ *     <li>We enter a while loop, while mState's remaining_exposure_length is greater than 0 and mAbort is false,
+ *         sleeping for up to 1 second and updating mState's remaining_exposure_length and elapsed_exposure_length.
+ *     <li>We check whether mAbort is set true, and if so stop taking frames.
+ *     <li>We set mState's exposure_state to readout, and sleep for mReadoutLength milliseconds to emulate 
+ *         the readout.
+ *     <li>We fill in an EmulatedFrame with the image dimensions, binning, window start, exposure length, 
+ *         start time, and whether the shutter was open and the frame is to be saved, and loop over the image
+ *         dimensions setting the pixel values of it's image.
+ *     <li>We add the measured length of the emulated exposure (zero for a bias) and readout to the totals for the
+ *         series.
+ *     <li>We increment mState's exposure_index, and call hand_off_frame to hand the frame to the processing stage.
+ *         hand_off_frame only blocks if the processing stage has fallen more than a pipeline length behind.
+ *     <li>We update mState's duty_cycle, the measured exposure length of the frames emulated so far divided by the
+ *         time since the series was started, and the mean measured exposure and readout lengths per frame
+ *         (frame_exposure_length and frame_readout_length).
+ *     </ul>
+ * <li>We reset mState's exposure_state to idle.
+ * <li>We log the measured duty cycle, and mean exposure and readout lengths.
+ * <li>We reset mState's exposure_in_progress to FALSE and wake any clients blocked in wait_for_exposure, whilst
+ *     holding mExposureMutex. The exposure is still reported as in progress until the processing stage has
+ *     processed all the series' frames (mFramesPendingCount is zero).
+ * </ul>
+ * @param exposure_count The number of frames to take. Should be at least 1.
+ * @param exposure_length The length of each exposure in milliseconds. Zero for biases.
+ * @param open_shutter A boolean, true for a multrun and false for a multbias / multdark. Only saved frames taken
+ *        with the shutter open are reduced.
+ * @param save_images A boolean, whether to save the taken images to disc (if "emulation.data_dir" is configured).
+ * @see EmulatedCamera::EmulatedFrame
+ * @see EmulatedCamera::mState
+ * @see EmulatedCamera::mAbort
+ * @see EmulatedCamera::mReadoutLength
+ * @see EmulatedCamera::get_readout_dimensions
+ * @see EmulatedCamera::hand_off_frame
+ * @see EmulatedCamera::frame_processing_thread
+ * @see EmulatedCamera::mFramesPendingCount
+ * @see EmulatedCamera::mExposureMutex
+ * @see EmulatedCamera::mExposureCondition
+ */
+void EmulatedCamera::multrun_thread(int32_t exposure_count,int32_t exposure_length,bool open_shutter,
+				    bool save_images)
+{
+	std::chrono::steady_clock::time_point multrun_start_time,phase_start_time;
+	EmulatedFrame frame;
+	double elapsed_length,total_exposure_length,total_readout_length;
+	int reg_width;
+	int reg_height;
+	int total_pixels;
+
+	mState.exposure_in_progress = TRUE;
+ 	cout << "multrun thread with exposure count " << exposure_count << " and exposure length " <<
+		exposure_length << "ms." << endl;
+	LOG4CXX_INFO(logger,"multrun thread with exposure count " << exposure_count << " and exposure length " <<
+		     exposure_length << "ms.");
+	mState.exposure_length = exposure_length;
+	mState.exposure_index = 0;
+	mState.exposure_count = exposure_count;
+	mState.duty_cycle = 0.0;
+	mState.frame_exposure_length = 0.0;
+	mState.frame_readout_length = 0.0;
+	total_exposure_length = 0.0;
+	total_readout_length = 0.0;
+	multrun_start_time = std::chrono::steady_clock::now();
+	while((mState.exposure_index < exposure_count) && (mAbort == false))
+	{
+		// setup image dimensions
+		get_readout_dimensions(&reg_width,&reg_height);
+		total_pixels = reg_width * reg_height;
+		clock_gettime(CLOCK_REALTIME,&(frame.mStartTime));
+		mState.exposure_state = ExposureState::EXPOSING;
+		mState.elapsed_exposure_length = 0;
+		mState.remaining_exposure_length = exposure_length;
+		cout << "Starting frame " << (mState.exposure_index+1) << " of " << exposure_count << "." << endl;
+		LOG4CXX_INFO(logger,"Starting frame " << (mState.exposure_index+1) << " of " << exposure_count << ".");
+		// Simulate the exposure
+		phase_start_time = std::chrono::steady_clock::now();
+		while ( (mState.remaining_exposure_length > 0) && (mAbort == false))
+		{
+			// sleep for up to 1 second
+			std::this_thread::sleep_for(std::chrono::milliseconds(std::min(mState.remaining_exposure_length,
+										       1000)));
+			// reduce remaining exposure length by up to 1000 ms
+			mState.elapsed_exposure_length += std::min(mState.remaining_exposure_length,1000);
+			mState.remaining_exposure_length -= std::min(mState.remaining_exposure_length,1000);
+		}
+		if(mAbort)
+			break;
+		if(exposure_length > 0)
+		{
+			total_exposure_length += std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-
+											  phase_start_time).count();
+		}
+		// Simulate the readout
+		mState.exposure_state = ExposureState::READOUT;
+		phase_start_time = std::chrono::steady_clock::now();
+		std::this_thread::sleep_for(std::chrono::milliseconds(mReadoutLength));
+		frame.mImageBuf.resize(total_pixels);
+		for (int i = 0; i < reg_height; i++)
+		{
+			for (int j = 0; j < reg_width; j++)
+			{
+				frame.mImageBuf[i*reg_width+j] = (i*j) * pow(2, 14) / total_pixels;
+			}
+		}
+		frame.mNCols = reg_width;
+		frame.mNRows = reg_height;
+		frame.mXBin = mState.xbin;
+		frame.mYBin = mState.ybin;
+		frame.mXStart = mState.use_window ? mState.window.x_start : 1;
+		frame.mYStart = mState.use_window ? mState.window.y_start : 1;
+		frame.mExposureLength = exposure_length;
+		frame.mOpenShutter = open_shutter;
+		frame.mSaveImage = save_images;
+		total_readout_length += std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-
+										 phase_start_time).count();
+		// hand the frame to the processing stage, and go straight on to the next frame
+		mState.exposure_index++;
+		hand_off_frame(frame);
+		elapsed_length = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-
+									 multrun_start_time).count();
+		if(elapsed_length > 0.0)
+			mState.duty_cycle = total_exposure_length/elapsed_length;
+		mState.frame_exposure_length = total_exposure_length/((double)mState.exposure_index);
+		mState.frame_readout_length = total_readout_length/((double)mState.exposure_index);
+	}/* end while on exposure_index */
+	mState.exposure_state = ExposureState::IDLE;
+	cout << "multrun complete after " << mState.exposure_index << " frames with a duty cycle of " <<
+		(mState.duty_cycle*100.0) << "%, a mean exposure length of " << mState.frame_exposure_length <<
+		" ms and a mean readout length of " << mState.frame_readout_length << " ms." << endl;
+	LOG4CXX_INFO(logger,"multrun complete after " << mState.exposure_index << " frames with a duty cycle of " <<
+		     (mState.duty_cycle*100.0) << "%, a mean exposure length of " << mState.frame_exposure_length <<
+		     " ms and a mean readout length of " << mState.frame_readout_length << " ms.");
+	// notify whilst holding the mutex, so the destructor cannot see the series has finished until we are done
+	{
+		std::lock_guard<std::mutex> lock(mExposureMutex);
+
+		mState.exposure_in_progress = FALSE;
+		mExposureCondition.notify_all();
+	}
+}
+
+/**
+ * Load the master calibration frames saved emulated multrun frames are reduced with, as the camera server does
+ * (Camera::initialize_reduction).
+ * <ul>
+ * <li>We stop any previously started processing stage using stop_frame_pipeline (initialize may be called more than
+ *     once), as it uses the calibration frames and reduced image buffer pool.
+ * <li>We retrieve the optional "reduction.enable" boolean from the config file. If it is not present, reduction is
+ *     disabled and we return.
+ * <li>We retrieve the optional "reduction.thread_count" integer from the config file (defaulting to
+ *     FRAME_REDUCTION_DEFAULT_THREAD_COUNT).
+ * <li>We retrieve the "reduction.bias", "reduction.dark" and "reduction.flat" master frame filenames from the
+ *     config file, which are required when reduction is enabled.
+ * <li>We load the master frames into mFrameCalibration using frame_reduction_load_calibration. If they cannot be
+ *     loaded we throw a CameraException.
+ * <li>We start the reduction worker pool mReductionPool with that many threads.
+ * <li>We retrieve the optional "reduction.buffer_count" integer from the config file (defaulting to
+ *     DEFAULT_REDUCTION_BUFFER_COUNT, and forced to be at least one), and the full frame size "ccd.ncols" /
+ *     "ccd.nrows". We destroy any previously created reduced image buffer pool, and create mReducedBufferPool with
+ *     that many buffers, each large enough to hold a full frame reduced image. If the pool cannot be created we
+ *     throw a CameraException.
+ * </ul>
+ * @see #CONFIG_CAMERA_SECTION
+ * @see #DEFAULT_REDUCTION_BUFFER_COUNT
+ * @see #FRAME_REDUCTION_DEFAULT_THREAD_COUNT
+ * @see #FRAME_REDUCTION_POOL_BUFFER_LENGTH
+ * @see EmulatedCamera::mCameraConfig
+ * @see EmulatedCamera::mReductionEnabled
+ * @see EmulatedCamera::mReductionPool
+ * @see EmulatedCamera::mFrameCalibration
+ * @see EmulatedCamera::mReducedBufferPool
+ * @see EmulatedCamera::stop_frame_pipeline
+ * @see frame_reduction_load_calibration
+ * @see FrameReductionPool::start
+ * @see CCD_Setup_Buffer_Pool_Create
+ * @see CCD_Setup_Buffer_Pool_Destroy
+ * @see CCD_General_Error_To_String
+ */
+void EmulatedCamera::initialize_reduction()
+{
+	CameraException ce;
+	std::string error_message;
+	char bias_filename[256];
+	char dark_filename[256];
+	char flat_filename[256];
+	char error_buffer[1024];
+	int reduction_enable,thread_count,buffer_count,ncols,nrows;
+
+	stop_frame_pipeline();
+	try
+	{
+		mCameraConfig.get_config_boolean(CONFIG_CAMERA_SECTION,"reduction.enable",&reduction_enable);
+	}
+	catch(CameraException &e)
+	{
+		reduction_enable = FALSE;
+	}
+	mReductionEnabled = (reduction_enable == TRUE);
+	if(!mReductionEnabled)
+		return;
+	try
+	{
+		mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,"reduction.thread_count",&thread_count);
+	}
+	catch(CameraException &e)
+	{
+		thread_count = FRAME_REDUCTION_DEFAULT_THREAD_COUNT;
+	}
+	mCameraConfig.get_config_string(CONFIG_CAMERA_SECTION,"reduction.bias",bias_filename,256);
+	mCameraConfig.get_config_string(CONFIG_CAMERA_SECTION,"reduction.dark",dark_filename,256);
+	mCameraConfig.get_config_string(CONFIG_CAMERA_SECTION,"reduction.flat",flat_filename,256);
+	if(!frame_reduction_load_calibration(bias_filename,dark_filename,flat_filename,mFrameCalibration,
+					     error_message))
+	{
+		ce.message = "Failed to load the master calibration frames:"+error_message;
+		LOG4CXX_ERROR(logger,"initialize_reduction:" << ce.message);
+		throw ce;
+	}
+	mReductionPool.start(thread_count);
+	try
+	{
+		mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,"reduction.buffer_count",&buffer_count);
+	}
+	catch(CameraException &e)
+	{
+		buffer_count = DEFAULT_REDUCTION_BUFFER_COUNT;
+	}
+	buffer_count = std::max(buffer_count,1);
+	mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,"ccd.ncols",&ncols);
+	mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,"ccd.nrows",&nrows);
+	CCD_Setup_Buffer_Pool_Destroy(&mReducedBufferPool);
+	if(CCD_Setup_Buffer_Pool_Create(&mReducedBufferPool,buffer_count,
+					FRAME_REDUCTION_POOL_BUFFER_LENGTH(((size_t)ncols)*((size_t)nrows)),0) == FALSE)
+	{
+		CCD_General_Error_To_String(error_buffer);
+		ce.message = std::string("Failed to create the reduced image buffer pool:")+error_buffer;
+		LOG4CXX_ERROR(logger,"initialize_reduction:" << ce.message);
+		throw ce;
+	}
+	cout << "Reducing saved emulated frames using " << mReductionPool.get_thread_count() << " threads and " <<
+		buffer_count << " reduced image buffers, with master bias " << bias_filename << ", dark " <<
+		dark_filename << " (" << mFrameCalibration.mDarkExposureLength << " s) and flat " << flat_filename <<
+		"." << endl;
+	LOG4CXX_INFO(logger,"Reducing saved emulated frames using " << mReductionPool.get_thread_count() <<
+		     " threads and " << buffer_count << " reduced image buffers, with master bias " << bias_filename <<
+		     ", dark " << dark_filename << " (" << mFrameCalibration.mDarkExposureLength << " s) and flat " <<
+		     flat_filename << ".");
+}
+
+/**
+ * Start the processing stage of the emulated frame pipeline. As in the camera server, the acquisition stage
+ * (multrun_thread) hands each emulated frame to the processing stage (frame_processing_thread) through the 
+ * lock-free single-producer / single-consumer queue mFramePipeline, and starts emulating the next frame.
+ * <ul>
+ * <li>We retrieve the optional "frame_pipeline.length" integer from the config file (defaulting to
+ *     DEFAULT_FRAME_PIPELINE_LENGTH), the number of emulated frames that can be waiting to be processed before
+ *     the acquisition stage blocks.
+ * <li>We stop any previously started processing stage (initialize may be called more than once) using
+ *     stop_frame_pipeline.
+ * <li>We create mFramePipeline, and initialise the mFramePipelineFree / mFramePipelineFilled semaphores
+ *     used to block the stages when the queue is full / empty.
+ * <li>We start mFrameProcessingThread running frame_processing_thread.
+ * </ul>
+ * If the pipeline length is illegal or a semaphore cannot be created a CameraException is thrown.
+ * @see #CONFIG_CAMERA_SECTION
+ * @see #DEFAULT_FRAME_PIPELINE_LENGTH
+ * @see EmulatedCamera::mCameraConfig
+ * @see EmulatedCamera::mFramePipeline
+ * @see EmulatedCamera::mFramePipelineFree
+ * @see EmulatedCamera::mFramePipelineFilled
+ * @see EmulatedCamera::mFramePipelineStopping
+ * @see EmulatedCamera::mFramesPendingCount
+ * @see EmulatedCamera::mFrameProcessingThread
+ * @see EmulatedCamera::stop_frame_pipeline
+ * @see EmulatedCamera::frame_processing_thread
+ * @see CameraConfig::get_config_int
+ */
+void EmulatedCamera::initialize_frame_pipeline()
+{
+	CameraException ce;
+	int pipeline_length;
+
+	try
+	{
+		mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,"frame_pipeline.length",&pipeline_length);
+	}
+	catch(CameraException &e)
+	{
+		pipeline_length = DEFAULT_FRAME_PIPELINE_LENGTH;
+	}
+	if(pipeline_length < 1)
+	{
+		ce.message = "Illegal frame_pipeline.length (" + std::to_string(pipeline_length) + ").";
+		LOG4CXX_ERROR(logger,"initialize_frame_pipeline:" << ce.message);
+		throw ce;
+	}
+	stop_frame_pipeline();
+	mFramePipeline.reset(new SpscQueue<EmulatedFrame>(pipeline_length));
+	if(sem_init(&mFramePipelineFree,0,pipeline_length) != 0)
+	{
+		ce.message = std::string("Failed to create frame pipeline semaphore:") + strerror(errno);
+		LOG4CXX_ERROR(logger,"initialize_frame_pipeline:" << ce.message);
+		throw ce;
+	}
+	if(sem_init(&mFramePipelineFilled,0,0) != 0)
+	{
+		ce.message = std::string("Failed to create frame pipeline semaphore:") + strerror(errno);
+		LOG4CXX_ERROR(logger,"initialize_frame_pipeline:" << ce.message);
+		sem_destroy(&mFramePipelineFree);
+		throw ce;
+	}
+	mFramePipelineStopping = false;
+	mFramesPendingCount = 0;
+	mFrameProcessingThread = std::thread(&EmulatedCamera::frame_processing_thread,this);
+	cout << "Processing emulated frames on a separate thread, with up to " << pipeline_length <<
+		" frames waiting to be processed." << endl;
+	LOG4CXX_INFO(logger,"Processing emulated frames on a separate thread, with up to " << pipeline_length <<
+		     " frames waiting to be processed.");
+}
+
+/**
+ * Stop the processing stage of the emulated frame pipeline, if it has been started. This must only be called when
+ * no multbias/multdark/multrun thread is running.
+ * <ul>
+ * <li>We set mFramePipelineStopping, and post mFramePipelineFilled to wake frame_processing_thread.
+ *     It processes any frames left in mFramePipeline before exiting.
+ * <li>We join mFrameProcessingThread.
+ * <li>We destroy the semaphores and mFramePipeline.
+ * </ul>
+ * @see EmulatedCamera::mFramePipeline
+ * @see EmulatedCamera::mFramePipelineFree
+ * @see EmulatedCamera::mFramePipelineFilled
+ * @see EmulatedCamera::mFramePipelineStopping
+ * @see EmulatedCamera::mFrameProcessingThread
+ * @see EmulatedCamera::frame_processing_thread
+ */
+void EmulatedCamera::stop_frame_pipeline()
+{
+	if(!mFrameProcessingThread.joinable())
+		return;
+	mFramePipelineStopping = true;
+	sem_post(&mFramePipelineFilled);
+	mFrameProcessingThread.join();
+	sem_destroy(&mFramePipelineFree);
+	sem_destroy(&mFramePipelineFilled);
+	mFramePipeline.reset();
+}
+
+/**
+ * Hand an emulated frame from the acquisition stage (multrun_thread) to the processing
+ * stage (frame_processing_thread).
+ * <ul>
+ * <li>We increment mFramesPendingCount.
+ * <li>We wait on mFramePipelineFree for a free slot in mFramePipeline. This only blocks if the processing
+ *     stage has fallen behind.
+ * <li>We push the frame onto mFramePipeline (moving the image into the queue), and post mFramePipelineFilled to 
+ *     wake the processing stage.
+ * </ul>
+ * @param frame The emulated frame. It's image is moved into the queue.
+ * @see EmulatedCamera::EmulatedFrame
+ * @see EmulatedCamera::mFramePipeline
+ * @see EmulatedCamera::mFramePipelineFree
+ * @see EmulatedCamera::mFramePipelineFilled
+ * @see EmulatedCamera::mFramesPendingCount
+ */
+void EmulatedCamera::hand_off_frame(EmulatedFrame &frame)
+{
+	mFramesPendingCount++;
+	while((sem_wait(&mFramePipelineFree) != 0)&&(errno == EINTR))
+		;
+	/* we own a free slot, so this cannot fail */
+	mFramePipeline->try_push(frame);
+	sem_post(&mFramePipelineFilled);
+}
+
+/**
+ * The processing stage of the emulated frame pipeline, run as a separate thread (mFrameProcessingThread) started by
+ * initialize_frame_pipeline. It processes the frames handed off by multrun_thread, in the order they were emulated.
+ * <ul>
+ * <li>We wait on mFramePipelineFilled for a frame, and pop it off mFramePipeline, posting mFramePipelineFree to 
+ *     free it's slot. If the queue is empty and mFramePipelineStopping is set, we exit.
+ * <li>We sleep for mProcessingLength milliseconds, to emulate processing the frame.
+ * <li>If the frame is to be saved and mDataDirectory is set, we call save_frame to save it (and it's reduced frame)
+ *     under the frame id it will be published with.
+ * <li>We lock mImageBufMutex, move the frame's image into mImageBuf, and record it's dimensions, binning and
+ *     window start. We increment mImageFrameSequence, call publish_frame_ring to publish the emulated image
+ *     into the shared memory frame ring, and call add_frame_history to add it (and it's filename) to the
+ *     frame history.
+ * <li>We decrement mFramesPendingCount, and call notify_exposure_waiters to wake any clients blocked in
+ *     wait_for_exposure.
+ * </ul>
+ * @see EmulatedCamera::EmulatedFrame
+ * @see EmulatedCamera::mFramePipeline
+ * @see EmulatedCamera::mFramePipelineFree
+ * @see EmulatedCamera::mFramePipelineFilled
+ * @see EmulatedCamera::mFramePipelineStopping
+ * @see EmulatedCamera::mFramesPendingCount
+ * @see EmulatedCamera::mProcessingLength
+ * @see EmulatedCamera::mDataDirectory
+ * @see EmulatedCamera::save_frame
+ * @see EmulatedCamera::mImageBuf
+ * @see EmulatedCamera::mImageBufMutex
+ * @see EmulatedCamera::mImageFrameSequence
+ * @see EmulatedCamera::publish_frame_ring
+ * @see EmulatedCamera::add_frame_history
+ * @see EmulatedCamera::notify_exposure_waiters
+ */
+void EmulatedCamera::frame_processing_thread()
+{
+	EmulatedFrame frame;
+	std::string filename;
+
+	while(true)
+	{
+		while((sem_wait(&mFramePipelineFilled) != 0)&&(errno == EINTR))
+			;
+		if(!mFramePipeline->try_pop(frame))
+		{
+			/* woken by stop_frame_pipeline, with no frames left to process */
+			if(mFramePipelineStopping)
+				break;
+			continue;
+		}
+		sem_post(&mFramePipelineFree);
+		std::this_thread::sleep_for(std::chrono::milliseconds(mProcessingLength));
+		/* no expose/bias/dark thread runs during a multrun, so the frame will be published with the next id */
+		filename = "";
+		if(frame.mSaveImage&&(mDataDirectory.empty() == false))
+			filename = save_frame(frame,mImageFrameSequence+1);
+		{
+			std::lock_guard<std::mutex> lock(mImageBufMutex);
+
+			mImageBuf.swap(frame.mImageBuf);
+			mImageBufNCols = frame.mNCols;
+			mImageBufNRows = frame.mNRows;
+			mImageBufXBin = frame.mXBin;
+			mImageBufYBin = frame.mYBin;
+			mImageBufXStart = frame.mXStart;
+			mImageBufYStart = frame.mYStart;
+			mImageFrameSequence++;
+			publish_frame_ring(frame.mExposureLength,frame.mStartTime);
+			add_frame_history(frame.mExposureLength,frame.mStartTime,filename);
+		}
+		mFramesPendingCount--;
+		/* wake any clients blocked in wait_for_exposure */
+		notify_exposure_waiters();
+	}
+}
+
+/**
+ * Save an emulated frame to a FITS image in mDataDirectory, as the camera server's FITS writer queue does, and if
+ * reduction is enabled and the shutter was open, reduce it and save the reduced frame alongside it.
+ * <ul>
+ * <li>We create a FITS header containing the EXPOSURE and EXPTIME of the frame in seconds (the reduction uses
+ *     EXPOSURE to scale the master dark, as ReductionController.reduce_ccd_image does).
+ * <li>The filename is EMULATION_FILENAME_PREFIX followed by the frame id, in mDataDirectory.
+ * <li>We save the frame with the CCD library's native FITS writer, CCD_Fits_Writer_Save.
+ * <li>If mReductionEnabled is set and the frame's shutter was open, we call save_reduced_frame.
+ * <li>We record the filename in mLastImageFilename (whilst holding mLastImageFilenameMutex).
+ * </ul>
+ * A failure to save is logged, but not thrown, as this is called from the processing stage (or expose_thread).
+ * @param frame The emulated frame to save.
+ * @param frame_id The id the frame will be published with.
+ * @return The filename the frame was saved to, or an empty string if it could not be saved.
+ * @see #EMULATION_FILENAME_PREFIX
+ * @see EmulatedCamera::mDataDirectory
+ * @see EmulatedCamera::mReductionEnabled
+ * @see EmulatedCamera::mLastImageFilename
+ * @see EmulatedCamera::mLastImageFilenameMutex
+ * @see EmulatedCamera::save_reduced_frame
+ * @see CCD_Fits_Header_Add_Float
+ * @see CCD_Fits_Writer_Save
+ */
+std::string EmulatedCamera::save_frame(EmulatedFrame &frame,int64_t frame_id)
+{
+	struct Fits_Header_Struct fits_header;
+	std::string filename;
+	char error_buffer[1024];
+	double exposure_length;
+	int retval;
+
+	exposure_length = ((double)frame.mExposureLength)/((double)CCD_GENERAL_ONE_SECOND_MS);
+	CCD_Fits_Header_Initialise(&fits_header);
+	retval = CCD_Fits_Header_Add_Float(&fits_header,"EXPOSURE",exposure_length,"Exposure length in seconds");
+	if(retval == TRUE)
+		retval = CCD_Fits_Header_Add_Float(&fits_header,"EXPTIME",exposure_length,"Exposure length in seconds");
+	filename = mDataDirectory+"/"+EMULATION_FILENAME_PREFIX+std::to_string(frame_id)+".fits";
+	if(retval == TRUE)
+	{
+		retval = CCD_Fits_Writer_Save((char*)(filename.c_str()),(void*)(frame.mImageBuf.data()),
+					      frame.mImageBuf.size(),frame.mNCols,frame.mNRows,fits_header,NULL);
+	}
+	if(retval == FALSE)
+	{
+		CCD_General_Error_To_String(error_buffer);
+		cerr << "save_frame:Failed to save frame " << frame_id << " to " << filename << ":" << error_buffer <<
+			endl;
+		LOG4CXX_ERROR(logger,"save_frame:Failed to save frame " << frame_id << " to " << filename << ":" <<
+			      error_buffer);
+		CCD_Fits_Header_Free(&fits_header);
+		return "";
+	}
+	if(mReductionEnabled&&frame.mOpenShutter)
+		save_reduced_frame(frame,filename,fits_header);
+	CCD_Fits_Header_Free(&fits_header);
+	{
+		std::lock_guard<std::mutex> lock(mLastImageFilenameMutex);
+
+		mLastImageFilename = filename;
+	}
+	return filename;
+}
+
+/**
+ * Reduce a saved emulated frame with the master calibration frames, and save the reduced frame alongside it, as the
+ * camera server's processing stage and FITS writer queue do.
+ * <ul>
+ * <li>We get a buffer to reduce the frame into from allocate_reduced_image.
+ * <li>We reduce the frame using frame_reduction_apply.
+ * <li>We copy the raw frame's FITS headers, and add the reduction FITS headers using 
+ *     frame_reduction_add_fits_headers.
+ * <li>We save the reduced frame using frame_reduction_save, to filename with FRAME_REDUCTION_FILENAME_SUFFIX in
+ *     place of it's '.fits' extension, removing any reduced frame of that name saved by an earlier run.
+ * </ul>
+ * A failure is logged, but not thrown, as this is called from the processing stage.
+ * @param frame The emulated frame to reduce.
+ * @param filename The filename the raw frame was saved to.
+ * @param fits_header The raw frame's FITS headers.
+ * @see #FRAME_REDUCTION_FILENAME_SUFFIX
+ * @see EmulatedCamera::allocate_reduced_image
+ * @see EmulatedCamera::mFrameCalibration
+ * @see EmulatedCamera::mReductionPool
+ * @see frame_reduction_apply
+ * @see frame_reduction_add_fits_headers
+ * @see frame_reduction_save
+ * @see CCD_Fits_Header_Copy
+ */
+void EmulatedCamera::save_reduced_frame(EmulatedFrame &frame,const std::string &filename,
+					struct Fits_Header_Struct fits_header)
+{
+	struct Fits_Header_Struct reduced_fits_header;
+	std::shared_ptr<float[]> reduced_image;
+	std::string reduced_filename,error_message;
+	std::string::size_type extension_index;
+	char error_buffer[1024];
+	bool retval;
+
+	reduced_image = allocate_reduced_image(((size_t)frame.mNCols)*((size_t)frame.mNRows));
+	reduced_filename = filename;
+	extension_index = reduced_filename.rfind(".fits");
+	if(extension_index != std::string::npos)
+		reduced_filename.erase(extension_index);
+	reduced_filename += FRAME_REDUCTION_FILENAME_SUFFIX;
+	/* emulated frame ids restart each time the emulator is started, and CFITSIO will not overwrite a file */
+	remove(reduced_filename.c_str());
+	CCD_Fits_Header_Initialise(&reduced_fits_header);
+	retval = frame_reduction_apply(frame.mImageBuf.data(),frame.mNCols,frame.mNRows,
+				       ((double)frame.mExposureLength)/((double)CCD_GENERAL_ONE_SECOND_MS),
+				       mFrameCalibration,mReductionPool,reduced_image.get(),error_message);
+	if(retval)
+	{
+		if(CCD_Fits_Header_Copy(&reduced_fits_header,fits_header) == FALSE)
+		{
+			CCD_General_Error_To_String(error_buffer);
+			error_message = error_buffer;
+			retval = false;
+		}
+	}
+	if(retval)
+		retval = frame_reduction_add_fits_headers(&reduced_fits_header,mFrameCalibration,error_message);
+	if(retval)
+	{
+		retval = frame_reduction_save(reduced_filename.c_str(),reduced_image.get(),frame.mNCols,frame.mNRows,
+					      reduced_fits_header,error_message);
+	}
+	CCD_Fits_Header_Free(&reduced_fits_header);
+	if(!retval)
+	{
+		cerr << "save_reduced_frame:Failed to save the reduced frame " << reduced_filename << ":" <<
+			error_message << endl;
+		LOG4CXX_ERROR(logger,"save_reduced_frame:Failed to save the reduced frame " << reduced_filename <<
+			      ":" << error_message);
+	}
+}
+
+/**
+ * Get a buffer to reduce an emulated frame into, preferably out of the reduced image buffer pool, as the camera
+ * server does (Camera::allocate_reduced_image).
+ * <ul>
+ * <li>We try to take a buffer out of mReducedBufferPool using frame_reduction_buffer_get. The buffer is returned to
+ *     the pool when the last reference to it is released.
+ * <li>Otherwise (all the buffers are in use, or the frame is too large) we allocate a new buffer, and increment
+ *     mReducedImageAllocationCount.
+ * </ul>
+ * @param pixel_count The number of pixels in the reduced frame.
+ * @return A new reduced image buffer, of at least pixel_count floats.
+ * @see EmulatedCamera::mReducedBufferPool
+ * @see EmulatedCamera::mReducedImageAllocationCount
+ * @see frame_reduction_buffer_get
+ */
+std::shared_ptr<float[]> EmulatedCamera::allocate_reduced_image(size_t pixel_count)
+{
+	std::shared_ptr<float[]> reduced_image;
+
+	reduced_image = frame_reduction_buffer_get(&mReducedBufferPool,pixel_count);
+	if(reduced_image != nullptr)
+		return reduced_image;
+	mReducedImageAllocationCount++;
+	LOG4CXX_WARN(logger,"allocate_reduced_image:Reduced image buffer pool exhausted, allocating reduced image " << 
+		     mReducedImageAllocationCount << " outside the pool.");
+	reduced_image.reset(new float[pixel_count]);
+	return reduced_image;
+}
+
+/**
+ * Wake any clients blocked in wait_for_exposure. This is called by the emulation threads each time they 
+ * emulate reading out a frame, and when they finish.
+ * @see EmulatedCamera::mExposureMutex
+ * @see EmulatedCamera::mExposureCondition
+ * @see EmulatedCamera::wait_for_exposure
+ */
+void EmulatedCamera::notify_exposure_waiters()
+{
+	{
+		std::lock_guard<std::mutex> lock(mExposureMutex);
+	}
+	mExposureCondition.notify_all();
+}
+
+/**
+ * Create the POSIX shared memory frame ring, that emulated frames are published into. This allows
+ * co-located frame ring consumers to be tested without a camera.
+ * <ul>
+ * <li>We retrieve the "frame_ring.enable" boolean from the config file. If it is not present we treat the
+ *     frame ring as disabled.
+ * <li>If the frame ring is enabled, we retrieve the shared memory segment name "frame_ring.name", the
+ *     number of frame slots "frame_ring.slot_count", and the full frame size "ccd.ncols" / "ccd.nrows"
+ *     from the config file.
+ * <li>We close any previously created frame ring, and call CCD_Frame_Ring_Create to create the ring.
+ * </ul>
+ * If CCD_Frame_Ring_Create fails we throw a CameraException containing the CCD library error.
+ * @see #CONFIG_CAMERA_SECTION
+ * @see EmulatedCamera::mCameraConfig
+ * @see EmulatedCamera::mFrameRingEnabled
+ * @see EmulatedCamera::mFrameRing
+ * @see CameraConfig::get_config_boolean
+ * @see CameraConfig::get_config_string
+ * @see CameraConfig::get_config_int
+ * @see CCD_Frame_Ring_Create
+ * @see CCD_Frame_Ring_Close
+ * @see CCD_General_Error_To_String
+ */
+void EmulatedCamera::initialize_frame_ring()
+{
+	CameraException ce;
+	char frame_ring_name[CCD_FRAME_RING_NAME_LENGTH];
+	char error_buffer[1024];
+	int frame_ring_enable,slot_count,ncols,nrows;
+
+	if(mFrameRingEnabled)
+	{
+		CCD_Frame_Ring_Close(&mFrameRing);
+		mFrameRingEnabled = false;
+	}
+	try
+	{
+		mCameraConfig.get_config_boolean(CONFIG_CAMERA_SECTION,"frame_ring.enable",&frame_ring_enable);
+	}
+	catch(CameraException &e)
+	{
+		frame_ring_enable = FALSE;
+	}
+	if(frame_ring_enable == FALSE)
+		return;
+	mCameraConfig.get_config_string(CONFIG_CAMERA_SECTION,"frame_ring.name",frame_ring_name,
+					CCD_FRAME_RING_NAME_LENGTH);
+	mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,"frame_ring.slot_count",&slot_count);
+	mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,"ccd.ncols",&ncols);
+	mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,"ccd.nrows",&nrows);
+	cout << "Creating shared memory frame ring " << frame_ring_name << " with " << slot_count << " slots." << endl;
+	LOG4CXX_INFO(logger,"Creating shared memory frame ring " << frame_ring_name << " with " << slot_count <<
+		     " slots.");
+	if(CCD_Frame_Ring_Create(&mFrameRing,frame_ring_name,slot_count,((size_t)ncols)*((size_t)nrows)) == FALSE)
+	{
+		CCD_General_Error_To_String(error_buffer);
+		ce.message = std::string(error_buffer);
+		LOG4CXX_ERROR(logger,"initialize_frame_ring:" << ce.message);
+		throw ce;
+	}
+	mFrameRingEnabled = true;
+}
+
+/**
+ * Calculate the dimensions of the emulated read out image, as the real camera would read it out.
+ * <ul>
+ * <li>If mState.use_window is true, the unbinned dimensions are those of the window in mState.window 
+ *     (the window positions are inclusive). Otherwise they are the full frame, from the mCameraConfig 
+ *     config values "ccd.ncols" / "ccd.nrows".
+ * <li>We divide the unbinned dimensions by the binning in mState.xbin / mState.ybin.
+ * </ul>
+ * @param ncols The address of an integer to store the number of binned columns in the read out image.
+ * @param nrows The address of an integer to store the number of binned rows in the read out image.
+ * @see #CONFIG_CAMERA_SECTION
+ * @see EmulatedCamera::mState
+ * @see EmulatedCamera::mCameraConfig
+ */
+void EmulatedCamera::get_readout_dimensions(int *ncols,int *nrows)
+{
+	if(mState.use_window)
+	{
+		(*ncols) = (mState.window.x_end - mState.window.x_start)+1;
+		(*nrows) = (mState.window.y_end - mState.window.y_start)+1;
+	}
+	else
+	{
+		mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,"ccd.ncols",ncols);
+		mCameraConfig.get_config_int(CONFIG_CAMERA_SECTION,"ccd.nrows",nrows);
+	}
+	(*ncols) /= mState.xbin;
+	(*nrows) /= mState.ybin;
+}
+
+/**
+ * Publish the emulated image in mImageBuf into the shared memory frame ring, if it is enabled.
+ * This should be called with mImageBufMutex held, after mImageFrameSequence has been incremented.
+ * A failure to publish is logged, but not thrown.
+ * @param exposure_length The exposure length of the emulated image in milliseconds.
+ * @param start_time When the emulated exposure started.
+ * @see EmulatedCamera::mFrameRingEnabled
+ * @see EmulatedCamera::mFrameRing
+ * @see EmulatedCamera::mImageBuf
+ * @see EmulatedCamera::mImageBufMutex
+ * @see EmulatedCamera::mImageFrameSequence
+ * @see CCD_Frame_Ring_Publish
+ */
+void EmulatedCamera::publish_frame_ring(int32_t exposure_length,struct timespec start_time)
+{
+	struct CCD_Frame_Ring_Frame_Struct frame;
+	char error_buffer[1024];
+
+	if(mFrameRingEnabled == false)
+		return;
+	frame.Sequence_Number = mImageFrameSequence;
+	frame.NCols = mImageBufNCols;
+	frame.NRows = mImageBufNRows;
+	frame.Bin_X = mImageBufXBin;
+	frame.Bin_Y = mImageBufYBin;
+	frame.Exposure_Length = exposure_length;
+	frame.Start_Time = start_time;
+	if(CCD_Frame_Ring_Publish(&mFrameRing,&frame,mImageBuf.data(),mImageBuf.size()) == FALSE)
+	{
+		CCD_General_Error_To_String(error_buffer);
+		cerr << "publish_frame_ring:Failed to publish frame " << frame.Sequence_Number << ":" <<
+			error_buffer << endl;
+		LOG4CXX_ERROR(logger,"publish_frame_ring:Failed to publish frame " << frame.Sequence_Number << ":" <<
+			      error_buffer);
+	}
+}
+
+/**
+ * Add a copy of the emulated image in mImageBuf to the frame history, removing the oldest frame
+ * if the history already holds mFrameHistoryLength frames.
+ * This should be called with mImageBufMutex held, after mImageFrameSequence has been incremented.
+ * @param exposure_length The exposure length of the emulated image in milliseconds.
+ * @param start_time When the emulated exposure started.
+ * @param filename The filename the emulated image was saved to, or an empty string if it was not saved.
+ * @see EmulatedCamera::mFrameHistory
+ * @see EmulatedCamera::mFrameHistoryLength
+ * @see EmulatedCamera::mImageBuf
+ * @see EmulatedCamera::mImageBufMutex
+ * @see EmulatedCamera::mImageFrameSequence
+ */
+void EmulatedCamera::add_frame_history(int32_t exposure_length,struct timespec start_time,
+					const std::string &filename)
+{
+	FrameHistoryEntry entry;
+
+	entry.mInfo.frame_id = mImageFrameSequence;
+	entry.mInfo.x_size = mImageBufNCols;
+	entry.mInfo.y_size = mImageBufNRows;
+	entry.mInfo.xbin = mImageBufXBin;
+	entry.mInfo.ybin = mImageBufYBin;
+	entry.mInfo.exposure_length = exposure_length;
+	entry.mInfo.start_time = (((int64_t)start_time.tv_sec)*CCD_GENERAL_ONE_SECOND_MS)+
+		(start_time.tv_nsec/CCD_GENERAL_ONE_MILLISECOND_NS);
+	entry.mInfo.filename = filename;
+	entry.mImageBuf = mImageBuf;
+	while(mFrameHistory.size() >= (size_t)mFrameHistoryLength)
+		mFrameHistory.pop_front();
+	mFrameHistory.push_back(std::move(entry));
+}
+
+/**
+ * Add the emulated CCD temperature and cooler status in mState to the temperature history, with the current time.
+ * The emulated CCD is always at it's target temperature.
+ * @see EmulatedCamera::mState
+ * @see EmulatedCamera::mTemperatureHistory
+ * @see TemperatureHistoryRing::add_sample
+ */
+void EmulatedCamera::add_temperature_history()
+{
+	struct timespec sample_time;
+
+	clock_gettime(CLOCK_REALTIME,&sample_time);
+	mTemperatureHistory.add_sample((((int64_t)sample_time.tv_sec)*CCD_GENERAL_ONE_SECOND_MS)+
+				       (sample_time.tv_nsec/CCD_GENERAL_ONE_MILLISECOND_NS),mState.ccd_temperature,
+				       mState.ccd_temperature,mState.cooler_status);
+}
@@ -7,9 +7,29 @@
 #ifndef EMULATED_CAMERA_H
 #define EMULATED_CAMERA_H
 #include "CameraService.h"
+#include "BlockingCallLimiter.h"
 #include "CameraConfig.h"
+#include "FrameReduction.h"
+#include "FrameStatistics.h"
+#include "ImageCodec.h"
+#include "ImagePreview.h"
+#include "ImageRegion.h"
+#include "SpscQueue.h"
+#include "TemperatureHistoryRing.h"
 #include <boost/program_options.hpp>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <set>
+#include <thread>
+#include <semaphore.h>
+#include <time.h>
 #include <log4cxx/logger.h>
+#include "ccd_fits_header.h"
+#include "ccd_frame_ring.h"
+#include "ccd_setup.h"
 
 using std::string;
 using std::vector;
@@ -35,17 +55,39 @@ class EmulatedCamera : virtual public CameraServiceIf
     void add_fits_header(const std::string & keyword, const FitsCardType::type valtype,const std::string & value,
 			 const std::string & comment);
     void clear_fits_headers();
+    int64_t create_fits_header_set(const std::vector<FitsHeaderCard> & fits_info);
+    void delete_fits_header_set(const int64_t header_set_id);
     
     // Take and process exposures
     void set_exposure_length(const int32_t exposure_length);
     void start_expose(const bool save_image);
+    void start_expose_with_header_set(const bool save_image,const int64_t header_set_id);
     void start_bias();
     void start_dark();
+    void start_multrun(const int32_t exposure_count,const int32_t exposure_length,const bool save_images);
+    void start_multbias(const int32_t exposure_count);
+    void start_multdark(const int32_t exposure_count,const int32_t exposure_length);
     void abort_exposure();
+    bool wait_for_exposure(const int32_t timeout_ms);
     
     // Return state and data
     void get_state(CameraState &state);
+    void get_temperature_history(TemperatureHistory &history,const int64_t since,
+				 const TemperatureResolution::type resolution);
     void get_image_data(ImageData& img_data);
+    void get_image_data_binary(ImageDataBinary& img_data);
+    void get_image_region(ImageRegion& region,const int32_t x0,const int32_t y0,const int32_t w,const int32_t h,
+			  const int32_t step);
+    void get_preview(Preview &preview,const int32_t max_width,const int32_t max_height,
+		     const PreviewStretch::type stretch,const PreviewDownsample::type downsample,
+		     const PreviewFormat::type format);
+    void get_image_statistics(ImageStatistics &statistics,const int64_t frame_id,const bool include_histogram);
+    void get_image_codecs(std::vector<ImageCodec::type> &codecs);
+    void get_image_data_compressed(CompressedImageData &compressed,const int64_t frame_id,
+				   const ImageCodec::type codec);
+    void list_frames(std::vector<FrameInfo> &frames);
+    void get_image_data_by_id(ImageDataBinary& img_data,const int64_t frame_id);
+    void get_exposure_timings(std::vector<ExposureTiming> &timings);
     void get_last_image_filename(std::string &filename);
     
     //Camera temperature control
@@ -53,10 +95,71 @@ class EmulatedCamera : virtual public CameraServiceIf
     void warm_up();
     
   private:
+    /**
+     * A frame held in the emulated frame history: it's description, and a copy of it's pixels.
+     */
+    struct FrameHistoryEntry
+    {
+	    /**
+	     * The description of the frame returned by list_frames.
+	     */
+	    FrameInfo mInfo;
+	    /**
+	     * A copy of the emulated image.
+	     */
+	    std::vector<uint16_t> mImageBuf;
+    };
+    /**
+     * A frame emulated by the acquisition stage (multrun_thread), and handed to the processing stage
+     * (frame_processing_thread) through mFramePipeline, or emulated and saved by expose_thread.
+     * <ul>
+     * <li><b>mImageBuf</b> The emulated image.
+     * <li><b>mNCols / mNRows</b> The (windowed and binned) dimensions of the image.
+     * <li><b>mXBin / mYBin</b> The binning in use when the frame was emulated.
+     * <li><b>mXStart / mYStart</b> The first detector column / row (unbinned, starting from 1) of the window in use
+     *     when the frame was emulated.
+     * <li><b>mExposureLength</b> The exposure length of the frame, in milliseconds.
+     * <li><b>mStartTime</b> When the emulated exposure started.
+     * <li><b>mOpenShutter</b> Whether the shutter was (emulated as) open, i.e. the frame is part of a multrun
+     *     rather than a multbias / multdark. Only open shutter frames are reduced.
+     * <li><b>mSaveImage</b> Whether the frame is saved to disc (if mDataDirectory is set).
+     * </ul>
+     */
+    struct EmulatedFrame
+    {
+	    std::vector<uint16_t> mImageBuf;
+	    int mNCols;
+	    int mNRows;
+	    int mXBin;
+	    int mYBin;
+	    int mXStart;
+	    int mYStart;
+	    int32_t mExposureLength;
+	    struct timespec mStartTime;
+	    bool mOpenShutter;
+	    bool mSaveImage;
+    };
+
     // Private methods
+    void check_blocking_call_slot(const BlockingCallSlot &slot,const char *method_name);
     void expose_thread(int32_t exposure_length, bool save_image);
     void bias_thread();
     void dark_thread(int32_t exposure_length);
+    void multrun_thread(int32_t exposure_count,int32_t exposure_length,bool open_shutter,bool save_images);
+    void initialize_reduction();
+    void initialize_frame_pipeline();
+    void stop_frame_pipeline();
+    void hand_off_frame(EmulatedFrame &frame);
+    void frame_processing_thread();
+    std::string save_frame(EmulatedFrame &frame,int64_t frame_id);
+    void save_reduced_frame(EmulatedFrame &frame,const std::string &filename,struct Fits_Header_Struct fits_header);
+    std::shared_ptr<float[]> allocate_reduced_image(size_t pixel_count);
+    void notify_exposure_waiters();
+    void get_readout_dimensions(int *ncols,int *nrows);
+    void initialize_frame_ring();
+    void publish_frame_ring(int32_t exposure_length,struct timespec start_time);
+    void add_frame_history(int32_t exposure_length,struct timespec start_time,const std::string &filename);
+    void add_temperature_history();
 
     // Private member vars
     /**
@@ -75,10 +178,36 @@ class EmulatedCamera : virtual public CameraServiceIf
      * A set of FITS headers used for emulation.
      */
     std::vector<FitsHeaderCard> mFitsHeader;
+    /**
+     * The ids of the emulated FITS header sets created by create_fits_header_set, and not yet deleted.
+     * @see EmulatedCamera::mFitsHeaderMutex
+     */
+    std::set<int64_t> mFitsHeaderSetIds;
+    /**
+     * The header set id to give the next emulated FITS header set created by create_fits_header_set.
+     */
+    int64_t mNextFitsHeaderSetId;
+    /**
+     * Mutex protecting mFitsHeaderSetIds and mNextFitsHeaderSetId.
+     */
+    std::mutex mFitsHeaderMutex;
+    /**
+     * The history of emulated CCD temperature samples, added to whenever the emulated temperature is set
+     * or the state is retrieved, and returned by get_temperature_history.
+     * @see EmulatedCamera::add_temperature_history
+     * @see EmulatedCamera::get_temperature_history
+     * @see TemperatureHistoryRing
+     */
+    TemperatureHistoryRing mTemperatureHistory;
+    /**
+     * Mutex protecting mImageBuf and it's associated dimensions / binning / frame sequence number,
+     * as the emulation threads fill it whilst clients may be retrieving it.
+     */
+    std::mutex mImageBufMutex;
     /**
      * An emulated image buffer, used to simulate CCD readouts.
      */
-    std::vector<int32_t> mImageBuf;
+    std::vector<uint16_t> mImageBuf;
     /**
      * A cached copy of the number of columns (x dimension) of data in the image buffer.
      */
@@ -88,14 +217,204 @@ class EmulatedCamera : virtual public CameraServiceIf
      */
     int mImageBufNRows;
     /**
-     * This is used to simulate aborting exposures. It is set to false at the start of a 
-     * multbias/multdark/multrun thread, and can be set using abort_exposure, 
+     * A cached copy of the horizontal binning in use when the image buffer was last filled.
+     */
+    int mImageBufXBin;
+    /**
+     * A cached copy of the vertical binning in use when the image buffer was last filled.
+     */
+    int mImageBufYBin;
+    /**
+     * The first detector column (unbinned, starting from 1) of the window in use when the image buffer was last
+     * filled.
+     */
+    int mImageBufXStart;
+    /**
+     * The first detector row (unbinned, starting from 1) of the window in use when the image buffer was last filled.
+     */
+    int mImageBufYStart;
+    /**
+     * A sequence number, incremented each time a new image is emulated into the image buffer.
+     * This is zero if no image has been read out yet. It is atomic as wait_for_exposure reads it without holding
+     * mImageBufMutex.
+     */
+    std::atomic<int64_t> mImageFrameSequence;
+    /**
+     * This is used to simulate aborting exposures. It is set to false when a multbias/multdark/multrun is started 
+     * (or at the start of an expose/bias/dark thread), and can be set using abort_exposure, 
      * which causes the multbias/multdark/multrun to terminate early.
      * @see EmulatedCamera::abort_exposure
-     * @see EmulatedCamera::multbias_thread
-     * @see EmulatedCamera::multdark_thread
      * @see EmulatedCamera::multrun_thread
      */
-    bool mAbort;
+    std::atomic<bool> mAbort;
+    /**
+     * Mutex used with mExposureCondition, to let wait_for_exposure block until an emulated frame
+     * is read out or the emulated exposure finishes.
+     * @see EmulatedCamera::wait_for_exposure
+     */
+    std::mutex mExposureMutex;
+    /**
+     * Condition variable signalled by notify_exposure_waiters, used to wake clients blocked in wait_for_exposure.
+     * @see EmulatedCamera::wait_for_exposure
+     * @see EmulatedCamera::notify_exposure_waiters
+     */
+    std::condition_variable mExposureCondition;
+    /**
+     * A boolean, true if emulated frames are also published into the POSIX shared memory frame ring mFrameRing.
+     * Set from the "frame_ring.enable" config keyword.
+     * @see EmulatedCamera::initialize_frame_ring
+     */
+    bool mFrameRingEnabled;
+    /**
+     * The handle of the shared memory frame ring emulated frames are published into, if mFrameRingEnabled is true.
+     * @see EmulatedCamera::initialize_frame_ring
+     * @see EmulatedCamera::publish_frame_ring
+     */
+    struct CCD_Frame_Ring_Struct mFrameRing;
+    /**
+     * The last mFrameHistoryLength emulated frames, oldest first, protected by mImageBufMutex.
+     * @see EmulatedCamera::add_frame_history
+     */
+    std::deque<FrameHistoryEntry> mFrameHistory;
+    /**
+     * The maximum number of frames kept in mFrameHistory. Set from the "frame_history.length" config keyword.
+     * @see EmulatedCamera::initialize
+     */
+    int mFrameHistoryLength;
+    /**
+     * The maximum length of time a wait_for_exposure call blocks, in milliseconds. 
+     * Set from the optional "wait_for_exposure.max_timeout" config keyword.
+     * @see EmulatedCamera::wait_for_exposure
+     */
+    int mWaitForExposureMaxTimeout;
+    /**
+     * Limits how many blocking calls (wait_for_exposure and the full frame image downloads) are in progress at once,
+     * as in the camera server. The limit is set from the optional "server.blocking_call_limit" config keyword.
+     * @see EmulatedCamera::check_blocking_call_slot
+     */
+    BlockingCallLimiter mBlockingCalls;
+    /**
+     * The length of time the emulated readout of a multbias/multdark/multrun frame takes, in milliseconds.
+     * Set from the optional "emulation.readout_length" config keyword.
+     * @see EmulatedCamera::multrun_thread
+     */
+    int mReadoutLength;
+    /**
+     * The length of time the processing stage takes to process each emulated multbias/multdark/multrun frame, 
+     * in milliseconds. Set from the optional "emulation.processing_length" config keyword.
+     * @see EmulatedCamera::frame_processing_thread
+     */
+    int mProcessingLength;
+    /**
+     * The queue of emulated frames handed from the acquisition stage (multrun_thread) to the processing stage
+     * (frame_processing_thread). It's capacity is set from the optional "frame_pipeline.length" config keyword.
+     * @see EmulatedCamera::initialize_frame_pipeline
+     * @see EmulatedCamera::hand_off_frame
+     */
+    std::unique_ptr<SpscQueue<EmulatedFrame>> mFramePipeline;
+    /**
+     * Semaphore counting the free slots in mFramePipeline. The acquisition stage waits on this before
+     * handing off a frame, so it blocks if the processing stage falls behind.
+     * @see EmulatedCamera::hand_off_frame
+     */
+    sem_t mFramePipelineFree;
+    /**
+     * Semaphore counting the frames in mFramePipeline. The processing stage waits on this for the next frame.
+     * @see EmulatedCamera::frame_processing_thread
+     */
+    sem_t mFramePipelineFilled;
+    /**
+     * Set by stop_frame_pipeline to tell the processing stage to exit once mFramePipeline is empty.
+     * @see EmulatedCamera::stop_frame_pipeline
+     */
+    std::atomic<bool> mFramePipelineStopping;
+    /**
+     * The number of emulated frames handed to the processing stage and not yet processed. The exposure is
+     * reported as in progress by get_state and wait_for_exposure whilst this is non-zero.
+     * @see EmulatedCamera::hand_off_frame
+     * @see EmulatedCamera::frame_processing_thread
+     */
+    std::atomic<int> mFramesPendingCount;
+    /**
+     * The processing stage thread, running frame_processing_thread.
+     * @see EmulatedCamera::initialize_frame_pipeline
+     * @see EmulatedCamera::stop_frame_pipeline
+     */
+    std::thread mFrameProcessingThread;
+    /**
+     * How get_image_data_compressed compresses emulated images. Set from the optional "image_codec.tile_rows",
+     * "image_codec.thread_count" and "image_codec.zstd_level" config keywords.
+     * @see EmulatedCamera::initialize
+     * @see ImageCodecConfig
+     */
+    ImageCodecConfig mImageCodecConfig;
+    /**
+     * The number of threads get_preview uses to downsample and stretch an emulated image. Set from the optional
+     * "preview.thread_count" config keyword.
+     * @see EmulatedCamera::initialize
+     * @see #IMAGE_PREVIEW_DEFAULT_THREAD_COUNT
+     */
+    int mPreviewThreadCount;
+    /**
+     * How get_image_statistics computes the statistics of an emulated image. Set from the optional
+     * "image_statistics.thread_count", "image_statistics.saturation_level" and "image_statistics.region.<n>.*"
+     * config keywords.
+     * @see EmulatedCamera::initialize
+     * @see FrameStatisticsConfig
+     */
+    FrameStatisticsConfig mFrameStatisticsConfig;
+    /**
+     * The directory the processing stage saves emulated multbias/multdark/multrun frames, and expose_thread saves
+     * emulated exposures, into as FITS images. Set from the optional "emulation.data_dir" config keyword.
+     * If it is empty, emulated frames are not saved.
+     * @see EmulatedCamera::save_frame
+     * @see EmulatedCamera::expose_thread
+     */
+    std::string mDataDirectory;
+    /**
+     * The filename of the last emulated frame saved (by the processing stage or expose_thread), returned by 
+     * get_last_image_filename.
+     * Protected by mLastImageFilenameMutex.
+     * @see EmulatedCamera::save_frame
+     * @see EmulatedCamera::get_last_image_filename
+     */
+    std::string mLastImageFilename;
+    /**
+     * Mutex protecting mLastImageFilename.
+     */
+    std::mutex mLastImageFilenameMutex;
+    /**
+     * Whether saved emulated multrun frames are reduced with the master calibration frames, as the camera server
+     * does. Set from the optional "reduction.enable" config keyword.
+     * @see EmulatedCamera::initialize_reduction
+     * @see EmulatedCamera::save_reduced_frame
+     */
+    bool mReductionEnabled;
+    /**
+     * The worker pool each frame's rows are split between when it is reduced, started in initialize_reduction
+     * with the number of threads in the optional "reduction.thread_count" config keyword.
+     * @see EmulatedCamera::initialize_reduction
+     * @see FrameReductionPool
+     * @see #FRAME_REDUCTION_DEFAULT_THREAD_COUNT
+     */
+    FrameReductionPool mReductionPool;
+    /**
+     * The master calibration frames emulated frames are reduced with, if mReductionEnabled is true.
+     * @see EmulatedCamera::initialize_reduction
+     * @see FrameCalibration
+     */
+    FrameCalibration mFrameCalibration;
+    /**
+     * The pool of buffers emulated frames are reduced into, as in the camera server. Each buffer holds a full
+     * frame reduced (float32) image.
+     * @see EmulatedCamera::initialize_reduction
+     * @see EmulatedCamera::allocate_reduced_image
+     */
+    struct CCD_Setup_Buffer_Pool_Struct mReducedBufferPool;
+    /**
+     * The number of reduced images allocated outside mReducedBufferPool, because all it's buffers were in use.
+     * @see EmulatedCamera::allocate_reduced_image
+     */
+    std::atomic<int64_t> mReducedImageAllocationCount;
 };    
 #endif
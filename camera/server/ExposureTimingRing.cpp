@@ -0,0 +1,147 @@
+/**
+ * @file
+ * @brief ExposureTimingRing.cpp implements a fixed memory ring of the timelines of the last few frames acquired,
+ *        returned to clients by get_exposure_timings.
+ * @author Chris Mottram
+ * @version $Id$
+ */
+#include "ExposureTimingRing.h"
+#include <algorithm>
+
+/* The thrift ExposureTimingPhase values index the CCD library's timeline phases */
+static_assert((int)ExposureTimingPhase::PUBLISHED == (int)CCD_EXPOSURE_TIMELINE_PUBLISHED,
+	      "ExposureTimingPhase does not match CCD_EXPOSURE_TIMELINE_PHASE.");
+static_assert(CCD_EXPOSURE_TIMELINE_PHASE_COUNT == CCD_EXPOSURE_TIMELINE_PUBLISHED+1,
+	      "ExposureTimingPhase does not match CCD_EXPOSURE_TIMELINE_PHASE.");
+
+/**
+ * Constructor for the exposure timing ring.
+ * @param length The number of frame timelines to keep.
+ * @see ExposureTimingRing::set_length
+ */
+ExposureTimingRing::ExposureTimingRing(size_t length)
+{
+	set_length(length);
+}
+
+/**
+ * Set the number of frame timelines kept. The ring is (re)allocated, and emptied.
+ * @param length The number of frame timelines to keep (at least 1).
+ * @see ExposureTimingRing::mMutex
+ * @see ExposureTimingRing::mEntries
+ */
+void ExposureTimingRing::set_length(size_t length)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mEntries.resize(std::max(length,(size_t)1));
+	mHead = 0;
+	mCount = 0;
+}
+
+/**
+ * Add a frame's timeline to the ring, overwriting the oldest timeline if it is full.
+ * @param frame_id The frame sequence number of the frame.
+ * @param exposure_length The exposure length of the frame, in milliseconds.
+ * @param start_time The start time of the exposure (CLOCK_REALTIME).
+ * @param timeline The time stamps of the phases of the frame's acquisition reached so far.
+ * @see ExposureTimingRing::mMutex
+ */
+void ExposureTimingRing::add_timeline(int64_t frame_id,int32_t exposure_length,struct timespec start_time,
+				      const struct CCD_Exposure_Timeline_Struct &timeline)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	struct Entry &entry = mEntries[mHead];
+
+	entry.mFrameId = frame_id;
+	entry.mExposureLength = exposure_length;
+	entry.mStartTime = start_time;
+	entry.mTimeline = timeline;
+	mHead = (mHead+1)%mEntries.size();
+	if(mCount < mEntries.size())
+		mCount++;
+}
+
+/**
+ * Merge the phases reached later in a frame's acquisition (e.g. by a FITS writer thread) into the frame's timeline.
+ * Each phase that has been time stamped in timeline is copied into the frame's timeline in the ring.
+ * We search from the newest timeline backwards, as the frame is almost always one of the last few added.
+ * If the frame is no longer in the ring nothing is done.
+ * @param frame_id The frame sequence number of the frame.
+ * @param timeline A timeline containing the phases to merge.
+ * @see ExposureTimingRing::mMutex
+ */
+void ExposureTimingRing::merge_timeline(int64_t frame_id,const struct CCD_Exposure_Timeline_Struct &timeline)
+{
+	size_t length,index,i;
+	int phase;
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	length = mEntries.size();
+	for(i = 0; i < mCount; i++)
+	{
+		index = (mHead+length-1-i)%length;
+		if(mEntries[index].mFrameId != frame_id)
+			continue;
+		for(phase = 0; phase < CCD_EXPOSURE_TIMELINE_PHASE_COUNT; phase++)
+		{
+			if((timeline.Phase_Time[phase].tv_sec != 0)||(timeline.Phase_Time[phase].tv_nsec != 0))
+				mEntries[index].mTimeline.Phase_Time[phase] = timeline.Phase_Time[phase];
+		}
+		return;
+	}
+}
+
+/**
+ * Get the timings of the frames in the ring.
+ * @param timings A vector, on return filled with an ExposureTiming for each frame in the ring, oldest first.
+ *        Each phase time is the offset in microseconds from the REQUEST phase, or -1 if the phase was not reached.
+ * @see ExposureTimingRing::mMutex
+ * @see ExposureTimingRing::get_phase_interval
+ */
+void ExposureTimingRing::get_timings(std::vector<ExposureTiming> &timings)
+{
+	ExposureTiming timing;
+	size_t length,i;
+	int phase;
+
+	timings.clear();
+	std::lock_guard<std::mutex> lock(mMutex);
+	length = mEntries.size();
+	timings.reserve(mCount);
+	for(i = 0; i < mCount; i++)
+	{
+		const struct Entry &entry = mEntries[(mHead+length-mCount+i)%length];
+
+		timing.frame_id = entry.mFrameId;
+		timing.exposure_length = entry.mExposureLength;
+		timing.start_time = (((int64_t)entry.mStartTime.tv_sec)*CCD_GENERAL_ONE_SECOND_MS)+
+			(entry.mStartTime.tv_nsec/CCD_GENERAL_ONE_MILLISECOND_NS);
+		timing.phase_times.resize(CCD_EXPOSURE_TIMELINE_PHASE_COUNT);
+		for(phase = 0; phase < CCD_EXPOSURE_TIMELINE_PHASE_COUNT; phase++)
+		{
+			timing.phase_times[phase] = get_phase_interval(entry.mTimeline,CCD_EXPOSURE_TIMELINE_REQUEST,
+								       (enum CCD_EXPOSURE_TIMELINE_PHASE)phase);
+		}
+		timings.push_back(timing);
+	}
+}
+
+/**
+ * Return the time between two phases of a timeline.
+ * @param timeline The timeline.
+ * @param from_phase The earlier phase.
+ * @param to_phase The later phase.
+ * @return The time between the phases in microseconds, or -1 if either phase was not reached.
+ */
+int64_t ExposureTimingRing::get_phase_interval(const struct CCD_Exposure_Timeline_Struct &timeline,
+					       enum CCD_EXPOSURE_TIMELINE_PHASE from_phase,
+					       enum CCD_EXPOSURE_TIMELINE_PHASE to_phase)
+{
+	const struct timespec &from_time = timeline.Phase_Time[from_phase];
+	const struct timespec &to_time = timeline.Phase_Time[to_phase];
+
+	if(((from_time.tv_sec == 0)&&(from_time.tv_nsec == 0))||((to_time.tv_sec == 0)&&(to_time.tv_nsec == 0)))
+		return -1;
+	return ((((int64_t)(to_time.tv_sec-from_time.tv_sec))*CCD_GENERAL_ONE_SECOND_NS)+
+		(to_time.tv_nsec-from_time.tv_nsec))/CCD_GENERAL_ONE_MICROSECOND_NS;
+}
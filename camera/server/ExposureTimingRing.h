@@ -0,0 +1,85 @@
+/**
+ * @file
+ * @brief ExposureTimingRing.h declares a fixed memory ring of the timelines of the last few frames acquired,
+ *        returned to clients by get_exposure_timings.
+ * @author Chris Mottram
+ * @version $Id$
+ */
+#ifndef EXPOSURETIMINGRING_H
+#define EXPOSURETIMINGRING_H
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include "CameraService.h"
+#include "ccd_exposure.h"
+
+/**
+ * The default number of frame timelines kept.
+ */
+#define EXPOSURE_TIMING_DEFAULT_LENGTH (100)
+
+/**
+ * A fixed memory ring of the timelines (CCD_Exposure_Timeline_Struct) of the last few frames acquired.
+ * A frame's timeline is added by the processing stage once the frame has been published (and, if it is to be saved,
+ * queued to the FITS writer), and the save / publish phases are merged in by the FITS writer threads once the
+ * image has been written. Once the ring is full, the oldest timeline is overwritten. All access is serialised by
+ * a mutex.
+ * @see CCD_Exposure_Timeline_Struct
+ * @see ExposureTiming
+ */
+class ExposureTimingRing
+{
+  public:
+	ExposureTimingRing(size_t length = EXPOSURE_TIMING_DEFAULT_LENGTH);
+	ExposureTimingRing(const ExposureTimingRing &) = delete;
+	ExposureTimingRing & operator=(const ExposureTimingRing &) = delete;
+	void set_length(size_t length);
+	void add_timeline(int64_t frame_id,int32_t exposure_length,struct timespec start_time,
+			  const struct CCD_Exposure_Timeline_Struct &timeline);
+	void merge_timeline(int64_t frame_id,const struct CCD_Exposure_Timeline_Struct &timeline);
+	void get_timings(std::vector<ExposureTiming> &timings);
+	static int64_t get_phase_interval(const struct CCD_Exposure_Timeline_Struct &timeline,
+					  enum CCD_EXPOSURE_TIMELINE_PHASE from_phase,
+					  enum CCD_EXPOSURE_TIMELINE_PHASE to_phase);
+  private:
+	/**
+	 * One frame's timeline.
+	 */
+	struct Entry
+	{
+		/**
+		 * The frame sequence number of the frame.
+		 */
+		int64_t mFrameId;
+		/**
+		 * The exposure length of the frame, in milliseconds.
+		 */
+		int32_t mExposureLength;
+		/**
+		 * The start time of the exposure (CLOCK_REALTIME).
+		 */
+		struct timespec mStartTime;
+		/**
+		 * The time stamps of the phases of the frame's acquisition (CLOCK_MONOTONIC).
+		 */
+		struct CCD_Exposure_Timeline_Struct mTimeline;
+	};
+	/**
+	 * The timelines, allocated to the ring's length by the constructor / set_length.
+	 */
+	std::vector<struct Entry> mEntries;
+	/**
+	 * The index in mEntries the next timeline is written to.
+	 */
+	size_t mHead;
+	/**
+	 * The number of timelines in the ring.
+	 */
+	size_t mCount;
+	/**
+	 * Mutex protecting the ring.
+	 */
+	std::mutex mMutex;
+};
+#endif
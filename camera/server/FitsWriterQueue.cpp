@@ -0,0 +1,469 @@
+/**
+ * @file
+ * @brief FitsWriterQueue.cpp implements a bounded queue of FITS image save jobs, written to disk by background writer
+ *        threads so the exposure threads do not wait for the disk.
+ * @author Chris Mottram
+ * @version $Id$
+ */
+#include "FitsWriterQueue.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include "log4cxx/logger.h"
+#include "FrameReduction.h"
+#include "ccd_exposure.h"
+#include "ccd_fits_filename.h"
+#include "ccd_fits_writer.h"
+#include "ccd_general.h"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+using namespace log4cxx;
+
+/**
+ * The length of the buffer used to retrieve CCD library error strings.
+ */
+#define FITS_WRITER_ERROR_BUFFER_LENGTH (1024)
+/**
+ * The suffix added to a job's filename to make the temporary filename the image is written to. The data
+ * transfer processes only pick up '.fits' files, so they ignore the temporary file.
+ */
+#define FITS_WRITER_TEMPORARY_SUFFIX    (".tmp")
+
+/**
+ * Logger instance for the FITS writer queue (FitsWriterQueue.cpp).
+ */
+static LoggerPtr logger(Logger::getLogger("mookodi.camera.server.FitsWriterQueue"));
+
+/**
+ * Constructor for a FITS image save job. The header snapshots are initialised to empty lists, and the timeline
+ * cleared.
+ * @see FitsWriterJob::mFitsHeader
+ * @see FitsWriterJob::mReducedFitsHeader
+ * @see FitsWriterJob::mTimeline
+ * @see CCD_Fits_Header_Initialise
+ * @see CCD_Exposure_Timeline_Clear
+ */
+FitsWriterJob::FitsWriterJob()
+{
+	mImageBufferLength = 0;
+	mNCols = 0;
+	mNRows = 0;
+	mFrameSequence = -1;
+	CCD_Fits_Header_Initialise(&mFitsHeader);
+	CCD_Fits_Header_Initialise(&mReducedFitsHeader);
+	CCD_Exposure_Timeline_Clear(&mTimeline);
+}
+
+/**
+ * Destructor for a FITS image save job. The header snapshots' card lists are freed, and the job's references to
+ * the image buffer and reduced image released.
+ * @see FitsWriterJob::mFitsHeader
+ * @see FitsWriterJob::mReducedFitsHeader
+ * @see CCD_Fits_Header_Free
+ */
+FitsWriterJob::~FitsWriterJob()
+{
+	CCD_Fits_Header_Free(&mFitsHeader);
+	CCD_Fits_Header_Free(&mReducedFitsHeader);
+	mImageBuf = nullptr;
+	mReducedImage = nullptr;
+}
+
+/**
+ * Constructor for the FITS writer queue. The queue is not usable until start has been called.
+ * @see FitsWriterQueue::start
+ */
+FitsWriterQueue::FitsWriterQueue()
+{
+	mQueueLength = 1;
+	mActiveCount = 0;
+	mWrittenCount = 0;
+	mFailedCount = 0;
+	mStopping = false;
+	mSyncPolicy = FITS_WRITER_SYNC_FILE;
+	mNativeWriter = false;
+}
+
+/**
+ * Destructor for the FITS writer queue. Any queued jobs are written before the writer threads are stopped.
+ * @see FitsWriterQueue::stop
+ */
+FitsWriterQueue::~FitsWriterQueue()
+{
+	stop();
+}
+
+/**
+ * Start the writer threads.
+ * @param queue_length The maximum number of jobs that can be queued before push blocks (at least 1).
+ * @param thread_count The number of writer threads to start (at least 1). CCD_Exposure_Save and
+ *        frame_reduction_save each use their own CFITSIO file pointer, but CFITSIO itself must have been built
+ *        reentrant for more than one thread to use them at once: Camera::initialize_fits_writer uses one thread
+ *        if it was not.
+ * @param sync_policy When the written images are flushed to disk.
+ * @param native_writer True to write images with CCD_Fits_Writer_Save, false to use CCD_Exposure_Save (CFITSIO).
+ * @param publish_callback The callback called after each image has been renamed into place.
+ * @see FitsWriterQueue::writer_thread
+ * @see FitsWriterQueue::mThreads
+ */
+void FitsWriterQueue::start(size_t queue_length,int thread_count,enum FitsWriterSyncPolicy sync_policy,
+			    bool native_writer,PublishCallback publish_callback)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	mQueueLength = std::max(queue_length,(size_t)1);
+	mSyncPolicy = sync_policy;
+	mNativeWriter = native_writer;
+	mPublishCallback = publish_callback;
+	mStopping = false;
+	for(int i = 0; i < std::max(thread_count,1); i++)
+		mThreads.push_back(std::thread(&FitsWriterQueue::writer_thread,this));
+	cout << "FITS writer queue started with " << mThreads.size() << " writer threads and a queue length of " <<
+		mQueueLength << "." << endl;
+	LOG4CXX_INFO(logger,"FITS writer queue started with " << mThreads.size() <<
+		     " writer threads and a queue length of " << mQueueLength << ".");
+}
+
+/**
+ * Stop the writer threads. Jobs already queued are written first. The queue can be restarted with start.
+ * @see FitsWriterQueue::mStopping
+ * @see FitsWriterQueue::mThreads
+ */
+void FitsWriterQueue::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+
+		mStopping = true;
+	}
+	mJobAvailable.notify_all();
+	for(std::thread &thrd : mThreads)
+	{
+		if(thrd.joinable())
+			thrd.join();
+	}
+	mThreads.clear();
+}
+
+/**
+ * Queue a FITS image save job (the queue must have been started). If the queue already holds mQueueLength jobs,
+ * we block until a writer thread takes one off the queue, so a camera producing images faster than the disk can
+ * write them is slowed down rather than queueing an unbounded number of image buffers.
+ * @param job The job to queue. The queue takes ownership of the job.
+ * @see FitsWriterQueue::mJobs
+ * @see FitsWriterQueue::mQueueLength
+ */
+void FitsWriterQueue::push(std::unique_ptr<FitsWriterJob> job)
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+
+	if(mJobs.size() >= mQueueLength)
+	{
+		LOG4CXX_WARN(logger,"push:FITS writer queue full (" << mJobs.size() << " jobs), waiting to queue " <<
+			     job->mFilename << ".");
+	}
+	mJobTaken.wait(lock,[this]{return mJobs.size() < mQueueLength;});
+	mJobs.push_back(std::move(job));
+	lock.unlock();
+	mJobAvailable.notify_one();
+}
+
+/**
+ * Wait until all queued jobs have been written (or failed), so every image saved so far has been published.
+ * @see FitsWriterQueue::mJobs
+ * @see FitsWriterQueue::mActiveCount
+ */
+void FitsWriterQueue::flush()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+
+	mJobTaken.wait(lock,[this]{return mJobs.empty()&&(mActiveCount == 0);});
+}
+
+/**
+ * Return the number of jobs queued or being written.
+ * @return The number of jobs queued or being written.
+ */
+size_t FitsWriterQueue::get_pending_count()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	return mJobs.size()+mActiveCount;
+}
+
+/**
+ * Return the number of images successfully written and published since the queue was started.
+ * @return The number of images written.
+ */
+uint64_t FitsWriterQueue::get_written_count()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	return mWrittenCount;
+}
+
+/**
+ * Return the number of images that failed to be written since the queue was started.
+ * @return The number of failed images.
+ */
+uint64_t FitsWriterQueue::get_failed_count()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	return mFailedCount;
+}
+
+/**
+ * Convert a sync policy string, as used in the config file, into a FitsWriterSyncPolicy.
+ * @param policy_string The policy string, one of "none", "file" or "directory".
+ * @param sync_policy The address of a FitsWriterSyncPolicy to return the policy in.
+ * @return The method returns true if the policy string was recognised, and false if it was not.
+ */
+bool FitsWriterQueue::sync_policy_from_string(const std::string &policy_string,
+					      enum FitsWriterSyncPolicy *sync_policy)
+{
+	if(policy_string == "none")
+		(*sync_policy) = FITS_WRITER_SYNC_NONE;
+	else if(policy_string == "file")
+		(*sync_policy) = FITS_WRITER_SYNC_FILE;
+	else if(policy_string == "directory")
+		(*sync_policy) = FITS_WRITER_SYNC_DIRECTORY;
+	else
+		return false;
+	return true;
+}
+
+/**
+ * Writer thread. We wait for a job to be queued, take it off the queue and write it with write_job.
+ * On success the publish callback is called with the job's filename, frame sequence number and timeline, on failure
+ * the error is logged. The thread exits when the queue is stopping and no jobs are left.
+ * @see FitsWriterQueue::write_job
+ * @see FitsWriterQueue::mPublishCallback
+ */
+void FitsWriterQueue::writer_thread()
+{
+	std::unique_ptr<FitsWriterJob> job;
+	std::string error_string;
+	bool retval;
+
+	while(true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+
+			mJobAvailable.wait(lock,[this]{return (!mJobs.empty())||mStopping;});
+			if(mJobs.empty())
+				break;
+			job = std::move(mJobs.front());
+			mJobs.pop_front();
+			mActiveCount++;
+		}
+		mJobTaken.notify_all();
+		retval = write_job(job.get(),error_string);
+		if(retval)
+		{
+			if(mPublishCallback)
+				mPublishCallback(job->mFilename,job->mFrameSequence,job->mTimeline);
+		}
+		else
+		{
+			cerr << "FITS writer failed to save frame " << job->mFrameSequence << " to " << job->mFilename <<
+				":" << error_string << endl;
+			LOG4CXX_ERROR(logger,"writer_thread:Failed to save frame " << job->mFrameSequence << " to " <<
+				      job->mFilename << ":" << error_string);
+		}
+		/* release the image buffer and header snapshot before reporting the job finished */
+		job = nullptr;
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+
+			mActiveCount--;
+			if(retval)
+				mWrittenCount++;
+			else
+				mFailedCount++;
+		}
+		mJobTaken.notify_all();
+	}
+}
+
+/**
+ * Write a job's image to disk and rename it into place using write_file. If the job carries a reduced image, we then
+ * write the reduced image to the job's reduced filename in the same way, before the image is published, so both
+ * files exist once the exposure is reported as finished. A failure to write the reduced image is logged, but does
+ * not fail the job, as the raw image is complete and in place.
+ * @param job The job to write.
+ * @param error_string A string to return a description of the failure in.
+ * @return The method returns true if the image was written, and false on failure.
+ * @see FitsWriterQueue::write_file
+ * @see FitsWriterJob::mReducedImage
+ */
+bool FitsWriterQueue::write_job(FitsWriterJob *job,std::string &error_string)
+{
+	std::string reduced_error_string;
+
+	if(!write_file(job,job->mFilename,false,error_string))
+		return false;
+	if(job->mReducedImage != nullptr)
+	{
+		if(!write_file(job,job->mReducedFilename,true,reduced_error_string))
+		{
+			cerr << "FITS writer failed to save reduced frame " << job->mFrameSequence << " to " <<
+				job->mReducedFilename << ":" << reduced_error_string << endl;
+			LOG4CXX_ERROR(logger,"write_job:Failed to save reduced frame " << job->mFrameSequence << " to " <<
+				      job->mReducedFilename << ":" << reduced_error_string);
+		}
+	}
+	return true;
+}
+
+/**
+ * Write one of a job's images to disk and rename it into place. This does the following:
+ * <ul>
+ * <li>We create a '.lock' file for the filename with CCD_Fits_Filename_Lock, so the data transfer processes
+ *     leave the image alone until it has been completely written. If the lock file cannot be created (for instance
+ *     a stale lock file exists) we log the error and carry on, as the image is never visible under it's final
+ *     filename until it is complete anyway.
+ * <li>We write the image to a temporary filename (the filename with FITS_WRITER_TEMPORARY_SUFFIX appended)
+ *     in the same directory. The reduced image is written as float32 with frame_reduction_save. Otherwise the
+ *     image is written using CCD_Fits_Writer_Save if mNativeWriter is set, otherwise CCD_Exposure_Save.
+ *     Either time stamps the save open / write / close phases in the job's timeline.
+ * <li>If mSyncPolicy is not FITS_WRITER_SYNC_NONE, we fsync the temporary file.
+ * <li>We rename the temporary file to the filename, which atomically replaces any existing file.
+ * <li>If mSyncPolicy is FITS_WRITER_SYNC_DIRECTORY, we fsync the directory containing the file.
+ * <li>We remove the lock file with CCD_Fits_Filename_UnLock.
+ * </ul>
+ * If any step fails, the temporary file and lock file are removed.
+ * @param job The job to write.
+ * @param filename The filename to write the image to.
+ * @param reduced If true the job's reduced image (mReducedImage) is written with it's reduced FITS headers,
+ *        otherwise the job's image is written.
+ * @param error_string A string to return a description of the failure in.
+ * @return The method returns true on success, and false on failure.
+ * @see FitsWriterQueue::mNativeWriter
+ * @see FitsWriterQueue::mSyncPolicy
+ * @see #FITS_WRITER_TEMPORARY_SUFFIX
+ * @see CCD_Fits_Filename_Lock
+ * @see CCD_Fits_Filename_UnLock
+ * @see CCD_Fits_Writer_Save
+ * @see CCD_Exposure_Save
+ * @see frame_reduction_save
+ */
+bool FitsWriterQueue::write_file(FitsWriterJob *job,const std::string &filename,bool reduced,
+				 std::string &error_string)
+{
+	char error_buffer[FITS_WRITER_ERROR_BUFFER_LENGTH];
+	std::vector<char> filename_buffer(filename.begin(),filename.end());
+	std::string temporary_filename = filename+FITS_WRITER_TEMPORARY_SUFFIX;
+	std::vector<char> temporary_filename_buffer(temporary_filename.begin(),temporary_filename.end());
+	std::string directory_name;
+	std::string::size_type slash_index;
+	bool locked,saved;
+	int fd,sync_errno;
+
+	filename_buffer.push_back('\0');
+	temporary_filename_buffer.push_back('\0');
+	/* stop the data transfer processes picking up the image whilst it is written */
+	locked = (CCD_Fits_Filename_Lock(filename_buffer.data()) == TRUE);
+	if(!locked)
+	{
+		CCD_General_Error_To_String(error_buffer);
+		LOG4CXX_WARN(logger,"write_file:Failed to create lock file for " << filename << ":" << error_buffer);
+	}
+	/* remove any temporary file left behind by an earlier failure, CFITSIO will not overwrite it */
+	unlink(temporary_filename.c_str());
+	if(reduced)
+	{
+		saved = frame_reduction_save(temporary_filename.c_str(),job->mReducedImage.get(),job->mNCols,job->mNRows,
+					     job->mReducedFitsHeader,error_string);
+	}
+	else
+	{
+		if(mNativeWriter)
+		{
+			saved = (CCD_Fits_Writer_Save(temporary_filename_buffer.data(),(void*)(job->mImageBuf->data()),
+						      job->mImageBufferLength,job->mNCols,job->mNRows,job->mFitsHeader,
+						      &(job->mTimeline)) == TRUE);
+		}
+		else
+		{
+			saved = (CCD_Exposure_Save(temporary_filename_buffer.data(),(void*)(job->mImageBuf->data()),
+						   job->mImageBufferLength,job->mNCols,job->mNRows,job->mFitsHeader,
+						   &(job->mTimeline)) == TRUE);
+		}
+		if(!saved)
+		{
+			CCD_General_Error_To_String(error_buffer);
+			error_string = error_buffer;
+		}
+	}
+	if(!saved)
+	{
+		unlink(temporary_filename.c_str());
+		if(locked)
+			CCD_Fits_Filename_UnLock(filename_buffer.data());
+		return false;
+	}
+	/* flush the image data before it becomes visible under it's final name */
+	if(mSyncPolicy != FITS_WRITER_SYNC_NONE)
+	{
+		fd = open(temporary_filename.c_str(),O_RDONLY);
+		if((fd == -1)||(fsync(fd) == -1))
+		{
+			sync_errno = errno;
+			if(fd != -1)
+				close(fd);
+			error_string = "Failed to fsync "+temporary_filename+":"+strerror(sync_errno);
+			unlink(temporary_filename.c_str());
+			if(locked)
+				CCD_Fits_Filename_UnLock(filename_buffer.data());
+			return false;
+		}
+		close(fd);
+	}
+	if(rename(temporary_filename.c_str(),filename.c_str()) != 0)
+	{
+		error_string = "Failed to rename "+temporary_filename+":"+strerror(errno);
+		unlink(temporary_filename.c_str());
+		if(locked)
+			CCD_Fits_Filename_UnLock(filename_buffer.data());
+		return false;
+	}
+	/* flush the directory entry created by the rename */
+	if(mSyncPolicy == FITS_WRITER_SYNC_DIRECTORY)
+	{
+		slash_index = filename.find_last_of('/');
+		if(slash_index == std::string::npos)
+			directory_name = ".";
+		else if(slash_index == 0)
+			directory_name = "/";
+		else
+			directory_name = filename.substr(0,slash_index);
+		fd = open(directory_name.c_str(),O_RDONLY|O_DIRECTORY);
+		if((fd == -1)||(fsync(fd) == -1))
+		{
+			/* the image is complete and in place, so we only log this */
+			LOG4CXX_WARN(logger,"write_file:Failed to fsync directory " << directory_name << ":" <<
+				     strerror(errno));
+		}
+		if(fd != -1)
+			close(fd);
+	}
+	if(locked)
+	{
+		if(CCD_Fits_Filename_UnLock(filename_buffer.data()) == FALSE)
+		{
+			/* the image is complete and in place, so we only log this */
+			CCD_General_Error_To_String(error_buffer);
+			LOG4CXX_ERROR(logger,"write_file:Failed to remove lock file for " << filename << ":" <<
+				      error_buffer);
+		}
+	}
+	return true;
+}
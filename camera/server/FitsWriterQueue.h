@@ -0,0 +1,195 @@
+/**
+ * @file
+ * @brief FitsWriterQueue.h declares a bounded queue of FITS image save jobs, written to disk by background writer
+ *        threads so the exposure threads do not wait for the disk.
+ * @author Chris Mottram
+ * @version $Id$
+ */
+#ifndef FITSWRITERQUEUE_H
+#define FITSWRITERQUEUE_H
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ImageBuffer.h"
+#include "ccd_exposure.h"
+#include "ccd_fits_header.h"
+
+/**
+ * When a FITS image written by a FitsWriterQueue is flushed to disk.
+ * <dl>
+ * <dt>FITS_WRITER_SYNC_NONE</dt> <dd>The image is not explicitly flushed, the kernel writes it back in it's own
+ *     time.</dd>
+ * <dt>FITS_WRITER_SYNC_FILE</dt> <dd>The temporary file is flushed (fsync) before it is renamed into place.</dd>
+ * <dt>FITS_WRITER_SYNC_DIRECTORY</dt> <dd>As FITS_WRITER_SYNC_FILE, and the directory is also flushed after the
+ *     rename, so the new directory entry survives a crash.</dd>
+ * </dl>
+ */
+enum FitsWriterSyncPolicy
+{
+	FITS_WRITER_SYNC_NONE,
+	FITS_WRITER_SYNC_FILE,
+	FITS_WRITER_SYNC_DIRECTORY
+};
+
+/**
+ * A FITS image save job: the read out image, a snapshot of the FITS headers to save with it, and the filename
+ * to publish it as. The job can also carry a reduced (float32) copy of the image, which is saved alongside it.
+ * The job owns the header snapshots, which are freed when the job is destroyed.
+ * @see FitsWriterQueue
+ */
+class FitsWriterJob
+{
+  public:
+	FitsWriterJob();
+	~FitsWriterJob();
+	FitsWriterJob(const FitsWriterJob &) = delete;
+	FitsWriterJob & operator=(const FitsWriterJob &) = delete;
+	/**
+	 * The image buffer containing the read out image. Holding the shared pointer stops the buffer being
+	 * returned to the buffer pool until the image has been written.
+	 */
+	std::shared_ptr<ImageBuffer> mImageBuf;
+	/**
+	 * The number of pixels in the image.
+	 */
+	size_t mImageBufferLength;
+	/**
+	 * The number of columns in the image.
+	 */
+	int mNCols;
+	/**
+	 * The number of rows in the image.
+	 */
+	int mNRows;
+	/**
+	 * A snapshot of the FITS headers to save with the image, taken with CCD_Fits_Header_Copy.
+	 * @see CCD_Fits_Header_Copy
+	 */
+	struct Fits_Header_Struct mFitsHeader;
+	/**
+	 * The '.fits' filename the image is published as.
+	 */
+	std::string mFilename;
+	/**
+	 * The frame sequence number of the image, as returned by Camera::publish_image.
+	 */
+	int64_t mFrameSequence;
+	/**
+	 * The time stamps of the phases of the image's acquisition. The writer thread time stamps the save phases
+	 * (CCD_EXPOSURE_TIMELINE_SAVE_OPEN to CCD_EXPOSURE_TIMELINE_SAVE_CLOSE), and passes the timeline to the
+	 * publish callback.
+	 */
+	struct CCD_Exposure_Timeline_Struct mTimeline;
+	/**
+	 * The reduced (float32) image, mNCols x mNRows pixels, saved alongside the image once it has been written.
+	 * NULL if the image has not been reduced.
+	 */
+	std::shared_ptr<float[]> mReducedImage;
+	/**
+	 * The '.fits' filename the reduced image is saved as.
+	 */
+	std::string mReducedFilename;
+	/**
+	 * The FITS headers to save with the reduced image.
+	 */
+	struct Fits_Header_Struct mReducedFitsHeader;
+};
+
+/**
+ * A bounded queue of FITS image save jobs, serviced by one or more writer threads. Each job is written to a
+ * temporary file alongside the final filename, flushed according to the sync policy, and renamed into place,
+ * whilst a '.lock' file (CCD_Fits_Filename_Lock) stops the data transfer processes picking the image up.
+ * Only once the rename has completed is the publish callback called with the filename, so a published filename
+ * always refers to a complete FITS image. When the queue is full, push blocks until a writer thread has taken
+ * a job off the queue.
+ * @see FitsWriterJob
+ * @see FitsWriterSyncPolicy
+ */
+class FitsWriterQueue
+{
+  public:
+	/**
+	 * The type of the callback called (from a writer thread) after a FITS image has been published.
+	 * The arguments are the published filename, the job's frame sequence number, and the job's timeline.
+	 */
+	typedef std::function<void(const std::string &,int64_t,const struct CCD_Exposure_Timeline_Struct &)>
+		PublishCallback;
+	FitsWriterQueue();
+	~FitsWriterQueue();
+	FitsWriterQueue(const FitsWriterQueue &) = delete;
+	FitsWriterQueue & operator=(const FitsWriterQueue &) = delete;
+	void start(size_t queue_length,int thread_count,enum FitsWriterSyncPolicy sync_policy,bool native_writer,
+		   PublishCallback publish_callback);
+	void stop();
+	void push(std::unique_ptr<FitsWriterJob> job);
+	void flush();
+	size_t get_pending_count();
+	uint64_t get_written_count();
+	uint64_t get_failed_count();
+	static bool sync_policy_from_string(const std::string &policy_string,enum FitsWriterSyncPolicy *sync_policy);
+  private:
+	void writer_thread();
+	bool write_job(FitsWriterJob *job,std::string &error_string);
+	bool write_file(FitsWriterJob *job,const std::string &filename,bool reduced,std::string &error_string);
+	/**
+	 * The queued jobs, oldest first.
+	 */
+	std::deque<std::unique_ptr<FitsWriterJob>> mJobs;
+	/**
+	 * The maximum number of jobs in mJobs before push blocks.
+	 */
+	size_t mQueueLength;
+	/**
+	 * The number of jobs taken off mJobs that a writer thread is still writing.
+	 */
+	size_t mActiveCount;
+	/**
+	 * The number of images successfully written and published since the queue was started.
+	 */
+	uint64_t mWrittenCount;
+	/**
+	 * The number of images that failed to be written since the queue was started.
+	 */
+	uint64_t mFailedCount;
+	/**
+	 * Set when the queue is stopping, the writer threads exit once mJobs is empty.
+	 */
+	bool mStopping;
+	/**
+	 * When the written images are flushed to disk.
+	 */
+	enum FitsWriterSyncPolicy mSyncPolicy;
+	/**
+	 * True if images are written with CCD_Fits_Writer_Save, false if with CCD_Exposure_Save (CFITSIO).
+	 */
+	bool mNativeWriter;
+	/**
+	 * The callback called after each image has been published.
+	 */
+	PublishCallback mPublishCallback;
+	/**
+	 * Mutex protecting the queue state.
+	 */
+	std::mutex mMutex;
+	/**
+	 * Condition signalled when a job is pushed, or the queue is stopping, to wake the writer threads.
+	 */
+	std::condition_variable mJobAvailable;
+	/**
+	 * Condition signalled when a writer thread takes a job off the queue or finishes writing one, to wake
+	 * push (waiting for space) and flush (waiting for the queue to drain).
+	 */
+	std::condition_variable mJobTaken;
+	/**
+	 * The writer threads.
+	 */
+	std::vector<std::thread> mThreads;
+};
+#endif
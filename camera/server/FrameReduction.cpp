@@ -0,0 +1,498 @@
+/**
+ * @file
+ * @brief FrameReduction.cpp implements the routines used to apply the basic CCD reductions (master bias subtraction,
+ *        exposure-scaled dark subtraction and flat field division) to each read out frame in the server, as done by
+ *        ReductionController.reduce_ccd_image in the pipelines, and to save the reduced frame as a float32 FITS image.
+ * @author Chris Mottram
+ * @version $Id$
+ */
+#include "FrameReduction.h"
+#include <algorithm>
+#include <thread>
+#include "fitsio.h"
+#include "ccd_general.h"
+
+static bool load_fits_image(const char *filename,bool read_exposure_length,int *ncols,int *nrows,
+			    std::vector<float> &image,double *exposure_length,std::string &error_message);
+static void reduce_rows(const uint16_t *image,int ncols,int first_row,int last_row,
+			const FrameCalibration &calibration,float dark_scale,float *reduced_image);
+static std::string fits_error_string(int status);
+
+/**
+ * Load the master calibration frames a frame is reduced with, as ReductionController.read_cal_images does for the
+ * pipelines.
+ * <ul>
+ * <li>We load the master bias, dark and flat into float32 arrays with load_fits_image. The dark's exposure length
+ *     (in seconds) is read from it's EXPOSURE FITS header, which must be greater than zero.
+ * <li>We check the three frames have the same dimensions.
+ * </ul>
+ * The calibration is only updated if all the frames load successfully.
+ * @param bias_filename The filename of the master bias frame.
+ * @param dark_filename The filename of the master dark frame (already bias subtracted).
+ * @param flat_filename The filename of the master flat field (normalised to unity).
+ * @param calibration The FrameCalibration to fill in.
+ * @param error_message If a frame cannot be loaded, or the frames do not match, on return this contains a
+ *        description of the problem.
+ * @return The routine returns true if the calibration was loaded, and false if it was not.
+ * @see load_fits_image
+ * @see FrameCalibration
+ */
+bool frame_reduction_load_calibration(const char *bias_filename,const char *dark_filename,
+				      const char *flat_filename,FrameCalibration &calibration,
+				      std::string &error_message)
+{
+	FrameCalibration loaded_calibration;
+	int dark_ncols,dark_nrows,flat_ncols,flat_nrows;
+
+	if(!load_fits_image(bias_filename,false,&(loaded_calibration.mNCols),&(loaded_calibration.mNRows),
+			    loaded_calibration.mBias,nullptr,error_message))
+		return false;
+	if(!load_fits_image(dark_filename,true,&dark_ncols,&dark_nrows,loaded_calibration.mDark,
+			    &(loaded_calibration.mDarkExposureLength),error_message))
+		return false;
+	if(!load_fits_image(flat_filename,false,&flat_ncols,&flat_nrows,loaded_calibration.mFlat,nullptr,
+			    error_message))
+		return false;
+	if((dark_ncols != loaded_calibration.mNCols)||(dark_nrows != loaded_calibration.mNRows)||
+	   (flat_ncols != loaded_calibration.mNCols)||(flat_nrows != loaded_calibration.mNRows))
+	{
+		error_message = "Master frame sizes do not match: bias "+std::to_string(loaded_calibration.mNCols)+"x"+
+			std::to_string(loaded_calibration.mNRows)+", dark "+std::to_string(dark_ncols)+"x"+
+			std::to_string(dark_nrows)+", flat "+std::to_string(flat_ncols)+"x"+std::to_string(flat_nrows)+".";
+		return false;
+	}
+	if(loaded_calibration.mDarkExposureLength <= 0.0)
+	{
+		error_message = "Master dark "+std::string(dark_filename)+" has an illegal EXPOSURE of "+
+			std::to_string(loaded_calibration.mDarkExposureLength)+" seconds.";
+		return false;
+	}
+	loaded_calibration.mBiasFilename = bias_filename;
+	loaded_calibration.mDarkFilename = dark_filename;
+	loaded_calibration.mFlatFilename = flat_filename;
+	calibration = std::move(loaded_calibration);
+	return true;
+}
+
+/**
+ * Reduce a frame with the master calibration frames:
+ * reduced = (image - bias - (exposure_length/dark exposure length)*dark) / flat, the same sum
+ * ReductionController.reduce_ccd_image does, evaluated in the same order.
+ * The three corrections are fused into a single pass over the pixels, that reads each input pixel once and writes
+ * each reduced pixel once, without the whole-frame temporaries numpy creates for each operation. The frame's rows are
+ * split into one band per pool thread (FrameReductionPool::reduce). The result is float32, rather than numpy's 
+ * float64, which matches the float64 result to within float32 rounding.
+ * @param image The frame to reduce, ncols x nrows pixels, re-oriented as it is saved.
+ * @param ncols The number of binned columns in the frame.
+ * @param nrows The number of binned rows in the frame.
+ * @param exposure_length The frame's exposure length in seconds.
+ * @param calibration The master calibration frames, which must have the same dimensions as the frame.
+ * @param pool The worker pool the frame's rows are split between.
+ * @param reduced_image An array of at least ncols x nrows floats, that on return contains the reduced frame.
+ * @param error_message If the frame does not match the calibration, on return this contains a description of the
+ *        problem.
+ * @return The routine returns true if the frame was reduced, and false if it was not.
+ * @see FrameReductionPool::reduce
+ * @see FrameCalibration
+ */
+bool frame_reduction_apply(const uint16_t *image,int ncols,int nrows,double exposure_length,
+			   const FrameCalibration &calibration,FrameReductionPool &pool,float *reduced_image,
+			   std::string &error_message)
+{
+	if((ncols < 1)||(nrows < 1))
+	{
+		error_message = "Illegal image size "+std::to_string(ncols)+"x"+std::to_string(nrows)+".";
+		return false;
+	}
+	if((ncols != calibration.mNCols)||(nrows != calibration.mNRows))
+	{
+		error_message = "Image size "+std::to_string(ncols)+"x"+std::to_string(nrows)+
+			" does not match the master frame size "+std::to_string(calibration.mNCols)+"x"+
+			std::to_string(calibration.mNRows)+".";
+		return false;
+	}
+	pool.reduce(image,ncols,nrows,calibration,(float)(exposure_length/calibration.mDarkExposureLength),
+		    reduced_image);
+	return true;
+}
+
+/**
+ * Constructor for the frame reduction pool. The pool has no worker threads until start is called.
+ * @see FrameReductionPool::start
+ */
+FrameReductionPool::FrameReductionPool()
+{
+	mGeneration = 0;
+	mPendingCount = 0;
+	mStopping = false;
+	mImage = nullptr;
+	mNCols = 0;
+	mNRows = 0;
+	mBandRows = 0;
+	mCalibration = nullptr;
+	mDarkScale = 0.0f;
+	mReducedImage = nullptr;
+}
+
+/**
+ * Destructor for the frame reduction pool. The worker threads are stopped.
+ * @see FrameReductionPool::stop
+ */
+FrameReductionPool::~FrameReductionPool()
+{
+	stop();
+}
+
+/**
+ * Start the worker threads. Any workers already running are stopped first.
+ * @param thread_count The number of threads frames are reduced by, including the thread calling reduce, so 
+ *        thread_count-1 workers are started. Values less than one are treated as one.
+ * @see FrameReductionPool::worker_thread
+ * @see FrameReductionPool::mThreads
+ */
+void FrameReductionPool::start(int thread_count)
+{
+	stop();
+	std::lock_guard<std::mutex> reduce_lock(mReduceMutex);
+
+	mStopping = false;
+	for(int i = 1; i < thread_count; i++)
+		mThreads.push_back(std::thread(&FrameReductionPool::worker_thread,this,i,mGeneration));
+}
+
+/**
+ * Stop the worker threads. Frames reduced afterwards are reduced in the calling thread only, until the pool
+ * is restarted.
+ * @see FrameReductionPool::mStopping
+ * @see FrameReductionPool::mThreads
+ */
+void FrameReductionPool::stop()
+{
+	std::lock_guard<std::mutex> reduce_lock(mReduceMutex);
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+
+		mStopping = true;
+	}
+	mWorkAvailable.notify_all();
+	for(std::thread &thrd : mThreads)
+	{
+		if(thrd.joinable())
+			thrd.join();
+	}
+	mThreads.clear();
+}
+
+/**
+ * Return the number of threads frames are reduced by, the worker threads plus the thread calling reduce.
+ */
+int FrameReductionPool::get_thread_count()
+{
+	std::lock_guard<std::mutex> reduce_lock(mReduceMutex);
+
+	return ((int)mThreads.size())+1;
+}
+
+/**
+ * Reduce a frame, split into one band of rows per thread (at least one row per band). The calling thread reduces
+ * the first band with reduce_rows, whilst the workers reduce the rest, and we wait until every band has been
+ * reduced. Only one frame is reduced at once (mReduceMutex).
+ * @param image The frame to reduce.
+ * @param ncols The number of columns in the frame.
+ * @param nrows The number of rows in the frame.
+ * @param calibration The master calibration frames, the same size as the frame.
+ * @param dark_scale The ratio of the frame's exposure length to the master dark's exposure length.
+ * @param reduced_image The reduced frame to write the bands into.
+ * @see reduce_rows
+ * @see FrameReductionPool::worker_thread
+ */
+void FrameReductionPool::reduce(const uint16_t *image,int ncols,int nrows,const FrameCalibration &calibration,
+				float dark_scale,float *reduced_image)
+{
+	std::lock_guard<std::mutex> reduce_lock(mReduceMutex);
+	int band_count,band_rows,worker_band_count;
+
+	band_count = std::max(1,std::min(((int)mThreads.size())+1,nrows));
+	band_rows = (nrows+band_count-1)/band_count;
+	/* bands past the end of the frame (when the rows do not divide evenly) are empty */
+	worker_band_count = (nrows+band_rows-1)/band_rows-1;
+	if(worker_band_count > 0)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+
+			mImage = image;
+			mNCols = ncols;
+			mNRows = nrows;
+			mBandRows = band_rows;
+			mCalibration = &calibration;
+			mDarkScale = dark_scale;
+			mReducedImage = reduced_image;
+			mPendingCount = worker_band_count;
+			mGeneration++;
+		}
+		mWorkAvailable.notify_all();
+	}
+	reduce_rows(image,ncols,0,std::min(band_rows,nrows),calibration,dark_scale,reduced_image);
+	if(worker_band_count > 0)
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+
+		mWorkDone.wait(lock,[this]{return mPendingCount == 0;});
+	}
+}
+
+/**
+ * A worker thread. We wait for a new frame to be put in the pool (mGeneration changes), reduce our band of it's
+ * rows (if the band is not past the end of the frame) with reduce_rows, and signal mWorkDone once the last worker
+ * band has been reduced. We exit when the pool is stopping.
+ * @param band The band of each frame this worker reduces (the calling thread reduces band 0).
+ * @param generation The value of mGeneration when the worker was started, so a frame put in the pool before the
+ *        worker first locks mMutex is still reduced.
+ * @see reduce_rows
+ * @see FrameReductionPool::reduce
+ */
+void FrameReductionPool::worker_thread(int band,uint64_t generation)
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	int first_row,last_row;
+
+	while(true)
+	{
+		mWorkAvailable.wait(lock,[this,generation]{return mStopping||(mGeneration != generation);});
+		if(mStopping)
+			return;
+		generation = mGeneration;
+		first_row = band*mBandRows;
+		if(first_row >= mNRows)
+			continue;
+		/* the frame's parameters do not change until every worker band has been reduced */
+		last_row = std::min(first_row+mBandRows,mNRows);
+		lock.unlock();
+		reduce_rows(mImage,mNCols,first_row,last_row,*mCalibration,mDarkScale,mReducedImage);
+		lock.lock();
+		mPendingCount--;
+		if(mPendingCount == 0)
+			mWorkDone.notify_one();
+	}
+}
+
+/**
+ * Take a buffer to reduce a frame into out of a CCD library buffer pool, created with buffer lengths of
+ * FRAME_REDUCTION_POOL_BUFFER_LENGTH pixels. The buffer is returned to the pool (CCD_Setup_Buffer_Pool_Put) when
+ * the last reference to it is released, so reducing a frame does not allocate memory.
+ * @param pool The buffer pool, or a pool that has not been created (it's Memory is NULL).
+ * @param pixel_count The number of pixels in the reduced frame.
+ * @return A buffer of at least pixel_count floats, or nullptr if the pool has not been created, all it's buffers are
+ *         in use, or it's buffers are too small.
+ * @see #FRAME_REDUCTION_POOL_BUFFER_LENGTH
+ * @see CCD_Setup_Buffer_Pool_Get
+ * @see CCD_Setup_Buffer_Pool_Put
+ */
+std::shared_ptr<float[]> frame_reduction_buffer_get(struct CCD_Setup_Buffer_Pool_Struct *pool,size_t pixel_count)
+{
+	unsigned short *buffer = NULL;
+
+	if((pool->Memory == NULL)||(FRAME_REDUCTION_POOL_BUFFER_LENGTH(pixel_count) > pool->Buffer_Pixel_Count))
+		return nullptr;
+	if(!CCD_Setup_Buffer_Pool_Get(pool,&buffer))
+		return nullptr;
+	/* the buffer came from the pool, so returning it cannot fail */
+	return std::shared_ptr<float[]>((float *)buffer,[pool](float *reduced_image)
+					{CCD_Setup_Buffer_Pool_Put(pool,(unsigned short *)reduced_image);});
+}
+
+/**
+ * Add the FITS headers ReductionController.reduce_ccd_image adds to a reduced frame: L1 (the string "True"), and
+ * L1BIAS / L1DARK / L1FLAT, the filenames of the master frames it was reduced with.
+ * @param fits_header The FITS header list to add the headers to.
+ * @param calibration The master calibration frames the frame was reduced with.
+ * @param error_message If a header cannot be added, on return this contains a description of the problem.
+ * @return The routine returns true if the headers were added, and false if they were not.
+ * @see FrameCalibration
+ * @see CCD_Fits_Header_Add_String
+ */
+bool frame_reduction_add_fits_headers(struct Fits_Header_Struct *fits_header,const FrameCalibration &calibration,
+				      std::string &error_message)
+{
+	char error_buffer[1024];
+
+	if((CCD_Fits_Header_Add_String(fits_header,"L1","True","Basic CCD reductions applied") == FALSE)||
+	   (CCD_Fits_Header_Add_String(fits_header,"L1BIAS",calibration.mBiasFilename.c_str(),
+				       "Master bias frame") == FALSE)||
+	   (CCD_Fits_Header_Add_String(fits_header,"L1DARK",calibration.mDarkFilename.c_str(),
+				       "Master dark frame") == FALSE)||
+	   (CCD_Fits_Header_Add_String(fits_header,"L1FLAT",calibration.mFlatFilename.c_str(),
+				       "Master flat field") == FALSE))
+	{
+		CCD_Fits_Header_Error_String(error_buffer);
+		error_message = error_buffer;
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Save a reduced frame to a float32 (BITPIX = -32) FITS image using CFITSIO. The file must not already exist.
+ * @param filename The filename to save the reduced frame to.
+ * @param reduced_image The reduced frame, ncols x nrows pixels.
+ * @param ncols The number of columns in the reduced frame.
+ * @param nrows The number of rows in the reduced frame.
+ * @param fits_header The FITS headers to save with the reduced frame.
+ * @param error_message If the frame cannot be saved, on return this contains a description of the problem.
+ * @return The routine returns true if the frame was saved, and false if it was not.
+ * @see fits_error_string
+ * @see CCD_Fits_Header_Write_To_Fits
+ */
+bool frame_reduction_save(const char *filename,const float *reduced_image,int ncols,int nrows,
+			  struct Fits_Header_Struct fits_header,std::string &error_message)
+{
+	fitsfile *fits_fp = NULL;
+	char error_buffer[1024];
+	long axes[2];
+	int status = 0,close_status = 0;
+
+	if(fits_create_file(&fits_fp,filename,&status))
+	{
+		error_message = "Failed to create "+std::string(filename)+":"+fits_error_string(status);
+		return false;
+	}
+	axes[0] = ncols;
+	axes[1] = nrows;
+	if(fits_create_img(fits_fp,FLOAT_IMG,2,axes,&status))
+	{
+		error_message = "Failed to create image in "+std::string(filename)+":"+fits_error_string(status);
+		fits_close_file(fits_fp,&close_status);
+		return false;
+	}
+	if(CCD_Fits_Header_Write_To_Fits(fits_header,fits_fp) == FALSE)
+	{
+		CCD_Fits_Header_Error_String(error_buffer);
+		error_message = "Failed to write FITS headers to "+std::string(filename)+":"+error_buffer;
+		fits_close_file(fits_fp,&close_status);
+		return false;
+	}
+	if(fits_write_img(fits_fp,TFLOAT,1,((LONGLONG)ncols)*nrows,(void*)reduced_image,&status))
+	{
+		error_message = "Failed to write image to "+std::string(filename)+":"+fits_error_string(status);
+		fits_close_file(fits_fp,&close_status);
+		return false;
+	}
+	if(fits_close_file(fits_fp,&status))
+	{
+		error_message = "Failed to close "+std::string(filename)+":"+fits_error_string(status);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Load a two dimensional FITS image into a float32 array using CFITSIO.
+ * @param filename The filename of the FITS image.
+ * @param read_exposure_length Whether to read the image's EXPOSURE FITS header into exposure_length.
+ * @param ncols The address of an integer to return the number of columns in the image in.
+ * @param nrows The address of an integer to return the number of rows in the image in.
+ * @param image A vector to return the image in, ncols x nrows pixels.
+ * @param exposure_length If read_exposure_length is true, the address of a double to return the image's exposure
+ *        length (the EXPOSURE FITS header, in seconds) in.
+ * @param error_message If the image cannot be loaded, on return this contains a description of the problem.
+ * @return The routine returns true if the image was loaded, and false if it was not.
+ * @see fits_error_string
+ */
+static bool load_fits_image(const char *filename,bool read_exposure_length,int *ncols,int *nrows,
+			    std::vector<float> &image,double *exposure_length,std::string &error_message)
+{
+	fitsfile *fits_fp = NULL;
+	long axes[2];
+	float null_value = 0.0f;
+	int status = 0,close_status = 0,naxis,any_null;
+
+	if(fits_open_file(&fits_fp,filename,READONLY,&status))
+	{
+		error_message = "Failed to open "+std::string(filename)+":"+fits_error_string(status);
+		return false;
+	}
+	if(fits_get_img_dim(fits_fp,&naxis,&status))
+	{
+		error_message = "Failed to get the dimensions of "+std::string(filename)+":"+fits_error_string(status);
+		fits_close_file(fits_fp,&close_status);
+		return false;
+	}
+	if(naxis != 2)
+	{
+		error_message = std::string(filename)+" has "+std::to_string(naxis)+" axes, not 2.";
+		fits_close_file(fits_fp,&close_status);
+		return false;
+	}
+	if(fits_get_img_size(fits_fp,2,axes,&status))
+	{
+		error_message = "Failed to get the size of "+std::string(filename)+":"+fits_error_string(status);
+		fits_close_file(fits_fp,&close_status);
+		return false;
+	}
+	if(read_exposure_length)
+	{
+		if(fits_read_key(fits_fp,TDOUBLE,"EXPOSURE",exposure_length,NULL,&status))
+		{
+			error_message = "Failed to read EXPOSURE from "+std::string(filename)+":"+fits_error_string(status);
+			fits_close_file(fits_fp,&close_status);
+			return false;
+		}
+	}
+	(*ncols) = (int)axes[0];
+	(*nrows) = (int)axes[1];
+	image.resize(((size_t)axes[0])*axes[1]);
+	if(fits_read_img(fits_fp,TFLOAT,1,(LONGLONG)image.size(),&null_value,image.data(),&any_null,&status))
+	{
+		error_message = "Failed to read image from "+std::string(filename)+":"+fits_error_string(status);
+		fits_close_file(fits_fp,&close_status);
+		return false;
+	}
+	fits_close_file(fits_fp,&status);
+	return true;
+}
+
+/**
+ * Reduce a band of rows of a frame. Each row is one loop with no branches or temporaries, over contiguous arrays,
+ * that the compiler vectorises. Every pixel of the frame and master frames is read exactly once, so there is no
+ * reuse for cache blocking to exploit: streaming the rows in order is bandwidth bound, and lets the hardware
+ * prefetcher follow the five arrays.
+ * @param image The frame to reduce.
+ * @param ncols The number of columns in the frame (the row stride).
+ * @param first_row The first row of the band.
+ * @param last_row The row after the last row of the band.
+ * @param calibration The master calibration frames, the same size as the frame.
+ * @param dark_scale The ratio of the frame's exposure length to the master dark's exposure length.
+ * @param reduced_image The reduced frame to write the band into.
+ * @see frame_reduction_apply
+ */
+static void reduce_rows(const uint16_t *image,int ncols,int first_row,int last_row,
+			const FrameCalibration &calibration,float dark_scale,float *reduced_image)
+{
+	for(int y = first_row; y < last_row; y++)
+	{
+		size_t row_index = ((size_t)y)*ncols;
+		const uint16_t *row = image+row_index;
+		const float *bias = calibration.mBias.data()+row_index;
+		const float *dark = calibration.mDark.data()+row_index;
+		const float *flat = calibration.mFlat.data()+row_index;
+		float *reduced_row = reduced_image+row_index;
+
+		for(int x = 0; x < ncols; x++)
+			reduced_row[x] = ((((float)row[x])-bias[x])-(dark_scale*dark[x]))/flat[x];
+	}
+}
+
+/**
+ * Return a description of a CFITSIO status code.
+ * @param status The CFITSIO status code.
+ * @return A string containing the status code and it's description (fits_get_errstatus).
+ */
+static std::string fits_error_string(int status)
+{
+	char buff[FLEN_STATUS];
+
+	fits_get_errstatus(status,buff);
+	return std::to_string(status)+" ("+std::string(buff)+")";
+}
@@ -0,0 +1,160 @@
+/**
+ * @file
+ * @brief FrameReduction.h declares the routines used to apply the basic CCD reductions (master bias subtraction,
+ *        exposure-scaled dark subtraction and flat field division) to each read out frame in the server, as done by
+ *        ReductionController.reduce_ccd_image in the pipelines, and to save the reduced frame as a float32 FITS image.
+ * @author Chris Mottram
+ * @version $Id$
+ */
+#ifndef FRAMEREDUCTION_H
+#define FRAMEREDUCTION_H
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ccd_fits_header.h"
+#include "ccd_setup.h"
+
+/**
+ * The default number of threads used to reduce a frame (including the thread calling frame_reduction_apply).
+ */
+#define FRAME_REDUCTION_DEFAULT_THREAD_COUNT (4)
+/**
+ * The suffix that replaces the '.fits' extension of a raw frame's filename, to make the filename the reduced frame
+ * is saved to alongside it.
+ */
+#define FRAME_REDUCTION_FILENAME_SUFFIX      ("_reduced.fits")
+/**
+ * The length (in unsigned short pixels) of the CCD library buffer pool buffers needed to hold a reduced (float32) 
+ * frame of pixel_count pixels.
+ * @see frame_reduction_buffer_get
+ */
+#define FRAME_REDUCTION_POOL_BUFFER_LENGTH(pixel_count) ((pixel_count)*(sizeof(float)/sizeof(unsigned short)))
+
+/**
+ * Structure holding the master calibration frames a frame is reduced with, loaded by
+ * frame_reduction_load_calibration. The frames are held as float32, the type the reduced frame is computed in.
+ * <ul>
+ * <li><b>mBiasFilename / mDarkFilename / mFlatFilename</b> The filenames the master bias / dark / flat were loaded
+ *     from, saved in the reduced frame's L1BIAS / L1DARK / L1FLAT FITS headers.
+ * <li><b>mNCols / mNRows</b> The dimensions of the master frames, which must match the frame being reduced.
+ * <li><b>mBias</b> The master bias frame, subtracted as is.
+ * <li><b>mDark</b> The master dark frame (already bias subtracted), scaled by the ratio of the frame's exposure
+ *     length to mDarkExposureLength before it is subtracted.
+ * <li><b>mFlat</b> The master flat field, normalised to unity, that the frame is divided by.
+ * <li><b>mDarkExposureLength</b> The exposure length of the master dark in seconds, from it's EXPOSURE FITS header.
+ * </ul>
+ * @see frame_reduction_load_calibration
+ */
+struct FrameCalibration
+{
+	std::string mBiasFilename;
+	std::string mDarkFilename;
+	std::string mFlatFilename;
+	int mNCols = 0;
+	int mNRows = 0;
+	std::vector<float> mBias;
+	std::vector<float> mDark;
+	std::vector<float> mFlat;
+	double mDarkExposureLength = 0.0;
+};
+
+/**
+ * A pool of worker threads that frame_reduction_apply splits a frame's rows between. The threads are started once,
+ * when reduction is configured, and wait between frames, so reducing a frame neither creates threads nor allocates
+ * memory. A pool of N threads starts N-1 workers, as the thread calling frame_reduction_apply reduces the first band
+ * of rows itself. A pool that has not been started reduces frames in the calling thread only.
+ * @see frame_reduction_apply
+ */
+class FrameReductionPool
+{
+  public:
+	FrameReductionPool();
+	~FrameReductionPool();
+	FrameReductionPool(const FrameReductionPool &) = delete;
+	FrameReductionPool & operator=(const FrameReductionPool &) = delete;
+	void start(int thread_count);
+	void stop();
+	int get_thread_count();
+	void reduce(const uint16_t *image,int ncols,int nrows,const FrameCalibration &calibration,float dark_scale,
+		    float *reduced_image);
+  private:
+	void worker_thread(int band,uint64_t generation);
+	/**
+	 * Mutex serialising calls to reduce, so only one frame is in the pool at once.
+	 */
+	std::mutex mReduceMutex;
+	/**
+	 * Mutex protecting the current frame's parameters, mGeneration, mPendingCount and mStopping.
+	 */
+	std::mutex mMutex;
+	/**
+	 * Condition signalled when a new frame is put in the pool, or the pool is stopping, to wake the workers.
+	 */
+	std::condition_variable mWorkAvailable;
+	/**
+	 * Condition signalled when the last worker band of a frame has been reduced.
+	 */
+	std::condition_variable mWorkDone;
+	/**
+	 * Incremented for each frame put in the pool, so a worker can tell a new frame from one it has already done.
+	 */
+	uint64_t mGeneration;
+	/**
+	 * The number of worker bands of the current frame not yet reduced.
+	 */
+	int mPendingCount;
+	/**
+	 * Set when the pool is stopping, the workers exit.
+	 */
+	bool mStopping;
+	/**
+	 * The current frame (see reduce).
+	 */
+	const uint16_t *mImage;
+	/**
+	 * The number of columns in the current frame.
+	 */
+	int mNCols;
+	/**
+	 * The number of rows in the current frame.
+	 */
+	int mNRows;
+	/**
+	 * The number of rows in each band of the current frame.
+	 */
+	int mBandRows;
+	/**
+	 * The master calibration frames the current frame is reduced with.
+	 */
+	const FrameCalibration *mCalibration;
+	/**
+	 * The ratio of the current frame's exposure length to the master dark's exposure length.
+	 */
+	float mDarkScale;
+	/**
+	 * The reduced frame the bands are written into.
+	 */
+	float *mReducedImage;
+	/**
+	 * The worker threads. Worker i (starting from 0) reduces band i+1 of each frame.
+	 */
+	std::vector<std::thread> mThreads;
+};
+
+extern bool frame_reduction_load_calibration(const char *bias_filename,const char *dark_filename,
+					     const char *flat_filename,FrameCalibration &calibration,
+					     std::string &error_message);
+extern bool frame_reduction_apply(const uint16_t *image,int ncols,int nrows,double exposure_length,
+				  const FrameCalibration &calibration,FrameReductionPool &pool,float *reduced_image,
+				  std::string &error_message);
+extern std::shared_ptr<float[]> frame_reduction_buffer_get(struct CCD_Setup_Buffer_Pool_Struct *pool,
+							 size_t pixel_count);
+extern bool frame_reduction_add_fits_headers(struct Fits_Header_Struct *fits_header,
+					     const FrameCalibration &calibration,std::string &error_message);
+extern bool frame_reduction_save(const char *filename,const float *reduced_image,int ncols,int nrows,
+				 struct Fits_Header_Struct fits_header,std::string &error_message);
+#endif
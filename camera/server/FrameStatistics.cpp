@@ -0,0 +1,222 @@
+/**
+ * @file
+ * @brief FrameStatistics.cpp implements the routines used to compute the statistics (minimum, maximum, mean, median,
+ *        standard deviation and saturated pixel count) and histogram of each read out frame, and of configured
+ *        regions of it, returned by get_image_statistics and saved as FITS headers.
+ * @author Chris Mottram
+ * @version $Id$
+ */
+#include "FrameStatistics.h"
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+static void histogram_rows(const uint16_t *image,int ncols,int x0,int width,int first_row,int last_row,
+			   uint32_t *histogram);
+
+/**
+ * Histogram a region of an image: count the number of pixels with each 16-bit value. This is the only pass over the
+ * pixels needed, as all the statistics can then be computed from the histogram (frame_statistics_from_histogram).
+ * The region's rows are split into one band per thread. Each thread histograms it's band into it's own histogram
+ * (histogram_rows), so the threads never write to the same memory, and the histograms are then added together
+ * (a loop over the bins the compiler vectorises).
+ * @param image The image.
+ * @param ncols The number of columns in the image (the row stride).
+ * @param x0 The first column of the region (starting from 0).
+ * @param y0 The first row of the region (starting from 0).
+ * @param width The number of columns in the region.
+ * @param height The number of rows in the region.
+ * @param thread_count The number of threads to use. Values less than one are treated as one.
+ * @param histogram On return, FRAME_STATISTICS_HISTOGRAM_LENGTH bins containing the number of pixels in the region
+ *        with each value.
+ * @see #FRAME_STATISTICS_HISTOGRAM_LENGTH
+ * @see histogram_rows
+ */
+void frame_statistics_histogram(const uint16_t *image,int ncols,int x0,int y0,int width,int height,
+				int thread_count,std::vector<uint32_t> &histogram)
+{
+	std::vector<std::vector<uint32_t>> thread_histograms;
+	std::vector<std::thread> threads;
+	int band_rows,i;
+
+	histogram.assign(FRAME_STATISTICS_HISTOGRAM_LENGTH,0);
+	if((width < 1)||(height < 1))
+		return;
+	thread_count = std::max(1,std::min(thread_count,height));
+	band_rows = (height+thread_count-1)/thread_count;
+	thread_histograms.resize(thread_count);
+	for(i = 1; i < thread_count; i++)
+	{
+		if(i*band_rows >= height)
+			break;
+		thread_histograms[i].assign(FRAME_STATISTICS_HISTOGRAM_LENGTH,0);
+		threads.emplace_back(histogram_rows,image,ncols,x0,width,y0+(i*band_rows),
+				     y0+std::min((i+1)*band_rows,height),thread_histograms[i].data());
+	}
+	histogram_rows(image,ncols,x0,width,y0,y0+std::min(band_rows,height),histogram.data());
+	for(i = 0; i < (int)threads.size(); i++)
+	{
+		const uint32_t *thread_histogram = thread_histograms[i+1].data();
+
+		threads[i].join();
+		for(int value = 0; value < FRAME_STATISTICS_HISTOGRAM_LENGTH; value++)
+			histogram[value] += thread_histogram[value];
+	}
+}
+
+/**
+ * Compute the statistics of a region from it's histogram. The region's name and position are not changed.
+ * <ul>
+ * <li>The pixel count, minimum, maximum, mean and number of saturated pixels come from one pass over the bins.
+ * <li>The median is exact: the middle value (or the mean of the two middle values, if there are an even number of
+ *     pixels) found by counting up the bins.
+ * <li>The standard deviation is the population standard deviation, computed in a second pass over the bins from
+ *     each value's difference from the mean, which avoids the rounding errors of subtracting the squared mean from
+ *     the mean square.
+ * </ul>
+ * If the histogram is empty, the statistics are all zero.
+ * @param histogram The histogram, FRAME_STATISTICS_HISTOGRAM_LENGTH bins.
+ * @param saturation_level The pixel value at or above which a pixel is counted as saturated.
+ * @param statistics The RegionStatistics to fill in.
+ * @see #FRAME_STATISTICS_HISTOGRAM_LENGTH
+ */
+void frame_statistics_from_histogram(const std::vector<uint32_t> &histogram,int saturation_level,
+				     RegionStatistics &statistics)
+{
+	uint64_t pixel_count,sum,saturated_count,lower_rank,upper_rank,count;
+	double sum_squares,difference;
+	int min,max,lower_median,upper_median,value;
+
+	pixel_count = sum = saturated_count = 0;
+	min = -1;
+	max = -1;
+	for(value = 0; value < (int)histogram.size(); value++)
+	{
+		if(histogram[value] == 0)
+			continue;
+		if(min < 0)
+			min = value;
+		max = value;
+		pixel_count += histogram[value];
+		sum += ((uint64_t)value)*histogram[value];
+		if(value >= saturation_level)
+			saturated_count += histogram[value];
+	}
+	statistics.pixel_count = pixel_count;
+	if(pixel_count == 0)
+	{
+		statistics.min = statistics.max = 0;
+		statistics.mean = statistics.median = statistics.stddev = 0.0;
+		statistics.saturated_count = 0;
+		return;
+	}
+	statistics.min = min;
+	statistics.max = max;
+	statistics.mean = ((double)sum)/((double)pixel_count);
+	statistics.saturated_count = saturated_count;
+	/* the ranks (starting from 0) of the middle pixel(s) */
+	lower_rank = (pixel_count-1)/2;
+	upper_rank = pixel_count/2;
+	lower_median = upper_median = min;
+	count = 0;
+	sum_squares = 0.0;
+	for(value = min; value <= max; value++)
+	{
+		if(histogram[value] == 0)
+			continue;
+		if(count <= lower_rank)
+			lower_median = value;
+		if(count <= upper_rank)
+			upper_median = value;
+		count += histogram[value];
+		difference = value-statistics.mean;
+		sum_squares += difference*difference*histogram[value];
+	}
+	statistics.median = (lower_median+upper_median)/2.0;
+	statistics.stddev = std::sqrt(sum_squares/pixel_count);
+}
+
+/**
+ * Compute the statistics of an image, and of each configured region of it.
+ * <ul>
+ * <li>We histogram the whole image with config.mThreadCount threads (frame_statistics_histogram), compute the
+ *     image's statistics from the histogram (frame_statistics_from_histogram), and copy the histogram into the
+ *     ImageStatistics.
+ * <li>For each configured region, we clip the region to the image, and compute it's statistics in the same way.
+ *     A region outside the image has a width and height of zero, and zero statistics.
+ * </ul>
+ * @param image The image, ncols x nrows pixels.
+ * @param ncols The number of binned columns in the image.
+ * @param nrows The number of binned rows in the image.
+ * @param config How to compute the statistics (thread count, saturation level and regions).
+ * @param statistics The ImageStatistics to fill in with the saturation level, the image and region statistics and
+ *        the histogram. The frame_sequence is left for the caller to fill in.
+ * @param error_message If the image size is illegal, on return this contains a description of the problem.
+ * @return The routine returns true if the statistics were computed, and false if they were not.
+ * @see frame_statistics_histogram
+ * @see frame_statistics_from_histogram
+ * @see FrameStatisticsConfig
+ * @see ImageStatistics
+ */
+bool frame_statistics_compute(const uint16_t *image,int ncols,int nrows,const FrameStatisticsConfig &config,
+			      ImageStatistics &statistics,std::string &error_message)
+{
+	std::vector<uint32_t> histogram;
+	RegionStatistics region_statistics;
+	int x0,y0,x1,y1;
+
+	if((ncols < 1)||(nrows < 1))
+	{
+		error_message = "Illegal image size "+std::to_string(ncols)+"x"+std::to_string(nrows)+".";
+		return false;
+	}
+	statistics.saturation_level = config.mSaturationLevel;
+	statistics.image.name = "image";
+	statistics.image.x0 = 0;
+	statistics.image.y0 = 0;
+	statistics.image.width = ncols;
+	statistics.image.height = nrows;
+	frame_statistics_histogram(image,ncols,0,0,ncols,nrows,config.mThreadCount,histogram);
+	frame_statistics_from_histogram(histogram,config.mSaturationLevel,statistics.image);
+	statistics.histogram.assign(histogram.begin(),histogram.end());
+	statistics.regions.clear();
+	for(const FrameStatisticsRegion &region : config.mRegions)
+	{
+		x0 = std::min(std::max(region.mX0,0),ncols);
+		y0 = std::min(std::max(region.mY0,0),nrows);
+		x1 = std::min(std::max(region.mX0+region.mWidth,x0),ncols);
+		y1 = std::min(std::max(region.mY0+region.mHeight,y0),nrows);
+		region_statistics.name = region.mName;
+		region_statistics.x0 = x0;
+		region_statistics.y0 = y0;
+		region_statistics.width = x1-x0;
+		region_statistics.height = y1-y0;
+		frame_statistics_histogram(image,ncols,x0,y0,x1-x0,y1-y0,config.mThreadCount,histogram);
+		frame_statistics_from_histogram(histogram,config.mSaturationLevel,region_statistics);
+		statistics.regions.push_back(region_statistics);
+	}
+	return true;
+}
+
+/**
+ * Histogram a band of rows of a region of an image, adding to a histogram.
+ * @param image The image.
+ * @param ncols The number of columns in the image (the row stride).
+ * @param x0 The first column of the region.
+ * @param width The number of columns in the region.
+ * @param first_row The first row of the band.
+ * @param last_row The row after the last row of the band.
+ * @param histogram The histogram to add to, FRAME_STATISTICS_HISTOGRAM_LENGTH bins.
+ * @see #FRAME_STATISTICS_HISTOGRAM_LENGTH
+ */
+static void histogram_rows(const uint16_t *image,int ncols,int x0,int width,int first_row,int last_row,
+			   uint32_t *histogram)
+{
+	for(int y = first_row; y < last_row; y++)
+	{
+		const uint16_t *row = image+(((size_t)y)*ncols)+x0;
+
+		for(int x = 0; x < width; x++)
+			histogram[row[x]]++;
+	}
+}
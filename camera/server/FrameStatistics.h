@@ -0,0 +1,75 @@
+/**
+ * @file
+ * @brief FrameStatistics.h declares the routines used to compute the statistics (minimum, maximum, mean, median,
+ *        standard deviation and saturated pixel count) and histogram of each read out frame, and of configured
+ *        regions of it, returned by get_image_statistics and saved as FITS headers.
+ * @author Chris Mottram
+ * @version $Id$
+ */
+#ifndef FRAMESTATISTICS_H
+#define FRAMESTATISTICS_H
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "CameraService.h"
+
+/**
+ * The number of bins in a frame histogram, one for each 16-bit pixel value.
+ */
+#define FRAME_STATISTICS_HISTOGRAM_LENGTH         (65536)
+/**
+ * The default number of threads used to histogram a frame.
+ */
+#define FRAME_STATISTICS_DEFAULT_THREAD_COUNT     (4)
+/**
+ * The default pixel value at or above which a pixel is counted as saturated.
+ */
+#define FRAME_STATISTICS_DEFAULT_SATURATION_LEVEL (65535)
+/**
+ * The maximum number of configured regions. The regions are numbered from 1, and their FITS header keywords
+ * (e.g. R1MEAN) only have room for a single digit.
+ */
+#define FRAME_STATISTICS_MAX_REGION_COUNT         (9)
+
+/**
+ * Structure describing a region of a frame to compute statistics of.
+ * <ul>
+ * <li><b>mName</b> The name of the region (e.g. "overscan").
+ * <li><b>mX0 / mY0</b> The first column / row of the region, in binned image pixels (starting from 0).
+ * <li><b>mWidth / mHeight</b> The number of columns / rows in the region, in binned image pixels.
+ * </ul>
+ */
+struct FrameStatisticsRegion
+{
+	std::string mName;
+	int mX0;
+	int mY0;
+	int mWidth;
+	int mHeight;
+};
+
+/**
+ * Structure holding how frame statistics are computed.
+ * <ul>
+ * <li><b>mThreadCount</b> The number of threads a frame is histogrammed by.
+ * <li><b>mSaturationLevel</b> The pixel value at or above which a pixel is counted as saturated.
+ * <li><b>mRegions</b> The regions to compute statistics of, as well as the whole frame.
+ * </ul>
+ * @see #FRAME_STATISTICS_DEFAULT_THREAD_COUNT
+ * @see #FRAME_STATISTICS_DEFAULT_SATURATION_LEVEL
+ * @see FrameStatisticsRegion
+ */
+struct FrameStatisticsConfig
+{
+	int mThreadCount = FRAME_STATISTICS_DEFAULT_THREAD_COUNT;
+	int mSaturationLevel = FRAME_STATISTICS_DEFAULT_SATURATION_LEVEL;
+	std::vector<FrameStatisticsRegion> mRegions;
+};
+
+extern void frame_statistics_histogram(const uint16_t *image,int ncols,int x0,int y0,int width,int height,
+				       int thread_count,std::vector<uint32_t> &histogram);
+extern void frame_statistics_from_histogram(const std::vector<uint32_t> &histogram,int saturation_level,
+					    RegionStatistics &statistics);
+extern bool frame_statistics_compute(const uint16_t *image,int ncols,int nrows,const FrameStatisticsConfig &config,
+				     ImageStatistics &statistics,std::string &error_message);
+#endif
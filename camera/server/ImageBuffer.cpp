@@ -0,0 +1,114 @@
+/**
+ * @file
+ * @brief ImageBuffer.cpp implements a fixed capacity image buffer, normally taken from a CCD library buffer pool and
+ *        returned to it when the buffer is destroyed.
+ * @author Chris Mottram
+ * @version $Id$
+ */
+#include "ImageBuffer.h"
+#include "CameraService.h"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include "log4cxx/logger.h"
+#include "ccd_general.h"
+
+using std::cerr;
+using std::endl;
+using namespace log4cxx;
+
+/**
+ * Logger instance for the image buffers (ImageBuffer.cpp).
+ */
+static LoggerPtr logger(Logger::getLogger("mookodi.camera.server.ImageBuffer"));
+
+/**
+ * Constructor for an image buffer using memory taken from a buffer pool with CCD_Setup_Buffer_Pool_Get.
+ * The buffer's capacity is the pool's buffer pixel count, and it's initial length is the same.
+ * @param pool The buffer pool the memory was taken from.
+ * @param buffer The memory taken from the pool.
+ * @see ImageBuffer::mPool
+ * @see ImageBuffer::mBuffer
+ * @see ImageBuffer::mLength
+ * @see ImageBuffer::mCapacity
+ */
+ImageBuffer::ImageBuffer(struct CCD_Setup_Buffer_Pool_Struct *pool,uint16_t *buffer)
+{
+	mPool = pool;
+	mBuffer = buffer;
+	mCapacity = pool->Buffer_Pixel_Count;
+	mLength = mCapacity;
+}
+
+/**
+ * Constructor for an image buffer that allocates it's own memory, used when the buffer pool has run out.
+ * The memory is aligned to CCD_SETUP_BUFFER_POOL_ALIGNMENT, like the pool's buffers.
+ * @param capacity The number of pixels the buffer can hold. The initial length is the same.
+ * @exception std::bad_alloc Thrown if the memory could not be allocated.
+ * @see ImageBuffer::mPool
+ * @see ImageBuffer::mBuffer
+ * @see ImageBuffer::mLength
+ * @see ImageBuffer::mCapacity
+ * @see #CCD_SETUP_BUFFER_POOL_ALIGNMENT
+ */
+ImageBuffer::ImageBuffer(size_t capacity)
+{
+	size_t allocation_length;
+
+	/* aligned_alloc requires the allocated length to be a multiple of the alignment */
+	allocation_length = ((capacity*sizeof(uint16_t)+CCD_SETUP_BUFFER_POOL_ALIGNMENT-1)/
+			     CCD_SETUP_BUFFER_POOL_ALIGNMENT)*CCD_SETUP_BUFFER_POOL_ALIGNMENT;
+	mPool = NULL;
+	mBuffer = (uint16_t *)aligned_alloc(CCD_SETUP_BUFFER_POOL_ALIGNMENT,allocation_length);
+	if(mBuffer == NULL)
+		throw std::bad_alloc();
+	mCapacity = capacity;
+	mLength = mCapacity;
+}
+
+/**
+ * Destructor for the image buffer. If the memory came from a buffer pool it is returned to it using
+ * CCD_Setup_Buffer_Pool_Put, otherwise it is freed.
+ * @see ImageBuffer::mPool
+ * @see ImageBuffer::mBuffer
+ * @see logger
+ * @see LOG4CXX_ERROR
+ */
+ImageBuffer::~ImageBuffer()
+{
+	char error_buffer[1024];
+
+	if(mPool != NULL)
+	{
+		if(!CCD_Setup_Buffer_Pool_Put(mPool,mBuffer))
+		{
+			strcpy(error_buffer,"");
+			CCD_General_Error_To_String(error_buffer);
+			cerr << "ImageBuffer:Failed to return buffer to pool:" << error_buffer << endl;
+			LOG4CXX_ERROR(logger,"ImageBuffer:Failed to return buffer to pool:" << error_buffer);
+		}
+	}
+	else
+		free(mBuffer);
+}
+
+/**
+ * Set the number of pixels in the image held in the buffer. This never reallocates, or clears, the memory.
+ * @param length The number of pixels, which must be no more than the buffer's capacity.
+ * @exception CameraException Thrown if length is more than the buffer's capacity.
+ * @see ImageBuffer::mLength
+ * @see ImageBuffer::mCapacity
+ */
+void ImageBuffer::resize(size_t length)
+{
+	CameraException ce;
+
+	if(length > mCapacity)
+	{
+		ce.message = "ImageBuffer::resize:Length " + std::to_string(length) + " is more than the capacity " +
+			std::to_string(mCapacity) + ".";
+		LOG4CXX_ERROR(logger,ce.message);
+		throw ce;
+	}
+	mLength = length;
+}
@@ -0,0 +1,77 @@
+/**
+ * @file
+ * @brief ImageBuffer.h declares a fixed capacity image buffer, normally taken from a CCD library buffer pool and
+ *        returned to it when the buffer is destroyed.
+ * @author Chris Mottram
+ * @version $Id$
+ */
+#ifndef IMAGEBUFFER_H
+#define IMAGEBUFFER_H
+#include <cstddef>
+#include <cstdint>
+#include "ccd_setup.h"
+
+/**
+ * A fixed capacity buffer of unsigned 16-bit pixels, with a length (the number of pixels in the image it holds)
+ * that can be changed without reallocating. The memory either comes from a CCD library buffer pool
+ * (and is returned to it by the destructor), or is allocated by the buffer itself if the pool has run out.
+ * It cannot be copied, and is shared between the exposure threads, the frame history and downloading clients
+ * using a std::shared_ptr.
+ * @see CCD_Setup_Buffer_Pool_Struct
+ */
+class ImageBuffer
+{
+  public:
+	ImageBuffer(struct CCD_Setup_Buffer_Pool_Struct *pool,uint16_t *buffer);
+	ImageBuffer(size_t capacity);
+	~ImageBuffer();
+	ImageBuffer(const ImageBuffer &) = delete;
+	ImageBuffer & operator=(const ImageBuffer &) = delete;
+	void resize(size_t length);
+	/**
+	 * Return the address of the pixel data.
+	 */
+	uint16_t *data() { return mBuffer; }
+	/**
+	 * Return the address of the pixel data.
+	 */
+	const uint16_t *data() const { return mBuffer; }
+	/**
+	 * Return the number of pixels in the image held in the buffer.
+	 */
+	size_t size() const { return mLength; }
+	/**
+	 * Return the maximum number of pixels the buffer can hold.
+	 */
+	size_t capacity() const { return mCapacity; }
+	/**
+	 * Return the address of the first pixel.
+	 */
+	const uint16_t *begin() const { return mBuffer; }
+	/**
+	 * Return the address after the last pixel in the image.
+	 */
+	const uint16_t *end() const { return mBuffer+mLength; }
+	/**
+	 * Return whether the buffer came from a buffer pool.
+	 */
+	bool is_pooled() const { return mPool != NULL; }
+  private:
+	/**
+	 * The buffer pool the memory was taken from, or NULL if the memory was allocated by this object.
+	 */
+	struct CCD_Setup_Buffer_Pool_Struct *mPool;
+	/**
+	 * The pixel data.
+	 */
+	uint16_t *mBuffer;
+	/**
+	 * The number of pixels in the image held in the buffer.
+	 */
+	size_t mLength;
+	/**
+	 * The maximum number of pixels the buffer can hold.
+	 */
+	size_t mCapacity;
+};
+#endif
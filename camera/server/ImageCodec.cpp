@@ -0,0 +1,437 @@
+/**
+ * @file
+ * @brief ImageCodec.cpp implements the routines used by get_image_data_compressed to compress an image, in tiles of
+ *        whole rows compressed in parallel, with one of the ImageCodec codecs, and the matching decoder for
+ *        C++ clients.
+ * @author Chris Mottram
+ * @version $Id$
+ */
+#include "ImageCodec.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <thread>
+#include <lz4.h>
+#include <zstd.h>
+
+/* CFITSIO's Rice coder (as used by FITS tile compression), declared in CFITSIO's fitsio2.h rather than fitsio.h */
+extern "C"
+{
+	int fits_rcomp_short(short a[],int nx,unsigned char *c,int clen,int nblock);
+	int fits_rdecomp_short(unsigned char *c,int clen,unsigned short array[],int nx,int nblock);
+}
+
+static bool compress_tile(const uint16_t *pixels,size_t pixel_count,ImageCodec::type codec,int zstd_level,
+			  std::string &tile,std::string &error_message);
+static bool decompress_tile(const char *tile,size_t tile_size,ImageCodec::type codec,uint16_t *pixels,
+			    size_t pixel_count,std::string &error_message);
+static void shuffle_pixels(const uint16_t *pixels,size_t pixel_count,char *bytes);
+static void unshuffle_pixels(const char *bytes,size_t pixel_count,uint16_t *pixels);
+static bool for_each_tile(int tile_count,int thread_count,
+			  const std::function<bool(int tile_index,std::string &error_message)> &tile_function,
+			  std::string &error_message);
+
+/**
+ * Return the list of codecs images can be compressed with.
+ * @param codecs On return, the list of ImageCodec supported, in increasing enumeration order.
+ * @see ImageCodec
+ */
+void image_codec_list(std::vector<ImageCodec::type> &codecs)
+{
+	codecs = {ImageCodec::NONE,ImageCodec::SHUFFLE_LZ4,ImageCodec::RICE,ImageCodec::SHUFFLE_ZSTD};
+}
+
+/**
+ * Return whether images can be compressed with a codec.
+ * @param codec The ImageCodec.
+ * @return The routine returns true if the codec is supported, and false if it is not (for instance an out of range
+ *         enumeration value sent by a client).
+ * @see image_codec_list
+ */
+bool image_codec_is_supported(ImageCodec::type codec)
+{
+	std::vector<ImageCodec::type> codecs;
+
+	image_codec_list(codecs);
+	return std::find(codecs.begin(),codecs.end(),codec) != codecs.end();
+}
+
+/**
+ * Compress an image with a codec. The image is split into tiles of config.mTileRows rows (the last tile may have
+ * fewer rows), which are compressed independently by config.mThreadCount threads, and then concatenated in order
+ * into the compressed data.
+ * @param image The image, ncols x nrows pixels.
+ * @param ncols The number of binned columns in the image.
+ * @param nrows The number of binned rows in the image.
+ * @param codec The ImageCodec to compress the image with.
+ * @param config How to compress the image (tile size, thread count and Zstandard compression level).
+ * @param compressed The CompressedImageData to fill in with the codec, image dimensions, tile_rows, tile_sizes and
+ *        the compressed data. The binning and frame_sequence are left for the caller to fill in.
+ * @param error_message If the codec is not supported, or a tile failed to compress, on return this contains
+ *        a description of the problem.
+ * @return The routine returns true if the image was compressed, and false if it was not.
+ * @see image_codec_is_supported
+ * @see compress_tile
+ * @see for_each_tile
+ * @see ImageCodecConfig
+ * @see CompressedImageData
+ */
+bool image_codec_compress(const uint16_t *image,int ncols,int nrows,ImageCodec::type codec,
+			  const ImageCodecConfig &config,CompressedImageData &compressed,std::string &error_message)
+{
+	std::vector<std::string> tiles;
+	size_t data_size;
+	int tile_rows,tile_count,i;
+
+	if(!image_codec_is_supported(codec))
+	{
+		error_message = "Unsupported image codec "+std::to_string((int)codec)+".";
+		return false;
+	}
+	if((ncols < 1)||(nrows < 1))
+	{
+		error_message = "Illegal image size "+std::to_string(ncols)+"x"+std::to_string(nrows)+".";
+		return false;
+	}
+	tile_rows = std::min(std::max(config.mTileRows,1),nrows);
+	tile_count = (nrows+tile_rows-1)/tile_rows;
+	tiles.resize(tile_count);
+	if(!for_each_tile(tile_count,config.mThreadCount,[&](int tile_index,std::string &tile_error_message)
+		{
+			int first_row = tile_index*tile_rows;
+			int row_count = std::min(tile_rows,nrows-first_row);
+
+			return compress_tile(image+(((size_t)first_row)*ncols),((size_t)row_count)*ncols,codec,
+					     config.mZstdLevel,tiles[tile_index],tile_error_message);
+		},error_message))
+	{
+		return false;
+	}
+	compressed.codec = codec;
+	compressed.x_size = ncols;
+	compressed.y_size = nrows;
+	compressed.tile_rows = tile_rows;
+	compressed.tile_sizes.resize(tile_count);
+	data_size = 0;
+	for(i = 0; i < tile_count; i++)
+	{
+		compressed.tile_sizes[i] = (int32_t)tiles[i].size();
+		data_size += tiles[i].size();
+	}
+	compressed.data.clear();
+	compressed.data.reserve(data_size);
+	for(i = 0; i < tile_count; i++)
+		compressed.data.append(tiles[i]);
+	return true;
+}
+
+/**
+ * Decompress an image compressed by image_codec_compress. The tiles are decompressed in parallel.
+ * @param compressed The CompressedImageData to decompress.
+ * @param thread_count The number of threads to decompress the tiles with.
+ * @param image On return, the decompressed image, compressed.x_size x compressed.y_size pixels (in host byte order).
+ * @param error_message If the compressed data is malformed, on return this contains a description of the problem.
+ * @return The routine returns true if the image was decompressed, and false if it was not.
+ * @see decompress_tile
+ * @see for_each_tile
+ * @see CompressedImageData
+ */
+bool image_codec_decompress(const CompressedImageData &compressed,int thread_count,std::vector<uint16_t> &image,
+			    std::string &error_message)
+{
+	std::vector<size_t> tile_offsets;
+	size_t data_size;
+	int tile_count,i;
+
+	if(!image_codec_is_supported(compressed.codec))
+	{
+		error_message = "Unsupported image codec "+std::to_string((int)compressed.codec)+".";
+		return false;
+	}
+	if((compressed.x_size < 1)||(compressed.y_size < 1)||(compressed.tile_rows < 1))
+	{
+		error_message = "Illegal image size "+std::to_string(compressed.x_size)+"x"+
+			std::to_string(compressed.y_size)+" with "+std::to_string(compressed.tile_rows)+
+			" rows per tile.";
+		return false;
+	}
+	tile_count = (compressed.y_size+compressed.tile_rows-1)/compressed.tile_rows;
+	if((int)compressed.tile_sizes.size() != tile_count)
+	{
+		error_message = "Expected "+std::to_string(tile_count)+" tiles, but there are "+
+			std::to_string(compressed.tile_sizes.size())+" tile sizes.";
+		return false;
+	}
+	tile_offsets.resize(tile_count);
+	data_size = 0;
+	for(i = 0; i < tile_count; i++)
+	{
+		if(compressed.tile_sizes[i] < 0)
+		{
+			error_message = "Tile "+std::to_string(i)+" has an illegal size "+
+				std::to_string(compressed.tile_sizes[i])+".";
+			return false;
+		}
+		tile_offsets[i] = data_size;
+		data_size += compressed.tile_sizes[i];
+	}
+	if(data_size != compressed.data.size())
+	{
+		error_message = "The tile sizes add up to "+std::to_string(data_size)+" bytes, but there are "+
+			std::to_string(compressed.data.size())+" bytes of data.";
+		return false;
+	}
+	image.resize(((size_t)compressed.x_size)*((size_t)compressed.y_size));
+	return for_each_tile(tile_count,thread_count,[&](int tile_index,std::string &tile_error_message)
+		{
+			int first_row = tile_index*compressed.tile_rows;
+			int row_count = std::min(compressed.tile_rows,compressed.y_size-first_row);
+
+			return decompress_tile(compressed.data.data()+tile_offsets[tile_index],
+					       compressed.tile_sizes[tile_index],compressed.codec,
+					       image.data()+(((size_t)first_row)*compressed.x_size),
+					       ((size_t)row_count)*compressed.x_size,tile_error_message);
+		},error_message);
+}
+
+/**
+ * Compress one tile of an image.
+ * <ul>
+ * <li><b>NONE</b> We copy the pixels, little-endian.
+ * <li><b>SHUFFLE_LZ4</b> We byte shuffle the pixels (shuffle_pixels), and compress them with LZ4_compress_default.
+ * <li><b>RICE</b> We subtract 32768 from each pixel (as FITS tile compression does for unsigned 16-bit data with
+ *     BZERO = 32768), and Rice code the signed pixels with fits_rcomp_short.
+ * <li><b>SHUFFLE_ZSTD</b> We byte shuffle the pixels, and compress them with ZSTD_compress.
+ * </ul>
+ * @param pixels The tile's pixels.
+ * @param pixel_count The number of pixels in the tile.
+ * @param codec The ImageCodec to compress the tile with.
+ * @param zstd_level The Zstandard compression level, used by SHUFFLE_ZSTD.
+ * @param tile On return, the compressed tile.
+ * @param error_message If the tile failed to compress, on return this contains a description of the problem.
+ * @return The routine returns true if the tile was compressed, and false if it was not.
+ * @see shuffle_pixels
+ * @see #IMAGE_CODEC_RICE_BLOCK_SIZE
+ */
+static bool compress_tile(const uint16_t *pixels,size_t pixel_count,ImageCodec::type codec,int zstd_level,
+			  std::string &tile,std::string &error_message)
+{
+	std::string shuffled;
+	std::vector<short> signed_pixels;
+	size_t byte_count = pixel_count*sizeof(uint16_t);
+	size_t tile_size;
+	int compressed_size;
+
+	switch(codec)
+	{
+		case ImageCodec::NONE:
+			tile.assign((const char*)pixels,byte_count);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+			for(size_t i = 0; i < tile.size(); i += 2)
+				std::swap(tile[i],tile[i+1]);
+#endif
+			return true;
+		case ImageCodec::SHUFFLE_LZ4:
+			shuffled.resize(byte_count);
+			shuffle_pixels(pixels,pixel_count,&(shuffled[0]));
+			tile.resize(LZ4_compressBound((int)byte_count));
+			compressed_size = LZ4_compress_default(shuffled.data(),&(tile[0]),(int)byte_count,
+							       (int)tile.size());
+			if(compressed_size <= 0)
+			{
+				error_message = "LZ4_compress_default failed to compress "+std::to_string(byte_count)+
+					" bytes.";
+				return false;
+			}
+			tile.resize(compressed_size);
+			return true;
+		case ImageCodec::RICE:
+			signed_pixels.resize(pixel_count);
+			for(size_t i = 0; i < pixel_count; i++)
+				signed_pixels[i] = (short)(pixels[i]^0x8000);
+			/* incompressible blocks are stored as 16 bits per pixel, plus a 4 bit code per block */
+			tile.resize(byte_count+(pixel_count/16)+64);
+			compressed_size = fits_rcomp_short(signed_pixels.data(),(int)pixel_count,
+							   (unsigned char*)&(tile[0]),(int)tile.size(),
+							   IMAGE_CODEC_RICE_BLOCK_SIZE);
+			if(compressed_size < 0)
+			{
+				error_message = "fits_rcomp_short failed to compress "+std::to_string(pixel_count)+
+					" pixels.";
+				return false;
+			}
+			tile.resize(compressed_size);
+			return true;
+		case ImageCodec::SHUFFLE_ZSTD:
+			shuffled.resize(byte_count);
+			shuffle_pixels(pixels,pixel_count,&(shuffled[0]));
+			tile.resize(ZSTD_compressBound(byte_count));
+			tile_size = ZSTD_compress(&(tile[0]),tile.size(),shuffled.data(),byte_count,zstd_level);
+			if(ZSTD_isError(tile_size))
+			{
+				error_message = "ZSTD_compress failed:"+std::string(ZSTD_getErrorName(tile_size));
+				return false;
+			}
+			tile.resize(tile_size);
+			return true;
+		default:
+			error_message = "Unsupported image codec "+std::to_string((int)codec)+".";
+			return false;
+	}
+}
+
+/**
+ * Decompress one tile of an image compressed by compress_tile.
+ * @param tile The compressed tile.
+ * @param tile_size The number of bytes in the compressed tile.
+ * @param codec The ImageCodec the tile was compressed with.
+ * @param pixels Where to put the tile's decompressed pixels.
+ * @param pixel_count The number of pixels in the tile.
+ * @param error_message If the tile failed to decompress (or decompressed to the wrong number of pixels), on return
+ *        this contains a description of the problem.
+ * @return The routine returns true if the tile was decompressed, and false if it was not.
+ * @see compress_tile
+ * @see unshuffle_pixels
+ * @see #IMAGE_CODEC_RICE_BLOCK_SIZE
+ */
+static bool decompress_tile(const char *tile,size_t tile_size,ImageCodec::type codec,uint16_t *pixels,
+			    size_t pixel_count,std::string &error_message)
+{
+	std::string shuffled;
+	size_t byte_count = pixel_count*sizeof(uint16_t);
+	size_t decompressed_size;
+
+	switch(codec)
+	{
+		case ImageCodec::NONE:
+			if(tile_size != byte_count)
+			{
+				error_message = "Uncompressed tile has "+std::to_string(tile_size)+" bytes, expected "+
+					std::to_string(byte_count)+".";
+				return false;
+			}
+			memcpy(pixels,tile,byte_count);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+			for(size_t i = 0; i < pixel_count; i++)
+				pixels[i] = __builtin_bswap16(pixels[i]);
+#endif
+			return true;
+		case ImageCodec::SHUFFLE_LZ4:
+			shuffled.resize(byte_count);
+			if(LZ4_decompress_safe(tile,&(shuffled[0]),(int)tile_size,(int)byte_count) != (int)byte_count)
+			{
+				error_message = "LZ4_decompress_safe failed to decompress a "+std::to_string(tile_size)+
+					" byte tile into "+std::to_string(byte_count)+" bytes.";
+				return false;
+			}
+			unshuffle_pixels(shuffled.data(),pixel_count,pixels);
+			return true;
+		case ImageCodec::RICE:
+			if(fits_rdecomp_short((unsigned char*)tile,(int)tile_size,pixels,(int)pixel_count,
+					      IMAGE_CODEC_RICE_BLOCK_SIZE) != 0)
+			{
+				error_message = "fits_rdecomp_short failed to decompress a "+std::to_string(tile_size)+
+					" byte tile into "+std::to_string(pixel_count)+" pixels.";
+				return false;
+			}
+			for(size_t i = 0; i < pixel_count; i++)
+				pixels[i] ^= 0x8000;
+			return true;
+		case ImageCodec::SHUFFLE_ZSTD:
+			shuffled.resize(byte_count);
+			decompressed_size = ZSTD_decompress(&(shuffled[0]),byte_count,tile,tile_size);
+			if(ZSTD_isError(decompressed_size)||(decompressed_size != byte_count))
+			{
+				error_message = "ZSTD_decompress failed to decompress a "+std::to_string(tile_size)+
+					" byte tile into "+std::to_string(byte_count)+" bytes.";
+				return false;
+			}
+			unshuffle_pixels(shuffled.data(),pixel_count,pixels);
+			return true;
+		default:
+			error_message = "Unsupported image codec "+std::to_string((int)codec)+".";
+			return false;
+	}
+}
+
+/**
+ * Byte shuffle some pixels: the low bytes of all the pixels, followed by the high bytes of all the pixels.
+ * The high bytes of a frame vary little, so once shuffled they compress much better.
+ * @param pixels The pixels to shuffle.
+ * @param pixel_count The number of pixels.
+ * @param bytes Where to put the shuffled bytes, pixel_count*2 bytes long.
+ */
+static void shuffle_pixels(const uint16_t *pixels,size_t pixel_count,char *bytes)
+{
+	for(size_t i = 0; i < pixel_count; i++)
+	{
+		bytes[i] = (char)(pixels[i]&0xff);
+		bytes[pixel_count+i] = (char)(pixels[i] >> 8);
+	}
+}
+
+/**
+ * Undo shuffle_pixels.
+ * @param bytes The shuffled bytes, pixel_count*2 bytes long.
+ * @param pixel_count The number of pixels.
+ * @param pixels Where to put the pixels.
+ * @see shuffle_pixels
+ */
+static void unshuffle_pixels(const char *bytes,size_t pixel_count,uint16_t *pixels)
+{
+	for(size_t i = 0; i < pixel_count; i++)
+		pixels[i] = (uint16_t)(((unsigned char)bytes[i])|(((unsigned char)bytes[pixel_count+i]) << 8));
+}
+
+/**
+ * Call a function for each tile of an image, using up to thread_count threads (including the calling thread).
+ * Each thread takes the next tile not yet started, so a tile that is slow to compress does not hold up the others.
+ * @param tile_count The number of tiles.
+ * @param thread_count The number of threads to use. Values less than one are treated as one.
+ * @param tile_function The function to call for each tile, which is passed the tile index and an error message to
+ *        fill in, and returns false if the tile failed.
+ * @param error_message If a tile failed, on return this contains the error message of the first tile that failed.
+ * @return The routine returns true if every tile succeeded, and false if any tile failed.
+ */
+static bool for_each_tile(int tile_count,int thread_count,
+			  const std::function<bool(int tile_index,std::string &error_message)> &tile_function,
+			  std::string &error_message)
+{
+	std::vector<std::thread> threads;
+	std::vector<std::string> thread_error_messages;
+	std::atomic<int> next_tile(0);
+	std::atomic<bool> failed(false);
+	int i;
+
+	thread_count = std::max(1,std::min(thread_count,tile_count));
+	thread_error_messages.resize(thread_count);
+	auto worker = [&](int thread_index)
+		{
+			int tile_index;
+
+			while((!failed)&&((tile_index = next_tile++) < tile_count))
+			{
+				if(!tile_function(tile_index,thread_error_messages[thread_index]))
+					failed = true;
+			}
+		};
+	for(i = 1; i < thread_count; i++)
+		threads.emplace_back(worker,i);
+	worker(0);
+	for(std::thread &thread : threads)
+		thread.join();
+	if(failed)
+	{
+		for(i = 0; i < thread_count; i++)
+		{
+			if(thread_error_messages[i].size() > 0)
+			{
+				error_message = thread_error_messages[i];
+				break;
+			}
+		}
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,58 @@
+/**
+ * @file
+ * @brief ImageCodec.h declares the routines used by get_image_data_compressed to compress an image, in tiles of whole
+ *        rows compressed in parallel, with one of the ImageCodec codecs, and the matching decoder for C++ clients.
+ * @author Chris Mottram
+ * @version $Id$
+ */
+#ifndef IMAGECODEC_H
+#define IMAGECODEC_H
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "CameraService.h"
+
+/**
+ * The default number of image rows in each compressed tile.
+ */
+#define IMAGE_CODEC_DEFAULT_TILE_ROWS    (64)
+/**
+ * The default number of threads used to compress the tiles of an image.
+ */
+#define IMAGE_CODEC_DEFAULT_THREAD_COUNT (4)
+/**
+ * The default Zstandard compression level used by the SHUFFLE_ZSTD codec. Low levels are much faster, and on
+ * shuffled 16-bit data compress almost as well as the higher levels.
+ */
+#define IMAGE_CODEC_DEFAULT_ZSTD_LEVEL   (1)
+/**
+ * The block size (in pixels) used by the RICE codec, the same as the FITS tile compression default.
+ */
+#define IMAGE_CODEC_RICE_BLOCK_SIZE      (32)
+
+/**
+ * Structure holding how images are compressed.
+ * <ul>
+ * <li><b>mTileRows</b> The number of image rows in each compressed tile.
+ * <li><b>mThreadCount</b> The number of threads the tiles are compressed by.
+ * <li><b>mZstdLevel</b> The Zstandard compression level used by the SHUFFLE_ZSTD codec.
+ * </ul>
+ * @see #IMAGE_CODEC_DEFAULT_TILE_ROWS
+ * @see #IMAGE_CODEC_DEFAULT_THREAD_COUNT
+ * @see #IMAGE_CODEC_DEFAULT_ZSTD_LEVEL
+ */
+struct ImageCodecConfig
+{
+	int mTileRows = IMAGE_CODEC_DEFAULT_TILE_ROWS;
+	int mThreadCount = IMAGE_CODEC_DEFAULT_THREAD_COUNT;
+	int mZstdLevel = IMAGE_CODEC_DEFAULT_ZSTD_LEVEL;
+};
+
+extern void image_codec_list(std::vector<ImageCodec::type> &codecs);
+extern bool image_codec_is_supported(ImageCodec::type codec);
+extern bool image_codec_compress(const uint16_t *image,int ncols,int nrows,ImageCodec::type codec,
+				 const ImageCodecConfig &config,CompressedImageData &compressed,
+				 std::string &error_message);
+extern bool image_codec_decompress(const CompressedImageData &compressed,int thread_count,
+				   std::vector<uint16_t> &image,std::string &error_message);
+#endif
@@ -0,0 +1,602 @@
+/**
+ * @file
+ * @brief ImagePreview.cpp implements the routines used by get_preview to render an 8-bit preview of an image:
+ *        downsampling, stretching (zscale, percentile or asinh) and PNG encoding.
+ * @author Chris Mottram
+ * @version $Id$
+ */
+#include "ImagePreview.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <thread>
+#include <zlib.h>
+
+static void zscale_limits(const std::vector<uint16_t> &pixels,double &black_level,double &white_level);
+static double histogram_percentile(const std::vector<size_t> &histogram,size_t pixel_count,double percentile);
+static int deflate_band(const uint8_t *pixels,int width,int first_row,int last_row,bool last_band,
+			std::string &deflated,uLong &adler);
+static void png_append_chunk(std::string &png,const char *type,const std::string &data);
+static void png_append_uint32(std::string &png,uint32_t value);
+static void for_each_band(int row_count,int thread_count,
+			  const std::function<void(int first_row,int last_row)> &band_function);
+
+/**
+ * Work out the downsampling factor needed to fit an image into a preview.
+ * @param ncols The number of binned columns in the image.
+ * @param nrows The number of binned rows in the image.
+ * @param max_width The maximum number of columns in the preview.
+ * @param max_height The maximum number of rows in the preview.
+ * @return The smallest integer factor (at least one) such that ceil(ncols/factor) <= max_width and
+ *         ceil(nrows/factor) <= max_height.
+ */
+int image_preview_factor(int ncols,int nrows,int max_width,int max_height)
+{
+	int factor;
+
+	max_width = std::max(max_width,1);
+	max_height = std::max(max_height,1);
+	factor = std::max((ncols+max_width-1)/max_width,(nrows+max_height-1)/max_height);
+	return std::max(factor,1);
+}
+
+/**
+ * Downsample an image by an integer factor. Each output pixel is made from a factor x factor block of image pixels,
+ * the blocks on the right and bottom edges of the image only using the pixels that exist.
+ * Each thread downsamples a band of output rows: the image rows of a block are first reduced into a per-column
+ * accumulator (a simple loop over whole rows that the compiler vectorises), which is then reduced along each block
+ * of columns.
+ * @param image The image, ncols x nrows pixels.
+ * @param ncols The number of binned columns in the image.
+ * @param nrows The number of binned rows in the image.
+ * @param factor The downsampling factor.
+ * @param downsample How to reduce each block: the (rounded) mean or the maximum.
+ * @param thread_count The number of threads to use.
+ * @param downsampled On return, the downsampled image, ceil(ncols/factor) x ceil(nrows/factor) pixels.
+ * @param error_message If the parameters are illegal, on return this contains a description of the problem.
+ * @return The routine returns true if the image was downsampled, and false if it was not.
+ * @see for_each_band
+ */
+bool image_preview_downsample(const uint16_t *image,int ncols,int nrows,int factor,
+			      PreviewDownsample::type downsample,int thread_count,
+			      std::vector<uint16_t> &downsampled,std::string &error_message)
+{
+	int width,height;
+
+	if((ncols < 1)||(nrows < 1))
+	{
+		error_message = "Illegal image size "+std::to_string(ncols)+"x"+std::to_string(nrows)+".";
+		return false;
+	}
+	if(factor < 1)
+	{
+		error_message = "Illegal downsampling factor "+std::to_string(factor)+".";
+		return false;
+	}
+	if((downsample != PreviewDownsample::AVERAGE)&&(downsample != PreviewDownsample::MAX))
+	{
+		error_message = "Unsupported preview downsample "+std::to_string((int)downsample)+".";
+		return false;
+	}
+	width = (ncols+factor-1)/factor;
+	height = (nrows+factor-1)/factor;
+	downsampled.resize(((size_t)width)*((size_t)height));
+	if(factor == 1)
+	{
+		std::copy(image,image+downsampled.size(),downsampled.begin());
+		return true;
+	}
+	for_each_band(height,thread_count,[&](int first_row,int last_row)
+		{
+			std::vector<uint32_t> column_accumulator(ncols);
+			uint32_t *accumulator = column_accumulator.data();
+
+			for(int out_y = first_row; out_y < last_row; out_y++)
+			{
+				int y0 = out_y*factor;
+				int y1 = std::min(y0+factor,nrows);
+				const uint16_t *row = image+(((size_t)y0)*ncols);
+				uint16_t *out_row = downsampled.data()+(((size_t)out_y)*width);
+
+				for(int x = 0; x < ncols; x++)
+					accumulator[x] = row[x];
+				for(int y = y0+1; y < y1; y++)
+				{
+					row = image+(((size_t)y)*ncols);
+					if(downsample == PreviewDownsample::MAX)
+					{
+						for(int x = 0; x < ncols; x++)
+							accumulator[x] = std::max(accumulator[x],(uint32_t)row[x]);
+					}
+					else
+					{
+						for(int x = 0; x < ncols; x++)
+							accumulator[x] += row[x];
+					}
+				}
+				for(int out_x = 0; out_x < width; out_x++)
+				{
+					int x0 = out_x*factor;
+					int x1 = std::min(x0+factor,ncols);
+					uint64_t value = accumulator[x0];
+
+					for(int x = x0+1; x < x1; x++)
+					{
+						if(downsample == PreviewDownsample::MAX)
+							value = std::max(value,(uint64_t)accumulator[x]);
+						else
+							value += accumulator[x];
+					}
+					if(downsample == PreviewDownsample::AVERAGE)
+					{
+						uint64_t count = ((uint64_t)(x1-x0))*((uint64_t)(y1-y0));
+
+						value = (value+(count/2))/count;
+					}
+					out_row[out_x] = (uint16_t)value;
+				}
+			}
+		});
+	return true;
+}
+
+/**
+ * Work out the black and white levels of a preview stretch.
+ * <ul>
+ * <li>ZSCALE uses the IRAF zscale algorithm (see zscale_limits).
+ * <li>PERCENTILE uses the IMAGE_PREVIEW_LOW_PERCENTILE and IMAGE_PREVIEW_HIGH_PERCENTILE pixel values.
+ * <li>ASINH uses the IMAGE_PREVIEW_LOW_PERCENTILE pixel value and the maximum pixel value.
+ * </ul>
+ * The percentiles are found from a histogram of the 16-bit pixel values, rather than by sorting the pixels.
+ * If the black and white levels come out the same (a flat image), the white level is set one above the black level.
+ * @param pixels The (downsampled) pixels.
+ * @param stretch The PreviewStretch.
+ * @param black_level On return, the pixel value mapped to 0.
+ * @param white_level On return, the pixel value mapped to 255.
+ * @param error_message If there are no pixels or the stretch is not supported, on return this contains a
+ *        description of the problem.
+ * @return The routine returns true if the limits were found, and false if they were not.
+ * @see #IMAGE_PREVIEW_LOW_PERCENTILE
+ * @see #IMAGE_PREVIEW_HIGH_PERCENTILE
+ * @see zscale_limits
+ * @see histogram_percentile
+ */
+bool image_preview_stretch_limits(const std::vector<uint16_t> &pixels,PreviewStretch::type stretch,
+				  double &black_level,double &white_level,std::string &error_message)
+{
+	std::vector<size_t> histogram;
+
+	if(pixels.size() == 0)
+	{
+		error_message = "There are no pixels to stretch.";
+		return false;
+	}
+	switch(stretch)
+	{
+		case PreviewStretch::ZSCALE:
+			zscale_limits(pixels,black_level,white_level);
+			break;
+		case PreviewStretch::PERCENTILE:
+		case PreviewStretch::ASINH:
+			histogram.assign(65536,0);
+			for(uint16_t pixel : pixels)
+				histogram[pixel]++;
+			black_level = histogram_percentile(histogram,pixels.size(),IMAGE_PREVIEW_LOW_PERCENTILE);
+			if(stretch == PreviewStretch::PERCENTILE)
+				white_level = histogram_percentile(histogram,pixels.size(),IMAGE_PREVIEW_HIGH_PERCENTILE);
+			else
+				white_level = histogram_percentile(histogram,pixels.size(),100.0);
+			break;
+		default:
+			error_message = "Unsupported preview stretch "+std::to_string((int)stretch)+".";
+			return false;
+	}
+	if(white_level <= black_level)
+		white_level = black_level+1.0;
+	return true;
+}
+
+/**
+ * Encode an 8-bit greyscale image as a PNG.
+ * <ul>
+ * <li>We split the rows into one band per thread. Each thread filters the rows of it's band with the PNG "Sub"
+ *     filter (the difference from the pixel to the left, which suits smooth astronomical images), and deflates
+ *     them as an independent raw deflate stream (deflate_band).
+ * <li>We concatenate the deflated bands, between a zlib header and the Adler-32 checksum of all the filtered rows
+ *     (combined from the checksums of the bands), to make the zlib stream of the PNG's IDAT chunk.
+ * <li>We write the PNG signature, and the IHDR, IDAT and IEND chunks.
+ * </ul>
+ * @param pixels The image, width x height 8-bit pixels in row-major order.
+ * @param width The number of columns in the image.
+ * @param height The number of rows in the image.
+ * @param thread_count The number of threads to deflate the image with.
+ * @param png On return, the PNG file contents.
+ * @param error_message If the image could not be encoded, on return this contains a description of the problem.
+ * @return The routine returns true if the image was encoded, and false if it was not.
+ * @see deflate_band
+ * @see for_each_band
+ * @see png_append_chunk
+ * @see png_append_uint32
+ */
+bool image_preview_png_encode(const uint8_t *pixels,int width,int height,int thread_count,std::string &png,
+			      std::string &error_message)
+{
+	std::vector<std::string> bands;
+	std::vector<uLong> band_adlers;
+	std::vector<int> band_retvals;
+	std::string header,deflated;
+	uLong adler;
+	int band_rows,band_count,band;
+
+	if((width < 1)||(height < 1))
+	{
+		error_message = "Illegal PNG size "+std::to_string(width)+"x"+std::to_string(height)+".";
+		return false;
+	}
+	/* the same bands as for_each_band uses */
+	thread_count = std::max(1,std::min(thread_count,height));
+	band_rows = (height+thread_count-1)/thread_count;
+	band_count = (height+band_rows-1)/band_rows;
+	bands.resize(band_count);
+	band_adlers.resize(band_count);
+	band_retvals.assign(band_count,Z_OK);
+	for_each_band(height,thread_count,[&](int first_row,int last_row)
+		{
+			int band_index = first_row/band_rows;
+
+			band_retvals[band_index] = deflate_band(pixels,width,first_row,last_row,(last_row == height),
+								bands[band_index],band_adlers[band_index]);
+		});
+	deflated.assign("\x78\x01",2); /* zlib header: deflate, 32k window, fastest compression */
+	adler = adler32(0L,Z_NULL,0);
+	for(band = 0; band < band_count; band++)
+	{
+		if(band_retvals[band] != Z_OK)
+		{
+			error_message = "Failed to deflate band "+std::to_string(band)+" of the PNG image data ("+
+				std::to_string(band_retvals[band])+").";
+			return false;
+		}
+		deflated.append(bands[band]);
+		adler = adler32_combine(adler,band_adlers[band],
+					((z_off_t)(std::min((band+1)*band_rows,height)-(band*band_rows)))*(width+1));
+	}
+	png_append_uint32(deflated,adler);
+	png.assign("\x89PNG\r\n\x1a\n",8);
+	png_append_uint32(header,width);
+	png_append_uint32(header,height);
+	header.push_back(8); /* bit depth */
+	header.push_back(0); /* colour type: greyscale */
+	header.push_back(0); /* compression method */
+	header.push_back(0); /* filter method */
+	header.push_back(0); /* interlace method: none */
+	png_append_chunk(png,"IHDR",header);
+	png_append_chunk(png,"IDAT",deflated);
+	png_append_chunk(png,"IEND",std::string());
+	return true;
+}
+
+/**
+ * Render an 8-bit preview of an image.
+ * <ul>
+ * <li>We work out the downsampling factor needed to fit the image within max_width x max_height.
+ * <li>We downsample the image.
+ * <li>We work out the black and white levels of the stretch from the downsampled pixels.
+ * <li>We build a lookup table mapping every 16-bit pixel value to an 8-bit preview value, so the stretch
+ *     (including the asinh) is only evaluated once per pixel value, and map the downsampled pixels through it.
+ * <li>If format is PNG, we encode the preview as a PNG.
+ * </ul>
+ * @param image The image, ncols x nrows pixels.
+ * @param ncols The number of binned columns in the image.
+ * @param nrows The number of binned rows in the image.
+ * @param max_width The maximum number of columns in the preview.
+ * @param max_height The maximum number of rows in the preview.
+ * @param stretch The PreviewStretch.
+ * @param downsample The PreviewDownsample.
+ * @param format The PreviewFormat to return the preview in.
+ * @param thread_count The number of threads to downsample and map the image with.
+ * @param preview The Preview to fill in with the data, width, height, factor, format, black_level and white_level.
+ *        The frame_sequence is left for the caller to fill in.
+ * @param error_message If the preview could not be rendered, on return this contains a description of the problem.
+ * @return The routine returns true if the preview was rendered, and false if it was not.
+ * @see #IMAGE_PREVIEW_ASINH_SOFTENING
+ * @see image_preview_factor
+ * @see image_preview_downsample
+ * @see image_preview_stretch_limits
+ * @see image_preview_png_encode
+ * @see for_each_band
+ */
+bool image_preview_create(const uint16_t *image,int ncols,int nrows,int max_width,int max_height,
+			  PreviewStretch::type stretch,PreviewDownsample::type downsample,
+			  PreviewFormat::type format,int thread_count,Preview &preview,std::string &error_message)
+{
+	std::vector<uint16_t> downsampled;
+	std::vector<uint8_t> lookup_table;
+	std::string raw;
+	double black_level,white_level,scaled;
+	int factor,width,height;
+
+	if((max_width < 1)||(max_height < 1))
+	{
+		error_message = "Illegal maximum preview size "+std::to_string(max_width)+"x"+
+			std::to_string(max_height)+".";
+		return false;
+	}
+	if((format != PreviewFormat::RAW)&&(format != PreviewFormat::PNG))
+	{
+		error_message = "Unsupported preview format "+std::to_string((int)format)+".";
+		return false;
+	}
+	factor = image_preview_factor(ncols,nrows,max_width,max_height);
+	if(!image_preview_downsample(image,ncols,nrows,factor,downsample,thread_count,downsampled,error_message))
+		return false;
+	width = (ncols+factor-1)/factor;
+	height = (nrows+factor-1)/factor;
+	if(!image_preview_stretch_limits(downsampled,stretch,black_level,white_level,error_message))
+		return false;
+	lookup_table.resize(65536);
+	for(int value = 0; value < 65536; value++)
+	{
+		scaled = std::min(std::max((value-black_level)/(white_level-black_level),0.0),1.0);
+		if(stretch == PreviewStretch::ASINH)
+			scaled = std::asinh(IMAGE_PREVIEW_ASINH_SOFTENING*scaled)/std::asinh(IMAGE_PREVIEW_ASINH_SOFTENING);
+		lookup_table[value] = (uint8_t)std::lround(scaled*255.0);
+	}
+	raw.resize(downsampled.size());
+	for_each_band(height,thread_count,[&](int first_row,int last_row)
+		{
+			for(size_t i = ((size_t)first_row)*width; i < ((size_t)last_row)*width; i++)
+				raw[i] = (char)lookup_table[downsampled[i]];
+		});
+	if(format == PreviewFormat::PNG)
+	{
+		if(!image_preview_png_encode((const uint8_t*)raw.data(),width,height,thread_count,preview.data,
+					     error_message))
+			return false;
+	}
+	else
+		preview.data = std::move(raw);
+	preview.width = width;
+	preview.height = height;
+	preview.factor = factor;
+	preview.format = format;
+	preview.black_level = black_level;
+	preview.white_level = white_level;
+	return true;
+}
+
+/**
+ * Work out the black and white levels of the ZSCALE stretch, using the IRAF zscale algorithm (as implemented by
+ * astropy's ZScaleInterval):
+ * <ul>
+ * <li>We take up to IMAGE_PREVIEW_ZSCALE_SAMPLES evenly spaced pixels and sort them.
+ * <li>We fit a straight line to the sorted samples, rejecting samples more than IMAGE_PREVIEW_ZSCALE_KREJ standard
+ *     deviations from the line (and their neighbours), for up to IMAGE_PREVIEW_ZSCALE_ITERATIONS iterations.
+ * <li>If enough samples are left, the limits are the median -/+ the line's slope (divided by
+ *     IMAGE_PREVIEW_ZSCALE_CONTRAST) times the number of samples either side of the median, clipped to the
+ *     sample range. Otherwise the limits are the sample range.
+ * </ul>
+ * @param pixels The (downsampled) pixels, at least one.
+ * @param black_level On return, the lower zscale limit.
+ * @param white_level On return, the upper zscale limit.
+ * @see #IMAGE_PREVIEW_ZSCALE_SAMPLES
+ * @see #IMAGE_PREVIEW_ZSCALE_CONTRAST
+ * @see #IMAGE_PREVIEW_ZSCALE_KREJ
+ * @see #IMAGE_PREVIEW_ZSCALE_ITERATIONS
+ */
+static void zscale_limits(const std::vector<uint16_t> &pixels,double &black_level,double &white_level)
+{
+	std::vector<double> samples;
+	std::vector<bool> bad,grown;
+	double sum_w,sum_x,sum_y,sum_xx,sum_xy,slope,intercept,flat,sum_flat,sum_flat2,threshold,median;
+	size_t stride,sample_count,good_count,last_good_count,min_good_count,grow,center,first,last,i,j;
+
+	stride = std::max((size_t)1,pixels.size()/IMAGE_PREVIEW_ZSCALE_SAMPLES);
+	for(i = 0; (i < pixels.size())&&(samples.size() < IMAGE_PREVIEW_ZSCALE_SAMPLES); i += stride)
+		samples.push_back(pixels[i]);
+	std::sort(samples.begin(),samples.end());
+	sample_count = samples.size();
+	black_level = samples[0];
+	white_level = samples[sample_count-1];
+	min_good_count = std::max((size_t)5,sample_count/2);
+	grow = std::max((size_t)1,sample_count/100);
+	bad.assign(sample_count,false);
+	good_count = sample_count;
+	slope = 0.0;
+	for(int iteration = 0; iteration < IMAGE_PREVIEW_ZSCALE_ITERATIONS; iteration++)
+	{
+		last_good_count = good_count;
+		/* least squares straight line fit to the good samples, y = intercept + slope*x */
+		sum_w = sum_x = sum_y = sum_xx = sum_xy = 0.0;
+		for(i = 0; i < sample_count; i++)
+		{
+			if(bad[i])
+				continue;
+			sum_w += 1.0;
+			sum_x += i;
+			sum_y += samples[i];
+			sum_xx += ((double)i)*i;
+			sum_xy += i*samples[i];
+		}
+		if((sum_w*sum_xx)-(sum_x*sum_x) <= 0.0)
+			break;
+		slope = ((sum_w*sum_xy)-(sum_x*sum_y))/((sum_w*sum_xx)-(sum_x*sum_x));
+		intercept = (sum_y-(slope*sum_x))/sum_w;
+		/* reject the good samples too far from the line */
+		sum_flat = sum_flat2 = 0.0;
+		for(i = 0; i < sample_count; i++)
+		{
+			if(bad[i])
+				continue;
+			flat = samples[i]-(intercept+(slope*i));
+			sum_flat += flat;
+			sum_flat2 += flat*flat;
+		}
+		threshold = IMAGE_PREVIEW_ZSCALE_KREJ*
+			std::sqrt(std::max((sum_flat2/sum_w)-((sum_flat/sum_w)*(sum_flat/sum_w)),0.0));
+		grown = bad;
+		for(i = 0; i < sample_count; i++)
+		{
+			flat = samples[i]-(intercept+(slope*i));
+			if((flat < -threshold)||(flat > threshold))
+			{
+				/* reject the neighbours of a rejected sample as well */
+				first = (i >= grow/2) ? i-(grow/2) : 0;
+				last = std::min(i-(grow/2)+grow,sample_count);
+				for(j = first; j < last; j++)
+					grown[j] = true;
+			}
+		}
+		bad = grown;
+		good_count = std::count(bad.begin(),bad.end(),false);
+		if((good_count >= last_good_count)||(good_count < min_good_count))
+			break;
+	}
+	if(good_count < min_good_count)
+		return;
+	slope /= IMAGE_PREVIEW_ZSCALE_CONTRAST;
+	center = (sample_count-1)/2;
+	if((sample_count%2) == 1)
+		median = samples[center];
+	else
+		median = (samples[center]+samples[center+1])/2.0;
+	black_level = std::max(black_level,median-((((double)center)-1.0)*slope));
+	white_level = std::min(white_level,median+((double)(sample_count-center))*slope);
+}
+
+/**
+ * Find a percentile of the pixel values from their histogram.
+ * @param histogram The number of pixels with each 16-bit value.
+ * @param pixel_count The total number of pixels in the histogram, at least one.
+ * @param percentile The percentile (0..100).
+ * @return The smallest pixel value such that at least percentile% of the pixels are less than or equal to it.
+ */
+static double histogram_percentile(const std::vector<size_t> &histogram,size_t pixel_count,double percentile)
+{
+	size_t target,count;
+
+	target = (size_t)std::ceil((percentile/100.0)*pixel_count);
+	target = std::min(std::max(target,(size_t)1),pixel_count);
+	count = 0;
+	for(size_t value = 0; value < histogram.size(); value++)
+	{
+		count += histogram[value];
+		if(count >= target)
+			return (double)value;
+	}
+	return (double)(histogram.size()-1);
+}
+
+/**
+ * Filter and deflate a band of rows of a PNG. Each row is prefixed by the PNG "Sub" filter type, and stores the
+ * difference of each pixel from the pixel to it's left. The filtered rows are deflated as a raw deflate stream with
+ * zlib's fastest level and run length encoding strategy, which on noisy images compresses as well as the default
+ * strategy in half the time. Bands other than the last are ended with a sync flush rather than finished, so the
+ * deflated bands can be concatenated into one deflate stream.
+ * @param pixels The image, 8-bit pixels in row-major order.
+ * @param width The number of columns in the image.
+ * @param first_row The first row of the band.
+ * @param last_row The row after the last row of the band.
+ * @param last_band Whether this is the last band of the image.
+ * @param deflated On return, the deflated band.
+ * @param adler On return, the Adler-32 checksum of the filtered rows.
+ * @return The routine returns Z_OK if the band was deflated, and a zlib error code if it was not.
+ */
+static int deflate_band(const uint8_t *pixels,int width,int first_row,int last_row,bool last_band,
+			std::string &deflated,uLong &adler)
+{
+	std::string filtered;
+	z_stream stream;
+	size_t row_size;
+	int retval;
+
+	row_size = ((size_t)width)+1;
+	filtered.resize(row_size*(last_row-first_row));
+	for(int y = first_row; y < last_row; y++)
+	{
+		const uint8_t *row = pixels+(((size_t)y)*width);
+		char *filtered_row = &(filtered[(y-first_row)*row_size]);
+
+		filtered_row[0] = 1; /* Sub filter */
+		filtered_row[1] = (char)row[0];
+		for(int x = 1; x < width; x++)
+			filtered_row[x+1] = (char)(uint8_t)(row[x]-row[x-1]);
+	}
+	adler = adler32(adler32(0L,Z_NULL,0),(const Bytef*)filtered.data(),filtered.size());
+	stream.zalloc = Z_NULL;
+	stream.zfree = Z_NULL;
+	stream.opaque = Z_NULL;
+	retval = deflateInit2(&stream,Z_BEST_SPEED,Z_DEFLATED,-15,8,Z_RLE);
+	if(retval != Z_OK)
+		return retval;
+	/* allow for the sync flush marker */
+	deflated.resize(deflateBound(&stream,filtered.size())+16);
+	stream.next_in = (Bytef*)filtered.data();
+	stream.avail_in = filtered.size();
+	stream.next_out = (Bytef*)&(deflated[0]);
+	stream.avail_out = deflated.size();
+	retval = deflate(&stream,last_band ? Z_FINISH : Z_SYNC_FLUSH);
+	deflated.resize(stream.total_out);
+	deflateEnd(&stream);
+	if(last_band)
+		return (retval == Z_STREAM_END) ? Z_OK : ((retval == Z_OK) ? Z_BUF_ERROR : retval);
+	return ((retval == Z_OK)&&(stream.avail_in == 0)) ? Z_OK : ((retval == Z_OK) ? Z_BUF_ERROR : retval);
+}
+
+/**
+ * Append a chunk to a PNG: the data length, the chunk type, the data, and the CRC of the type and data.
+ * @param png The PNG to append the chunk to.
+ * @param type The four character chunk type.
+ * @param data The chunk data.
+ * @see png_append_uint32
+ */
+static void png_append_chunk(std::string &png,const char *type,const std::string &data)
+{
+	uLong crc;
+
+	png_append_uint32(png,data.size());
+	png.append(type,4);
+	png.append(data);
+	crc = crc32(0L,(const Bytef*)type,4);
+	crc = crc32(crc,(const Bytef*)data.data(),data.size());
+	png_append_uint32(png,crc);
+}
+
+/**
+ * Append a 32-bit unsigned integer to a PNG, in network (big-endian) byte order.
+ * @param png The PNG to append the value to.
+ * @param value The value.
+ */
+static void png_append_uint32(std::string &png,uint32_t value)
+{
+	png.push_back((char)((value >> 24)&0xff));
+	png.push_back((char)((value >> 16)&0xff));
+	png.push_back((char)((value >> 8)&0xff));
+	png.push_back((char)(value&0xff));
+}
+
+/**
+ * Split some rows into contiguous bands, one per thread, and call a function for each band, using up to
+ * thread_count threads (including the calling thread).
+ * @param row_count The number of rows.
+ * @param thread_count The number of threads to use. Values less than one are treated as one.
+ * @param band_function The function to call for each band, which is passed the first row of the band and the row
+ *        after the last row of the band.
+ */
+static void for_each_band(int row_count,int thread_count,
+			  const std::function<void(int first_row,int last_row)> &band_function)
+{
+	std::vector<std::thread> threads;
+	int band_rows,i;
+
+	thread_count = std::max(1,std::min(thread_count,row_count));
+	band_rows = (row_count+thread_count-1)/thread_count;
+	for(i = 1; i < thread_count; i++)
+	{
+		if(i*band_rows < row_count)
+			threads.emplace_back(band_function,i*band_rows,std::min((i+1)*band_rows,row_count));
+	}
+	band_function(0,std::min(band_rows,row_count));
+	for(std::thread &thread : threads)
+		thread.join();
+}
@@ -0,0 +1,61 @@
+/**
+ * @file
+ * @brief ImagePreview.h declares the routines used by get_preview to render an 8-bit preview of an image:
+ *        downsampling, stretching (zscale, percentile or asinh) and PNG encoding.
+ * @author Chris Mottram
+ * @version $Id$
+ */
+#ifndef IMAGEPREVIEW_H
+#define IMAGEPREVIEW_H
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "CameraService.h"
+
+/**
+ * The default number of threads used to downsample and stretch an image into a preview.
+ */
+#define IMAGE_PREVIEW_DEFAULT_THREAD_COUNT (4)
+/**
+ * The maximum number of (downsampled) pixels sampled by the ZSCALE stretch.
+ */
+#define IMAGE_PREVIEW_ZSCALE_SAMPLES       (1000)
+/**
+ * The ZSCALE contrast: the slope of the fitted line is divided by this to get the display range.
+ */
+#define IMAGE_PREVIEW_ZSCALE_CONTRAST      (0.25)
+/**
+ * The ZSCALE rejection threshold, in standard deviations from the fitted line.
+ */
+#define IMAGE_PREVIEW_ZSCALE_KREJ          (2.5)
+/**
+ * The maximum number of ZSCALE line fitting / rejection iterations.
+ */
+#define IMAGE_PREVIEW_ZSCALE_ITERATIONS    (5)
+/**
+ * The percentile (0..100) of the pixel values used as the black level by the PERCENTILE and ASINH stretches.
+ */
+#define IMAGE_PREVIEW_LOW_PERCENTILE       (0.5)
+/**
+ * The percentile (0..100) of the pixel values used as the white level by the PERCENTILE stretch.
+ */
+#define IMAGE_PREVIEW_HIGH_PERCENTILE      (99.5)
+/**
+ * The softening of the ASINH stretch: the preview is asinh(softening*t)/asinh(softening), where t is the pixel's
+ * scaled (0..1) position between the black and white levels. Larger values brighten the faint pixels more.
+ */
+#define IMAGE_PREVIEW_ASINH_SOFTENING      (10.0)
+
+extern int image_preview_factor(int ncols,int nrows,int max_width,int max_height);
+extern bool image_preview_downsample(const uint16_t *image,int ncols,int nrows,int factor,
+				     PreviewDownsample::type downsample,int thread_count,
+				     std::vector<uint16_t> &downsampled,std::string &error_message);
+extern bool image_preview_stretch_limits(const std::vector<uint16_t> &pixels,PreviewStretch::type stretch,
+					 double &black_level,double &white_level,std::string &error_message);
+extern bool image_preview_png_encode(const uint8_t *pixels,int width,int height,int thread_count,std::string &png,
+				     std::string &error_message);
+extern bool image_preview_create(const uint16_t *image,int ncols,int nrows,int max_width,int max_height,
+				 PreviewStretch::type stretch,PreviewDownsample::type downsample,
+				 PreviewFormat::type format,int thread_count,Preview &preview,
+				 std::string &error_message);
+#endif
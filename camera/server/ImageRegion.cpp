@@ -0,0 +1,133 @@
+/**
+ * @file
+ * @brief ImageRegion.cpp implements the routines used by get_image_region to cut a (subsampled) region out of
+ *        a read out image, without copying the rest of the image.
+ * @author Chris Mottram
+ * @version $Id$
+ */
+#include "ImageRegion.h"
+#include <algorithm>
+#include <cstring>
+
+/**
+ * Check a requested region of an image, and clip it to the image. The region's geometry (x0, y0, width, height,
+ * step, x_size and y_size) is filled in, the pixels are copied later by image_region_copy.
+ * @param ncols The number of binned columns in the image.
+ * @param nrows The number of binned rows in the image.
+ * @param x0 The first column of the requested region, in binned pixels (starting from 0).
+ * @param y0 The first row of the requested region, in binned pixels (starting from 0).
+ * @param w The number of columns in the requested region. Must be at least 1.
+ * @param h The number of rows in the requested region. Must be at least 1.
+ * @param step The subsampling step, every step'th pixel of every step'th row is returned. Must be at least 1.
+ * @param region The ImageRegion to fill in with the clipped region's geometry.
+ * @param error_message If the region is illegal, or does not overlap the image at all, on return this contains
+ *        a description of the problem.
+ * @return The routine returns true if the region was legal, and false if it was not.
+ * @see ImageRegion
+ */
+bool image_region_clip(int ncols,int nrows,int32_t x0,int32_t y0,int32_t w,int32_t h,int32_t step,
+		       ImageRegion &region,std::string &error_message)
+{
+	int64_t x_start,y_start,x_end,y_end;
+
+	if((w < 1)||(h < 1))
+	{
+		error_message = "Illegal region size "+std::to_string(w)+"x"+std::to_string(h)+".";
+		return false;
+	}
+	if(step < 1)
+	{
+		error_message = "Illegal region step "+std::to_string(step)+".";
+		return false;
+	}
+	/* 64-bit, so a large x0+w does not overflow */
+	x_start = std::max((int64_t)x0,(int64_t)0);
+	y_start = std::max((int64_t)y0,(int64_t)0);
+	x_end = std::min(((int64_t)x0)+w,(int64_t)ncols);
+	y_end = std::min(((int64_t)y0)+h,(int64_t)nrows);
+	if((x_start >= x_end)||(y_start >= y_end))
+	{
+		error_message = "Region "+std::to_string(x0)+","+std::to_string(y0)+" "+std::to_string(w)+"x"+
+			std::to_string(h)+" does not overlap the "+std::to_string(ncols)+"x"+std::to_string(nrows)+
+			" image.";
+		return false;
+	}
+	region.x0 = (int32_t)x_start;
+	region.y0 = (int32_t)y_start;
+	region.width = (int32_t)(x_end-x_start);
+	region.height = (int32_t)(y_end-y_start);
+	region.step = step;
+	region.x_size = (region.width+step-1)/step;
+	region.y_size = (region.height+step-1)/step;
+	return true;
+}
+
+/**
+ * Fill in the binning of a clipped region, and the area of the detector (in unbinned pixels) it was read out from.
+ * The image may have been re-oriented after it was read out, so we use CCD_Orientation_Get_Source_Region to find
+ * the region of the image as read out, and then scale it by the binning and offset it by the start of the readout
+ * window.
+ * @param region The ImageRegion, whose geometry has been filled in by image_region_clip.
+ * @param orientation How the image was re-oriented after it was read out.
+ * @param ncols The number of binned columns in the (re-oriented) image.
+ * @param nrows The number of binned rows in the (re-oriented) image.
+ * @param xbin The horizontal binning the image was read out with.
+ * @param ybin The vertical binning the image was read out with.
+ * @param x_start The first detector column (unbinned, starting from 1) of the readout window.
+ * @param y_start The first detector row (unbinned, starting from 1) of the readout window.
+ * @see CCD_Orientation_Get_Dimensions
+ * @see CCD_Orientation_Get_Source_Region
+ */
+void image_region_set_detector_area(ImageRegion &region,enum CCD_ORIENTATION orientation,int ncols,int nrows,
+				    int xbin,int ybin,int x_start,int y_start)
+{
+	int readout_ncols,readout_nrows,source_x,source_y,source_width,source_height;
+
+	/* re-orienting the image back swaps the same axes */
+	CCD_Orientation_Get_Dimensions(orientation,ncols,nrows,&readout_ncols,&readout_nrows);
+	CCD_Orientation_Get_Source_Region(orientation,readout_ncols,readout_nrows,region.x0,region.y0,region.width,
+					  region.height,&source_x,&source_y,&source_width,&source_height);
+	region.xbin = (int8_t)xbin;
+	region.ybin = (int8_t)ybin;
+	region.detector_x_start = x_start+(source_x*xbin);
+	region.detector_y_start = y_start+(source_y*ybin);
+	region.detector_x_end = x_start+((source_x+source_width)*xbin)-1;
+	region.detector_y_end = y_start+((source_y+source_height)*ybin)-1;
+}
+
+/**
+ * Copy the pixels of a clipped region of an image into the region's data, as packed 16-bit pixels.
+ * Only the region's rows are touched: each row is copied with a single memcpy if the region is not subsampled,
+ * otherwise every step'th pixel is copied. On a big-endian host we byte swap each pixel so the returned data
+ * is always little-endian.
+ * @param image The image, ncols pixels per row.
+ * @param ncols The number of binned columns in the image.
+ * @param region The ImageRegion, whose geometry has been filled in by image_region_clip. On return the data
+ *        contains x_size*y_size pixels.
+ * @see image_region_clip
+ */
+void image_region_copy(const uint16_t *image,int ncols,ImageRegion &region)
+{
+	const uint16_t *row = NULL;
+	uint16_t *pixels = NULL;
+	int x,y;
+
+	region.data.resize(((size_t)region.x_size)*((size_t)region.y_size)*sizeof(uint16_t));
+	pixels = (uint16_t*)(&(region.data[0]));
+	for(y = 0; y < region.y_size; y++)
+	{
+		row = image+(((size_t)(region.y0+(y*region.step)))*((size_t)ncols))+region.x0;
+		if(region.step == 1)
+			memcpy(pixels,row,((size_t)region.x_size)*sizeof(uint16_t));
+		else
+		{
+			for(x = 0; x < region.x_size; x++)
+				pixels[x] = row[x*region.step];
+		}
+		pixels += region.x_size;
+	}
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	for(size_t i = 0; i < region.data.size(); i += 2)
+		std::swap(region.data[i],region.data[i+1]);
+#endif
+}
@@ -0,0 +1,20 @@
+/**
+ * @file
+ * @brief ImageRegion.h declares the routines used by get_image_region to cut a (subsampled) region out of
+ *        a read out image, without copying the rest of the image.
+ * @author Chris Mottram
+ * @version $Id$
+ */
+#ifndef IMAGEREGION_H
+#define IMAGEREGION_H
+#include <cstdint>
+#include <string>
+#include "CameraService.h"
+#include "ccd_orientation.h"
+
+extern bool image_region_clip(int ncols,int nrows,int32_t x0,int32_t y0,int32_t w,int32_t h,int32_t step,
+			      ImageRegion &region,std::string &error_message);
+extern void image_region_set_detector_area(ImageRegion &region,enum CCD_ORIENTATION orientation,int ncols,int nrows,
+					   int xbin,int ybin,int x_start,int y_start);
+extern void image_region_copy(const uint16_t *image,int ncols,ImageRegion &region);
+#endif
@@ -0,0 +1,89 @@
+/**
+ * @file
+ * @brief SpscQueue.h declares a fixed capacity, lock-free, single-producer / single-consumer queue, used to hand
+ *        read out frames from the acquisition stage to the processing stage of a multrun.
+ * @author Chris Mottram
+ * @version $Id$
+ */
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+/**
+ * A fixed capacity queue that one thread (the producer) pushes onto and one other thread (the consumer) pops from,
+ * without locking. The producer only writes mTail and the consumer only writes mHead, each publishing the slot
+ * it has filled / emptied with a release store that the other thread reads with an acquire load. The two indices
+ * are kept on separate cache lines so the threads do not contend for the same line.
+ * The indices increase monotonically, and are reduced modulo the capacity to index the slots.
+ * try_push / try_pop never block, the caller decides how to wait if the queue is full / empty.
+ */
+template <typename T> class SpscQueue
+{
+  public:
+	/**
+	 * Constructor.
+	 * @param capacity The maximum number of items in the queue (at least 1).
+	 */
+	explicit SpscQueue(size_t capacity) : mSlots((capacity > 0) ? capacity : 1), mHead(0), mTail(0) {}
+	SpscQueue(const SpscQueue &) = delete;
+	SpscQueue & operator=(const SpscQueue &) = delete;
+	/**
+	 * Push an item onto the queue. This must only be called by the producer thread.
+	 * @param item The item to push, which is moved into the queue if there is room.
+	 * @return true if the item was pushed, false if the queue was full (item is left unchanged).
+	 */
+	bool try_push(T &item)
+	{
+		size_t tail = mTail.load(std::memory_order_relaxed);
+
+		if(tail-mHead.load(std::memory_order_acquire) >= mSlots.size())
+			return false;
+		mSlots[tail % mSlots.size()] = std::move(item);
+		mTail.store(tail+1,std::memory_order_release);
+		return true;
+	}
+	/**
+	 * Pop the oldest item off the queue. This must only be called by the consumer thread.
+	 * @param item Where to move the popped item to.
+	 * @return true if an item was popped, false if the queue was empty.
+	 */
+	bool try_pop(T &item)
+	{
+		size_t head = mHead.load(std::memory_order_relaxed);
+
+		if(head == mTail.load(std::memory_order_acquire))
+			return false;
+		item = std::move(mSlots[head % mSlots.size()]);
+		mHead.store(head+1,std::memory_order_release);
+		return true;
+	}
+	/**
+	 * Return the number of items in the queue. This is only a snapshot if called whilst the other thread is
+	 * pushing / popping.
+	 */
+	size_t size() const
+	{
+		return mTail.load(std::memory_order_acquire)-mHead.load(std::memory_order_acquire);
+	}
+	/**
+	 * Return the maximum number of items in the queue.
+	 */
+	size_t capacity() const { return mSlots.size(); }
+  private:
+	/**
+	 * The queue slots.
+	 */
+	std::vector<T> mSlots;
+	/**
+	 * The index of the next item to pop, only written by the consumer.
+	 */
+	alignas(64) std::atomic<size_t> mHead;
+	/**
+	 * The index of the next slot to push into, only written by the producer.
+	 */
+	alignas(64) std::atomic<size_t> mTail;
+};
+#endif
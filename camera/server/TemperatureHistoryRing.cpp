@@ -0,0 +1,265 @@
+/**
+ * @file
+ * @brief TemperatureHistoryRing.cpp implements a fixed memory history of CCD temperature samples, kept at several
+ *        resolutions, returned to clients by get_temperature_history.
+ * @author Chris Mottram
+ * @version $Id$
+ */
+#include "TemperatureHistoryRing.h"
+#include <algorithm>
+#include <cstring>
+
+/**
+ * The length of the TEN_SECONDS interval, in milliseconds.
+ */
+#define TEMPERATURE_HISTORY_TEN_SECOND_INTERVAL (10000)
+/**
+ * The length of the ONE_MINUTE interval, in milliseconds.
+ */
+#define TEMPERATURE_HISTORY_ONE_MINUTE_INTERVAL (60000)
+
+/**
+ * Append a value to a packed binary column, as little-endian bytes.
+ * On a big-endian host we byte swap the value.
+ * @param column The column (thrift binary) to append to.
+ * @param value The value to append.
+ */
+template <typename T> static void append_little_endian(std::string &column,T value)
+{
+	char bytes[sizeof(T)];
+
+	memcpy(bytes,&value,sizeof(T));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	std::reverse(bytes,bytes+sizeof(T));
+#endif
+	column.append(bytes,sizeof(T));
+}
+
+/**
+ * Constructor for the temperature history. All the rings are allocated here, so adding samples never allocates.
+ * The rings should span less than 49 days, as sample times are returned as 32-bit millisecond offsets.
+ * @param raw_length The number of raw samples to keep.
+ * @param ten_second_length The number of 10 second samples to keep.
+ * @param one_minute_length The number of 1 minute samples to keep.
+ * @see TemperatureHistoryRing::ring_initialise
+ * @see TemperatureHistoryRing::mRings
+ */
+TemperatureHistoryRing::TemperatureHistoryRing(size_t raw_length,size_t ten_second_length,size_t one_minute_length)
+{
+	ring_initialise(mRings[TemperatureResolution::RAW],raw_length,0);
+	ring_initialise(mRings[TemperatureResolution::TEN_SECONDS],ten_second_length,
+			TEMPERATURE_HISTORY_TEN_SECOND_INTERVAL);
+	ring_initialise(mRings[TemperatureResolution::ONE_MINUTE],one_minute_length,
+			TEMPERATURE_HISTORY_ONE_MINUTE_INTERVAL);
+}
+
+/**
+ * Add a temperature sample to the history.
+ * <ul>
+ * <li>We lock mMutex.
+ * <li>If the time is earlier than the last raw sample (the system clock has been stepped backwards), we use the
+ *     last sample's time instead, so the samples in each ring are always in time order.
+ * <li>We add the sample to the raw ring, overwriting the oldest sample if it is full.
+ * <li>We accumulate the sample into the open interval of the 10 second and 1 minute rings.
+ * </ul>
+ * @param time The time the sample was taken, in milliseconds since the epoch.
+ * @param temperature The CCD temperature, in degrees centigrade.
+ * @param target_temperature The cooler's target temperature, in degrees centigrade.
+ * @param cooler_status The cooler status.
+ * @see TemperatureHistoryRing::mMutex
+ * @see TemperatureHistoryRing::ring_push
+ * @see TemperatureHistoryRing::ring_accumulate
+ */
+void TemperatureHistoryRing::add_sample(int64_t time,double temperature,double target_temperature,
+					CoolerStatus::type cooler_status)
+{
+	struct Ring &raw_ring = mRings[TemperatureResolution::RAW];
+	TemperatureHistorySample sample;
+	size_t last_index;
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	if(raw_ring.mCount > 0)
+	{
+		last_index = (raw_ring.mHead+raw_ring.mSamples.size()-1)%raw_ring.mSamples.size();
+		time = std::max(time,raw_ring.mSamples[last_index].mTime);
+	}
+	sample.mTime = time;
+	sample.mTemperature = (float)temperature;
+	sample.mMinTemperature = sample.mTemperature;
+	sample.mMaxTemperature = sample.mTemperature;
+	sample.mTargetTemperature = (float)target_temperature;
+	sample.mCoolerStatus = (uint8_t)cooler_status;
+	ring_push(raw_ring,sample);
+	ring_accumulate(mRings[TemperatureResolution::TEN_SECONDS],sample);
+	ring_accumulate(mRings[TemperatureResolution::ONE_MINUTE],sample);
+}
+
+/**
+ * Get the samples taken after a time, at a resolution. Only completed 10 second / 1 minute intervals are
+ * returned, so each interval is only returned once to a client passing the time of the last sample it received
+ * as since. As the samples in a ring are in time order, we walk backwards from the newest sample until we reach
+ * one that is not newer than since, so the cost is proportional to the number of samples returned.
+ * @param since Only samples with a time (interval start) later than this (in milliseconds since the epoch)
+ *        are returned. Pass 0 for all the samples in the ring.
+ * @param resolution Which ring to return the samples from.
+ * @param samples A vector, on return filled with the samples, oldest first.
+ * @see TemperatureHistoryRing::mMutex
+ * @see TemperatureHistoryRing::mRings
+ */
+void TemperatureHistoryRing::get_samples(int64_t since,TemperatureResolution::type resolution,
+					 std::vector<TemperatureHistorySample> &samples)
+{
+	size_t count,length,index,i;
+
+	samples.clear();
+	if((resolution < TemperatureResolution::RAW)||(resolution > TemperatureResolution::ONE_MINUTE))
+		return;
+	std::lock_guard<std::mutex> lock(mMutex);
+	const struct Ring &ring = mRings[resolution];
+	length = ring.mSamples.size();
+	count = 0;
+	while(count < ring.mCount)
+	{
+		index = (ring.mHead+length-1-count)%length;
+		if(ring.mSamples[index].mTime <= since)
+			break;
+		count++;
+	}
+	samples.reserve(count);
+	for(i = 0; i < count; i++)
+		samples.push_back(ring.mSamples[(ring.mHead+length-count+i)%length]);
+}
+
+/**
+ * Get the samples taken after a time, at a resolution, packed into a thrift TemperatureHistory.
+ * Each column of the TemperatureHistory is packed as little-endian binary values, one per sample.
+ * @param since Only samples with a time (interval start) later than this (in milliseconds since the epoch)
+ *        are returned. Pass 0 for all the samples in the ring.
+ * @param resolution Which ring to return the samples from.
+ * @param history The TemperatureHistory to fill in. If there are no samples, the columns are empty,
+ *        start_time is 0 and last_time is since.
+ * @see TemperatureHistoryRing::get_samples
+ * @see append_little_endian
+ */
+void TemperatureHistoryRing::get_history(int64_t since,TemperatureResolution::type resolution,
+					 TemperatureHistory &history)
+{
+	std::vector<TemperatureHistorySample> samples;
+
+	get_samples(since,resolution,samples);
+	history.resolution = resolution;
+	history.sample_count = (int32_t)samples.size();
+	history.start_time = 0;
+	history.last_time = since;
+	history.time_offsets.clear();
+	history.temperatures.clear();
+	history.min_temperatures.clear();
+	history.max_temperatures.clear();
+	history.target_temperatures.clear();
+	history.cooler_status.clear();
+	if(samples.size() == 0)
+		return;
+	history.start_time = samples.front().mTime;
+	history.last_time = samples.back().mTime;
+	history.time_offsets.reserve(samples.size()*sizeof(uint32_t));
+	history.temperatures.reserve(samples.size()*sizeof(float));
+	history.min_temperatures.reserve(samples.size()*sizeof(float));
+	history.max_temperatures.reserve(samples.size()*sizeof(float));
+	history.target_temperatures.reserve(samples.size()*sizeof(float));
+	history.cooler_status.reserve(samples.size());
+	for(const TemperatureHistorySample &sample : samples)
+	{
+		append_little_endian(history.time_offsets,(uint32_t)(sample.mTime-history.start_time));
+		append_little_endian(history.temperatures,sample.mTemperature);
+		append_little_endian(history.min_temperatures,sample.mMinTemperature);
+		append_little_endian(history.max_temperatures,sample.mMaxTemperature);
+		append_little_endian(history.target_temperatures,sample.mTargetTemperature);
+		history.cooler_status.push_back((char)sample.mCoolerStatus);
+	}
+}
+
+/**
+ * Return the length of the intervals samples are rolled up into at a resolution.
+ * @param resolution The resolution.
+ * @return The interval length in milliseconds, or 0 for RAW (or an unknown resolution).
+ */
+int64_t TemperatureHistoryRing::get_interval(TemperatureResolution::type resolution)
+{
+	switch(resolution)
+	{
+		case TemperatureResolution::TEN_SECONDS:
+			return TEMPERATURE_HISTORY_TEN_SECOND_INTERVAL;
+		case TemperatureResolution::ONE_MINUTE:
+			return TEMPERATURE_HISTORY_ONE_MINUTE_INTERVAL;
+		default:
+			return 0;
+	}
+}
+
+/**
+ * Allocate and empty a ring.
+ * @param ring The ring.
+ * @param length The number of samples the ring holds (at least 1).
+ * @param interval The length of each interval in milliseconds, or 0 for the raw ring.
+ */
+void TemperatureHistoryRing::ring_initialise(struct Ring &ring,size_t length,int64_t interval)
+{
+	ring.mSamples.resize(std::max(length,(size_t)1));
+	ring.mHead = 0;
+	ring.mCount = 0;
+	ring.mInterval = interval;
+	ring.mOpenCount = 0;
+	memset(&(ring.mOpen),0,sizeof(ring.mOpen));
+}
+
+/**
+ * Add a sample to the head of a ring, overwriting the oldest sample if it is full. mMutex should be locked.
+ * @param ring The ring.
+ * @param sample The sample.
+ */
+void TemperatureHistoryRing::ring_push(struct Ring &ring,const TemperatureHistorySample &sample)
+{
+	ring.mSamples[ring.mHead] = sample;
+	ring.mHead = (ring.mHead+1)%ring.mSamples.size();
+	if(ring.mCount < ring.mSamples.size())
+		ring.mCount++;
+}
+
+/**
+ * Accumulate a raw sample into a rolled up ring. mMutex should be locked.
+ * <ul>
+ * <li>If the sample is in a different interval to the open one, we close the open interval (turning it's sum of
+ *     temperatures into a mean) and push it onto the ring, and open the sample's interval.
+ * <li>We add the sample's temperature to the open interval's sum, update it's minimum and maximum,
+ *     and set it's target temperature and cooler status to the sample's.
+ * </ul>
+ * @param ring The ring.
+ * @param sample The raw sample.
+ * @see TemperatureHistoryRing::ring_push
+ */
+void TemperatureHistoryRing::ring_accumulate(struct Ring &ring,const TemperatureHistorySample &sample)
+{
+	int64_t interval_start;
+
+	interval_start = sample.mTime-(sample.mTime%ring.mInterval);
+	if((ring.mOpenCount > 0)&&(ring.mOpen.mTime != interval_start))
+	{
+		ring.mOpen.mTemperature /= ring.mOpenCount;
+		ring_push(ring,ring.mOpen);
+		ring.mOpenCount = 0;
+	}
+	if(ring.mOpenCount == 0)
+	{
+		ring.mOpen = sample;
+		ring.mOpen.mTime = interval_start;
+	}
+	else
+	{
+		ring.mOpen.mTemperature += sample.mTemperature;
+		ring.mOpen.mMinTemperature = std::min(ring.mOpen.mMinTemperature,sample.mTemperature);
+		ring.mOpen.mMaxTemperature = std::max(ring.mOpen.mMaxTemperature,sample.mTemperature);
+		ring.mOpen.mTargetTemperature = sample.mTargetTemperature;
+		ring.mOpen.mCoolerStatus = sample.mCoolerStatus;
+	}
+	ring.mOpenCount++;
+}
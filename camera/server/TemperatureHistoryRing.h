@@ -0,0 +1,127 @@
+/**
+ * @file
+ * @brief TemperatureHistoryRing.h declares a fixed memory history of CCD temperature samples, kept at several
+ *        resolutions, returned to clients by get_temperature_history.
+ * @author Chris Mottram
+ * @version $Id$
+ */
+#ifndef TEMPERATUREHISTORYRING_H
+#define TEMPERATUREHISTORYRING_H
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include "CameraService.h"
+
+/**
+ * The default number of raw samples kept (an hour's worth at the default telemetry period of 1 second).
+ */
+#define TEMPERATURE_HISTORY_DEFAULT_RAW_LENGTH        (3600)
+/**
+ * The default number of 10 second samples kept (12 hours).
+ */
+#define TEMPERATURE_HISTORY_DEFAULT_TEN_SECOND_LENGTH (4320)
+/**
+ * The default number of 1 minute samples kept (3 days).
+ */
+#define TEMPERATURE_HISTORY_DEFAULT_ONE_MINUTE_LENGTH (4320)
+
+/**
+ * One sample in a TemperatureHistoryRing. A raw sample is a single temperature reading, a rolled up sample
+ * summarises all the readings taken in it's interval.
+ */
+struct TemperatureHistorySample
+{
+	/**
+	 * The time of the sample, in milliseconds since the epoch. For a rolled up sample, the start of the interval.
+	 */
+	int64_t mTime;
+	/**
+	 * The (mean) CCD temperature, in degrees centigrade.
+	 */
+	float mTemperature;
+	/**
+	 * The minimum CCD temperature in the interval, in degrees centigrade.
+	 */
+	float mMinTemperature;
+	/**
+	 * The maximum CCD temperature in the interval, in degrees centigrade.
+	 */
+	float mMaxTemperature;
+	/**
+	 * The cooler's target temperature at the end of the interval, in degrees centigrade.
+	 */
+	float mTargetTemperature;
+	/**
+	 * The CoolerStatus at the end of the interval.
+	 */
+	uint8_t mCoolerStatus;
+};
+
+/**
+ * A fixed memory history of CCD temperature samples. Each sample added is kept in a ring of raw samples, and
+ * rolled up into rings of 10 second and 1 minute samples (mean / minimum / maximum temperature). Once a ring is
+ * full, the oldest samples are overwritten. The rings are all allocated by the constructor, so adding a sample
+ * never allocates memory. Samples are added by the telemetry thread and retrieved by the thrift threads,
+ * so all access is serialised by a mutex.
+ * @see TemperatureHistorySample
+ * @see TemperatureResolution
+ */
+class TemperatureHistoryRing
+{
+  public:
+	TemperatureHistoryRing(size_t raw_length = TEMPERATURE_HISTORY_DEFAULT_RAW_LENGTH,
+			       size_t ten_second_length = TEMPERATURE_HISTORY_DEFAULT_TEN_SECOND_LENGTH,
+			       size_t one_minute_length = TEMPERATURE_HISTORY_DEFAULT_ONE_MINUTE_LENGTH);
+	TemperatureHistoryRing(const TemperatureHistoryRing &) = delete;
+	TemperatureHistoryRing & operator=(const TemperatureHistoryRing &) = delete;
+	void add_sample(int64_t time,double temperature,double target_temperature,CoolerStatus::type cooler_status);
+	void get_samples(int64_t since,TemperatureResolution::type resolution,
+			 std::vector<TemperatureHistorySample> &samples);
+	void get_history(int64_t since,TemperatureResolution::type resolution,TemperatureHistory &history);
+	static int64_t get_interval(TemperatureResolution::type resolution);
+  private:
+	/**
+	 * A ring of samples at one resolution, plus (for a rolled up resolution) the interval currently being
+	 * accumulated.
+	 */
+	struct Ring
+	{
+		/**
+		 * The samples, allocated to the ring's length when the ring is constructed.
+		 */
+		std::vector<TemperatureHistorySample> mSamples;
+		/**
+		 * The index in mSamples the next sample is written to.
+		 */
+		size_t mHead;
+		/**
+		 * The number of samples in the ring.
+		 */
+		size_t mCount;
+		/**
+		 * The length of each interval in milliseconds, or 0 for the raw ring.
+		 */
+		int64_t mInterval;
+		/**
+		 * The interval currently being accumulated. It's mTemperature is the sum of the temperatures so far.
+		 */
+		TemperatureHistorySample mOpen;
+		/**
+		 * The number of samples accumulated into mOpen, 0 if no interval is open.
+		 */
+		int mOpenCount;
+	};
+	void ring_initialise(struct Ring &ring,size_t length,int64_t interval);
+	void ring_push(struct Ring &ring,const TemperatureHistorySample &sample);
+	void ring_accumulate(struct Ring &ring,const TemperatureHistorySample &sample);
+	/**
+	 * The rings, indexed by TemperatureResolution.
+	 */
+	struct Ring mRings[3];
+	/**
+	 * Mutex protecting the rings.
+	 */
+	std::mutex mMutex;
+};
+#endif
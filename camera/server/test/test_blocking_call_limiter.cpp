@@ -0,0 +1,150 @@
+/**
+ * @file
+ * @brief test_blocking_call_limiter.cpp tests the counter limiting how many blocking calls (wait_for_exposure and
+ *        the full frame image downloads) the camera server has in progress at once. It checks calls beyond the limit
+ *        are refused, that finished calls free their slot, and that the limit holds with many threads competing.
+ * @author Chris Mottram
+ * @version $Id$
+ */
+#include "BlockingCallLimiter.h"
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using std::cout, std::cerr, std::endl;
+
+/**
+ * The blocking call limit used by the tests.
+ */
+#define TEST_LIMIT              (3)
+/**
+ * The number of threads competing for slots in the threaded test.
+ */
+#define TEST_THREAD_COUNT       (8)
+/**
+ * The number of slots each thread tries to take in the threaded test.
+ */
+#define TEST_ITERATION_COUNT    (100000)
+
+static bool Test_Failed = false;
+
+static void Check(bool condition,const std::string &message);
+
+/**
+ * Main program.
+ * <ul>
+ * <li>We check a new limiter has the default limit, and that illegal limits are raised to one.
+ * <li>We take TEST_LIMIT slots, and check a further try_acquire fails, and that releasing a slot lets another
+ *     call take it.
+ * <li>We check a BlockingCallSlot releases its slot when it goes out of scope, even when an exception is thrown,
+ *     and that a slot that was refused does not release one.
+ * <li>We start TEST_THREAD_COUNT threads, each taking and releasing a slot TEST_ITERATION_COUNT times, and check
+ *     no more than TEST_LIMIT are ever held at once, and that all the slots are free afterwards.
+ * </ul>
+ * @return The program returns 0 if the test passed, and 1 if it failed.
+ */
+int main(int argc, char *argv[])
+{
+	BlockingCallLimiter limiter;
+	std::vector<std::thread> threads;
+	std::atomic<int> held_count(0),max_held_count(0);
+	int i;
+
+	/* limit */
+	Check(limiter.get_limit() == DEFAULT_BLOCKING_CALL_LIMIT,"New limiter has limit "+
+	      std::to_string(limiter.get_limit())+".");
+	limiter.set_limit(0);
+	Check(limiter.get_limit() == 1,"Limit of zero was set to "+std::to_string(limiter.get_limit())+".");
+	limiter.set_limit(TEST_LIMIT);
+	Check(limiter.get_limit() == TEST_LIMIT,"Limit is "+std::to_string(limiter.get_limit())+".");
+	/* acquire up to the limit */
+	for(i = 0; i < TEST_LIMIT; i++)
+		Check(limiter.try_acquire(),"try_acquire failed with "+std::to_string(i)+" calls in progress.");
+	Check(!limiter.try_acquire(),"try_acquire succeeded with the limit reached.");
+	Check(limiter.get_count() == TEST_LIMIT,"Count is "+std::to_string(limiter.get_count())+" at the limit.");
+	limiter.release();
+	Check(limiter.try_acquire(),"try_acquire failed after a call was released.");
+	for(i = 0; i < TEST_LIMIT; i++)
+		limiter.release();
+	Check(limiter.get_count() == 0,"Count is "+std::to_string(limiter.get_count())+" after releasing all calls.");
+	/* RAII slots */
+	{
+		BlockingCallSlot slot(limiter);
+
+		Check(slot.acquired(),"BlockingCallSlot was not acquired on an idle limiter.");
+		Check(limiter.get_count() == 1,"Count is "+std::to_string(limiter.get_count())+" with one slot held.");
+	}
+	Check(limiter.get_count() == 0,"BlockingCallSlot did not release it's slot.");
+	try
+	{
+		BlockingCallSlot slot(limiter);
+
+		throw std::string("blocking call failed");
+	}
+	catch(std::string &e)
+	{
+	}
+	Check(limiter.get_count() == 0,"BlockingCallSlot did not release it's slot when an exception was thrown.");
+	for(i = 0; i < TEST_LIMIT; i++)
+		limiter.try_acquire();
+	{
+		BlockingCallSlot slot(limiter);
+
+		Check(!slot.acquired(),"BlockingCallSlot was acquired with the limit reached.");
+	}
+	Check(limiter.get_count() == TEST_LIMIT,"A refused BlockingCallSlot changed the count to "+
+	      std::to_string(limiter.get_count())+".");
+	for(i = 0; i < TEST_LIMIT; i++)
+		limiter.release();
+	/* threads competing for slots */
+	for(i = 0; i < TEST_THREAD_COUNT; i++)
+	{
+		threads.emplace_back([&limiter,&held_count,&max_held_count]()
+				     {
+					     int held,max_held;
+
+					     for(int j = 0; j < TEST_ITERATION_COUNT; j++)
+					     {
+						     BlockingCallSlot slot(limiter);
+
+						     if(!slot.acquired())
+							     continue;
+						     held = ++held_count;
+						     max_held = max_held_count;
+						     while((held > max_held)&&
+							   (!max_held_count.compare_exchange_weak(max_held,held)))
+							     ;
+						     held_count--;
+					     }
+				     });
+	}
+	for(std::thread &thread : threads)
+		thread.join();
+	Check(max_held_count <= TEST_LIMIT,std::to_string(max_held_count)+" slots were held at once.");
+	Check(max_held_count > 0,"No thread acquired a slot.");
+	Check(limiter.get_count() == 0,"Count is "+std::to_string(limiter.get_count())+" after the threaded test.");
+	if(Test_Failed)
+	{
+		cout << "test_blocking_call_limiter FAILED." << endl;
+		return 1;
+	}
+	cout << "test_blocking_call_limiter PASSED." << endl;
+	return 0;
+}
+
+/**
+ * Check a test condition. If it is false, print the message and set Test_Failed.
+ * @param condition The condition.
+ * @param message The message to print if the condition is false.
+ * @see #Test_Failed
+ */
+static void Check(bool condition,const std::string &message)
+{
+	if(!condition)
+	{
+		cerr << "FAILED:" << message << endl;
+		Test_Failed = true;
+	}
+}
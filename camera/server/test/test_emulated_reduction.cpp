@@ -0,0 +1,367 @@
+/**
+ * @file
+ * @brief test_emulated_reduction.cpp tests the in-server frame reduction on the camera emulator's frame pipeline.
+ *        We take a multrun and a multbias on an EmulatedCamera configured to save it's frames and reduce them with
+ *        a set of master calibration frames, and check the raw frames are saved, only the multrun's frames are
+ *        reduced, and get_last_image_filename / list_frames return the saved filenames. We then check a single
+ *        exposure is only saved (and reduced) when start_expose is asked to save it. The saved frames are left
+ *        in the test directory when one is given on the command line, so test_reduction_against_pipeline.py can
+ *        compare the reduced frames with ReductionController.reduce_ccd_image.
+ * @author Chris Mottram
+ * @version $Id$
+ */
+#include "CameraConfig.h"
+#include "EmulatedCamera.h"
+#include "FrameReduction.h"
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "log4cxx/basicconfigurator.h"
+#include "log4cxx/logger.h"
+#include "ccd_fits_header.h"
+
+using std::cout, std::cerr, std::endl;
+using namespace log4cxx;
+
+/**
+ * The directory the test writes it's configuration, master frames and saved frames into, if none is given on the
+ * command line.
+ */
+#define TEST_DEFAULT_DIRECTORY  ("/tmp/test_emulated_reduction")
+/**
+ * The number of columns in the emulated CCD.
+ */
+#define TEST_NCOLS              (64)
+/**
+ * The number of rows in the emulated CCD.
+ */
+#define TEST_NROWS              (32)
+/**
+ * The length of each emulated exposure, in milliseconds.
+ */
+#define TEST_EXPOSURE_LENGTH    (200)
+/**
+ * The length of each emulated readout, in milliseconds ("emulation.readout_length").
+ */
+#define TEST_READOUT_LENGTH     (5)
+/**
+ * The exposure length of the master dark written by the test, in seconds (it's EXPOSURE FITS header).
+ */
+#define TEST_DARK_EXPOSURE      (1.0)
+/**
+ * The number of frames in the multrun.
+ */
+#define TEST_FRAME_COUNT        (4)
+/**
+ * The number of frames in the multbias.
+ */
+#define TEST_BIAS_COUNT         (2)
+
+static bool Test_Failed = false;
+
+static bool File_Exists(const std::string &filename);
+static std::string Reduced_Filename(const std::string &filename);
+static void Write_Master(const std::string &filename,const std::vector<float> &image,double exposure_length);
+static void Write_Masters(const std::string &directory);
+static void Write_Config(const std::string &directory,const std::string &config_filename);
+static void Wait_For_Multrun(EmulatedCamera &camera);
+static void Test_Multrun(EmulatedCamera &camera);
+static void Test_Multbias(EmulatedCamera &camera);
+static void Test_Expose(EmulatedCamera &camera);
+static void Check(bool condition,const std::string &message);
+
+/**
+ * Main program.
+ * <ul>
+ * <li>If a directory is given as the first argument, we use it (and leave the saved frames in it),
+ *     otherwise we use TEST_DEFAULT_DIRECTORY.
+ * <li>We write master bias, dark and flat frames into the directory using Write_Masters, unless they are
+ *     already there.
+ * <li>We write a configuration file with saving and reduction enabled using Write_Config.
+ * <li>We create and initialise an EmulatedCamera.
+ * <li>We call Test_Multrun to check a multrun's frames are saved and reduced.
+ * <li>We call Test_Multbias to check a multbias's frames are saved, but not reduced.
+ * <li>We call Test_Expose to check a single exposure is saved only when asked to be.
+ * </ul>
+ * @param argc The number of arguments.
+ * @param argv The arguments: an optional directory to use.
+ * @return The program returns 0 if the test passed, and 1 if it failed.
+ */
+int main(int argc, char *argv[])
+{
+	CameraConfig config;
+	std::string directory,config_filename;
+
+	BasicConfigurator::configure();
+	if(argc > 1)
+		directory = argv[1];
+	else
+		directory = TEST_DEFAULT_DIRECTORY;
+	mkdir(directory.c_str(),0755);
+	config_filename = directory+"/test_emulated_reduction.cfg";
+	Write_Masters(directory);
+	Write_Config(directory,config_filename);
+	config.initialise();
+	config.set_config_filename(config_filename.c_str());
+	config.load_config();
+	{
+		EmulatedCamera camera;
+
+		camera.set_config(config);
+		camera.initialize();
+		Test_Multrun(camera);
+		Test_Multbias(camera);
+		Test_Expose(camera);
+	}
+	if(argc <= 1)
+	{
+		std::string command = std::string("rm -rf ")+directory;
+
+		system(command.c_str());
+	}
+	if(Test_Failed)
+	{
+		cout << "test_emulated_reduction:FAILED" << endl;
+		return 1;
+	}
+	cout << "test_emulated_reduction:PASSED" << endl;
+	return 0;
+}
+
+/**
+ * Return whether a file exists.
+ * @param filename The filename.
+ * @return True if the file exists.
+ */
+static bool File_Exists(const std::string &filename)
+{
+	return access(filename.c_str(),F_OK) == 0;
+}
+
+/**
+ * Return the filename a raw frame's reduced frame is saved to, as the camera server and emulator name it.
+ * @param filename The raw frame's filename.
+ * @return The reduced frame's filename.
+ * @see #FRAME_REDUCTION_FILENAME_SUFFIX
+ */
+static std::string Reduced_Filename(const std::string &filename)
+{
+	std::string reduced_filename = filename;
+	std::string::size_type extension_index;
+
+	extension_index = reduced_filename.rfind(".fits");
+	if(extension_index != std::string::npos)
+		reduced_filename.erase(extension_index);
+	return reduced_filename+FRAME_REDUCTION_FILENAME_SUFFIX;
+}
+
+/**
+ * Save a master frame as a float32 FITS image using frame_reduction_save.
+ * @param filename The filename to save the master frame to.
+ * @param image The master frame, TEST_NCOLS x TEST_NROWS pixels.
+ * @param exposure_length If positive, the exposure length to save in the EXPOSURE FITS header, in seconds.
+ * @see #TEST_NCOLS
+ * @see #TEST_NROWS
+ * @see frame_reduction_save
+ */
+static void Write_Master(const std::string &filename,const std::vector<float> &image,double exposure_length)
+{
+	struct Fits_Header_Struct fits_header;
+	std::string error_message;
+
+	CCD_Fits_Header_Initialise(&fits_header);
+	if(exposure_length > 0.0)
+		CCD_Fits_Header_Add_Float(&fits_header,"EXPOSURE",exposure_length,"Exposure length in seconds");
+	Check(frame_reduction_save(filename.c_str(),image.data(),TEST_NCOLS,TEST_NROWS,fits_header,error_message),
+	      "Failed to save master frame "+filename+":"+error_message);
+	CCD_Fits_Header_Free(&fits_header);
+}
+
+/**
+ * Write a master bias, dark and flat into a directory, unless they are already there (e.g. written by
+ * test_reduction_against_pipeline.py). The bias and dark vary across the frame, and the flat is close to one.
+ * @param directory The directory to write bias.fits, dark.fits and flat.fits into.
+ * @see #TEST_DARK_EXPOSURE
+ * @see Write_Master
+ */
+static void Write_Masters(const std::string &directory)
+{
+	std::vector<float> bias(TEST_NCOLS*TEST_NROWS),dark(TEST_NCOLS*TEST_NROWS),flat(TEST_NCOLS*TEST_NROWS);
+
+	if(File_Exists(directory+"/bias.fits")&&File_Exists(directory+"/dark.fits")&&
+	   File_Exists(directory+"/flat.fits"))
+		return;
+	for(int y = 0; y < TEST_NROWS; y++)
+	{
+		for(int x = 0; x < TEST_NCOLS; x++)
+		{
+			bias[(y*TEST_NCOLS)+x] = 100.0f+(float)((x+y)%7);
+			dark[(y*TEST_NCOLS)+x] = 20.0f+(float)((x*y)%11);
+			flat[(y*TEST_NCOLS)+x] = 0.9f+0.2f*(float)(x)/(float)(TEST_NCOLS);
+		}
+	}
+	remove((directory+"/bias.fits").c_str());
+	remove((directory+"/dark.fits").c_str());
+	remove((directory+"/flat.fits").c_str());
+	Write_Master(directory+"/bias.fits",bias,0.0);
+	Write_Master(directory+"/dark.fits",dark,TEST_DARK_EXPOSURE);
+	Write_Master(directory+"/flat.fits",flat,0.0);
+}
+
+/**
+ * Write a configuration file containing the keywords the EmulatedCamera needs, with fast emulated readouts, and
+ * saving and reduction enabled.
+ * @param directory The directory the master frames are in, and frames are saved into.
+ * @param config_filename The filename to write the configuration to.
+ * @see #TEST_NCOLS
+ * @see #TEST_NROWS
+ * @see #TEST_READOUT_LENGTH
+ */
+static void Write_Config(const std::string &directory,const std::string &config_filename)
+{
+	std::ofstream config_file(config_filename);
+
+	config_file << "[Camera]" << endl;
+	config_file << "ccd.ncols = " << TEST_NCOLS << endl;
+	config_file << "ccd.nrows = " << TEST_NROWS << endl;
+	config_file << "ccd.target_temperature = -60.0" << endl;
+	config_file << "emulation.readout_length = " << TEST_READOUT_LENGTH << endl;
+	config_file << "emulation.data_dir = " << directory << endl;
+	config_file << "reduction.enable = true" << endl;
+	config_file << "reduction.thread_count = 2" << endl;
+	config_file << "reduction.bias = " << directory << "/bias.fits" << endl;
+	config_file << "reduction.dark = " << directory << "/dark.fits" << endl;
+	config_file << "reduction.flat = " << directory << "/flat.fits" << endl;
+	config_file.close();
+}
+
+/**
+ * Wait until the camera's multrun, and the processing of all it's frames, has finished.
+ * @param camera The camera.
+ */
+static void Wait_For_Multrun(EmulatedCamera &camera)
+{
+	CameraState state;
+
+	do
+	{
+		camera.wait_for_exposure(1000);
+		camera.get_state(state);
+	} while(state.exposure_in_progress);
+}
+
+/**
+ * Take a multrun, and check each frame is saved, and reduced, and that the last image filename is the last frame's.
+ * @param camera The camera.
+ * @see #TEST_FRAME_COUNT
+ * @see #TEST_EXPOSURE_LENGTH
+ */
+static void Test_Multrun(EmulatedCamera &camera)
+{
+	std::vector<FrameInfo> frames;
+	std::string filename;
+
+	camera.start_multrun(TEST_FRAME_COUNT,TEST_EXPOSURE_LENGTH,true);
+	Wait_For_Multrun(camera);
+	camera.list_frames(frames);
+	Check(frames.size() == TEST_FRAME_COUNT,"Multrun listed "+std::to_string(frames.size())+" frames, not "+
+	      std::to_string(TEST_FRAME_COUNT)+".");
+	for(const FrameInfo &frame : frames)
+	{
+		Check(frame.filename.empty() == false,"Multrun frame "+std::to_string(frame.frame_id)+
+		      " was not saved.");
+		if(frame.filename.empty())
+			continue;
+		Check(File_Exists(frame.filename),"Multrun frame "+frame.filename+" does not exist.");
+		Check(File_Exists(Reduced_Filename(frame.filename)),"Multrun frame "+frame.filename+
+		      " was not reduced.");
+	}
+	camera.get_last_image_filename(filename);
+	if(frames.size() > 0)
+	{
+		Check(filename == frames.back().filename,"Last image filename "+filename+" is not the last frame "+
+		      frames.back().filename+".");
+	}
+}
+
+/**
+ * Take a multbias, and check it's frames are saved, but not reduced (the shutter is closed).
+ * @param camera The camera.
+ * @see #TEST_BIAS_COUNT
+ */
+static void Test_Multbias(EmulatedCamera &camera)
+{
+	std::vector<FrameInfo> frames;
+	std::string filename;
+
+	camera.start_multbias(TEST_BIAS_COUNT);
+	Wait_For_Multrun(camera);
+	camera.list_frames(frames);
+	Check(frames.size() == TEST_FRAME_COUNT+TEST_BIAS_COUNT,"Multbias listed "+std::to_string(frames.size())+
+	      " frames, not "+std::to_string(TEST_FRAME_COUNT+TEST_BIAS_COUNT)+".");
+	for(size_t i = TEST_FRAME_COUNT; i < frames.size(); i++)
+	{
+		Check(File_Exists(frames[i].filename),"Multbias frame "+frames[i].filename+" does not exist.");
+		Check(File_Exists(Reduced_Filename(frames[i].filename)) == false,"Multbias frame "+frames[i].filename+
+		      " was reduced.");
+	}
+	camera.get_last_image_filename(filename);
+	if(frames.size() > 0)
+	{
+		Check(filename == frames.back().filename,"Last image filename "+filename+" is not the last bias "+
+		      frames.back().filename+".");
+	}
+}
+
+/**
+ * Take a single exposure saving the image, and check it is saved and reduced, and then one not saving the image,
+ * and check it is not saved.
+ * @param camera The camera.
+ * @see #TEST_EXPOSURE_LENGTH
+ */
+static void Test_Expose(EmulatedCamera &camera)
+{
+	std::vector<FrameInfo> frames;
+	std::string filename;
+
+	camera.set_exposure_length(TEST_EXPOSURE_LENGTH);
+	camera.start_expose(true);
+	Wait_For_Multrun(camera);
+	camera.list_frames(frames);
+	Check(frames.size() > 0,"Expose listed no frames.");
+	if(frames.size() > 0)
+	{
+		filename = frames.back().filename;
+		Check(filename.empty() == false,"Expose frame "+std::to_string(frames.back().frame_id)+
+		      " was not saved.");
+		Check(File_Exists(filename),"Expose frame "+filename+" does not exist.");
+		Check(File_Exists(Reduced_Filename(filename)),"Expose frame "+filename+" was not reduced.");
+	}
+	camera.start_expose(false);
+	Wait_For_Multrun(camera);
+	camera.list_frames(frames);
+	if(frames.size() > 0)
+	{
+		Check(frames.back().filename.empty(),"Expose frame "+std::to_string(frames.back().frame_id)+
+		      " was saved to "+frames.back().filename+" when it was not to be saved.");
+	}
+}
+
+/**
+ * Check a test condition. If it is false, print the message and set Test_Failed.
+ * @param condition The condition.
+ * @param message The message to print if the condition is false.
+ * @see #Test_Failed
+ */
+static void Check(bool condition,const std::string &message)
+{
+	if(!condition)
+	{
+		cerr << "FAILED:" << message << endl;
+		Test_Failed = true;
+	}
+}
@@ -0,0 +1,149 @@
+/**
+ * @file
+ * @brief test_exposure_timing.cpp tests the fixed memory ring of frame timelines. It adds emulated timelines,
+ *        merges in the save / published phases, and checks the ExposureTimings returned contain the right phase
+ *        offsets (-1 for the phases not reached), oldest first, and that the oldest timelines are overwritten once
+ *        the ring is full.
+ * @author Chris Mottram
+ * @version $Id$
+ */
+#include "ExposureTimingRing.h"
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using std::cout, std::cerr, std::endl;
+
+/**
+ * The number of timelines held by the test ring. Less than TEST_FRAME_COUNT, so the ring wraps.
+ */
+#define TEST_RING_LENGTH        (10)
+/**
+ * The number of timelines added to the ring.
+ */
+#define TEST_FRAME_COUNT        (25)
+/**
+ * The time between each phase of an emulated timeline, in microseconds.
+ */
+#define TEST_PHASE_INTERVAL     (1500)
+
+static bool Test_Failed = false;
+
+static void Test_Timeline(int frame_index,int first_phase,int last_phase,struct CCD_Exposure_Timeline_Struct *timeline);
+static void Check(bool condition,const std::string &message);
+
+/**
+ * Main program.
+ * <ul>
+ * <li>We add TEST_FRAME_COUNT emulated timelines, stamped from the request to the header phase (Test_Timeline),
+ *     to a ring of TEST_RING_LENGTH timelines. For every other frame we merge in the save and published phases.
+ * <li>We check only the last TEST_RING_LENGTH timings are returned, oldest first, with the right frame id,
+ *     exposure length and start time.
+ * <li>We check each phase offset is the time since the request phase, or -1 for the phases that were not merged in.
+ * <li>We check merging a timeline for a frame no longer in the ring does nothing, and resizing the ring empties it.
+ * </ul>
+ * @return The program returns 0 if the test passed, and 1 if it failed.
+ */
+int main(int argc, char *argv[])
+{
+	ExposureTimingRing ring(TEST_RING_LENGTH);
+	struct CCD_Exposure_Timeline_Struct timeline;
+	struct timespec start_time;
+	std::vector<ExposureTiming> timings;
+	int64_t expected_time;
+	int i,phase,frame_index;
+
+	for(i = 0; i < TEST_FRAME_COUNT; i++)
+	{
+		Test_Timeline(i,CCD_EXPOSURE_TIMELINE_REQUEST,CCD_EXPOSURE_TIMELINE_HEADER,&timeline);
+		start_time.tv_sec = 1700000000+i;
+		start_time.tv_nsec = 500000000;
+		ring.add_timeline(i,100*i,start_time,timeline);
+		if((i%2) == 0)
+		{
+			Test_Timeline(i,CCD_EXPOSURE_TIMELINE_SAVE_OPEN,CCD_EXPOSURE_TIMELINE_PUBLISHED,&timeline);
+			ring.merge_timeline(i,timeline);
+		}
+	}
+	ring.get_timings(timings);
+	Check(timings.size() == TEST_RING_LENGTH,"Ring returned "+std::to_string(timings.size())+" timings.");
+	for(i = 0; i < (int)timings.size(); i++)
+	{
+		frame_index = TEST_FRAME_COUNT-TEST_RING_LENGTH+i;
+		Check(timings[i].frame_id == frame_index,"Timing "+std::to_string(i)+" has frame id "+
+		      std::to_string(timings[i].frame_id)+".");
+		Check(timings[i].exposure_length == 100*frame_index,"Timing "+std::to_string(i)+
+		      " has the wrong exposure length.");
+		Check(timings[i].start_time == ((1700000000LL+frame_index)*1000LL)+500,"Timing "+std::to_string(i)+
+		      " has start time "+std::to_string(timings[i].start_time)+".");
+		Check(timings[i].phase_times.size() == CCD_EXPOSURE_TIMELINE_PHASE_COUNT,"Timing "+std::to_string(i)+
+		      " has "+std::to_string(timings[i].phase_times.size())+" phases.");
+		for(phase = 0; phase < (int)timings[i].phase_times.size(); phase++)
+		{
+			if((phase <= CCD_EXPOSURE_TIMELINE_HEADER)||((frame_index%2) == 0))
+				expected_time = phase*TEST_PHASE_INTERVAL;
+			else
+				expected_time = -1;
+			Check(timings[i].phase_times[phase] == expected_time,"Timing "+std::to_string(i)+" phase "+
+			      std::to_string(phase)+" is "+std::to_string(timings[i].phase_times[phase])+" not "+
+			      std::to_string(expected_time)+".");
+		}
+	}
+	/* a frame no longer in the ring */
+	Test_Timeline(0,CCD_EXPOSURE_TIMELINE_REQUEST,CCD_EXPOSURE_TIMELINE_PUBLISHED,&timeline);
+	ring.merge_timeline(0,timeline);
+	ring.get_timings(timings);
+	Check((timings.size() == TEST_RING_LENGTH)&&(timings[0].frame_id == TEST_FRAME_COUNT-TEST_RING_LENGTH),
+	      "Merging a frame no longer in the ring changed the ring.");
+	/* resizing empties the ring */
+	ring.set_length(TEST_RING_LENGTH*2);
+	ring.get_timings(timings);
+	Check(timings.size() == 0,"Resized ring returned "+std::to_string(timings.size())+" timings.");
+	if(Test_Failed)
+	{
+		cout << "test_exposure_timing FAILED." << endl;
+		return 1;
+	}
+	cout << "test_exposure_timing PASSED." << endl;
+	return 0;
+}
+
+/**
+ * Fill in an emulated timeline. Phase n of frame frame_index is stamped at frame_index seconds plus
+ * n*TEST_PHASE_INTERVAL microseconds, so phases cross a second boundary. Only the phases from first_phase to
+ * last_phase (inclusive) are stamped, the others are cleared.
+ * @param frame_index The index of the frame.
+ * @param first_phase The first phase to stamp.
+ * @param last_phase The last phase to stamp.
+ * @param timeline The timeline to fill in.
+ */
+static void Test_Timeline(int frame_index,int first_phase,int last_phase,struct CCD_Exposure_Timeline_Struct *timeline)
+{
+	int64_t time_ns;
+	int phase;
+
+	memset(timeline,0,sizeof(struct CCD_Exposure_Timeline_Struct));
+	for(phase = first_phase; phase <= last_phase; phase++)
+	{
+		time_ns = (((int64_t)(1000+frame_index))*CCD_GENERAL_ONE_SECOND_NS)+999000000LL+
+			(((int64_t)phase)*TEST_PHASE_INTERVAL*CCD_GENERAL_ONE_MICROSECOND_NS);
+		timeline->Phase_Time[phase].tv_sec = time_ns/CCD_GENERAL_ONE_SECOND_NS;
+		timeline->Phase_Time[phase].tv_nsec = time_ns%CCD_GENERAL_ONE_SECOND_NS;
+	}
+}
+
+/**
+ * Check a test condition. If it is false, print the message and set Test_Failed.
+ * @param condition The condition.
+ * @param message The message to print if the condition is false.
+ * @see #Test_Failed
+ */
+static void Check(bool condition,const std::string &message)
+{
+	if(!condition)
+	{
+		cerr << "FAILED:" << message << endl;
+		Test_Failed = true;
+	}
+}
@@ -0,0 +1,243 @@
+/**
+ * @file
+ * @brief test_fits_writer_queue.cpp tests the background FITS writer queue, by queueing a series of images to be
+ *        saved with both the native FITS writer and CFITSIO, and checking each image is only published once it is
+ *        complete, in order, with no temporary or lock files left behind, and with the save phases of it's timeline
+ *        time stamped. It also checks a failed save is reported.
+ * @author Chris Mottram
+ * @version $Id$
+ */
+#include "FitsWriterQueue.h"
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <string.h>
+#include <sys/stat.h>
+#include "log4cxx/basicconfigurator.h"
+#include "log4cxx/logger.h"
+#include "ccd_fits_header.h"
+#include "ccd_general.h"
+
+using std::cout, std::cerr, std::endl;
+using namespace log4cxx;
+
+/**
+ * The directory the test images are written into.
+ */
+#define TEST_DIRECTORY          ("/tmp")
+/**
+ * The number of columns in each test image.
+ */
+#define TEST_NCOLS              (1024)
+/**
+ * The number of rows in each test image.
+ */
+#define TEST_NROWS              (1024)
+/**
+ * The number of images queued for each writer.
+ */
+#define TEST_IMAGE_COUNT        (8)
+/**
+ * The length of the queue. This is less than TEST_IMAGE_COUNT, so pushing images blocks.
+ */
+#define TEST_QUEUE_LENGTH       (2)
+
+static int Test_Failed = FALSE;
+
+static void Check(int condition,const std::string &message);
+static int File_Exists(const std::string &filename,off_t *file_length);
+static void Test_Writer(bool native_writer,struct Fits_Header_Struct header);
+static std::string Test_Filename(bool native_writer,int index,const char *suffix);
+
+/**
+ * Main program.
+ * <ul>
+ * <li>We create a FITS header list with a couple of cards in.
+ * <li>We call Test_Writer to test the queue with the native FITS writer, and then with CFITSIO.
+ * <li>We queue an image to be saved into a directory that does not exist, and check it is reported as failed
+ *     and not published.
+ * </ul>
+ * @return The program returns 0 if the test passed, and 1 if it failed.
+ */
+int main(int argc, char *argv[])
+{
+	FitsWriterQueue queue;
+	std::unique_ptr<FitsWriterJob> job;
+	struct Fits_Header_Struct header;
+	int published_count;
+
+	BasicConfigurator::configure();
+	CCD_Fits_Header_Initialise(&header);
+	CCD_Fits_Header_Add_String(&header,"OBSTYPE","EXPOSE","What sort of image this is");
+	CCD_Fits_Header_Add_Int(&header,"RUNNUM",1,"Run number");
+	Test_Writer(true,header);
+	Test_Writer(false,header);
+	/* a failed save is counted, and not published */
+	published_count = 0;
+	queue.start(TEST_QUEUE_LENGTH,1,FITS_WRITER_SYNC_NONE,true,
+		    [&published_count](const std::string &filename,int64_t frame_sequence,
+				       const struct CCD_Exposure_Timeline_Struct &timeline)
+		    {
+			    published_count++;
+		    });
+	job.reset(new FitsWriterJob());
+	job->mImageBuf = std::make_shared<ImageBuffer>((size_t)(TEST_NCOLS*TEST_NROWS));
+	job->mImageBufferLength = TEST_NCOLS*TEST_NROWS;
+	job->mNCols = TEST_NCOLS;
+	job->mNRows = TEST_NROWS;
+	job->mFilename = "/mookodi_test_fits_writer_queue_does_not_exist/test.fits";
+	job->mFrameSequence = 1;
+	queue.push(std::move(job));
+	queue.flush();
+	Check(queue.get_failed_count() == 1,"Saving into a non-existent directory was not reported as failed.");
+	Check(published_count == 0,"An image that failed to save was published.");
+	queue.stop();
+	CCD_Fits_Header_Free(&header);
+	if(Test_Failed)
+	{
+		cout << "test_fits_writer_queue FAILED." << endl;
+		return 1;
+	}
+	cout << "test_fits_writer_queue PASSED." << endl;
+	return 0;
+}
+
+/**
+ * Test the FITS writer queue with one of the writers.
+ * <ul>
+ * <li>We start the queue with TEST_QUEUE_LENGTH slots, one writer thread and FITS_WRITER_SYNC_DIRECTORY.
+ *     The publish callback checks the image is complete (the file exists and is a whole number of FITS blocks
+ *     long, with no temporary file or lock file left behind) and records the frame sequence number.
+ * <li>We queue TEST_IMAGE_COUNT images, each with a different pixel pattern and a snapshot of the header.
+ * <li>We flush the queue and check all the images were published, in order, and none failed.
+ * <li>We remove the test images.
+ * </ul>
+ * @param native_writer True to save the images with the native FITS writer, false to use CFITSIO.
+ * @param header The FITS headers to save with each image.
+ * @see #Test_Filename
+ * @see #File_Exists
+ */
+static void Test_Writer(bool native_writer,struct Fits_Header_Struct header)
+{
+	FitsWriterQueue queue;
+	std::unique_ptr<FitsWriterJob> job;
+	std::vector<int64_t> published_sequence_list;
+	std::mutex published_mutex;
+	std::chrono::steady_clock::time_point start_time,push_time,flush_time;
+	off_t file_length = 0;
+	size_t pixel_index;
+	int i;
+
+	/* remove any images left behind by an earlier run */
+	for(i = 0; i < TEST_IMAGE_COUNT; i++)
+		remove(Test_Filename(native_writer,i,".fits").c_str());
+	queue.start(TEST_QUEUE_LENGTH,1,FITS_WRITER_SYNC_DIRECTORY,native_writer,
+		    [&](const std::string &filename,int64_t frame_sequence,const struct CCD_Exposure_Timeline_Struct &timeline)
+		    {
+			    off_t length = 0;
+			    std::lock_guard<std::mutex> lock(published_mutex);
+
+			    Check(File_Exists(filename,&length),"Published image "+filename+" does not exist.");
+			    Check((length % CCD_FITS_HEADER_BLOCK_LENGTH) == 0,"Published image "+filename+
+				  " has length "+std::to_string(length)+
+				  " which is not a whole number of FITS blocks.");
+			    Check(length > (off_t)(TEST_NCOLS*TEST_NROWS*sizeof(uint16_t)),"Published image "+filename+
+				  " is too short ("+std::to_string(length)+").");
+			    Check(!File_Exists(filename+".tmp",&length),"Temporary file for "+filename+
+				  " still exists after publishing.");
+			    Check((timeline.Phase_Time[CCD_EXPOSURE_TIMELINE_SAVE_OPEN].tv_sec != 0)&&
+				  (timeline.Phase_Time[CCD_EXPOSURE_TIMELINE_SAVE_WRITE].tv_sec != 0)&&
+				  (timeline.Phase_Time[CCD_EXPOSURE_TIMELINE_SAVE_CLOSE].tv_sec != 0),
+				  "Published image "+filename+" does not have it's save phases time stamped.");
+			    published_sequence_list.push_back(frame_sequence);
+		    });
+	start_time = std::chrono::steady_clock::now();
+	for(i = 0; i < TEST_IMAGE_COUNT; i++)
+	{
+		job.reset(new FitsWriterJob());
+		job->mImageBuf = std::make_shared<ImageBuffer>((size_t)(TEST_NCOLS*TEST_NROWS));
+		for(pixel_index = 0; pixel_index < job->mImageBuf->size(); pixel_index++)
+			job->mImageBuf->data()[pixel_index] = (uint16_t)(pixel_index+i);
+		job->mImageBufferLength = TEST_NCOLS*TEST_NROWS;
+		job->mNCols = TEST_NCOLS;
+		job->mNRows = TEST_NROWS;
+		Check(CCD_Fits_Header_Copy(&(job->mFitsHeader),header),"CCD_Fits_Header_Copy failed.");
+		job->mFilename = Test_Filename(native_writer,i,".fits");
+		job->mFrameSequence = i+1;
+		queue.push(std::move(job));
+		Check(queue.get_pending_count() <= TEST_QUEUE_LENGTH+1,"More than "+
+		      std::to_string(TEST_QUEUE_LENGTH+1)+" images pending.");
+	}
+	push_time = std::chrono::steady_clock::now();
+	queue.flush();
+	flush_time = std::chrono::steady_clock::now();
+	Check(queue.get_pending_count() == 0,"Images still pending after flush.");
+	Check(queue.get_written_count() == TEST_IMAGE_COUNT,"Only "+std::to_string(queue.get_written_count())+
+	      " of "+std::to_string(TEST_IMAGE_COUNT)+" images written.");
+	Check(queue.get_failed_count() == 0,std::to_string(queue.get_failed_count())+" images failed to save.");
+	Check(published_sequence_list.size() == TEST_IMAGE_COUNT,"Only "+std::to_string(published_sequence_list.size())+
+	      " images published.");
+	for(i = 0; i < (int)published_sequence_list.size(); i++)
+	{
+		Check(published_sequence_list[i] == i+1,"Image "+std::to_string(i)+" was published with frame sequence "+
+		      std::to_string(published_sequence_list[i])+".");
+	}
+	for(i = 0; i < TEST_IMAGE_COUNT; i++)
+	{
+		Check(!File_Exists(Test_Filename(native_writer,i,".lock"),&file_length),"Lock file for image "+
+		      std::to_string(i)+" was not removed.");
+		remove(Test_Filename(native_writer,i,".fits").c_str());
+	}
+	queue.stop();
+	cout << (native_writer ? "Native FITS writer" : "CFITSIO") << ": queued " << TEST_IMAGE_COUNT << " " <<
+		TEST_NCOLS << "x" << TEST_NROWS << " images in " <<
+		std::chrono::duration<double,std::milli>(push_time-start_time).count() << " ms, all published after " <<
+		std::chrono::duration<double,std::milli>(flush_time-start_time).count() << " ms." << endl;
+}
+
+/**
+ * Return the filename of a test image.
+ * @param native_writer Which writer the image is saved with, so the two tests use different filenames.
+ * @param index The index of the image.
+ * @param suffix The filename suffix, ".fits" for the image or ".lock" for it's lock file.
+ * @return The filename.
+ * @see #TEST_DIRECTORY
+ */
+static std::string Test_Filename(bool native_writer,int index,const char *suffix)
+{
+	return std::string(TEST_DIRECTORY)+"/test_fits_writer_queue_"+(native_writer ? "native" : "cfitsio")+"_"+
+		std::to_string(index)+suffix;
+}
+
+/**
+ * Return whether a file exists, and it's length.
+ * @param filename The filename.
+ * @param file_length The address of an off_t to return the file's length in.
+ * @return TRUE if the file exists, FALSE if it does not.
+ */
+static int File_Exists(const std::string &filename,off_t *file_length)
+{
+	struct stat file_stat;
+
+	if(stat(filename.c_str(),&file_stat) != 0)
+		return FALSE;
+	(*file_length) = file_stat.st_size;
+	return TRUE;
+}
+
+/**
+ * Check a test condition. If it is false, print the message and set Test_Failed.
+ * @param condition The condition.
+ * @param message The message to print if the condition is false.
+ * @see #Test_Failed
+ */
+static void Check(int condition,const std::string &message)
+{
+	if(!condition)
+	{
+		cerr << "FAILED:" << message << endl;
+		Test_Failed = TRUE;
+	}
+}
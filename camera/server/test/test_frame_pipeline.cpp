@@ -0,0 +1,325 @@
+/**
+ * @file
+ * @brief test_frame_pipeline.cpp tests the two stage (acquisition / processing) frame pipeline, by taking multruns
+ *        on an EmulatedCamera whose processing stage is slower than it's acquisition stage. We check the frames are
+ *        processed in the order they were acquired, that the acquisition stage blocks once frame_pipeline.length
+ *        frames are waiting to be processed, that the measured duty cycle and frame timings are reported, and that
+ *        an aborted multrun, or destroying the camera during a multrun, shuts the pipeline down cleanly.
+ * @author Chris Mottram
+ * @version $Id$
+ */
+#include "CameraConfig.h"
+#include "EmulatedCamera.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include "log4cxx/basicconfigurator.h"
+#include "log4cxx/logger.h"
+
+using std::cout, std::cerr, std::endl;
+using namespace log4cxx;
+
+/**
+ * The name of the temporary configuration file written by this test.
+ */
+#define TEST_CONFIG_FILENAME    ("/tmp/test_frame_pipeline.cfg")
+/**
+ * The number of columns in the emulated CCD.
+ */
+#define TEST_NCOLS              (64)
+/**
+ * The number of rows in the emulated CCD.
+ */
+#define TEST_NROWS              (32)
+/**
+ * The number of emulated frames that can be waiting to be processed ("frame_pipeline.length").
+ */
+#define TEST_PIPELINE_LENGTH    (2)
+/**
+ * The length of each emulated exposure, in milliseconds.
+ */
+#define TEST_EXPOSURE_LENGTH    (10)
+/**
+ * The length of each emulated readout, in milliseconds ("emulation.readout_length").
+ */
+#define TEST_READOUT_LENGTH     (5)
+/**
+ * The length of time the processing stage takes to process each frame, in milliseconds
+ * ("emulation.processing_length"). This is much longer than an exposure and readout, so the processing stage
+ * falls behind.
+ */
+#define TEST_PROCESSING_LENGTH  (100)
+/**
+ * The number of frames in the multrun that runs to completion.
+ */
+#define TEST_FRAME_COUNT        (8)
+/**
+ * The number of frames in the multruns that are aborted / interrupted.
+ */
+#define TEST_LONG_FRAME_COUNT   (50)
+
+static bool Test_Failed = false;
+
+static void Write_Config(void);
+static void Initialise_Camera(EmulatedCamera &camera,CameraConfig &config);
+static int64_t Get_Last_Frame_Id(EmulatedCamera &camera);
+static void Wait_For_Multrun(EmulatedCamera &camera,CameraState &state);
+static void Test_Frame_Order(EmulatedCamera &camera);
+static void Test_Abort(EmulatedCamera &camera);
+static void Test_Destroy_During_Multrun(CameraConfig &config);
+static void Check(bool condition,const std::string &message);
+
+/**
+ * Main program.
+ * <ul>
+ * <li>We write a configuration file with a short pipeline and a slow processing stage using Write_Config.
+ * <li>We create and initialise an EmulatedCamera.
+ * <li>We call Test_Frame_Order to check frame order, backpressure and the measured timings of a multrun.
+ * <li>We call Test_Abort to check an aborted multrun processes all the frames it acquired.
+ * <li>We call Test_Destroy_During_Multrun to check an EmulatedCamera can be destroyed during a multrun.
+ * </ul>
+ * @return The program returns 0 if the test passed, and 1 if it failed.
+ */
+int main(int argc, char *argv[])
+{
+	CameraConfig config;
+
+	BasicConfigurator::configure();
+	Write_Config();
+	config.initialise();
+	config.set_config_filename(TEST_CONFIG_FILENAME);
+	config.load_config();
+	{
+		EmulatedCamera camera;
+
+		Initialise_Camera(camera,config);
+		Test_Frame_Order(camera);
+		Test_Abort(camera);
+	}
+	Test_Destroy_During_Multrun(config);
+	remove(TEST_CONFIG_FILENAME);
+	if(Test_Failed)
+	{
+		cout << "test_frame_pipeline:FAILED" << endl;
+		return 1;
+	}
+	cout << "test_frame_pipeline:PASSED" << endl;
+	return 0;
+}
+
+/**
+ * Write a configuration file containing the keywords the EmulatedCamera needs, with a short frame pipeline,
+ * fast emulated readouts and a slow emulated processing stage.
+ * @see #TEST_CONFIG_FILENAME
+ * @see #TEST_NCOLS
+ * @see #TEST_NROWS
+ * @see #TEST_PIPELINE_LENGTH
+ * @see #TEST_READOUT_LENGTH
+ * @see #TEST_PROCESSING_LENGTH
+ * @see #TEST_LONG_FRAME_COUNT
+ */
+static void Write_Config(void)
+{
+	std::ofstream config_file(TEST_CONFIG_FILENAME);
+
+	config_file << "[Camera]" << endl;
+	config_file << "ccd.ncols = " << TEST_NCOLS << endl;
+	config_file << "ccd.nrows = " << TEST_NROWS << endl;
+	config_file << "ccd.target_temperature = -60.0" << endl;
+	config_file << "frame_pipeline.length = " << TEST_PIPELINE_LENGTH << endl;
+	config_file << "frame_history.length = " << TEST_LONG_FRAME_COUNT << endl;
+	config_file << "emulation.readout_length = " << TEST_READOUT_LENGTH << endl;
+	config_file << "emulation.processing_length = " << TEST_PROCESSING_LENGTH << endl;
+	config_file.close();
+}
+
+/**
+ * Configure and initialise an EmulatedCamera.
+ * @param camera The camera to initialise.
+ * @param config The loaded configuration.
+ */
+static void Initialise_Camera(EmulatedCamera &camera,CameraConfig &config)
+{
+	camera.set_config(config);
+	camera.initialize();
+}
+
+/**
+ * Get the id of the last frame the processing stage has added to the frame history, which is the number of
+ * frames it has processed since the camera was initialised.
+ * @param camera The camera.
+ * @return The id of the last processed frame, or 0 if no frames have been processed.
+ */
+static int64_t Get_Last_Frame_Id(EmulatedCamera &camera)
+{
+	std::vector<FrameInfo> frames;
+
+	camera.list_frames(frames);
+	if(frames.size() == 0)
+		return 0;
+	return frames.back().frame_id;
+}
+
+/**
+ * Wait for a multrun to finish (including processing it's frames).
+ * @param camera The camera.
+ * @param state A CameraState to fill in with the state once the multrun has finished.
+ */
+static void Wait_For_Multrun(EmulatedCamera &camera,CameraState &state)
+{
+	do
+	{
+		camera.wait_for_exposure(10000);
+		camera.get_state(state);
+	}
+	while(state.exposure_in_progress);
+}
+
+/**
+ * Take a multrun of TEST_FRAME_COUNT frames, with a processing stage much slower than the acquisition stage.
+ * <ul>
+ * <li>Whilst the multrun is in progress we poll the number of frames acquired (exposure_index) and then the
+ *     number processed (the last frame id in the frame history). The acquisition stage can be at most
+ *     TEST_PIPELINE_LENGTH frames waiting in the queue, plus one frame being processed, plus the frame it is
+ *     waiting to hand off, ahead of the processing stage. As the processing stage is slow, it should reach this.
+ * <li>Once it has finished, we check all the frames were acquired and processed, in order (consecutive frame ids
+ *     and increasing exposure start times).
+ * <li>We check the measured frame exposure and readout lengths are at least the emulated lengths, and that the
+ *     measured duty cycle reflects the acquisition stage being held up by the processing stage.
+ * </ul>
+ * @param camera The camera to test.
+ * @see #Check
+ */
+static void Test_Frame_Order(EmulatedCamera &camera)
+{
+	std::chrono::steady_clock::time_point start_time,end_time;
+	std::vector<FrameInfo> frames;
+	CameraState state;
+	int64_t first_frame_id,processed_count;
+	double elapsed_length;
+	int acquired_count,max_backlog;
+
+	cout << "Frame order and backpressure:" << endl;
+	first_frame_id = Get_Last_Frame_Id(camera)+1;
+	max_backlog = 0;
+	start_time = std::chrono::steady_clock::now();
+	camera.start_multrun(TEST_FRAME_COUNT,TEST_EXPOSURE_LENGTH,false);
+	do
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+		/* frames acquired first, so frames processed later can only make the backlog look smaller */
+		camera.get_state(state);
+		acquired_count = state.exposure_index;
+		processed_count = Get_Last_Frame_Id(camera)-first_frame_id+1;
+		max_backlog = std::max(max_backlog,acquired_count-(int)processed_count);
+	}
+	while(state.exposure_in_progress);
+	end_time = std::chrono::steady_clock::now();
+	elapsed_length = std::chrono::duration<double,std::milli>(end_time-start_time).count();
+	Check(max_backlog <= TEST_PIPELINE_LENGTH+2,"Acquisition stage was at most "+
+	      std::to_string(TEST_PIPELINE_LENGTH+2)+" frames ahead of processing (was "+
+	      std::to_string(max_backlog)+")");
+	Check(max_backlog == TEST_PIPELINE_LENGTH+2,"Acquisition stage blocked on a full pipeline (backlog "+
+	      std::to_string(max_backlog)+")");
+	Check(elapsed_length >= TEST_FRAME_COUNT*TEST_PROCESSING_LENGTH,"Multrun took "+std::to_string(elapsed_length)+
+	      " ms, limited by the processing stage");
+	Check(state.exposure_index == TEST_FRAME_COUNT,"Acquired "+std::to_string(state.exposure_index)+" frames");
+	camera.list_frames(frames);
+	frames.erase(std::remove_if(frames.begin(),frames.end(),
+				    [first_frame_id](const FrameInfo &frame){return frame.frame_id < first_frame_id;}),
+		     frames.end());
+	Check(frames.size() == TEST_FRAME_COUNT,"Processed "+std::to_string(frames.size())+" frames");
+	for(size_t i = 0; i < frames.size(); i++)
+	{
+		Check(frames[i].frame_id == first_frame_id+(int64_t)i,"Frame "+std::to_string(i)+" has id "+
+		      std::to_string(frames[i].frame_id));
+		Check((frames[i].x_size == TEST_NCOLS)&&(frames[i].y_size == TEST_NROWS),
+		      "Frame "+std::to_string(i)+" has the read out dimensions");
+		if(i > 0)
+		{
+			Check(frames[i].start_time > frames[i-1].start_time,"Frame "+std::to_string(i)+
+			      " was started after the previous frame");
+		}
+	}
+	cout << "Duty cycle " << (state.duty_cycle*100.0) << "%, mean exposure length " <<
+		state.frame_exposure_length << " ms, mean readout length " << state.frame_readout_length << " ms." << endl;
+	Check(state.frame_exposure_length >= TEST_EXPOSURE_LENGTH,"Measured exposure length "+
+	      std::to_string(state.frame_exposure_length)+" ms");
+	Check(state.frame_readout_length >= TEST_READOUT_LENGTH,"Measured readout length "+
+	      std::to_string(state.frame_readout_length)+" ms");
+	/* held up by the processing stage, the duty cycle is well below that of back to back exposures and readouts */
+	Check((state.duty_cycle > 0.0)&&
+	      (state.duty_cycle < 0.5*((double)TEST_EXPOSURE_LENGTH)/((double)(TEST_EXPOSURE_LENGTH+TEST_READOUT_LENGTH))),
+	      "Measured duty cycle "+std::to_string(state.duty_cycle)+" reflects the slow processing stage");
+}
+
+/**
+ * Start a long multrun, abort it part way through, and check it finishes with every frame it acquired processed
+ * (none are lost in the pipeline).
+ * @param camera The camera to test.
+ * @see #Check
+ */
+static void Test_Abort(EmulatedCamera &camera)
+{
+	CameraState state;
+	int64_t first_frame_id,processed_count;
+
+	cout << "Aborted multrun:" << endl;
+	first_frame_id = Get_Last_Frame_Id(camera)+1;
+	camera.start_multrun(TEST_LONG_FRAME_COUNT,TEST_EXPOSURE_LENGTH,false);
+	std::this_thread::sleep_for(std::chrono::milliseconds(3*TEST_PROCESSING_LENGTH));
+	camera.abort_exposure();
+	Wait_For_Multrun(camera,state);
+	processed_count = Get_Last_Frame_Id(camera)-first_frame_id+1;
+	Check((state.exposure_index > 0)&&(state.exposure_index < TEST_LONG_FRAME_COUNT),"Aborted after "+
+	      std::to_string(state.exposure_index)+" frames");
+	Check(processed_count == state.exposure_index,"Processed all "+std::to_string(processed_count)+
+	      " acquired frames");
+	Check(state.exposure_in_progress == false,"Aborted multrun is no longer in progress");
+}
+
+/**
+ * Create an EmulatedCamera, start a long multrun, and destroy the camera whilst the multrun is in progress.
+ * The destructor should abort the multrun and stop the processing stage, rather than hanging or leaving threads
+ * using the destroyed camera.
+ * @param config The loaded configuration.
+ * @see #Check
+ */
+static void Test_Destroy_During_Multrun(CameraConfig &config)
+{
+	std::chrono::steady_clock::time_point start_time;
+	double elapsed_length;
+
+	cout << "Destroy during multrun:" << endl;
+	{
+		EmulatedCamera camera;
+
+		Initialise_Camera(camera,config);
+		camera.start_multrun(TEST_LONG_FRAME_COUNT,TEST_EXPOSURE_LENGTH,false);
+		std::this_thread::sleep_for(std::chrono::milliseconds(TEST_PROCESSING_LENGTH));
+		start_time = std::chrono::steady_clock::now();
+	}
+	elapsed_length = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-start_time).count();
+	Check(elapsed_length < (TEST_PIPELINE_LENGTH+3)*TEST_PROCESSING_LENGTH+1000,"Destroyed the camera in "+
+	      std::to_string(elapsed_length)+" ms");
+}
+
+/**
+ * Report the result of a check, and set Test_Failed if it failed.
+ * @param condition The result of the check.
+ * @param message A description of the check.
+ * @see #Test_Failed
+ */
+static void Check(bool condition,const std::string &message)
+{
+	if(condition)
+		cout << "OK     : " << message << endl;
+	else
+	{
+		cout << "FAILED : " << message << endl;
+		Test_Failed = true;
+	}
+}
@@ -0,0 +1,355 @@
+/**
+ * @file
+ * @brief test_frame_reduction.cpp tests the routines used to apply the basic CCD reductions (bias, dark and flat) to
+ *        each read out frame in the server. It checks a reduced synthetic frame (made like the pipelines' test data)
+ *        against ReductionController.reduce_ccd_image's sum evaluated in double precision, that the result does not
+ *        depend on the number of reduction pool threads, that mismatched frames are rejected, and that master frames saved with
+ *        frame_reduction_save load back unchanged. It then benchmarks the latency of reducing full, binned and
+ *        large frames.
+ * @author Chris Mottram
+ * @version $Id$
+ */
+#include "FrameReduction.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "ccd_fits_header.h"
+
+using std::cout, std::cerr, std::endl;
+
+/**
+ * The directory the test master frames are written into.
+ */
+#define TEST_DIRECTORY          ("/tmp")
+/**
+ * The number of columns in the test frame. Odd, so the rows are not a multiple of the vector length.
+ */
+#define TEST_NCOLS              (257)
+/**
+ * The number of rows in the test frame.
+ */
+#define TEST_NROWS              (131)
+/**
+ * The exposure length of the test frame in seconds, as in the pipelines' test data.
+ */
+#define TEST_EXPOSURE_LENGTH    (10.0)
+/**
+ * The exposure length of the test master dark in seconds, as in the pipelines' test data.
+ */
+#define TEST_DARK_EXPOSURE      (100.0)
+/**
+ * The number of columns / rows in each benchmark frame: a full frame of the 1024 x 1024 detector, the same frame
+ * binned 2x2, and a 2048 x 2048 frame.
+ */
+static const int Benchmark_Size_List[] = {1024,512,2048};
+/**
+ * The number of times each benchmark frame is reduced.
+ */
+#define BENCHMARK_REPEAT_COUNT  (5)
+
+static bool Test_Failed = false;
+
+static void Synthetic_Calibration(int ncols,int nrows,unsigned int seed,FrameCalibration &calibration);
+static void Synthetic_Frame(int ncols,int nrows,unsigned int seed,std::vector<uint16_t> &image);
+static void Check_Reduction(const std::vector<uint16_t> &image,double exposure_length,
+			    const FrameCalibration &calibration,const std::vector<float> &reduced);
+static void Test_Save_Load(const FrameCalibration &calibration);
+static void Benchmark(int size,int thread_count);
+static void Check(bool condition,const std::string &message);
+
+/**
+ * Main program.
+ * <ul>
+ * <li>We make a synthetic master bias, dark and flat, and raw frame (Synthetic_Calibration / Synthetic_Frame),
+ *     reduce the frame with a pool that has not been started (so in this thread only), and check it against the
+ *     reduction in double precision (Check_Reduction).
+ * <li>We check the reduced frame is the same with pools of several threads, including more threads than rows, 
+ *     reducing the frame several times with each pool, and that a bias (zero exposure length) is reduced without
+ *     the dark by a restarted pool.
+ * <li>We check a frame that does not match the master frames, or has an illegal size, is rejected.
+ * <li>We check the reduction FITS headers are added.
+ * <li>We save and reload the master frames (Test_Save_Load).
+ * <li>We benchmark (Benchmark) reducing a frame of each size in Benchmark_Size_List.
+ * </ul>
+ * @return The program returns 0 if the test passed, and 1 if it failed.
+ */
+int main(int argc, char *argv[])
+{
+	FrameCalibration calibration;
+	FrameReductionPool pool;
+	struct Fits_Header_Struct fits_header;
+	std::vector<uint16_t> image;
+	std::vector<float> reduced,threaded_reduced;
+	std::string error_message;
+
+	Synthetic_Calibration(TEST_NCOLS,TEST_NROWS,1,calibration);
+	Synthetic_Frame(TEST_NCOLS,TEST_NROWS,2,image);
+	reduced.resize(image.size());
+	Check(pool.get_thread_count() == 1,"A pool that has not been started has "+
+	      std::to_string(pool.get_thread_count())+" threads, not 1.");
+	Check(frame_reduction_apply(image.data(),TEST_NCOLS,TEST_NROWS,TEST_EXPOSURE_LENGTH,calibration,pool,
+				    reduced.data(),error_message),"Reduction failed:"+error_message);
+	Check_Reduction(image,TEST_EXPOSURE_LENGTH,calibration,reduced);
+	/* the result does not depend on the number of threads, or on how many frames the pool has reduced */
+	for(int thread_count : {3,TEST_NROWS+5})
+	{
+		FrameReductionPool threaded_pool;
+
+		threaded_pool.start(thread_count);
+		for(int i = 0; i < 3; i++)
+		{
+			threaded_reduced.assign(image.size(),0.0f);
+			Check(frame_reduction_apply(image.data(),TEST_NCOLS,TEST_NROWS,TEST_EXPOSURE_LENGTH,calibration,
+						    threaded_pool,threaded_reduced.data(),error_message),
+			      "Reduction with "+std::to_string(thread_count)+" threads failed:"+error_message);
+			Check(threaded_reduced == reduced,"Reduction with "+std::to_string(thread_count)+
+			      " threads differs from the reduction with one thread.");
+		}
+	}
+	/* restarting a pool replaces it's workers */
+	pool.start(2);
+	pool.start(4);
+	Check(pool.get_thread_count() == 4,"A restarted pool has "+std::to_string(pool.get_thread_count())+
+	      " threads, not 4.");
+	/* a bias has no dark current to subtract */
+	Check(frame_reduction_apply(image.data(),TEST_NCOLS,TEST_NROWS,0.0,calibration,pool,reduced.data(),
+				    error_message),"Bias reduction failed:"+error_message);
+	Check_Reduction(image,0.0,calibration,reduced);
+	/* mismatched and illegal frame sizes */
+	Check(!frame_reduction_apply(image.data(),TEST_NROWS,TEST_NCOLS,TEST_EXPOSURE_LENGTH,calibration,pool,
+				     reduced.data(),error_message),"Reduction of a transposed frame succeeded.");
+	Check(!frame_reduction_apply(image.data(),0,TEST_NROWS,TEST_EXPOSURE_LENGTH,calibration,pool,
+				     reduced.data(),error_message),"Reduction of a frame with no columns succeeded.");
+	pool.stop();
+	/* reduction FITS headers */
+	CCD_Fits_Header_Initialise(&fits_header);
+	Check(frame_reduction_add_fits_headers(&fits_header,calibration,error_message),
+	      "Adding the reduction FITS headers failed:"+error_message);
+	Check(fits_header.Card_Count == 4,"Reduction FITS headers has "+std::to_string(fits_header.Card_Count)+
+	      " cards, not 4.");
+	CCD_Fits_Header_Free(&fits_header);
+	Test_Save_Load(calibration);
+	/* benchmark */
+	cout << "Size      Threads Latency(ms)" << endl;
+	for(int size : Benchmark_Size_List)
+	{
+		Benchmark(size,1);
+		Benchmark(size,4);
+	}
+	if(Test_Failed)
+	{
+		cout << "test_frame_reduction FAILED." << endl;
+		return 1;
+	}
+	cout << "test_frame_reduction PASSED." << endl;
+	return 0;
+}
+
+/**
+ * Create synthetic master frames, made like the pipelines' test data (pipelines/testdata/generate_testdata.py):
+ * a bias of normally distributed integers (10 +/- 3), an integer dark current between 0 and 9 with an exposure
+ * length of TEST_DARK_EXPOSURE seconds, and a flat field normally distributed around 1 (+/- 0.01).
+ * The random number generator has a fixed seed, so the frames are the same every time.
+ * @param ncols The number of columns in the frames.
+ * @param nrows The number of rows in the frames.
+ * @param seed The random number generator seed.
+ * @param calibration On return, the master frames.
+ * @see #TEST_DARK_EXPOSURE
+ */
+static void Synthetic_Calibration(int ncols,int nrows,unsigned int seed,FrameCalibration &calibration)
+{
+	std::mt19937 generator(seed);
+	std::normal_distribution<double> bias_distribution(10.0,3.0);
+	std::uniform_int_distribution<int> dark_distribution(0,9);
+	std::normal_distribution<double> flat_distribution(1.0,0.01);
+	size_t pixel_count = ((size_t)ncols)*nrows;
+
+	calibration.mBiasFilename = "image_zero.fits";
+	calibration.mDarkFilename = "image_dark.fits";
+	calibration.mFlatFilename = "image_flat.fits";
+	calibration.mNCols = ncols;
+	calibration.mNRows = nrows;
+	calibration.mBias.resize(pixel_count);
+	calibration.mDark.resize(pixel_count);
+	calibration.mFlat.resize(pixel_count);
+	for(size_t i = 0; i < pixel_count; i++)
+	{
+		calibration.mBias[i] = (float)std::trunc(bias_distribution(generator));
+		calibration.mDark[i] = (float)dark_distribution(generator);
+		calibration.mFlat[i] = (float)flat_distribution(generator);
+	}
+	calibration.mDarkExposureLength = TEST_DARK_EXPOSURE;
+}
+
+/**
+ * Create a synthetic raw frame of normally distributed pixel values (100 +/- 10), as in the pipelines' test data.
+ * @param ncols The number of columns in the frame.
+ * @param nrows The number of rows in the frame.
+ * @param seed The random number generator seed.
+ * @param image On return, the frame.
+ */
+static void Synthetic_Frame(int ncols,int nrows,unsigned int seed,std::vector<uint16_t> &image)
+{
+	std::mt19937 generator(seed);
+	std::normal_distribution<double> distribution(100.0,10.0);
+
+	image.resize(((size_t)ncols)*nrows);
+	for(size_t i = 0; i < image.size(); i++)
+		image[i] = (uint16_t)std::min(std::max(std::lround(distribution(generator)),0L),65535L);
+}
+
+/**
+ * Check a reduced frame against ReductionController.reduce_ccd_image's sum, evaluated in double precision as numpy
+ * does. Each pixel is allowed a relative error of 1e-6 of the size of the terms summed, a few float32 roundings.
+ * @param image The raw frame.
+ * @param exposure_length The raw frame's exposure length in seconds.
+ * @param calibration The master frames the frame was reduced with.
+ * @param reduced The reduced frame.
+ */
+static void Check_Reduction(const std::vector<uint16_t> &image,double exposure_length,
+			    const FrameCalibration &calibration,const std::vector<float> &reduced)
+{
+	double dark_scale,expected,tolerance,error,max_error;
+	size_t error_count;
+
+	dark_scale = exposure_length/calibration.mDarkExposureLength;
+	max_error = 0.0;
+	error_count = 0;
+	for(size_t i = 0; i < image.size(); i++)
+	{
+		expected = (((double)image[i])-calibration.mBias[i]-(dark_scale*calibration.mDark[i]))/
+			calibration.mFlat[i];
+		tolerance = 1.0e-6*(image[i]+std::fabs(calibration.mBias[i])+std::fabs(dark_scale*calibration.mDark[i]))/
+			calibration.mFlat[i];
+		error = std::fabs(reduced[i]-expected);
+		max_error = std::max(max_error,error);
+		if(error > tolerance)
+			error_count++;
+	}
+	Check(error_count == 0,std::to_string(error_count)+" reduced pixels differ from the double precision "
+	      "reduction, by up to "+std::to_string(max_error)+".");
+}
+
+/**
+ * Save the master frames to FITS images in TEST_DIRECTORY with frame_reduction_save (the dark with an EXPOSURE
+ * header), load them back with frame_reduction_load_calibration, and check they are unchanged. We also check a
+ * missing master frame, and master frames of different sizes, are rejected.
+ * @param calibration The master frames to save.
+ * @see #TEST_DIRECTORY
+ */
+static void Test_Save_Load(const FrameCalibration &calibration)
+{
+	FrameCalibration loaded_calibration;
+	struct Fits_Header_Struct fits_header;
+	std::string bias_filename,dark_filename,flat_filename,small_filename,error_message;
+	std::vector<float> small_frame(4,1.0f);
+	bool loaded;
+
+	bias_filename = std::string(TEST_DIRECTORY)+"/test_frame_reduction_bias.fits";
+	dark_filename = std::string(TEST_DIRECTORY)+"/test_frame_reduction_dark.fits";
+	flat_filename = std::string(TEST_DIRECTORY)+"/test_frame_reduction_flat.fits";
+	small_filename = std::string(TEST_DIRECTORY)+"/test_frame_reduction_small.fits";
+	for(const std::string &filename : {bias_filename,dark_filename,flat_filename,small_filename})
+		unlink(filename.c_str());
+	CCD_Fits_Header_Initialise(&fits_header);
+	Check(frame_reduction_save(bias_filename.c_str(),calibration.mBias.data(),calibration.mNCols,
+				   calibration.mNRows,fits_header,error_message),"Saving the bias failed:"+error_message);
+	Check(frame_reduction_save(flat_filename.c_str(),calibration.mFlat.data(),calibration.mNCols,
+				   calibration.mNRows,fits_header,error_message),"Saving the flat failed:"+error_message);
+	Check(frame_reduction_save(small_filename.c_str(),small_frame.data(),2,2,fits_header,error_message),
+	      "Saving the small frame failed:"+error_message);
+	CCD_Fits_Header_Add_Float(&fits_header,"EXPOSURE",calibration.mDarkExposureLength,
+				  "Exposure length in decimal seconds");
+	Check(frame_reduction_save(dark_filename.c_str(),calibration.mDark.data(),calibration.mNCols,
+				   calibration.mNRows,fits_header,error_message),"Saving the dark failed:"+error_message);
+	CCD_Fits_Header_Free(&fits_header);
+	loaded = frame_reduction_load_calibration(bias_filename.c_str(),dark_filename.c_str(),flat_filename.c_str(),
+						  loaded_calibration,error_message);
+	Check(loaded,"Loading the master frames failed:"+error_message);
+	if(loaded)
+	{
+		Check((loaded_calibration.mNCols == calibration.mNCols)&&(loaded_calibration.mNRows == calibration.mNRows),
+		      "Loaded master frames have size "+std::to_string(loaded_calibration.mNCols)+"x"+
+		      std::to_string(loaded_calibration.mNRows)+".");
+		Check((loaded_calibration.mBias == calibration.mBias)&&(loaded_calibration.mDark == calibration.mDark)&&
+		      (loaded_calibration.mFlat == calibration.mFlat),"Loaded master frames differ from the saved ones.");
+		Check(loaded_calibration.mDarkExposureLength == calibration.mDarkExposureLength,
+		      "Loaded master dark exposure length "+std::to_string(loaded_calibration.mDarkExposureLength)+
+		      " is not "+std::to_string(calibration.mDarkExposureLength)+".");
+		Check(loaded_calibration.mDarkFilename == dark_filename,"Loaded master dark filename "+
+		      loaded_calibration.mDarkFilename+" is not "+dark_filename+".");
+	}
+	Check(!frame_reduction_load_calibration(bias_filename.c_str(),dark_filename.c_str(),small_filename.c_str(),
+						loaded_calibration,error_message),
+	      "Loading master frames of different sizes succeeded.");
+	/* the dark needs an EXPOSURE header */
+	Check(!frame_reduction_load_calibration(bias_filename.c_str(),flat_filename.c_str(),flat_filename.c_str(),
+						loaded_calibration,error_message),
+	      "Loading a master dark without an EXPOSURE header succeeded.");
+	Check(!frame_reduction_load_calibration((bias_filename+".missing").c_str(),dark_filename.c_str(),
+						flat_filename.c_str(),loaded_calibration,error_message),
+	      "Loading a missing master bias succeeded.");
+	for(const std::string &filename : {bias_filename,dark_filename,flat_filename,small_filename})
+		unlink(filename.c_str());
+}
+
+/**
+ * Benchmark reducing a square frame with frame_reduction_apply, and print the latency. The frame is
+ * reduced BENCHMARK_REPEAT_COUNT times by the same reduction pool, started before the timing starts as the camera
+ * server starts it's pool when it is initialised, and the fastest time used. The latency depends on the machine the test is
+ * run on, so it does not fail the test.
+ * @param size The number of columns / rows in the frame.
+ * @param thread_count The number of threads to use.
+ * @see #BENCHMARK_REPEAT_COUNT
+ */
+static void Benchmark(int size,int thread_count)
+{
+	std::chrono::steady_clock::time_point start_time;
+	FrameCalibration calibration;
+	FrameReductionPool pool;
+	std::vector<uint16_t> image;
+	std::vector<float> reduced(((size_t)size)*size);
+	std::string error_message;
+	double best_time;
+
+	Synthetic_Calibration(size,size,3,calibration);
+	Synthetic_Frame(size,size,4,image);
+	pool.start(thread_count);
+	best_time = 1.0e9;
+	for(int i = 0; i < BENCHMARK_REPEAT_COUNT; i++)
+	{
+		start_time = std::chrono::steady_clock::now();
+		if(!frame_reduction_apply(image.data(),size,size,TEST_EXPOSURE_LENGTH,calibration,pool,
+					  reduced.data(),error_message))
+		{
+			Check(false,"Benchmark reduction failed:"+error_message);
+			return;
+		}
+		best_time = std::min(best_time,
+				     std::chrono::duration<double>(std::chrono::steady_clock::now()-start_time).count());
+	}
+	cout << std::left << std::setw(10) << (std::to_string(size)+"x"+std::to_string(size)) << std::right <<
+		std::setw(7) << thread_count << std::fixed << std::setprecision(1) << std::setw(12) <<
+		best_time*1000.0 << endl;
+}
+
+/**
+ * Check a test condition. If it is false, print the message and set Test_Failed.
+ * @param condition The condition.
+ * @param message The message to print if the condition is false.
+ * @see #Test_Failed
+ */
+static void Check(bool condition,const std::string &message)
+{
+	if(!condition)
+	{
+		cerr << "FAILED:" << message << endl;
+		Test_Failed = true;
+	}
+}
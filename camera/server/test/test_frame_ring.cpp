@@ -0,0 +1,268 @@
+/**
+ * @file
+ * @brief test_frame_ring.cpp tests the shared memory frame ring, by running a multrun on an EmulatedCamera with the
+ *        frame ring enabled, and reading the published frames back using the CCD library frame ring reader API.
+ *        It also checks the frame history (list_frames / get_image_data_by_id).
+ * @author Chris Mottram
+ * @version $Id$
+ */
+#include "CameraConfig.h"
+#include "EmulatedCamera.h"
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <string.h>
+#include "log4cxx/basicconfigurator.h"
+#include "log4cxx/logger.h"
+#include "ccd_frame_ring.h"
+#include "ccd_general.h"
+
+using std::cout, std::cerr, std::endl;
+using namespace log4cxx;
+
+/**
+ * The name of the temporary configuration file written by this test.
+ */
+#define TEST_CONFIG_FILENAME    ("/tmp/test_frame_ring.cfg")
+/**
+ * The name of the shared memory segment used by this test.
+ */
+#define TEST_FRAME_RING_NAME    ("/mookodi_test_frame_ring")
+/**
+ * The number of slots in the test frame ring.
+ */
+#define TEST_SLOT_COUNT         (4)
+/**
+ * The number of columns in the emulated CCD.
+ */
+#define TEST_NCOLS              (256)
+/**
+ * The number of rows in the emulated CCD.
+ */
+#define TEST_NROWS              (128)
+/**
+ * The number of frames to take in the multrun. This is more than TEST_SLOT_COUNT, so the ring wraps.
+ */
+#define TEST_FRAME_COUNT        (6)
+/**
+ * The number of frames kept in the frame history. This is less than TEST_FRAME_COUNT, so frames are evicted.
+ */
+#define TEST_HISTORY_LENGTH     (3)
+
+static int Test_Failed = FALSE;
+
+static void Write_Config(void);
+static void Check(int condition,const std::string &message);
+static int Check_Pixels(const unsigned short *buffer,int ncols,int nrows);
+static void Check_Latest_Frame(struct CCD_Frame_Ring_Struct *ring,int64_t *last_sequence_number);
+
+/**
+ * Main program.
+ * <ul>
+ * <li>We write a minimal configuration file, enabling the frame ring, using Write_Config.
+ * <li>We create and initialise an EmulatedCamera, which creates the frame ring.
+ * <li>We attach to the frame ring as a reader using CCD_Frame_Ring_Open, and check no frames have been published.
+ * <li>We start a multbias of TEST_FRAME_COUNT frames, and each time wait_for_exposure returns we check the
+ *     latest frame in the ring using Check_Latest_Frame.
+ * <li>We check frames that have been overwritten cannot be read, and the frames still in the ring can.
+ * <li>We check the last frame in the ring matches the one returned by get_image_data_binary.
+ * <li>We check the frame history (list_frames) holds the last TEST_HISTORY_LENGTH frames, that the last frame 
+ *     returned by get_image_data_by_id matches get_image_data_binary, and that an evicted frame cannot be retrieved.
+ * </ul>
+ * @return The program returns 0 if the test passed, and 1 if it failed.
+ */
+int main(int argc, char *argv[])
+{
+	EmulatedCamera camera;
+	CameraConfig config;
+	CameraState state;
+	ImageDataBinary image_data,history_image_data;
+	std::vector<FrameInfo> frames;
+	bool thrown;
+	struct CCD_Frame_Ring_Struct ring;
+	struct CCD_Frame_Ring_Frame_Struct frame;
+	std::vector<unsigned short> buffer(TEST_NCOLS*TEST_NROWS);
+	int64_t sequence_number,last_sequence_number;
+	int slot_count;
+
+	BasicConfigurator::configure();
+	Write_Config();
+	config.initialise();
+	config.set_config_filename(TEST_CONFIG_FILENAME);
+	config.load_config();
+	camera.set_config(config);
+	camera.initialize();
+	/* attach to the ring as a co-located consumer would */
+	CCD_Frame_Ring_Initialise(&ring);
+	if(!CCD_Frame_Ring_Open(&ring,TEST_FRAME_RING_NAME))
+	{
+		CCD_General_Error();
+		return 1;
+	}
+	Check(CCD_Frame_Ring_Slot_Count_Get(&ring,&slot_count)&&(slot_count == TEST_SLOT_COUNT),"Slot count");
+	Check(CCD_Frame_Ring_Latest_Sequence_Get(&ring,&sequence_number)&&(sequence_number == 0),
+	      "No frames published before the first exposure");
+	/* take a series of frames, checking each one as it is published */
+	last_sequence_number = 0;
+	camera.start_multbias(TEST_FRAME_COUNT);
+	do
+	{
+		camera.wait_for_exposure(10000);
+		Check_Latest_Frame(&ring,&last_sequence_number);
+		camera.get_state(state);
+	}
+	while(state.exposure_in_progress);
+	Check_Latest_Frame(&ring,&last_sequence_number);
+	Check(last_sequence_number == TEST_FRAME_COUNT,"Latest sequence number is the frame count");
+	/* frames that have been overwritten can no longer be read */
+	for(sequence_number = 1; sequence_number <= TEST_FRAME_COUNT; sequence_number++)
+	{
+		if(sequence_number <= (TEST_FRAME_COUNT-TEST_SLOT_COUNT))
+		{
+			Check(CCD_Frame_Ring_Read(&ring,sequence_number,&frame,buffer.data(),buffer.size()) == FALSE,
+			      "Overwritten frame "+std::to_string(sequence_number)+" cannot be read");
+		}
+		else
+		{
+			Check(CCD_Frame_Ring_Read(&ring,sequence_number,&frame,buffer.data(),buffer.size())&&
+			      (frame.Sequence_Number == sequence_number)&&
+			      Check_Pixels(buffer.data(),frame.NCols,frame.NRows),
+			      "Frame "+std::to_string(sequence_number)+" can be read");
+		}
+	}
+	/* the last frame in the ring is the same as the one returned through thrift */
+	camera.get_image_data_binary(image_data);
+	Check(CCD_Frame_Ring_Read(&ring,TEST_FRAME_COUNT,&frame,buffer.data(),buffer.size()),"Read last frame");
+	Check((image_data.frame_sequence == frame.Sequence_Number)&&(image_data.x_size == frame.NCols)&&
+	      (image_data.y_size == frame.NRows)&&
+	      (image_data.data.size() == (size_t)(frame.NCols*frame.NRows*sizeof(unsigned short)))&&
+	      (memcmp(image_data.data.data(),buffer.data(),image_data.data.size()) == 0),
+	      "Last frame matches get_image_data_binary");
+	/* the frame history holds the last TEST_HISTORY_LENGTH frames */
+	camera.list_frames(frames);
+	Check((frames.size() == TEST_HISTORY_LENGTH)&&
+	      (frames.front().frame_id == (TEST_FRAME_COUNT-TEST_HISTORY_LENGTH+1))&&
+	      (frames.back().frame_id == TEST_FRAME_COUNT),"Frame history holds the last frames");
+	camera.get_image_data_by_id(history_image_data,TEST_FRAME_COUNT);
+	Check((history_image_data.frame_sequence == image_data.frame_sequence)&&
+	      (history_image_data.data == image_data.data),"Last frame in history matches get_image_data_binary");
+	thrown = false;
+	try
+	{
+		camera.get_image_data_by_id(history_image_data,1);
+	}
+	catch(CameraException &e)
+	{
+		thrown = true;
+	}
+	Check(thrown,"Evicted frame 1 cannot be retrieved from the frame history");
+	CCD_Frame_Ring_Close(&ring);
+	remove(TEST_CONFIG_FILENAME);
+	if(Test_Failed)
+	{
+		cout << "test_frame_ring:FAILED" << endl;
+		return 1;
+	}
+	cout << "test_frame_ring:PASSED" << endl;
+	return 0;
+}
+
+/**
+ * Write a minimal configuration file containing the keywords the EmulatedCamera needs, with the frame ring enabled.
+ * @see #TEST_CONFIG_FILENAME
+ * @see #TEST_FRAME_RING_NAME
+ * @see #TEST_SLOT_COUNT
+ * @see #TEST_NCOLS
+ * @see #TEST_NROWS
+ * @see #TEST_HISTORY_LENGTH
+ */
+static void Write_Config(void)
+{
+	std::ofstream config_file(TEST_CONFIG_FILENAME);
+
+	config_file << "[Camera]" << endl;
+	config_file << "ccd.ncols = " << TEST_NCOLS << endl;
+	config_file << "ccd.nrows = " << TEST_NROWS << endl;
+	config_file << "ccd.target_temperature = -60.0" << endl;
+	config_file << "frame_ring.enable = true" << endl;
+	config_file << "frame_ring.name = " << TEST_FRAME_RING_NAME << endl;
+	config_file << "frame_ring.slot_count = " << TEST_SLOT_COUNT << endl;
+	config_file << "frame_history.length = " << TEST_HISTORY_LENGTH << endl;
+	config_file.close();
+}
+
+/**
+ * Report the result of a check, and set Test_Failed if it failed.
+ * @param condition The result of the check.
+ * @param message A description of the check.
+ * @see #Test_Failed
+ */
+static void Check(int condition,const std::string &message)
+{
+	if(condition)
+		cout << "OK     : " << message << endl;
+	else
+	{
+		cout << "FAILED : " << message << endl;
+		Test_Failed = TRUE;
+	}
+}
+
+/**
+ * Check the pixels in a frame match the pattern generated by the EmulatedCamera.
+ * @param buffer The frame's pixels.
+ * @param ncols The number of columns in the frame.
+ * @param nrows The number of rows in the frame.
+ * @return TRUE if all the pixels match, FALSE otherwise.
+ */
+static int Check_Pixels(const unsigned short *buffer,int ncols,int nrows)
+{
+	int total_pixels = ncols*nrows;
+
+	if((ncols != TEST_NCOLS)||(nrows != TEST_NROWS))
+		return FALSE;
+	for(int i = 0; i < nrows; i++)
+	{
+		for(int j = 0; j < ncols; j++)
+		{
+			if(buffer[i*ncols+j] != (unsigned short)((i*j) * pow(2, 14) / total_pixels))
+				return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/**
+ * Check the latest frame in the ring, by mapping it (zero-copy), checking its contents, and then checking
+ * the writer did not overwrite it whilst we were using it.
+ * @param ring The attached frame ring.
+ * @param last_sequence_number The address of the sequence number last seen, updated by this routine.
+ *        The latest sequence number should never go backwards.
+ * @see #Check
+ * @see #Check_Pixels
+ */
+static void Check_Latest_Frame(struct CCD_Frame_Ring_Struct *ring,int64_t *last_sequence_number)
+{
+	struct CCD_Frame_Ring_Frame_Struct frame;
+	const unsigned short *mapped_buffer = NULL;
+	uint64_t generation;
+	int64_t sequence_number;
+	int pixels_ok;
+
+	Check(CCD_Frame_Ring_Latest_Sequence_Get(ring,&sequence_number)&&(sequence_number >= (*last_sequence_number)),
+	      "Latest sequence number "+std::to_string(sequence_number)+" has not gone backwards");
+	(*last_sequence_number) = sequence_number;
+	if(sequence_number == 0)
+		return;
+	Check(CCD_Frame_Ring_Frame_Map(ring,sequence_number,&frame,&mapped_buffer,&generation),
+	      "Map frame "+std::to_string(sequence_number));
+	if(mapped_buffer == NULL)
+		return;
+	pixels_ok = Check_Pixels(mapped_buffer,frame.NCols,frame.NRows);
+	/* the emulator only publishes every second or so, so the slot should not have been overwritten */
+	Check(CCD_Frame_Ring_Frame_Is_Valid(ring,sequence_number,generation),
+	      "Mapped frame "+std::to_string(sequence_number)+" still valid");
+	Check(pixels_ok&&(frame.Sequence_Number == sequence_number)&&(frame.Bin_X == 1)&&(frame.Bin_Y == 1),
+	      "Mapped frame "+std::to_string(sequence_number)+" contents");
+}
@@ -0,0 +1,309 @@
+/**
+ * @file
+ * @brief test_frame_statistics.cpp tests the routines used to compute the statistics and histogram of each read out
+ *        frame. It checks the statistics of random images and regions against statistics computed directly from
+ *        the pixels (by sorting them), including odd and even pixel counts, saturated pixels, regions clipped by
+ *        or outside the image, and that the result does not depend on the number of threads. It then benchmarks
+ *        the latency of computing the statistics of full, binned and large frames.
+ * @author Chris Mottram
+ * @version $Id$
+ */
+#include "FrameStatistics.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using std::cout, std::cerr, std::endl;
+
+/**
+ * The number of columns / rows in each benchmark frame: a full frame of the 1024 x 1024 detector, the same frame
+ * binned 2x2, and a 2048 x 2048 frame.
+ */
+static const int Benchmark_Size_List[] = {1024,512,2048};
+/**
+ * The number of times the statistics of each benchmark frame are computed.
+ */
+#define BENCHMARK_REPEAT_COUNT  (5)
+
+static bool Test_Failed = false;
+
+static void Random_Image(int ncols,int nrows,int mean,int sigma,unsigned int seed,std::vector<uint16_t> &image);
+static void Direct_Statistics(const std::vector<uint16_t> &image,int ncols,int x0,int y0,int width,int height,
+			      int saturation_level,RegionStatistics &statistics);
+static void Check_Statistics(const RegionStatistics &statistics,const RegionStatistics &expected,
+			     const std::string &name);
+static void Benchmark(const std::vector<uint16_t> &image,int ncols,int nrows,int thread_count,
+		      const std::string &name);
+static void Check(bool condition,const std::string &message);
+
+/**
+ * Main program.
+ * <ul>
+ * <li>We check the statistics of a few hand computed histograms: odd and even pixel counts, and an empty histogram.
+ * <li>We compute the statistics of a random odd sized image, with saturated pixels and four regions (inside,
+ *     clipped by the right / bottom edges, and outside the image), and check them against Direct_Statistics.
+ * <li>We check the histogram adds up to the number of pixels, and that the statistics are the same with one and
+ *     with several threads, including more threads than rows.
+ * <li>We check an illegal image size is rejected.
+ * <li>We benchmark (Benchmark) computing the statistics of a sky frame and bias frame of each size in
+ *     Benchmark_Size_List.
+ * </ul>
+ * @return The program returns 0 if the test passed, and 1 if it failed.
+ */
+int main(int argc, char *argv[])
+{
+	std::vector<uint16_t> image;
+	std::vector<uint32_t> histogram;
+	FrameStatisticsConfig config;
+	ImageStatistics statistics,threaded_statistics;
+	RegionStatistics region_statistics,expected;
+	std::string error_message;
+	int64_t histogram_total;
+	int ncols,nrows;
+
+	/* statistics from a histogram: values 10,10,20,40 (even count), then 10,10,20,40,40 (odd count) */
+	histogram.assign(FRAME_STATISTICS_HISTOGRAM_LENGTH,0);
+	histogram[10] = 2;
+	histogram[20] = 1;
+	histogram[40] = 1;
+	frame_statistics_from_histogram(histogram,40,region_statistics);
+	Check((region_statistics.pixel_count == 4)&&(region_statistics.min == 10)&&(region_statistics.max == 40),
+	      "Even count histogram has the wrong pixel count, minimum or maximum.");
+	Check(region_statistics.mean == 20.0,"Even count histogram mean "+std::to_string(region_statistics.mean)+
+	      " is not 20.");
+	Check(region_statistics.median == 15.0,"Even count histogram median "+std::to_string(region_statistics.median)+
+	      " is not 15.");
+	Check(std::fabs(region_statistics.stddev-std::sqrt(150.0)) < 1.0e-9,"Even count histogram standard deviation "+
+	      std::to_string(region_statistics.stddev)+" is not sqrt(150).");
+	Check(region_statistics.saturated_count == 1,"Even count histogram does not have 1 saturated pixel.");
+	histogram[40] = 2;
+	frame_statistics_from_histogram(histogram,41,region_statistics);
+	Check(region_statistics.median == 20.0,"Odd count histogram median "+std::to_string(region_statistics.median)+
+	      " is not 20.");
+	Check(region_statistics.saturated_count == 0,"Odd count histogram has saturated pixels.");
+	histogram.assign(FRAME_STATISTICS_HISTOGRAM_LENGTH,0);
+	frame_statistics_from_histogram(histogram,40,region_statistics);
+	Check((region_statistics.pixel_count == 0)&&(region_statistics.min == 0)&&(region_statistics.max == 0)&&
+	      (region_statistics.mean == 0.0)&&(region_statistics.median == 0.0),"Empty histogram statistics not zero.");
+	/* a random image, with some saturated pixels, and regions inside, clipped by and outside the image */
+	ncols = 517;
+	nrows = 331;
+	Random_Image(ncols,nrows,3000,400,1,image);
+	for(int i = 0; i < 200; i++)
+		image[(i*7919)%image.size()] = 65535;
+	config.mThreadCount = 1;
+	config.mSaturationLevel = 60000;
+	config.mRegions = {{"inside",10,20,101,51},{"overscan",500,0,40,331},{"corner",-5,300,20,50},
+			   {"outside",600,400,10,10}};
+	Check(frame_statistics_compute(image.data(),ncols,nrows,config,statistics,error_message),
+	      "Statistics failed:"+error_message);
+	Check((statistics.saturation_level == 60000)&&(statistics.image.name == "image")&&
+	      (statistics.image.width == ncols)&&(statistics.image.height == nrows),
+	      "Image statistics have the wrong saturation level, name or size.");
+	Direct_Statistics(image,ncols,0,0,ncols,nrows,60000,expected);
+	Check_Statistics(statistics.image,expected,"image");
+	Check(statistics.image.saturated_count >= 200,"Image has less than 200 saturated pixels.");
+	Check(statistics.histogram.size() == FRAME_STATISTICS_HISTOGRAM_LENGTH,"Histogram has the wrong length.");
+	histogram_total = 0;
+	for(int32_t count : statistics.histogram)
+		histogram_total += count;
+	Check(histogram_total == ((int64_t)ncols)*nrows,"Histogram does not add up to the number of pixels.");
+	Check(statistics.histogram[65535] == statistics.image.saturated_count,
+	      "Histogram bin 65535 is not the saturated count.");
+	Check(statistics.regions.size() == 4,"There are not 4 region statistics.");
+	if(statistics.regions.size() == 4)
+	{
+		Direct_Statistics(image,ncols,10,20,101,51,60000,expected);
+		Check_Statistics(statistics.regions[0],expected,"inside");
+		Direct_Statistics(image,ncols,500,0,17,331,60000,expected);
+		Check_Statistics(statistics.regions[1],expected,"overscan");
+		Direct_Statistics(image,ncols,0,300,15,31,60000,expected);
+		Check_Statistics(statistics.regions[2],expected,"corner");
+		Check((statistics.regions[2].x0 == 0)&&(statistics.regions[2].y0 == 300)&&
+		      (statistics.regions[2].width == 15)&&(statistics.regions[2].height == 31),
+		      "Region corner was not clipped to the image.");
+		Check((statistics.regions[3].name == "outside")&&(statistics.regions[3].width == 0)&&
+		      (statistics.regions[3].height == 0)&&(statistics.regions[3].pixel_count == 0),
+		      "Region outside is not empty.");
+	}
+	/* the statistics do not depend on the number of threads */
+	for(int thread_count : {3,4,1000})
+	{
+		config.mThreadCount = thread_count;
+		Check(frame_statistics_compute(image.data(),ncols,nrows,config,threaded_statistics,error_message),
+		      "Threaded statistics failed:"+error_message);
+		Check(threaded_statistics == statistics,std::to_string(thread_count)+
+		      " thread statistics differ from 1 thread statistics.");
+	}
+	/* a single row image has an odd number of pixels */
+	Check(frame_statistics_compute(image.data(),ncols,1,config,statistics,error_message),
+	      "Single row statistics failed:"+error_message);
+	Direct_Statistics(image,ncols,0,0,ncols,1,60000,expected);
+	Check_Statistics(statistics.image,expected,"single row");
+	/* illegal image size */
+	Check(!frame_statistics_compute(image.data(),0,nrows,config,statistics,error_message),
+	      "Image with no columns succeeded.");
+	/* benchmark */
+	cout << "Size      Frame Threads Latency(ms)" << endl;
+	for(int size : Benchmark_Size_List)
+	{
+		Random_Image(size,size,3000,60,2,image);
+		Benchmark(image,size,size,1,"sky");
+		Benchmark(image,size,size,4,"sky");
+		Random_Image(size,size,1000,3,3,image);
+		Benchmark(image,size,size,1,"bias");
+		Benchmark(image,size,size,4,"bias");
+	}
+	if(Test_Failed)
+	{
+		cout << "test_frame_statistics FAILED." << endl;
+		return 1;
+	}
+	cout << "test_frame_statistics PASSED." << endl;
+	return 0;
+}
+
+/**
+ * Create an image of normally distributed pixel values, clipped to 0..65535. The random number generator has a
+ * fixed seed, so the image is the same every time.
+ * @param ncols The number of columns in the image.
+ * @param nrows The number of rows in the image.
+ * @param mean The mean pixel value.
+ * @param sigma The standard deviation of the pixel values.
+ * @param seed The random number generator seed.
+ * @param image On return, the image.
+ */
+static void Random_Image(int ncols,int nrows,int mean,int sigma,unsigned int seed,std::vector<uint16_t> &image)
+{
+	std::mt19937 generator(seed);
+	std::normal_distribution<double> distribution(mean,sigma);
+
+	image.resize(((size_t)ncols)*nrows);
+	for(size_t i = 0; i < image.size(); i++)
+		image[i] = (uint16_t)std::min(std::max(std::lround(distribution(generator)),0L),65535L);
+}
+
+/**
+ * Compute the statistics of a region of an image directly from it's pixels: the median is found by sorting them.
+ * @param image The image.
+ * @param ncols The number of columns in the image.
+ * @param x0 The first column of the region.
+ * @param y0 The first row of the region.
+ * @param width The number of columns in the region.
+ * @param height The number of rows in the region.
+ * @param saturation_level The pixel value at or above which a pixel is counted as saturated.
+ * @param statistics On return, the region's statistics.
+ */
+static void Direct_Statistics(const std::vector<uint16_t> &image,int ncols,int x0,int y0,int width,int height,
+			      int saturation_level,RegionStatistics &statistics)
+{
+	std::vector<uint16_t> pixels;
+	double sum,sum_squares;
+	size_t n;
+
+	for(int y = y0; y < y0+height; y++)
+		pixels.insert(pixels.end(),image.begin()+((size_t)y)*ncols+x0,image.begin()+((size_t)y)*ncols+x0+width);
+	std::sort(pixels.begin(),pixels.end());
+	n = pixels.size();
+	sum = 0.0;
+	statistics.saturated_count = 0;
+	for(uint16_t pixel : pixels)
+	{
+		sum += pixel;
+		if(pixel >= saturation_level)
+			statistics.saturated_count++;
+	}
+	statistics.pixel_count = n;
+	statistics.min = pixels[0];
+	statistics.max = pixels[n-1];
+	statistics.mean = sum/n;
+	statistics.median = (pixels[(n-1)/2]+pixels[n/2])/2.0;
+	sum_squares = 0.0;
+	for(uint16_t pixel : pixels)
+		sum_squares += (pixel-statistics.mean)*(pixel-statistics.mean);
+	statistics.stddev = std::sqrt(sum_squares/n);
+}
+
+/**
+ * Check computed region statistics against the expected statistics. The mean and standard deviation are allowed
+ * a small relative error, as they are summed in a different order.
+ * @param statistics The computed statistics.
+ * @param expected The expected statistics.
+ * @param name The name of the region, for the failure messages.
+ * @see #Check
+ */
+static void Check_Statistics(const RegionStatistics &statistics,const RegionStatistics &expected,
+			     const std::string &name)
+{
+	Check(statistics.pixel_count == expected.pixel_count,name+" pixel count "+
+	      std::to_string(statistics.pixel_count)+" is not "+std::to_string(expected.pixel_count)+".");
+	Check(statistics.min == expected.min,name+" minimum "+std::to_string(statistics.min)+" is not "+
+	      std::to_string(expected.min)+".");
+	Check(statistics.max == expected.max,name+" maximum "+std::to_string(statistics.max)+" is not "+
+	      std::to_string(expected.max)+".");
+	Check(std::fabs(statistics.mean-expected.mean) < 1.0e-9*expected.mean,name+" mean "+
+	      std::to_string(statistics.mean)+" is not "+std::to_string(expected.mean)+".");
+	Check(statistics.median == expected.median,name+" median "+std::to_string(statistics.median)+" is not "+
+	      std::to_string(expected.median)+".");
+	Check(std::fabs(statistics.stddev-expected.stddev) < 1.0e-6*expected.stddev,name+" standard deviation "+
+	      std::to_string(statistics.stddev)+" is not "+std::to_string(expected.stddev)+".");
+	Check(statistics.saturated_count == expected.saturated_count,name+" saturated count "+
+	      std::to_string(statistics.saturated_count)+" is not "+std::to_string(expected.saturated_count)+".");
+}
+
+/**
+ * Benchmark computing the statistics of an image, and print the latency. The statistics are computed
+ * BENCHMARK_REPEAT_COUNT times, and the fastest time used. The latency depends on the machine the test is run on,
+ * so it does not fail the test.
+ * @param image The image.
+ * @param ncols The number of columns in the image.
+ * @param nrows The number of rows in the image.
+ * @param thread_count The number of threads to use.
+ * @param name The name of the frame, to print.
+ */
+static void Benchmark(const std::vector<uint16_t> &image,int ncols,int nrows,int thread_count,
+		      const std::string &name)
+{
+	std::chrono::steady_clock::time_point start_time;
+	FrameStatisticsConfig config;
+	ImageStatistics statistics;
+	std::string error_message;
+	double best_time;
+
+	config.mThreadCount = thread_count;
+	best_time = 1.0e9;
+	for(int i = 0; i < BENCHMARK_REPEAT_COUNT; i++)
+	{
+		start_time = std::chrono::steady_clock::now();
+		if(!frame_statistics_compute(image.data(),ncols,nrows,config,statistics,error_message))
+		{
+			Check(false,"Benchmark statistics failed:"+error_message);
+			return;
+		}
+		best_time = std::min(best_time,
+				     std::chrono::duration<double>(std::chrono::steady_clock::now()-start_time).count());
+	}
+	cout << std::left << std::setw(10) << (std::to_string(ncols)+"x"+std::to_string(nrows)) << std::setw(6) << name <<
+		std::right << std::setw(7) << thread_count << std::fixed <<
+		std::setprecision(1) << std::setw(12) << best_time*1000.0 << endl;
+}
+
+/**
+ * Check a test condition. If it is false, print the message and set Test_Failed.
+ * @param condition The condition.
+ * @param message The message to print if the condition is false.
+ * @see #Test_Failed
+ */
+static void Check(bool condition,const std::string &message)
+{
+	if(!condition)
+	{
+		cerr << "FAILED:" << message << endl;
+		Test_Failed = true;
+	}
+}
@@ -0,0 +1,316 @@
+/**
+ * @file
+ * @brief test_image_codec.cpp tests the routines get_image_data_compressed uses to compress an image, and the C++
+ *        decoder. It checks every codec round trips emulated bias, dark and sky frames exactly (including an image
+ *        whose last tile is short, and the full range of pixel values), and that unsupported codecs and malformed
+ *        compressed data are rejected. It then benchmarks the compression ratio, compression / decompression
+ *        throughput and latency of each codec on each kind of frame.
+ * @author Chris Mottram
+ * @version $Id$
+ */
+#include "ImageCodec.h"
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using std::cout, std::cerr, std::endl;
+
+/**
+ * The number of columns in the test image. Not a multiple of the Rice block size.
+ */
+#define TEST_NCOLS              (300)
+/**
+ * The number of rows in the test image. Not a multiple of the tile size, so the last tile is short.
+ */
+#define TEST_NROWS              (203)
+/**
+ * The number of rows in each tile of the test image.
+ */
+#define TEST_TILE_ROWS          (16)
+/**
+ * The number of columns / rows in each benchmark frame: a full frame of the 1024 x 1024 detector, the same frame
+ * binned 2x2, and a 2048 x 2048 frame.
+ */
+static const int Benchmark_Size_List[] = {1024,512,2048};
+/**
+ * The number of times each benchmark frame is compressed / decompressed.
+ */
+#define BENCHMARK_REPEAT_COUNT  (5)
+/**
+ * The bias level of the emulated frames, in ADU.
+ */
+#define FRAME_BIAS_LEVEL        (1000.0)
+/**
+ * The read noise of the emulated frames, in ADU.
+ */
+#define FRAME_READ_NOISE        (5.0)
+
+/**
+ * The kinds of emulated frame.
+ */
+enum FRAME_TYPE
+{
+	FRAME_TYPE_BIAS = 0,
+	FRAME_TYPE_DARK = 1,
+	FRAME_TYPE_SKY = 2
+};
+
+/**
+ * The names of the kinds of emulated frame, indexed by FRAME_TYPE.
+ */
+static const char *Frame_Type_Names[] = {"bias","dark","sky"};
+static bool Test_Failed = false;
+
+static void Emulate_Frame(enum FRAME_TYPE frame_type,int ncols,int nrows,std::vector<uint16_t> &image);
+static void Test_Round_Trip(const std::vector<uint16_t> &image,int ncols,int nrows,ImageCodec::type codec,
+			    const ImageCodecConfig &config,const std::string &description);
+static void Benchmark(const std::vector<uint16_t> &image,int ncols,int nrows,ImageCodec::type codec,
+		      const ImageCodecConfig &config,const char *frame_type_name);
+static void Check(bool condition,const std::string &message);
+
+/**
+ * Main program.
+ * <ul>
+ * <li>We check image_codec_list returns every codec, and an out of range codec is not supported.
+ * <li>For each codec, we round trip (Test_Round_Trip) TEST_NCOLS x TEST_NROWS emulated bias, dark and sky frames
+ *     (Emulate_Frame) compressed in tiles of TEST_TILE_ROWS rows, and an image containing every pixel value.
+ * <li>We check compressing with an unsupported codec fails, and that decompressing compressed data with the wrong
+ *     number of tiles, tile sizes that do not match the data, or a corrupt tile fails.
+ * <li>We benchmark (Benchmark) every codec on emulated bias, dark and sky frames of each size in
+ *     Benchmark_Size_List.
+ * </ul>
+ * @return The program returns 0 if the test passed, and 1 if it failed.
+ */
+int main(int argc, char *argv[])
+{
+	std::vector<ImageCodec::type> codecs;
+	std::vector<uint16_t> image,decompressed_image;
+	ImageCodecConfig config;
+	CompressedImageData compressed,malformed;
+	std::string error_message;
+	int frame_type,i;
+
+	image_codec_list(codecs);
+	Check(codecs.size() == 4,"image_codec_list returned "+std::to_string(codecs.size())+" codecs.");
+	Check(!image_codec_is_supported((ImageCodec::type)99),"Codec 99 is supported.");
+	/* round trips */
+	config.mTileRows = TEST_TILE_ROWS;
+	config.mThreadCount = 3;
+	for(ImageCodec::type codec : codecs)
+	{
+		for(frame_type = FRAME_TYPE_BIAS; frame_type <= FRAME_TYPE_SKY; frame_type++)
+		{
+			Emulate_Frame((enum FRAME_TYPE)frame_type,TEST_NCOLS,TEST_NROWS,image);
+			Test_Round_Trip(image,TEST_NCOLS,TEST_NROWS,codec,config,Frame_Type_Names[frame_type]);
+		}
+		image.resize(256*256);
+		for(i = 0; i < 256*256; i++)
+			image[i] = (uint16_t)((i*40503)&0xffff);
+		Test_Round_Trip(image,256,256,codec,config,"every pixel value");
+	}
+	/* rejected */
+	Emulate_Frame(FRAME_TYPE_SKY,TEST_NCOLS,TEST_NROWS,image);
+	Check(!image_codec_compress(image.data(),TEST_NCOLS,TEST_NROWS,(ImageCodec::type)99,config,compressed,
+				    error_message),"Compressing with codec 99 succeeded.");
+	Check(image_codec_compress(image.data(),TEST_NCOLS,TEST_NROWS,ImageCodec::SHUFFLE_LZ4,config,compressed,
+				   error_message),"Compressing failed:"+error_message);
+	malformed = compressed;
+	malformed.tile_sizes.pop_back();
+	Check(!image_codec_decompress(malformed,1,decompressed_image,error_message),
+	      "Decompressing with a missing tile size succeeded.");
+	malformed = compressed;
+	malformed.data.pop_back();
+	Check(!image_codec_decompress(malformed,1,decompressed_image,error_message),
+	      "Decompressing truncated data succeeded.");
+	malformed = compressed;
+	malformed.data[malformed.tile_sizes[0]/2] ^= 0x5a;
+	malformed.data[malformed.tile_sizes[0]/2+1] ^= 0xa5;
+	Check(!image_codec_decompress(malformed,1,decompressed_image,error_message)||
+	      (decompressed_image != image),"Decompressing a corrupt tile returned the original image.");
+	/* benchmark */
+	config = ImageCodecConfig();
+	cout << "Size      Frame Codec        Ratio Compress(MB/s) Decompress(MB/s) Latency(ms)" << endl;
+	for(int size : Benchmark_Size_List)
+	{
+		for(frame_type = FRAME_TYPE_BIAS; frame_type <= FRAME_TYPE_SKY; frame_type++)
+		{
+			Emulate_Frame((enum FRAME_TYPE)frame_type,size,size,image);
+			for(ImageCodec::type codec : codecs)
+				Benchmark(image,size,size,codec,config,Frame_Type_Names[frame_type]);
+		}
+	}
+	if(Test_Failed)
+	{
+		cout << "test_image_codec FAILED." << endl;
+		return 1;
+	}
+	cout << "test_image_codec PASSED." << endl;
+	return 0;
+}
+
+/**
+ * Emulate a frame. Every frame has a bias level of FRAME_BIAS_LEVEL with a slight column pattern, and gaussian read
+ * noise of FRAME_READ_NOISE. A dark frame adds Poisson distributed dark current and a sprinkling of hot pixels.
+ * A sky frame adds a Poisson distributed sky background and a few hundred stars, some of them saturated.
+ * The random number generator is seeded with the frame type, so each kind of frame is the same every time.
+ * @param frame_type The kind of frame to emulate.
+ * @param ncols The number of columns in the frame.
+ * @param nrows The number of rows in the frame.
+ * @param image On return, the emulated frame.
+ */
+static void Emulate_Frame(enum FRAME_TYPE frame_type,int ncols,int nrows,std::vector<uint16_t> &image)
+{
+	std::mt19937 generator(frame_type);
+	std::normal_distribution<double> read_noise(0.0,FRAME_READ_NOISE);
+	std::poisson_distribution<int> dark_current(3.0);
+	std::poisson_distribution<int> sky(2000.0);
+	std::uniform_real_distribution<double> uniform(0.0,1.0);
+	std::vector<double> pixels((size_t)ncols*nrows);
+	double x0,y0,peak,r2;
+	int x,y,star;
+
+	for(y = 0; y < nrows; y++)
+	{
+		for(x = 0; x < ncols; x++)
+		{
+			pixels[(size_t)y*ncols+x] = FRAME_BIAS_LEVEL+(2.0*sin(x*0.05))+read_noise(generator);
+			if(frame_type == FRAME_TYPE_DARK)
+			{
+				pixels[(size_t)y*ncols+x] += dark_current(generator);
+				if(uniform(generator) < 0.0001)
+					pixels[(size_t)y*ncols+x] += 20000.0+(uniform(generator)*50000.0);
+			}
+			else if(frame_type == FRAME_TYPE_SKY)
+				pixels[(size_t)y*ncols+x] += sky(generator);
+		}
+	}
+	if(frame_type == FRAME_TYPE_SKY)
+	{
+		for(star = 0; star < (ncols*nrows)/10000; star++)
+		{
+			x0 = uniform(generator)*ncols;
+			y0 = uniform(generator)*nrows;
+			peak = pow(10.0,2.0+(uniform(generator)*3.0));
+			for(y = std::max((int)y0-10,0); y < std::min((int)y0+10,nrows); y++)
+			{
+				for(x = std::max((int)x0-10,0); x < std::min((int)x0+10,ncols); x++)
+				{
+					r2 = ((x-x0)*(x-x0))+((y-y0)*(y-y0));
+					pixels[(size_t)y*ncols+x] += peak*exp(-r2/(2.0*1.5*1.5));
+				}
+			}
+		}
+	}
+	image.resize(pixels.size());
+	for(size_t i = 0; i < pixels.size(); i++)
+		image[i] = (uint16_t)std::min(std::max(pixels[i],0.0),65535.0);
+}
+
+/**
+ * Compress an image with a codec, check the compressed data's metadata, decompress it, and check the decompressed
+ * image is the same as the original.
+ * @param image The image.
+ * @param ncols The number of columns in the image.
+ * @param nrows The number of rows in the image.
+ * @param codec The ImageCodec to compress the image with.
+ * @param config How to compress the image.
+ * @param description A description of the image, used in failure messages.
+ */
+static void Test_Round_Trip(const std::vector<uint16_t> &image,int ncols,int nrows,ImageCodec::type codec,
+			    const ImageCodecConfig &config,const std::string &description)
+{
+	CompressedImageData compressed;
+	std::vector<uint16_t> decompressed_image;
+	std::string message,error_message;
+
+	message = "Codec "+to_string(codec)+" "+description+":";
+	if(!image_codec_compress(image.data(),ncols,nrows,codec,config,compressed,error_message))
+	{
+		Check(false,message+"Compressing failed:"+error_message);
+		return;
+	}
+	Check((compressed.codec == codec)&&(compressed.x_size == ncols)&&(compressed.y_size == nrows)&&
+	      (compressed.tile_rows == config.mTileRows)&&
+	      ((int)compressed.tile_sizes.size() == (nrows+config.mTileRows-1)/config.mTileRows),
+	      message+"Compressed data has the wrong metadata.");
+	if(!image_codec_decompress(compressed,2,decompressed_image,error_message))
+	{
+		Check(false,message+"Decompressing failed:"+error_message);
+		return;
+	}
+	Check(decompressed_image == image,message+"Decompressed image is different.");
+}
+
+/**
+ * Benchmark compressing and decompressing an image with a codec, and print the compression ratio, the compression
+ * and decompression throughput (in megabytes of uncompressed image per second), and the latency (the time taken to
+ * compress and then decompress the image). The image is compressed and decompressed BENCHMARK_REPEAT_COUNT times,
+ * and the fastest times used.
+ * @param image The image.
+ * @param ncols The number of columns in the image.
+ * @param nrows The number of rows in the image.
+ * @param codec The ImageCodec to compress the image with.
+ * @param config How to compress the image.
+ * @param frame_type_name The kind of frame, printed with the results.
+ */
+static void Benchmark(const std::vector<uint16_t> &image,int ncols,int nrows,ImageCodec::type codec,
+		      const ImageCodecConfig &config,const char *frame_type_name)
+{
+	std::chrono::steady_clock::time_point start_time,compressed_time,decompressed_time;
+	CompressedImageData compressed;
+	std::vector<uint16_t> decompressed_image;
+	std::string error_message;
+	double image_mb,compress_time,decompress_time,best_compress_time,best_decompress_time;
+	int i;
+
+	best_compress_time = 1.0e9;
+	best_decompress_time = 1.0e9;
+	for(i = 0; i < BENCHMARK_REPEAT_COUNT; i++)
+	{
+		start_time = std::chrono::steady_clock::now();
+		if(!image_codec_compress(image.data(),ncols,nrows,codec,config,compressed,error_message))
+		{
+			Check(false,"Benchmark compressing failed:"+error_message);
+			return;
+		}
+		compressed_time = std::chrono::steady_clock::now();
+		if(!image_codec_decompress(compressed,config.mThreadCount,decompressed_image,error_message))
+		{
+			Check(false,"Benchmark decompressing failed:"+error_message);
+			return;
+		}
+		decompressed_time = std::chrono::steady_clock::now();
+		compress_time = std::chrono::duration<double>(compressed_time-start_time).count();
+		decompress_time = std::chrono::duration<double>(decompressed_time-compressed_time).count();
+		best_compress_time = std::min(best_compress_time,compress_time);
+		best_decompress_time = std::min(best_decompress_time,decompress_time);
+	}
+	Check(decompressed_image == image,"Benchmark codec "+to_string(codec)+" "+frame_type_name+
+	      ":Decompressed image is different.");
+	image_mb = (image.size()*sizeof(uint16_t))/(1024.0*1024.0);
+	cout << std::left << std::setw(10) << (std::to_string(ncols)+"x"+std::to_string(nrows)) << std::setw(6) <<
+		frame_type_name << std::setw(13) << to_string(codec) << std::right <<
+		std::fixed << std::setprecision(2) << std::setw(5) <<
+		((double)(image.size()*sizeof(uint16_t)))/compressed.data.size() << std::setw(15) <<
+		std::setprecision(0) << image_mb/best_compress_time << std::setw(17) << image_mb/best_decompress_time <<
+		std::setw(12) << std::setprecision(1) << (best_compress_time+best_decompress_time)*1000.0 << endl;
+}
+
+/**
+ * Check a test condition. If it is false, print the message and set Test_Failed.
+ * @param condition The condition.
+ * @param message The message to print if the condition is false.
+ * @see #Test_Failed
+ */
+static void Check(bool condition,const std::string &message)
+{
+	if(!condition)
+	{
+		cerr << "FAILED:" << message << endl;
+		Test_Failed = true;
+	}
+}
@@ -0,0 +1,375 @@
+/**
+ * @file
+ * @brief test_image_preview.cpp tests the routines get_preview uses to render an 8-bit preview of an image.
+ *        It checks the downsampling factor, average and maximum downsampling (including partial edge blocks),
+ *        the zscale, percentile and asinh stretch limits, that the PNG encoding decodes back to the raw preview,
+ *        and that illegal parameters are rejected. It then benchmarks the latency of rendering previews of
+ *        full, binned and large frames.
+ * @author Chris Mottram
+ * @version $Id$
+ */
+#include "ImagePreview.h"
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+using std::cout, std::cerr, std::endl;
+
+/**
+ * The number of columns / rows in each benchmark frame: a full frame of the 1024 x 1024 detector, the same frame
+ * binned 2x2, and a 2048 x 2048 frame.
+ */
+static const int Benchmark_Size_List[] = {1024,512,2048};
+/**
+ * The number of times each benchmark preview is rendered.
+ */
+#define BENCHMARK_REPEAT_COUNT  (5)
+/**
+ * The target latency of rendering a preview of the benchmark frame, in milliseconds.
+ */
+#define BENCHMARK_TARGET_MS     (20.0)
+/**
+ * The number of threads used to render the previews.
+ */
+#define TEST_THREAD_COUNT       (4)
+
+static bool Test_Failed = false;
+
+static void Emulate_Sky_Frame(int ncols,int nrows,std::vector<uint16_t> &image);
+static void Test_Png(const std::vector<uint16_t> &image,int ncols,int nrows);
+static bool Png_Decode(const std::string &png,int &width,int &height,std::string &pixels);
+static uint32_t Png_Read_Uint32(const unsigned char *data);
+static void Benchmark(const std::vector<uint16_t> &image,int ncols,int nrows,int max_size,
+		      PreviewStretch::type stretch,PreviewDownsample::type downsample,PreviewFormat::type format);
+static void Check(bool condition,const std::string &message);
+
+/**
+ * Main program.
+ * <ul>
+ * <li>We check image_preview_factor.
+ * <li>We check average and maximum downsampling of a small image by a factor that leaves partial edge blocks,
+ *     using several threads.
+ * <li>We check the percentile and asinh stretch limits of a ramp, the zscale limits of a sky frame with stars,
+ *     and that a flat image gets a non-zero range.
+ * <li>We check a raw preview of a ramp, that a PNG preview decodes to the raw preview (Test_Png), and that
+ *     a PNG with fewer rows than threads decodes.
+ * <li>We check illegal maximum sizes, stretches, downsamples and formats are rejected.
+ * <li>We benchmark (Benchmark) rendering previews of a sky frame of each size in Benchmark_Size_List.
+ * </ul>
+ * @return The program returns 0 if the test passed, and 1 if it failed.
+ */
+int main(int argc, char *argv[])
+{
+	std::vector<uint16_t> image,downsampled;
+	Preview preview;
+	std::string png,pixels,error_message;
+	double black_level,white_level;
+	int width,height,i;
+
+	/* downsampling factor */
+	Check(image_preview_factor(2048,2048,512,512) == 4,"2048x2048 into 512x512 is not factor 4.");
+	Check(image_preview_factor(2049,1000,512,512) == 5,"2049x1000 into 512x512 is not factor 5.");
+	Check(image_preview_factor(1000,2049,512,512) == 5,"1000x2049 into 512x512 is not factor 5.");
+	Check(image_preview_factor(100,50,512,512) == 1,"100x50 into 512x512 is not factor 1.");
+	/* downsampling: a 5x3 image, by a factor of 2, has partial blocks on the right and bottom */
+	image = {1,2,3,4,5,
+		 6,7,8,9,10,
+		 11,12,13,14,65535};
+	Check(image_preview_downsample(image.data(),5,3,2,PreviewDownsample::AVERAGE,3,downsampled,error_message),
+	      "Average downsampling failed:"+error_message);
+	Check(downsampled == std::vector<uint16_t>({4,6,8,12,14,65535}),"Average downsampling is wrong.");
+	Check(image_preview_downsample(image.data(),5,3,2,PreviewDownsample::MAX,3,downsampled,error_message),
+	      "Maximum downsampling failed:"+error_message);
+	Check(downsampled == std::vector<uint16_t>({7,9,10,12,14,65535}),"Maximum downsampling is wrong.");
+	Check(image_preview_downsample(image.data(),5,3,1,PreviewDownsample::AVERAGE,3,downsampled,error_message)&&
+	      (downsampled == image),"Downsampling by a factor of 1 changed the image.");
+	/* stretch limits */
+	image.resize(10000);
+	for(i = 0; i < 10000; i++)
+		image[i] = (uint16_t)i;
+	Check(image_preview_stretch_limits(image,PreviewStretch::PERCENTILE,black_level,white_level,error_message)&&
+	      (black_level == 49.0)&&(white_level == 9949.0),"Percentile limits of a ramp are "+
+	      std::to_string(black_level)+" to "+std::to_string(white_level)+".");
+	Check(image_preview_stretch_limits(image,PreviewStretch::ASINH,black_level,white_level,error_message)&&
+	      (black_level == 49.0)&&(white_level == 9999.0),"Asinh limits of a ramp are "+
+	      std::to_string(black_level)+" to "+std::to_string(white_level)+".");
+	Emulate_Sky_Frame(256,256,image);
+	Check(image_preview_stretch_limits(image,PreviewStretch::ZSCALE,black_level,white_level,error_message)&&
+	      (black_level > 1900.0)&&(black_level < 3000.0)&&(white_level > 3000.0)&&(white_level < 4100.0),
+	      "Zscale limits of a sky frame are "+std::to_string(black_level)+" to "+std::to_string(white_level)+".");
+	image.assign(1000,1234);
+	for(PreviewStretch::type stretch : {PreviewStretch::ZSCALE,PreviewStretch::PERCENTILE,PreviewStretch::ASINH})
+	{
+		Check(image_preview_stretch_limits(image,stretch,black_level,white_level,error_message)&&
+		      (black_level == 1234.0)&&(white_level == 1235.0),"Stretch "+to_string(stretch)+
+		      " limits of a flat image are "+std::to_string(black_level)+" to "+std::to_string(white_level)+".");
+	}
+	/* a raw preview of a 1000x10 ramp, by a factor of 4 */
+	image.resize(1000*10);
+	for(i = 0; i < 1000*10; i++)
+		image[i] = (uint16_t)((i%1000)*10);
+	Check(image_preview_create(image.data(),1000,10,250,250,PreviewStretch::PERCENTILE,PreviewDownsample::AVERAGE,
+				   PreviewFormat::RAW,TEST_THREAD_COUNT,preview,error_message),
+	      "Creating a raw preview failed:"+error_message);
+	Check((preview.width == 250)&&(preview.height == 3)&&(preview.factor == 4)&&
+	      (preview.format == PreviewFormat::RAW)&&(preview.data.size() == 250*3),"Raw preview has size "+
+	      std::to_string(preview.width)+"x"+std::to_string(preview.height)+" factor "+
+	      std::to_string(preview.factor)+" and "+std::to_string(preview.data.size())+" bytes.");
+	if(preview.data.size() == 250*3)
+	{
+		Check(((uint8_t)preview.data[0] == 0)&&((uint8_t)preview.data[249] == 255),
+		      "Raw preview of a ramp does not run from 0 to 255.");
+		for(i = 1; i < 250; i++)
+			Check((uint8_t)preview.data[i] >= (uint8_t)preview.data[i-1],"Raw preview of a ramp decreases.");
+	}
+	/* PNG, including an image with fewer rows than threads */
+	Emulate_Sky_Frame(333,211,image);
+	Test_Png(image,333,211);
+	Check(image_preview_png_encode((const uint8_t*)"\x00\x80\xff\x01\x02\x03",3,2,8,png,error_message)&&
+	      Png_Decode(png,width,height,pixels)&&(width == 3)&&(height == 2)&&
+	      (pixels == std::string("\x00\x80\xff\x01\x02\x03",6)),"A 3x2 PNG encoded with 8 threads is wrong.");
+	/* rejected */
+	Check(!image_preview_create(image.data(),333,211,0,100,PreviewStretch::ZSCALE,PreviewDownsample::AVERAGE,
+				    PreviewFormat::RAW,1,preview,error_message),"Maximum width 0 succeeded.");
+	Check(!image_preview_create(image.data(),333,211,100,100,(PreviewStretch::type)99,
+				    PreviewDownsample::AVERAGE,PreviewFormat::RAW,1,preview,error_message),
+	      "Stretch 99 succeeded.");
+	Check(!image_preview_create(image.data(),333,211,100,100,PreviewStretch::ZSCALE,
+				    (PreviewDownsample::type)99,PreviewFormat::RAW,1,preview,error_message),
+	      "Downsample 99 succeeded.");
+	Check(!image_preview_create(image.data(),333,211,100,100,PreviewStretch::ZSCALE,PreviewDownsample::AVERAGE,
+				    (PreviewFormat::type)99,1,preview,error_message),"Format 99 succeeded.");
+	/* benchmark */
+	cout << "Frame     Size  Stretch    Downsample Format Bytes   Latency(ms)" << endl;
+	for(int size : Benchmark_Size_List)
+	{
+		Emulate_Sky_Frame(size,size,image);
+		for(int max_size : {512,1024})
+		{
+			for(PreviewStretch::type stretch : {PreviewStretch::ZSCALE,PreviewStretch::PERCENTILE,
+					PreviewStretch::ASINH})
+			{
+				for(PreviewDownsample::type downsample : {PreviewDownsample::AVERAGE,PreviewDownsample::MAX})
+				{
+					Benchmark(image,size,size,max_size,stretch,downsample,PreviewFormat::PNG);
+				}
+			}
+			Benchmark(image,size,size,max_size,PreviewStretch::ZSCALE,PreviewDownsample::AVERAGE,
+				  PreviewFormat::RAW);
+		}
+	}
+	if(Test_Failed)
+	{
+		cout << "test_image_preview FAILED." << endl;
+		return 1;
+	}
+	cout << "test_image_preview PASSED." << endl;
+	return 0;
+}
+
+/**
+ * Emulate a sky frame: a bias level of 1000 ADU plus a Poisson distributed sky background of 2000 ADU, and a few
+ * hundred stars, some of them saturated. The random number generator has a fixed seed, so the frame is the
+ * same every time.
+ * @param ncols The number of columns in the frame.
+ * @param nrows The number of rows in the frame.
+ * @param image On return, the emulated frame.
+ */
+static void Emulate_Sky_Frame(int ncols,int nrows,std::vector<uint16_t> &image)
+{
+	std::mt19937 generator(2);
+	std::poisson_distribution<int> sky(2000.0);
+	std::uniform_real_distribution<double> uniform(0.0,1.0);
+	std::vector<double> pixels((size_t)ncols*nrows);
+	double x0,y0,peak,r2;
+	int x,y,star;
+
+	for(size_t i = 0; i < pixels.size(); i++)
+		pixels[i] = 1000.0+sky(generator);
+	for(star = 0; star < std::max((ncols*nrows)/10000,10); star++)
+	{
+		x0 = uniform(generator)*ncols;
+		y0 = uniform(generator)*nrows;
+		peak = pow(10.0,2.0+(uniform(generator)*3.0));
+		for(y = std::max((int)y0-10,0); y < std::min((int)y0+10,nrows); y++)
+		{
+			for(x = std::max((int)x0-10,0); x < std::min((int)x0+10,ncols); x++)
+			{
+				r2 = ((x-x0)*(x-x0))+((y-y0)*(y-y0));
+				pixels[(size_t)y*ncols+x] += peak*exp(-r2/(2.0*1.5*1.5));
+			}
+		}
+	}
+	image.resize(pixels.size());
+	for(size_t i = 0; i < pixels.size(); i++)
+		image[i] = (uint16_t)std::min(std::max(pixels[i],0.0),65535.0);
+}
+
+/**
+ * Check a PNG preview of an image decodes to the same pixels as the raw preview, for every stretch and downsample.
+ * @param image The image.
+ * @param ncols The number of columns in the image.
+ * @param nrows The number of rows in the image.
+ * @see Png_Decode
+ */
+static void Test_Png(const std::vector<uint16_t> &image,int ncols,int nrows)
+{
+	Preview raw_preview,png_preview;
+	std::string pixels,error_message,message;
+	int width,height;
+
+	for(PreviewStretch::type stretch : {PreviewStretch::ZSCALE,PreviewStretch::PERCENTILE,PreviewStretch::ASINH})
+	{
+		for(PreviewDownsample::type downsample : {PreviewDownsample::AVERAGE,PreviewDownsample::MAX})
+		{
+			message = "Stretch "+to_string(stretch)+" downsample "+to_string(downsample)+":";
+			if(!image_preview_create(image.data(),ncols,nrows,100,100,stretch,downsample,PreviewFormat::RAW,
+						 TEST_THREAD_COUNT,raw_preview,error_message)||
+			   !image_preview_create(image.data(),ncols,nrows,100,100,stretch,downsample,PreviewFormat::PNG,
+						 TEST_THREAD_COUNT,png_preview,error_message))
+			{
+				Check(false,message+"Creating a preview failed:"+error_message);
+				continue;
+			}
+			Check((png_preview.width == 84)&&(png_preview.height == 53)&&(png_preview.factor == 4)&&
+			      (png_preview.format == PreviewFormat::PNG),message+"PNG preview has the wrong metadata.");
+			Check(Png_Decode(png_preview.data,width,height,pixels),message+"PNG preview failed to decode.");
+			Check((width == raw_preview.width)&&(height == raw_preview.height)&&
+			      (pixels == raw_preview.data),message+"PNG preview is different to the raw preview.");
+		}
+	}
+}
+
+/**
+ * Decode a PNG as written by image_preview_png_encode: check the signature and the IHDR chunk (8-bit greyscale,
+ * not interlaced), inflate the IDAT chunk, and undo the "Sub" filter of each row.
+ * @param png The PNG.
+ * @param width On return, the number of columns in the image.
+ * @param height On return, the number of rows in the image.
+ * @param pixels On return, the 8-bit pixels in row-major order.
+ * @return The routine returns true if the PNG decoded, and false if it did not.
+ */
+static bool Png_Decode(const std::string &png,int &width,int &height,std::string &pixels)
+{
+	std::string inflated;
+	const unsigned char *data = (const unsigned char*)png.data();
+	uLongf inflated_size;
+	uint32_t chunk_size;
+	size_t offset = 8;
+
+	if((png.size() < 8)||(png.compare(0,8,"\x89PNG\r\n\x1a\n",8) != 0))
+		return false;
+	width = height = 0;
+	while(offset+12 <= png.size())
+	{
+		chunk_size = Png_Read_Uint32(data+offset);
+		if(offset+12+chunk_size > png.size())
+			return false;
+		if(crc32(crc32(0L,Z_NULL,0),data+offset+4,chunk_size+4) != Png_Read_Uint32(data+offset+8+chunk_size))
+			return false;
+		if(png.compare(offset+4,4,"IHDR") == 0)
+		{
+			width = (int)Png_Read_Uint32(data+offset+8);
+			height = (int)Png_Read_Uint32(data+offset+12);
+			if((data[offset+16] != 8)||(data[offset+17] != 0)||(data[offset+20] != 0))
+				return false;
+		}
+		else if(png.compare(offset+4,4,"IDAT") == 0)
+		{
+			inflated_size = ((uLongf)width+1)*height;
+			inflated.resize(inflated_size);
+			if((uncompress((Bytef*)&(inflated[0]),&inflated_size,data+offset+8,chunk_size) != Z_OK)||
+			   (inflated_size != inflated.size()))
+				return false;
+		}
+		else if(png.compare(offset+4,4,"IEND") == 0)
+			break;
+		offset += 12+chunk_size;
+	}
+	if((width < 1)||(height < 1)||(inflated.size() != ((size_t)width+1)*height))
+		return false;
+	pixels.resize((size_t)width*height);
+	for(int y = 0; y < height; y++)
+	{
+		if(inflated[y*(width+1)] != 1)
+			return false;
+		for(int x = 0; x < width; x++)
+		{
+			pixels[y*width+x] = inflated[y*(width+1)+1+x];
+			if(x > 0)
+				pixels[y*width+x] = (char)(uint8_t)(pixels[y*width+x]+pixels[y*width+x-1]);
+		}
+	}
+	return true;
+}
+
+/**
+ * Read a 32-bit unsigned integer from a PNG, stored in network (big-endian) byte order.
+ * @param data The four bytes of the integer.
+ * @return The integer.
+ */
+static uint32_t Png_Read_Uint32(const unsigned char *data)
+{
+	return (((uint32_t)data[0]) << 24)|(((uint32_t)data[1]) << 16)|(((uint32_t)data[2]) << 8)|((uint32_t)data[3]);
+}
+
+/**
+ * Benchmark rendering a preview of an image, and print the preview size in bytes and the latency. The preview is
+ * rendered BENCHMARK_REPEAT_COUNT times, and the fastest time used. Latencies over BENCHMARK_TARGET_MS are marked,
+ * but do not fail the test, as they depend on the machine the test is run on.
+ * @param image The image.
+ * @param ncols The number of columns in the image.
+ * @param nrows The number of rows in the image.
+ * @param max_size The maximum number of columns and rows in the preview.
+ * @param stretch The PreviewStretch to use.
+ * @param downsample The PreviewDownsample to use.
+ * @param format The PreviewFormat to use.
+ */
+static void Benchmark(const std::vector<uint16_t> &image,int ncols,int nrows,int max_size,
+		      PreviewStretch::type stretch,PreviewDownsample::type downsample,PreviewFormat::type format)
+{
+	std::chrono::steady_clock::time_point start_time;
+	Preview preview;
+	std::string error_message;
+	double best_time;
+	int i;
+
+	best_time = 1.0e9;
+	for(i = 0; i < BENCHMARK_REPEAT_COUNT; i++)
+	{
+		start_time = std::chrono::steady_clock::now();
+		if(!image_preview_create(image.data(),ncols,nrows,max_size,max_size,stretch,downsample,format,
+					 TEST_THREAD_COUNT,preview,error_message))
+		{
+			Check(false,"Benchmark preview failed:"+error_message);
+			return;
+		}
+		best_time = std::min(best_time,
+				     std::chrono::duration<double>(std::chrono::steady_clock::now()-start_time).count());
+	}
+	cout << std::left << std::setw(10) << (std::to_string(ncols)+"x"+std::to_string(nrows)) << std::setw(6) <<
+		max_size << std::setw(11) << to_string(stretch) << std::setw(11) <<
+		to_string(downsample) << std::setw(7) << to_string(format) << std::setw(8) << preview.data.size() <<
+		std::right << std::fixed << std::setprecision(1) << std::setw(11) << best_time*1000.0 <<
+		((best_time*1000.0 > BENCHMARK_TARGET_MS) ? " (over target)" : "") << endl;
+}
+
+/**
+ * Check a test condition. If it is false, print the message and set Test_Failed.
+ * @param condition The condition.
+ * @param message The message to print if the condition is false.
+ * @see #Test_Failed
+ */
+static void Check(bool condition,const std::string &message)
+{
+	if(!condition)
+	{
+		cerr << "FAILED:" << message << endl;
+		Test_Failed = true;
+	}
+}
@@ -0,0 +1,180 @@
+/**
+ * @file
+ * @brief test_image_region.cpp tests the routines get_image_region uses to cut a region out of a read out image.
+ *        It checks the region's pixels (with and without subsampling), that regions are clipped to the image and
+ *        illegal regions rejected, and the detector area of a region of a binned, windowed and re-oriented image.
+ *        It then times cutting a 64x64 region out of full, binned and large images.
+ * @author Chris Mottram
+ * @version $Id$
+ */
+#include "ImageRegion.h"
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using std::cout, std::cerr, std::endl;
+
+/**
+ * The number of columns in the test image.
+ */
+#define TEST_NCOLS              (100)
+/**
+ * The number of rows in the test image.
+ */
+#define TEST_NROWS              (60)
+/**
+ * The number of columns / rows in each benchmark image: a full frame of the 1024 x 1024 detector, the same frame
+ * binned 2x2, and a 2048 x 2048 frame.
+ */
+static const int Benchmark_Size_List[] = {1024,512,2048};
+/**
+ * The number of columns / rows in the benchmark region.
+ */
+#define BENCHMARK_REGION_SIZE   (64)
+/**
+ * The number of regions cut out by the benchmark.
+ */
+#define BENCHMARK_REGION_COUNT  (100000)
+
+static bool Test_Failed = false;
+
+static uint16_t Region_Pixel(const ImageRegion &region,int x,int y);
+static void Check(bool condition,const std::string &message);
+
+/**
+ * Main program.
+ * <ul>
+ * <li>We fill a TEST_NCOLS x TEST_NROWS image, each pixel holding (y*TEST_NCOLS)+x.
+ * <li>We cut out a region, and a region subsampled by 3, and check their geometry and pixels.
+ * <li>We check a region overlapping the image's edge is clipped, and that regions outside the image, with a zero
+ *     size or step, are rejected.
+ * <li>We check the detector area of a region of an image binned 2x2 read out from a window starting at
+ *     (101,201), not re-oriented and rotated by 90 degrees.
+ * <li>We time cutting BENCHMARK_REGION_COUNT BENCHMARK_REGION_SIZE square regions out of the centre of an
+ *     image of each size in Benchmark_Size_List.
+ * </ul>
+ * @return The program returns 0 if the test passed, and 1 if it failed.
+ */
+int main(int argc, char *argv[])
+{
+	std::vector<uint16_t> image(TEST_NCOLS*TEST_NROWS);
+	std::vector<uint16_t> benchmark_image;
+	std::chrono::steady_clock::time_point start_time,end_time;
+	ImageRegion region;
+	std::string error_message;
+	bool pixels_ok;
+	int i,x,y;
+
+	for(i = 0; i < TEST_NCOLS*TEST_NROWS; i++)
+		image[i] = (uint16_t)i;
+	/* region */
+	Check(image_region_clip(TEST_NCOLS,TEST_NROWS,10,20,30,15,1,region,error_message),"Region rejected:"+
+	      error_message);
+	image_region_copy(image.data(),TEST_NCOLS,region);
+	Check((region.x_size == 30)&&(region.y_size == 15)&&(region.data.size() == 30*15*sizeof(uint16_t)),
+	      "Region has size "+std::to_string(region.x_size)+"x"+std::to_string(region.y_size)+".");
+	pixels_ok = true;
+	for(y = 0; y < region.y_size; y++)
+	{
+		for(x = 0; x < region.x_size; x++)
+			pixels_ok &= (Region_Pixel(region,x,y) == ((20+y)*TEST_NCOLS)+10+x);
+	}
+	Check(pixels_ok,"Region pixels are wrong.");
+	/* subsampled region */
+	Check(image_region_clip(TEST_NCOLS,TEST_NROWS,10,20,30,15,3,region,error_message),
+	      "Subsampled region rejected:"+error_message);
+	image_region_copy(image.data(),TEST_NCOLS,region);
+	Check((region.x_size == 10)&&(region.y_size == 5)&&(region.width == 30)&&(region.height == 15),
+	      "Subsampled region has size "+std::to_string(region.x_size)+"x"+std::to_string(region.y_size)+".");
+	pixels_ok = true;
+	for(y = 0; y < region.y_size; y++)
+	{
+		for(x = 0; x < region.x_size; x++)
+			pixels_ok &= (Region_Pixel(region,x,y) == ((20+(y*3))*TEST_NCOLS)+10+(x*3));
+	}
+	Check(pixels_ok,"Subsampled region pixels are wrong.");
+	/* clipping */
+	Check(image_region_clip(TEST_NCOLS,TEST_NROWS,-5,50,20,20,2,region,error_message),
+	      "Edge region rejected:"+error_message);
+	Check((region.x0 == 0)&&(region.y0 == 50)&&(region.width == 15)&&(region.height == 10)&&
+	      (region.x_size == 8)&&(region.y_size == 5),"Edge region was not clipped to the image.");
+	image_region_copy(image.data(),TEST_NCOLS,region);
+	Check(Region_Pixel(region,7,4) == ((50+8)*TEST_NCOLS)+14,"Edge region pixels are wrong.");
+	Check(!image_region_clip(TEST_NCOLS,TEST_NROWS,TEST_NCOLS,0,10,10,1,region,error_message),
+	      "Region outside the image was accepted.");
+	Check(!image_region_clip(TEST_NCOLS,TEST_NROWS,0,0,0,10,1,region,error_message),
+	      "Zero width region was accepted.");
+	Check(!image_region_clip(TEST_NCOLS,TEST_NROWS,0,0,10,10,0,region,error_message),
+	      "Zero step region was accepted.");
+	Check(!image_region_clip(TEST_NCOLS,TEST_NROWS,0x7fffff00,0,0x7fffffff,10,1,region,error_message),
+	      "Overflowing region was accepted.");
+	/* detector area */
+	image_region_clip(TEST_NCOLS,TEST_NROWS,10,20,30,15,1,region,error_message);
+	image_region_set_detector_area(region,CCD_ORIENTATION_NONE,TEST_NCOLS,TEST_NROWS,2,2,101,201);
+	Check((region.xbin == 2)&&(region.ybin == 2)&&(region.detector_x_start == 121)&&
+	      (region.detector_y_start == 241)&&(region.detector_x_end == 180)&&(region.detector_y_end == 270),
+	      "Detector area is "+std::to_string(region.detector_x_start)+","+std::to_string(region.detector_y_start)+
+	      " to "+std::to_string(region.detector_x_end)+","+std::to_string(region.detector_y_end)+".");
+	/* rotated by 90 degrees: the image's columns are read out rows, bottom to top */
+	image_region_set_detector_area(region,CCD_ORIENTATION_ROTATE_90,TEST_NCOLS,TEST_NROWS,2,2,101,201);
+	Check((region.detector_x_start == 141)&&(region.detector_x_end == 170)&&
+	      (region.detector_y_start == 321)&&(region.detector_y_end == 380),
+	      "Rotated detector area is "+std::to_string(region.detector_x_start)+","+
+	      std::to_string(region.detector_y_start)+" to "+std::to_string(region.detector_x_end)+","+
+	      std::to_string(region.detector_y_end)+".");
+	/* benchmark */
+	for(int size : Benchmark_Size_List)
+	{
+		benchmark_image.assign(((size_t)size)*size,0);
+		Check(image_region_clip(size,size,(size-BENCHMARK_REGION_SIZE)/2,(size-BENCHMARK_REGION_SIZE)/2,
+					BENCHMARK_REGION_SIZE,BENCHMARK_REGION_SIZE,1,region,error_message),
+		      "Benchmark region clip failed:"+error_message);
+		start_time = std::chrono::steady_clock::now();
+		for(i = 0; i < BENCHMARK_REGION_COUNT; i++)
+			image_region_copy(benchmark_image.data(),size,region);
+		end_time = std::chrono::steady_clock::now();
+		cout << "Cut a " << BENCHMARK_REGION_SIZE << "x" << BENCHMARK_REGION_SIZE << " region (" <<
+			region.data.size() << " bytes) out of a " << size << "x" << size << " image in " <<
+			std::chrono::duration<double,std::micro>(end_time-start_time).count()/BENCHMARK_REGION_COUNT <<
+			" us." << endl;
+	}
+	if(Test_Failed)
+	{
+		cout << "test_image_region FAILED." << endl;
+		return 1;
+	}
+	cout << "test_image_region PASSED." << endl;
+	return 0;
+}
+
+/**
+ * Return a pixel of a region's packed little-endian data.
+ * @param region The region.
+ * @param x The column of the pixel in the region's data.
+ * @param y The row of the pixel in the region's data.
+ * @return The pixel value.
+ */
+static uint16_t Region_Pixel(const ImageRegion &region,int x,int y)
+{
+	const unsigned char *bytes = (const unsigned char *)(region.data.data()+
+							      ((((size_t)y)*region.x_size)+x)*sizeof(uint16_t));
+
+	return (uint16_t)(bytes[0]|(bytes[1] << 8));
+}
+
+/**
+ * Check a test condition. If it is false, print the message and set Test_Failed.
+ * @param condition The condition.
+ * @param message The message to print if the condition is false.
+ * @see #Test_Failed
+ */
+static void Check(bool condition,const std::string &message)
+{
+	if(!condition)
+	{
+		cerr << "FAILED:" << message << endl;
+		Test_Failed = true;
+	}
+}
@@ -0,0 +1,95 @@
+#!/usr/bin/env python
+'''Compare the camera server's in-server frame reduction with the pipelines' ReductionController.
+
+We write master bias, dark and flat frames the way pipelines/testdata/generate_testdata.py does (int16 bias and dark,
+float32 flat, EXPOSURE in the dark's header), run test_emulated_reduction on them, which saves an emulated multrun
+and the frames the server reduced, and then reduce each saved raw frame with ReductionController.reduce_ccd_image.
+The server's float32 reduced frames must match the pipeline's within a float tolerance.
+
+Usage: test_reduction_against_pipeline.py <test_emulated_reduction executable>
+'''
+
+import configparser
+import glob
+import os
+import subprocess
+import sys
+import tempfile
+
+import numpy as np
+from astropy.io import fits
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', '..', '..', 'pipelines'))
+from ReductionController import ReductionController
+
+# The emulated CCD size used by test_emulated_reduction
+NCOLS = 64
+NROWS = 32
+# The relative and absolute tolerance the reduced frames must match within
+RTOL = 1e-5
+ATOL = 1e-3
+
+
+def write_masters(directory):
+    '''Write the master frames test_emulated_reduction reduces with, as generate_testdata.py does.'''
+    rng = np.random.default_rng(1)
+    bias = np.array(rng.normal(0, 3, size=(NROWS, NCOLS)) + 100, dtype=np.int16)
+    fits.PrimaryHDU(bias).writeto(os.path.join(directory, 'bias.fits'), overwrite=True)
+    dark = np.array(rng.uniform(0, 10, size=(NROWS, NCOLS)), dtype=np.int16)
+    hdu = fits.PrimaryHDU(dark)
+    hdu.header['EXPOSURE'] = 1
+    hdu.writeto(os.path.join(directory, 'dark.fits'), overwrite=True)
+    flat = np.array(rng.normal(0, 0.01, size=(NROWS, NCOLS)) + 1, dtype=np.float32)
+    fits.PrimaryHDU(flat).writeto(os.path.join(directory, 'flat.fits'), overwrite=True)
+
+
+def pipeline_controller(directory):
+    '''Create a ReductionController using the test's master frames for both the imaging and spectral modes.'''
+    controller = ReductionController()
+    controller.config = configparser.ConfigParser()
+    controller.config['Reduction'] = {}
+    for mode in ('image', 'spectrum'):
+        for frame in ('bias', 'dark', 'flat'):
+            controller.config['Reduction'][f'reduction.{mode}.{frame}'] = os.path.join(directory, f'{frame}.fits')
+    controller.read_cal_images()
+    return controller
+
+
+def main():
+    if len(sys.argv) != 2:
+        print(__doc__)
+        return 2
+    failed = False
+    with tempfile.TemporaryDirectory() as directory:
+        write_masters(directory)
+        subprocess.run([sys.argv[1], directory], check=True, stdout=subprocess.DEVNULL)
+        controller = pipeline_controller(directory)
+        reduced_filenames = sorted(glob.glob(os.path.join(directory, 'EMU_*_reduced.fits')))
+        if len(reduced_filenames) == 0:
+            print('FAILED:test_emulated_reduction saved no reduced frames.')
+            failed = True
+        for reduced_filename in reduced_filenames:
+            raw_filename = reduced_filename.replace('_reduced.fits', '.fits')
+            pipeline_filename = reduced_filename.replace('_reduced.fits', '_pipeline.fits')
+            controller.reduce_ccd_image(raw_filename, pipeline_filename)
+            server_data = fits.getdata(reduced_filename)
+            pipeline_data = fits.getdata(pipeline_filename)
+            if server_data.shape != pipeline_data.shape:
+                print(f'FAILED:{reduced_filename} is {server_data.shape}, the pipeline made {pipeline_data.shape}.')
+                failed = True
+                continue
+            difference = np.max(np.abs(server_data.astype(np.float64) - pipeline_data))
+            if not np.allclose(server_data, pipeline_data, rtol=RTOL, atol=ATOL):
+                print(f'FAILED:{reduced_filename} differs from the pipeline by up to {difference}.')
+                failed = True
+            else:
+                print(f'OK     :{reduced_filename} matches the pipeline to within {difference}.')
+    if failed:
+        print('test_reduction_against_pipeline:FAILED')
+        return 1
+    print('test_reduction_against_pipeline:PASSED')
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,119 @@
+/**
+ * @file
+ * @brief test_spsc_queue.cpp tests the lock-free single-producer / single-consumer queue used to hand read out
+ *        frames from the acquisition stage to the processing stage. It checks a full / empty queue is reported,
+ *        and that items pushed by one thread are popped by another, in order, with none lost or duplicated.
+ * @author Chris Mottram
+ * @version $Id$
+ */
+#include "SpscQueue.h"
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+using std::cout, std::cerr, std::endl;
+
+/**
+ * The capacity of the queue used by the threaded test. This is small, so the producer often finds it full.
+ */
+#define TEST_QUEUE_CAPACITY     (4)
+/**
+ * The number of items passed between the threads.
+ */
+#define TEST_ITEM_COUNT         (1000000)
+
+static bool Test_Failed = false;
+
+static void Check(bool condition,const std::string &message);
+
+/**
+ * Main program.
+ * <ul>
+ * <li>We push items into an empty queue until it is full, and check try_push then fails and size / capacity are
+ *     right. We pop them and check they come out in order, and that try_pop then fails.
+ * <li>We check a move-only type (a unique_ptr, like the frame's image buffer reference) is moved in and out.
+ * <li>We start a producer thread, that pushes TEST_ITEM_COUNT sequence numbers into a queue of
+ *     TEST_QUEUE_CAPACITY items (yielding whenever it is full), whilst this thread pops them (yielding whenever
+ *     it is empty) and checks each one is the next in the sequence.
+ * </ul>
+ * @return The program returns 0 if the test passed, and 1 if it failed.
+ */
+int main(int argc, char *argv[])
+{
+	SpscQueue<int> queue(TEST_QUEUE_CAPACITY);
+	SpscQueue<std::unique_ptr<int>> pointer_queue(1);
+	std::unique_ptr<int> pointer;
+	int i,item,expected_item;
+
+	/* fill the queue, and check it reports being full */
+	Check(queue.capacity() == TEST_QUEUE_CAPACITY,"Queue capacity is "+std::to_string(queue.capacity())+".");
+	for(i = 0; i < TEST_QUEUE_CAPACITY; i++)
+	{
+		item = i;
+		Check(queue.try_push(item),"try_push failed on a queue with "+std::to_string(queue.size())+" items.");
+	}
+	item = TEST_QUEUE_CAPACITY;
+	Check(!queue.try_push(item),"try_push succeeded on a full queue.");
+	Check(queue.size() == TEST_QUEUE_CAPACITY,"Full queue has size "+std::to_string(queue.size())+".");
+	/* empty the queue, and check it reports being empty */
+	for(i = 0; i < TEST_QUEUE_CAPACITY; i++)
+	{
+		Check(queue.try_pop(item),"try_pop failed on a queue with "+std::to_string(queue.size())+" items.");
+		Check(item == i,"Popped "+std::to_string(item)+" when expecting "+std::to_string(i)+".");
+	}
+	Check(!queue.try_pop(item),"try_pop succeeded on an empty queue.");
+	Check(queue.size() == 0,"Empty queue has size "+std::to_string(queue.size())+".");
+	/* move-only items */
+	pointer.reset(new int(42));
+	Check(pointer_queue.try_push(pointer),"try_push of a unique_ptr failed.");
+	Check(pointer == nullptr,"unique_ptr was not moved into the queue.");
+	Check(pointer_queue.try_pop(pointer),"try_pop of a unique_ptr failed.");
+	Check((pointer != nullptr)&&(*pointer == 42),"unique_ptr was not moved out of the queue.");
+	/* one producer thread, and this thread as the consumer */
+	std::thread producer([&queue]()
+			     {
+				     int producer_item;
+
+				     for(int j = 0; j < TEST_ITEM_COUNT; j++)
+				     {
+					     producer_item = j;
+					     while(!queue.try_push(producer_item))
+						     std::this_thread::yield();
+				     }
+			     });
+	for(expected_item = 0; expected_item < TEST_ITEM_COUNT; expected_item++)
+	{
+		while(!queue.try_pop(item))
+			std::this_thread::yield();
+		if(item != expected_item)
+		{
+			Check(false,"Popped "+std::to_string(item)+" when expecting "+std::to_string(expected_item)+".");
+			break;
+		}
+	}
+	producer.join();
+	Check(queue.size() == 0,"Queue has "+std::to_string(queue.size())+" items left after the threaded test.");
+	if(Test_Failed)
+	{
+		cout << "test_spsc_queue FAILED." << endl;
+		return 1;
+	}
+	cout << "test_spsc_queue PASSED." << endl;
+	return 0;
+}
+
+/**
+ * Check a test condition. If it is false, print the message and set Test_Failed.
+ * @param condition The condition.
+ * @param message The message to print if the condition is false.
+ * @see #Test_Failed
+ */
+static void Check(bool condition,const std::string &message)
+{
+	if(!condition)
+	{
+		cerr << "FAILED:" << message << endl;
+		Test_Failed = true;
+	}
+}
@@ -0,0 +1,216 @@
+/**
+ * @file
+ * @brief test_temperature_history.cpp tests the fixed memory CCD temperature history. It feeds in an emulated
+ *        cooldown curve, and checks the raw samples and the 10 second / 1 minute rollups (mean / minimum / maximum)
+ *        are right, that only samples after the since time are returned, that the oldest samples are overwritten
+ *        once a ring is full, and that the packed TemperatureHistory columns decode to the same samples.
+ * @author Chris Mottram
+ * @version $Id$
+ */
+#include "TemperatureHistoryRing.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using std::cout, std::cerr, std::endl;
+
+/**
+ * The number of raw samples held by the test history. Less than TEST_SAMPLE_COUNT, so the raw ring wraps.
+ */
+#define TEST_RAW_LENGTH         (100)
+/**
+ * The number of 10 second / 1 minute samples held by the test history.
+ */
+#define TEST_ROLLUP_LENGTH      (1000)
+/**
+ * The number of samples fed into the history, one a second.
+ */
+#define TEST_SAMPLE_COUNT       (600)
+/**
+ * The time of the first sample, in milliseconds since the epoch. This is the start of a minute.
+ */
+#define TEST_START_TIME         (1700000040000LL)
+/**
+ * The number of samples added by the benchmark.
+ */
+#define BENCHMARK_SAMPLE_COUNT  (1000000)
+
+static bool Test_Failed = false;
+
+static double Test_Temperature(int index);
+static void Check(bool condition,const std::string &message);
+template <typename T> static T Unpack(const std::string &column,int index);
+
+/**
+ * Main program.
+ * <ul>
+ * <li>We add TEST_SAMPLE_COUNT samples, one a second, of an emulated cooldown curve (Test_Temperature) to a
+ *     history with TEST_RAW_LENGTH raw samples.
+ * <li>We check only the last TEST_RAW_LENGTH raw samples are returned, in order, and that a since time returns
+ *     just the samples after it.
+ * <li>We check the 10 second and 1 minute rollups contain the completed intervals (not the one still open), with
+ *     the right mean / minimum / maximum temperature and target temperature / cooler status.
+ * <li>We check the packed TemperatureHistory columns decode to the same samples, and an empty result returns
+ *     since as it's last_time.
+ * <li>We check a sample whose time is earlier than the last (the clock was stepped back) is kept in time order.
+ * <li>We time adding BENCHMARK_SAMPLE_COUNT samples, and retrieving a full raw ring.
+ * </ul>
+ * @return The program returns 0 if the test passed, and 1 if it failed.
+ */
+int main(int argc, char *argv[])
+{
+	TemperatureHistoryRing history(TEST_RAW_LENGTH,TEST_ROLLUP_LENGTH,TEST_ROLLUP_LENGTH);
+	TemperatureHistoryRing benchmark_history;
+	std::vector<TemperatureHistorySample> samples;
+	TemperatureHistory packed_history;
+	std::chrono::steady_clock::time_point start_time,add_time,get_time;
+	double mean,minimum,maximum;
+	int i,j,index;
+
+	for(i = 0; i < TEST_SAMPLE_COUNT; i++)
+	{
+		history.add_sample(TEST_START_TIME+(i*1000LL),Test_Temperature(i),-60.0,
+				   (i < TEST_SAMPLE_COUNT/2) ? CoolerStatus::RAMPING : CoolerStatus::OK);
+	}
+	/* raw samples */
+	history.get_samples(0,TemperatureResolution::RAW,samples);
+	Check(samples.size() == TEST_RAW_LENGTH,"Raw ring returned "+std::to_string(samples.size())+" samples.");
+	for(i = 0; i < (int)samples.size(); i++)
+	{
+		index = TEST_SAMPLE_COUNT-TEST_RAW_LENGTH+i;
+		Check(samples[i].mTime == TEST_START_TIME+(index*1000LL),"Raw sample "+std::to_string(i)+
+		      " has time "+std::to_string(samples[i].mTime)+".");
+		Check(samples[i].mTemperature == (float)Test_Temperature(index),"Raw sample "+std::to_string(i)+
+		      " has temperature "+std::to_string(samples[i].mTemperature)+".");
+	}
+	history.get_samples(TEST_START_TIME+((TEST_SAMPLE_COUNT-10)*1000LL),TemperatureResolution::RAW,samples);
+	Check(samples.size() == 9,"Raw samples since the 10th last returned "+std::to_string(samples.size())+
+	      " samples.");
+	/* rollups: the last interval is still open, so is not returned */
+	history.get_samples(0,TemperatureResolution::TEN_SECONDS,samples);
+	Check(samples.size() == (TEST_SAMPLE_COUNT/10)-1,"10 second ring returned "+std::to_string(samples.size())+
+	      " samples.");
+	for(i = 0; i < (int)samples.size(); i++)
+	{
+		mean = 0.0;
+		minimum = 1000.0;
+		maximum = -1000.0;
+		for(j = 0; j < 10; j++)
+		{
+			mean += (float)Test_Temperature((i*10)+j);
+			minimum = std::min(minimum,(double)(float)Test_Temperature((i*10)+j));
+			maximum = std::max(maximum,(double)(float)Test_Temperature((i*10)+j));
+		}
+		mean /= 10.0;
+		Check(samples[i].mTime == TEST_START_TIME+(i*10000LL),"10 second sample "+std::to_string(i)+
+		      " has time "+std::to_string(samples[i].mTime)+".");
+		Check(fabs(samples[i].mTemperature-mean) < 0.001,"10 second sample "+std::to_string(i)+
+		      " has mean "+std::to_string(samples[i].mTemperature)+" not "+std::to_string(mean)+".");
+		Check((samples[i].mMinTemperature == (float)minimum)&&(samples[i].mMaxTemperature == (float)maximum),
+		      "10 second sample "+std::to_string(i)+" has the wrong minimum / maximum.");
+		Check(samples[i].mTargetTemperature == -60.0f,"10 second sample "+std::to_string(i)+
+		      " has the wrong target temperature.");
+	}
+	Check(samples.back().mCoolerStatus == CoolerStatus::OK,"Last 10 second sample has the wrong cooler status.");
+	history.get_samples(0,TemperatureResolution::ONE_MINUTE,samples);
+	Check(samples.size() == (TEST_SAMPLE_COUNT/60)-1,"1 minute ring returned "+std::to_string(samples.size())+
+	      " samples.");
+	Check((samples.size() > 0)&&(samples[0].mMinTemperature == (float)Test_Temperature(59))&&
+	      (samples[0].mMaxTemperature == (float)Test_Temperature(0)),"First 1 minute sample has the wrong range.");
+	/* packed history */
+	history.get_history(0,TemperatureResolution::TEN_SECONDS,packed_history);
+	history.get_samples(0,TemperatureResolution::TEN_SECONDS,samples);
+	Check(packed_history.sample_count == (int)samples.size(),"Packed history has "+
+	      std::to_string(packed_history.sample_count)+" samples.");
+	Check((packed_history.time_offsets.size() == samples.size()*sizeof(uint32_t))&&
+	      (packed_history.temperatures.size() == samples.size()*sizeof(float))&&
+	      (packed_history.cooler_status.size() == samples.size()),"Packed history columns are the wrong length.");
+	Check(packed_history.start_time == samples.front().mTime,"Packed history has the wrong start time.");
+	Check(packed_history.last_time == samples.back().mTime,"Packed history has the wrong last time.");
+	for(i = 0; i < packed_history.sample_count; i++)
+	{
+		Check(packed_history.start_time+Unpack<uint32_t>(packed_history.time_offsets,i) == samples[i].mTime,
+		      "Packed sample "+std::to_string(i)+" has the wrong time.");
+		Check((Unpack<float>(packed_history.temperatures,i) == samples[i].mTemperature)&&
+		      (Unpack<float>(packed_history.min_temperatures,i) == samples[i].mMinTemperature)&&
+		      (Unpack<float>(packed_history.max_temperatures,i) == samples[i].mMaxTemperature)&&
+		      (Unpack<float>(packed_history.target_temperatures,i) == samples[i].mTargetTemperature)&&
+		      ((uint8_t)packed_history.cooler_status[i] == samples[i].mCoolerStatus),
+		      "Packed sample "+std::to_string(i)+" has the wrong values.");
+	}
+	history.get_history(packed_history.last_time,TemperatureResolution::TEN_SECONDS,packed_history);
+	Check((packed_history.sample_count == 0)&&(packed_history.temperatures.size() == 0)&&
+	      (packed_history.last_time == samples.back().mTime),"Packed history since the last sample is not empty.");
+	/* the clock stepping back */
+	history.add_sample(TEST_START_TIME,-50.0,-60.0,CoolerStatus::OK);
+	history.get_samples(0,TemperatureResolution::RAW,samples);
+	Check(samples.back().mTime == TEST_START_TIME+((TEST_SAMPLE_COUNT-1)*1000LL),
+	      "A sample from the past was not kept in time order.");
+	/* benchmark */
+	start_time = std::chrono::steady_clock::now();
+	for(i = 0; i < BENCHMARK_SAMPLE_COUNT; i++)
+		benchmark_history.add_sample(TEST_START_TIME+(i*1000LL),Test_Temperature(i%TEST_SAMPLE_COUNT),-60.0,
+					     CoolerStatus::OK);
+	add_time = std::chrono::steady_clock::now();
+	benchmark_history.get_history(0,TemperatureResolution::RAW,packed_history);
+	get_time = std::chrono::steady_clock::now();
+	cout << "Added " << BENCHMARK_SAMPLE_COUNT << " samples in " <<
+		std::chrono::duration<double,std::milli>(add_time-start_time).count() << " ms, packed " <<
+		packed_history.sample_count << " raw samples in " <<
+		std::chrono::duration<double,std::milli>(get_time-add_time).count() << " ms." << endl;
+	if(Test_Failed)
+	{
+		cout << "test_temperature_history FAILED." << endl;
+		return 1;
+	}
+	cout << "test_temperature_history PASSED." << endl;
+	return 0;
+}
+
+/**
+ * Return the temperature of an emulated cooldown curve: an exponential decay from 20 C towards -60 C.
+ * @param index The index of the sample (the number of seconds since the cooler was turned on).
+ * @return The temperature in degrees centigrade.
+ */
+static double Test_Temperature(int index)
+{
+	return -60.0+(80.0*exp(-index/120.0));
+}
+
+/**
+ * Unpack a value from a packed little-endian binary column.
+ * @param column The column.
+ * @param index The index of the value in the column.
+ * @return The value.
+ */
+template <typename T> static T Unpack(const std::string &column,int index)
+{
+	char bytes[sizeof(T)];
+	T value;
+
+	memcpy(bytes,column.data()+(index*sizeof(T)),sizeof(T));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	std::reverse(bytes,bytes+sizeof(T));
+#endif
+	memcpy(&value,bytes,sizeof(T));
+	return value;
+}
+
+/**
+ * Check a test condition. If it is false, print the message and set Test_Failed.
+ * @param condition The condition.
+ * @param message The message to print if the condition is false.
+ * @see #Test_Failed
+ */
+static void Check(bool condition,const std::string &message)
+{
+	if(!condition)
+	{
+		cerr << "FAILED:" << message << endl;
+		Test_Failed = true;
+	}
+}
@@ -0,0 +1,240 @@
+/**
+ * @file
+ * @brief test_window_readout.cpp tests windowed and binned readouts, by taking bias frames on an EmulatedCamera
+ *        with a series of windows / binnings, and checking the dimensions and size of the returned image data
+ *        and frame history entries.
+ * @author Chris Mottram
+ * @version $Id$
+ */
+#include "CameraConfig.h"
+#include "EmulatedCamera.h"
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include "log4cxx/basicconfigurator.h"
+#include "log4cxx/logger.h"
+
+using std::cout, std::cerr, std::endl;
+using namespace log4cxx;
+
+/**
+ * The name of the temporary configuration file written by this test.
+ */
+#define TEST_CONFIG_FILENAME    ("/tmp/test_window_readout.cfg")
+/**
+ * The number of columns in the emulated CCD.
+ */
+#define TEST_NCOLS              (256)
+/**
+ * The number of rows in the emulated CCD.
+ */
+#define TEST_NROWS              (128)
+
+/**
+ * Structure describing one readout to test.
+ * <dl>
+ * <dt>mDescription</dt> <dd>A description of the readout.</dd>
+ * <dt>mXBin / mYBin</dt> <dd>The binning.</dd>
+ * <dt>mUseWindow</dt> <dd>Whether to set the window.</dd>
+ * <dt>mWindow</dt> <dd>The window (unbinned, inclusive, starting at 1).</dd>
+ * <dt>mBinnedNCols / mBinnedNRows</dt> <dd>The expected dimensions of the read out image.</dd>
+ * </dl>
+ */
+struct ReadoutTest
+{
+	std::string mDescription;
+	int mXBin;
+	int mYBin;
+	bool mUseWindow;
+	CameraWindow mWindow;
+	int mBinnedNCols;
+	int mBinnedNRows;
+};
+
+static bool Test_Failed = false;
+
+static void Write_Config(void);
+static void Check(bool condition,const std::string &message);
+static ReadoutTest Create_Readout_Test(const std::string &description,int xbin,int ybin,bool use_window,
+				       int x_start,int y_start,int x_end,int y_end,int binned_ncols,int binned_nrows);
+static void Test_Readout(EmulatedCamera &camera,const ReadoutTest &readout_test);
+
+/**
+ * Main program.
+ * <ul>
+ * <li>We write a minimal configuration file using Write_Config.
+ * <li>We create and initialise an EmulatedCamera.
+ * <li>We check set_window rejects windows that are not on the detector.
+ * <li>For each readout in a list of full frame / windowed readouts at different binnings, we call Test_Readout.
+ * </ul>
+ * @return The program returns 0 if the test passed, and 1 if it failed.
+ */
+int main(int argc, char *argv[])
+{
+	EmulatedCamera camera;
+	CameraConfig config;
+	std::vector<ReadoutTest> readout_test_list;
+	bool thrown;
+
+	BasicConfigurator::configure();
+	Write_Config();
+	config.initialise();
+	config.set_config_filename(TEST_CONFIG_FILENAME);
+	config.load_config();
+	camera.set_config(config);
+	camera.initialize();
+	/* windows not on the detector are rejected */
+	thrown = false;
+	try
+	{
+		camera.set_window(0,1,10,10);
+	}
+	catch(CameraException &e)
+	{
+		thrown = true;
+	}
+	Check(thrown,"Window starting at column 0 rejected");
+	thrown = false;
+	try
+	{
+		camera.set_window(1,1,TEST_NCOLS+1,10);
+	}
+	catch(CameraException &e)
+	{
+		thrown = true;
+	}
+	Check(thrown,"Window ending past the last column rejected");
+	readout_test_list.push_back(Create_Readout_Test("Full frame 1x1",1,1,false,0,0,0,0,TEST_NCOLS,TEST_NROWS));
+	readout_test_list.push_back(Create_Readout_Test("Full frame 2x2",2,2,false,0,0,0,0,
+							TEST_NCOLS/2,TEST_NROWS/2));
+	readout_test_list.push_back(Create_Readout_Test("Window 100x40 1x1",1,1,true,11,21,110,60,100,40));
+	readout_test_list.push_back(Create_Readout_Test("Window 100x40 2x2",2,2,true,11,21,110,60,50,20));
+	readout_test_list.push_back(Create_Readout_Test("Full detector window 1x1",1,1,true,1,1,TEST_NCOLS,TEST_NROWS,
+							TEST_NCOLS,TEST_NROWS));
+	for(const ReadoutTest &readout_test : readout_test_list)
+		Test_Readout(camera,readout_test);
+	remove(TEST_CONFIG_FILENAME);
+	if(Test_Failed)
+	{
+		cout << "test_window_readout:FAILED" << endl;
+		return 1;
+	}
+	cout << "test_window_readout:PASSED" << endl;
+	return 0;
+}
+
+/**
+ * Write a minimal configuration file containing the keywords the EmulatedCamera needs.
+ * @see #TEST_CONFIG_FILENAME
+ * @see #TEST_NCOLS
+ * @see #TEST_NROWS
+ */
+static void Write_Config(void)
+{
+	std::ofstream config_file(TEST_CONFIG_FILENAME);
+
+	config_file << "[Camera]" << endl;
+	config_file << "ccd.ncols = " << TEST_NCOLS << endl;
+	config_file << "ccd.nrows = " << TEST_NROWS << endl;
+	config_file << "ccd.target_temperature = -60.0" << endl;
+	config_file.close();
+}
+
+/**
+ * Report the result of a check, and set Test_Failed if it failed.
+ * @param condition The result of the check.
+ * @param message A description of the check.
+ * @see #Test_Failed
+ */
+static void Check(bool condition,const std::string &message)
+{
+	if(condition)
+		cout << "OK     : " << message << endl;
+	else
+	{
+		cout << "FAILED : " << message << endl;
+		Test_Failed = true;
+	}
+}
+
+/**
+ * Create a ReadoutTest from it's parameters.
+ * @param description A description of the readout.
+ * @param xbin The horizontal binning.
+ * @param ybin The vertical binning.
+ * @param use_window Whether to set the window.
+ * @param x_start The window start column.
+ * @param y_start The window start row.
+ * @param x_end The window end column.
+ * @param y_end The window end row.
+ * @param binned_ncols The expected number of columns in the read out image.
+ * @param binned_nrows The expected number of rows in the read out image.
+ * @return The ReadoutTest.
+ */
+static ReadoutTest Create_Readout_Test(const std::string &description,int xbin,int ybin,bool use_window,
+				       int x_start,int y_start,int x_end,int y_end,int binned_ncols,int binned_nrows)
+{
+	ReadoutTest readout_test;
+
+	readout_test.mDescription = description;
+	readout_test.mXBin = xbin;
+	readout_test.mYBin = ybin;
+	readout_test.mUseWindow = use_window;
+	readout_test.mWindow.x_start = x_start;
+	readout_test.mWindow.y_start = y_start;
+	readout_test.mWindow.x_end = x_end;
+	readout_test.mWindow.y_end = y_end;
+	readout_test.mBinnedNCols = binned_ncols;
+	readout_test.mBinnedNRows = binned_nrows;
+	return readout_test;
+}
+
+/**
+ * Configure the camera for a readout, take a bias frame, and check the returned image has the
+ * windowed, binned dimensions and pixel count.
+ * @param camera The camera to test.
+ * @param readout_test The readout to test.
+ * @see #Check
+ */
+static void Test_Readout(EmulatedCamera &camera,const ReadoutTest &readout_test)
+{
+	CameraState state;
+	ImageData image_data;
+	ImageDataBinary image_data_binary;
+	std::vector<FrameInfo> frames;
+	size_t pixel_count;
+
+	cout << readout_test.mDescription << ":" << endl;
+	camera.set_binning(readout_test.mXBin,readout_test.mYBin);
+	if(readout_test.mUseWindow)
+	{
+		camera.set_window(readout_test.mWindow.x_start,readout_test.mWindow.y_start,
+				  readout_test.mWindow.x_end,readout_test.mWindow.y_end);
+	}
+	else
+		camera.clear_window();
+	camera.start_bias();
+	do
+	{
+		camera.wait_for_exposure(10000);
+		camera.get_state(state);
+	}
+	while(state.exposure_in_progress);
+	pixel_count = ((size_t)readout_test.mBinnedNCols)*((size_t)readout_test.mBinnedNRows);
+	camera.get_image_data_binary(image_data_binary);
+	Check((image_data_binary.x_size == readout_test.mBinnedNCols)&&
+	      (image_data_binary.y_size == readout_test.mBinnedNRows)&&
+	      (image_data_binary.xbin == readout_test.mXBin)&&(image_data_binary.ybin == readout_test.mYBin),
+	      "get_image_data_binary dimensions "+std::to_string(image_data_binary.x_size)+" x "+
+	      std::to_string(image_data_binary.y_size));
+	Check(image_data_binary.data.size() == pixel_count*sizeof(uint16_t),
+	      "get_image_data_binary returned "+std::to_string(image_data_binary.data.size())+" bytes");
+	camera.get_image_data(image_data);
+	Check((image_data.x_size == readout_test.mBinnedNCols)&&(image_data.y_size == readout_test.mBinnedNRows)&&
+	      (image_data.data.size() == pixel_count),"get_image_data returned "+
+	      std::to_string(image_data.data.size())+" pixels");
+	camera.list_frames(frames);
+	Check((frames.size() > 0)&&(frames.back().frame_id == image_data_binary.frame_sequence)&&
+	      (frames.back().x_size == readout_test.mBinnedNCols)&&(frames.back().y_size == readout_test.mBinnedNRows),
+	      "Frame history entry has the read out dimensions");
+}
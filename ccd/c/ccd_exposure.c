@@ -34,6 +34,7 @@
 #include "fitsio.h"
 #include "ccd_general.h"
 #include "ccd_exposure.h"
+#include "ccd_orientation.h"
 #include "ccd_setup.h"
 #include "ccd_temperature.h"
 
@@ -66,9 +67,18 @@ struct Exposure_Struct
 	volatile int Accumulation;
 	/** The current Andor series. */
 	volatile int Series;
-	/** An amount of time to pause/sleep, in milliseconds, each time
-	 *     round the loop whilst waiting for an exposure to be done (DRV_ACQUIRING -> DRV_IDLE). */
-	int Exposure_Loop_Pause_Length;
+	/** The maximum amount of time, in milliseconds, to block in WaitForAcquisitionTimeOut each time
+	 *     round the loop whilst waiting for an exposure to be done (DRV_ACQUIRING -> DRV_IDLE). 
+	 *     CCD_Exposure_Abort calls CancelWait to wake the waiting thread immediately, this just bounds
+	 *     how long an abort can go unnoticed if it arrives before the thread has started waiting. */
+	int Exposure_Wait_Slice_Length;
+	/** If TRUE, the read out image is not re-oriented after readout, and the caller must apply the configured
+	 *     orientation (CCD_Setup_Get_Orientation) itself using CCD_Orientation_Apply. This allows a camera server to
+	 *     re-orient the image on another thread, whilst the next frame is being acquired. */
+	int Defer_Orientation;
+	/** The CLOCK_MONOTONIC time stamps of the phases of the last exposure done by CCD_Exposure_Expose, from
+	 *     CCD_EXPOSURE_TIMELINE_SETUP to CCD_EXPOSURE_TIMELINE_ORIENT. The other phases are left zero. */
+	struct CCD_Exposure_Timeline_Struct Timeline;
 };
 
 /* external variables */
@@ -89,7 +99,9 @@ static struct Exposure_Struct Exposure_Data =
 	{0L,0L},
 	0,FALSE,
 	-1,-1,-1,-1,
-	1
+	1000,
+	FALSE,
+	{{{0L,0L}}}
 };
 
 /**
@@ -105,8 +117,6 @@ static char Exposure_Error_String[CCD_GENERAL_ERROR_STRING_LENGTH] = "";
 /* internal functions */
 static int Exposure_Wait_For_Start_Time(struct timespec start_time);
 static void Exposure_Debug_Buffer(char *description,unsigned short *buffer,size_t buffer_length);
-static void Exposure_Flip_X(int ncols,int nrows,unsigned short *exposure_data);
-static void Exposure_Flip_Y(int ncols,int nrows,unsigned short *exposure_data);
 
 static int fexist(char *filename);
 
@@ -127,35 +137,45 @@ void CCD_Exposure_Initialise(void)
 /**
  * Do an exposure.
  * <ul>
+ * <li>We clear Exposure_Data.Timeline, the time stamps of the phases of the exposure.
  * <li>We call <b>SetAcquisitionMode(1)</b> to set the Andor library to do a single scan (rather than a kinetic series).
  * <li>If we want to open the shutter, we call <b>SetShutter(1,0,shutter close time,shutter open time)</b> 
  *     else we call <b>SetShutter(1,2,0,0)</b> to
  *     keep the shutter closed (for biases and darks). The open and close shutter times are retrieved from the
  *     previously configured setup (CCD_Setup_Get_Open_Shutter_Time / CCD_Setup_Get_Close_Shutter_Time).
  * <li>We setup Exposure_Data's Exposure_Length, Exposure_Index and Exposure_Count for status reporting.
- * <li>We call <b>SetExposureTime</b> to set the camera's exposure length.
+ * <li>We call <b>SetExposureTime</b> to set the camera's exposure length, and time stamp the
+ *     CCD_EXPOSURE_TIMELINE_SETUP phase.
  * <li>We check the image buffer is not NULL, call CCD_Setup_Get_Buffer_Length to get it's allocated length, and 
- *     use CCD_Setup_Get_NCols / CCD_Setup_Get_NRows / CCD_Setup_Get_Bin_X / CCD_Setup_Get_Bin_Y 
- *     to compute binned image dimensions (for image flipping).
+ *     use CCD_Setup_Get_Binned_NCols / CCD_Setup_Get_Binned_NRows to get the binned (and windowed) 
+ *     image dimensions (for image re-orientation).
  * <li>We reset the Exposure_Data Abort flag.
  * <li>If start_time is not zero, we enter a loop until the the correct start_time is acheived.
  * <li>We take a timestamp and store it in Exposure_Data.Start_Time, and set Exposure_Data.Exposure_Status to 
  *     CCD_EXPOSURE_STATUS_EXPOSE.
  * <li>We call <b>StartAcquisition</b> to tell the Andor library to start the exposure.
+ * <li>We time stamp the CCD_EXPOSURE_TIMELINE_START phase in Exposure_Data.Timeline.
  * <li>We enter a loop:
  *     <ul>
- *     <li>We sleep for a millisecond.
- *     <li>We call <b>GetStatus</b> to see what exposure status the Andor library is currently in.
+ *     <li>We check whether we have been in the acquisition loop too long 
+ *         (Exposure_Data.Exposure_Length+EXPOSURE_TIMEOUT_SECS) and if so return a timeout error.
+ *     <li>We call <b>WaitForAcquisitionTimeOut</b> to block until the Andor library signals the acquisition
+ *         has finished, for at most the remaining time before the timeout or Exposure_Data.Exposure_Wait_Slice_Length
+ *         milliseconds, whichever is shorter. This returns DRV_NO_NEW_DATA if the wait timed out, 
+ *         or was cancelled by CCD_Exposure_Abort calling <b>CancelWait</b>.
  *     <li>We check Exposure_Data.Abort to see if we have been aborted 
  *         (and if so call <b>AbortAcquisition</b> and return an error as the exposure has failed).
- *     <li>We check whether we have been in the acquisition loop too long 
- *         (Exposure_Data+Exposure_LengthEXPOSURE_TIMEOUT_SECS) and if so return a timeout error.
+ *     <li>We call <b>GetStatus</b> to see what exposure status the Andor library is currently in.
  *     <li>We exit the loop if the exposure status is no longer DRV_ACQUIRING.
  *     </ul>
- * <li>We set Exposure_Data.Exposure_Status to CCD_EXPOSURE_STATUS_READOUT.
- * <li>We call <b>GetAcquiredData16</b> to get the acquired data into the image buffer.
- * <li>If CCD_Setup_Get_Flip_X returns TRUE, we call Exposure_Flip_X to flip the image data in X.
- * <li>If CCD_Setup_Get_Flip_Y returns TRUE, we call Exposure_Flip_Y to flip the image data in Y.
+ * <li>We time stamp the CCD_EXPOSURE_TIMELINE_ACQUIRED phase, and set Exposure_Data.Exposure_Status to
+ *     CCD_EXPOSURE_STATUS_READOUT.
+ * <li>We call <b>GetAcquiredData16</b> to get the acquired data into the image buffer, and time stamp the
+ *     CCD_EXPOSURE_TIMELINE_READOUT phase.
+ * <li>If CCD_Setup_Get_Orientation does not return CCD_ORIENTATION_NONE, and orientation has not been deferred to the
+ *     caller (CCD_Exposure_Defer_Orientation_Set), we call CCD_Orientation_Apply to
+ *     flip / rotate / transpose the image data in a single pass, and time stamp the CCD_EXPOSURE_TIMELINE_ORIENT
+ *     phase.
  * <li>We set Exposure_Data.Exposure_Status to CCD_EXPOSURE_STATUS_NONE.
  * <li>We call <b>GetAcquisitionProgress</b> to update some ExposureData status.
  * <li>We returrn TRUE (success).
@@ -169,22 +189,25 @@ void CCD_Exposure_Initialise(void)
  * @param buffer_length The length of the buffer in <b>pixels</b>.
  * @return Returns TRUE if the exposure succeeds and the data read out into the buffer, returns FALSE if an error
  *	occurs or the exposure is aborted.
+ * @see #EXPOSURE_TIMEOUT_SECS
+ * @see #Exposure_Data
  * @see #Exposure_Error_Number
  * @see #Exposure_Error_String
- * @see #Exposure_Flip_X
- * @see #Exposure_Flip_Y
  * @see #Exposure_Debug_Buffer
+ * @see #CCD_Exposure_Abort
  * @see CCD_General_Log
  * @see CCD_General_Andor_ErrorCode_To_String
  * @see CCD_Setup_Get_Close_Shutter_Time
  * @see CCD_Setup_Get_Open_Shutter_Time
  * @see CCD_Setup_Get_Buffer_Length
- * @see CCD_Setup_Get_Flip_X
- * @see CCD_Setup_Get_Flip_Y
- * @see CCD_Setup_Get_NCols
- * @see CCD_Setup_Get_NRows
+ * @see CCD_Setup_Get_Orientation
+ * @see CCD_Orientation_Apply
+ * @see CCD_Setup_Get_Binned_NCols
+ * @see CCD_Setup_Get_Binned_NRows
  * @see CCD_Setup_Get_Bin_X
  * @see CCD_Setup_Get_Bin_Y
+ * @see CCD_Exposure_Timeline_Clear
+ * @see CCD_Exposure_Timeline_Mark
  */
 int CCD_Exposure_Expose(int open_shutter,struct timespec start_time,int exposure_length,
 			void *buffer,size_t buffer_length)
@@ -196,7 +219,8 @@ int CCD_Exposure_Expose(int open_shutter,struct timespec start_time,int exposure
 	at_u32 andor_pixel_count;
 	size_t pixel_count;
 	unsigned int andor_retval;
-	int binned_ncols,binned_nrows,accumulation,series,exposure_status,acquisition_counter,done;
+	double remaining_time;
+	int binned_ncols,binned_nrows,accumulation,series,exposure_status,acquisition_counter,done,wait_length;
 
 	Exposure_Error_Number = 0;
 #if LOGGING > 1
@@ -209,6 +233,7 @@ int CCD_Exposure_Expose(int open_shutter,struct timespec start_time,int exposure
 			       "buffer_length=%ld).",open_shutter,start_time.tv_sec,exposure_length,
 			       buffer,buffer_length);
 #endif
+	CCD_Exposure_Timeline_Clear(&(Exposure_Data.Timeline));
 	/* set acquisition mode to single scan */
 #if LOGGING > 0
 	CCD_General_Log("ccd","ccd_exposure.c","CCD_Exposure_Expose",LOG_VERBOSITY_VERBOSE,"ANDOR",
@@ -277,6 +302,7 @@ int CCD_Exposure_Expose(int open_shutter,struct timespec start_time,int exposure
 			andor_retval);
 		return FALSE;
 	}
+	CCD_Exposure_Timeline_Mark(&(Exposure_Data.Timeline),CCD_EXPOSURE_TIMELINE_SETUP);
 	/* check buffer details */
 	if(buffer == NULL)
 	{
@@ -298,9 +324,9 @@ int CCD_Exposure_Expose(int open_shutter,struct timespec start_time,int exposure
 			buffer_length,pixel_count);
 		return FALSE;
 	}
-	/* calculate binned ncols / binned nrows for image flipping */
-	binned_ncols = CCD_Setup_Get_NCols() / CCD_Setup_Get_Bin_X();
-	binned_nrows = CCD_Setup_Get_NRows() / CCD_Setup_Get_Bin_Y();
+	/* calculate binned ncols / binned nrows for image re-orientation */
+	binned_ncols = CCD_Setup_Get_Binned_NCols();
+	binned_nrows = CCD_Setup_Get_Binned_NRows();
 	/* reset abort */
 	Exposure_Data.Abort = FALSE;
 	/* wait for start_time, if applicable */
@@ -372,80 +398,30 @@ int CCD_Exposure_Expose(int open_shutter,struct timespec start_time,int exposure
 			CCD_General_Andor_ErrorCode_To_String(andor_retval),andor_retval);
 		return FALSE;
 	}
+	CCD_Exposure_Timeline_Mark(&(Exposure_Data.Timeline),CCD_EXPOSURE_TIMELINE_START);
 	/* wait until acquisition complete */
 	acquisition_counter = 0;
 	do
 	{
-		/* sleep a (very small (configurable)) bit */
-		sleep_time.tv_sec = 0;
-		sleep_time.tv_nsec = Exposure_Data.Exposure_Loop_Pause_Length*CCD_GENERAL_ONE_MILLISECOND_NS;
-		nanosleep(&sleep_time,NULL);
-		/* get the status */
-		andor_retval = GetStatus(&exposure_status);
-		if(andor_retval != DRV_SUCCESS)
-		{
-			Exposure_Data.Exposure_Status = CCD_EXPOSURE_STATUS_NONE;
-			Exposure_Error_Number = 13;
-			sprintf(Exposure_Error_String,"CCD_Exposure_Expose: GetStatus() failed %s(%u).",
-				CCD_General_Andor_ErrorCode_To_String(andor_retval),andor_retval);
-			return FALSE;
-		}
-#if LOGGING > 3
-		if((acquisition_counter%1000)==0)
-		{
-			CCD_General_Log_Format("ccd","ccd_exposure.c","CCD_Exposure_Expose",
-					       LOG_VERBOSITY_VERBOSE,"CCD",
-					       "Current Acquisition Status after %d loops is %s(%u).",
-					       acquisition_counter,
-					       CCD_General_Andor_ErrorCode_To_String(exposure_status),
-					       exposure_status);
-		}
-#endif
-		acquisition_counter++;
-		/* check - have we been aborted? */
-		if(Exposure_Data.Abort)
-	        {
-			CCD_General_Log_Format("ccd","ccd_exposure.c","CCD_Exposure_Expose",
-					       LOG_VERBOSITY_VERBOSE,"ANDOR",
-					       "Abort detected, attempting Andor AbortAcquisition.");
-			andor_retval = AbortAcquisition();
-			CCD_General_Log_Format("ccd","ccd_exposure.c","CCD_Exposure_Expose",
-					       LOG_VERBOSITY_VERBOSE,"ANDOR",
-					       "AbortAcquisition() return %u.",andor_retval);
-			Exposure_Data.Exposure_Status = CCD_EXPOSURE_STATUS_NONE;
-			Exposure_Error_Number = 14;
-			sprintf(Exposure_Error_String,"CCD_Exposure_Expose:Aborted.");
-			return FALSE;
-		}
 		/* timeout */
 #ifdef _POSIX_TIMERS
 		clock_gettime(CLOCK_REALTIME,&current_time);
 #else
 		gettimeofday(&gtod_current_time,NULL);
 		current_time.tv_sec = gtod_current_time.tv_sec;
-		current_time.tv_nsec = gtod_current_time.tv_usec*CCD_GLOBAL_ONE_MICROSECOND_NS;
+		current_time.tv_nsec = gtod_current_time.tv_usec*CCD_GENERAL_ONE_MICROSECOND_NS;
 #endif
+		remaining_time = ((((double)Exposure_Data.Exposure_Length)/1000.0)+EXPOSURE_TIMEOUT_SECS)-
+			fdifftime(current_time,Exposure_Data.Start_Time);
 #if LOGGING > 3
-		if((acquisition_counter%1000)==0)
-		{
-			CCD_General_Log_Format("ccd","ccd_exposure.c","CCD_Exposure_Expose",
-					       LOG_VERBOSITY_VERBOSE,"CCD",
-					       "Start_Time = %s, current_time = %s, fdifftime = %.2f s,"
-					       "difftime = %.2f s, exposure length = %d ms, timeout length = %.2f s, "
-					       "is a timeout = %d.",ctime(&(Exposure_Data.Start_Time.tv_sec)),
-					       ctime(&(current_time.tv_sec)),
-					       fdifftime(current_time,Exposure_Data.Start_Time),
-					       difftime(current_time.tv_sec,Exposure_Data.Start_Time.tv_sec),
-					       Exposure_Data.Exposure_Length,
-					       ((((double)Exposure_Data.Exposure_Length)/1000.0)+
-						EXPOSURE_TIMEOUT_SECS),
-					       fdifftime(current_time,Exposure_Data.Start_Time) > 
-					       ((((double)Exposure_Data.Exposure_Length)/1000.0)+
-						EXPOSURE_TIMEOUT_SECS));
-		}
+		CCD_General_Log_Format("ccd","ccd_exposure.c","CCD_Exposure_Expose",LOG_VERBOSITY_VERBOSE,"CCD",
+				       "Start_Time = %s, current_time = %s, fdifftime = %.2f s,"
+				       "exposure length = %d ms, time remaining before timeout = %.2f s.",
+				       ctime(&(Exposure_Data.Start_Time.tv_sec)),ctime(&(current_time.tv_sec)),
+				       fdifftime(current_time,Exposure_Data.Start_Time),Exposure_Data.Exposure_Length,
+				       remaining_time);
 #endif
-		if(fdifftime(current_time,Exposure_Data.Start_Time) >
-		   ((((double)Exposure_Data.Exposure_Length)/1000.0)+EXPOSURE_TIMEOUT_SECS))
+		if(remaining_time <= 0.0)
 		{
 			CCD_General_Log_Format("ccd","ccd_exposure.c","CCD_Exposure_Expose",
 					       LOG_VERBOSITY_VERBOSE,"ANDOR",
@@ -463,11 +439,59 @@ int CCD_Exposure_Expose(int open_shutter,struct timespec start_time,int exposure
 					       "Timeout (Andor library stuck in DRV_ACQUIRING).");
 			return FALSE;
 		}
+		/* wait for the Andor library to signal the acquisition has finished */
+		wait_length = Exposure_Data.Exposure_Wait_Slice_Length;
+		if((remaining_time*1000.0) < ((double)wait_length))
+			wait_length = (int)(remaining_time*1000.0)+1;
+		if(!Exposure_Data.Abort)
+			andor_retval = WaitForAcquisitionTimeOut(wait_length);
+		else
+			andor_retval = DRV_NO_NEW_DATA;
+		if((andor_retval != DRV_SUCCESS)&&(andor_retval != DRV_NO_NEW_DATA))
+		{
+			AbortAcquisition();
+			Exposure_Data.Exposure_Status = CCD_EXPOSURE_STATUS_NONE;
+			Exposure_Error_Number = 58;
+			sprintf(Exposure_Error_String,"CCD_Exposure_Expose: WaitForAcquisitionTimeOut(%d) failed %s(%u).",
+				wait_length,CCD_General_Andor_ErrorCode_To_String(andor_retval),andor_retval);
+			return FALSE;
+		}
+		acquisition_counter++;
+		/* check - have we been aborted? */
+		if(Exposure_Data.Abort)
+	        {
+			CCD_General_Log_Format("ccd","ccd_exposure.c","CCD_Exposure_Expose",
+					       LOG_VERBOSITY_VERBOSE,"ANDOR",
+					       "Abort detected, attempting Andor AbortAcquisition.");
+			andor_retval = AbortAcquisition();
+			CCD_General_Log_Format("ccd","ccd_exposure.c","CCD_Exposure_Expose",
+					       LOG_VERBOSITY_VERBOSE,"ANDOR",
+					       "AbortAcquisition() return %u.",andor_retval);
+			Exposure_Data.Exposure_Status = CCD_EXPOSURE_STATUS_NONE;
+			Exposure_Error_Number = 14;
+			sprintf(Exposure_Error_String,"CCD_Exposure_Expose:Aborted.");
+			return FALSE;
+		}
+		/* get the status */
+		andor_retval = GetStatus(&exposure_status);
+		if(andor_retval != DRV_SUCCESS)
+		{
+			Exposure_Data.Exposure_Status = CCD_EXPOSURE_STATUS_NONE;
+			Exposure_Error_Number = 13;
+			sprintf(Exposure_Error_String,"CCD_Exposure_Expose: GetStatus() failed %s(%u).",
+				CCD_General_Andor_ErrorCode_To_String(andor_retval),andor_retval);
+			return FALSE;
+		}
+#if LOGGING > 3
+		CCD_General_Log_Format("ccd","ccd_exposure.c","CCD_Exposure_Expose",LOG_VERBOSITY_VERBOSE,"CCD",
+				       "Current Acquisition Status after %d waits is %s(%u).",acquisition_counter,
+				       CCD_General_Andor_ErrorCode_To_String(exposure_status),exposure_status);
+#endif
 	}
 	while(exposure_status==DRV_ACQUIRING);
 #if LOGGING > 3
 	CCD_General_Log_Format("ccd","ccd_exposure.c","CCD_Exposure_Expose",LOG_VERBOSITY_VERBOSE,"ANDOR",
-			       "Acquisition Status after %d loops is %s(%u).",acquisition_counter,
+			       "Acquisition Status after %d waits is %s(%u).",acquisition_counter,
 			       CCD_General_Andor_ErrorCode_To_String(exposure_status),exposure_status);
 #endif
 	/* get data */
@@ -475,6 +499,7 @@ int CCD_Exposure_Expose(int open_shutter,struct timespec start_time,int exposure
 	CCD_General_Log_Format("ccd","ccd_exposure.c","CCD_Exposure_Expose",LOG_VERBOSITY_VERBOSE,"ANDOR",
 			       "Calling GetAcquiredData16(%p,%lu).",buffer,andor_pixel_count);
 #endif
+	CCD_Exposure_Timeline_Mark(&(Exposure_Data.Timeline),CCD_EXPOSURE_TIMELINE_ACQUIRED);
 	Exposure_Data.Exposure_Status = CCD_EXPOSURE_STATUS_READOUT;
 	andor_retval = GetAcquiredData16((unsigned short*)buffer,andor_pixel_count);
 	if(andor_retval != DRV_SUCCESS)
@@ -485,11 +510,21 @@ int CCD_Exposure_Expose(int open_shutter,struct timespec start_time,int exposure
 			buffer,andor_pixel_count,CCD_General_Andor_ErrorCode_To_String(andor_retval),andor_retval);
 		return FALSE;
 	}
-	/* if required, flip the data */
-	if(CCD_Setup_Get_Flip_X())
-		Exposure_Flip_X(binned_ncols,binned_nrows,(unsigned short*)buffer);
-	if(CCD_Setup_Get_Flip_Y())
-		Exposure_Flip_Y(binned_ncols,binned_nrows,(unsigned short*)buffer);
+	CCD_Exposure_Timeline_Mark(&(Exposure_Data.Timeline),CCD_EXPOSURE_TIMELINE_READOUT);
+	/* if required, flip / rotate the data, unless the caller is doing it */
+	if((CCD_Setup_Get_Orientation() != CCD_ORIENTATION_NONE)&&(Exposure_Data.Defer_Orientation == FALSE))
+	{
+		if(!CCD_Orientation_Apply(CCD_Setup_Get_Orientation(),binned_ncols,binned_nrows,
+					  (unsigned short*)buffer))
+		{
+			Exposure_Data.Exposure_Status = CCD_EXPOSURE_STATUS_NONE;
+			Exposure_Error_Number = 61;
+			sprintf(Exposure_Error_String,"CCD_Exposure_Expose: CCD_Orientation_Apply(%s,%d,%d) failed.",
+				CCD_Orientation_To_String(CCD_Setup_Get_Orientation()),binned_ncols,binned_nrows);
+			return FALSE;
+		}
+		CCD_Exposure_Timeline_Mark(&(Exposure_Data.Timeline),CCD_EXPOSURE_TIMELINE_ORIENT);
+	}
 	Exposure_Data.Exposure_Status = CCD_EXPOSURE_STATUS_NONE;
 	Exposure_Data.Exposure_Index++;
 	andor_retval = GetAcquisitionProgress(&(accumulation),&(series));
@@ -527,15 +562,426 @@ int CCD_Exposure_Bias(void *buffer,size_t buffer_length)
 	return retval;
 }
 
+/**
+ * Take a series of exposures/darks/biases using the Andor kinetic series acquisition mode. The detector is
+ * set up once, and then takes exposure_count frames back to back at the minimum kinetic cycle time the head allows,
+ * each frame being pulled out of the Andor circular buffer into the next caller supplied buffer as it completes.
+ * <ul>
+ * <li>We check the buffer_list is not NULL, and the exposure_count is at least 1.
+ * <li>We call <b>SetAcquisitionMode(3)</b> to set the Andor library to do a kinetic series.
+ * <li>If we want to open the shutter, we call <b>SetShutter(1,0,shutter close time,shutter open time)</b> 
+ *     else we call <b>SetShutter(1,2,0,0)</b> to keep the shutter closed (for biases and darks). 
+ * <li>We setup Exposure_Data's Exposure_Length, Exposure_Index and Exposure_Count for status reporting.
+ * <li>We call <b>SetExposureTime</b> to set the camera's exposure length.
+ * <li>We call <b>SetNumberAccumulations(1)</b>, as each frame in the series is a single scan.
+ * <li>We call <b>SetNumberKinetics</b> to set the number of frames in the series.
+ * <li>We call <b>SetKineticCycleTime(0)</b>, which causes the Andor library to use the 
+ *     minimum cycle time the head allows.
+ * <li>We call <b>GetAcquisitionTimings</b> to find out the actual exposure and kinetic cycle time that will be used.
+ * <li>We call CCD_Setup_Get_Buffer_Length to get the length each frame buffer should be, 
+ *     and use CCD_Setup_Get_Binned_NCols / CCD_Setup_Get_Binned_NRows to get the binned (and windowed)
+ *     image dimensions (for image re-orientation).
+ * <li>We reset the Exposure_Data Abort flag.
+ * <li>We take a timestamp and store it in Exposure_Data.Start_Time, and set Exposure_Data.Exposure_Status to 
+ *     CCD_EXPOSURE_STATUS_EXPOSE.
+ * <li>We call <b>StartAcquisition</b> to tell the Andor library to start the kinetic series.
+ * <li>We enter a loop, until all exposure_count frames have been retrieved:
+ *     <ul>
+ *     <li>We call <b>GetOldestImage16</b> to try to retrieve the oldest frame in the Andor circular buffer 
+ *         into the next buffer in buffer_list. If there is no new data, this returns DRV_NO_NEW_DATA.
+ *     <li>If a frame was retrieved, we re-orient it (if required, and not deferred to the caller) using 
+ *         CCD_Orientation_Apply,
+ *         increment Exposure_Data.Exposure_Index, reset Exposure_Data.Start_Time to the start of the next frame,
+ *         and call <b>GetAcquisitionProgress</b> to update Exposure_Data's Accumulation and Series.
+ *     <li>We check Exposure_Data.Abort to see if we have been aborted 
+ *         (and if so call <b>AbortAcquisition</b> and return an error as the series has failed).
+ *     <li>We check whether we have been waiting for the current frame too long 
+ *         (kinetic cycle time + EXPOSURE_TIMEOUT_SECS) and if so return a timeout error.
+ *     <li>We call <b>WaitForAcquisitionTimeOut</b> to block until the Andor library signals another frame
+ *         has been acquired, for at most Exposure_Data.Exposure_Wait_Slice_Length milliseconds.
+ *         CCD_Exposure_Abort calls <b>CancelWait</b> to cut this wait short.
+ *     </ul>
+ * <li>We set Exposure_Data.Exposure_Status to CCD_EXPOSURE_STATUS_NONE.
+ * <li>We return TRUE (success).
+ * </ul>
+ * @param open_shutter A boolean, TRUE to open the shutter, FALSE to leave it closed (darks and biases).
+ * @param exposure_length The length of time to open the shutter for in milliseconds. 
+ *        This should be zero for biases.
+ * @param exposure_count The number of frames in the series. This must be at least 1.
+ * @param buffer_list An array of exposure_count pointers to previously allocated areas of memory, 
+ *        each of length buffer_length. Frame N of the series is read out into buffer_list[N].
+ * @param buffer_length The length of each buffer in <b>pixels</b>.
+ * @return Returns TRUE if the series succeeds and the data read out into the buffers, returns FALSE if an error
+ *	occurs or the series is aborted.
+ * @see #EXPOSURE_TIMEOUT_SECS
+ * @see #Exposure_Data
+ * @see #Exposure_Error_Number
+ * @see #Exposure_Error_String
+ * @see CCD_General_Log
+ * @see CCD_General_Andor_ErrorCode_To_String
+ * @see CCD_Setup_Get_Close_Shutter_Time
+ * @see CCD_Setup_Get_Open_Shutter_Time
+ * @see CCD_Setup_Get_Buffer_Length
+ * @see CCD_Setup_Get_Orientation
+ * @see CCD_Orientation_Apply
+ * @see CCD_Setup_Get_Binned_NCols
+ * @see CCD_Setup_Get_Binned_NRows
+ * @see CCD_Setup_Get_Bin_X
+ * @see CCD_Setup_Get_Bin_Y
+ */
+int CCD_Exposure_Series(int open_shutter,int exposure_length,int exposure_count,void **buffer_list,
+			size_t buffer_length)
+{
+	struct timespec current_time;
+#ifndef _POSIX_TIMERS
+	struct timeval gtod_current_time;
+#endif
+	at_u32 andor_pixel_count;
+	size_t pixel_count;
+	unsigned int andor_retval;
+	float andor_exposure_length,andor_accumulate_cycle_time,andor_kinetic_cycle_time;
+	int binned_ncols,binned_nrows,accumulation,series,acquisition_counter;
+
+	Exposure_Error_Number = 0;
+#if LOGGING > 1
+	CCD_General_Log("ccd","ccd_exposure.c","CCD_Exposure_Series",LOG_VERBOSITY_INTERMEDIATE,"CCD",
+			"CCD_Exposure_Series started.");
+#endif
+#if LOGGING > 5
+	CCD_General_Log_Format("ccd","ccd_exposure.c","CCD_Exposure_Series",LOG_VERBOSITY_INTERMEDIATE,"CCD",
+			       "CCD_Exposure_Series(open_shutter=%d,exposure_length=%d,exposure_count=%d,"
+			       "buffer_list=%p,buffer_length=%ld).",open_shutter,exposure_length,exposure_count,
+			       buffer_list,buffer_length);
+#endif
+	/* check arguments */
+	if(buffer_list == NULL)
+	{
+		Exposure_Error_Number = 42;
+		sprintf(Exposure_Error_String,"CCD_Exposure_Series: buffer_list was NULL.");
+		return FALSE;
+	}
+	if(exposure_count < 1)
+	{
+		Exposure_Error_Number = 43;
+		sprintf(Exposure_Error_String,"CCD_Exposure_Series: exposure_count %d was too small.",exposure_count);
+		return FALSE;
+	}
+	/* set acquisition mode to kinetic series */
+#if LOGGING > 0
+	CCD_General_Log("ccd","ccd_exposure.c","CCD_Exposure_Series",LOG_VERBOSITY_VERBOSE,"ANDOR",
+		       "CCD_Exposure_Series:SetAcquisitionMode(3):kinetic series.");
+#endif
+	andor_retval = SetAcquisitionMode(3);
+	if(andor_retval != DRV_SUCCESS)
+	{
+		Exposure_Error_Number = 44;
+		sprintf(Exposure_Error_String,"CCD_Exposure_Series:SetAcquisitionMode(3) failed %d(%s).",
+			andor_retval,CCD_General_Andor_ErrorCode_To_String(andor_retval));
+		return FALSE;
+	}
+	/* set shutter */
+	if(open_shutter)
+	{
+#if LOGGING > 5
+		CCD_General_Log_Format("ccd","ccd_exposure.c","CCD_Exposure_Series",LOG_VERBOSITY_INTERMEDIATE,
+				       "ANDOR","SetShutter(1,0,shutter close time = %d,shutter open time = %d).",
+				       CCD_Setup_Get_Shutter_Close_Time(),CCD_Setup_Get_Shutter_Open_Time());
+#endif
+		andor_retval = SetShutter(1,0,CCD_Setup_Get_Shutter_Close_Time(),CCD_Setup_Get_Shutter_Open_Time());
+		if(andor_retval != DRV_SUCCESS)
+		{
+			Exposure_Error_Number = 45;
+			sprintf(Exposure_Error_String,
+				"CCD_Exposure_Series: SetShutter(1,0,shutter close time = %d,shutter open time = %d) "
+				"failed %s(%u).",
+				CCD_Setup_Get_Shutter_Close_Time(),CCD_Setup_Get_Shutter_Open_Time(),
+				CCD_General_Andor_ErrorCode_To_String(andor_retval),andor_retval);
+			return FALSE;
+		}
+	}
+	else
+	{
+#if LOGGING > 5
+		CCD_General_Log("ccd","ccd_exposure.c","CCD_Exposure_Series",LOG_VERBOSITY_INTERMEDIATE,"ANDOR",
+				"SetShutter(1,2,0,0).");
+#endif
+		andor_retval = SetShutter(1,2,0,0);/* 2 means close */
+		if(andor_retval != DRV_SUCCESS)
+		{
+			Exposure_Error_Number = 46;
+			sprintf(Exposure_Error_String,"CCD_Exposure_Series: SetShutter() failed %s(%u).",
+				CCD_General_Andor_ErrorCode_To_String(andor_retval),andor_retval);
+			return FALSE;
+		}
+	}
+	/* set exposure length */
+	Exposure_Data.Exposure_Length = exposure_length;
+	/* set other parameters used for status reporting */
+	Exposure_Data.Exposure_Count = exposure_count;
+	Exposure_Data.Exposure_Index = 0;
+	Exposure_Data.Accumulation = -1;
+	Exposure_Data.Series = -1;
+#if LOGGING > 5
+	CCD_General_Log_Format("ccd","ccd_exposure.c","CCD_Exposure_Series",LOG_VERBOSITY_INTERMEDIATE,"ANDOR",
+			"SetExposureTime(%.2f).",((float)exposure_length)/1000.0f);
+#endif
+	andor_retval = SetExposureTime(((float)exposure_length)/1000.0f);/* in seconds */
+	if(andor_retval != DRV_SUCCESS)
+	{
+		Exposure_Error_Number = 47;
+		sprintf(Exposure_Error_String,"CCD_Exposure_Series: SetExposureTime(%f) failed %s(%u).",
+			(((float)exposure_length)/1000.0f),CCD_General_Andor_ErrorCode_To_String(andor_retval),
+			andor_retval);
+		return FALSE;
+	}
+	/* one accumulation per frame */
+	andor_retval = SetNumberAccumulations(1);
+	if(andor_retval != DRV_SUCCESS)
+	{
+		Exposure_Error_Number = 48;
+		sprintf(Exposure_Error_String,"CCD_Exposure_Series: SetNumberAccumulations(1) failed %s(%u).",
+			CCD_General_Andor_ErrorCode_To_String(andor_retval),andor_retval);
+		return FALSE;
+	}
+	/* number of frames in the series */
+#if LOGGING > 5
+	CCD_General_Log_Format("ccd","ccd_exposure.c","CCD_Exposure_Series",LOG_VERBOSITY_INTERMEDIATE,"ANDOR",
+			       "SetNumberKinetics(%d).",exposure_count);
+#endif
+	andor_retval = SetNumberKinetics(exposure_count);
+	if(andor_retval != DRV_SUCCESS)
+	{
+		Exposure_Error_Number = 49;
+		sprintf(Exposure_Error_String,"CCD_Exposure_Series: SetNumberKinetics(%d) failed %s(%u).",
+			exposure_count,CCD_General_Andor_ErrorCode_To_String(andor_retval),andor_retval);
+		return FALSE;
+	}
+	/* a kinetic cycle time of zero means use the shortest cycle time the head allows */
+	andor_retval = SetKineticCycleTime(0.0f);
+	if(andor_retval != DRV_SUCCESS)
+	{
+		Exposure_Error_Number = 50;
+		sprintf(Exposure_Error_String,"CCD_Exposure_Series: SetKineticCycleTime(0) failed %s(%u).",
+			CCD_General_Andor_ErrorCode_To_String(andor_retval),andor_retval);
+		return FALSE;
+	}
+	/* find out the actual timings the head will use */
+	andor_retval = GetAcquisitionTimings(&andor_exposure_length,&andor_accumulate_cycle_time,
+					     &andor_kinetic_cycle_time);
+	if(andor_retval != DRV_SUCCESS)
+	{
+		Exposure_Error_Number = 51;
+		sprintf(Exposure_Error_String,"CCD_Exposure_Series: GetAcquisitionTimings failed %s(%u).",
+			CCD_General_Andor_ErrorCode_To_String(andor_retval),andor_retval);
+		return FALSE;
+	}
+#if LOGGING > 5
+	CCD_General_Log_Format("ccd","ccd_exposure.c","CCD_Exposure_Series",LOG_VERBOSITY_INTERMEDIATE,"ANDOR",
+			       "GetAcquisitionTimings returned exposure length %.3f s, accumulate cycle time %.3f s,"
+			       " kinetic cycle time %.3f s.",andor_exposure_length,andor_accumulate_cycle_time,
+			       andor_kinetic_cycle_time);
+#endif
+	/* check buffer details */
+	if(!CCD_Setup_Get_Buffer_Length(&pixel_count))
+	{
+		Exposure_Error_Number = 52;
+		sprintf(Exposure_Error_String,"CCD_Exposure_Series: CCD_Setup_Get_Buffer_Length failed.");
+		return FALSE;
+	}
+	andor_pixel_count = (at_u32)pixel_count;
+	if(buffer_length < pixel_count)
+	{
+		Exposure_Error_Number = 53;
+		sprintf(Exposure_Error_String,"CCD_Exposure_Series: buffer_length (%ld) was too small (%ld).",
+			buffer_length,pixel_count);
+		return FALSE;
+	}
+	/* calculate binned ncols / binned nrows for image re-orientation */
+	binned_ncols = CCD_Setup_Get_Binned_NCols();
+	binned_nrows = CCD_Setup_Get_Binned_NRows();
+	/* reset abort */
+	Exposure_Data.Abort = FALSE;
+	/* start the series */
+#ifdef _POSIX_TIMERS
+	clock_gettime(CLOCK_REALTIME,&(Exposure_Data.Start_Time));
+#else
+	gettimeofday(&gtod_current_time,NULL);
+	Exposure_Data.Start_Time.tv_sec = gtod_current_time.tv_sec;
+	Exposure_Data.Start_Time.tv_nsec = gtod_current_time.tv_usec*CCD_GENERAL_ONE_MICROSECOND_NS;
+#endif
+	Exposure_Data.Exposure_Status = CCD_EXPOSURE_STATUS_EXPOSE;
+#if LOGGING > 5
+	CCD_General_Log("ccd","ccd_exposure.c","CCD_Exposure_Series",LOG_VERBOSITY_INTERMEDIATE,"ANDOR",
+			"StartAcquisition().");
+#endif
+	andor_retval = StartAcquisition();
+	if(andor_retval != DRV_SUCCESS)
+	{
+		Exposure_Data.Exposure_Status = CCD_EXPOSURE_STATUS_NONE;
+		Exposure_Error_Number = 54;
+		sprintf(Exposure_Error_String,"CCD_Exposure_Series: StartAcquisition() failed %s(%u).",
+			CCD_General_Andor_ErrorCode_To_String(andor_retval),andor_retval);
+		return FALSE;
+	}
+	/* retrieve each frame as it completes */
+	acquisition_counter = 0;
+	while(Exposure_Data.Exposure_Index < exposure_count)
+	{
+		/* try to get the oldest frame from the Andor circular buffer */
+		andor_retval = GetOldestImage16((unsigned short*)(buffer_list[Exposure_Data.Exposure_Index]),
+						andor_pixel_count);
+		if(andor_retval == DRV_SUCCESS)
+		{
+#if LOGGING > 3
+			CCD_General_Log_Format("ccd","ccd_exposure.c","CCD_Exposure_Series",LOG_VERBOSITY_VERBOSE,
+					       "ANDOR","Retrieved frame %d of %d after %d waits.",
+					       Exposure_Data.Exposure_Index+1,exposure_count,acquisition_counter);
+#endif
+			/* if required, flip / rotate the data, unless the caller is doing it */
+			if((CCD_Setup_Get_Orientation() != CCD_ORIENTATION_NONE)&&
+			   (Exposure_Data.Defer_Orientation == FALSE))
+			{
+				if(!CCD_Orientation_Apply(CCD_Setup_Get_Orientation(),binned_ncols,binned_nrows,
+						  (unsigned short*)(buffer_list[Exposure_Data.Exposure_Index])))
+				{
+					AbortAcquisition();
+					Exposure_Data.Exposure_Status = CCD_EXPOSURE_STATUS_NONE;
+					Exposure_Error_Number = 62;
+					sprintf(Exposure_Error_String,"CCD_Exposure_Series: "
+						"CCD_Orientation_Apply(%s,%d,%d) failed for frame %d.",
+						CCD_Orientation_To_String(CCD_Setup_Get_Orientation()),
+						binned_ncols,binned_nrows,Exposure_Data.Exposure_Index);
+					return FALSE;
+				}
+			}
+			Exposure_Data.Exposure_Index++;
+			/* the next frame in the series is now exposing */
+#ifdef _POSIX_TIMERS
+			clock_gettime(CLOCK_REALTIME,&(Exposure_Data.Start_Time));
+#else
+			gettimeofday(&gtod_current_time,NULL);
+			Exposure_Data.Start_Time.tv_sec = gtod_current_time.tv_sec;
+			Exposure_Data.Start_Time.tv_nsec = gtod_current_time.tv_usec*CCD_GENERAL_ONE_MICROSECOND_NS;
+#endif
+			andor_retval = GetAcquisitionProgress(&(accumulation),&(series));
+			if(andor_retval == DRV_SUCCESS)
+			{
+				Exposure_Data.Accumulation = accumulation;
+				Exposure_Data.Series = series;
+			}
+			acquisition_counter = 0;
+			continue;
+		}
+		else if(andor_retval != DRV_NO_NEW_DATA)
+		{
+			AbortAcquisition();
+			Exposure_Data.Exposure_Status = CCD_EXPOSURE_STATUS_NONE;
+			Exposure_Error_Number = 55;
+			sprintf(Exposure_Error_String,"CCD_Exposure_Series: GetOldestImage16(%p,%lu) failed %s(%u).",
+				buffer_list[Exposure_Data.Exposure_Index],(unsigned long)andor_pixel_count,
+				CCD_General_Andor_ErrorCode_To_String(andor_retval),andor_retval);
+			return FALSE;
+		}
+		acquisition_counter++;
+		/* check - have we been aborted? */
+		if(Exposure_Data.Abort)
+	        {
+			CCD_General_Log_Format("ccd","ccd_exposure.c","CCD_Exposure_Series",
+					       LOG_VERBOSITY_VERBOSE,"ANDOR",
+					       "Abort detected, attempting Andor AbortAcquisition.");
+			andor_retval = AbortAcquisition();
+			CCD_General_Log_Format("ccd","ccd_exposure.c","CCD_Exposure_Series",
+					       LOG_VERBOSITY_VERBOSE,"ANDOR",
+					       "AbortAcquisition() return %u.",andor_retval);
+			Exposure_Data.Exposure_Status = CCD_EXPOSURE_STATUS_NONE;
+			Exposure_Error_Number = 56;
+			sprintf(Exposure_Error_String,"CCD_Exposure_Series:Aborted after %d of %d frames.",
+				Exposure_Data.Exposure_Index,exposure_count);
+			return FALSE;
+		}
+		/* timeout */
+#ifdef _POSIX_TIMERS
+		clock_gettime(CLOCK_REALTIME,&current_time);
+#else
+		gettimeofday(&gtod_current_time,NULL);
+		current_time.tv_sec = gtod_current_time.tv_sec;
+		current_time.tv_nsec = gtod_current_time.tv_usec*CCD_GENERAL_ONE_MICROSECOND_NS;
+#endif
+		if(fdifftime(current_time,Exposure_Data.Start_Time) >
+		   (((double)andor_kinetic_cycle_time)+EXPOSURE_TIMEOUT_SECS))
+		{
+			CCD_General_Log_Format("ccd","ccd_exposure.c","CCD_Exposure_Series",
+					       LOG_VERBOSITY_VERBOSE,"ANDOR",
+					       "Timeout detected, attempting Andor AbortAcquisition.");
+			andor_retval = AbortAcquisition();
+			CCD_General_Log_Format("ccd","ccd_exposure.c","CCD_Exposure_Series",
+					       LOG_VERBOSITY_VERBOSE,"ANDOR",
+					       "AbortAcquisition() return %u.",andor_retval);
+			Exposure_Data.Exposure_Status = CCD_EXPOSURE_STATUS_NONE;
+			Exposure_Error_Number = 57;
+			sprintf(Exposure_Error_String,"CCD_Exposure_Series:"
+				"Timeout waiting for frame %d of %d.",Exposure_Data.Exposure_Index+1,exposure_count);
+			CCD_General_Log_Format("ccd","ccd_exposure.c","CCD_Exposure_Series",
+					       LOG_VERBOSITY_VERY_TERSE,"ANDOR",
+					       "Timeout waiting for frame %d of %d.",Exposure_Data.Exposure_Index+1,
+					       exposure_count);
+			return FALSE;
+		}
+		/* wait for the Andor library to signal the next frame has been acquired */
+		if(!Exposure_Data.Abort)
+			andor_retval = WaitForAcquisitionTimeOut(Exposure_Data.Exposure_Wait_Slice_Length);
+		else
+			andor_retval = DRV_NO_NEW_DATA;
+		if((andor_retval != DRV_SUCCESS)&&(andor_retval != DRV_NO_NEW_DATA))
+		{
+			AbortAcquisition();
+			Exposure_Data.Exposure_Status = CCD_EXPOSURE_STATUS_NONE;
+			Exposure_Error_Number = 59;
+			sprintf(Exposure_Error_String,"CCD_Exposure_Series: WaitForAcquisitionTimeOut(%d) failed %s(%u).",
+				Exposure_Data.Exposure_Wait_Slice_Length,
+				CCD_General_Andor_ErrorCode_To_String(andor_retval),andor_retval);
+			return FALSE;
+		}
+	}/* end while */
+	Exposure_Data.Exposure_Status = CCD_EXPOSURE_STATUS_NONE;
+#if LOGGING > 1
+	CCD_General_Log("ccd","ccd_exposure.c","CCD_Exposure_Series",LOG_VERBOSITY_INTERMEDIATE,"CCD",
+			"CCD_Exposure_Series finished.");
+#endif
+	return TRUE;
+}
+
 /**
  * This routine aborts an exposure currently underway, whether it is reading out or not.
+ * We set Exposure_Data.Abort to TRUE. If an exposure is underway, we call <b>CancelWait</b> to wake
+ * the exposing thread if it is blocked in <b>WaitForAcquisitionTimeOut</b>, so it notices the abort immediately.
  * @return Returns TRUE if the abort succeeds  returns FALSE if an error occurs.
  * @see #Exposure_Data
+ * @see #CCD_Exposure_Expose
+ * @see #CCD_Exposure_Series
+ * @see CCD_General_Andor_ErrorCode_To_String
  */
 int CCD_Exposure_Abort(void)
 {
+	unsigned int andor_retval;
+
 	Exposure_Error_Number = 0;
 	Exposure_Data.Abort = TRUE;
+	if(Exposure_Data.Exposure_Status != CCD_EXPOSURE_STATUS_NONE)
+	{
+#if LOGGING > 5
+		CCD_General_Log("ccd","ccd_exposure.c","CCD_Exposure_Abort",LOG_VERBOSITY_INTERMEDIATE,"ANDOR",
+				"CancelWait().");
+#endif
+		andor_retval = CancelWait();
+		if(andor_retval != DRV_SUCCESS)
+		{
+			Exposure_Error_Number = 60;
+			sprintf(Exposure_Error_String,"CCD_Exposure_Abort: CancelWait() failed %s(%u).",
+				CCD_General_Andor_ErrorCode_To_String(andor_retval),andor_retval);
+			return FALSE;
+		}
+	}
 	return TRUE;
 }
 
@@ -590,6 +1036,41 @@ int CCD_Exposure_Count_Get(void)
 	return Exposure_Data.Exposure_Count;
 }
 
+/**
+ * Set whether the re-orientation of read out images (as configured by CCD_Setup_Set_Orientation / the flip
+ * routines) is deferred to the caller. If it is, CCD_Exposure_Expose / CCD_Exposure_Bias / CCD_Exposure_Series
+ * return the image as read out (with the binned dimensions CCD_Setup_Get_Binned_NCols / CCD_Setup_Get_Binned_NRows),
+ * and the caller must call CCD_Orientation_Apply with CCD_Setup_Get_Orientation itself. This allows a camera server
+ * to re-orient the last frame on another thread, whilst the next frame is being acquired.
+ * @param defer A boolean, TRUE to defer re-orientation to the caller, FALSE to re-orient after readout (the default).
+ * @return The routine returns TRUE on success, and FALSE if defer is not a boolean.
+ * @see #Exposure_Data
+ * @see CCD_GENERAL_IS_BOOLEAN
+ */
+int CCD_Exposure_Defer_Orientation_Set(int defer)
+{
+	if(!CCD_GENERAL_IS_BOOLEAN(defer))
+	{
+		Exposure_Error_Number = 63;
+		sprintf(Exposure_Error_String,"CCD_Exposure_Defer_Orientation_Set: Argument defer (%d) was not a boolean.",
+			defer);
+		return FALSE;
+	}
+	Exposure_Data.Defer_Orientation = defer;
+	return TRUE;
+}
+
+/**
+ * Get whether the re-orientation of read out images is deferred to the caller.
+ * @return TRUE if re-orientation is deferred to the caller, FALSE if it is done after readout.
+ * @see #Exposure_Data
+ * @see CCD_Exposure_Defer_Orientation_Set
+ */
+int CCD_Exposure_Defer_Orientation_Get(void)
+{
+	return Exposure_Data.Defer_Orientation;
+}
+
 /**
  * Get the current exposure length.
  * @return The current exposure length, in milliseconds. 
@@ -620,25 +1101,88 @@ int CCD_Exposure_Start_Time_Get(struct timespec* timespec)
 }
 
 /**
- * Save the exposure to disk.
+ * Clear a timeline, so that none of it's phases have been reached.
+ * @param timeline The address of the timeline to clear. If this is NULL, nothing is done.
+ * @see #CCD_Exposure_Timeline_Struct
+ */
+void CCD_Exposure_Timeline_Clear(struct CCD_Exposure_Timeline_Struct *timeline)
+{
+	if(timeline == NULL)
+		return;
+	memset(timeline,0,sizeof(struct CCD_Exposure_Timeline_Struct));
+}
+
+/**
+ * Time stamp a phase of an acquisition in a timeline, with the current CLOCK_MONOTONIC time. A monotonic clock is
+ * used so the phase durations are not upset by the system clock being stepped or slewed.
+ * @param timeline The address of the timeline. If this is NULL, nothing is done, so callers that are not
+ *        interested in the timeline of an acquisition can pass NULL.
+ * @param phase Which phase of the acquisition to time stamp. An illegal phase is ignored.
+ * @see #CCD_Exposure_Timeline_Struct
+ * @see #CCD_EXPOSURE_TIMELINE_PHASE
+ */
+void CCD_Exposure_Timeline_Mark(struct CCD_Exposure_Timeline_Struct *timeline,enum CCD_EXPOSURE_TIMELINE_PHASE phase)
+{
+	if(timeline == NULL)
+		return;
+	if((phase < CCD_EXPOSURE_TIMELINE_REQUEST)||(phase >= CCD_EXPOSURE_TIMELINE_PHASE_COUNT))
+		return;
+	clock_gettime(CLOCK_MONOTONIC,&(timeline->Phase_Time[phase]));
+}
+
+/**
+ * Get the time stamps of the phases of the last exposure done by CCD_Exposure_Expose (or CCD_Exposure_Bias).
+ * Only the phases the library times (CCD_EXPOSURE_TIMELINE_SETUP to CCD_EXPOSURE_TIMELINE_ORIENT) are copied into
+ * the timeline, the other phases (which are time stamped by the caller) are left alone. If orientation was deferred
+ * to the caller (CCD_Exposure_Defer_Orientation_Set), the copied CCD_EXPOSURE_TIMELINE_ORIENT phase is zero.
+ * This should be called from the thread that did the exposure, before the next exposure is started.
+ * @param timeline The address of the timeline to fill in.
+ * @return Returns TRUE on success, and FALSE if an error occurs.
+ * @see #Exposure_Data
+ * @see #CCD_Exposure_Timeline_Struct
+ */
+int CCD_Exposure_Timeline_Get(struct CCD_Exposure_Timeline_Struct *timeline)
+{
+	int phase;
+
+	Exposure_Error_Number = 0;
+	if(timeline == NULL)
+	{
+		Exposure_Error_Number = 64;
+		sprintf(Exposure_Error_String,"CCD_Exposure_Timeline_Get: timeline was NULL.");
+		return FALSE;
+	}
+	for(phase = CCD_EXPOSURE_TIMELINE_SETUP; phase <= CCD_EXPOSURE_TIMELINE_ORIENT; phase++)
+		timeline->Phase_Time[phase] = Exposure_Data.Timeline.Phase_Time[phase];
+	return TRUE;
+}
+
+/**
+ * Save the exposure to disk. Each call opens it's own CFITSIO file pointer, so this can be called from several
+ * threads at once (each saving a different file), as long as CFITSIO was built reentrant (see fits_is_reentrant).
  * @param filename The name of the file to save the image into. If it does not exist, it is created.
  * @param buffer Pointer to a previously allocated array of unsigned shorts containing the image pixel values.
  * @param buffer_length The length of the buffer in bytes.
  * @param ncols The number of binned image columns (the X size/width of the image).
  * @param nrows The number of binned image rows (the Y size/height of the image).
  * @param header A list of FITS header cards to write to the output filename's FITS header.
+ * @param timeline The address of a timeline, in which the CCD_EXPOSURE_TIMELINE_SAVE_OPEN,
+ *        CCD_EXPOSURE_TIMELINE_SAVE_WRITE and CCD_EXPOSURE_TIMELINE_SAVE_CLOSE phases are time stamped once the file
+ *        has been opened, written and closed. This can be NULL. Each thread saving images should pass it's own
+ *        timeline.
  * @return Returns TRUE on success, and FALSE if an error occurs.
  * @see #Exposure_Error_Number
  * @see #Exposure_Error_String
  * @see #Exposure_Debug_Buffer
  * @see CCD_General_Log
  * @see CCD_Fits_Header_Write_To_Fits
+ * @see CCD_Exposure_Timeline_Mark
  * @see #fexist
  */
 int CCD_Exposure_Save(char *filename,void *buffer,size_t buffer_length,int ncols,int nrows,
-		      struct Fits_Header_Struct header)
+		      struct Fits_Header_Struct header,struct CCD_Exposure_Timeline_Struct *timeline)
 {
-	static fitsfile *fits_fp = NULL;
+	fitsfile *fits_fp = NULL;
 	char buff[32]; /* fits_get_errstatus returns 30 chars max */
 	long axes[2];
 	int status = 0,retval,ivalue;
@@ -679,8 +1223,9 @@ int CCD_Exposure_Save(char *filename,void *buffer,size_t buffer_length,int ncols
 			return FALSE;
 		}
 		/* create image block */
-		axes[0] = nrows;
-		axes[1] = ncols;
+		/* NAXIS1 is the number of columns (the fastest varying axis), NAXIS2 the number of rows */
+		axes[0] = ncols;
+		axes[1] = nrows;
 		retval = fits_create_img(fits_fp,USHORT_IMG,2,axes,&status);
 		if(retval)
 		{
@@ -693,9 +1238,11 @@ int CCD_Exposure_Save(char *filename,void *buffer,size_t buffer_length,int ncols
 			return FALSE;
 		}
 	}
+	CCD_Exposure_Timeline_Mark(timeline,CCD_EXPOSURE_TIMELINE_SAVE_OPEN);
 	/* write the FITS headers */
 	if(!CCD_Fits_Header_Write_To_Fits(header,fits_fp))
 	{
+		fits_close_file(fits_fp,&status);
 		Exposure_Error_Number = 41;
 		sprintf(Exposure_Error_String,"CCD_Exposure_Save: Writing FITS headers to disk failed(%s).",
 			filename);
@@ -717,6 +1264,7 @@ int CCD_Exposure_Save(char *filename,void *buffer,size_t buffer_length,int ncols
 			filename,status,buff);
 		return FALSE;
 	}
+	CCD_Exposure_Timeline_Mark(timeline,CCD_EXPOSURE_TIMELINE_SAVE_WRITE);
 	/* diddly time stamp etc*/
 	/* ensure data we have written is in the actual data buffer, not CFITSIO's internal buffers */
 	/* closing the file ensures this. */ 
@@ -731,6 +1279,7 @@ int CCD_Exposure_Save(char *filename,void *buffer,size_t buffer_length,int ncols
 			filename,status,buff);
 		return FALSE;
 	}
+	CCD_Exposure_Timeline_Mark(timeline,CCD_EXPOSURE_TIMELINE_SAVE_CLOSE);
 #if LOGGING > 5
 	CCD_General_Log("ccd","ccd_exposure.c","CCD_Exposure_Save",LOG_VERBOSITY_INTERMEDIATE,"FITS","finished.");
 #endif
@@ -906,72 +1455,6 @@ static void Exposure_Debug_Buffer(char *description,unsigned short *buffer,size_
 #endif	
 }
 
-/**
- * Flip the image data in the X direction.
- * @param ncols The number of columns on the CCD.
- * @param nrows The number of rows on the CCD.
- * @param exposure_data The image data received from the CCD. The data in this array is flipped in the X direction.
- */
-static void Exposure_Flip_X(int ncols,int nrows,unsigned short *exposure_data)
-{
-	int x,y;
-	unsigned short int tempval;
-
-#if LOGGING > 5
-	CCD_General_Log("ccd","ccd_exposure.c","Exposure_Flip_X",LOG_VERBOSITY_INTERMEDIATE,"FITS",
-			"Flipping image data in the X (horizontal) direction.");
-#endif
-	/* for each row */
-	for(y=0;y<nrows;y++)
-	{
-		/* for the first half of the columns.
-		** Note the middle column will be missed, this is OK as it
-		** does not need to be flipped if it is in the middle */
-		for(x=0;x<(ncols/2);x++)
-		{
-			/* Copy exposure_data[x,y] to tempval */
-			tempval = *(exposure_data+(y*ncols)+x);
-			/* Copy exposure_data[ncols-(x+1),y] to exposure_data[x,y] */
-			*(exposure_data+(y*ncols)+x) = *(exposure_data+(y*ncols)+(ncols-(x+1)));
-			/* Copy tempval = exposure_data[ncols-(x+1),y] */
-			*(exposure_data+(y*ncols)+(ncols-(x+1))) = tempval;
-		}
-	}
-}
-
-/**
- * Flip the image data in the Y direction.
- * @param ncols The number of columns on the CCD.
- * @param nrows The number of rows on the CCD.
- * @param exposure_data The image data received from the CCD. The data in this array is flipped in the Y direction.
- */
-static void Exposure_Flip_Y(int ncols,int nrows,unsigned short *exposure_data)
-{
-	int x,y;
-	unsigned short int tempval;
-
-#if LOGGING > 5
-	CCD_General_Log("ccd","ccd_exposure.c","Exposure_Flip_Y",LOG_VERBOSITY_INTERMEDIATE,"FITS",
-			"Flipping image data in the Y (vertical) direction.");
-#endif
-	/* for the first half of the rows.
-	** Note the middle row will be missed, this is OK as it
-	** does not need to be flipped if it is in the middle */
-	for(y=0;y<(nrows/2);y++)
-	{
-		/* for each column */
-		for(x=0;x<ncols;x++)
-		{
-			/* Copy exposure_data[x,y] to tempval */
-			tempval = *(exposure_data+(y*ncols)+x);
-			/* Copy exposure_data[x,nrows-(y+1)] to exposure_data[x,y] */
-			*(exposure_data+(y*ncols)+x) = *(exposure_data+(((nrows-(y+1))*ncols)+x));
-			/* Copy tempval = exposure_data[x,nrows-(y+1)] */
-			*(exposure_data+(((nrows-(y+1))*ncols)+x)) = tempval;
-		}
-	}
-}
-
 /**
  * Return whether the specified filename exists or not.
  * @param filename A string representing the filename to test.
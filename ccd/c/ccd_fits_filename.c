@@ -47,6 +47,20 @@
  * Length of string to reserve  for each component of the directory structure string.
  */
 #define COMPONENT_STRING_LENGTH   (64)
+/**
+ * The number of seconds in a day.
+ */
+#define ONE_DAY_S                 (24*60*60)
+/**
+ * The number of seconds after midnight UTC the night's date (and so the data directory) rolls over (12 noon).
+ */
+#define DATE_ROLLOVER_OFFSET_S    (12*60*60)
+/**
+ * The leafname of the run number journal, kept in each data directory. The instrument code is
+ * substituted in, so cameras with different instrument codes sharing a data directory have separate journals.
+ * The leading '.' stops the data transfer processes (and Fits_Filename_File_Select) picking it up.
+ */
+#define RUN_JOURNAL_LEAFNAME      (".%s.run")
 
 /* structure declarations */
 /**
@@ -71,6 +85,11 @@ struct Fits_Filename_Struct
 	int Current_Date_Number;
 	/** Current Run number. */
 	int Current_Run_Number;
+	/** The time (seconds since the epoch) the date number next rolls over, and the data directory has to be
+	 * setup again. */
+	time_t Date_Rollover_Time;
+	/** The filename of the run number journal in Data_Dir. */
+	char Run_Journal_Filename[DATA_DIR_STRING_LENGTH+COMPONENT_STRING_LENGTH];
 };
 
 /* internal data */
@@ -94,11 +113,16 @@ static char Fits_Filename_Error_String[CCD_GENERAL_ERROR_STRING_LENGTH] = "";
 static struct Fits_Filename_Struct Fits_Filename_Data = 
 {
 	"",CCD_FITS_FILENAME_DEFAULT_INSTRUMENT_CODE,CCD_FITS_FILENAME_DEFAULT_DATA_DIR_ROOT,
-	CCD_FITS_FILENAME_DEFAULT_DATA_DIR_TELESCOPE,CCD_FITS_FILENAME_DEFAULT_DATA_DIR_INSTRUMENT,0,0
+	CCD_FITS_FILENAME_DEFAULT_DATA_DIR_TELESCOPE,CCD_FITS_FILENAME_DEFAULT_DATA_DIR_INSTRUMENT,0,0,0,""
 };
 
 /* internal functions */
+static int Fits_Filename_Roll_Over_Date(void);
 static int Fits_Filename_Setup_Data_Directory(void);
+static int Fits_Filename_Scan_Run_Number(int *run_number);
+static int Fits_Filename_Run_Journal_Read(int *run_number,int *journal_valid);
+static int Fits_Filename_Run_Journal_Write(void);
+static void Fits_Filename_Get_Current_Time(time_t *seconds_since_epoch);
 static int Fits_Filename_Create_Directory(char *dir,int *directory_created);
 static int Fits_Filename_Get_Year_Number(int *year_number);
 static int Fits_Filename_Get_Month_Day_String(char *month_day_string);
@@ -112,8 +136,9 @@ static int fexist(char *filename);
 ** ---------------------------------------------------------------------------- */
 /**
  * Initialise FITS filename data, using the given data directory and the current (astronomical) day of year.
- * Retrieves current FITS images in directory, find the one with the highest multrun number, and sets
- * the current multrun number to it.
+ * Fits_Filename_Roll_Over_Date is called to setup the data directory and date number, and retrieve the current
+ * run number from the directory's run number journal (or, if the journal is missing or inconsistent, by scanning
+ * the FITS images in the directory for the highest run number).
  * @param instrument_code A string describing which instrument code to associate with this camera, which appears in
  *        the resulting FITS filenames.
  * @param data_dir_root A string containing the first part of the directory name containing FITS images.
@@ -122,21 +147,12 @@ static int fexist(char *filename);
  *        used to construct part of the directory path.
  * @return Returns TRUE if the routine succeeds and returns FALSE if an error occurs.
  * @see #Fits_Filename_Data
- * @see #Fits_Filename_Setup_Data_Directory
- * @see #Fits_Filename_File_Select
+ * @see #Fits_Filename_Roll_Over_Date
  * @see #COMPONENT_STRING_LENGTH
  */
 int CCD_Fits_Filename_Initialise(char *instrument_code,char *data_dir_root,char *data_dir_telescope,
 				 char *data_dir_instrument)
 {
-	struct dirent **name_list = NULL;
-	int name_list_count,i,retval,date_number,run_number,fully_parsed;
-	char *chptr = NULL;
-	char filename[256];
-	char inst_code[5];
-	char date_string[9];
-	char run_string[9];
-	
 #if LOGGING > 1
 	CCD_General_Log("ccd","ccd_fits_filename.c","CCD_Fits_Filename_Initialise",
 			       LOG_VERBOSITY_INTERMEDIATE,"FITS","Started.");
@@ -221,116 +237,9 @@ int CCD_Fits_Filename_Initialise(char *instrument_code,char *data_dir_root,char
 			       LOG_VERBOSITY_VERBOSE,"FITS","Instrument component of the data directory is '%s'.",
 			       Fits_Filename_Data.Data_Dir_Instrument);
 #endif
-	/* setup data_dir */
-	if(!Fits_Filename_Setup_Data_Directory())
-		return FALSE;
-#if LOGGING > 5
-	CCD_General_Log_Format("ccd","ccd_fits_filename.c","CCD_Fits_Filename_Initialise",
-			      LOG_VERBOSITY_VERY_VERBOSE,"FITS","Data Dir set to %s.",
-			      Fits_Filename_Data.Data_Dir);
-#endif
-	if(!Fits_Filename_Get_Date_Number(&(Fits_Filename_Data.Current_Date_Number)))
+	/* setup data_dir, date number and run number */
+	if(!Fits_Filename_Roll_Over_Date())
 		return FALSE;
-#if LOGGING > 5
-	CCD_General_Log_Format("ccd","ccd_fits_filename.c","CCD_Fits_Filename_Initialise",
-			      LOG_VERBOSITY_VERY_VERBOSE,"FITS","Current Date Number is %d.",
-			      Fits_Filename_Data.Current_Date_Number);
-#endif
-	Fits_Filename_Data.Current_Run_Number = 0;
-	name_list_count = scandir(Fits_Filename_Data.Data_Dir,&name_list,
-				  Fits_Filename_File_Select,alphasort);
-	for(i=0; i< name_list_count;i++)
-	{
-#if LOGGING > 9
-		CCD_General_Log_Format("ccd","ccd_fits_filename.c","CCD_Fits_Filename_Initialise",
-				      LOG_VERBOSITY_VERY_VERBOSE,"FITS","Filename %d is %s.",i,name_list[i]->d_name);
-#endif
-		fully_parsed = FALSE;
-		if(strlen(name_list[i]->d_name) > 255)
-		{
-			Fits_Filename_Error_Number = 26;
-			sprintf(Fits_Filename_Error_String,
-				"CCD_Fits_Filename_Initialise:filename '%s' was too long (%ld).",
-				name_list[i]->d_name,strlen(name_list[i]->d_name));
-			return FALSE;
-		}
-		strcpy(filename,name_list[i]->d_name);
-		chptr = strtok(filename,"_");
-		if(chptr != NULL)
-		{
-			strncpy(inst_code,chptr,4);
-			inst_code[4] = '\0';
-			chptr = strtok(NULL,".");
-			if(chptr != NULL)
-			{
-				strncpy(date_string,chptr,8);
-				date_string[8] = '\0';
-				chptr = strtok(NULL,".");
-				if(chptr != NULL)
-				{
-					strncpy(run_string,chptr,8);
-					run_string[8] = '\0';
-					fully_parsed = TRUE;
-				}
-			}
-		}
-		if(fully_parsed)
-		{
-#if LOGGING > 9
-			CCD_General_Log_Format("ccd","ccd_fits_filename.c","CCD_Fits_Filename_Initialise",
-					       LOG_VERBOSITY_VERY_VERBOSE,"FITS",
-					       "Filename %s parsed OK: inst_code = %s,date_string = %s,run_string = %s.",
-					       name_list[i]->d_name,inst_code,date_string,run_string);
-#endif
-			/* check filename is for the right instrument (camera_index) */
-			if(strcmp(inst_code,Fits_Filename_Data.Instrument_Code) == 0)
-			{
-				retval = sscanf(date_string,"%d",&date_number);
-#if LOGGING > 9
-				CCD_General_Log_Format("ccd","ccd_fits_filename.c","CCD_Fits_Filename_Initialise",
-						      LOG_VERBOSITY_VERY_VERBOSE,"FITS",
-						      "Filename %s has date number %d.",
-						      name_list[i]->d_name,date_number);
-#endif
-				/* check filename has right date number */
-				if((retval == 1)&&
-				   (date_number == Fits_Filename_Data.Current_Date_Number))
-				{
-					retval = sscanf(run_string,"%d",&run_number);
-#if LOGGING > 9
-					CCD_General_Log_Format("ccd","ccd_fits_filename.c",
-							      "CCD_Fits_Filename_Initialise",
-							      LOG_VERBOSITY_VERY_VERBOSE,"FITS",
-							      "Filename %s has run number %d.",
-							      name_list[i]->d_name,run_number);
-#endif
-					/* check if multrun number is highest yet found */
-					if((retval == 1)&&(run_number > Fits_Filename_Data.Current_Run_Number))
-					{
-						Fits_Filename_Data.Current_Run_Number = run_number;
-#if LOGGING > 9
-						CCD_General_Log_Format("ccd","ccd_fits_filename.c",
-								      "CCD_Fits_Filename_Initialise",
-								      LOG_VERBOSITY_VERY_VERBOSE,"FITS",
-								      "Current run number now %d.",
-								      Fits_Filename_Data.Current_Run_Number);
-#endif
-					}/* end if run_number > Current_Run_Number */
-				}/* end if filename has right date number */
-			}/* end if instrument has right instrument code */
-		}/* end if fully_parsed */
-		else
-		{
-#if LOGGING > 9
-			CCD_General_Log_Format("ccd","ccd_fits_filename.c","CCD_Fits_Filename_Initialise",
-					      LOG_VERBOSITY_VERY_VERBOSE,"FITS","Failed to parse filename %s: "
-					      "inst_code = %s,date_string = %s,run_string = %s.",
-					       name_list[i]->d_name,inst_code,date_string,run_string);
-#endif
-		}
-		free(name_list[i]);
-	}/* end for on name_list_count */
-	free(name_list);
 #if LOGGING > 1
 	CCD_General_Log("ccd","ccd_fits_filename.c","CCD_Fits_Filename_Initialise",
 			LOG_VERBOSITY_INTERMEDIATE,"FITS","Finished.");
@@ -339,21 +248,30 @@ int CCD_Fits_Filename_Initialise(char *instrument_code,char *data_dir_root,char
 }
 
 /**
- * Increments the Run number. Fits_Filename_Setup_Data_Directory is called first, to make sure the data directory
- * exists, and has not changed since the last run (in which case it is created and the run number reset to 0).
- * Fits_Filename_Get_Date_Number is also called, to roll over the date number used in the filename if necessary.
+ * Increments the Run number. The data directory and date number are cached, and only setup again 
+ * (by Fits_Filename_Roll_Over_Date) when the current time passes the date rollover time, 
+ * in which case the run number is retrieved for the new directory (usually 0). The new run number is then written
+ * to the run number journal (Fits_Filename_Run_Journal_Write), so the next CCD_Fits_Filename_Initialise does not
+ * have to scan the directory.
  * @return Returns TRUE if the routine succeeds and returns FALSE if an error occurs.
  * @see #Fits_Filename_Data
- * @see #Fits_Filename_Setup_Data_Directory
- * @see #Fits_Filename_Get_Date_Number
+ * @see #Fits_Filename_Get_Current_Time
+ * @see #Fits_Filename_Roll_Over_Date
+ * @see #Fits_Filename_Run_Journal_Write
  */
 int CCD_Fits_Filename_Next_Run(void)
 {
-	if(!Fits_Filename_Setup_Data_Directory())
-		return FALSE;
-	if(!Fits_Filename_Get_Date_Number(&(Fits_Filename_Data.Current_Date_Number)))
-		return FALSE;
+	time_t current_time;
+
+	Fits_Filename_Get_Current_Time(&current_time);
+	if(current_time >= Fits_Filename_Data.Date_Rollover_Time)
+	{
+		if(!Fits_Filename_Roll_Over_Date())
+			return FALSE;
+	}
 	Fits_Filename_Data.Current_Run_Number++;
+	if(!Fits_Filename_Run_Journal_Write())
+		return FALSE;
 	return TRUE;
 }
 
@@ -577,6 +495,80 @@ void CCD_Fits_Filename_Error_String(char *error_string)
 /* ----------------------------------------------------------------------------
 ** 		internal functions 
 ** ---------------------------------------------------------------------------- */
+/**
+ * Setup the FITS filename data for the current (astronomical) date. This is called by CCD_Fits_Filename_Initialise,
+ * and by CCD_Fits_Filename_Next_Run when the date rolls over.
+ * <ul>
+ * <li>We call Fits_Filename_Setup_Data_Directory to construct (and if necessary create) the data directory.
+ * <li>We call Fits_Filename_Get_Date_Number to compute the date number used in the filenames.
+ * <li>We compute the time the date next rolls over (12 noon UTC), and store it in Date_Rollover_Time.
+ * <li>We construct the run number journal filename for the data directory (RUN_JOURNAL_LEAFNAME).
+ * <li>We try to read the run number from the journal (Fits_Filename_Run_Journal_Read). 
+ * <li>If the journal is missing or inconsistent, we scan the data directory for the highest run number 
+ *     (Fits_Filename_Scan_Run_Number), and write it to a new journal (Fits_Filename_Run_Journal_Write).
+ * </ul>
+ * @return Returns TRUE if the routine succeeds and returns FALSE if an error occurs.
+ * @see #Fits_Filename_Data
+ * @see #Fits_Filename_Setup_Data_Directory
+ * @see #Fits_Filename_Get_Date_Number
+ * @see #Fits_Filename_Get_Current_Time
+ * @see #Fits_Filename_Run_Journal_Read
+ * @see #Fits_Filename_Scan_Run_Number
+ * @see #Fits_Filename_Run_Journal_Write
+ * @see #ONE_DAY_S
+ * @see #DATE_ROLLOVER_OFFSET_S
+ * @see #RUN_JOURNAL_LEAFNAME
+ */
+static int Fits_Filename_Roll_Over_Date(void)
+{
+	time_t current_time;
+	int journal_valid;
+
+	if(!Fits_Filename_Setup_Data_Directory())
+		return FALSE;
+#if LOGGING > 5
+	CCD_General_Log_Format("ccd","ccd_fits_filename.c","Fits_Filename_Roll_Over_Date",
+			      LOG_VERBOSITY_VERY_VERBOSE,"FITS","Data Dir set to %s.",
+			      Fits_Filename_Data.Data_Dir);
+#endif
+	if(!Fits_Filename_Get_Date_Number(&(Fits_Filename_Data.Current_Date_Number)))
+		return FALSE;
+#if LOGGING > 5
+	CCD_General_Log_Format("ccd","ccd_fits_filename.c","Fits_Filename_Roll_Over_Date",
+			      LOG_VERBOSITY_VERY_VERBOSE,"FITS","Current Date Number is %d.",
+			      Fits_Filename_Data.Current_Date_Number);
+#endif
+	/* the date number rolls over at the next 12 noon UTC */
+	Fits_Filename_Get_Current_Time(&current_time);
+	Fits_Filename_Data.Date_Rollover_Time = (((current_time-DATE_ROLLOVER_OFFSET_S)/ONE_DAY_S)+1)*ONE_DAY_S+
+		DATE_ROLLOVER_OFFSET_S;
+	/* construct the run number journal filename. Data_Dir is already terminated with a '/' */
+	strcpy(Fits_Filename_Data.Run_Journal_Filename,Fits_Filename_Data.Data_Dir);
+	sprintf(Fits_Filename_Data.Run_Journal_Filename+strlen(Fits_Filename_Data.Run_Journal_Filename),
+		RUN_JOURNAL_LEAFNAME,Fits_Filename_Data.Instrument_Code);
+	if(!Fits_Filename_Run_Journal_Read(&(Fits_Filename_Data.Current_Run_Number),&journal_valid))
+		return FALSE;
+	if(!journal_valid)
+	{
+#if LOGGING > 1
+		CCD_General_Log_Format("ccd","ccd_fits_filename.c","Fits_Filename_Roll_Over_Date",
+				       LOG_VERBOSITY_INTERMEDIATE,"FITS",
+				       "Run journal %s missing or inconsistent: scanning %s for the run number.",
+				       Fits_Filename_Data.Run_Journal_Filename,Fits_Filename_Data.Data_Dir);
+#endif
+		if(!Fits_Filename_Scan_Run_Number(&(Fits_Filename_Data.Current_Run_Number)))
+			return FALSE;
+		if(!Fits_Filename_Run_Journal_Write())
+			return FALSE;
+	}
+#if LOGGING > 5
+	CCD_General_Log_Format("ccd","ccd_fits_filename.c","Fits_Filename_Roll_Over_Date",
+			      LOG_VERBOSITY_VERY_VERBOSE,"FITS","Current Run Number is %d, date rolls over at %ld.",
+			      Fits_Filename_Data.Current_Run_Number,(long)Fits_Filename_Data.Date_Rollover_Time);
+#endif
+	return TRUE;
+}
+
 /**
  * Construct a suitable directory name to store FITS images in, and if the directory does not exist create it.
  * The SAAO FITS directory structure is as follows: /data/lesedi/mkd/2021/0311, and the name is constructed 
@@ -824,6 +816,273 @@ static int Fits_Filename_Get_Date_Number(int *date_number)
 	return TRUE;
 }
 
+/**
+ * Find the highest run number of the FITS images in the data directory (Data_Dir), for the current instrument code
+ * and date number. This is only used when the run number journal is missing or inconsistent, as it has to list
+ * and parse every image in the directory.
+ * @param run_number The address of an integer. On a successful return, this contains the highest run number found,
+ *        or 0 if there are no FITS images for the current instrument code and date number in the directory.
+ * @return Returns TRUE if the routine succeeds and returns FALSE if an error occurs.
+ * @see #Fits_Filename_Data
+ * @see #Fits_Filename_File_Select
+ */
+static int Fits_Filename_Scan_Run_Number(int *run_number)
+{
+	struct dirent **name_list = NULL;
+	int name_list_count,i,retval,date_number,file_run_number,fully_parsed;
+	char *chptr = NULL;
+	char filename[256];
+	char inst_code[5];
+	char date_string[9];
+	char run_string[9];
+
+	if(run_number == NULL)
+	{
+		Fits_Filename_Error_Number = 27;
+		sprintf(Fits_Filename_Error_String,"Fits_Filename_Scan_Run_Number:run_number was NULL.");
+		return FALSE;
+	}
+	(*run_number) = 0;
+	name_list_count = scandir(Fits_Filename_Data.Data_Dir,&name_list,
+				  Fits_Filename_File_Select,alphasort);
+	for(i=0; i< name_list_count;i++)
+	{
+#if LOGGING > 9
+		CCD_General_Log_Format("ccd","ccd_fits_filename.c","Fits_Filename_Scan_Run_Number",
+				      LOG_VERBOSITY_VERY_VERBOSE,"FITS","Filename %d is %s.",i,name_list[i]->d_name);
+#endif
+		fully_parsed = FALSE;
+		if(strlen(name_list[i]->d_name) > 255)
+		{
+			Fits_Filename_Error_Number = 26;
+			sprintf(Fits_Filename_Error_String,
+				"Fits_Filename_Scan_Run_Number:filename '%s' was too long (%ld).",
+				name_list[i]->d_name,strlen(name_list[i]->d_name));
+			for(;i < name_list_count;i++)
+				free(name_list[i]);
+			free(name_list);
+			return FALSE;
+		}
+		strcpy(filename,name_list[i]->d_name);
+		chptr = strtok(filename,"_");
+		if(chptr != NULL)
+		{
+			strncpy(inst_code,chptr,4);
+			inst_code[4] = '\0';
+			chptr = strtok(NULL,".");
+			if(chptr != NULL)
+			{
+				strncpy(date_string,chptr,8);
+				date_string[8] = '\0';
+				chptr = strtok(NULL,".");
+				if(chptr != NULL)
+				{
+					strncpy(run_string,chptr,8);
+					run_string[8] = '\0';
+					fully_parsed = TRUE;
+				}
+			}
+		}
+		if(fully_parsed)
+		{
+#if LOGGING > 9
+			CCD_General_Log_Format("ccd","ccd_fits_filename.c","Fits_Filename_Scan_Run_Number",
+					       LOG_VERBOSITY_VERY_VERBOSE,"FITS",
+					       "Filename %s parsed OK: inst_code = %s,date_string = %s,run_string = %s.",
+					       name_list[i]->d_name,inst_code,date_string,run_string);
+#endif
+			/* check filename is for the right instrument (camera_index) */
+			if(strcmp(inst_code,Fits_Filename_Data.Instrument_Code) == 0)
+			{
+				retval = sscanf(date_string,"%d",&date_number);
+#if LOGGING > 9
+				CCD_General_Log_Format("ccd","ccd_fits_filename.c","Fits_Filename_Scan_Run_Number",
+						      LOG_VERBOSITY_VERY_VERBOSE,"FITS",
+						      "Filename %s has date number %d.",
+						      name_list[i]->d_name,date_number);
+#endif
+				/* check filename has right date number */
+				if((retval == 1)&&
+				   (date_number == Fits_Filename_Data.Current_Date_Number))
+				{
+					retval = sscanf(run_string,"%d",&file_run_number);
+#if LOGGING > 9
+					CCD_General_Log_Format("ccd","ccd_fits_filename.c",
+							      "Fits_Filename_Scan_Run_Number",
+							      LOG_VERBOSITY_VERY_VERBOSE,"FITS",
+							      "Filename %s has run number %d.",
+							      name_list[i]->d_name,file_run_number);
+#endif
+					/* check if multrun number is highest yet found */
+					if((retval == 1)&&(file_run_number > (*run_number)))
+					{
+						(*run_number) = file_run_number;
+#if LOGGING > 9
+						CCD_General_Log_Format("ccd","ccd_fits_filename.c",
+								      "Fits_Filename_Scan_Run_Number",
+								      LOG_VERBOSITY_VERY_VERBOSE,"FITS",
+								      "Current run number now %d.",
+								      (*run_number));
+#endif
+					}/* end if run_number > Current_Run_Number */
+				}/* end if filename has right date number */
+			}/* end if instrument has right instrument code */
+		}/* end if fully_parsed */
+		else
+		{
+#if LOGGING > 9
+			CCD_General_Log_Format("ccd","ccd_fits_filename.c","Fits_Filename_Scan_Run_Number",
+					      LOG_VERBOSITY_VERY_VERBOSE,"FITS","Failed to parse filename %s: "
+					      "inst_code = %s,date_string = %s,run_string = %s.",
+					       name_list[i]->d_name,inst_code,date_string,run_string);
+#endif
+		}
+		free(name_list[i]);
+	}/* end for on name_list_count */
+	free(name_list);
+	return TRUE;
+}
+
+/**
+ * Read the run number from the run number journal (Run_Journal_Filename) in the data directory. The journal
+ * is a single line containing the instrument code, date number and last run number allocated.
+ * The journal is only valid if it can be parsed, it's instrument code and date number match the current ones,
+ * and no FITS image exists for the next run number (which would mean the journal is behind the images in the
+ * directory, for instance if it's last update was lost in a power failure).
+ * @param run_number The address of an integer. On a successful return, if the journal is valid,
+ *        this contains the journal's run number.
+ * @param journal_valid The address of an integer. On a successful return, this is set to TRUE if the journal
+ *        exists and is valid, and FALSE if it does not exist or is not consistent.
+ * @return Returns TRUE if the routine succeeds and returns FALSE if an error occurs. A missing or invalid
+ *         journal is not an error.
+ * @see #Fits_Filename_Data
+ * @see #fexist
+ */
+static int Fits_Filename_Run_Journal_Read(int *run_number,int *journal_valid)
+{
+	FILE *fp = NULL;
+	char inst_code[COMPONENT_STRING_LENGTH];
+	char next_filename[DATA_DIR_STRING_LENGTH+(2*COMPONENT_STRING_LENGTH)];
+	int retval,date_number,journal_run_number;
+
+	if(run_number == NULL)
+	{
+		Fits_Filename_Error_Number = 28;
+		sprintf(Fits_Filename_Error_String,"Fits_Filename_Run_Journal_Read:run_number was NULL.");
+		return FALSE;
+	}
+	if(journal_valid == NULL)
+	{
+		Fits_Filename_Error_Number = 29;
+		sprintf(Fits_Filename_Error_String,"Fits_Filename_Run_Journal_Read:journal_valid was NULL.");
+		return FALSE;
+	}
+	(*journal_valid) = FALSE;
+	fp = fopen(Fits_Filename_Data.Run_Journal_Filename,"r");
+	if(fp == NULL)
+		return TRUE;
+	retval = fscanf(fp,"%63s %d %d",inst_code,&date_number,&journal_run_number);
+	fclose(fp);
+	if(retval != 3)
+		return TRUE;
+	if((strcmp(inst_code,Fits_Filename_Data.Instrument_Code) != 0)||
+	   (date_number != Fits_Filename_Data.Current_Date_Number)||(journal_run_number < 0))
+	{
+		return TRUE;
+	}
+	/* check the journal is not behind the FITS images in the directory */
+	sprintf(next_filename,"%s%s_%d.%04d.fits",Fits_Filename_Data.Data_Dir,Fits_Filename_Data.Instrument_Code,
+		Fits_Filename_Data.Current_Date_Number,journal_run_number+1);
+	if(fexist(next_filename))
+		return TRUE;
+	(*run_number) = journal_run_number;
+	(*journal_valid) = TRUE;
+	return TRUE;
+}
+
+/**
+ * Write the current run number to the run number journal (Run_Journal_Filename) in the data directory. 
+ * The journal is written to a temporary file, which is then renamed over the journal, so a crash cannot leave
+ * a partially written journal. The journal is written when a run number is allocated, before the image is saved,
+ * so it is never behind the images in the directory unless the update is lost (which 
+ * Fits_Filename_Run_Journal_Read detects). We do not fsync the journal, as that would add a disk flush to
+ * every frame.
+ * @return Returns TRUE if the routine succeeds and returns FALSE if an error occurs.
+ * @see #Fits_Filename_Data
+ */
+static int Fits_Filename_Run_Journal_Write(void)
+{
+	FILE *fp = NULL;
+	char tmp_filename[DATA_DIR_STRING_LENGTH+COMPONENT_STRING_LENGTH+4];
+	int retval,write_errno;
+
+	sprintf(tmp_filename,"%s.tmp",Fits_Filename_Data.Run_Journal_Filename);
+	fp = fopen(tmp_filename,"w");
+	if(fp == NULL)
+	{
+		write_errno = errno;
+		Fits_Filename_Error_Number = 30;
+		sprintf(Fits_Filename_Error_String,
+			"Fits_Filename_Run_Journal_Write:Failed to open run journal '%s' (%d).",tmp_filename,write_errno);
+		return FALSE;
+	}
+	retval = fprintf(fp,"%s %d %d\n",Fits_Filename_Data.Instrument_Code,Fits_Filename_Data.Current_Date_Number,
+			 Fits_Filename_Data.Current_Run_Number);
+	if(retval < 0)
+	{
+		write_errno = errno;
+		fclose(fp);
+		remove(tmp_filename);
+		Fits_Filename_Error_Number = 31;
+		sprintf(Fits_Filename_Error_String,
+			"Fits_Filename_Run_Journal_Write:Failed to write run journal '%s' (%d).",tmp_filename,write_errno);
+		return FALSE;
+	}
+	retval = fclose(fp);
+	if(retval != 0)
+	{
+		write_errno = errno;
+		remove(tmp_filename);
+		Fits_Filename_Error_Number = 32;
+		sprintf(Fits_Filename_Error_String,
+			"Fits_Filename_Run_Journal_Write:Failed to close run journal '%s' (%d).",tmp_filename,write_errno);
+		return FALSE;
+	}
+	retval = rename(tmp_filename,Fits_Filename_Data.Run_Journal_Filename);
+	if(retval != 0)
+	{
+		write_errno = errno;
+		remove(tmp_filename);
+		Fits_Filename_Error_Number = 33;
+		sprintf(Fits_Filename_Error_String,
+			"Fits_Filename_Run_Journal_Write:Failed to rename run journal '%s' to '%s' (%d).",tmp_filename,
+			Fits_Filename_Data.Run_Journal_Filename,write_errno);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Get the current time, in seconds since the epoch.
+ * @param seconds_since_epoch The address of a time_t, filled in with the current time.
+ */
+static void Fits_Filename_Get_Current_Time(time_t *seconds_since_epoch)
+{
+	struct timespec current_time;
+#ifndef _POSIX_TIMERS
+	struct timeval gtod_current_time;
+#endif
+
+#ifdef _POSIX_TIMERS
+	clock_gettime(CLOCK_REALTIME,&current_time);
+#else
+	gettimeofday(&gtod_current_time,NULL);
+	current_time.tv_sec = gtod_current_time.tv_sec;
+	current_time.tv_nsec = gtod_current_time.tv_usec*CCD_GENERAL_ONE_MICROSECOND_NS;
+#endif
+	(*seconds_since_epoch) = (time_t)(current_time.tv_sec);
+}
+
 /**
  * Select routine for scandir. Selects files starting with the instrument code (Fits_Filename_Data.Instrument_Code) 
  * and ending in '.fits'.
@@ -46,6 +46,16 @@
  * Maximum length of FITS header comment (can go from column 10 to column 80 inclusive), plus a '\0' terminator.
  */
 #define FITS_HEADER_COMMENT_STRING_LENGTH (72) 
+/**
+ * The number of cards allocated in the card list when the first card is added. The allocation is doubled
+ * whenever it fills up.
+ */
+#define FITS_HEADER_INITIAL_CARD_COUNT    (32)
+/**
+ * The number of bytes allocated in the string arena when the first string is added. The allocation is doubled
+ * (at least) whenever it fills up.
+ */
+#define FITS_HEADER_INITIAL_ARENA_LENGTH  (2048)
 
 /* data types */
 /**
@@ -66,12 +76,26 @@ enum Fits_Header_Type_Enum
 };
 
 /**
- * Structure containing information on a FITS header entry.
+ * Structure describing where a string is stored in a FITS header's string arena.
+ * <dl>
+ * <dt>Offset</dt> <dd>The offset of the start of the string in the arena.</dd>
+ * <dt>Length</dt> <dd>The length of the string (not including the '\0' terminator). An empty string has
+ *     length 0, and is not stored in the arena.</dd>
+ * </dl>
+ * @see #Fits_Header_Struct
+ */
+struct Fits_Header_String_Struct
+{
+	unsigned int Offset;
+	unsigned short Length;
+};
+
+/**
+ * Structure containing information on a FITS header entry. The string value, units and comment are stored in the
+ * header's string arena, rather than in fixed length arrays, so a card is small and cheap to copy.
  * @see #Fits_Header_Type_Enum
- * @see #FITS_HEADER_VALUE_STRING_LENGTH
+ * @see #Fits_Header_String_Struct
  * @see #FITS_HEADER_KEYWORD_STRING_LENGTH
- * @see #FITS_HEADER_UNITS_STRING_LENGTH
- * @see #FITS_HEADER_COMMENT_STRING_LENGTH
  */
 struct Fits_Header_Card_Struct
 {
@@ -82,8 +106,9 @@ struct Fits_Header_Card_Struct
 	/** A union representing the value of the keyword */
 	union
 	{
-		/** If Type is FITS_HEADER_TYPE_STRING, the string value (of length FITS_HEADER_VALUE_STRING_LENGTH). */
-		char String[FITS_HEADER_VALUE_STRING_LENGTH]; /* columns 11-80 */
+		/** If Type is FITS_HEADER_TYPE_STRING, where the string value (of at most 
+		 *  FITS_HEADER_VALUE_STRING_LENGTH-1 characters) is in the arena. */
+		struct Fits_Header_String_Struct String; /* columns 11-80 */
 		/** If Type is FITS_HEADER_TYPE_INTEGER, the integer value. */
 		int Int;
 		/** If Type is FITS_HEADER_TYPE_FLOAT, the float value (of type double). */
@@ -91,10 +116,10 @@ struct Fits_Header_Card_Struct
 		/** If Type if FITS_HEADER_TYPE_LOGICAL, the boolean value (an integer, should be 0 (FALSE) or 1 (TRUE)). */
 		int Boolean;
 	} Value;
-	/** What units the value is in */
-	char Units[FITS_HEADER_UNITS_STRING_LENGTH]; /* columns 10-80 */
-	/** String of length FITS_HEADER_COMMENT_STRING_LENGTH. */
-	char Comment[FITS_HEADER_COMMENT_STRING_LENGTH]; /* columns 10-80  not already units columns */
+	/** Where the units the value is in (at most FITS_HEADER_UNITS_STRING_LENGTH-1 characters) are in the arena. */
+	struct Fits_Header_String_Struct Units; /* columns 10-80 */
+	/** Where the comment (at most FITS_HEADER_COMMENT_STRING_LENGTH-1 characters) is in the arena. */
+	struct Fits_Header_String_Struct Comment; /* columns 10-80  not already units columns */
 };
 
 /* internal data */
@@ -113,14 +138,26 @@ static char Fits_Header_Error_String[CCD_GENERAL_ERROR_STRING_LENGTH] = "";
 
 /* internal functions */
 static int Fits_Header_Find_Card(struct Fits_Header_Struct *header,const char *keyword,int *found_index);
-static int Fits_Header_Add_Card(struct Fits_Header_Struct *header,struct Fits_Header_Card_Struct card);
+static int Fits_Header_Add_Card(struct Fits_Header_Struct *header,struct Fits_Header_Card_Struct card,
+				const char *string_value,const char *units,const char *comment);
+static int Fits_Header_Lookup(struct Fits_Header_Struct *header,const char *uppercase_keyword,int *found_index,
+			      int *hash_slot);
+static unsigned int Fits_Header_Hash(const char *keyword);
+static int Fits_Header_Rehash(struct Fits_Header_Struct *header,int hash_table_length);
+static int Fits_Header_Reserve_Arena(struct Fits_Header_Struct *header,size_t length);
+static void Fits_Header_Store_String(struct Fits_Header_Struct *header,struct Fits_Header_String_Struct *string,
+				     const char *value,size_t max_length);
+static char *Fits_Header_Get_String(struct Fits_Header_Struct *header,struct Fits_Header_String_Struct string);
 static void Fits_Header_Uppercase(char *string);
+static int Fits_Header_Format_Card(struct Fits_Header_Struct *header,struct Fits_Header_Card_Struct *card,
+				   char *record);
 
 /* ----------------------------------------------------------------------------
 ** 		external functions 
 ** ---------------------------------------------------------------------------- */
 /**
- * Routine to initialise the fits header of cards. This does <b>not</b> free the card list memory.
+ * Routine to initialise the fits header of cards. This does <b>not</b> free the card list, hash index or string arena
+ * memory.
  * @param header The address of a Fits_Header_Struct structure to modify.
  * @return The routine returns TRUE on success, and FALSE on failure. On failure, Fits_Header_Error_Number
  *         and Fits_Header_Error_String should be filled in with suitable values.
@@ -144,6 +181,11 @@ int CCD_Fits_Header_Initialise(struct Fits_Header_Struct *header)
 	header->Card_List = NULL;
 	header->Allocated_Card_Count = 0;
 	header->Card_Count = 0;
+	header->Hash_Table = NULL;
+	header->Hash_Table_Length = 0;
+	header->Arena = NULL;
+	header->Arena_Length = 0;
+	header->Allocated_Arena_Length = 0;
 #if LOGGING > 1
 	CCD_General_Log("ccd","ccd_fits_header.c","CCD_Fits_Header_Initialise",
 			       LOG_VERBOSITY_INTERMEDIATE,"FITS","finished.");
@@ -152,7 +194,8 @@ int CCD_Fits_Header_Initialise(struct Fits_Header_Struct *header)
 }
 
 /**
- * Routine to clear the fits header of cards. This does <b>not</b> free the card list memory.
+ * Routine to clear the fits header of cards. This does <b>not</b> free the card list, hash index or string arena
+ * memory, which is reused by subsequent cards.
  * @param header The address of a Fits_Header_Struct structure to modify.
  * @return The routine returns TRUE on success, and FALSE on failure. On failure, Fits_Header_Error_Number
  *         and Fits_Header_Error_String should be filled in with suitable values.
@@ -173,8 +216,11 @@ int CCD_Fits_Header_Clear(struct Fits_Header_Struct *header)
 		sprintf(Fits_Header_Error_String,"CCD_Fits_Header_Clear:Header was NULL.");
 		return FALSE;
 	}
-	/* reset number of cards, without resetting allocated cards */
+	/* reset number of cards, and empty the hash index and string arena, without freeing them */
 	header->Card_Count = 0;
+	if(header->Hash_Table != NULL)
+		memset(header->Hash_Table,0,header->Hash_Table_Length*sizeof(int));
+	header->Arena_Length = 0;
 #if LOGGING > 1
 	CCD_General_Log("ccd","ccd_fits_header.c","CCD_Fits_Header_Clear",
 			       LOG_VERBOSITY_INTERMEDIATE,"FITS","finished.");
@@ -185,6 +231,8 @@ int CCD_Fits_Header_Clear(struct Fits_Header_Struct *header)
 /**
  * Routine to delete the specified keyword from the FITS header. 
  * The list is not reallocated, CCD_Fits_Header_Free will eventually free the allocated memory.
+ * The following cards are moved down the list to keep it in insertion order, and the hash index is rebuilt
+ * (by Fits_Header_Rehash), so this is O(n) in the number of cards.
  * The routine fails (returns FALSE) if a card with the specified keyword  (uppercased) is NOT in the list.
  * @param header The address of a Fits_Header_Struct structure to modify.
  * @param keyword The keyword of the FITS header card to remove from the list.
@@ -195,11 +243,13 @@ int CCD_Fits_Header_Clear(struct Fits_Header_Struct *header)
  * @see #Fits_Header_Error_Number
  * @see #Fits_Header_Error_String
  * @see #Fits_Header_Uppercase
+ * @see #Fits_Header_Lookup
+ * @see #Fits_Header_Rehash
  */
 int CCD_Fits_Header_Delete(struct Fits_Header_Struct *header,const char *keyword)
 {
 	char uppercase_keyword[FITS_HEADER_KEYWORD_STRING_LENGTH];
-	int found_index,index,done;
+	int found_index,hash_slot;
 
 #if LOGGING > 1
 	CCD_General_Log("ccd","ccd_fits_header.c","CCD_Fits_Header_Delete",
@@ -229,19 +279,7 @@ int CCD_Fits_Header_Delete(struct Fits_Header_Struct *header,const char *keyword
 	strcpy(uppercase_keyword,keyword);
 	Fits_Header_Uppercase(uppercase_keyword);
 	/* find keyword in header */
-	found_index = 0;
-	done  = FALSE;
-	while((found_index < header->Card_Count) && (done == FALSE))
-	{
-		if(strcmp(header->Card_List[found_index].Keyword,uppercase_keyword) == 0)
-		{
-			done = TRUE;
-		}
-		else
-			found_index++;
-	}
-	/* if we failed to find the header, then error */
-	if(done == FALSE)
+	if(!Fits_Header_Lookup(header,uppercase_keyword,&found_index,&hash_slot))
 	{
 		Fits_Header_Error_Number = 5;
 		sprintf(Fits_Header_Error_String,"CCD_Fits_Header_Delete:"
@@ -250,12 +288,14 @@ int CCD_Fits_Header_Delete(struct Fits_Header_Struct *header,const char *keyword
 	}
 	/* if we found a card with this keyword, delete it. 
 	** Move all cards beyond index down by one. */
-	for(index=found_index; index < (header->Card_Count-1); index++)
-	{
-		header->Card_List[index] = header->Card_List[index+1];
-	}
+	memmove(header->Card_List+found_index,header->Card_List+found_index+1,
+		(header->Card_Count-found_index-1)*sizeof(struct Fits_Header_Card_Struct));
 	/* decrement headers in this list */
 	header->Card_Count--;
+	/* the cards beyond index have moved, so rebuild the hash index. The card's strings are left in the
+	** arena, and are reclaimed when it is next compacted */
+	if(!Fits_Header_Rehash(header,header->Hash_Table_Length))
+		return FALSE;
 	/* leave memory allocated for reuse - this is deleted in CCD_Fits_Header_Free */
 #if LOGGING > 1
 	CCD_General_Log("ccd","ccd_fits_header.c","CCD_Fits_Header_Delete",
@@ -321,21 +361,8 @@ int CCD_Fits_Header_Add_String(struct Fits_Header_Struct *header,const char *key
 #endif
 	strcpy(card.Keyword,keyword);
 	card.Type = FITS_HEADER_TYPE_STRING;
-	/* the value will be truncated to FITS_HEADER_VALUE_STRING_LENGTH-1 */
-	strncpy(card.Value.String,value,FITS_HEADER_VALUE_STRING_LENGTH-1);
-	card.Value.String[FITS_HEADER_VALUE_STRING_LENGTH-1] = '\0';
-	strcpy(card.Units,"");
-	/* the comment will be truncated to FITS_HEADER_COMMENT_STRING_LENGTH-1 */
-	if(comment != NULL)
-	{
-		strncpy(card.Comment,comment,FITS_HEADER_COMMENT_STRING_LENGTH-1);
-		card.Comment[FITS_HEADER_COMMENT_STRING_LENGTH-1] = '\0';
-	}
-	else
-	{
-		strcpy(card.Comment,"");
-	}
-	if(!Fits_Header_Add_Card(header,card))
+	/* the value and comment are truncated by Fits_Header_Add_Card */
+	if(!Fits_Header_Add_Card(header,card,value,NULL,comment))
 		return FALSE;
 #if LOGGING > 1
 	CCD_General_Log("ccd","ccd_fits_header.c","CCD_Fits_Header_Add_String",
@@ -388,18 +415,8 @@ int CCD_Fits_Header_Add_Int(struct Fits_Header_Struct *header,const char *keywor
 	strcpy(card.Keyword,keyword);
 	card.Type = FITS_HEADER_TYPE_INTEGER;
 	card.Value.Int = value;
-	strcpy(card.Units,"");
-	/* the comment will be truncated to FITS_HEADER_COMMENT_STRING_LENGTH-1 */
-	if(comment != NULL)
-	{
-		strncpy(card.Comment,comment,FITS_HEADER_COMMENT_STRING_LENGTH-1);
-		card.Comment[FITS_HEADER_COMMENT_STRING_LENGTH-1] = '\0';
-	}
-	else
-	{
-		strcpy(card.Comment,"");
-	}
-	if(!Fits_Header_Add_Card(header,card))
+	/* the comment is truncated by Fits_Header_Add_Card */
+	if(!Fits_Header_Add_Card(header,card,NULL,NULL,comment))
 		return FALSE;
 #if LOGGING > 1
 	CCD_General_Log("ccd","ccd_fits_header.c","CCD_Fits_Header_Add_Int",
@@ -452,18 +469,8 @@ int CCD_Fits_Header_Add_Float(struct Fits_Header_Struct *header,const char *keyw
 	strcpy(card.Keyword,keyword);
 	card.Type = FITS_HEADER_TYPE_FLOAT;
 	card.Value.Float = value;
-	strcpy(card.Units,"");
-	/* the comment will be truncated to FITS_HEADER_COMMENT_STRING_LENGTH-1 */
-	if(comment != NULL)
-	{
-		strncpy(card.Comment,comment,FITS_HEADER_COMMENT_STRING_LENGTH-1);
-		card.Comment[FITS_HEADER_COMMENT_STRING_LENGTH-1] = '\0';
-	}
-	else
-	{
-		strcpy(card.Comment,"");
-	}
-	if(!Fits_Header_Add_Card(header,card))
+	/* the comment is truncated by Fits_Header_Add_Card */
+	if(!Fits_Header_Add_Card(header,card,NULL,NULL,comment))
 		return FALSE;
 #if LOGGING > 1
 	CCD_General_Log("ccd","ccd_fits_header.c","CCD_Fits_Header_Add_Float",
@@ -523,18 +530,8 @@ int CCD_Fits_Header_Add_Logical(struct Fits_Header_Struct *header,const char *ke
 	strcpy(card.Keyword,keyword);
 	card.Type = FITS_HEADER_TYPE_LOGICAL;
 	card.Value.Boolean = value;
-	strcpy(card.Units,"");
-	/* the comment will be truncated to FITS_HEADER_COMMENT_STRING_LENGTH-1 */
-	if(comment != NULL)
-	{
-		strncpy(card.Comment,comment,FITS_HEADER_COMMENT_STRING_LENGTH-1);
-		card.Comment[FITS_HEADER_COMMENT_STRING_LENGTH-1] = '\0';
-	}
-	else
-	{
-		strcpy(card.Comment,"");
-	}
-	if(!Fits_Header_Add_Card(header,card))
+	/* the comment is truncated by Fits_Header_Add_Card */
+	if(!Fits_Header_Add_Card(header,card,NULL,NULL,comment))
 		return FALSE;
 #if LOGGING > 1
 	CCD_General_Log("ccd","ccd_fits_header.c","CCD_Fits_Header_Add_Logical",
@@ -554,6 +551,8 @@ int CCD_Fits_Header_Add_Logical(struct Fits_Header_Struct *header,const char *ke
  *         and Fits_Header_Error_String should be filled in with suitable values.
  * @see #Fits_Header_Struct
  * @see #Fits_Header_Find_Card
+ * @see #Fits_Header_Reserve_Arena
+ * @see #Fits_Header_Store_String
  * @see #FITS_HEADER_COMMENT_STRING_LENGTH
  */
 int CCD_Fits_Header_Add_Comment(struct Fits_Header_Struct *header,const char *keyword,const char *comment)
@@ -579,9 +578,11 @@ int CCD_Fits_Header_Add_Comment(struct Fits_Header_Struct *header,const char *ke
 			keyword);
 		return FALSE;
 	}
-	/* the units will be truncated to FITS_HEADER_COMMENT_STRING_LENGTH-1 */
-	strncpy(header->Card_List[found_index].Comment,comment,FITS_HEADER_COMMENT_STRING_LENGTH-1);
-	header->Card_List[found_index].Comment[FITS_HEADER_COMMENT_STRING_LENGTH-1] = '\0';
+	/* the comment will be truncated to FITS_HEADER_COMMENT_STRING_LENGTH-1 */
+	if(!Fits_Header_Reserve_Arena(header,FITS_HEADER_COMMENT_STRING_LENGTH))
+		return FALSE;
+	Fits_Header_Store_String(header,&(header->Card_List[found_index].Comment),comment,
+				 FITS_HEADER_COMMENT_STRING_LENGTH-1);
 	return TRUE;
 }
 
@@ -596,6 +597,8 @@ int CCD_Fits_Header_Add_Comment(struct Fits_Header_Struct *header,const char *ke
  *         and Fits_Header_Error_String should be filled in with suitable values.
  * @see #Fits_Header_Struct
  * @see #Fits_Header_Find_Card
+ * @see #Fits_Header_Reserve_Arena
+ * @see #Fits_Header_Store_String
  * @see #FITS_HEADER_UNITS_STRING_LENGTH
  */
 int CCD_Fits_Header_Add_Units(struct Fits_Header_Struct *header,const char *keyword,const char *units)
@@ -622,13 +625,15 @@ int CCD_Fits_Header_Add_Units(struct Fits_Header_Struct *header,const char *keyw
 		return FALSE;
 	}
 	/* the units will be truncated to FITS_HEADER_UNITS_STRING_LENGTH-1 */
-	strncpy(header->Card_List[found_index].Units,units,FITS_HEADER_UNITS_STRING_LENGTH-1);
-	header->Card_List[found_index].Units[FITS_HEADER_UNITS_STRING_LENGTH-1] = '\0';
+	if(!Fits_Header_Reserve_Arena(header,FITS_HEADER_UNITS_STRING_LENGTH))
+		return FALSE;
+	Fits_Header_Store_String(header,&(header->Card_List[found_index].Units),units,
+				 FITS_HEADER_UNITS_STRING_LENGTH-1);
 	return TRUE;
 }
 
 /**
- * Routine to free an allocated FITS header list.
+ * Routine to free an allocated FITS header list, and it's hash index and string arena.
  * @param header The address of a Fits_Header_Struct structure to modify.
  * @return The routine returns TRUE on success, and FALSE on failure. On failure, Fits_Header_Error_Number
  *         and Fits_Header_Error_String should be filled in with suitable values.
@@ -654,6 +659,15 @@ int CCD_Fits_Header_Free(struct Fits_Header_Struct *header)
 	header->Card_List = NULL;
 	header->Card_Count = 0;
 	header->Allocated_Card_Count = 0;
+	if(header->Hash_Table != NULL)
+		free(header->Hash_Table);
+	header->Hash_Table = NULL;
+	header->Hash_Table_Length = 0;
+	if(header->Arena != NULL)
+		free(header->Arena);
+	header->Arena = NULL;
+	header->Arena_Length = 0;
+	header->Allocated_Arena_Length = 0;
 #if LOGGING > 1
 	CCD_General_Log("ccd","ccd_fits_header.c","CCD_Fits_Header_Free",
 			       LOG_VERBOSITY_INTERMEDIATE,"FITS","finished.");
@@ -661,6 +675,156 @@ int CCD_Fits_Header_Free(struct Fits_Header_Struct *header)
 	return TRUE;
 }
 
+/**
+ * Routine to copy a FITS header list, for instance to take a snapshot of the headers to save with an image whilst
+ * the original list continues to be modified. The destination's card list, hash index and string arena memory is
+ * reused if it is large enough, and otherwise reallocated to the size the source is using. The hash index is
+ * copied rather than rebuilt, so it is given the same number of entries as the source's.
+ * @param destination The address of a Fits_Header_Struct structure to copy the cards into. This should have been
+ *        initialised with CCD_Fits_Header_Initialise, and should eventually be freed with CCD_Fits_Header_Free.
+ * @param source The Fits_Header_Struct structure containing the cards to copy.
+ * @return The routine returns TRUE on success, and FALSE on failure. On failure, Fits_Header_Error_Number
+ *         and Fits_Header_Error_String should be filled in with suitable values.
+ * @see CCD_General_Log
+ * @see #Fits_Header_Error_Number
+ * @see #Fits_Header_Error_String
+ */
+int CCD_Fits_Header_Copy(struct Fits_Header_Struct *destination,struct Fits_Header_Struct source)
+{
+	struct Fits_Header_Card_Struct *card_list = NULL;
+	int *hash_table = NULL;
+	char *arena = NULL;
+
+#if LOGGING > 1
+	CCD_General_Log("ccd","ccd_fits_header.c","CCD_Fits_Header_Copy",
+			       LOG_VERBOSITY_INTERMEDIATE,"FITS","started.");
+#endif
+	if(destination == NULL)
+	{
+		Fits_Header_Error_Number = 33;
+		sprintf(Fits_Header_Error_String,"CCD_Fits_Header_Copy:Destination header was NULL.");
+		return FALSE;
+	}
+	if(source.Card_Count > destination->Allocated_Card_Count)
+	{
+		card_list = (struct Fits_Header_Card_Struct *)realloc(destination->Card_List,
+						  source.Card_Count*sizeof(struct Fits_Header_Card_Struct));
+		if(card_list == NULL)
+		{
+			Fits_Header_Error_Number = 34;
+			sprintf(Fits_Header_Error_String,"CCD_Fits_Header_Copy:"
+				"Failed to reallocate card list (%d,%d).",source.Card_Count,
+				destination->Allocated_Card_Count);
+			return FALSE;
+		}
+		destination->Card_List = card_list;
+		destination->Allocated_Card_Count = source.Card_Count;
+	}
+	/* an empty source index can be copied by emptying any destination index, otherwise the destination index
+	** must have the same number of entries for the card's hash slots to be the same */
+	if((source.Card_Count > 0)&&(source.Hash_Table_Length != destination->Hash_Table_Length))
+	{
+		hash_table = (int *)realloc(destination->Hash_Table,source.Hash_Table_Length*sizeof(int));
+		if(hash_table == NULL)
+		{
+			Fits_Header_Error_Number = 37;
+			sprintf(Fits_Header_Error_String,"CCD_Fits_Header_Copy:"
+				"Failed to reallocate hash index (%d,%d).",source.Hash_Table_Length,
+				destination->Hash_Table_Length);
+			return FALSE;
+		}
+		destination->Hash_Table = hash_table;
+		destination->Hash_Table_Length = source.Hash_Table_Length;
+	}
+	if(source.Arena_Length > destination->Allocated_Arena_Length)
+	{
+		arena = (char *)realloc(destination->Arena,source.Arena_Length);
+		if(arena == NULL)
+		{
+			Fits_Header_Error_Number = 38;
+			sprintf(Fits_Header_Error_String,"CCD_Fits_Header_Copy:"
+				"Failed to reallocate string arena (%lu,%lu).",(unsigned long)source.Arena_Length,
+				(unsigned long)destination->Allocated_Arena_Length);
+			return FALSE;
+		}
+		destination->Arena = arena;
+		destination->Allocated_Arena_Length = source.Arena_Length;
+	}
+	if(source.Card_Count > 0)
+	{
+		memcpy(destination->Card_List,source.Card_List,
+		       source.Card_Count*sizeof(struct Fits_Header_Card_Struct));
+		memcpy(destination->Hash_Table,source.Hash_Table,source.Hash_Table_Length*sizeof(int));
+	}
+	else if(destination->Hash_Table != NULL)
+		memset(destination->Hash_Table,0,destination->Hash_Table_Length*sizeof(int));
+	if(source.Arena_Length > 0)
+		memcpy(destination->Arena,source.Arena,source.Arena_Length);
+	destination->Card_Count = source.Card_Count;
+	destination->Arena_Length = source.Arena_Length;
+#if LOGGING > 1
+	CCD_General_Log("ccd","ccd_fits_header.c","CCD_Fits_Header_Copy",
+			       LOG_VERBOSITY_INTERMEDIATE,"FITS","finished.");
+#endif
+	return TRUE;
+}
+
+/**
+ * Routine to merge one FITS header list into another, for instance to add a precomputed block of cards to an image's
+ * headers. Each card in the source is added to the destination in order (with it's value, units and comment), 
+ * updating any card in the destination with the same keyword, otherwise being added to the end of the list.
+ * @param destination The address of a Fits_Header_Struct structure to add the cards to.
+ * @param source The Fits_Header_Struct structure containing the cards to add. This must be a different header to
+ *        the destination.
+ * @return The routine returns TRUE on success, and FALSE on failure. On failure, Fits_Header_Error_Number
+ *         and Fits_Header_Error_String should be filled in with suitable values.
+ * @see #Fits_Header_Add_Card
+ * @see #Fits_Header_Get_String
+ * @see CCD_General_Log
+ * @see #Fits_Header_Error_Number
+ * @see #Fits_Header_Error_String
+ */
+int CCD_Fits_Header_Merge(struct Fits_Header_Struct *destination,struct Fits_Header_Struct source)
+{
+	struct Fits_Header_Card_Struct *card = NULL;
+	char *string_value = NULL;
+	int i;
+
+#if LOGGING > 1
+	CCD_General_Log("ccd","ccd_fits_header.c","CCD_Fits_Header_Merge",
+			       LOG_VERBOSITY_INTERMEDIATE,"FITS","started.");
+#endif
+	if(destination == NULL)
+	{
+		Fits_Header_Error_Number = 39;
+		sprintf(Fits_Header_Error_String,"CCD_Fits_Header_Merge:Destination header was NULL.");
+		return FALSE;
+	}
+	/* the source strings are in the source arena, which must not be compacted whilst they are added */
+	if((source.Card_Count > 0)&&(destination->Card_List == source.Card_List))
+	{
+		Fits_Header_Error_Number = 40;
+		sprintf(Fits_Header_Error_String,"CCD_Fits_Header_Merge:Cannot merge a header into itself.");
+		return FALSE;
+	}
+	for(i = 0; i < source.Card_Count; i++)
+	{
+		card = &(source.Card_List[i]);
+		if(card->Type == FITS_HEADER_TYPE_STRING)
+			string_value = Fits_Header_Get_String(&source,card->Value.String);
+		else
+			string_value = NULL;
+		if(!Fits_Header_Add_Card(destination,(*card),string_value,Fits_Header_Get_String(&source,card->Units),
+					 Fits_Header_Get_String(&source,card->Comment)))
+			return FALSE;
+	}
+#if LOGGING > 1
+	CCD_General_Log("ccd","ccd_fits_header.c","CCD_Fits_Header_Merge",
+			       LOG_VERBOSITY_INTERMEDIATE,"FITS","finished.");
+#endif
+	return TRUE;
+}
+
 /**
  * Write the information contained in the header structure to the specified fitsfile.
  * @param header The Fits_Header_Struct structure containing the headers to insert.
@@ -671,6 +835,7 @@ int CCD_Fits_Header_Free(struct Fits_Header_Struct *header)
  * @see CCD_General_Log_Format
  * @see #Fits_Header_Error_Number
  * @see #Fits_Header_Error_String
+ * @see #Fits_Header_Get_String
  */
 int CCD_Fits_Header_Write_To_Fits(struct Fits_Header_Struct header,fitsfile *fits_fp)
 {
@@ -686,8 +851,8 @@ int CCD_Fits_Header_Write_To_Fits(struct Fits_Header_Struct header,fitsfile *fit
 	for(i=0;i<header.Card_Count;i++)
 	{
 		/* convert empty comment to NULL comment for CFITSIO */
-		if(strlen(header.Card_List[i].Comment) > 0)
-			comment = header.Card_List[i].Comment;
+		if(header.Card_List[i].Comment.Length > 0)
+			comment = Fits_Header_Get_String(&header,header.Card_List[i].Comment);
 		else
 			comment = NULL;
 		switch(header.Card_List[i].Type)
@@ -698,10 +863,12 @@ int CCD_Fits_Header_Write_To_Fits(struct Fits_Header_Struct header,fitsfile *fit
 							      "CCD_Fits_Header_Write_To_Fits",
 							      LOG_VERBOSITY_VERBOSE,"FITS",
 							      "%d: %s = %s.",i,
-						       header.Card_List[i].Keyword,header.Card_List[i].Value.String);
+						       header.Card_List[i].Keyword,
+						       Fits_Header_Get_String(&header,header.Card_List[i].Value.String));
 #endif
 				retval = fits_update_key(fits_fp,TSTRING,header.Card_List[i].Keyword,
-							 header.Card_List[i].Value.String,comment,&status);
+							 Fits_Header_Get_String(&header,header.Card_List[i].Value.String),
+							 comment,&status);
 				break;
 			case FITS_HEADER_TYPE_INTEGER:
 #if LOGGING > 9
@@ -753,17 +920,18 @@ int CCD_Fits_Header_Write_To_Fits(struct Fits_Header_Struct header,fitsfile *fit
 			return FALSE;
 		}
 		/* units */
-		if(strlen(header.Card_List[i].Units) > 0)
+		if(header.Card_List[i].Units.Length > 0)
 		{
-			retval = fits_write_key_unit(fits_fp,header.Card_List[i].Keyword,header.Card_List[i].Units,
-						     &status);
+			retval = fits_write_key_unit(fits_fp,header.Card_List[i].Keyword,
+						     Fits_Header_Get_String(&header,header.Card_List[i].Units),&status);
 			if(retval)
 			{
 				fits_get_errstatus(status,buff);
 				Fits_Header_Error_Number = 27;
 				sprintf(Fits_Header_Error_String,"CCD_Fits_Header_Write_To_Fits:"
 				     "Failed to update FITS header Units for index='%d' keyword='%s' units='%s' (%s).",
-					i,header.Card_List[i].Keyword,header.Card_List[i].Units,buff);
+					i,header.Card_List[i].Keyword,
+					Fits_Header_Get_String(&header,header.Card_List[i].Units),buff);
 				return FALSE;
 			}
 		}
@@ -775,6 +943,57 @@ int CCD_Fits_Header_Write_To_Fits(struct Fits_Header_Struct header,fitsfile *fit
 	return TRUE;
 }
 
+/**
+ * Write the information contained in the header structure into a memory block, as FITS header records,
+ * without using CFITSIO. Each card is formatted into one CCD_FITS_HEADER_CARD_LENGTH character record (with no
+ * terminating '\0') by Fits_Header_Format_Card, in the same format CCD_Fits_Header_Write_To_Fits produces
+ * using CFITSIO. The END record and the padding to a multiple of CCD_FITS_HEADER_BLOCK_LENGTH are <b>not</b>
+ * written, the caller adds these after any other records.
+ * @param header The Fits_Header_Struct structure containing the headers to format.
+ * @param block The memory block to write the records into.
+ * @param block_length The length of block in bytes. This must be at least
+ *        header.Card_Count*CCD_FITS_HEADER_CARD_LENGTH.
+ * @return The routine returns TRUE on success, and FALSE on failure. On failure, Fits_Header_Error_Number
+ *         and Fits_Header_Error_String should be filled in with suitable values.
+ * @see #CCD_FITS_HEADER_CARD_LENGTH
+ * @see #Fits_Header_Format_Card
+ * @see #Fits_Header_Error_Number
+ * @see #Fits_Header_Error_String
+ */
+int CCD_Fits_Header_Write_To_Block(struct Fits_Header_Struct header,char *block,size_t block_length)
+{
+	int i;
+
+#if LOGGING > 1
+	CCD_General_Log("ccd","ccd_fits_header.c","CCD_Fits_Header_Write_To_Block",
+		       LOG_VERBOSITY_INTERMEDIATE,"FITS","started.");
+#endif
+	if(block == NULL)
+	{
+		Fits_Header_Error_Number = 29;
+		sprintf(Fits_Header_Error_String,"CCD_Fits_Header_Write_To_Block:Block was NULL.");
+		return FALSE;
+	}
+	if(block_length < (((size_t)header.Card_Count)*CCD_FITS_HEADER_CARD_LENGTH))
+	{
+		Fits_Header_Error_Number = 30;
+		sprintf(Fits_Header_Error_String,"CCD_Fits_Header_Write_To_Block:"
+			"Block length %lu too short for %d cards.",(unsigned long)block_length,header.Card_Count);
+		return FALSE;
+	}
+	for(i=0;i<header.Card_Count;i++)
+	{
+		if(!Fits_Header_Format_Card(&header,&(header.Card_List[i]),
+					    block+(((size_t)i)*CCD_FITS_HEADER_CARD_LENGTH)))
+			return FALSE;
+	}
+#if LOGGING > 1
+	CCD_General_Log("ccd","ccd_fits_header.c","CCD_Fits_Header_Write_To_Block",
+			       LOG_VERBOSITY_INTERMEDIATE,"FITS","finished.");
+#endif
+	return TRUE;
+}
+
 /**
  * Routine to convert a timespec structure to a DATE sytle string to put into a FITS header.
  * This uses gmtime_r and strftime to format the string. The resultant string is of the form:
@@ -885,7 +1104,7 @@ void CCD_Fits_Header_Error_String(char *error_string)
 ** 		internal functions 
 ** ---------------------------------------------------------------------------- */
 /**
- * Find the FITS header card with a specified keyword (uppercased).
+ * Find the FITS header card with a specified keyword (uppercased), using the hash index.
  * @param header The FITS header data structure to search.
  * @param keyword A string representing the keyword to search for.
  * @param found_index The address of an integer. If the routine returns true, found_index will contain
@@ -893,11 +1112,12 @@ void CCD_Fits_Header_Error_String(char *error_string)
  * @return The routine returns TRUE if the keyword is found in the header, and FALSE if it is not.
  * @see #FITS_HEADER_KEYWORD_STRING_LENGTH
  * @see #Fits_Header_Uppercase
+ * @see #Fits_Header_Lookup
  */
 static int Fits_Header_Find_Card(struct Fits_Header_Struct *header,const char *keyword,int *found_index)
 {
 	char uppercase_keyword[FITS_HEADER_KEYWORD_STRING_LENGTH];
-	int done;
+	int hash_slot;
 
 	if(header == NULL)
 	{
@@ -919,35 +1139,44 @@ static int Fits_Header_Find_Card(struct Fits_Header_Struct *header,const char *k
 		return FALSE;
 	}
 	/* find keyword in header */
-	(*found_index) = 0;
-	done  = FALSE;
-	while(((*found_index) < header->Card_Count) && (done == FALSE))
-	{
-		if(strcmp(header->Card_List[(*found_index)].Keyword,uppercase_keyword) == 0)
-		{
-			done = TRUE;
-		}
-		else
-			(*found_index)++;
-	}
-	return done;
+	return Fits_Header_Lookup(header,uppercase_keyword,found_index,&hash_slot);
 }
 
 /**
  * Routine to add a card to the list. If the keyword already exists, that card will be updated with the new value,
- * otherwise a new card will be allocated (if necessary) and added to the lsit.
+ * otherwise the card is added to the end of the list (and the hash index). The card list is doubled in size
+ * (starting at FITS_HEADER_INITIAL_CARD_COUNT cards) whenever it is full, and the hash index is doubled in size
+ * (using Fits_Header_Rehash) whenever it is more than half full, so adding a card is amortised O(1).
  * @param header The address of a Fits_Header_Struct structure to modify.
- * @param card The instance of a Fits_Header_Card_Struct to add to the header.
+ * @param card The instance of a Fits_Header_Card_Struct to add to the header. The Keyword, Type and (numeric)
+ *        Value should be filled in, the string value, units and comment are filled in by this routine.
+ * @param string_value If the card's Type is FITS_HEADER_TYPE_STRING, the string value, which is truncated to
+ *        FITS_HEADER_VALUE_STRING_LENGTH-1 characters. Otherwise this is not used.
+ * @param units The units string, which is truncated to FITS_HEADER_UNITS_STRING_LENGTH-1 characters. 
+ *        This parameter can also be NULL, which clears the card's units.
+ * @param comment The comment string, which is truncated to FITS_HEADER_COMMENT_STRING_LENGTH-1 characters. 
+ *        This parameter can also be NULL.
  * @return The routine returns TRUE on success, and FALSE on failure. On failure, Fits_Header_Error_Number
  *         and Fits_Header_Error_String should be filled in with suitable values.
+ * @see #FITS_HEADER_INITIAL_CARD_COUNT
+ * @see #FITS_HEADER_VALUE_STRING_LENGTH
+ * @see #FITS_HEADER_UNITS_STRING_LENGTH
+ * @see #FITS_HEADER_COMMENT_STRING_LENGTH
+ * @see #Fits_Header_Uppercase
+ * @see #Fits_Header_Lookup
+ * @see #Fits_Header_Rehash
+ * @see #Fits_Header_Reserve_Arena
+ * @see #Fits_Header_Store_String
  * @see CCD_General_Log
  * @see CCD_General_Log_Format
  * @see #Fits_Header_Error_Number
  * @see #Fits_Header_Error_String
  */
-static int Fits_Header_Add_Card(struct Fits_Header_Struct *header,struct Fits_Header_Card_Struct card)
+static int Fits_Header_Add_Card(struct Fits_Header_Struct *header,struct Fits_Header_Card_Struct card,
+				const char *string_value,const char *units,const char *comment)
 {
-	int index,done;
+	struct Fits_Header_Card_Struct *card_list = NULL;
+	int index,hash_slot,allocated_card_count,found;
 #if LOGGING > 1
 	CCD_General_Log("ccd","ccd_fits_header.c","Fits_Header_Add_Card",
 			       LOG_VERBOSITY_VERBOSE,"FITS","started.");
@@ -961,65 +1190,312 @@ static int Fits_Header_Add_Card(struct Fits_Header_Struct *header,struct Fits_He
 	}
 	/* uppercase keyword */
 	Fits_Header_Uppercase(card.Keyword);
-	index = 0;
-	done  = FALSE;
-	while((index < header->Card_Count) && (done == FALSE))
+	/* make room in the arena for the strings first, as compacting it moves the existing card's strings */
+	if(!Fits_Header_Reserve_Arena(header,FITS_HEADER_VALUE_STRING_LENGTH+FITS_HEADER_UNITS_STRING_LENGTH+
+				      FITS_HEADER_COMMENT_STRING_LENGTH))
+		return FALSE;
+	found = Fits_Header_Lookup(header,card.Keyword,&index,&hash_slot);
+	if(found == FALSE)
 	{
-		if(strcmp(header->Card_List[index].Keyword,card.Keyword) == 0)
+		/* if we need to allocate more memory, double the size of the card list */
+		if(header->Card_Count >= header->Allocated_Card_Count)
 		{
-			done = TRUE;
+			if(header->Allocated_Card_Count > 0)
+				allocated_card_count = header->Allocated_Card_Count*2;
+			else
+				allocated_card_count = FITS_HEADER_INITIAL_CARD_COUNT;
+			card_list = (struct Fits_Header_Card_Struct *)realloc(header->Card_List,
+					    allocated_card_count*sizeof(struct Fits_Header_Card_Struct));
+			if(card_list == NULL)
+			{
+				Fits_Header_Error_Number = 20;
+				sprintf(Fits_Header_Error_String,"Fits_Header_Add_Card:"
+					"Failed to reallocate card list (%d,%d).",allocated_card_count,
+					header->Allocated_Card_Count);
+				return FALSE;
+			}
+			header->Card_List = card_list;
+			header->Allocated_Card_Count = allocated_card_count;
+		}/* end if more memory needed */
+		/* keep the hash index at most half full, so probe sequences stay short */
+		if(((header->Card_Count+1)*2) > header->Hash_Table_Length)
+		{
+			if(!Fits_Header_Rehash(header,header->Allocated_Card_Count*2))
+				return FALSE;
+			Fits_Header_Lookup(header,card.Keyword,&index,&hash_slot);
 		}
-		else
-			index++;
+		index = header->Card_Count;
+		if(card.Type == FITS_HEADER_TYPE_STRING)
+			card.Value.String.Length = 0;
+		card.Units.Length = 0;
+		card.Comment.Length = 0;
 	}
-	/* if we found a card with this keyword, update it. */
-	if(done == TRUE)
+	else
 	{
 #if LOGGING > 5
 		CCD_General_Log_Format("ccd","ccd_fits_header.c","Fits_Header_Add_Card",
 					      LOG_VERBOSITY_VERY_VERBOSE,"FITS",
 					      "Found keyword %s at index %d:Card updated.",card.Keyword,index);
 #endif
-		header->Card_List[index] = card;
-		return TRUE;
+		/* reuse the existing card's arena space for the string value, units and comment, if they fit */
+		if(card.Type == FITS_HEADER_TYPE_STRING)
+		{
+			if(header->Card_List[index].Type == FITS_HEADER_TYPE_STRING)
+				card.Value.String = header->Card_List[index].Value.String;
+			else
+				card.Value.String.Length = 0;
+		}
+		card.Units = header->Card_List[index].Units;
+		card.Comment = header->Card_List[index].Comment;
 	}
+	/* store the strings in the arena */
+	if(card.Type == FITS_HEADER_TYPE_STRING)
+	{
+		Fits_Header_Store_String(header,&(card.Value.String),string_value,
+					 FITS_HEADER_VALUE_STRING_LENGTH-1);
+	}
+	Fits_Header_Store_String(header,&(card.Units),units,FITS_HEADER_UNITS_STRING_LENGTH-1);
+	Fits_Header_Store_String(header,&(card.Comment),comment,FITS_HEADER_COMMENT_STRING_LENGTH-1);
 	/* add the card to the list */
-	/* if we need to allocate more memory... */
-	if((header->Card_Count+1) >= header->Allocated_Card_Count)
+	header->Card_List[index] = card;
+	if(found == FALSE)
 	{
-		/* allocate card list memory to be the current card count +1 */
-		if(header->Card_List == NULL)
+		header->Hash_Table[hash_slot] = index+1;
+		header->Card_Count++;
+	}
+#if LOGGING > 1
+	CCD_General_Log("ccd","ccd_fits_header.c","Fits_Header_Add_Card",
+			       LOG_VERBOSITY_VERBOSE,"FITS","finished.");
+#endif
+	return TRUE;
+
+}
+
+/**
+ * Look up an (uppercased) keyword in the header's hash index. The index uses open addressing with linear probing:
+ * we start at the entry given by the keyword's hash (modulo the power of two index length), and step forward
+ * until we find the keyword's card, or an empty entry.
+ * @param header The FITS header data structure to search.
+ * @param uppercase_keyword The uppercased keyword to search for.
+ * @param found_index The address of an integer. If the routine returns TRUE, this is set to the index in the
+ *        card list of the keyword's card.
+ * @param hash_slot The address of an integer. If the routine returns FALSE, this is set to the hash index entry
+ *        the keyword's card should be put in (or -1 if the hash index has not been allocated yet).
+ * @return The routine returns TRUE if the keyword is found in the header, and FALSE if it is not.
+ * @see #Fits_Header_Hash
+ */
+static int Fits_Header_Lookup(struct Fits_Header_Struct *header,const char *uppercase_keyword,int *found_index,
+			      int *hash_slot)
+{
+	unsigned int mask,slot;
+
+	if(header->Hash_Table_Length == 0)
+	{
+		(*hash_slot) = -1;
+		return FALSE;
+	}
+	mask = header->Hash_Table_Length-1;
+	slot = Fits_Header_Hash(uppercase_keyword) & mask;
+	while(header->Hash_Table[slot] != 0)
+	{
+		if(strcmp(header->Card_List[header->Hash_Table[slot]-1].Keyword,uppercase_keyword) == 0)
 		{
-			header->Card_List = (struct Fits_Header_Card_Struct *)malloc((header->Card_Count+1)*
-									  sizeof(struct Fits_Header_Card_Struct));
+			(*found_index) = header->Hash_Table[slot]-1;
+			return TRUE;
 		}
-		else
+		slot = (slot+1) & mask;
+	}
+	(*hash_slot) = slot;
+	return FALSE;
+}
+
+/**
+ * Compute the hash of a keyword, using the 32 bit FNV-1a hash.
+ * @param keyword The keyword.
+ * @return The hash.
+ */
+static unsigned int Fits_Header_Hash(const char *keyword)
+{
+	unsigned int hash;
+
+	hash = 2166136261U;
+	while((*keyword) != '\0')
+	{
+		hash ^= (unsigned char)(*keyword);
+		hash *= 16777619U;
+		keyword++;
+	}
+	return hash;
+}
+
+/**
+ * Rebuild the header's hash index from the card list, reallocating it with a new number of entries if necessary.
+ * @param header The address of a Fits_Header_Struct structure to modify.
+ * @param hash_table_length The number of entries the hash index should have. This is rounded up to a power of two,
+ *        and must be more than the number of cards.
+ * @return The routine returns TRUE on success, and FALSE on failure. On failure, Fits_Header_Error_Number
+ *         and Fits_Header_Error_String should be filled in with suitable values.
+ * @see #Fits_Header_Hash
+ * @see #Fits_Header_Error_Number
+ * @see #Fits_Header_Error_String
+ */
+static int Fits_Header_Rehash(struct Fits_Header_Struct *header,int hash_table_length)
+{
+	int *hash_table = NULL;
+	unsigned int mask,slot;
+	int length,i;
+
+	length = 1;
+	while((length < hash_table_length)||(length <= header->Card_Count))
+		length *= 2;
+	if(length != header->Hash_Table_Length)
+	{
+		hash_table = (int *)realloc(header->Hash_Table,length*sizeof(int));
+		if(hash_table == NULL)
 		{
-			header->Card_List = (struct Fits_Header_Card_Struct *)realloc(header->Card_List,
-					    (header->Card_Count+1)*sizeof(struct Fits_Header_Card_Struct));
+			Fits_Header_Error_Number = 35;
+			sprintf(Fits_Header_Error_String,"Fits_Header_Rehash:"
+				"Failed to reallocate hash index (%d,%d).",length,header->Hash_Table_Length);
+			return FALSE;
 		}
-		if(header->Card_List == NULL)
+		header->Hash_Table = hash_table;
+		header->Hash_Table_Length = length;
+	}
+	memset(header->Hash_Table,0,header->Hash_Table_Length*sizeof(int));
+	mask = header->Hash_Table_Length-1;
+	for(i = 0; i < header->Card_Count; i++)
+	{
+		slot = Fits_Header_Hash(header->Card_List[i].Keyword) & mask;
+		while(header->Hash_Table[slot] != 0)
+			slot = (slot+1) & mask;
+		header->Hash_Table[slot] = i+1;
+	}
+	return TRUE;
+}
+
+/**
+ * Make sure there are at least length bytes free at the end of the header's string arena, so the following calls
+ * to Fits_Header_Store_String do not have to reallocate it. If there is not enough room, a new arena is allocated,
+ * the strings the cards still use are copied (compacted) into it, and the old arena is freed. The new arena is
+ * made at least twice the size of the strings it will contain (starting at FITS_HEADER_INITIAL_ARENA_LENGTH bytes),
+ * so updating cards does not leave it growing without bound, and reallocations are amortised O(1).
+ * @param header The address of a Fits_Header_Struct structure to modify.
+ * @param length The number of bytes needed.
+ * @return The routine returns TRUE on success, and FALSE on failure. On failure, Fits_Header_Error_Number
+ *         and Fits_Header_Error_String should be filled in with suitable values.
+ * @see #FITS_HEADER_INITIAL_ARENA_LENGTH
+ * @see #Fits_Header_Get_String
+ * @see #Fits_Header_Error_Number
+ * @see #Fits_Header_Error_String
+ */
+static int Fits_Header_Reserve_Arena(struct Fits_Header_Struct *header,size_t length)
+{
+	struct Fits_Header_String_Struct *string_list[3];
+	char *arena = NULL;
+	size_t used_length,arena_length;
+	int i,j;
+
+	if((header->Arena_Length+length) <= header->Allocated_Arena_Length)
+		return TRUE;
+	/* how much of the current arena is in use */
+	used_length = 0;
+	for(i = 0; i < header->Card_Count; i++)
+	{
+		if(header->Card_List[i].Type == FITS_HEADER_TYPE_STRING)
+			used_length += header->Card_List[i].Value.String.Length+1;
+		used_length += header->Card_List[i].Units.Length+1;
+		used_length += header->Card_List[i].Comment.Length+1;
+	}
+	arena_length = FITS_HEADER_INITIAL_ARENA_LENGTH;
+	while(arena_length < ((used_length+length)*2))
+		arena_length *= 2;
+	arena = (char *)malloc(arena_length);
+	if(arena == NULL)
+	{
+		Fits_Header_Error_Number = 36;
+		sprintf(Fits_Header_Error_String,"Fits_Header_Reserve_Arena:"
+			"Failed to allocate string arena (%lu,%lu).",(unsigned long)arena_length,
+			(unsigned long)header->Allocated_Arena_Length);
+		return FALSE;
+	}
+	/* copy the strings in use into the new arena */
+	used_length = 0;
+	for(i = 0; i < header->Card_Count; i++)
+	{
+		string_list[0] = &(header->Card_List[i].Units);
+		string_list[1] = &(header->Card_List[i].Comment);
+		if(header->Card_List[i].Type == FITS_HEADER_TYPE_STRING)
+			string_list[2] = &(header->Card_List[i].Value.String);
+		else
+			string_list[2] = NULL;
+		for(j = 0; j < 3; j++)
 		{
-			header->Card_Count = 0;
-			header->Allocated_Card_Count = 0;
-			Fits_Header_Error_Number = 20;
-			sprintf(Fits_Header_Error_String,"Fits_Header_Add_Card:"
-				"Failed to reallocate card list (%d,%d).",(header->Card_Count+1),
-				header->Allocated_Card_Count);
-			return FALSE;
+			if((string_list[j] != NULL)&&(string_list[j]->Length > 0))
+			{
+				memcpy(arena+used_length,header->Arena+string_list[j]->Offset,string_list[j]->Length+1);
+				string_list[j]->Offset = used_length;
+				used_length += string_list[j]->Length+1;
+			}
 		}
-		/* upcate allocated card count */
-		header->Allocated_Card_Count = header->Card_Count+1;
-	}/* end if more memory needed */
-	/* add the card to the list */
-	header->Card_List[header->Card_Count] = card;
-	header->Card_Count++;
-#if LOGGING > 1
-	CCD_General_Log("ccd","ccd_fits_header.c","Fits_Header_Add_Card",
-			       LOG_VERBOSITY_VERBOSE,"FITS","finished.");
-#endif
+	}
+	if(header->Arena != NULL)
+		free(header->Arena);
+	header->Arena = arena;
+	header->Arena_Length = used_length;
+	header->Allocated_Arena_Length = arena_length;
 	return TRUE;
+}
 
+/**
+ * Store a string in the header's string arena. If the string fits in the arena space the string previously
+ * occupied, it is overwritten, otherwise it is appended to the end of the arena (the caller must have called
+ * Fits_Header_Reserve_Arena to make sure there is room). An empty string is not stored.
+ * @param header The address of a Fits_Header_Struct structure to modify.
+ * @param string The address of the card's string to set. It's Offset and Length should describe where the string
+ *        was previously stored (or have a Length of 0).
+ * @param value The string to store, which is truncated to max_length characters. This can be NULL,
+ *        which is stored as an empty string.
+ * @param max_length The maximum number of characters to store.
+ * @see #Fits_Header_Reserve_Arena
+ */
+static void Fits_Header_Store_String(struct Fits_Header_Struct *header,struct Fits_Header_String_Struct *string,
+				     const char *value,size_t max_length)
+{
+	size_t length;
+
+	length = 0;
+	if(value != NULL)
+	{
+		while((length < max_length)&&(value[length] != '\0'))
+			length++;
+	}
+	if((length > string->Length)||(string->Length == 0))
+	{
+		string->Offset = header->Arena_Length;
+		if(length > 0)
+			header->Arena_Length += length+1;
+	}
+	string->Length = length;
+	if(length > 0)
+	{
+		memcpy(header->Arena+string->Offset,value,length);
+		header->Arena[string->Offset+length] = '\0';
+	}
+}
+
+/**
+ * Return a card's string from the header's string arena.
+ * @param header The address of the Fits_Header_Struct structure containing the string arena.
+ * @param string The card's string.
+ * @return The '\0' terminated string, or "" if the string is empty.
+ */
+static char *Fits_Header_Get_String(struct Fits_Header_Struct *header,struct Fits_Header_String_Struct string)
+{
+	static char empty_string[1] = "";
+
+	if(string.Length == 0)
+		return empty_string;
+	return header->Arena+string.Offset;
 }
 
 /**
@@ -1035,3 +1511,108 @@ static void Fits_Header_Uppercase(char *string)
 		string[i] = toupper(string[i]);
 	}
 }
+
+/**
+ * Format a card into a FITS header record, in the same way CFITSIO's fits_update_key / fits_update_key_fixdbl /
+ * fits_write_key_unit do:
+ * <ul>
+ * <li>The keyword is left justified in columns 1-8, followed by '= '.
+ * <li>String values are enclosed in quotes (embedded quotes are doubled), padded to at least 8 characters and
+ *     truncated to fit the record. Other values are right justified to end in column 30. Floats are written
+ *     with 6 decimal places, logicals as T or F.
+ * <li>If the card has units, they are prepended to the comment as '[units] '.
+ * <li>If there is a comment, the record is padded to column 30, and ' / ' and the comment are appended,
+ *     truncated to fit.
+ * <li>The record is padded with spaces to CCD_FITS_HEADER_CARD_LENGTH characters.
+ * </ul>
+ * @param header The address of the Fits_Header_Struct structure containing the card's strings.
+ * @param card The card to format.
+ * @param record Where to write the record. This must have room for CCD_FITS_HEADER_CARD_LENGTH characters.
+ *        No terminating '\0' is written.
+ * @return The routine returns TRUE on success, and FALSE on failure. On failure, Fits_Header_Error_Number
+ *         and Fits_Header_Error_String should be filled in with suitable values.
+ * @see #CCD_FITS_HEADER_CARD_LENGTH
+ * @see #Fits_Header_Get_String
+ * @see #Fits_Header_Error_Number
+ * @see #Fits_Header_Error_String
+ */
+static int Fits_Header_Format_Card(struct Fits_Header_Struct *header,struct Fits_Header_Card_Struct *card,
+				   char *record)
+{
+	char buff[CCD_FITS_HEADER_CARD_LENGTH+1];
+	char value[CCD_FITS_HEADER_CARD_LENGTH+1];
+	char comment[FITS_HEADER_UNITS_STRING_LENGTH+FITS_HEADER_COMMENT_STRING_LENGTH+3];
+	char *string_value = NULL;
+	char *units = NULL;
+	char *card_comment = NULL;
+	int i,length;
+
+	switch(card->Type)
+	{
+		case FITS_HEADER_TYPE_STRING:
+			/* quoted string, with embedded quotes doubled, at most 68 characters between the quotes */
+			string_value = Fits_Header_Get_String(header,card->Value.String);
+			length = 0;
+			value[length++] = '\'';
+			for(i = 0; (string_value[i] != '\0') && (length < 69); i++)
+			{
+				if(string_value[i] == '\'')
+				{
+					if(length > 67)
+						break;
+					value[length++] = '\'';
+				}
+				value[length++] = string_value[i];
+			}
+			while(length < 9)
+				value[length++] = ' ';
+			value[length++] = '\'';
+			value[length] = '\0';
+			break;
+		case FITS_HEADER_TYPE_INTEGER:
+			sprintf(value,"%20d",card->Value.Int);
+			break;
+		case FITS_HEADER_TYPE_FLOAT:
+			snprintf(buff,sizeof(buff),"%.6f",card->Value.Float);
+			if((strchr(buff,'n') != NULL)||(strchr(buff,'N') != NULL))
+			{
+				Fits_Header_Error_Number = 31;
+				sprintf(Fits_Header_Error_String,"Fits_Header_Format_Card:"
+					"Keyword %s has an illegal float value %s.",card->Keyword,buff);
+				return FALSE;
+			}
+			sprintf(value,"%20.59s",buff);
+			break;
+		case FITS_HEADER_TYPE_LOGICAL:
+			sprintf(value,"%20s",card->Value.Boolean ? "T" : "F");
+			break;
+		default:
+			Fits_Header_Error_Number = 32;
+			sprintf(Fits_Header_Error_String,"Fits_Header_Format_Card:"
+				"Keyword %s has unknown type %d.",card->Keyword,card->Type);
+			return FALSE;
+	}
+	units = Fits_Header_Get_String(header,card->Units);
+	card_comment = Fits_Header_Get_String(header,card->Comment);
+	if(strlen(units) > 0)
+	{
+		if(strlen(card_comment) > 0)
+			sprintf(comment,"[%s] %s",units,card_comment);
+		else
+			sprintf(comment,"[%s]",units);
+	}
+	else
+		strcpy(comment,card_comment);
+	sprintf(buff,"%-8.8s= %.70s",card->Keyword,value);
+	length = strlen(buff);
+	if((strlen(comment) > 0)&&(length < (CCD_FITS_HEADER_CARD_LENGTH-3)))
+	{
+		if(length < 30)
+			length += sprintf(buff+length,"%*s",30-length,"");
+		snprintf(buff+length,sizeof(buff)-length," / %s",comment);
+		length = strlen(buff);
+	}
+	memcpy(record,buff,length);
+	memset(record+length,' ',CCD_FITS_HEADER_CARD_LENGTH-length);
+	return TRUE;
+}
@@ -0,0 +1,708 @@
+/* ccd_fits_writer.c
+** Native FITS image writer, that does not use CFITSIO.
+** $Id$
+*/
+/**
+ * @file
+ * @brief ccd_fits_writer.c contains a FITS image writer that does not use CFITSIO. The header is formatted into
+ *        memory in one pass, the pixels are converted to big endian signed values (with BZERO = 32768) using
+ *        SIMD instructions where the CPU supports them, and the header and data are written with a single writev.
+ *        Each thread saving images formats them into it's own buffers, so several threads can save images at once.
+ * @author Chris Mottram
+ * @version $Id$
+ */
+/**
+ * This hash define is needed before including source files give us POSIX.4/IEEE1003.1b-1993 prototypes.
+ */
+#define _POSIX_SOURCE 1
+/**
+ * This hash define is needed before including source files give us POSIX.4/IEEE1003.1b-1993 prototypes.
+ */
+#define _POSIX_C_SOURCE 199309L
+/**
+ * Define this to enable aligned_alloc in 'stdlib.h'.
+ */
+#define _DEFAULT_SOURCE 1
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "ccd_exposure.h"
+#include "ccd_fits_header.h"
+#include "ccd_fits_writer.h"
+#include "ccd_general.h"
+
+/* hash defines */
+#if defined(__x86_64__) || defined(__i386__)
+/**
+ * Defined if we are compiling for an x86 CPU, and can therefore build the SSE2 and AVX2 pixel conversion kernels.
+ */
+#define FITS_WRITER_X86
+#endif
+/**
+ * The number of mandatory records written before the user's FITS header cards: SIMPLE, BITPIX, NAXIS, NAXIS1,
+ * NAXIS2, EXTEND, the two COMMENT records describing the FITS standard, BZERO and BSCALE.
+ */
+#define FITS_WRITER_MANDATORY_CARD_COUNT (10)
+/**
+ * The alignment, in bytes, of the converted pixel buffer. This is the cache line size, and suitable for
+ * vectorised stores.
+ */
+#define FITS_WRITER_ALIGNMENT            (64)
+/**
+ * Macro to round a length up to the next multiple of alignment.
+ */
+#define FITS_WRITER_ROUND_UP(length,alignment) ((((length)+(alignment)-1)/(alignment))*(alignment))
+
+/* data types */
+/**
+ * Structure holding the memory a thread formats images into before they are written. Each thread saving images
+ * has it's own instance (see Fits_Writer_Buffer_Key), so the images can be formatted and written without holding
+ * a lock. The buffers grow to fit the largest image written by the thread, and are then re-used, so saving a
+ * series of images does not allocate memory.
+ * <dl>
+ * <dt>Header_Block</dt> <dd>The memory the FITS header is formatted into.</dd>
+ * <dt>Header_Block_Length</dt> <dd>The number of bytes allocated to Header_Block.</dd>
+ * <dt>Pixel_Buffer</dt> <dd>The memory the pixels are converted into. The image buffer passed to
+ *     CCD_Fits_Writer_Save is not modified, as it may still be in use by other threads (e.g. being downloaded by
+ *     a client).</dd>
+ * <dt>Pixel_Buffer_Length</dt> <dd>The number of pixels Pixel_Buffer can hold.</dd>
+ * </dl>
+ * @see #Fits_Writer_Buffer_Key
+ */
+struct Fits_Writer_Buffer_Struct
+{
+	char *Header_Block;
+	size_t Header_Block_Length;
+	unsigned short *Pixel_Buffer;
+	size_t Pixel_Buffer_Length;
+};
+
+/* internal data */
+/**
+ * Revision Control System identifier.
+ */
+static char rcsid[] = "$Id$";
+/**
+ * Variable holding error code of last operation performed by the FITS writer.
+ */
+static int Fits_Writer_Error_Number = 0;
+/**
+ * Local variable holding description of the last error that occured.
+ */
+static char Fits_Writer_Error_String[CCD_GENERAL_ERROR_STRING_LENGTH] = "";
+/**
+ * Thread specific data key, holding a pointer to each thread's Fits_Writer_Buffer_Struct. The buffers are
+ * freed by Fits_Writer_Buffer_Free when the thread exits.
+ * @see #Fits_Writer_Buffer_Struct
+ * @see #Fits_Writer_Buffer_Key_Once
+ * @see #Fits_Writer_Buffer_Get
+ */
+static pthread_key_t Fits_Writer_Buffer_Key;
+/**
+ * Used to create Fits_Writer_Buffer_Key once, the first time any thread saves an image.
+ * @see #Fits_Writer_Buffer_Key
+ * @see #Fits_Writer_Buffer_Key_Create
+ */
+static pthread_once_t Fits_Writer_Buffer_Key_Once = PTHREAD_ONCE_INIT;
+/**
+ * The return value of pthread_key_create, when Fits_Writer_Buffer_Key was created.
+ * @see #Fits_Writer_Buffer_Key_Create
+ */
+static int Fits_Writer_Buffer_Key_Retval = 0;
+/**
+ * A FITS block of zeros, used to pad the data unit to a multiple of CCD_FITS_HEADER_BLOCK_LENGTH.
+ * @see #CCD_FITS_HEADER_BLOCK_LENGTH
+ */
+static const char Fits_Writer_Zero_Block[CCD_FITS_HEADER_BLOCK_LENGTH] = {0};
+/**
+ * The COMMENT records describing the FITS standard, that CFITSIO's fits_create_img writes after EXTEND in a
+ * primary header.
+ */
+static const char *Fits_Writer_Comment_List[] =
+{
+	"COMMENT   FITS (Flexible Image Transport System) format is defined in 'Astronomy",
+	"COMMENT   and Astrophysics', volume 376, page 359; bibcode: 2001A&A...376..359H"
+};
+
+/* internal functions */
+static void Fits_Writer_Buffer_Key_Create(void);
+static void Fits_Writer_Buffer_Free(void *buffer_data);
+static int Fits_Writer_Buffer_Get(struct Fits_Writer_Buffer_Struct **buffers);
+static int Fits_Writer_Format_Header(struct Fits_Writer_Buffer_Struct *buffers,struct Fits_Header_Struct header,
+				     int ncols,int nrows,size_t *header_length);
+static void Fits_Writer_Format_Record(char *record,const char *keyword,const char *value,const char *comment);
+static void Fits_Writer_Format_Comment(char *record,const char *comment);
+static int Fits_Writer_Convert_Pixels(struct Fits_Writer_Buffer_Struct *buffers,const unsigned short *input_buffer,
+				      size_t pixel_count);
+static void Fits_Writer_Convert_Pixels_Scalar(const unsigned short *input_buffer,unsigned short *output_buffer,
+					      size_t pixel_count);
+#ifdef FITS_WRITER_X86
+static void Fits_Writer_Convert_Pixels_SSE2(const unsigned short *input_buffer,unsigned short *output_buffer,
+					    size_t pixel_count);
+static void Fits_Writer_Convert_Pixels_AVX2(const unsigned short *input_buffer,unsigned short *output_buffer,
+					    size_t pixel_count);
+#endif
+static int Fits_Writer_Write_Vector(int fd,struct iovec *iov,int iov_count);
+
+/* ----------------------------------------------------------------------------
+** 		external functions
+** ---------------------------------------------------------------------------- */
+/**
+ * Save an image to disk as a FITS file, without using CFITSIO. The file contains a single, primary, HDU with
+ * BITPIX = 16 and BZERO = 32768 (i.e. unsigned short data), and is equivalent to the file CCD_Exposure_Save
+ * writes using CFITSIO, but is much quicker to write.
+ * <ul>
+ * <li>We check the parameters.
+ * <li>We call Fits_Writer_Buffer_Get to get the calling thread's buffers. No lock is held whilst the image is 
+ *     formatted and written, so several threads (e.g. the FITS writer queue's writer threads) can save images
+ *     at the same time.
+ * <li>We call Fits_Writer_Format_Header to format the mandatory records, the records for the cards in header,
+ *     and the END record into the thread's header block, padded to a multiple of CCD_FITS_HEADER_BLOCK_LENGTH.
+ * <li>We call Fits_Writer_Convert_Pixels to convert the pixels into big endian signed values in the thread's
+ *     pixel buffer.
+ * <li>We open (creating or truncating) filename.
+ * <li>We call Fits_Writer_Write_Vector to write the header block, the pixels, and the zero padding to a
+ *     multiple of CCD_FITS_HEADER_BLOCK_LENGTH, with a single writev.
+ * <li>We close the file.
+ * </ul>
+ * Unlike CCD_Exposure_Save, an existing file is always overwritten.
+ * @param filename The name of the file to save the image into.
+ * @param buffer Pointer to a previously allocated array of unsigned shorts containing the image pixel values.
+ *        This is not modified.
+ * @param buffer_length The length of the buffer in pixels. This must be at least ncols*nrows.
+ * @param ncols The number of binned image columns (the X size/width of the image).
+ * @param nrows The number of binned image rows (the Y size/height of the image).
+ * @param header A list of FITS header cards to write to the output filename's FITS header.
+ * @param timeline The address of a timeline, in which the CCD_EXPOSURE_TIMELINE_SAVE_OPEN,
+ *        CCD_EXPOSURE_TIMELINE_SAVE_WRITE and CCD_EXPOSURE_TIMELINE_SAVE_CLOSE phases are time stamped once the file
+ *        has been opened, written and closed. This can be NULL.
+ * @return Returns TRUE on success, and FALSE if an error occurs.
+ * @see #Fits_Writer_Buffer_Struct
+ * @see #Fits_Writer_Buffer_Get
+ * @see #Fits_Writer_Zero_Block
+ * @see #Fits_Writer_Format_Header
+ * @see #Fits_Writer_Convert_Pixels
+ * @see #Fits_Writer_Write_Vector
+ * @see #Fits_Writer_Error_Number
+ * @see #Fits_Writer_Error_String
+ * @see CCD_General_Log
+ * @see CCD_Exposure_Timeline_Mark
+ */
+int CCD_Fits_Writer_Save(char *filename,void *buffer,size_t buffer_length,int ncols,int nrows,
+			 struct Fits_Header_Struct header,struct CCD_Exposure_Timeline_Struct *timeline)
+{
+	struct Fits_Writer_Buffer_Struct *buffers = NULL;
+	struct iovec iov[3];
+	size_t header_length,pixel_count,data_length;
+	int fd;
+
+#if LOGGING > 5
+	CCD_General_Log_Format("ccd","ccd_fits_writer.c","CCD_Fits_Writer_Save",LOG_VERBOSITY_INTERMEDIATE,"FITS",
+			       "Saving to '%s', buffer of length %lu with dimensions %d x %d.",filename,
+			       (unsigned long)buffer_length,ncols,nrows);
+#endif
+	Fits_Writer_Error_Number = 0;
+	if(filename == NULL)
+	{
+		Fits_Writer_Error_Number = 1;
+		sprintf(Fits_Writer_Error_String,"CCD_Fits_Writer_Save: filename was NULL.");
+		return FALSE;
+	}
+	if(buffer == NULL)
+	{
+		Fits_Writer_Error_Number = 2;
+		sprintf(Fits_Writer_Error_String,"CCD_Fits_Writer_Save: buffer was NULL.");
+		return FALSE;
+	}
+	if((ncols < 1)||(nrows < 1))
+	{
+		Fits_Writer_Error_Number = 3;
+		sprintf(Fits_Writer_Error_String,"CCD_Fits_Writer_Save: Illegal image dimensions %d x %d.",ncols,nrows);
+		return FALSE;
+	}
+	pixel_count = ((size_t)ncols)*((size_t)nrows);
+	if(buffer_length < pixel_count)
+	{
+		Fits_Writer_Error_Number = 4;
+		sprintf(Fits_Writer_Error_String,"CCD_Fits_Writer_Save: buffer length %lu is less than %d x %d.",
+			(unsigned long)buffer_length,ncols,nrows);
+		return FALSE;
+	}
+	data_length = pixel_count*sizeof(unsigned short);
+	if(!Fits_Writer_Buffer_Get(&buffers))
+		return FALSE;
+	if(!Fits_Writer_Format_Header(buffers,header,ncols,nrows,&header_length))
+		return FALSE;
+	if(!Fits_Writer_Convert_Pixels(buffers,(const unsigned short *)buffer,pixel_count))
+		return FALSE;
+	fd = open(filename,O_WRONLY|O_CREAT|O_TRUNC,S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP|S_IROTH);
+	if(fd < 0)
+	{
+		Fits_Writer_Error_Number = 5;
+		sprintf(Fits_Writer_Error_String,"CCD_Fits_Writer_Save: Failed to open '%s' (%d,%s).",filename,
+			errno,strerror(errno));
+		return FALSE;
+	}
+	CCD_Exposure_Timeline_Mark(timeline,CCD_EXPOSURE_TIMELINE_SAVE_OPEN);
+	iov[0].iov_base = buffers->Header_Block;
+	iov[0].iov_len = header_length;
+	iov[1].iov_base = buffers->Pixel_Buffer;
+	iov[1].iov_len = data_length;
+	iov[2].iov_base = (void *)Fits_Writer_Zero_Block;
+	iov[2].iov_len = FITS_WRITER_ROUND_UP(data_length,CCD_FITS_HEADER_BLOCK_LENGTH)-data_length;
+	if(!Fits_Writer_Write_Vector(fd,iov,3))
+	{
+		close(fd);
+		sprintf(Fits_Writer_Error_String+strlen(Fits_Writer_Error_String)," Filename '%s'.",filename);
+		return FALSE;
+	}
+	CCD_Exposure_Timeline_Mark(timeline,CCD_EXPOSURE_TIMELINE_SAVE_WRITE);
+	if(close(fd) != 0)
+	{
+		Fits_Writer_Error_Number = 6;
+		sprintf(Fits_Writer_Error_String,"CCD_Fits_Writer_Save: Failed to close '%s' (%d,%s).",filename,
+			errno,strerror(errno));
+		return FALSE;
+	}
+	CCD_Exposure_Timeline_Mark(timeline,CCD_EXPOSURE_TIMELINE_SAVE_CLOSE);
+#if LOGGING > 5
+	CCD_General_Log("ccd","ccd_fits_writer.c","CCD_Fits_Writer_Save",LOG_VERBOSITY_INTERMEDIATE,"FITS",
+			"finished.");
+#endif
+	return TRUE;
+}
+
+/**
+ * Get the current value of the FITS writer's error number.
+ * @return The current value of the FITS writer's error number.
+ * @see #Fits_Writer_Error_Number
+ */
+int CCD_Fits_Writer_Get_Error_Number(void)
+{
+	return Fits_Writer_Error_Number;
+}
+
+/**
+ * The error routine that reports any errors occuring in the FITS writer in a standard way.
+ * @see #Fits_Writer_Error_Number
+ * @see #Fits_Writer_Error_String
+ * @see CCD_General_Get_Current_Time_String
+ */
+void CCD_Fits_Writer_Error(void)
+{
+	char time_string[32];
+
+	CCD_General_Get_Current_Time_String(time_string,32);
+	/* if the error number is zero an error message has not been set up
+	** This is in itself an error as we should not be calling this routine
+	** without there being an error to display */
+	if(Fits_Writer_Error_Number == 0)
+		sprintf(Fits_Writer_Error_String,"Logic Error:No Error defined");
+	fprintf(stderr,"%s CCD_Fits_Writer:Error(%d) : %s\n",time_string,Fits_Writer_Error_Number,
+		Fits_Writer_Error_String);
+}
+
+/**
+ * The error routine that reports any errors occuring in the FITS writer in a standard way. This routine places
+ * the generated error string at the end of a passed in string argument.
+ * @param error_string A string to put the generated error in. This string should be initialised before
+ *        being passed to this routine. The routine will try to concatenate it's error string onto the end
+ *        of any string already in existance.
+ * @see #Fits_Writer_Error_Number
+ * @see #Fits_Writer_Error_String
+ * @see CCD_General_Get_Current_Time_String
+ */
+void CCD_Fits_Writer_Error_String(char *error_string)
+{
+	char time_string[32];
+
+	CCD_General_Get_Current_Time_String(time_string,32);
+	/* if the error number is zero an error message has not been set up
+	** This is in itself an error as we should not be calling this routine
+	** without there being an error to display */
+	if(Fits_Writer_Error_Number == 0)
+		sprintf(Fits_Writer_Error_String,"Logic Error:No Error defined");
+	sprintf(error_string+strlen(error_string),"%s CCD_Fits_Writer:Error(%d) : %s\n",time_string,
+		Fits_Writer_Error_Number,Fits_Writer_Error_String);
+}
+
+/* ----------------------------------------------------------------------------
+** 		internal functions
+** ---------------------------------------------------------------------------- */
+/**
+ * Create Fits_Writer_Buffer_Key, with Fits_Writer_Buffer_Free as it's destructor. Called once, using
+ * Fits_Writer_Buffer_Key_Once, from Fits_Writer_Buffer_Get. The pthread_key_create return value is saved in
+ * Fits_Writer_Buffer_Key_Retval.
+ * @see #Fits_Writer_Buffer_Key
+ * @see #Fits_Writer_Buffer_Key_Once
+ * @see #Fits_Writer_Buffer_Key_Retval
+ * @see #Fits_Writer_Buffer_Free
+ */
+static void Fits_Writer_Buffer_Key_Create(void)
+{
+	Fits_Writer_Buffer_Key_Retval = pthread_key_create(&Fits_Writer_Buffer_Key,Fits_Writer_Buffer_Free);
+}
+
+/**
+ * Free a thread's Fits_Writer_Buffer_Struct, and the buffers it holds. Called by the pthread library when a thread
+ * that has saved an image exits.
+ * @param buffer_data A pointer to the thread's Fits_Writer_Buffer_Struct.
+ * @see #Fits_Writer_Buffer_Struct
+ * @see #Fits_Writer_Buffer_Key_Create
+ */
+static void Fits_Writer_Buffer_Free(void *buffer_data)
+{
+	struct Fits_Writer_Buffer_Struct *buffers = (struct Fits_Writer_Buffer_Struct *)buffer_data;
+
+	if(buffers == NULL)
+		return;
+	if(buffers->Header_Block != NULL)
+		free(buffers->Header_Block);
+	if(buffers->Pixel_Buffer != NULL)
+		free(buffers->Pixel_Buffer);
+	free(buffers);
+}
+
+/**
+ * Get the calling thread's buffers. The first time a thread calls this routine, an empty
+ * Fits_Writer_Buffer_Struct is allocated and stored against Fits_Writer_Buffer_Key. The buffers themselves are
+ * allocated (and grown) by Fits_Writer_Format_Header and Fits_Writer_Convert_Pixels.
+ * @param buffers The address of a pointer, on success filled in with the calling thread's buffers.
+ * @return The routine returns TRUE on success, and FALSE if an error occurs.
+ * @see #Fits_Writer_Buffer_Struct
+ * @see #Fits_Writer_Buffer_Key
+ * @see #Fits_Writer_Buffer_Key_Once
+ * @see #Fits_Writer_Buffer_Key_Create
+ */
+static int Fits_Writer_Buffer_Get(struct Fits_Writer_Buffer_Struct **buffers)
+{
+	struct Fits_Writer_Buffer_Struct *thread_buffers = NULL;
+	int retval;
+
+	pthread_once(&Fits_Writer_Buffer_Key_Once,Fits_Writer_Buffer_Key_Create);
+	if(Fits_Writer_Buffer_Key_Retval != 0)
+	{
+		Fits_Writer_Error_Number = 11;
+		sprintf(Fits_Writer_Error_String,"Fits_Writer_Buffer_Get:Failed to create buffer key (%d).",
+			Fits_Writer_Buffer_Key_Retval);
+		return FALSE;
+	}
+	thread_buffers = (struct Fits_Writer_Buffer_Struct *)pthread_getspecific(Fits_Writer_Buffer_Key);
+	if(thread_buffers == NULL)
+	{
+		thread_buffers = (struct Fits_Writer_Buffer_Struct *)calloc(1,sizeof(struct Fits_Writer_Buffer_Struct));
+		if(thread_buffers == NULL)
+		{
+			Fits_Writer_Error_Number = 12;
+			sprintf(Fits_Writer_Error_String,"Fits_Writer_Buffer_Get:Failed to allocate buffers.");
+			return FALSE;
+		}
+		retval = pthread_setspecific(Fits_Writer_Buffer_Key,thread_buffers);
+		if(retval != 0)
+		{
+			free(thread_buffers);
+			Fits_Writer_Error_Number = 13;
+			sprintf(Fits_Writer_Error_String,"Fits_Writer_Buffer_Get:Failed to set buffers (%d).",retval);
+			return FALSE;
+		}
+	}
+	(*buffers) = thread_buffers;
+	return TRUE;
+}
+
+/**
+ * Format the FITS header into the thread's header block (growing it if necessary). We write the mandatory
+ * records (using Fits_Writer_Format_Record and Fits_Writer_Format_Comment) with the same values and comments, in
+ * the same order, as CCD_Exposure_Save's CFITSIO fits_create_img call, then the cards in header 
+ * (using CCD_Fits_Header_Write_To_Block), then the END record, and pad the block with spaces to a multiple of
+ * CCD_FITS_HEADER_BLOCK_LENGTH.
+ * @param buffers The calling thread's buffers.
+ * @param header A list of FITS header cards to write.
+ * @param ncols The number of image columns (NAXIS1).
+ * @param nrows The number of image rows (NAXIS2).
+ * @param header_length The address of a size_t, on success filled in with the number of bytes of
+ *        the header block to write.
+ * @return The routine returns TRUE on success, and FALSE if an error occurs.
+ * @see #FITS_WRITER_MANDATORY_CARD_COUNT
+ * @see #Fits_Writer_Buffer_Struct
+ * @see #Fits_Writer_Comment_List
+ * @see #Fits_Writer_Format_Record
+ * @see #Fits_Writer_Format_Comment
+ * @see CCD_Fits_Header_Write_To_Block
+ */
+static int Fits_Writer_Format_Header(struct Fits_Writer_Buffer_Struct *buffers,struct Fits_Header_Struct header,
+				     int ncols,int nrows,size_t *header_length)
+{
+	char *new_block = NULL;
+	char *record = NULL;
+	char value[32];
+	size_t length;
+
+	length = FITS_WRITER_ROUND_UP(((size_t)(FITS_WRITER_MANDATORY_CARD_COUNT+header.Card_Count+1))*
+				      CCD_FITS_HEADER_CARD_LENGTH,CCD_FITS_HEADER_BLOCK_LENGTH);
+	if(length > buffers->Header_Block_Length)
+	{
+		new_block = (char *)realloc(buffers->Header_Block,length);
+		if(new_block == NULL)
+		{
+			Fits_Writer_Error_Number = 7;
+			sprintf(Fits_Writer_Error_String,"Fits_Writer_Format_Header: Failed to allocate header block "
+				"of length %lu.",(unsigned long)length);
+			return FALSE;
+		}
+		buffers->Header_Block = new_block;
+		buffers->Header_Block_Length = length;
+	}
+	record = buffers->Header_Block;
+	Fits_Writer_Format_Record(record,"SIMPLE","T","file does conform to FITS standard");
+	record += CCD_FITS_HEADER_CARD_LENGTH;
+	Fits_Writer_Format_Record(record,"BITPIX","16","number of bits per data pixel");
+	record += CCD_FITS_HEADER_CARD_LENGTH;
+	Fits_Writer_Format_Record(record,"NAXIS","2","number of data axes");
+	record += CCD_FITS_HEADER_CARD_LENGTH;
+	sprintf(value,"%d",ncols);
+	Fits_Writer_Format_Record(record,"NAXIS1",value,"length of data axis 1");
+	record += CCD_FITS_HEADER_CARD_LENGTH;
+	sprintf(value,"%d",nrows);
+	Fits_Writer_Format_Record(record,"NAXIS2",value,"length of data axis 2");
+	record += CCD_FITS_HEADER_CARD_LENGTH;
+	Fits_Writer_Format_Record(record,"EXTEND","T","FITS dataset may contain extensions");
+	record += CCD_FITS_HEADER_CARD_LENGTH;
+	Fits_Writer_Format_Comment(record,Fits_Writer_Comment_List[0]);
+	record += CCD_FITS_HEADER_CARD_LENGTH;
+	Fits_Writer_Format_Comment(record,Fits_Writer_Comment_List[1]);
+	record += CCD_FITS_HEADER_CARD_LENGTH;
+	Fits_Writer_Format_Record(record,"BZERO","32768","offset data range to that of unsigned short");
+	record += CCD_FITS_HEADER_CARD_LENGTH;
+	Fits_Writer_Format_Record(record,"BSCALE","1","default scaling factor");
+	record += CCD_FITS_HEADER_CARD_LENGTH;
+	if(!CCD_Fits_Header_Write_To_Block(header,record,
+				 length-(FITS_WRITER_MANDATORY_CARD_COUNT*CCD_FITS_HEADER_CARD_LENGTH)))
+	{
+		Fits_Writer_Error_Number = 8;
+		sprintf(Fits_Writer_Error_String,"Fits_Writer_Format_Header: Failed to format %d FITS header cards.",
+			header.Card_Count);
+		return FALSE;
+	}
+	record += ((size_t)header.Card_Count)*CCD_FITS_HEADER_CARD_LENGTH;
+	/* END record, then pad the rest of the block with spaces */
+	memset(record,' ',(buffers->Header_Block+length)-record);
+	memcpy(record,"END",3);
+	(*header_length) = length;
+	return TRUE;
+}
+
+/**
+ * Format a mandatory FITS header record. The value is right justified to end in column 30, followed by the comment.
+ * The record is padded with spaces to CCD_FITS_HEADER_CARD_LENGTH characters, with no terminating '\\0'.
+ * @param record Where to write the record.
+ * @param keyword The keyword, at most 8 characters.
+ * @param value The value, at most 20 characters.
+ * @param comment The comment, at most 47 characters.
+ * @see #CCD_FITS_HEADER_CARD_LENGTH
+ */
+static void Fits_Writer_Format_Record(char *record,const char *keyword,const char *value,const char *comment)
+{
+	char buff[CCD_FITS_HEADER_CARD_LENGTH+1];
+
+	sprintf(buff,"%-8.8s= %20.20s / %-47.47s",keyword,value,comment);
+	memcpy(record,buff,CCD_FITS_HEADER_CARD_LENGTH);
+}
+
+/**
+ * Format a complete commentary record. The record is padded with spaces to CCD_FITS_HEADER_CARD_LENGTH characters,
+ * with no terminating '\\0'.
+ * @param record Where to write the record.
+ * @param comment The whole record, including the COMMENT keyword, at most CCD_FITS_HEADER_CARD_LENGTH characters.
+ * @see #CCD_FITS_HEADER_CARD_LENGTH
+ */
+static void Fits_Writer_Format_Comment(char *record,const char *comment)
+{
+	size_t length;
+
+	length = strlen(comment);
+	if(length > CCD_FITS_HEADER_CARD_LENGTH)
+		length = CCD_FITS_HEADER_CARD_LENGTH;
+	memset(record,' ',CCD_FITS_HEADER_CARD_LENGTH);
+	memcpy(record,comment,length);
+}
+
+/**
+ * Convert the pixels into the thread's pixel buffer (growing it if necessary), as big endian signed 16 bit values
+ * with BZERO = 32768. We use the AVX2 kernel if the CPU supports it, otherwise the SSE2 kernel if the CPU
+ * supports it, otherwise the scalar kernel.
+ * @param buffers The calling thread's buffers.
+ * @param input_buffer The image pixels, as native unsigned shorts.
+ * @param pixel_count The number of pixels to convert.
+ * @return The routine returns TRUE on success, and FALSE if an error occurs.
+ * @see #Fits_Writer_Buffer_Struct
+ * @see #FITS_WRITER_ALIGNMENT
+ * @see #Fits_Writer_Convert_Pixels_Scalar
+ * @see #Fits_Writer_Convert_Pixels_SSE2
+ * @see #Fits_Writer_Convert_Pixels_AVX2
+ */
+static int Fits_Writer_Convert_Pixels(struct Fits_Writer_Buffer_Struct *buffers,const unsigned short *input_buffer,
+				      size_t pixel_count)
+{
+	unsigned short *new_buffer = NULL;
+
+	if(pixel_count > buffers->Pixel_Buffer_Length)
+	{
+		new_buffer = (unsigned short *)aligned_alloc(FITS_WRITER_ALIGNMENT,
+				     FITS_WRITER_ROUND_UP(pixel_count*sizeof(unsigned short),FITS_WRITER_ALIGNMENT));
+		if(new_buffer == NULL)
+		{
+			Fits_Writer_Error_Number = 9;
+			sprintf(Fits_Writer_Error_String,"Fits_Writer_Convert_Pixels: Failed to allocate pixel buffer "
+				"of length %lu pixels.",(unsigned long)pixel_count);
+			return FALSE;
+		}
+		if(buffers->Pixel_Buffer != NULL)
+			free(buffers->Pixel_Buffer);
+		buffers->Pixel_Buffer = new_buffer;
+		buffers->Pixel_Buffer_Length = pixel_count;
+	}
+#ifdef FITS_WRITER_X86
+	if(__builtin_cpu_supports("avx2"))
+		Fits_Writer_Convert_Pixels_AVX2(input_buffer,buffers->Pixel_Buffer,pixel_count);
+	else if(__builtin_cpu_supports("sse2"))
+		Fits_Writer_Convert_Pixels_SSE2(input_buffer,buffers->Pixel_Buffer,pixel_count);
+	else
+		Fits_Writer_Convert_Pixels_Scalar(input_buffer,buffers->Pixel_Buffer,pixel_count);
+#else
+	Fits_Writer_Convert_Pixels_Scalar(input_buffer,buffers->Pixel_Buffer,pixel_count);
+#endif
+	return TRUE;
+}
+
+/**
+ * Convert unsigned short pixels into big endian signed values with BZERO = 32768, one pixel at a time.
+ * Subtracting 32768 from an unsigned short is the same as flipping it's top bit, we then swap the bytes on a little
+ * endian host. On a big endian host the pixels are already in FITS byte order, so only the top bit is flipped.
+ * This is also used for the pixels left over after the SIMD kernels.
+ * @param input_buffer The pixels to convert.
+ * @param output_buffer Where to write the converted pixels.
+ * @param pixel_count The number of pixels to convert.
+ */
+static void Fits_Writer_Convert_Pixels_Scalar(const unsigned short *input_buffer,unsigned short *output_buffer,
+					      size_t pixel_count)
+{
+	unsigned short value;
+	size_t i;
+
+	for(i = 0; i < pixel_count; i++)
+	{
+		value = input_buffer[i]^0x8000;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		output_buffer[i] = (unsigned short)((value << 8)|(value >> 8));
+#else
+		output_buffer[i] = value;
+#endif
+	}
+}
+
+#ifdef FITS_WRITER_X86
+/**
+ * Convert unsigned short pixels into big endian signed values with BZERO = 32768, 8 pixels at a time using SSE2.
+ * The bytes are swapped using 16 bit shifts, as SSE2 has no byte shuffle.
+ * @param input_buffer The pixels to convert.
+ * @param output_buffer Where to write the converted pixels.
+ * @param pixel_count The number of pixels to convert.
+ * @see #Fits_Writer_Convert_Pixels_Scalar
+ */
+static __attribute__((target("sse2"))) void Fits_Writer_Convert_Pixels_SSE2(const unsigned short *input_buffer,
+									    unsigned short *output_buffer,
+									    size_t pixel_count)
+{
+	__m128i offset,value;
+	size_t i;
+
+	offset = _mm_set1_epi16((short)0x8000);
+	for(i = 0; (i+8) <= pixel_count; i += 8)
+	{
+		value = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(input_buffer+i)),offset);
+		value = _mm_or_si128(_mm_slli_epi16(value,8),_mm_srli_epi16(value,8));
+		_mm_storeu_si128((__m128i *)(output_buffer+i),value);
+	}
+	Fits_Writer_Convert_Pixels_Scalar(input_buffer+i,output_buffer+i,pixel_count-i);
+}
+
+/**
+ * Convert unsigned short pixels into big endian signed values with BZERO = 32768, 16 pixels at a time using AVX2.
+ * @param input_buffer The pixels to convert.
+ * @param output_buffer Where to write the converted pixels.
+ * @param pixel_count The number of pixels to convert.
+ * @see #Fits_Writer_Convert_Pixels_Scalar
+ */
+static __attribute__((target("avx2"))) void Fits_Writer_Convert_Pixels_AVX2(const unsigned short *input_buffer,
+									    unsigned short *output_buffer,
+									    size_t pixel_count)
+{
+	__m256i offset,swap,value;
+	size_t i;
+
+	offset = _mm256_set1_epi16((short)0x8000);
+	swap = _mm256_setr_epi8(1,0,3,2,5,4,7,6,9,8,11,10,13,12,15,14,1,0,3,2,5,4,7,6,9,8,11,10,13,12,15,14);
+	for(i = 0; (i+16) <= pixel_count; i += 16)
+	{
+		value = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(input_buffer+i)),offset);
+		value = _mm256_shuffle_epi8(value,swap);
+		_mm256_storeu_si256((__m256i *)(output_buffer+i),value);
+	}
+	Fits_Writer_Convert_Pixels_Scalar(input_buffer+i,output_buffer+i,pixel_count-i);
+}
+#endif
+
+/**
+ * Write a vector of buffers to a file descriptor using writev, retrying after partial writes and interrupts
+ * until all the data has been written. The iov array is modified.
+ * @param fd The file descriptor to write to.
+ * @param iov The array of buffers to write.
+ * @param iov_count The number of buffers in iov.
+ * @return The routine returns TRUE on success, and FALSE if an error occurs.
+ * @see #Fits_Writer_Error_Number
+ * @see #Fits_Writer_Error_String
+ */
+static int Fits_Writer_Write_Vector(int fd,struct iovec *iov,int iov_count)
+{
+	ssize_t written_length;
+
+	while(iov_count > 0)
+	{
+		written_length = writev(fd,iov,iov_count);
+		if(written_length < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			Fits_Writer_Error_Number = 10;
+			sprintf(Fits_Writer_Error_String,"Fits_Writer_Write_Vector: writev failed (%d,%s).",errno,
+				strerror(errno));
+			return FALSE;
+		}
+		/* skip the buffers (and part of a buffer) that have been written */
+		while((iov_count > 0)&&(((size_t)written_length) >= iov[0].iov_len))
+		{
+			written_length -= iov[0].iov_len;
+			iov++;
+			iov_count--;
+		}
+		if(iov_count > 0)
+		{
+			iov[0].iov_base = ((char *)iov[0].iov_base)+written_length;
+			iov[0].iov_len -= written_length;
+		}
+	}
+	return TRUE;
+}
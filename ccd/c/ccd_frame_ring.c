@@ -0,0 +1,908 @@
+/* ccd_frame_ring.c
+** CCD shared memory frame ring routines
+** $Id$
+*/
+/**
+ * @file
+ * @brief Routines to publish read out frames into a POSIX shared memory ring of frame slots, and to read them
+ *        back from co-located consumer processes. Each slot is protected by a sequence lock (generation counter):
+ *        the writer makes the generation odd whilst it is updating the slot and even again when it has finished,
+ *        so readers never block the writer and can detect (and retry) a torn read. The sequence locks only support
+ *        one writer: if more than one thread writes to a ring (CCD_Frame_Ring_Publish / CCD_Frame_Ring_Filename_Set),
+ *        the caller must serialise the calls.
+ * @author Chris Mottram
+ * @version $Id$
+ */
+/**
+ * This hash define is needed before including source files give us POSIX.4/IEEE1003.1b-1993 prototypes.
+ */
+#define _POSIX_SOURCE 1
+/**
+ * This hash define is needed before including source files give us POSIX shm_open/ftruncate prototypes.
+ */
+#define _POSIX_C_SOURCE 200112L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _POSIX_TIMERS
+#include <sys/time.h>
+#endif
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ccd_frame_ring.h"
+#include "ccd_general.h"
+
+/* hash defines */
+/**
+ * The alignment, in bytes, of the slot headers and pixel data within the shared memory segment.
+ * This is a cache line, so the generation counters of adjacent slots do not share a line.
+ */
+#define FRAME_RING_ALIGNMENT          (64)
+/**
+ * The number of times CCD_Frame_Ring_Read / CCD_Frame_Ring_Frame_Map retry reading a slot that
+ * the writer is updating, before giving up.
+ */
+#define FRAME_RING_READ_RETRY_COUNT   (1000)
+/**
+ * Macro to round a length up to the next multiple of FRAME_RING_ALIGNMENT.
+ * @see #FRAME_RING_ALIGNMENT
+ */
+#define FRAME_RING_ALIGN(l)           ((((l)+FRAME_RING_ALIGNMENT-1)/FRAME_RING_ALIGNMENT)*FRAME_RING_ALIGNMENT)
+
+/* structure declarations */
+/**
+ * The header at the start of the shared memory segment, describing the layout of the slots that follow it.
+ * <dl>
+ * <dt>Magic</dt> <dd>Set to CCD_FRAME_RING_MAGIC once the segment has been initialised.</dd>
+ * <dt>Version</dt> <dd>The layout version, CCD_FRAME_RING_VERSION.</dd>
+ * <dt>Slot_Count</dt> <dd>The number of frame slots in the ring.</dd>
+ * <dt>Slot_Pixel_Count</dt> <dd>The maximum number of pixels each slot can hold.</dd>
+ * <dt>Slot_Offset</dt> <dd>The offset in bytes from the start of the segment of the first slot.</dd>
+ * <dt>Slot_Stride</dt> <dd>The length in bytes of each slot (slot header plus pixel data).</dd>
+ * <dt>Slot_Data_Offset</dt> <dd>The offset in bytes from the start of a slot to it's pixel data.</dd>
+ * <dt>Latest_Sequence_Number</dt> <dd>The sequence number of the last completely published frame,
+ *     or zero if no frame has been published yet.</dd>
+ * </dl>
+ * @see #CCD_FRAME_RING_MAGIC
+ * @see #CCD_FRAME_RING_VERSION
+ */
+struct Frame_Ring_Header_Struct
+{
+	uint32_t Magic;
+	uint32_t Version;
+	uint32_t Slot_Count;
+	uint32_t Padding;
+	uint64_t Slot_Pixel_Count;
+	uint64_t Slot_Offset;
+	uint64_t Slot_Stride;
+	uint64_t Slot_Data_Offset;
+	int64_t Latest_Sequence_Number;
+};
+
+/**
+ * The header at the start of each slot in the ring.
+ * <dl>
+ * <dt>Generation</dt> <dd>The sequence lock protecting Pixel_Count, Frame (apart from the filename) and the pixel
+ *     data. It is odd whilst the writer is updating the slot.</dd>
+ * <dt>Filename_Generation</dt> <dd>A second sequence lock protecting Frame.Filename, which is filled in
+ *     after the frame has been saved to disk. This means setting the filename does not invalidate
+ *     readers that have mapped the pixel data.</dd>
+ * <dt>Pixel_Count</dt> <dd>The number of pixels in the frame.</dd>
+ * <dt>Frame</dt> <dd>The frame's metadata.</dd>
+ * </dl>
+ * @see #CCD_Frame_Ring_Frame_Struct
+ */
+struct Frame_Ring_Slot_Header_Struct
+{
+	uint64_t Generation;
+	uint64_t Filename_Generation;
+	uint64_t Pixel_Count;
+	struct CCD_Frame_Ring_Frame_Struct Frame;
+};
+
+/* internal data */
+/**
+ * Revision Control System identifier.
+ */
+static char rcsid[] = "$Id$";
+/**
+ * Variable holding error code of last operation performed by the frame ring routines.
+ */
+static int Frame_Ring_Error_Number = 0;
+/**
+ * Local variable holding description of the last error that occured.
+ */
+static char Frame_Ring_Error_String[CCD_GENERAL_ERROR_STRING_LENGTH] = "";
+
+/* internal functions */
+static int Frame_Ring_Check(struct CCD_Frame_Ring_Struct *ring,char *function_name);
+static struct Frame_Ring_Slot_Header_Struct *Frame_Ring_Slot_Get(struct CCD_Frame_Ring_Struct *ring,
+								  int64_t sequence_number);
+static void Frame_Ring_Filename_Get(struct Frame_Ring_Slot_Header_Struct *slot,char *filename);
+
+/* ----------------------------------------------------------------------------
+** 		external functions
+** ---------------------------------------------------------------------------- */
+/**
+ * Initialise a frame ring handle to a known (unattached) state. This should be called on a handle
+ * before CCD_Frame_Ring_Create or CCD_Frame_Ring_Open are called on it.
+ * @param ring The address of the handle to initialise.
+ * @see #CCD_Frame_Ring_Struct
+ */
+void CCD_Frame_Ring_Initialise(struct CCD_Frame_Ring_Struct *ring)
+{
+	if(ring == NULL)
+		return;
+	strcpy(ring->Name,"");
+	ring->Fd = -1;
+	ring->Memory = NULL;
+	ring->Memory_Length = 0;
+	ring->Is_Writer = FALSE;
+}
+
+/**
+ * Create (or re-create) the shared memory segment for a frame ring, size it to hold slot_count frames of
+ * up to slot_pixel_count pixels, map it and initialise the ring header. The handle is then able to publish
+ * frames. Any previous segment with the same name is removed first, so stale frames from a previous
+ * run of the server are never returned to readers.
+ * @param ring The address of a handle, previously initialised with CCD_Frame_Ring_Initialise.
+ * @param name The name of the POSIX shared memory segment, which should start with a '/'.
+ * @param slot_count The number of frame slots in the ring, which must be at least 1.
+ * @param slot_pixel_count The maximum number of pixels in a frame, normally the unbinned size of the CCD.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #FRAME_RING_ALIGN
+ * @see #Frame_Ring_Header_Struct
+ * @see #Frame_Ring_Slot_Header_Struct
+ * @see #CCD_FRAME_RING_MAGIC
+ * @see #CCD_FRAME_RING_VERSION
+ */
+int CCD_Frame_Ring_Create(struct CCD_Frame_Ring_Struct *ring,const char *name,int slot_count,
+			  size_t slot_pixel_count)
+{
+	struct Frame_Ring_Header_Struct *header = NULL;
+	struct Frame_Ring_Slot_Header_Struct *slot = NULL;
+	size_t slot_offset,slot_data_offset,slot_stride,memory_length;
+	int i,open_errno;
+
+	Frame_Ring_Error_Number = 0;
+	if(ring == NULL)
+	{
+		Frame_Ring_Error_Number = 1;
+		sprintf(Frame_Ring_Error_String,"CCD_Frame_Ring_Create:ring was NULL.");
+		return FALSE;
+	}
+	if(name == NULL)
+	{
+		Frame_Ring_Error_Number = 2;
+		sprintf(Frame_Ring_Error_String,"CCD_Frame_Ring_Create:name was NULL.");
+		return FALSE;
+	}
+	if(strlen(name) >= CCD_FRAME_RING_NAME_LENGTH)
+	{
+		Frame_Ring_Error_Number = 3;
+		sprintf(Frame_Ring_Error_String,"CCD_Frame_Ring_Create:name was too long(%lu).",
+			(unsigned long)strlen(name));
+		return FALSE;
+	}
+	if((slot_count < 1)||(slot_pixel_count < 1))
+	{
+		Frame_Ring_Error_Number = 4;
+		sprintf(Frame_Ring_Error_String,"CCD_Frame_Ring_Create:Illegal slot count %d or slot pixel count %lu.",
+			slot_count,(unsigned long)slot_pixel_count);
+		return FALSE;
+	}
+#if LOGGING > 1
+	CCD_General_Log_Format("ccd","ccd_frame_ring.c","CCD_Frame_Ring_Create",LOG_VERBOSITY_TERSE,"FRAMERING",
+			       "Creating frame ring %s with %d slots of %lu pixels.",name,slot_count,
+			       (unsigned long)slot_pixel_count);
+#endif
+	slot_offset = FRAME_RING_ALIGN(sizeof(struct Frame_Ring_Header_Struct));
+	slot_data_offset = FRAME_RING_ALIGN(sizeof(struct Frame_Ring_Slot_Header_Struct));
+	slot_stride = FRAME_RING_ALIGN(slot_data_offset+(slot_pixel_count*sizeof(unsigned short)));
+	memory_length = slot_offset+(slot_count*slot_stride);
+	/* remove any stale segment, so readers attached to it see the old (unchanging) frames, and new readers
+	** attach to the new segment. */
+	shm_unlink(name);
+	ring->Fd = shm_open(name,O_CREAT|O_EXCL|O_RDWR,S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
+	if(ring->Fd == -1)
+	{
+		open_errno = errno;
+		Frame_Ring_Error_Number = 5;
+		sprintf(Frame_Ring_Error_String,"CCD_Frame_Ring_Create:shm_open(%s) failed:%d (%s).",name,
+			open_errno,strerror(open_errno));
+		return FALSE;
+	}
+	if(ftruncate(ring->Fd,memory_length) == -1)
+	{
+		open_errno = errno;
+		close(ring->Fd);
+		ring->Fd = -1;
+		shm_unlink(name);
+		Frame_Ring_Error_Number = 6;
+		sprintf(Frame_Ring_Error_String,"CCD_Frame_Ring_Create:ftruncate(%s,%lu) failed:%d (%s).",name,
+			(unsigned long)memory_length,open_errno,strerror(open_errno));
+		return FALSE;
+	}
+	ring->Memory = mmap(NULL,memory_length,PROT_READ|PROT_WRITE,MAP_SHARED,ring->Fd,0);
+	if(ring->Memory == MAP_FAILED)
+	{
+		open_errno = errno;
+		close(ring->Fd);
+		ring->Fd = -1;
+		ring->Memory = NULL;
+		shm_unlink(name);
+		Frame_Ring_Error_Number = 7;
+		sprintf(Frame_Ring_Error_String,"CCD_Frame_Ring_Create:mmap(%s,%lu) failed:%d (%s).",name,
+			(unsigned long)memory_length,open_errno,strerror(open_errno));
+		return FALSE;
+	}
+	strcpy(ring->Name,name);
+	ring->Memory_Length = memory_length;
+	ring->Is_Writer = TRUE;
+	/* initialise header. The segment is zero filled by ftruncate, so all slot generations start at 0 and
+	** all sequence numbers start at 0 (no frame). */
+	header = (struct Frame_Ring_Header_Struct *)(ring->Memory);
+	header->Version = CCD_FRAME_RING_VERSION;
+	header->Slot_Count = slot_count;
+	header->Padding = 0;
+	header->Slot_Pixel_Count = slot_pixel_count;
+	header->Slot_Offset = slot_offset;
+	header->Slot_Stride = slot_stride;
+	header->Slot_Data_Offset = slot_data_offset;
+	header->Latest_Sequence_Number = 0;
+	for(i = 0; i < slot_count; i++)
+	{
+		slot = (struct Frame_Ring_Slot_Header_Struct *)(((char*)ring->Memory)+slot_offset+(i*slot_stride));
+		slot->Generation = 0;
+		slot->Filename_Generation = 0;
+		slot->Pixel_Count = 0;
+		memset(&(slot->Frame),0,sizeof(struct CCD_Frame_Ring_Frame_Struct));
+	}
+	/* write the magic number last, so a reader never sees a partially initialised header */
+	__atomic_store_n(&(header->Magic),CCD_FRAME_RING_MAGIC,__ATOMIC_RELEASE);
+#if LOGGING > 1
+	CCD_General_Log_Format("ccd","ccd_frame_ring.c","CCD_Frame_Ring_Create",LOG_VERBOSITY_TERSE,"FRAMERING",
+			       "Frame ring %s created with length %lu bytes.",name,(unsigned long)memory_length);
+#endif
+	return TRUE;
+}
+
+/**
+ * Attach to an existing frame ring, created by the camera server, read only. The handle can then be
+ * used to read frames from the ring.
+ * @param ring The address of a handle, previously initialised with CCD_Frame_Ring_Initialise.
+ * @param name The name of the POSIX shared memory segment, which should start with a '/'.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Frame_Ring_Header_Struct
+ * @see #CCD_FRAME_RING_MAGIC
+ * @see #CCD_FRAME_RING_VERSION
+ */
+int CCD_Frame_Ring_Open(struct CCD_Frame_Ring_Struct *ring,const char *name)
+{
+	struct Frame_Ring_Header_Struct *header = NULL;
+	struct stat stat_buffer;
+	int open_errno;
+
+	Frame_Ring_Error_Number = 0;
+	if(ring == NULL)
+	{
+		Frame_Ring_Error_Number = 8;
+		sprintf(Frame_Ring_Error_String,"CCD_Frame_Ring_Open:ring was NULL.");
+		return FALSE;
+	}
+	if(name == NULL)
+	{
+		Frame_Ring_Error_Number = 9;
+		sprintf(Frame_Ring_Error_String,"CCD_Frame_Ring_Open:name was NULL.");
+		return FALSE;
+	}
+	if(strlen(name) >= CCD_FRAME_RING_NAME_LENGTH)
+	{
+		Frame_Ring_Error_Number = 10;
+		sprintf(Frame_Ring_Error_String,"CCD_Frame_Ring_Open:name was too long(%lu).",
+			(unsigned long)strlen(name));
+		return FALSE;
+	}
+	ring->Fd = shm_open(name,O_RDONLY,0);
+	if(ring->Fd == -1)
+	{
+		open_errno = errno;
+		Frame_Ring_Error_Number = 11;
+		sprintf(Frame_Ring_Error_String,"CCD_Frame_Ring_Open:shm_open(%s) failed:%d (%s).",name,
+			open_errno,strerror(open_errno));
+		return FALSE;
+	}
+	if(fstat(ring->Fd,&stat_buffer) == -1)
+	{
+		open_errno = errno;
+		close(ring->Fd);
+		ring->Fd = -1;
+		Frame_Ring_Error_Number = 12;
+		sprintf(Frame_Ring_Error_String,"CCD_Frame_Ring_Open:fstat(%s) failed:%d (%s).",name,
+			open_errno,strerror(open_errno));
+		return FALSE;
+	}
+	if(stat_buffer.st_size < (off_t)sizeof(struct Frame_Ring_Header_Struct))
+	{
+		close(ring->Fd);
+		ring->Fd = -1;
+		Frame_Ring_Error_Number = 13;
+		sprintf(Frame_Ring_Error_String,"CCD_Frame_Ring_Open:Segment %s is too small (%ld bytes).",name,
+			(long)stat_buffer.st_size);
+		return FALSE;
+	}
+	ring->Memory = mmap(NULL,stat_buffer.st_size,PROT_READ,MAP_SHARED,ring->Fd,0);
+	if(ring->Memory == MAP_FAILED)
+	{
+		open_errno = errno;
+		close(ring->Fd);
+		ring->Fd = -1;
+		ring->Memory = NULL;
+		Frame_Ring_Error_Number = 14;
+		sprintf(Frame_Ring_Error_String,"CCD_Frame_Ring_Open:mmap(%s) failed:%d (%s).",name,
+			open_errno,strerror(open_errno));
+		return FALSE;
+	}
+	strcpy(ring->Name,name);
+	ring->Memory_Length = stat_buffer.st_size;
+	ring->Is_Writer = FALSE;
+	header = (struct Frame_Ring_Header_Struct *)(ring->Memory);
+	if((__atomic_load_n(&(header->Magic),__ATOMIC_ACQUIRE) != CCD_FRAME_RING_MAGIC)||
+	   (header->Version != CCD_FRAME_RING_VERSION)||
+	   (ring->Memory_Length < (header->Slot_Offset+(header->Slot_Count*header->Slot_Stride))))
+	{
+		Frame_Ring_Error_Number = 15;
+		sprintf(Frame_Ring_Error_String,"CCD_Frame_Ring_Open:Segment %s is not a version %d frame ring "
+			"(magic %#x, version %u).",name,CCD_FRAME_RING_VERSION,header->Magic,header->Version);
+		CCD_Frame_Ring_Close(ring);
+		return FALSE;
+	}
+#if LOGGING > 5
+	CCD_General_Log_Format("ccd","ccd_frame_ring.c","CCD_Frame_Ring_Open",LOG_VERBOSITY_VERBOSE,"FRAMERING",
+			       "Attached to frame ring %s with %u slots of %lu pixels.",name,header->Slot_Count,
+			       (unsigned long)header->Slot_Pixel_Count);
+#endif
+	return TRUE;
+}
+
+/**
+ * Detach from a frame ring. If the handle was created with CCD_Frame_Ring_Create, the shared memory segment
+ * is also unlinked (readers still attached keep their mapping until they close it).
+ * Closing an unattached handle is not an error.
+ * @param ring The address of the handle to close.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #CCD_Frame_Ring_Initialise
+ */
+int CCD_Frame_Ring_Close(struct CCD_Frame_Ring_Struct *ring)
+{
+	int retval = TRUE;
+	int close_errno;
+
+	if(ring == NULL)
+	{
+		Frame_Ring_Error_Number = 16;
+		sprintf(Frame_Ring_Error_String,"CCD_Frame_Ring_Close:ring was NULL.");
+		return FALSE;
+	}
+	if(ring->Memory != NULL)
+	{
+		if(munmap(ring->Memory,ring->Memory_Length) == -1)
+		{
+			close_errno = errno;
+			Frame_Ring_Error_Number = 17;
+			sprintf(Frame_Ring_Error_String,"CCD_Frame_Ring_Close:munmap(%s) failed:%d (%s).",ring->Name,
+				close_errno,strerror(close_errno));
+			retval = FALSE;
+		}
+	}
+	if(ring->Fd != -1)
+		close(ring->Fd);
+	if(ring->Is_Writer)
+		shm_unlink(ring->Name);
+	CCD_Frame_Ring_Initialise(ring);
+	return retval;
+}
+
+/**
+ * Publish a frame into the ring. The slot used is determined by the frame's sequence number, overwriting
+ * the oldest frame in the ring. The slot's generation is made odd, the metadata and pixels are copied in,
+ * and the generation is made even again, before the ring's latest sequence number is updated.
+ * Only one thread should write to a ring at a time, so calls to this routine and CCD_Frame_Ring_Filename_Set must
+ * be serialised by the caller.
+ * @param ring The address of a handle created with CCD_Frame_Ring_Create.
+ * @param frame The address of a structure describing the frame. The Sequence_Number must be greater than 0,
+ *        and should be greater than the previously published sequence number. The Publish_Time is filled in
+ *        by this routine, and the Filename is ignored (it is set blank, see CCD_Frame_Ring_Filename_Set).
+ * @param buffer The pixel data to publish.
+ * @param pixel_count The number of pixels in buffer, which must be no more than the slot pixel count
+ *        the ring was created with.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Frame_Ring_Check
+ * @see #Frame_Ring_Slot_Get
+ * @see #CCD_Frame_Ring_Filename_Set
+ */
+int CCD_Frame_Ring_Publish(struct CCD_Frame_Ring_Struct *ring,struct CCD_Frame_Ring_Frame_Struct *frame,
+			   const unsigned short *buffer,size_t pixel_count)
+{
+	struct Frame_Ring_Header_Struct *header = NULL;
+	struct Frame_Ring_Slot_Header_Struct *slot = NULL;
+	uint64_t generation,filename_generation;
+#ifndef _POSIX_TIMERS
+	struct timeval gtod_current_time;
+#endif
+
+	Frame_Ring_Error_Number = 0;
+	if(!Frame_Ring_Check(ring,"CCD_Frame_Ring_Publish"))
+		return FALSE;
+	if(!ring->Is_Writer)
+	{
+		Frame_Ring_Error_Number = 18;
+		sprintf(Frame_Ring_Error_String,"CCD_Frame_Ring_Publish:Frame ring %s was not opened for writing.",
+			ring->Name);
+		return FALSE;
+	}
+	if((frame == NULL)||(buffer == NULL))
+	{
+		Frame_Ring_Error_Number = 19;
+		sprintf(Frame_Ring_Error_String,"CCD_Frame_Ring_Publish:frame %p or buffer %p was NULL.",
+			(void*)frame,(void*)buffer);
+		return FALSE;
+	}
+	header = (struct Frame_Ring_Header_Struct *)(ring->Memory);
+	if(pixel_count > header->Slot_Pixel_Count)
+	{
+		Frame_Ring_Error_Number = 20;
+		sprintf(Frame_Ring_Error_String,"CCD_Frame_Ring_Publish:Pixel count %lu too large for slot (%lu).",
+			(unsigned long)pixel_count,(unsigned long)header->Slot_Pixel_Count);
+		return FALSE;
+	}
+	if(frame->Sequence_Number < 1)
+	{
+		Frame_Ring_Error_Number = 21;
+		sprintf(Frame_Ring_Error_String,"CCD_Frame_Ring_Publish:Illegal sequence number %lld.",
+			(long long)frame->Sequence_Number);
+		return FALSE;
+	}
+#ifdef _POSIX_TIMERS
+	clock_gettime(CLOCK_REALTIME,&(frame->Publish_Time));
+#else
+	gettimeofday(&gtod_current_time,NULL);
+	frame->Publish_Time.tv_sec = gtod_current_time.tv_sec;
+	frame->Publish_Time.tv_nsec = gtod_current_time.tv_usec*CCD_GENERAL_ONE_MICROSECOND_NS;
+#endif
+	strcpy(frame->Filename,"");
+	slot = Frame_Ring_Slot_Get(ring,frame->Sequence_Number);
+	/* start of write: generations go odd */
+	generation = __atomic_load_n(&(slot->Generation),__ATOMIC_RELAXED);
+	filename_generation = __atomic_load_n(&(slot->Filename_Generation),__ATOMIC_RELAXED);
+	__atomic_store_n(&(slot->Generation),generation+1,__ATOMIC_RELAXED);
+	__atomic_store_n(&(slot->Filename_Generation),filename_generation+1,__ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	slot->Pixel_Count = pixel_count;
+	memcpy(&(slot->Frame),frame,sizeof(struct CCD_Frame_Ring_Frame_Struct));
+	memcpy(((char*)slot)+header->Slot_Data_Offset,buffer,pixel_count*sizeof(unsigned short));
+	/* end of write: generations go even */
+	__atomic_store_n(&(slot->Filename_Generation),filename_generation+2,__ATOMIC_RELEASE);
+	__atomic_store_n(&(slot->Generation),generation+2,__ATOMIC_RELEASE);
+	__atomic_store_n(&(header->Latest_Sequence_Number),frame->Sequence_Number,__ATOMIC_RELEASE);
+#if LOGGING > 9
+	CCD_General_Log_Format("ccd","ccd_frame_ring.c","CCD_Frame_Ring_Publish",LOG_VERBOSITY_VERY_VERBOSE,
+			       "FRAMERING","Published frame %lld (%d x %d) into %s.",
+			       (long long)frame->Sequence_Number,frame->NCols,frame->NRows,ring->Name);
+#endif
+	return TRUE;
+}
+
+/**
+ * Set the FITS filename of a previously published frame, once the frame has been saved to disk. This only
+ * updates the filename sequence lock, so readers that have mapped the frame's pixel data remain valid.
+ * If the frame has already been overwritten in the ring, nothing is done. This must not be called at the same time
+ * as CCD_Frame_Ring_Publish (or another CCD_Frame_Ring_Filename_Set) on the same ring.
+ * @param ring The address of a handle created with CCD_Frame_Ring_Create.
+ * @param sequence_number The sequence number of the frame.
+ * @param filename The FITS filename the frame was saved to.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Frame_Ring_Check
+ * @see #Frame_Ring_Slot_Get
+ * @see #CCD_FRAME_RING_FILENAME_LENGTH
+ */
+int CCD_Frame_Ring_Filename_Set(struct CCD_Frame_Ring_Struct *ring,int64_t sequence_number,const char *filename)
+{
+	struct Frame_Ring_Slot_Header_Struct *slot = NULL;
+	uint64_t filename_generation;
+
+	Frame_Ring_Error_Number = 0;
+	if(!Frame_Ring_Check(ring,"CCD_Frame_Ring_Filename_Set"))
+		return FALSE;
+	if(!ring->Is_Writer)
+	{
+		Frame_Ring_Error_Number = 22;
+		sprintf(Frame_Ring_Error_String,"CCD_Frame_Ring_Filename_Set:Frame ring %s was not opened for writing.",
+			ring->Name);
+		return FALSE;
+	}
+	if(filename == NULL)
+	{
+		Frame_Ring_Error_Number = 23;
+		sprintf(Frame_Ring_Error_String,"CCD_Frame_Ring_Filename_Set:filename was NULL.");
+		return FALSE;
+	}
+	if(strlen(filename) >= CCD_FRAME_RING_FILENAME_LENGTH)
+	{
+		Frame_Ring_Error_Number = 24;
+		sprintf(Frame_Ring_Error_String,"CCD_Frame_Ring_Filename_Set:filename was too long(%lu).",
+			(unsigned long)strlen(filename));
+		return FALSE;
+	}
+	slot = Frame_Ring_Slot_Get(ring,sequence_number);
+	/* only the writer changes the slot, so the sequence number can be read without the lock */
+	if(slot->Frame.Sequence_Number != sequence_number)
+		return TRUE;
+	filename_generation = __atomic_load_n(&(slot->Filename_Generation),__ATOMIC_RELAXED);
+	__atomic_store_n(&(slot->Filename_Generation),filename_generation+1,__ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	strcpy(slot->Frame.Filename,filename);
+	__atomic_store_n(&(slot->Filename_Generation),filename_generation+2,__ATOMIC_RELEASE);
+	return TRUE;
+}
+
+/**
+ * Get the sequence number of the last frame completely published into the ring.
+ * @param ring The address of an attached handle.
+ * @param sequence_number The address of an integer to store the sequence number in. This is zero if no frame
+ *        has been published yet.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Frame_Ring_Check
+ */
+int CCD_Frame_Ring_Latest_Sequence_Get(struct CCD_Frame_Ring_Struct *ring,int64_t *sequence_number)
+{
+	struct Frame_Ring_Header_Struct *header = NULL;
+
+	Frame_Ring_Error_Number = 0;
+	if(!Frame_Ring_Check(ring,"CCD_Frame_Ring_Latest_Sequence_Get"))
+		return FALSE;
+	if(sequence_number == NULL)
+	{
+		Frame_Ring_Error_Number = 25;
+		sprintf(Frame_Ring_Error_String,"CCD_Frame_Ring_Latest_Sequence_Get:sequence_number was NULL.");
+		return FALSE;
+	}
+	header = (struct Frame_Ring_Header_Struct *)(ring->Memory);
+	(*sequence_number) = __atomic_load_n(&(header->Latest_Sequence_Number),__ATOMIC_ACQUIRE);
+	return TRUE;
+}
+
+/**
+ * Get the number of frame slots in the ring. Frames with a sequence number more than this number older than
+ * the latest sequence number have been overwritten.
+ * @param ring The address of an attached handle.
+ * @param slot_count The address of an integer to store the slot count in.
+ * @return The routine returns TRUE on success and FALSE on failure.
+ * @see #Frame_Ring_Check
+ */
+int CCD_Frame_Ring_Slot_Count_Get(struct CCD_Frame_Ring_Struct *ring,int *slot_count)
+{
+	struct Frame_Ring_Header_Struct *header = NULL;
+
+	Frame_Ring_Error_Number = 0;
+	if(!Frame_Ring_Check(ring,"CCD_Frame_Ring_Slot_Count_Get"))
+		return FALSE;
+	if(slot_count == NULL)
+	{
+		Frame_Ring_Error_Number = 26;
+		sprintf(Frame_Ring_Error_String,"CCD_Frame_Ring_Slot_Count_Get:slot_count was NULL.");
+		return FALSE;
+	}
+	header = (struct Frame_Ring_Header_Struct *)(ring->Memory);
+	(*slot_count) = header->Slot_Count;
+	return TRUE;
+}
+
+/**
+ * Copy a frame out of the ring. The slot's sequence lock is used to detect the writer overwriting the slot
+ * whilst it is being copied, in which case the copy is retried (or fails if the requested frame has been
+ * overwritten).
+ * @param ring The address of an attached handle.
+ * @param sequence_number The sequence number of the frame to copy, normally retrieved using
+ *        CCD_Frame_Ring_Latest_Sequence_Get.
+ * @param frame The address of a structure to fill in with the frame's metadata.
+ * @param buffer The address of some memory to copy the frame's pixels into.
+ * @param buffer_length The number of pixels that buffer can hold.
+ * @return The routine returns TRUE on success and FALSE on failure. The routine fails if the frame is not
+ *         in the ring (not yet published, or already overwritten), or buffer is too small.
+ * @see #FRAME_RING_READ_RETRY_COUNT
+ * @see #Frame_Ring_Check
+ * @see #Frame_Ring_Slot_Get
+ * @see #Frame_Ring_Filename_Get
+ */
+int CCD_Frame_Ring_Read(struct CCD_Frame_Ring_Struct *ring,int64_t sequence_number,
+			struct CCD_Frame_Ring_Frame_Struct *frame,unsigned short *buffer,size_t buffer_length)
+{
+	struct Frame_Ring_Header_Struct *header = NULL;
+	struct Frame_Ring_Slot_Header_Struct *slot = NULL;
+	uint64_t generation,pixel_count;
+	int retry;
+
+	Frame_Ring_Error_Number = 0;
+	if(!Frame_Ring_Check(ring,"CCD_Frame_Ring_Read"))
+		return FALSE;
+	if((frame == NULL)||(buffer == NULL))
+	{
+		Frame_Ring_Error_Number = 27;
+		sprintf(Frame_Ring_Error_String,"CCD_Frame_Ring_Read:frame %p or buffer %p was NULL.",
+			(void*)frame,(void*)buffer);
+		return FALSE;
+	}
+	header = (struct Frame_Ring_Header_Struct *)(ring->Memory);
+	slot = Frame_Ring_Slot_Get(ring,sequence_number);
+	for(retry = 0; retry < FRAME_RING_READ_RETRY_COUNT; retry++)
+	{
+		generation = __atomic_load_n(&(slot->Generation),__ATOMIC_ACQUIRE);
+		if(generation & 1)
+			continue;
+		memcpy(frame,&(slot->Frame),sizeof(struct CCD_Frame_Ring_Frame_Struct));
+		pixel_count = slot->Pixel_Count;
+		if((frame->Sequence_Number == sequence_number)&&(pixel_count <= buffer_length))
+			memcpy(buffer,((char*)slot)+header->Slot_Data_Offset,pixel_count*sizeof(unsigned short));
+		Frame_Ring_Filename_Get(slot,frame->Filename);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if(__atomic_load_n(&(slot->Generation),__ATOMIC_RELAXED) != generation)
+			continue;
+		/* we have a consistent copy of the slot */
+		if(frame->Sequence_Number != sequence_number)
+		{
+			Frame_Ring_Error_Number = 28;
+			sprintf(Frame_Ring_Error_String,"CCD_Frame_Ring_Read:Frame %lld is not in the ring "
+				"(slot contains frame %lld).",(long long)sequence_number,
+				(long long)frame->Sequence_Number);
+			return FALSE;
+		}
+		if(pixel_count > buffer_length)
+		{
+			Frame_Ring_Error_Number = 29;
+			sprintf(Frame_Ring_Error_String,"CCD_Frame_Ring_Read:Buffer too small (%lu vs %lu pixels).",
+				(unsigned long)buffer_length,(unsigned long)pixel_count);
+			return FALSE;
+		}
+		return TRUE;
+	}
+	Frame_Ring_Error_Number = 30;
+	sprintf(Frame_Ring_Error_String,"CCD_Frame_Ring_Read:Failed to get a consistent copy of frame %lld "
+		"after %d retries.",(long long)sequence_number,FRAME_RING_READ_RETRY_COUNT);
+	return FALSE;
+}
+
+/**
+ * Get a pointer to a frame's pixel data in the ring, without copying it. The frame's metadata is copied into
+ * frame, and the slot generation at the time the frame was mapped is returned. After using the pixel data,
+ * the caller should call CCD_Frame_Ring_Frame_Is_Valid with the returned generation, to check the writer did not
+ * overwrite the slot whilst the data was being used. The ring should therefore be created with enough slots
+ * that consumers finish with a frame before the writer wraps round to it.
+ * @param ring The address of an attached handle.
+ * @param sequence_number The sequence number of the frame to map.
+ * @param frame The address of a structure to fill in with the frame's metadata.
+ * @param buffer The address of a pointer, set to the address of the frame's pixel data in the shared memory.
+ * @param generation The address of an integer to store the slot's generation in.
+ * @return The routine returns TRUE on success and FALSE on failure. The routine fails if the frame is not
+ *         in the ring (not yet published, or already overwritten).
+ * @see #FRAME_RING_READ_RETRY_COUNT
+ * @see #Frame_Ring_Check
+ * @see #Frame_Ring_Slot_Get
+ * @see #Frame_Ring_Filename_Get
+ * @see #CCD_Frame_Ring_Frame_Is_Valid
+ */
+int CCD_Frame_Ring_Frame_Map(struct CCD_Frame_Ring_Struct *ring,int64_t sequence_number,
+			     struct CCD_Frame_Ring_Frame_Struct *frame,const unsigned short **buffer,
+			     uint64_t *generation)
+{
+	struct Frame_Ring_Header_Struct *header = NULL;
+	struct Frame_Ring_Slot_Header_Struct *slot = NULL;
+	uint64_t slot_generation;
+	int retry;
+
+	Frame_Ring_Error_Number = 0;
+	if(!Frame_Ring_Check(ring,"CCD_Frame_Ring_Frame_Map"))
+		return FALSE;
+	if((frame == NULL)||(buffer == NULL)||(generation == NULL))
+	{
+		Frame_Ring_Error_Number = 31;
+		sprintf(Frame_Ring_Error_String,"CCD_Frame_Ring_Frame_Map:frame %p, buffer %p or generation %p was NULL.",
+			(void*)frame,(void*)buffer,(void*)generation);
+		return FALSE;
+	}
+	header = (struct Frame_Ring_Header_Struct *)(ring->Memory);
+	slot = Frame_Ring_Slot_Get(ring,sequence_number);
+	for(retry = 0; retry < FRAME_RING_READ_RETRY_COUNT; retry++)
+	{
+		slot_generation = __atomic_load_n(&(slot->Generation),__ATOMIC_ACQUIRE);
+		if(slot_generation & 1)
+			continue;
+		memcpy(frame,&(slot->Frame),sizeof(struct CCD_Frame_Ring_Frame_Struct));
+		Frame_Ring_Filename_Get(slot,frame->Filename);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if(__atomic_load_n(&(slot->Generation),__ATOMIC_RELAXED) != slot_generation)
+			continue;
+		if(frame->Sequence_Number != sequence_number)
+		{
+			Frame_Ring_Error_Number = 32;
+			sprintf(Frame_Ring_Error_String,"CCD_Frame_Ring_Frame_Map:Frame %lld is not in the ring "
+				"(slot contains frame %lld).",(long long)sequence_number,
+				(long long)frame->Sequence_Number);
+			return FALSE;
+		}
+		(*buffer) = (const unsigned short *)(((char*)slot)+header->Slot_Data_Offset);
+		(*generation) = slot_generation;
+		return TRUE;
+	}
+	Frame_Ring_Error_Number = 33;
+	sprintf(Frame_Ring_Error_String,"CCD_Frame_Ring_Frame_Map:Failed to get a consistent view of frame %lld "
+		"after %d retries.",(long long)sequence_number,FRAME_RING_READ_RETRY_COUNT);
+	return FALSE;
+}
+
+/**
+ * Check whether pixel data previously mapped with CCD_Frame_Ring_Frame_Map is still valid, i.e. the writer
+ * has not started overwriting the slot since it was mapped.
+ * @param ring The address of an attached handle.
+ * @param sequence_number The sequence number of the mapped frame.
+ * @param generation The generation returned by CCD_Frame_Ring_Frame_Map.
+ * @return The routine returns TRUE if the data is still valid, and FALSE if it has been (or is being) overwritten,
+ *         or an error occurs.
+ * @see #Frame_Ring_Check
+ * @see #Frame_Ring_Slot_Get
+ * @see #CCD_Frame_Ring_Frame_Map
+ */
+int CCD_Frame_Ring_Frame_Is_Valid(struct CCD_Frame_Ring_Struct *ring,int64_t sequence_number,uint64_t generation)
+{
+	struct Frame_Ring_Slot_Header_Struct *slot = NULL;
+
+	Frame_Ring_Error_Number = 0;
+	if(!Frame_Ring_Check(ring,"CCD_Frame_Ring_Frame_Is_Valid"))
+		return FALSE;
+	slot = Frame_Ring_Slot_Get(ring,sequence_number);
+	/* order the caller's reads of the pixel data before the generation re-read */
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return (__atomic_load_n(&(slot->Generation),__ATOMIC_RELAXED) == generation);
+}
+
+/**
+ * Get the current value of ccd_frame_ring's error number.
+ * @return The current value of ccd_frame_ring's error number.
+ * @see #Frame_Ring_Error_Number
+ */
+int CCD_Frame_Ring_Get_Error_Number(void)
+{
+	return Frame_Ring_Error_Number;
+}
+
+/**
+ * The error routine that reports any errors occuring in ccd_frame_ring in a standard way.
+ * @see CCD_General_Get_Current_Time_String
+ * @see #Frame_Ring_Error_Number
+ * @see #Frame_Ring_Error_String
+ */
+void CCD_Frame_Ring_Error(void)
+{
+	char time_string[32];
+
+	CCD_General_Get_Current_Time_String(time_string,32);
+	/* if the error number is zero an error message has not been set up
+	** This is in itself an error as we should not be calling this routine
+	** without there being an error to display */
+	if(Frame_Ring_Error_Number == 0)
+		sprintf(Frame_Ring_Error_String,"Logic Error:No Error defined");
+	fprintf(stderr,"%s CCD_Frame_Ring:Error(%d) : %s\n",time_string,Frame_Ring_Error_Number,
+		Frame_Ring_Error_String);
+}
+
+/**
+ * The error routine that reports any errors occuring in ccd_frame_ring in a standard way. This routine places the
+ * generated error string at the end of a passed in string argument.
+ * @param error_string A string to put the generated error in. This string should be initialised before
+ * being passed to this routine. The routine will try to concatenate it's error string onto the end
+ * of any string already in existance.
+ * @see CCD_General_Get_Current_Time_String
+ * @see #Frame_Ring_Error_Number
+ * @see #Frame_Ring_Error_String
+ */
+void CCD_Frame_Ring_Error_String(char *error_string)
+{
+	char time_string[32];
+
+	CCD_General_Get_Current_Time_String(time_string,32);
+	/* if the error number is zero an error message has not been set up
+	** This is in itself an error as we should not be calling this routine
+	** without there being an error to display */
+	if(Frame_Ring_Error_Number == 0)
+		sprintf(Frame_Ring_Error_String,"Logic Error:No Error defined");
+	sprintf(error_string+strlen(error_string),"%s CCD_Frame_Ring:Error(%d) : %s\n",time_string,
+		Frame_Ring_Error_Number,Frame_Ring_Error_String);
+}
+
+/* ----------------------------------------------------------------------------
+** 		internal functions
+** ---------------------------------------------------------------------------- */
+/**
+ * Check a frame ring handle is attached to a segment.
+ * @param ring The address of the handle to check.
+ * @param function_name The name of the calling function, used in the error message.
+ * @return The routine returns TRUE if the handle is attached, and FALSE otherwise.
+ * @see #Frame_Ring_Error_Number
+ * @see #Frame_Ring_Error_String
+ */
+static int Frame_Ring_Check(struct CCD_Frame_Ring_Struct *ring,char *function_name)
+{
+	if(ring == NULL)
+	{
+		Frame_Ring_Error_Number = 34;
+		sprintf(Frame_Ring_Error_String,"%s:ring was NULL.",function_name);
+		return FALSE;
+	}
+	if(ring->Memory == NULL)
+	{
+		Frame_Ring_Error_Number = 35;
+		sprintf(Frame_Ring_Error_String,"%s:ring is not attached to a shared memory segment.",function_name);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Get the address of the slot header a frame with the specified sequence number is (or would be) stored in.
+ * @param ring The address of an attached handle.
+ * @param sequence_number The frame's sequence number.
+ * @return The address of the slot header in the shared memory.
+ * @see #Frame_Ring_Header_Struct
+ * @see #Frame_Ring_Slot_Header_Struct
+ */
+static struct Frame_Ring_Slot_Header_Struct *Frame_Ring_Slot_Get(struct CCD_Frame_Ring_Struct *ring,
+								  int64_t sequence_number)
+{
+	struct Frame_Ring_Header_Struct *header = NULL;
+	uint64_t slot_index;
+
+	header = (struct Frame_Ring_Header_Struct *)(ring->Memory);
+	/* sequence numbers start at 1 */
+	if(sequence_number < 1)
+		slot_index = 0;
+	else
+		slot_index = (uint64_t)(sequence_number-1)%header->Slot_Count;
+	return (struct Frame_Ring_Slot_Header_Struct *)(((char*)ring->Memory)+header->Slot_Offset+
+							 (slot_index*header->Slot_Stride));
+}
+
+/**
+ * Copy the filename out of a slot, using the slot's filename sequence lock. If a consistent copy cannot
+ * be made, the filename is set to the blank string.
+ * @param slot The address of the slot header.
+ * @param filename A string of at least CCD_FRAME_RING_FILENAME_LENGTH characters to copy the filename into.
+ * @see #FRAME_RING_READ_RETRY_COUNT
+ * @see #CCD_FRAME_RING_FILENAME_LENGTH
+ */
+static void Frame_Ring_Filename_Get(struct Frame_Ring_Slot_Header_Struct *slot,char *filename)
+{
+	uint64_t filename_generation;
+	int retry;
+
+	for(retry = 0; retry < FRAME_RING_READ_RETRY_COUNT; retry++)
+	{
+		filename_generation = __atomic_load_n(&(slot->Filename_Generation),__ATOMIC_ACQUIRE);
+		if(filename_generation & 1)
+			continue;
+		memcpy(filename,slot->Frame.Filename,CCD_FRAME_RING_FILENAME_LENGTH);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if(__atomic_load_n(&(slot->Filename_Generation),__ATOMIC_RELAXED) == filename_generation)
+		{
+			filename[CCD_FRAME_RING_FILENAME_LENGTH-1] = '\0';
+			return;
+		}
+	}
+	strcpy(filename,"");
+}
@@ -27,6 +27,9 @@
 #include "ccd_exposure.h"
 #include "ccd_fits_header.h"
 #include "ccd_fits_filename.h"
+#include "ccd_fits_writer.h"
+#include "ccd_frame_ring.h"
+#include "ccd_orientation.h"
 #include "ccd_setup.h"
 #include "ccd_temperature.h"
 
@@ -111,6 +114,9 @@ char* CCD_General_Andor_ErrorCode_To_String(unsigned int error_code)
  * @see CCD_Setup_Get_Error_Number
  * @see CCD_Fits_Header_Get_Error_Number
  * @see CCD_Fits_Filename_Get_Error_Number
+ * @see CCD_Fits_Writer_Get_Error_Number
+ * @see CCD_Frame_Ring_Get_Error_Number
+ * @see CCD_Orientation_Get_Error_Number
  * @see CCD_Exposure_Get_Error_Number
  * @see CCD_Temperature_Get_Error_Number
  */
@@ -130,6 +136,18 @@ int CCD_General_Is_Error(void)
 	{
 		found = TRUE;
 	}
+	if(CCD_Fits_Writer_Get_Error_Number() != 0)
+	{
+		found = TRUE;
+	}
+	if(CCD_Frame_Ring_Get_Error_Number() != 0)
+	{
+		found = TRUE;
+	}
+	if(CCD_Orientation_Get_Error_Number() != 0)
+	{
+		found = TRUE;
+	}
 	if(CCD_Exposure_Get_Error_Number() != 0)
 	{
 		found = TRUE;
@@ -153,6 +171,12 @@ int CCD_General_Is_Error(void)
  * @see CCD_Fits_Header_Error
  * @see CCD_Fits_Filename_Get_Error_Number
  * @see CCD_Fits_Filename_Error
+ * @see CCD_Fits_Writer_Get_Error_Number
+ * @see CCD_Fits_Writer_Error
+ * @see CCD_Frame_Ring_Get_Error_Number
+ * @see CCD_Frame_Ring_Error
+ * @see CCD_Orientation_Get_Error_Number
+ * @see CCD_Orientation_Error
  * @see CCD_Exposure_Get_Error_Number
  * @see CCD_Exposure_Error
  * @see CCD_Temperature_Get_Error_Number
@@ -179,6 +203,21 @@ void CCD_General_Error(void)
 		found = TRUE;
 		CCD_Fits_Filename_Error();
 	}
+	if(CCD_Fits_Writer_Get_Error_Number() != 0)
+	{
+		found = TRUE;
+		CCD_Fits_Writer_Error();
+	}
+	if(CCD_Frame_Ring_Get_Error_Number() != 0)
+	{
+		found = TRUE;
+		CCD_Frame_Ring_Error();
+	}
+	if(CCD_Orientation_Get_Error_Number() != 0)
+	{
+		found = TRUE;
+		CCD_Orientation_Error();
+	}
 	if(CCD_Exposure_Get_Error_Number() != 0)
 	{
 		found = TRUE;
@@ -210,6 +249,12 @@ void CCD_General_Error(void)
  * @see CCD_Fits_Header_Error_String
  * @see CCD_Fits_Filename_Get_Error_Number
  * @see CCD_Fits_Filename_Error_String
+ * @see CCD_Fits_Writer_Get_Error_Number
+ * @see CCD_Fits_Writer_Error_String
+ * @see CCD_Frame_Ring_Get_Error_Number
+ * @see CCD_Frame_Ring_Error_String
+ * @see CCD_Orientation_Get_Error_Number
+ * @see CCD_Orientation_Error_String
  * @see CCD_Exposure_Get_Error_Number
  * @see CCD_Exposure_Error_String
  * @see CCD_Temperature_Get_Error_Number
@@ -232,6 +277,18 @@ void CCD_General_Error_To_String(char *error_string)
 	{
 		CCD_Fits_Filename_Error_String(error_string);
 	}
+	if(CCD_Fits_Writer_Get_Error_Number() != 0)
+	{
+		CCD_Fits_Writer_Error_String(error_string);
+	}
+	if(CCD_Frame_Ring_Get_Error_Number() != 0)
+	{
+		CCD_Frame_Ring_Error_String(error_string);
+	}
+	if(CCD_Orientation_Get_Error_Number() != 0)
+	{
+		CCD_Orientation_Error_String(error_string);
+	}
 	if(CCD_Exposure_Get_Error_Number() != 0)
 	{
 		CCD_Exposure_Error_String(error_string);
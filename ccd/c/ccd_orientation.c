@@ -0,0 +1,1029 @@
+/* ccd_orientation.c
+** CCD image orientation routines
+** $Id$
+*/
+/**
+ * @file
+ * @brief Routines to flip, rotate and transpose read out images. Every orientation is done in a single pass over
+ *        the image: flipping in X reverses each row, flipping in Y swaps rows, a 180 degree rotation reverses the
+ *        whole image, and the transposes and 90/270 degree rotations copy the image in cache sized tiles into a
+ *        scratch buffer. The inner loops have SSE2 and AVX2 implementations, selected at run time depending on the
+ *        CPU, with a portable C fallback.
+ * @author Chris Mottram
+ * @version $Id$
+ */
+/**
+ * This hash define is needed before including source files give us POSIX.4/IEEE1003.1b-1993 prototypes.
+ */
+#define _POSIX_SOURCE 1
+/**
+ * This hash define is needed before including source files give us POSIX.4/IEEE1003.1b-1993 prototypes.
+ */
+#define _POSIX_C_SOURCE 199309L
+/**
+ * Define this to enable strcasecmp in 'strings.h', which is a BSD 4.3 prototype.
+ */
+#define _DEFAULT_SOURCE 1
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "ccd_general.h"
+#include "ccd_orientation.h"
+
+/* hash defines */
+#if defined(__x86_64__) || defined(__i386__)
+/**
+ * Defined if we are compiling for an x86 CPU, and can therefore build the SSE2 and AVX2 kernels.
+ */
+#define ORIENTATION_X86
+#endif
+/**
+ * The width and height, in pixels, of the tiles the transposing orientations copy the image in. A tile of input
+ * and a tile of output (2 x 64 x 64 x 2 bytes) fit in the L1 cache. This must be a multiple of 8 (the SIMD block
+ * size).
+ */
+#define ORIENTATION_TILE_SIZE          (64)
+/**
+ * Macro returning the minimum of two numbers.
+ */
+#define ORIENTATION_MIN(a,b)           (((a) < (b)) ? (a) : (b))
+
+/* internal data */
+/**
+ * Revision Control System identifier.
+ */
+static char rcsid[] = "$Id$";
+/**
+ * Variable holding error code of last operation performed by the orientation routines.
+ */
+static int Orientation_Error_Number = 0;
+/**
+ * Local variable holding description of the last error that occured.
+ */
+static char Orientation_Error_String[CCD_GENERAL_ERROR_STRING_LENGTH] = "";
+/**
+ * The names of the orientations, indexed by enum CCD_ORIENTATION. These are the values accepted by
+ * CCD_Orientation_Parse.
+ * @see #CCD_ORIENTATION
+ */
+static const char *Orientation_String_List[] =
+{
+	"none","flip_x","flip_y","rotate_180","transpose","rotate_90","rotate_270","transverse"
+};
+/**
+ * The names of the kernels, indexed by enum CCD_ORIENTATION_KERNEL.
+ * @see #CCD_ORIENTATION_KERNEL
+ */
+static const char *Orientation_Kernel_String_List[] =
+{
+	"auto","scalar","sse2","avx2"
+};
+/**
+ * The kernel the orientation routines use. This is never CCD_ORIENTATION_KERNEL_AUTO once
+ * Orientation_Kernel_Resolve has been called.
+ * @see #Orientation_Kernel_Resolve
+ */
+static enum CCD_ORIENTATION_KERNEL Orientation_Kernel = CCD_ORIENTATION_KERNEL_AUTO;
+/**
+ * A scratch buffer the transposing orientations write the re-oriented image into, before it is copied back over
+ * the read out image. It grows to fit the largest image re-oriented, and is then re-used, so re-orienting a
+ * series of images does not allocate memory.
+ * @see #Orientation_Scratch_Length
+ * @see #Orientation_Scratch_Mutex
+ */
+static unsigned short *Orientation_Scratch = NULL;
+/**
+ * The number of pixels Orientation_Scratch can hold.
+ * @see #Orientation_Scratch
+ */
+static size_t Orientation_Scratch_Length = 0;
+/**
+ * Mutex protecting Orientation_Scratch and Orientation_Scratch_Length.
+ * @see #Orientation_Scratch
+ */
+static pthread_mutex_t Orientation_Scratch_Mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* internal functions */
+static int Orientation_Check(enum CCD_ORIENTATION orientation,int ncols,int nrows,const unsigned short *buffer,
+			     char *function_name);
+static enum CCD_ORIENTATION_KERNEL Orientation_Kernel_Resolve(void);
+static void Orientation_In_Place(enum CCD_ORIENTATION_KERNEL kernel,enum CCD_ORIENTATION orientation,int ncols,
+				 int nrows,unsigned short *buffer);
+static void Orientation_Transpose(enum CCD_ORIENTATION_KERNEL kernel,enum CCD_ORIENTATION orientation,int ncols,
+				  int nrows,const unsigned short *input_buffer,unsigned short *output_buffer);
+static void Orientation_Reverse_Span_Scalar(unsigned short *left,unsigned short *right);
+static void Orientation_Swap_Rows_Scalar(int ncols,int nrows,unsigned short *buffer);
+static void Orientation_Transpose_Tile_Scalar(enum CCD_ORIENTATION orientation,int ncols,int nrows,
+					      const unsigned short *input_buffer,unsigned short *output_buffer,
+					      int x_start,int y_start,int x_end,int y_end);
+static void Orientation_Transpose_Scalar(enum CCD_ORIENTATION orientation,int ncols,int nrows,
+					 const unsigned short *input_buffer,unsigned short *output_buffer);
+#ifdef ORIENTATION_X86
+static void Orientation_Reverse_Span_SSE2(unsigned short *left,unsigned short *right);
+static void Orientation_Swap_Rows_SSE2(int ncols,int nrows,unsigned short *buffer);
+static void Orientation_Transpose_SSE2(enum CCD_ORIENTATION orientation,int ncols,int nrows,
+				       const unsigned short *input_buffer,unsigned short *output_buffer);
+static void Orientation_Reverse_Span_AVX2(unsigned short *left,unsigned short *right);
+static void Orientation_Swap_Rows_AVX2(int ncols,int nrows,unsigned short *buffer);
+#endif
+
+/* ----------------------------------------------------------------------------
+** 		external functions
+** ---------------------------------------------------------------------------- */
+/**
+ * Parse an orientation name (as used in the config file) into an orientation.
+ * @param string The name of the orientation, one of: "none", "flip_x", "flip_y", "rotate_180", "transpose",
+ *        "rotate_90", "rotate_270", "transverse". The comparison is case insensitive.
+ * @param orientation The address of an enum to store the parsed orientation in.
+ * @return The routine returns TRUE on success, and FALSE if the string is not an orientation name.
+ * @see #Orientation_String_List
+ * @see #CCD_ORIENTATION
+ */
+int CCD_Orientation_Parse(const char *string,enum CCD_ORIENTATION *orientation)
+{
+	int i;
+
+	Orientation_Error_Number = 0;
+	if(string == NULL)
+	{
+		Orientation_Error_Number = 1;
+		sprintf(Orientation_Error_String,"CCD_Orientation_Parse:string was NULL.");
+		return FALSE;
+	}
+	if(orientation == NULL)
+	{
+		Orientation_Error_Number = 2;
+		sprintf(Orientation_Error_String,"CCD_Orientation_Parse:orientation was NULL.");
+		return FALSE;
+	}
+	for(i = CCD_ORIENTATION_NONE; i <= CCD_ORIENTATION_TRANSVERSE; i++)
+	{
+		if(strcasecmp(string,Orientation_String_List[i]) == 0)
+		{
+			(*orientation) = (enum CCD_ORIENTATION)i;
+			return TRUE;
+		}
+	}
+	Orientation_Error_Number = 3;
+	sprintf(Orientation_Error_String,"CCD_Orientation_Parse:Unknown orientation '%s'.",string);
+	return FALSE;
+}
+
+/**
+ * Return the name of an orientation.
+ * @param orientation The orientation.
+ * @return The orientation's name, or "UNKNOWN" if it is not a legal orientation.
+ * @see #Orientation_String_List
+ * @see #CCD_ORIENTATION_IS_ORIENTATION
+ */
+const char *CCD_Orientation_To_String(enum CCD_ORIENTATION orientation)
+{
+	if(!CCD_ORIENTATION_IS_ORIENTATION(orientation))
+		return "UNKNOWN";
+	return Orientation_String_List[orientation];
+}
+
+/**
+ * Return the orientation equivalent to flipping the image in X and/or Y.
+ * @param flip_x A boolean, whether to flip the image in the horizontal (X) direction.
+ * @param flip_y A boolean, whether to flip the image in the vertical (Y) direction.
+ * @return The equivalent orientation (flipping in both directions is a 180 degree rotation).
+ * @see #CCD_ORIENTATION
+ */
+enum CCD_ORIENTATION CCD_Orientation_From_Flips(int flip_x,int flip_y)
+{
+	if(flip_x && flip_y)
+		return CCD_ORIENTATION_ROTATE_180;
+	if(flip_x)
+		return CCD_ORIENTATION_FLIP_X;
+	if(flip_y)
+		return CCD_ORIENTATION_FLIP_Y;
+	return CCD_ORIENTATION_NONE;
+}
+
+/**
+ * Return the dimensions of an image after it has been re-oriented.
+ * @param orientation The orientation.
+ * @param ncols The number of columns in the image as read out.
+ * @param nrows The number of rows in the image as read out.
+ * @param oriented_ncols The address of an integer to store the number of columns in the re-oriented image.
+ * @param oriented_nrows The address of an integer to store the number of rows in the re-oriented image.
+ * @see #CCD_ORIENTATION_SWAPS_AXES
+ */
+void CCD_Orientation_Get_Dimensions(enum CCD_ORIENTATION orientation,int ncols,int nrows,
+				    int *oriented_ncols,int *oriented_nrows)
+{
+	if(CCD_ORIENTATION_SWAPS_AXES(orientation))
+	{
+		if(oriented_ncols != NULL)
+			(*oriented_ncols) = nrows;
+		if(oriented_nrows != NULL)
+			(*oriented_nrows) = ncols;
+	}
+	else
+	{
+		if(oriented_ncols != NULL)
+			(*oriented_ncols) = ncols;
+		if(oriented_nrows != NULL)
+			(*oriented_nrows) = nrows;
+	}
+}
+
+/**
+ * Return the region of an image as read out, that a region of the re-oriented image came from.
+ * As each orientation is a flip / rotation / transpose, a rectangular region of the re-oriented image always comes
+ * from a rectangular region of the image as read out (with it's width and height swapped if the orientation swaps
+ * the image's axes). The region is not checked against the image's dimensions.
+ * @param orientation The orientation the image was re-oriented with.
+ * @param ncols The number of columns in the image as read out.
+ * @param nrows The number of rows in the image as read out.
+ * @param x The first column of the region in the re-oriented image (starting from 0).
+ * @param y The first row of the region in the re-oriented image (starting from 0).
+ * @param width The number of columns in the region.
+ * @param height The number of rows in the region.
+ * @param source_x The address of an integer to store the first column of the region in the image as read out.
+ * @param source_y The address of an integer to store the first row of the region in the image as read out.
+ * @param source_width The address of an integer to store the number of columns of the region in the image as
+ *        read out.
+ * @param source_height The address of an integer to store the number of rows of the region in the image as
+ *        read out.
+ * @see #CCD_ORIENTATION_SWAPS_AXES
+ * @see #Orientation_Transpose_Tile_Scalar
+ */
+void CCD_Orientation_Get_Source_Region(enum CCD_ORIENTATION orientation,int ncols,int nrows,int x,int y,
+				       int width,int height,int *source_x,int *source_y,
+				       int *source_width,int *source_height)
+{
+	int reverse_x,reverse_y;
+
+	if(CCD_ORIENTATION_SWAPS_AXES(orientation))
+	{
+		/* re-oriented columns come from read out rows, and re-oriented rows from read out columns */
+		reverse_y = (orientation == CCD_ORIENTATION_ROTATE_90)||(orientation == CCD_ORIENTATION_TRANSVERSE);
+		reverse_x = (orientation == CCD_ORIENTATION_ROTATE_270)||(orientation == CCD_ORIENTATION_TRANSVERSE);
+		(*source_x) = reverse_x ? (ncols-(y+height)) : y;
+		(*source_y) = reverse_y ? (nrows-(x+width)) : x;
+		(*source_width) = height;
+		(*source_height) = width;
+	}
+	else
+	{
+		reverse_x = (orientation == CCD_ORIENTATION_FLIP_X)||(orientation == CCD_ORIENTATION_ROTATE_180);
+		reverse_y = (orientation == CCD_ORIENTATION_FLIP_Y)||(orientation == CCD_ORIENTATION_ROTATE_180);
+		(*source_x) = reverse_x ? (ncols-(x+width)) : x;
+		(*source_y) = reverse_y ? (nrows-(y+height)) : y;
+		(*source_width) = width;
+		(*source_height) = height;
+	}
+}
+
+/**
+ * Re-orient an image in place.
+ * <ul>
+ * <li>We check the parameters using Orientation_Check.
+ * <li>We get the kernel to use from Orientation_Kernel_Resolve.
+ * <li>If the orientation does not swap the image's axes, we re-orient the image in place using Orientation_In_Place.
+ * <li>Otherwise we lock Orientation_Scratch_Mutex, make sure Orientation_Scratch is large enough to hold the image,
+ *     re-orient the image into it using Orientation_Transpose, and copy it back over the image.
+ * </ul>
+ * @param orientation The orientation to apply.
+ * @param ncols The number of columns in the image.
+ * @param nrows The number of rows in the image.
+ * @param buffer The image, ncols x nrows pixels. On return this holds the re-oriented image, which has
+ *        nrows columns and ncols rows if the orientation swaps the axes (see CCD_Orientation_Get_Dimensions).
+ * @return The routine returns TRUE on success, and FALSE if an error occurs.
+ * @see #Orientation_Check
+ * @see #Orientation_Kernel_Resolve
+ * @see #Orientation_In_Place
+ * @see #Orientation_Transpose
+ * @see #Orientation_Scratch
+ * @see #Orientation_Scratch_Length
+ * @see #Orientation_Scratch_Mutex
+ * @see #CCD_Orientation_Get_Dimensions
+ */
+int CCD_Orientation_Apply(enum CCD_ORIENTATION orientation,int ncols,int nrows,unsigned short *buffer)
+{
+	enum CCD_ORIENTATION_KERNEL kernel;
+	unsigned short *new_scratch = NULL;
+	size_t pixel_count;
+
+	Orientation_Error_Number = 0;
+	if(!Orientation_Check(orientation,ncols,nrows,buffer,"CCD_Orientation_Apply"))
+		return FALSE;
+#if LOGGING > 5
+	CCD_General_Log_Format("ccd","ccd_orientation.c","CCD_Orientation_Apply",LOG_VERBOSITY_INTERMEDIATE,"FITS",
+			       "Re-orienting image data (%d x %d) using orientation %s.",ncols,nrows,
+			       CCD_Orientation_To_String(orientation));
+#endif
+	kernel = Orientation_Kernel_Resolve();
+	if(!CCD_ORIENTATION_SWAPS_AXES(orientation))
+	{
+		Orientation_In_Place(kernel,orientation,ncols,nrows,buffer);
+		return TRUE;
+	}
+	pixel_count = ((size_t)ncols)*((size_t)nrows);
+	pthread_mutex_lock(&Orientation_Scratch_Mutex);
+	if(pixel_count > Orientation_Scratch_Length)
+	{
+		new_scratch = (unsigned short *)realloc(Orientation_Scratch,pixel_count*sizeof(unsigned short));
+		if(new_scratch == NULL)
+		{
+			pthread_mutex_unlock(&Orientation_Scratch_Mutex);
+			Orientation_Error_Number = 4;
+			sprintf(Orientation_Error_String,"CCD_Orientation_Apply:Failed to allocate scratch buffer (%lu).",
+				(unsigned long)pixel_count);
+			return FALSE;
+		}
+		Orientation_Scratch = new_scratch;
+		Orientation_Scratch_Length = pixel_count;
+	}
+	Orientation_Transpose(kernel,orientation,ncols,nrows,buffer,Orientation_Scratch);
+	memcpy(buffer,Orientation_Scratch,pixel_count*sizeof(unsigned short));
+	pthread_mutex_unlock(&Orientation_Scratch_Mutex);
+	return TRUE;
+}
+
+/**
+ * Re-orient an image, writing the re-oriented image into a different buffer. The transposing orientations are done
+ * in a single pass. The other orientations copy the image, and then re-orient the copy in place.
+ * @param orientation The orientation to apply.
+ * @param ncols The number of columns in the input image.
+ * @param nrows The number of rows in the input image.
+ * @param input_buffer The image, ncols x nrows pixels.
+ * @param output_buffer A buffer of at least ncols x nrows pixels, that must not overlap input_buffer.
+ *        On return this holds the re-oriented image.
+ * @return The routine returns TRUE on success, and FALSE if an error occurs.
+ * @see #Orientation_Check
+ * @see #Orientation_Kernel_Resolve
+ * @see #Orientation_In_Place
+ * @see #Orientation_Transpose
+ */
+int CCD_Orientation_Apply_Copy(enum CCD_ORIENTATION orientation,int ncols,int nrows,
+			       const unsigned short *input_buffer,unsigned short *output_buffer)
+{
+	enum CCD_ORIENTATION_KERNEL kernel;
+
+	Orientation_Error_Number = 0;
+	if(!Orientation_Check(orientation,ncols,nrows,input_buffer,"CCD_Orientation_Apply_Copy"))
+		return FALSE;
+	if(output_buffer == NULL)
+	{
+		Orientation_Error_Number = 5;
+		sprintf(Orientation_Error_String,"CCD_Orientation_Apply_Copy:output_buffer was NULL.");
+		return FALSE;
+	}
+	if(output_buffer == input_buffer)
+	{
+		Orientation_Error_Number = 6;
+		sprintf(Orientation_Error_String,"CCD_Orientation_Apply_Copy:input_buffer and output_buffer are the same.");
+		return FALSE;
+	}
+	kernel = Orientation_Kernel_Resolve();
+	if(CCD_ORIENTATION_SWAPS_AXES(orientation))
+		Orientation_Transpose(kernel,orientation,ncols,nrows,input_buffer,output_buffer);
+	else
+	{
+		memcpy(output_buffer,input_buffer,((size_t)ncols)*((size_t)nrows)*sizeof(unsigned short));
+		Orientation_In_Place(kernel,orientation,ncols,nrows,output_buffer);
+	}
+	return TRUE;
+}
+
+/**
+ * Select which implementation of the orientation routines to use. This is normally left as
+ * CCD_ORIENTATION_KERNEL_AUTO, but can be used to compare the implementations.
+ * @param kernel The kernel to use.
+ * @return The routine returns TRUE on success, and FALSE if the kernel is not supported by this CPU.
+ * @see #Orientation_Kernel
+ * @see #CCD_ORIENTATION_KERNEL
+ */
+int CCD_Orientation_Kernel_Set(enum CCD_ORIENTATION_KERNEL kernel)
+{
+	Orientation_Error_Number = 0;
+	switch(kernel)
+	{
+		case CCD_ORIENTATION_KERNEL_AUTO:
+		case CCD_ORIENTATION_KERNEL_SCALAR:
+			break;
+#ifdef ORIENTATION_X86
+		case CCD_ORIENTATION_KERNEL_SSE2:
+			if(!__builtin_cpu_supports("sse2"))
+			{
+				Orientation_Error_Number = 7;
+				sprintf(Orientation_Error_String,"CCD_Orientation_Kernel_Set:This CPU does not support SSE2.");
+				return FALSE;
+			}
+			break;
+		case CCD_ORIENTATION_KERNEL_AVX2:
+			if(!__builtin_cpu_supports("avx2"))
+			{
+				Orientation_Error_Number = 8;
+				sprintf(Orientation_Error_String,"CCD_Orientation_Kernel_Set:This CPU does not support AVX2.");
+				return FALSE;
+			}
+			break;
+#endif
+		default:
+			Orientation_Error_Number = 9;
+			sprintf(Orientation_Error_String,"CCD_Orientation_Kernel_Set:Kernel %d is not supported.",kernel);
+			return FALSE;
+	}
+	Orientation_Kernel = kernel;
+	return TRUE;
+}
+
+/**
+ * Return the kernel the orientation routines use.
+ * @return The kernel. If the kernel is set to CCD_ORIENTATION_KERNEL_AUTO, the kernel chosen for this CPU
+ *         is returned.
+ * @see #Orientation_Kernel_Resolve
+ */
+enum CCD_ORIENTATION_KERNEL CCD_Orientation_Kernel_Get(void)
+{
+	return Orientation_Kernel_Resolve();
+}
+
+/**
+ * Return the name of a kernel.
+ * @param kernel The kernel.
+ * @return The kernel's name, or "UNKNOWN" if it is not a legal kernel.
+ * @see #Orientation_Kernel_String_List
+ */
+const char *CCD_Orientation_Kernel_To_String(enum CCD_ORIENTATION_KERNEL kernel)
+{
+	if((kernel < CCD_ORIENTATION_KERNEL_AUTO)||(kernel > CCD_ORIENTATION_KERNEL_AVX2))
+		return "UNKNOWN";
+	return Orientation_Kernel_String_List[kernel];
+}
+
+/**
+ * Get the current value of ccd_orientation's error number.
+ * @return The current value of ccd_orientation's error number.
+ * @see #Orientation_Error_Number
+ */
+int CCD_Orientation_Get_Error_Number(void)
+{
+	return Orientation_Error_Number;
+}
+
+/**
+ * The error routine that reports any errors occuring in ccd_orientation in a standard way.
+ * @see CCD_General_Get_Current_Time_String
+ * @see #Orientation_Error_Number
+ * @see #Orientation_Error_String
+ */
+void CCD_Orientation_Error(void)
+{
+	char time_string[32];
+
+	CCD_General_Get_Current_Time_String(time_string,32);
+	/* if the error number is zero an error message has not been set up
+	** This is in itself an error as we should not be calling this routine
+	** without there being an error to display */
+	if(Orientation_Error_Number == 0)
+		sprintf(Orientation_Error_String,"Logic Error:No Error defined");
+	fprintf(stderr,"%s CCD_Orientation:Error(%d) : %s\n",time_string,Orientation_Error_Number,
+		Orientation_Error_String);
+}
+
+/**
+ * The error routine that reports any errors occuring in ccd_orientation in a standard way. This routine places the
+ * generated error string at the end of a passed in string argument.
+ * @param error_string A string to put the generated error in. This string should be initialised before
+ * being passed to this routine. The routine will try to concatenate it's error string onto the end
+ * of any string already in existance.
+ * @see CCD_General_Get_Current_Time_String
+ * @see #Orientation_Error_Number
+ * @see #Orientation_Error_String
+ */
+void CCD_Orientation_Error_String(char *error_string)
+{
+	char time_string[32];
+
+	CCD_General_Get_Current_Time_String(time_string,32);
+	/* if the error number is zero an error message has not been set up
+	** This is in itself an error as we should not be calling this routine
+	** without there being an error to display */
+	if(Orientation_Error_Number == 0)
+		sprintf(Orientation_Error_String,"Logic Error:No Error defined");
+	sprintf(error_string+strlen(error_string),"%s CCD_Orientation:Error(%d) : %s\n",time_string,
+		Orientation_Error_Number,Orientation_Error_String);
+}
+
+/* ----------------------------------------------------------------------------
+** 		internal functions
+** ---------------------------------------------------------------------------- */
+/**
+ * Check the parameters passed to CCD_Orientation_Apply / CCD_Orientation_Apply_Copy.
+ * @param orientation The orientation to check.
+ * @param ncols The number of columns in the image, which must be at least 1.
+ * @param nrows The number of rows in the image, which must be at least 1.
+ * @param buffer The image, which must not be NULL.
+ * @param function_name The name of the calling function, used in the error message.
+ * @return The routine returns TRUE if the parameters are legal, and FALSE otherwise.
+ * @see #Orientation_Error_Number
+ * @see #Orientation_Error_String
+ * @see #CCD_ORIENTATION_IS_ORIENTATION
+ */
+static int Orientation_Check(enum CCD_ORIENTATION orientation,int ncols,int nrows,const unsigned short *buffer,
+			     char *function_name)
+{
+	if(!CCD_ORIENTATION_IS_ORIENTATION(orientation))
+	{
+		Orientation_Error_Number = 10;
+		sprintf(Orientation_Error_String,"%s:Illegal orientation %d.",function_name,orientation);
+		return FALSE;
+	}
+	if((ncols < 1)||(nrows < 1))
+	{
+		Orientation_Error_Number = 11;
+		sprintf(Orientation_Error_String,"%s:Illegal image dimensions %d x %d.",function_name,ncols,nrows);
+		return FALSE;
+	}
+	if(buffer == NULL)
+	{
+		Orientation_Error_Number = 12;
+		sprintf(Orientation_Error_String,"%s:buffer was NULL.",function_name);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Return the kernel to use. If Orientation_Kernel is CCD_ORIENTATION_KERNEL_AUTO, we choose the AVX2 kernel
+ * if the CPU supports it, otherwise the SSE2 kernel if the CPU supports it, otherwise the scalar kernel, and
+ * save the choice in Orientation_Kernel.
+ * @return The kernel to use.
+ * @see #Orientation_Kernel
+ */
+static enum CCD_ORIENTATION_KERNEL Orientation_Kernel_Resolve(void)
+{
+	if(Orientation_Kernel == CCD_ORIENTATION_KERNEL_AUTO)
+	{
+#ifdef ORIENTATION_X86
+		if(__builtin_cpu_supports("avx2"))
+			Orientation_Kernel = CCD_ORIENTATION_KERNEL_AVX2;
+		else if(__builtin_cpu_supports("sse2"))
+			Orientation_Kernel = CCD_ORIENTATION_KERNEL_SSE2;
+		else
+			Orientation_Kernel = CCD_ORIENTATION_KERNEL_SCALAR;
+#else
+		Orientation_Kernel = CCD_ORIENTATION_KERNEL_SCALAR;
+#endif
+	}
+	return Orientation_Kernel;
+}
+
+/**
+ * Re-orient an image in place, for the orientations that do not swap the image's axes.
+ * <ul>
+ * <li>CCD_ORIENTATION_FLIP_X reverses each row.
+ * <li>CCD_ORIENTATION_FLIP_Y swaps the first row with the last, the second with the second to last, and so on.
+ * <li>CCD_ORIENTATION_ROTATE_180 reverses the whole image (which flips it in both directions at once).
+ * </ul>
+ * @param kernel The kernel to use.
+ * @param orientation The orientation to apply.
+ * @param ncols The number of columns in the image.
+ * @param nrows The number of rows in the image.
+ * @param buffer The image.
+ * @see #Orientation_Reverse_Span_Scalar
+ * @see #Orientation_Reverse_Span_SSE2
+ * @see #Orientation_Reverse_Span_AVX2
+ * @see #Orientation_Swap_Rows_Scalar
+ * @see #Orientation_Swap_Rows_SSE2
+ * @see #Orientation_Swap_Rows_AVX2
+ */
+static void Orientation_In_Place(enum CCD_ORIENTATION_KERNEL kernel,enum CCD_ORIENTATION orientation,int ncols,
+				 int nrows,unsigned short *buffer)
+{
+	void (*reverse_span)(unsigned short *left,unsigned short *right);
+	void (*swap_rows)(int ncols,int nrows,unsigned short *buffer);
+	size_t row_offset;
+	int y;
+
+	reverse_span = Orientation_Reverse_Span_Scalar;
+	swap_rows = Orientation_Swap_Rows_Scalar;
+#ifdef ORIENTATION_X86
+	if(kernel == CCD_ORIENTATION_KERNEL_SSE2)
+	{
+		reverse_span = Orientation_Reverse_Span_SSE2;
+		swap_rows = Orientation_Swap_Rows_SSE2;
+	}
+	else if(kernel == CCD_ORIENTATION_KERNEL_AVX2)
+	{
+		reverse_span = Orientation_Reverse_Span_AVX2;
+		swap_rows = Orientation_Swap_Rows_AVX2;
+	}
+#endif
+	switch(orientation)
+	{
+		case CCD_ORIENTATION_FLIP_X:
+			for(y = 0; y < nrows; y++)
+			{
+				row_offset = ((size_t)y)*((size_t)ncols);
+				reverse_span(buffer+row_offset,buffer+row_offset+ncols);
+			}
+			break;
+		case CCD_ORIENTATION_FLIP_Y:
+			swap_rows(ncols,nrows,buffer);
+			break;
+		case CCD_ORIENTATION_ROTATE_180:
+			reverse_span(buffer,buffer+(((size_t)ncols)*((size_t)nrows)));
+			break;
+		default:
+			break;
+	}
+}
+
+/**
+ * Re-orient an image into a different buffer, for the orientations that swap the image's axes.
+ * @param kernel The kernel to use.
+ * @param orientation The orientation to apply.
+ * @param ncols The number of columns in the input image.
+ * @param nrows The number of rows in the input image.
+ * @param input_buffer The input image.
+ * @param output_buffer The buffer to write the re-oriented image (nrows columns by ncols rows) into.
+ * @see #Orientation_Transpose_Scalar
+ * @see #Orientation_Transpose_SSE2
+ */
+static void Orientation_Transpose(enum CCD_ORIENTATION_KERNEL kernel,enum CCD_ORIENTATION orientation,int ncols,
+				  int nrows,const unsigned short *input_buffer,unsigned short *output_buffer)
+{
+#ifdef ORIENTATION_X86
+	/* the AVX2 kernel uses the SSE2 8x8 block transpose: 16-bit transposes need shuffles across the
+	** 128-bit AVX2 lanes, which gain nothing over two SSE2 blocks */
+	if((kernel == CCD_ORIENTATION_KERNEL_SSE2)||(kernel == CCD_ORIENTATION_KERNEL_AVX2))
+	{
+		Orientation_Transpose_SSE2(orientation,ncols,nrows,input_buffer,output_buffer);
+		return;
+	}
+#endif
+	Orientation_Transpose_Scalar(orientation,ncols,nrows,input_buffer,output_buffer);
+}
+
+/**
+ * Reverse the order of the pixels between left and right.
+ * @param left The address of the first pixel.
+ * @param right The address after the last pixel.
+ */
+static void Orientation_Reverse_Span_Scalar(unsigned short *left,unsigned short *right)
+{
+	unsigned short tempval;
+
+	while((right-left) > 1)
+	{
+		right--;
+		tempval = (*left);
+		(*left) = (*right);
+		(*right) = tempval;
+		left++;
+	}
+}
+
+/**
+ * Flip an image in the vertical (Y) direction, by swapping each row in the top half of the image with the
+ * corresponding row in the bottom half. The middle row (if any) does not move.
+ * @param ncols The number of columns in the image.
+ * @param nrows The number of rows in the image.
+ * @param buffer The image.
+ */
+static void Orientation_Swap_Rows_Scalar(int ncols,int nrows,unsigned short *buffer)
+{
+	unsigned short *top = NULL;
+	unsigned short *bottom = NULL;
+	unsigned short tempval;
+	int x,y;
+
+	for(y = 0; y < (nrows/2); y++)
+	{
+		top = buffer+(((size_t)y)*((size_t)ncols));
+		bottom = buffer+(((size_t)(nrows-(y+1)))*((size_t)ncols));
+		for(x = 0; x < ncols; x++)
+		{
+			tempval = top[x];
+			top[x] = bottom[x];
+			bottom[x] = tempval;
+		}
+	}
+}
+
+/**
+ * Copy one tile of an image into the output buffer, for the orientations that swap the image's axes.
+ * The input pixel (x,y) is written to output column y (or nrows-1-y if the orientation reverses the output rows),
+ * output row x (or ncols-1-x if the orientation reverses the output row order).
+ * @param orientation The orientation to apply (a transposing one).
+ * @param ncols The number of columns in the input image.
+ * @param nrows The number of rows in the input image.
+ * @param input_buffer The input image.
+ * @param output_buffer The output image.
+ * @param x_start The first input column in the tile.
+ * @param y_start The first input row in the tile.
+ * @param x_end The input column after the last one in the tile.
+ * @param y_end The input row after the last one in the tile.
+ */
+static void Orientation_Transpose_Tile_Scalar(enum CCD_ORIENTATION orientation,int ncols,int nrows,
+					      const unsigned short *input_buffer,unsigned short *output_buffer,
+					      int x_start,int y_start,int x_end,int y_end)
+{
+	int x,y,reverse_row,reverse_order,output_x,output_y;
+
+	reverse_row = (orientation == CCD_ORIENTATION_ROTATE_90)||(orientation == CCD_ORIENTATION_TRANSVERSE);
+	reverse_order = (orientation == CCD_ORIENTATION_ROTATE_270)||(orientation == CCD_ORIENTATION_TRANSVERSE);
+	for(y = y_start; y < y_end; y++)
+	{
+		output_x = reverse_row ? (nrows-1-y) : y;
+		for(x = x_start; x < x_end; x++)
+		{
+			output_y = reverse_order ? (ncols-1-x) : x;
+			output_buffer[(((size_t)output_y)*((size_t)nrows))+output_x] =
+				input_buffer[(((size_t)y)*((size_t)ncols))+x];
+		}
+	}
+}
+
+/**
+ * Re-orient an image into a different buffer, for the orientations that swap the image's axes,
+ * one ORIENTATION_TILE_SIZE square tile at a time.
+ * @param orientation The orientation to apply (a transposing one).
+ * @param ncols The number of columns in the input image.
+ * @param nrows The number of rows in the input image.
+ * @param input_buffer The input image.
+ * @param output_buffer The output image.
+ * @see #ORIENTATION_TILE_SIZE
+ * @see #Orientation_Transpose_Tile_Scalar
+ */
+static void Orientation_Transpose_Scalar(enum CCD_ORIENTATION orientation,int ncols,int nrows,
+					 const unsigned short *input_buffer,unsigned short *output_buffer)
+{
+	int tile_x,tile_y;
+
+	for(tile_y = 0; tile_y < nrows; tile_y += ORIENTATION_TILE_SIZE)
+	{
+		for(tile_x = 0; tile_x < ncols; tile_x += ORIENTATION_TILE_SIZE)
+		{
+			Orientation_Transpose_Tile_Scalar(orientation,ncols,nrows,input_buffer,output_buffer,tile_x,tile_y,
+							  ORIENTATION_MIN(tile_x+ORIENTATION_TILE_SIZE,ncols),
+							  ORIENTATION_MIN(tile_y+ORIENTATION_TILE_SIZE,nrows));
+		}
+	}
+}
+
+#ifdef ORIENTATION_X86
+/**
+ * Reverse the order of the 8 pixels in an SSE2 register.
+ * @param value The pixels.
+ * @return The reversed pixels.
+ */
+static inline __attribute__((target("sse2"))) __m128i Orientation_Reverse_8_SSE2(__m128i value)
+{
+	value = _mm_shufflelo_epi16(value,_MM_SHUFFLE(0,1,2,3));
+	value = _mm_shufflehi_epi16(value,_MM_SHUFFLE(0,1,2,3));
+	return _mm_shuffle_epi32(value,_MM_SHUFFLE(1,0,3,2));
+}
+
+/**
+ * Reverse the order of the pixels between left and right, 8 pixels at a time from each end.
+ * The pixels left in the middle are reversed using Orientation_Reverse_Span_Scalar.
+ * @param left The address of the first pixel.
+ * @param right The address after the last pixel.
+ * @see #Orientation_Reverse_8_SSE2
+ * @see #Orientation_Reverse_Span_Scalar
+ */
+static __attribute__((target("sse2"))) void Orientation_Reverse_Span_SSE2(unsigned short *left,unsigned short *right)
+{
+	__m128i left_value,right_value;
+
+	while((right-left) >= 16)
+	{
+		left_value = _mm_loadu_si128((const __m128i *)left);
+		right_value = _mm_loadu_si128((const __m128i *)(right-8));
+		_mm_storeu_si128((__m128i *)left,Orientation_Reverse_8_SSE2(right_value));
+		_mm_storeu_si128((__m128i *)(right-8),Orientation_Reverse_8_SSE2(left_value));
+		left += 8;
+		right -= 8;
+	}
+	Orientation_Reverse_Span_Scalar(left,right);
+}
+
+/**
+ * Flip an image in the vertical (Y) direction, by swapping rows 8 pixels at a time.
+ * @param ncols The number of columns in the image.
+ * @param nrows The number of rows in the image.
+ * @param buffer The image.
+ */
+static __attribute__((target("sse2"))) void Orientation_Swap_Rows_SSE2(int ncols,int nrows,unsigned short *buffer)
+{
+	unsigned short *top = NULL;
+	unsigned short *bottom = NULL;
+	unsigned short tempval;
+	__m128i top_value,bottom_value;
+	int x,y;
+
+	for(y = 0; y < (nrows/2); y++)
+	{
+		top = buffer+(((size_t)y)*((size_t)ncols));
+		bottom = buffer+(((size_t)(nrows-(y+1)))*((size_t)ncols));
+		for(x = 0; x <= (ncols-8); x += 8)
+		{
+			top_value = _mm_loadu_si128((const __m128i *)(top+x));
+			bottom_value = _mm_loadu_si128((const __m128i *)(bottom+x));
+			_mm_storeu_si128((__m128i *)(top+x),bottom_value);
+			_mm_storeu_si128((__m128i *)(bottom+x),top_value);
+		}
+		for(; x < ncols; x++)
+		{
+			tempval = top[x];
+			top[x] = bottom[x];
+			bottom[x] = tempval;
+		}
+	}
+}
+
+/**
+ * Transpose one 8x8 block of pixels, and write it to the output image, for the orientations that swap the
+ * image's axes. See Orientation_Transpose_Tile_Scalar for where each pixel is written.
+ * @param reverse_row Whether the orientation reverses each output row (ROTATE_90 / TRANSVERSE).
+ * @param reverse_order Whether the orientation reverses the order of the output rows (ROTATE_270 / TRANSVERSE).
+ * @param ncols The number of columns in the input image.
+ * @param nrows The number of rows in the input image.
+ * @param input_buffer The input image.
+ * @param output_buffer The output image.
+ * @param x The first input column in the block.
+ * @param y The first input row in the block.
+ * @see #Orientation_Reverse_8_SSE2
+ * @see #Orientation_Transpose_Tile_Scalar
+ */
+static inline __attribute__((target("sse2"))) void Orientation_Transpose_Block_SSE2(int reverse_row,int reverse_order,
+							int ncols,int nrows,const unsigned short *input_buffer,
+							unsigned short *output_buffer,int x,int y)
+{
+	__m128i row[8],pair[8],quad[8],column;
+	size_t output_x,output_y;
+	int i;
+
+	for(i = 0; i < 8; i++)
+		row[i] = _mm_loadu_si128((const __m128i *)(input_buffer+(((size_t)(y+i))*((size_t)ncols))+x));
+	/* interleave 16-bit pixels from pairs of rows */
+	for(i = 0; i < 4; i++)
+	{
+		pair[2*i] = _mm_unpacklo_epi16(row[2*i],row[(2*i)+1]);
+		pair[(2*i)+1] = _mm_unpackhi_epi16(row[2*i],row[(2*i)+1]);
+	}
+	/* interleave 32-bit pixel pairs from pairs of pairs */
+	quad[0] = _mm_unpacklo_epi32(pair[0],pair[2]);
+	quad[1] = _mm_unpackhi_epi32(pair[0],pair[2]);
+	quad[2] = _mm_unpacklo_epi32(pair[1],pair[3]);
+	quad[3] = _mm_unpackhi_epi32(pair[1],pair[3]);
+	quad[4] = _mm_unpacklo_epi32(pair[4],pair[6]);
+	quad[5] = _mm_unpackhi_epi32(pair[4],pair[6]);
+	quad[6] = _mm_unpacklo_epi32(pair[5],pair[7]);
+	quad[7] = _mm_unpackhi_epi32(pair[5],pair[7]);
+	/* each 64-bit half now holds 4 rows of one column, combine the halves into whole columns and write them out */
+	output_x = reverse_row ? ((size_t)(nrows-8-y)) : ((size_t)y);
+	for(i = 0; i < 8; i++)
+	{
+		if(i & 1)
+			column = _mm_unpackhi_epi64(quad[i/2],quad[(i/2)+4]);
+		else
+			column = _mm_unpacklo_epi64(quad[i/2],quad[(i/2)+4]);
+		if(reverse_row)
+			column = Orientation_Reverse_8_SSE2(column);
+		output_y = reverse_order ? ((size_t)(ncols-1-(x+i))) : ((size_t)(x+i));
+		_mm_storeu_si128((__m128i *)(output_buffer+(output_y*((size_t)nrows))+output_x),column);
+	}
+}
+
+/**
+ * Re-orient an image into a different buffer, for the orientations that swap the image's axes,
+ * one ORIENTATION_TILE_SIZE square tile at a time. Within each tile, whole 8x8 blocks are transposed using
+ * Orientation_Transpose_Block_SSE2, and the pixels at the right and bottom edges of the image that do not
+ * fill a block are copied using Orientation_Transpose_Tile_Scalar.
+ * @param orientation The orientation to apply (a transposing one).
+ * @param ncols The number of columns in the input image.
+ * @param nrows The number of rows in the input image.
+ * @param input_buffer The input image.
+ * @param output_buffer The output image.
+ * @see #ORIENTATION_TILE_SIZE
+ * @see #Orientation_Transpose_Block_SSE2
+ * @see #Orientation_Transpose_Tile_Scalar
+ */
+static __attribute__((target("sse2"))) void Orientation_Transpose_SSE2(enum CCD_ORIENTATION orientation,int ncols,
+				int nrows,const unsigned short *input_buffer,unsigned short *output_buffer)
+{
+	int tile_x,tile_y,x_end,y_end,block_x_end,block_y_end,x,y,reverse_row,reverse_order;
+
+	reverse_row = (orientation == CCD_ORIENTATION_ROTATE_90)||(orientation == CCD_ORIENTATION_TRANSVERSE);
+	reverse_order = (orientation == CCD_ORIENTATION_ROTATE_270)||(orientation == CCD_ORIENTATION_TRANSVERSE);
+	for(tile_y = 0; tile_y < nrows; tile_y += ORIENTATION_TILE_SIZE)
+	{
+		y_end = ORIENTATION_MIN(tile_y+ORIENTATION_TILE_SIZE,nrows);
+		block_y_end = tile_y+(((y_end-tile_y)/8)*8);
+		for(tile_x = 0; tile_x < ncols; tile_x += ORIENTATION_TILE_SIZE)
+		{
+			x_end = ORIENTATION_MIN(tile_x+ORIENTATION_TILE_SIZE,ncols);
+			block_x_end = tile_x+(((x_end-tile_x)/8)*8);
+			for(y = tile_y; y < block_y_end; y += 8)
+			{
+				for(x = tile_x; x < block_x_end; x += 8)
+				{
+					Orientation_Transpose_Block_SSE2(reverse_row,reverse_order,ncols,nrows,
+									 input_buffer,output_buffer,x,y);
+				}
+			}
+			/* right edge of the tile */
+			if(block_x_end < x_end)
+			{
+				Orientation_Transpose_Tile_Scalar(orientation,ncols,nrows,input_buffer,output_buffer,
+								  block_x_end,tile_y,x_end,y_end);
+			}
+			/* bottom edge of the tile */
+			if(block_y_end < y_end)
+			{
+				Orientation_Transpose_Tile_Scalar(orientation,ncols,nrows,input_buffer,output_buffer,
+								  tile_x,block_y_end,block_x_end,y_end);
+			}
+		}
+	}
+}
+
+/**
+ * Reverse the order of the 16 pixels in an AVX2 register.
+ * @param value The pixels.
+ * @return The reversed pixels.
+ */
+static inline __attribute__((target("avx2"))) __m256i Orientation_Reverse_16_AVX2(__m256i value)
+{
+	const __m256i reverse_mask = _mm256_setr_epi8(14,15,12,13,10,11,8,9,6,7,4,5,2,3,0,1,
+						      14,15,12,13,10,11,8,9,6,7,4,5,2,3,0,1);
+
+	/* reverse the pixels within each 128-bit lane, then swap the lanes */
+	value = _mm256_shuffle_epi8(value,reverse_mask);
+	return _mm256_permute4x64_epi64(value,_MM_SHUFFLE(1,0,3,2));
+}
+
+/**
+ * Reverse the order of the pixels between left and right, 16 pixels at a time from each end.
+ * The pixels left in the middle are reversed using Orientation_Reverse_Span_SSE2.
+ * @param left The address of the first pixel.
+ * @param right The address after the last pixel.
+ * @see #Orientation_Reverse_16_AVX2
+ * @see #Orientation_Reverse_Span_SSE2
+ */
+static __attribute__((target("avx2"))) void Orientation_Reverse_Span_AVX2(unsigned short *left,unsigned short *right)
+{
+	__m256i left_value,right_value;
+
+	while((right-left) >= 32)
+	{
+		left_value = _mm256_loadu_si256((const __m256i *)left);
+		right_value = _mm256_loadu_si256((const __m256i *)(right-16));
+		_mm256_storeu_si256((__m256i *)left,Orientation_Reverse_16_AVX2(right_value));
+		_mm256_storeu_si256((__m256i *)(right-16),Orientation_Reverse_16_AVX2(left_value));
+		left += 16;
+		right -= 16;
+	}
+	Orientation_Reverse_Span_SSE2(left,right);
+}
+
+/**
+ * Flip an image in the vertical (Y) direction, by swapping rows 16 pixels at a time.
+ * @param ncols The number of columns in the image.
+ * @param nrows The number of rows in the image.
+ * @param buffer The image.
+ */
+static __attribute__((target("avx2"))) void Orientation_Swap_Rows_AVX2(int ncols,int nrows,unsigned short *buffer)
+{
+	unsigned short *top = NULL;
+	unsigned short *bottom = NULL;
+	unsigned short tempval;
+	__m256i top_value,bottom_value;
+	int x,y;
+
+	for(y = 0; y < (nrows/2); y++)
+	{
+		top = buffer+(((size_t)y)*((size_t)ncols));
+		bottom = buffer+(((size_t)(nrows-(y+1)))*((size_t)ncols));
+		for(x = 0; x <= (ncols-16); x += 16)
+		{
+			top_value = _mm256_loadu_si256((const __m256i *)(top+x));
+			bottom_value = _mm256_loadu_si256((const __m256i *)(bottom+x));
+			_mm256_storeu_si256((__m256i *)(top+x),bottom_value);
+			_mm256_storeu_si256((__m256i *)(bottom+x),top_value);
+		}
+		for(; x < ncols; x++)
+		{
+			tempval = top[x];
+			top[x] = bottom[x];
+			bottom[x] = tempval;
+		}
+	}
+}
+#endif
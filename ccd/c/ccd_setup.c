@@ -30,12 +30,14 @@
 #include <math.h>
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/mman.h>
 #ifndef _POSIX_TIMERS
 #include <sys/time.h>
 #endif
 #include <time.h>
 #include "atmcdLXd.h"
 #include "ccd_general.h"
+#include "ccd_orientation.h"
 #include "ccd_setup.h"
 
 
@@ -45,6 +47,11 @@
  */
 #define CAMERA_HEAD_MODEL_NAME_LENGTH   (128)
 
+/**
+ * Macro to round a length up to the next multiple of alignment.
+ */
+#define SETUP_ROUND_UP(length,alignment) ((((length)+(alignment)-1)/(alignment))*(alignment))
+
 /* data types */
 /**
  * Data type holding local data to ccd_setup. 
@@ -97,6 +104,8 @@ struct Setup_Struct
 	int Flip_X;
 	/** A boolean - if true the exposure code wil flip the image in the vertical/Y direction. */
 	int Flip_Y;
+	/** How the exposure code re-orients the read out image. Kept consistent with Flip_X and Flip_Y. */
+	enum CCD_ORIENTATION Orientation;
 	/** The length of time, in milliseconds, to allow for the shutter opening. Used as a parameter to SetShutter */
 	int Shutter_Open_Time;
 	/** The length of time, in milliseconds, to allow for the shutter closing. Used as a parameter to SetShutter */
@@ -126,7 +135,7 @@ static char Setup_Error_String[CCD_GENERAL_ERROR_STRING_LENGTH] = "";
  */
 static struct Setup_Struct Setup_Data = 
 {
-	NULL,0,0,"",0,0,0,0,0,FALSE,0,0,0,0,0,0.0,0,0.0,0,FALSE,FALSE,0,0
+	NULL,0,0,"",0,0,0,0,0,FALSE,0,0,0,0,0,0.0,0,0.0,0,FALSE,FALSE,CCD_ORIENTATION_NONE,0,0
 };
 
 /* ----------------------------------------------------------------------------
@@ -850,10 +859,12 @@ int CCD_Setup_Set_Pre_Amp_Gain(int pre_amp_gain_index)
 
 /**
  * Routine to set whether the exposure code will flip the read out image in the horizontal/X direction.
- * This just sets a flag in Setup_Data which is retrieved by the exposure code.
+ * This just sets a flag in Setup_Data which is retrieved by the exposure code. The orientation is recalculated
+ * from the two flip flags, so any rotation set by CCD_Setup_Set_Orientation is replaced.
  * @param flip_x Whether to flip the readout data in the horizontal/X direction - a boolean.
  * @see #Setup_Data
  * @see CCD_GENERAL_IS_BOOLEAN
+ * @see CCD_Orientation_From_Flips
  */
 int CCD_Setup_Set_Flip_X(int flip_x)
 {
@@ -868,15 +879,18 @@ int CCD_Setup_Set_Flip_X(int flip_x)
 			       "Setting flipping of the image in the X direction to %d.",flip_x);
 #endif /* LOGGING */
 	Setup_Data.Flip_X = flip_x;
+	Setup_Data.Orientation = CCD_Orientation_From_Flips(Setup_Data.Flip_X,Setup_Data.Flip_Y);
 	return TRUE;
 }
 
 /**
  * Routine to set whether the exposure code will flip the read out image in the vertical/Y direction.
- * This just sets a flag in Setup_Data which is retrieved by the exposure code.
+ * This just sets a flag in Setup_Data which is retrieved by the exposure code. The orientation is recalculated
+ * from the two flip flags, so any rotation set by CCD_Setup_Set_Orientation is replaced.
  * @param flip_y Whether to flip the readout data in the vertical/Y direction - a boolean.
  * @see #Setup_Data
  * @see CCD_GENERAL_IS_BOOLEAN
+ * @see CCD_Orientation_From_Flips
  */
 int CCD_Setup_Set_Flip_Y(int flip_y)
 {
@@ -891,6 +905,38 @@ int CCD_Setup_Set_Flip_Y(int flip_y)
 			       "Setting flipping of the image in the Y direction to %d.",flip_y);
 #endif /* LOGGING */
 	Setup_Data.Flip_Y = flip_y;
+	Setup_Data.Orientation = CCD_Orientation_From_Flips(Setup_Data.Flip_X,Setup_Data.Flip_Y);
+	return TRUE;
+}
+
+/**
+ * Routine to set how the exposure code will re-orient the read out image (flip, rotate or transpose it).
+ * This sets Setup_Data.Orientation, which is retrieved by the exposure code. Flip_X and Flip_Y are
+ * also set, to TRUE if the orientation flips the image in that direction (a 180 degree rotation flips it
+ * in both), so CCD_Setup_Get_Flip_X / CCD_Setup_Get_Flip_Y still describe the image.
+ * Orientations that swap the image's axes leave both flips FALSE.
+ * @param orientation The orientation, which must be a legal CCD_ORIENTATION.
+ * @return The routine returns TRUE on success, and FALSE if an error occurs.
+ * @see #Setup_Data
+ * @see CCD_ORIENTATION_IS_ORIENTATION
+ * @see CCD_Orientation_To_String
+ */
+int CCD_Setup_Set_Orientation(enum CCD_ORIENTATION orientation)
+{
+	if(!CCD_ORIENTATION_IS_ORIENTATION(orientation))
+	{
+		Setup_Error_Number = 66;
+		sprintf(Setup_Error_String,"CCD_Setup_Set_Orientation: Argument orientation (%d) was not legal.",
+			orientation);
+		return FALSE;
+	}
+#if LOGGING > 1
+	CCD_General_Log_Format("setup","ccd_setup.c","CCD_Setup_Set_Orientation",LOG_VERBOSITY_TERSE,"CCD",
+			       "Setting the orientation of the image to %s.",CCD_Orientation_To_String(orientation));
+#endif /* LOGGING */
+	Setup_Data.Orientation = orientation;
+	Setup_Data.Flip_X = ((orientation == CCD_ORIENTATION_FLIP_X)||(orientation == CCD_ORIENTATION_ROTATE_180));
+	Setup_Data.Flip_Y = ((orientation == CCD_ORIENTATION_FLIP_Y)||(orientation == CCD_ORIENTATION_ROTATE_180));
 	return TRUE;
 }
 
@@ -964,6 +1010,74 @@ int CCD_Setup_Get_NRows(void)
 	return (Setup_Data.Vertical_End - Setup_Data.Vertical_Start)+1;
 }
 
+/**
+ * Get the number of binned columns that will be read out, with the dimensions, binning and window
+ * setup by the last CCD_Setup_Dimensions. This is the X size of the read out image. CCD_Setup_Dimensions checks
+ * the (windowed) number of columns is an exact multiple of the binning.
+ * @return The number of binned columns, or 0 if the binning has not been setup.
+ * @see #Setup_Data
+ * @see #CCD_Setup_Get_NCols
+ */
+int CCD_Setup_Get_Binned_NCols(void)
+{
+	if(Setup_Data.Horizontal_Bin < 1)
+		return 0;
+	return CCD_Setup_Get_NCols()/Setup_Data.Horizontal_Bin;
+}
+
+/**
+ * Get the number of binned rows that will be read out, with the dimensions, binning and window
+ * setup by the last CCD_Setup_Dimensions. This is the Y size of the read out image. CCD_Setup_Dimensions checks
+ * the (windowed) number of rows is an exact multiple of the binning.
+ * @return The number of binned rows, or 0 if the binning has not been setup.
+ * @see #Setup_Data
+ * @see #CCD_Setup_Get_NRows
+ */
+int CCD_Setup_Get_Binned_NRows(void)
+{
+	if(Setup_Data.Vertical_Bin < 1)
+		return 0;
+	return CCD_Setup_Get_NRows()/Setup_Data.Vertical_Bin;
+}
+
+/**
+ * Get the number of columns in the image returned by the exposure code, i.e. after it has been re-oriented.
+ * This is the number of binned columns, unless the orientation swaps the image's axes, in which
+ * case it is the number of binned rows.
+ * @return The number of columns in the re-oriented image, or 0 if the binning has not been setup.
+ * @see #Setup_Data
+ * @see #CCD_Setup_Get_Binned_NCols
+ * @see #CCD_Setup_Get_Binned_NRows
+ * @see CCD_Orientation_Get_Dimensions
+ */
+int CCD_Setup_Get_Image_NCols(void)
+{
+	int ncols,nrows;
+
+	CCD_Orientation_Get_Dimensions(Setup_Data.Orientation,CCD_Setup_Get_Binned_NCols(),
+				       CCD_Setup_Get_Binned_NRows(),&ncols,&nrows);
+	return ncols;
+}
+
+/**
+ * Get the number of rows in the image returned by the exposure code, i.e. after it has been re-oriented.
+ * This is the number of binned rows, unless the orientation swaps the image's axes, in which
+ * case it is the number of binned columns.
+ * @return The number of rows in the re-oriented image, or 0 if the binning has not been setup.
+ * @see #Setup_Data
+ * @see #CCD_Setup_Get_Binned_NCols
+ * @see #CCD_Setup_Get_Binned_NRows
+ * @see CCD_Orientation_Get_Dimensions
+ */
+int CCD_Setup_Get_Image_NRows(void)
+{
+	int ncols,nrows;
+
+	CCD_Orientation_Get_Dimensions(Setup_Data.Orientation,CCD_Setup_Get_Binned_NCols(),
+				       CCD_Setup_Get_Binned_NRows(),&ncols,&nrows);
+	return nrows;
+}
+
 /**
  * Routine that returns the column binning factor the last dimension setup has set the CCD Controller to. 
  * This is the number passed into CCD_Setup_Dimensions.
@@ -1080,6 +1194,16 @@ int CCD_Setup_Get_Flip_Y(void)
 	return Setup_Data.Flip_Y;
 }
 
+/**
+ * Return how the exposure code re-orients the read out image.
+ * @return The orientation.
+ * @see #Setup_Data
+ */
+enum CCD_ORIENTATION CCD_Setup_Get_Orientation(void)
+{
+	return Setup_Data.Orientation;
+}
+
 /**
  * Return the number of milliseconds configured to open the shutter.
  * @return The length of time configured to allow for the opening of the shutter, in milliseconds.
@@ -1207,11 +1331,14 @@ int CCD_Setup_Get_Pre_Amp_Gain_Index(void)
 
 /**
  * Return the length of buffer required to hold one image with the current setup.
+ * This is the number of binned pixels in the read out area, i.e. the sub-window if one was specified
+ * in the last CCD_Setup_Dimensions, otherwise the full frame. This is the number of pixels GetAcquiredData16 
+ * returns.
  * @param buffer_length The address of a size_t to hold required length of buffer in pixels. 
  *        These will be binned pixels.
  * @return The routine returns TRUE on success and FALSE if an error occurs.
- * @see #CCD_Setup_Get_NCols
- * @see #CCD_Setup_Get_NRows
+ * @see #CCD_Setup_Get_Binned_NCols
+ * @see #CCD_Setup_Get_Binned_NRows
  * @see #CCD_Setup_Get_Bin_X
  * @see #CCD_Setup_Get_Bin_Y
  */
@@ -1235,23 +1362,26 @@ int CCD_Setup_Get_Buffer_Length(size_t *buffer_length)
 		sprintf(Setup_Error_String,"CCD_Setup_Get_Buffer_Length:Y Binning is 0.");
 		return FALSE;
 	}
-	(*buffer_length) = (size_t)((CCD_Setup_Get_NCols() * CCD_Setup_Get_NRows())/
-				    (CCD_Setup_Get_Bin_X() * CCD_Setup_Get_Bin_Y()));
+	(*buffer_length) = ((size_t)CCD_Setup_Get_Binned_NCols())*((size_t)CCD_Setup_Get_Binned_NRows());
 #if LOGGING > 9
 	CCD_General_Log_Format("setup","ccd_setup.c","CCD_Setup_Get_Buffer_Length",LOG_VERBOSITY_VERBOSE,"CCD",
-			       "buffer_length %ld pixels = (ncols %d x nrows %d) / (binx %d x biny %d).",
-			       (*buffer_length),CCD_Setup_Get_NCols(),CCD_Setup_Get_NRows(),
-			       CCD_Setup_Get_Bin_X(),CCD_Setup_Get_Bin_Y());
+			       "buffer_length %ld pixels = (ncols %d / binx %d) x (nrows %d / biny %d).",
+			       (*buffer_length),CCD_Setup_Get_NCols(),CCD_Setup_Get_Bin_X(),
+			       CCD_Setup_Get_NRows(),CCD_Setup_Get_Bin_Y());
 #endif
 	return TRUE;
 }
 
 /**
- * Allocate memory to hold a single image using the current setup.
+ * Allocate memory to hold a single image using the current setup. The memory is aligned to 
+ * CCD_SETUP_BUFFER_POOL_ALIGNMENT bytes, and should be freed using free. Code that reads out images repeatedly
+ * should use a buffer pool (CCD_Setup_Buffer_Pool_Create) instead.
  * @param buffer The address of a pointer to store the location of the allocated memory.
  * @param buffer_length The address of a size_t to hold the length of the buffer in bytes.
  * @return The routine returns TRUE on success, and FALSE if an error occurs.
  * @see #CCD_Setup_Get_Buffer_Length
+ * @see #SETUP_ROUND_UP
+ * @see #CCD_SETUP_BUFFER_POOL_ALIGNMENT
  */
 int CCD_Setup_Allocate_Image_Buffer(void **buffer,size_t *buffer_length)
 {
@@ -1276,7 +1406,9 @@ int CCD_Setup_Allocate_Image_Buffer(void **buffer,size_t *buffer_length)
 	if(!CCD_Setup_Get_Buffer_Length(&binned_pixel_count))
 		return FALSE;
 	(*buffer_length) = binned_pixel_count*sizeof(unsigned short);
-	(*buffer) = (void *)malloc((*buffer_length));
+	/* aligned_alloc requires the allocated length to be a multiple of the alignment */
+	(*buffer) = aligned_alloc(CCD_SETUP_BUFFER_POOL_ALIGNMENT,
+				  SETUP_ROUND_UP((*buffer_length),CCD_SETUP_BUFFER_POOL_ALIGNMENT));
 	if((*buffer) == NULL)
 	{
 		Setup_Error_Number = 33;
@@ -1291,6 +1423,338 @@ int CCD_Setup_Allocate_Image_Buffer(void **buffer,size_t *buffer_length)
 	return TRUE;
 }
 
+/**
+ * Initialise a buffer pool structure to a known (empty) state. This should be called on a pool
+ * before CCD_Setup_Buffer_Pool_Create is called on it.
+ * @param pool The address of the pool to initialise.
+ * @see #CCD_Setup_Buffer_Pool_Struct
+ */
+void CCD_Setup_Buffer_Pool_Initialise(struct CCD_Setup_Buffer_Pool_Struct *pool)
+{
+	if(pool == NULL)
+		return;
+	pool->Memory = NULL;
+	pool->Memory_Length = 0;
+	pool->Buffer_Pixel_Count = 0;
+	pool->Buffer_Stride = 0;
+	pool->Buffer_Count = 0;
+	pool->Free_List = NULL;
+	pool->Free_Count = 0;
+	pool->Is_Huge_Page = FALSE;
+	pool->Is_Locked = FALSE;
+	pool->Exhausted_Count = 0;
+}
+
+/**
+ * Create a pool of image buffers. All the buffers are allocated up front in one anonymous mapping, so
+ * reading out a series of images never allocates memory:
+ * <ul>
+ * <li>If buffer_pixel_count is zero, we size the buffers for the current binning and window using 
+ *     CCD_Setup_Get_Buffer_Length.
+ * <li>Each buffer is rounded up to a multiple of CCD_SETUP_BUFFER_POOL_ALIGNMENT bytes, so every buffer 
+ *     starts on a cache line.
+ * <li>If CCD_SETUP_BUFFER_POOL_FLAG_HUGE_PAGE is set in flags, we round the mapping up to a multiple of 
+ *     CCD_SETUP_BUFFER_POOL_HUGE_PAGE_LENGTH and try to map it with MAP_HUGETLB. If no huge pages are reserved
+ *     this fails, and we map normal pages and ask for transparent huge pages using madvise(MADV_HUGEPAGE) instead.
+ * <li>If CCD_SETUP_BUFFER_POOL_FLAG_LOCK is set in flags, we lock the mapping into RAM using mlock. If this
+ *     fails (normally because RLIMIT_MEMLOCK is too small) we log the failure and carry on with an unlocked pool.
+ * <li>We write to every page of the mapping, so the pages are faulted in now rather than during a readout.
+ * <li>We put all the buffers on the free list.
+ * </ul>
+ * @param pool The address of a pool, previously initialised with CCD_Setup_Buffer_Pool_Initialise.
+ * @param buffer_count The number of buffers in the pool, which must be at least 1.
+ * @param buffer_pixel_count The number of pixels each buffer must hold, or zero to use the current 
+ *        binning and window.
+ * @param flags A bit-field of CCD_SETUP_BUFFER_POOL_FLAG_HUGE_PAGE and CCD_SETUP_BUFFER_POOL_FLAG_LOCK.
+ * @return The routine returns TRUE on success, and FALSE if an error occurs.
+ * @see #CCD_Setup_Buffer_Pool_Struct
+ * @see #CCD_Setup_Get_Buffer_Length
+ * @see #SETUP_ROUND_UP
+ * @see #CCD_SETUP_BUFFER_POOL_ALIGNMENT
+ * @see #CCD_SETUP_BUFFER_POOL_HUGE_PAGE_LENGTH
+ * @see #CCD_SETUP_BUFFER_POOL_FLAG_HUGE_PAGE
+ * @see #CCD_SETUP_BUFFER_POOL_FLAG_LOCK
+ */
+int CCD_Setup_Buffer_Pool_Create(struct CCD_Setup_Buffer_Pool_Struct *pool,int buffer_count,
+				 size_t buffer_pixel_count,int flags)
+{
+	size_t buffer_stride,memory_length;
+	void *memory = NULL;
+	int i,is_huge_page,is_locked;
+
+	Setup_Error_Number = 0;
+	if(pool == NULL)
+	{
+		Setup_Error_Number = 50;
+		sprintf(Setup_Error_String,"CCD_Setup_Buffer_Pool_Create:pool was NULL.");
+		return FALSE;
+	}
+	if(pool->Memory != NULL)
+	{
+		Setup_Error_Number = 51;
+		sprintf(Setup_Error_String,"CCD_Setup_Buffer_Pool_Create:pool has already been created.");
+		return FALSE;
+	}
+	if(buffer_pixel_count == 0)
+	{
+		if(!CCD_Setup_Get_Buffer_Length(&buffer_pixel_count))
+			return FALSE;
+	}
+	if((buffer_count < 1)||(buffer_pixel_count < 1))
+	{
+		Setup_Error_Number = 52;
+		sprintf(Setup_Error_String,"CCD_Setup_Buffer_Pool_Create:Illegal buffer count %d or "
+			"buffer pixel count %lu.",buffer_count,(unsigned long)buffer_pixel_count);
+		return FALSE;
+	}
+	buffer_stride = SETUP_ROUND_UP(buffer_pixel_count*sizeof(unsigned short),CCD_SETUP_BUFFER_POOL_ALIGNMENT);
+	memory_length = buffer_stride*((size_t)buffer_count);
+	is_huge_page = FALSE;
+	if(flags & CCD_SETUP_BUFFER_POOL_FLAG_HUGE_PAGE)
+	{
+		memory_length = SETUP_ROUND_UP(memory_length,CCD_SETUP_BUFFER_POOL_HUGE_PAGE_LENGTH);
+		memory = mmap(NULL,memory_length,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB,-1,0);
+		if(memory != MAP_FAILED)
+			is_huge_page = TRUE;
+		else
+		{
+#if LOGGING > 1
+			CCD_General_Log_Format("setup","ccd_setup.c","CCD_Setup_Buffer_Pool_Create",LOG_VERBOSITY_TERSE,
+					       "CCD","Failed to map %lu bytes of huge pages (%s), "
+					       "using transparent huge pages.",(unsigned long)memory_length,
+					       strerror(errno));
+#endif
+			memory = NULL;
+		}
+	}
+	if(memory == NULL)
+	{
+		memory = mmap(NULL,memory_length,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+		if(memory == MAP_FAILED)
+		{
+			Setup_Error_Number = 53;
+			sprintf(Setup_Error_String,"CCD_Setup_Buffer_Pool_Create:Failed to map %lu bytes (%d,%s).",
+				(unsigned long)memory_length,errno,strerror(errno));
+			return FALSE;
+		}
+		if(flags & CCD_SETUP_BUFFER_POOL_FLAG_HUGE_PAGE)
+		{
+			if(madvise(memory,memory_length,MADV_HUGEPAGE) != 0)
+			{
+#if LOGGING > 1
+				CCD_General_Log_Format("setup","ccd_setup.c","CCD_Setup_Buffer_Pool_Create",
+						       LOG_VERBOSITY_TERSE,"CCD",
+						       "madvise(MADV_HUGEPAGE) failed (%s).",strerror(errno));
+#endif
+			}
+		}
+	}
+	is_locked = FALSE;
+	if(flags & CCD_SETUP_BUFFER_POOL_FLAG_LOCK)
+	{
+		if(mlock(memory,memory_length) == 0)
+			is_locked = TRUE;
+		else
+		{
+#if LOGGING > 1
+			CCD_General_Log_Format("setup","ccd_setup.c","CCD_Setup_Buffer_Pool_Create",LOG_VERBOSITY_TERSE,
+					       "CCD","Failed to lock %lu bytes into RAM (%s), the pool is unlocked.",
+					       (unsigned long)memory_length,strerror(errno));
+#endif
+		}
+	}
+	/* fault in every page now, rather than on the first readout into each buffer */
+	memset(memory,0,memory_length);
+	pool->Free_List = (int *)malloc(buffer_count*sizeof(int));
+	if(pool->Free_List == NULL)
+	{
+		if(is_locked)
+			munlock(memory,memory_length);
+		munmap(memory,memory_length);
+		Setup_Error_Number = 54;
+		sprintf(Setup_Error_String,"CCD_Setup_Buffer_Pool_Create:Failed to allocate free list (%d).",
+			buffer_count);
+		return FALSE;
+	}
+	/* push the buffers in reverse order, so the first Get returns the first buffer */
+	for(i = 0; i < buffer_count; i++)
+		pool->Free_List[i] = buffer_count-1-i;
+	pthread_mutex_init(&(pool->Mutex),NULL);
+	pool->Memory = memory;
+	pool->Memory_Length = memory_length;
+	pool->Buffer_Pixel_Count = buffer_pixel_count;
+	pool->Buffer_Stride = buffer_stride;
+	pool->Buffer_Count = buffer_count;
+	pool->Free_Count = buffer_count;
+	pool->Is_Huge_Page = is_huge_page;
+	pool->Is_Locked = is_locked;
+	pool->Exhausted_Count = 0;
+#if LOGGING > 1
+	CCD_General_Log_Format("setup","ccd_setup.c","CCD_Setup_Buffer_Pool_Create",LOG_VERBOSITY_TERSE,"CCD",
+			       "Created buffer pool of %d buffers of %lu pixels (%lu bytes, huge pages %d, locked %d).",
+			       buffer_count,(unsigned long)buffer_pixel_count,(unsigned long)memory_length,
+			       is_huge_page,is_locked);
+#endif
+	return TRUE;
+}
+
+/**
+ * Take a free buffer out of the pool. This never allocates memory, and is safe to call from any thread.
+ * The buffer is not cleared, and holds whatever image was last read out into it.
+ * @param pool The address of a pool, previously created with CCD_Setup_Buffer_Pool_Create.
+ * @param buffer The address of a pointer to store the buffer's address in. The buffer holds 
+ *        pool->Buffer_Pixel_Count pixels.
+ * @return The routine returns TRUE on success, and FALSE if an error occurs (including if every buffer in the
+ *         pool is in use, in which case the pool's Exhausted_Count is incremented).
+ * @see #CCD_Setup_Buffer_Pool_Struct
+ */
+int CCD_Setup_Buffer_Pool_Get(struct CCD_Setup_Buffer_Pool_Struct *pool,unsigned short **buffer)
+{
+	int index;
+
+	if((pool == NULL)||(pool->Memory == NULL))
+	{
+		Setup_Error_Number = 55;
+		sprintf(Setup_Error_String,"CCD_Setup_Buffer_Pool_Get:pool was NULL or has not been created.");
+		return FALSE;
+	}
+	if(buffer == NULL)
+	{
+		Setup_Error_Number = 56;
+		sprintf(Setup_Error_String,"CCD_Setup_Buffer_Pool_Get:buffer was NULL.");
+		return FALSE;
+	}
+	pthread_mutex_lock(&(pool->Mutex));
+	if(pool->Free_Count == 0)
+	{
+		pool->Exhausted_Count++;
+		pthread_mutex_unlock(&(pool->Mutex));
+		Setup_Error_Number = 57;
+		sprintf(Setup_Error_String,"CCD_Setup_Buffer_Pool_Get:All %d buffers are in use.",pool->Buffer_Count);
+		return FALSE;
+	}
+	pool->Free_Count--;
+	index = pool->Free_List[pool->Free_Count];
+	pthread_mutex_unlock(&(pool->Mutex));
+	(*buffer) = (unsigned short *)(((char *)pool->Memory)+(((size_t)index)*pool->Buffer_Stride));
+	return TRUE;
+}
+
+/**
+ * Return a buffer previously taken out of the pool with CCD_Setup_Buffer_Pool_Get. This is safe to call from any 
+ * thread.
+ * @param pool The address of a pool, previously created with CCD_Setup_Buffer_Pool_Create.
+ * @param buffer The address of the buffer to return.
+ * @return The routine returns TRUE on success, and FALSE if an error occurs (for instance the buffer did not
+ *         come from this pool).
+ * @see #CCD_Setup_Buffer_Pool_Struct
+ */
+int CCD_Setup_Buffer_Pool_Put(struct CCD_Setup_Buffer_Pool_Struct *pool,unsigned short *buffer)
+{
+	size_t offset;
+
+	if((pool == NULL)||(pool->Memory == NULL))
+	{
+		Setup_Error_Number = 58;
+		sprintf(Setup_Error_String,"CCD_Setup_Buffer_Pool_Put:pool was NULL or has not been created.");
+		return FALSE;
+	}
+	offset = ((char *)buffer)-((char *)pool->Memory);
+	if((((char *)buffer) < ((char *)pool->Memory))||((offset % pool->Buffer_Stride) != 0)||
+	   ((offset/pool->Buffer_Stride) >= ((size_t)pool->Buffer_Count)))
+	{
+		Setup_Error_Number = 59;
+		sprintf(Setup_Error_String,"CCD_Setup_Buffer_Pool_Put:Buffer %p is not in the pool.",(void *)buffer);
+		return FALSE;
+	}
+	pthread_mutex_lock(&(pool->Mutex));
+	if(pool->Free_Count >= pool->Buffer_Count)
+	{
+		pthread_mutex_unlock(&(pool->Mutex));
+		Setup_Error_Number = 60;
+		sprintf(Setup_Error_String,"CCD_Setup_Buffer_Pool_Put:Buffer %p returned when all buffers are free.",
+			(void *)buffer);
+		return FALSE;
+	}
+	pool->Free_List[pool->Free_Count] = (int)(offset/pool->Buffer_Stride);
+	pool->Free_Count++;
+	pthread_mutex_unlock(&(pool->Mutex));
+	return TRUE;
+}
+
+/**
+ * Get the number of free buffers in the pool, and the number of times the pool has run out of buffers.
+ * @param pool The address of a pool, previously created with CCD_Setup_Buffer_Pool_Create.
+ * @param free_count The address of an integer to store the number of free buffers in.
+ * @param exhausted_count The address of an unsigned long long to store the number of times 
+ *        CCD_Setup_Buffer_Pool_Get found no free buffers. This can be NULL.
+ * @return The routine returns TRUE on success, and FALSE if an error occurs.
+ * @see #CCD_Setup_Buffer_Pool_Struct
+ */
+int CCD_Setup_Buffer_Pool_Free_Count_Get(struct CCD_Setup_Buffer_Pool_Struct *pool,int *free_count,
+					 unsigned long long *exhausted_count)
+{
+	if((pool == NULL)||(pool->Memory == NULL))
+	{
+		Setup_Error_Number = 61;
+		sprintf(Setup_Error_String,"CCD_Setup_Buffer_Pool_Free_Count_Get:pool was NULL or has not been created.");
+		return FALSE;
+	}
+	if(free_count == NULL)
+	{
+		Setup_Error_Number = 62;
+		sprintf(Setup_Error_String,"CCD_Setup_Buffer_Pool_Free_Count_Get:free_count was NULL.");
+		return FALSE;
+	}
+	pthread_mutex_lock(&(pool->Mutex));
+	(*free_count) = pool->Free_Count;
+	if(exhausted_count != NULL)
+		(*exhausted_count) = pool->Exhausted_Count;
+	pthread_mutex_unlock(&(pool->Mutex));
+	return TRUE;
+}
+
+/**
+ * Destroy a buffer pool, unlocking and unmapping its memory. All the buffers must have been returned to the pool.
+ * Destroying a pool that has not been created does nothing.
+ * @param pool The address of a pool, previously created with CCD_Setup_Buffer_Pool_Create.
+ * @return The routine returns TRUE on success, and FALSE if an error occurs (for instance buffers are still
+ *         in use, in which case the pool is left intact).
+ * @see #CCD_Setup_Buffer_Pool_Struct
+ * @see #CCD_Setup_Buffer_Pool_Initialise
+ */
+int CCD_Setup_Buffer_Pool_Destroy(struct CCD_Setup_Buffer_Pool_Struct *pool)
+{
+	if(pool == NULL)
+	{
+		Setup_Error_Number = 63;
+		sprintf(Setup_Error_String,"CCD_Setup_Buffer_Pool_Destroy:pool was NULL.");
+		return FALSE;
+	}
+	if(pool->Memory == NULL)
+		return TRUE;
+	if(pool->Free_Count != pool->Buffer_Count)
+	{
+		Setup_Error_Number = 64;
+		sprintf(Setup_Error_String,"CCD_Setup_Buffer_Pool_Destroy:%d of %d buffers are still in use.",
+			pool->Buffer_Count-pool->Free_Count,pool->Buffer_Count);
+		return FALSE;
+	}
+	if(pool->Is_Locked)
+		munlock(pool->Memory,pool->Memory_Length);
+	if(munmap(pool->Memory,pool->Memory_Length) != 0)
+	{
+		Setup_Error_Number = 65;
+		sprintf(Setup_Error_String,"CCD_Setup_Buffer_Pool_Destroy:Failed to unmap %lu bytes (%d,%s).",
+			(unsigned long)pool->Memory_Length,errno,strerror(errno));
+		return FALSE;
+	}
+	free(pool->Free_List);
+	pthread_mutex_destroy(&(pool->Mutex));
+	CCD_Setup_Buffer_Pool_Initialise(pool);
+	return TRUE;
+}
+
 /**
  * Get the current value of ccd_setup's error number.
  * @return The current value of ccd_setup's error number.
@@ -16,6 +16,7 @@
  */
 #define _POSIX_C_SOURCE 199309L
 
+#include <pthread.h>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
@@ -51,6 +52,13 @@ static char rcsid[] = "$Id$";
  * @see #CCD_TEMPERATURE_STATUS
  */
 static struct Temperature_Struct Temperature_Data = {0.0,0.0,CCD_TEMPERATURE_STATUS_UNKNOWN,{0,0L}};
+/**
+ * Mutex protecting Temperature_Data. The cache is updated by whichever thread reads the temperature from the camera
+ * (the camera server's telemetry thread, whilst the detector is idle or exposing), and read by the other threads
+ * (for instance the acquisition thread, for each frame's CCDTEMP FITS header).
+ * @see #Temperature_Data
+ */
+static pthread_mutex_t Temperature_Data_Mutex = PTHREAD_MUTEX_INITIALIZER;
 /**
  * Variable holding error code of last operation performed by ccd_temperature.
  */
@@ -65,13 +73,17 @@ static char Temperature_Error_String[CCD_GENERAL_ERROR_STRING_LENGTH] = "";
 ** 		external functions 
 ** ---------------------------------------------------------------------------- */
 /**
- * Get the current temperature of the CCD. If successfull, the local temperature cache is updated.
+ * Get the current temperature of the CCD. If successfull, the local temperature cache is updated
+ * (whilst holding Temperature_Data_Mutex). Some cameras cannot report their temperature whilst acquiring
+ * (GetTemperatureF returns DRV_ACQUIRING): we then return TRUE with a temperature_status of
+ * CCD_TEMPERATURE_STATUS_UNKNOWN, and leave the cache alone, as the temperature returned is not a new reading.
  * @param temperature The address of a double to return ther temperature in, in degrees centigrade.
  * @param temperature_status The address of a enum to store the temperature status.
  * @return Returns TRUE on success, and FALSE if an error occurs.
  * @see #Temperature_Error_Number
  * @see #Temperature_Error_String
  * @see #Temperature_Data
+ * @see #Temperature_Data_Mutex
  * @see CCD_General_Andor_ErrorCode_To_String
  * @see #CCD_TEMPERATURE_STATUS
  */
@@ -112,8 +124,9 @@ int CCD_Temperature_Get(double *temperature,enum CCD_TEMPERATURE_STATUS *tempera
 				andor_retval,CCD_General_Andor_ErrorCode_To_String(andor_retval));
 			return FALSE;
 		case DRV_ACQUIRING:
+			/* not a new reading, keep the cached temperature */
 			(*temperature_status) = CCD_TEMPERATURE_STATUS_UNKNOWN;
-			break;
+			return TRUE;
 		case DRV_ERROR_ACK:
 			(*temperature_status) = CCD_TEMPERATURE_STATUS_UNKNOWN;
 			Temperature_Error_Number = 4;
@@ -143,9 +156,11 @@ int CCD_Temperature_Get(double *temperature,enum CCD_TEMPERATURE_STATUS *tempera
 			return FALSE;
 	}
 	/* update cached copy */
+	pthread_mutex_lock(&Temperature_Data_Mutex);
 	Temperature_Data.Cached_Temperature = (*temperature);
 	Temperature_Data.Cached_Temperature_Status = (*temperature_status);
 	clock_gettime(CLOCK_REALTIME,&(Temperature_Data.Cache_Date_Stamp));
+	pthread_mutex_unlock(&Temperature_Data_Mutex);
 #if LOGGING > 1
 	CCD_General_Log("temperature","ccd_temperature.c","CCD_Temperature_Get",LOG_VERBOSITY_TERSE,"CCD",
 			"CCD_Temperature_Get Finished.");
@@ -184,7 +199,9 @@ int CCD_Temperature_Set(double target_temperature)
 		return FALSE;
 	}
        	/* save target temperature to put into FITS headers later. */
+	pthread_mutex_lock(&Temperature_Data_Mutex);
 	Temperature_Data.Target_Temperature = target_temperature;
+	pthread_mutex_unlock(&Temperature_Data_Mutex);
 #if LOGGING > 3
 	CCD_General_Log("temperature","ccd_temperature.c","CCD_Temperature_Set",LOG_VERBOSITY_VERBOSE,"CCD",
 		       "CCD_Temperature_Set:Turning on cooler.");
@@ -282,54 +299,60 @@ int CCD_Temperature_Cooler_Off(void)
 }
 
 /**
- * Get the cached temperature data from the last CCD_Temperature_Get call.
+ * Get the cached temperature data from the last CCD_Temperature_Get call. The cache is copied whilst holding
+ * Temperature_Data_Mutex, so the temperature, status and date stamp returned are all from the same call.
  * @param temperature A pointer to a double. If non-null, on return filled with the cached temperature in C.
  * @param temperature_status A pointer to a enum CCD_TEMPERATURE_STATUS. If non-null, on return filled with the cached 
  *        temperature status.
  * @param cache_date_stamp A pointer to a struct timespec. If non-null, on return filled with the cache date stamp.
  * @return The routine returns TRUE if successful, and FALSE if it fails.
  * @see #Temperature_Data
+ * @see #Temperature_Data_Mutex
  * @see #CCD_TEMPERATURE_STATUS
  */
 int CCD_Temperature_Get_Cached_Temperature(double *temperature,enum CCD_TEMPERATURE_STATUS *temperature_status,
 					   struct timespec *cache_date_stamp)
 {
+	struct Temperature_Struct cached_data;
 	char time_buff[32];
 
 #if LOGGING > 0
 	CCD_General_Log("temperature","ccd_temperature.c","CCD_Temperature_Get_Cached_Temperature",
 			LOG_VERBOSITY_VERBOSE,"CCD","CCD_Temperature_Get_Cached_Temperature() started.");
 #endif
+	pthread_mutex_lock(&Temperature_Data_Mutex);
+	cached_data = Temperature_Data;
+	pthread_mutex_unlock(&Temperature_Data_Mutex);
 	if(temperature != NULL)
 	{
-		(*temperature) = Temperature_Data.Cached_Temperature;
+		(*temperature) = cached_data.Cached_Temperature;
 #if LOGGING > 5
 		CCD_General_Log_Format("temperature","ccd_temperature.c","CCD_Temperature_Get_Cached_Temperature",
 				      LOG_VERBOSITY_VERBOSE,"CCD",
 				      "CCD_Temperature_Get_Cached_Temperature() found cached temperature %.2f.",
-				      Temperature_Data.Cached_Temperature);
+				      cached_data.Cached_Temperature);
 #endif
 	}
 	if(temperature_status != NULL)
 	{
-		(*temperature_status) = Temperature_Data.Cached_Temperature_Status;
+		(*temperature_status) = cached_data.Cached_Temperature_Status;
 #if LOGGING > 5
 		CCD_General_Log_Format("temperature","ccd_temperature.c","CCD_Temperature_Get_Cached_Temperature",
 				      LOG_VERBOSITY_VERBOSE,"CCD",
 				   "CCD_Temperature_Get_Cached_Temperature() found cached temperature status %d(%s).",
-				      Temperature_Data.Cached_Temperature_Status,
-				      CCD_Temperature_Status_To_String(Temperature_Data.Cached_Temperature_Status));
+				      cached_data.Cached_Temperature_Status,
+				      CCD_Temperature_Status_To_String(cached_data.Cached_Temperature_Status));
 #endif
 	}
 	if(cache_date_stamp != NULL)
 	{
-		(*cache_date_stamp) = Temperature_Data.Cache_Date_Stamp;
+		(*cache_date_stamp) = cached_data.Cache_Date_Stamp;
 #if LOGGING > 5
-		CCD_General_Get_Time_String(Temperature_Data.Cache_Date_Stamp,time_buff,31);
+		CCD_General_Get_Time_String(cached_data.Cache_Date_Stamp,time_buff,31);
 		CCD_General_Log_Format("temperature","ccd_temperature.c","CCD_Temperature_Get_Cached_Temperature",
 				      LOG_VERBOSITY_VERBOSE,"CCD",
 				      "CCD_Temperature_Get_Cached_Temperature() found cache date stamp %d(%s).",
-				      Temperature_Data.Cache_Date_Stamp.tv_sec,time_buff);
+				      cached_data.Cache_Date_Stamp.tv_sec,time_buff);
 #endif
 	}
 #if LOGGING > 0
@@ -344,6 +367,7 @@ int CCD_Temperature_Get_Cached_Temperature(double *temperature,enum CCD_TEMPERAT
  * @param target_temperature The address of a double to store the last target temperature.
  * @return The routine returns TRUE if successful, and FALSE if it fails.
  * @see #Temperature_Data
+ * @see #Temperature_Data_Mutex
  */
 int CCD_Temperature_Target_Temperature_Get(double *target_temperature)
 {
@@ -352,7 +376,11 @@ int CCD_Temperature_Target_Temperature_Get(double *target_temperature)
 			LOG_VERBOSITY_VERBOSE,"CCD","CCD_Temperature_Target_Temperature_Get() started.");
 #endif
 	if(target_temperature != NULL)
+	{
+		pthread_mutex_lock(&Temperature_Data_Mutex);
 		(*target_temperature) = Temperature_Data.Target_Temperature;
+		pthread_mutex_unlock(&Temperature_Data_Mutex);
+	}
 #if LOGGING > 0
 	CCD_General_Log("temperature","ccd_temperature.c","CCD_Temperature_Target_Temperature_Get",
 			LOG_VERBOSITY_VERBOSE,"CCD","CCD_Temperature_Target_Temperature_Get() returned TRUE.");
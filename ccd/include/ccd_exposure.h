@@ -56,10 +56,53 @@ enum CCD_EXPOSURE_STATUS
         ((status) == CCD_EXPOSURE_STATUS_WAIT_START)||((status) == CCD_EXPOSURE_STATUS_EXPOSE)|| \
         ((status) == CCD_EXPOSURE_STATUS_READOUT)
 
+/**
+ * The phases of an acquisition that are time stamped in a CCD_Exposure_Timeline_Struct, in the order they occur.
+ * <ul>
+ * <li>CCD_EXPOSURE_TIMELINE_REQUEST is when the request for the exposure was accepted (set by the caller).
+ * <li>CCD_EXPOSURE_TIMELINE_SETUP is when the shutter and exposure length had been set up (SetShutter /
+ *     SetExposureTime).
+ * <li>CCD_EXPOSURE_TIMELINE_START is when StartAcquisition returned.
+ * <li>CCD_EXPOSURE_TIMELINE_ACQUIRED is when the camera reported the acquisition was complete.
+ * <li>CCD_EXPOSURE_TIMELINE_READOUT is when GetAcquiredData16 returned the image.
+ * <li>CCD_EXPOSURE_TIMELINE_ORIENT is when the image had been flipped into the configured orientation.
+ * <li>CCD_EXPOSURE_TIMELINE_HEADER is when the FITS headers for the image had been built (set by the caller).
+ * <li>CCD_EXPOSURE_TIMELINE_SAVE_OPEN is when the FITS file had been opened.
+ * <li>CCD_EXPOSURE_TIMELINE_SAVE_WRITE is when the FITS headers and image data had been written.
+ * <li>CCD_EXPOSURE_TIMELINE_SAVE_CLOSE is when the FITS file had been closed.
+ * <li>CCD_EXPOSURE_TIMELINE_PUBLISHED is when the image was published to clients (set by the caller).
+ * <li>CCD_EXPOSURE_TIMELINE_PHASE_COUNT is the number of phases.
+ * </ul>
+ * @see #CCD_Exposure_Timeline_Struct
+ */
+enum CCD_EXPOSURE_TIMELINE_PHASE
+{
+	CCD_EXPOSURE_TIMELINE_REQUEST=0,CCD_EXPOSURE_TIMELINE_SETUP,CCD_EXPOSURE_TIMELINE_START,
+	CCD_EXPOSURE_TIMELINE_ACQUIRED,CCD_EXPOSURE_TIMELINE_READOUT,CCD_EXPOSURE_TIMELINE_ORIENT,
+	CCD_EXPOSURE_TIMELINE_HEADER,CCD_EXPOSURE_TIMELINE_SAVE_OPEN,CCD_EXPOSURE_TIMELINE_SAVE_WRITE,
+	CCD_EXPOSURE_TIMELINE_SAVE_CLOSE,CCD_EXPOSURE_TIMELINE_PUBLISHED,CCD_EXPOSURE_TIMELINE_PHASE_COUNT
+};
+
+/* structures */
+/**
+ * The time each phase of an acquisition was reached, taken from CLOCK_MONOTONIC.
+ * <dl>
+ * <dt>Phase_Time</dt> <dd>The time stamp of each phase, indexed by CCD_EXPOSURE_TIMELINE_PHASE. A phase that has
+ *     not been reached has a time stamp of zero.</dd>
+ * </dl>
+ * @see #CCD_EXPOSURE_TIMELINE_PHASE
+ */
+struct CCD_Exposure_Timeline_Struct
+{
+	struct timespec Phase_Time[CCD_EXPOSURE_TIMELINE_PHASE_COUNT];
+};
+
 extern void CCD_Exposure_Initialise(void);
 extern int CCD_Exposure_Expose(int open_shutter,struct timespec start_time,int exposure_length,
 			       void *buffer,size_t buffer_length);
 extern int CCD_Exposure_Bias(void *buffer,size_t buffer_length);
+extern int CCD_Exposure_Series(int open_shutter,int exposure_length,int exposure_count,void **buffer_list,
+			       size_t buffer_length);
 extern int CCD_Exposure_Abort(void);
 extern enum CCD_EXPOSURE_STATUS CCD_Exposure_Status_Get(void);
 extern int CCD_Exposure_Start_Time_Get(struct timespec *start_time);
@@ -68,8 +111,14 @@ extern int CCD_Exposure_Series_Get(void);
 extern int CCD_Exposure_Index_Get(void);
 extern int CCD_Exposure_Count_Get(void);
 extern int CCD_Exposure_Length_Get(void);
+extern int CCD_Exposure_Defer_Orientation_Set(int defer);
+extern int CCD_Exposure_Defer_Orientation_Get(void);
+extern void CCD_Exposure_Timeline_Clear(struct CCD_Exposure_Timeline_Struct *timeline);
+extern void CCD_Exposure_Timeline_Mark(struct CCD_Exposure_Timeline_Struct *timeline,
+				       enum CCD_EXPOSURE_TIMELINE_PHASE phase);
+extern int CCD_Exposure_Timeline_Get(struct CCD_Exposure_Timeline_Struct *timeline);
 extern int CCD_Exposure_Save(char *filename,void *buffer,size_t buffer_length,int ncols,int nrows,
-			     struct Fits_Header_Struct header);
+			     struct Fits_Header_Struct header,struct CCD_Exposure_Timeline_Struct *timeline);
 extern int CCD_Exposure_Get_Error_Number(void);
 extern void CCD_Exposure_Error(void);
 extern void CCD_Exposure_Error_String(char *error_string);
@@ -18,10 +18,25 @@ extern "C" {
 #include <time.h>
 /* for fitsfile declaration */
 #include "fitsio.h"
+/* for size_t declaration */
+#include <stddef.h>
+
+/* hash defines */
+/**
+ * The length of a FITS header record (card), in bytes.
+ */
+#define CCD_FITS_HEADER_CARD_LENGTH  (80)
+/**
+ * The length of a FITS logical record, in bytes. A FITS header and data unit are each padded to a multiple of this.
+ */
+#define CCD_FITS_HEADER_BLOCK_LENGTH (2880)
 
 /**
  * Structure defining the contents of a FITS header. Note the common basic FITS cards may not
- * be defined in this list.
+ * be defined in this list. The cards are kept in insertion order in Card_List, and are found by keyword using
+ * the open addressed hash index Hash_Table. The card string values, units and comments are kept in the string
+ * arena Arena, the cards just hold their offsets. All three are grown geometrically, so adding a card is
+ * amortised O(1). The structure should only be modified using the CCD_Fits_Header_* routines.
  * @see #Fits_Header_Card_Struct
  */
 struct Fits_Header_Struct
@@ -32,6 +47,16 @@ struct Fits_Header_Struct
 	int Card_Count;
 	/** The amount of memory allocated in the Card_List pointer, in terms of number of cards. */
 	int Allocated_Card_Count;
+	/** The hash index, each entry is 0 (empty), or the index in Card_List of a card plus one. */
+	int *Hash_Table;
+	/** The number of entries in Hash_Table, a power of two (or 0 if it has not been allocated yet). */
+	int Hash_Table_Length;
+	/** The string arena, containing the '\0' terminated string values, units and comments of the cards. */
+	char *Arena;
+	/** The number of bytes of Arena in use. */
+	size_t Arena_Length;
+	/** The number of bytes allocated in the Arena pointer. */
+	size_t Allocated_Arena_Length;
 };
 
 extern int CCD_Fits_Header_Initialise(struct Fits_Header_Struct *header);
@@ -48,8 +73,11 @@ extern int CCD_Fits_Header_Add_Logical(struct Fits_Header_Struct *header,const c
 extern int CCD_Fits_Header_Add_Comment(struct Fits_Header_Struct *header,const char *keyword,const char *comment);
 extern int CCD_Fits_Header_Add_Units(struct Fits_Header_Struct *header,const char *keyword,const char *units);
 extern int CCD_Fits_Header_Free(struct Fits_Header_Struct *header);
+extern int CCD_Fits_Header_Copy(struct Fits_Header_Struct *destination,struct Fits_Header_Struct source);
+extern int CCD_Fits_Header_Merge(struct Fits_Header_Struct *destination,struct Fits_Header_Struct source);
 
 extern int CCD_Fits_Header_Write_To_Fits(struct Fits_Header_Struct header,fitsfile *fits_fp);
+extern int CCD_Fits_Header_Write_To_Block(struct Fits_Header_Struct header,char *block,size_t block_length);
 
 extern void CCD_Fits_Header_TimeSpec_To_Date_String(struct timespec time,char *time_string);
 extern void CCD_Fits_Header_TimeSpec_To_Date_Obs_String(struct timespec time,char *time_string);
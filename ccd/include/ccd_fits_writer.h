@@ -0,0 +1,35 @@
+/* ccd_fits_writer.h
+** $Id$
+*/
+#ifndef CCD_FITS_WRITER_H
+#define CCD_FITS_WRITER_H
+/**
+ * @file
+ * @brief ccd_fits_writer.h contains the externally declared API of the native FITS image writer, which saves
+ *        images without using CFITSIO.
+ * @author Chris Mottram
+ * @version $Id$
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* for size_t declaration */
+#include <stddef.h>
+/* for struct Fits_Header_Struct declaration */
+#include "ccd_fits_header.h"
+/* for struct CCD_Exposure_Timeline_Struct declaration */
+#include "ccd_exposure.h"
+
+extern int CCD_Fits_Writer_Save(char *filename,void *buffer,size_t buffer_length,int ncols,int nrows,
+				struct Fits_Header_Struct header,struct CCD_Exposure_Timeline_Struct *timeline);
+extern int CCD_Fits_Writer_Get_Error_Number(void);
+extern void CCD_Fits_Writer_Error(void);
+extern void CCD_Fits_Writer_Error_String(char *error_string);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,124 @@
+/* ccd_frame_ring.h
+** $Id$
+*/
+#ifndef CCD_FRAME_RING_H
+#define CCD_FRAME_RING_H
+/**
+ * @file
+ * @brief ccd_frame_ring.h contains the externally declared API of the POSIX shared memory frame ring,
+ *        used to publish read out frames to co-located consumer processes without copying them through
+ *        the thrift interface.
+ * @author Chris Mottram
+ * @version $Id$
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* for size_t declaration */
+#include <stddef.h>
+/* for int64_t/uint64_t declarations */
+#include <stdint.h>
+/* for struct timespec declaration */
+#include <time.h>
+
+/**
+ * Magic number written at the start of the shared memory segment, so readers can check they have
+ * opened a frame ring. This is 'MKDF'.
+ */
+#define CCD_FRAME_RING_MAGIC               (0x4d4b4446)
+/**
+ * The version of the shared memory layout. Readers refuse to attach to a segment with a different version.
+ */
+#define CCD_FRAME_RING_VERSION             (1)
+/**
+ * The maximum length of the shared memory segment name, including the leading '/'.
+ */
+#define CCD_FRAME_RING_NAME_LENGTH         (256)
+/**
+ * The maximum length of the FITS filename stored with each frame.
+ */
+#define CCD_FRAME_RING_FILENAME_LENGTH     (256)
+/**
+ * The default name of the shared memory segment.
+ */
+#define CCD_FRAME_RING_DEFAULT_NAME        ("/mookodi_camera_frames")
+
+/**
+ * Structure describing one frame held in the frame ring. A copy of this is returned to readers.
+ * <dl>
+ * <dt>Sequence_Number</dt> <dd>The frame sequence number, starting at 1 and incremented for each published frame.</dd>
+ * <dt>NCols</dt> <dd>The number of columns (binned pixels) in the frame.</dd>
+ * <dt>NRows</dt> <dd>The number of rows (binned pixels) in the frame.</dd>
+ * <dt>Bin_X</dt> <dd>The horizontal binning used to read out the frame.</dd>
+ * <dt>Bin_Y</dt> <dd>The vertical binning used to read out the frame.</dd>
+ * <dt>Exposure_Length</dt> <dd>The exposure length of the frame, in milliseconds.</dd>
+ * <dt>Start_Time</dt> <dd>The time the exposure started.</dd>
+ * <dt>Publish_Time</dt> <dd>The time the frame was published into the ring.</dd>
+ * <dt>Filename</dt> <dd>The FITS filename the frame was saved to, or the blank string if it was not
+ *     (or has not yet been) saved.</dd>
+ * </dl>
+ * @see #CCD_FRAME_RING_FILENAME_LENGTH
+ */
+struct CCD_Frame_Ring_Frame_Struct
+{
+	int64_t Sequence_Number;
+	int NCols;
+	int NRows;
+	int Bin_X;
+	int Bin_Y;
+	int Exposure_Length;
+	struct timespec Start_Time;
+	struct timespec Publish_Time;
+	char Filename[CCD_FRAME_RING_FILENAME_LENGTH];
+};
+
+/**
+ * Structure holding the process local handle of an attached frame ring.
+ * <dl>
+ * <dt>Name</dt> <dd>The name of the POSIX shared memory segment.</dd>
+ * <dt>Fd</dt> <dd>The file descriptor returned by shm_open.</dd>
+ * <dt>Memory</dt> <dd>The address the segment is mapped at.</dd>
+ * <dt>Memory_Length</dt> <dd>The length of the mapping in bytes.</dd>
+ * <dt>Is_Writer</dt> <dd>A boolean, TRUE if this handle was created with CCD_Frame_Ring_Create,
+ *     and is therefore allowed to publish frames (and unlinks the segment on close).</dd>
+ * </dl>
+ * @see #CCD_FRAME_RING_NAME_LENGTH
+ */
+struct CCD_Frame_Ring_Struct
+{
+	char Name[CCD_FRAME_RING_NAME_LENGTH];
+	int Fd;
+	void *Memory;
+	size_t Memory_Length;
+	int Is_Writer;
+};
+
+extern void CCD_Frame_Ring_Initialise(struct CCD_Frame_Ring_Struct *ring);
+extern int CCD_Frame_Ring_Create(struct CCD_Frame_Ring_Struct *ring,const char *name,int slot_count,
+				 size_t slot_pixel_count);
+extern int CCD_Frame_Ring_Open(struct CCD_Frame_Ring_Struct *ring,const char *name);
+extern int CCD_Frame_Ring_Close(struct CCD_Frame_Ring_Struct *ring);
+extern int CCD_Frame_Ring_Publish(struct CCD_Frame_Ring_Struct *ring,struct CCD_Frame_Ring_Frame_Struct *frame,
+				  const unsigned short *buffer,size_t pixel_count);
+extern int CCD_Frame_Ring_Filename_Set(struct CCD_Frame_Ring_Struct *ring,int64_t sequence_number,
+				       const char *filename);
+extern int CCD_Frame_Ring_Latest_Sequence_Get(struct CCD_Frame_Ring_Struct *ring,int64_t *sequence_number);
+extern int CCD_Frame_Ring_Slot_Count_Get(struct CCD_Frame_Ring_Struct *ring,int *slot_count);
+extern int CCD_Frame_Ring_Read(struct CCD_Frame_Ring_Struct *ring,int64_t sequence_number,
+			       struct CCD_Frame_Ring_Frame_Struct *frame,unsigned short *buffer,size_t buffer_length);
+extern int CCD_Frame_Ring_Frame_Map(struct CCD_Frame_Ring_Struct *ring,int64_t sequence_number,
+				    struct CCD_Frame_Ring_Frame_Struct *frame,const unsigned short **buffer,
+				    uint64_t *generation);
+extern int CCD_Frame_Ring_Frame_Is_Valid(struct CCD_Frame_Ring_Struct *ring,int64_t sequence_number,
+					 uint64_t generation);
+extern int CCD_Frame_Ring_Get_Error_Number(void);
+extern void CCD_Frame_Ring_Error(void);
+extern void CCD_Frame_Ring_Error_String(char *error_string);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
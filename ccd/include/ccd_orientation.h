@@ -0,0 +1,90 @@
+/* ccd_orientation.h
+** $Id$
+*/
+#ifndef CCD_ORIENTATION_H
+#define CCD_ORIENTATION_H
+/**
+ * @file
+ * @brief ccd_orientation.h contains the externally declared API of the image orientation routines, used to
+ *        flip, rotate and transpose read out images.
+ * @author Chris Mottram
+ * @version $Id$
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* enums */
+/**
+ * Enumeration describing how a read out image is re-oriented. The rotations are clockwise, as the image appears
+ * with the first row read out at the top. The last four orientations swap the image's axes, so the
+ * re-oriented image has nrows columns and ncols rows.
+ * <ul>
+ * <li><b>CCD_ORIENTATION_NONE</b> The image is left as read out.
+ * <li><b>CCD_ORIENTATION_FLIP_X</b> The image is flipped in the horizontal (X) direction.
+ * <li><b>CCD_ORIENTATION_FLIP_Y</b> The image is flipped in the vertical (Y) direction.
+ * <li><b>CCD_ORIENTATION_ROTATE_180</b> The image is rotated by 180 degrees (flipped in both directions).
+ * <li><b>CCD_ORIENTATION_TRANSPOSE</b> The image is transposed (reflected about the leading diagonal).
+ * <li><b>CCD_ORIENTATION_ROTATE_90</b> The image is rotated by 90 degrees.
+ * <li><b>CCD_ORIENTATION_ROTATE_270</b> The image is rotated by 270 degrees.
+ * <li><b>CCD_ORIENTATION_TRANSVERSE</b> The image is reflected about the trailing diagonal.
+ * </ul>
+ */
+enum CCD_ORIENTATION
+{
+	CCD_ORIENTATION_NONE=0,CCD_ORIENTATION_FLIP_X=1,CCD_ORIENTATION_FLIP_Y=2,CCD_ORIENTATION_ROTATE_180=3,
+	CCD_ORIENTATION_TRANSPOSE=4,CCD_ORIENTATION_ROTATE_90=5,CCD_ORIENTATION_ROTATE_270=6,
+	CCD_ORIENTATION_TRANSVERSE=7
+};
+
+/**
+ * Enumeration describing which implementation of the orientation routines is used.
+ * <ul>
+ * <li><b>CCD_ORIENTATION_KERNEL_AUTO</b> Use the fastest implementation the CPU supports.
+ * <li><b>CCD_ORIENTATION_KERNEL_SCALAR</b> Use the portable C implementation.
+ * <li><b>CCD_ORIENTATION_KERNEL_SSE2</b> Use the SSE2 implementation (x86 only).
+ * <li><b>CCD_ORIENTATION_KERNEL_AVX2</b> Use the AVX2 implementation (x86 CPUs supporting AVX2 only).
+ * </ul>
+ */
+enum CCD_ORIENTATION_KERNEL
+{
+	CCD_ORIENTATION_KERNEL_AUTO=0,CCD_ORIENTATION_KERNEL_SCALAR=1,CCD_ORIENTATION_KERNEL_SSE2=2,
+	CCD_ORIENTATION_KERNEL_AVX2=3
+};
+
+/* hash defines */
+/**
+ * Macro to check whether the parameter is a legal orientation.
+ * @see #CCD_ORIENTATION
+ */
+#define CCD_ORIENTATION_IS_ORIENTATION(o)	(((o) >= CCD_ORIENTATION_NONE)&&((o) <= CCD_ORIENTATION_TRANSVERSE))
+/**
+ * Macro returning whether the orientation swaps the image's axes (i.e. is a transpose or a 90/270 degree rotation).
+ * @see #CCD_ORIENTATION
+ */
+#define CCD_ORIENTATION_SWAPS_AXES(o)		((o) >= CCD_ORIENTATION_TRANSPOSE)
+
+extern int CCD_Orientation_Parse(const char *string,enum CCD_ORIENTATION *orientation);
+extern const char *CCD_Orientation_To_String(enum CCD_ORIENTATION orientation);
+extern enum CCD_ORIENTATION CCD_Orientation_From_Flips(int flip_x,int flip_y);
+extern void CCD_Orientation_Get_Dimensions(enum CCD_ORIENTATION orientation,int ncols,int nrows,
+					   int *oriented_ncols,int *oriented_nrows);
+extern void CCD_Orientation_Get_Source_Region(enum CCD_ORIENTATION orientation,int ncols,int nrows,int x,int y,
+					      int width,int height,int *source_x,int *source_y,
+					      int *source_width,int *source_height);
+extern int CCD_Orientation_Apply(enum CCD_ORIENTATION orientation,int ncols,int nrows,unsigned short *buffer);
+extern int CCD_Orientation_Apply_Copy(enum CCD_ORIENTATION orientation,int ncols,int nrows,
+				      const unsigned short *input_buffer,unsigned short *output_buffer);
+extern int CCD_Orientation_Kernel_Set(enum CCD_ORIENTATION_KERNEL kernel);
+extern enum CCD_ORIENTATION_KERNEL CCD_Orientation_Kernel_Get(void);
+extern const char *CCD_Orientation_Kernel_To_String(enum CCD_ORIENTATION_KERNEL kernel);
+extern int CCD_Orientation_Get_Error_Number(void);
+extern void CCD_Orientation_Error(void);
+extern void CCD_Orientation_Error_String(char *error_string);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -14,6 +14,35 @@
 extern "C" {
 #endif
 
+/* for size_t declaration */
+#include <stddef.h>
+/* for pthread_mutex_t declaration */
+#include <pthread.h>
+/* for enum CCD_ORIENTATION declaration */
+#include "ccd_orientation.h"
+
+/* hash defines */
+/**
+ * The alignment, in bytes, of each buffer in a buffer pool. This is the cache line size, so a buffer never shares a
+ * cache line with its neighbour, and is suitable for vectorised copies.
+ */
+#define CCD_SETUP_BUFFER_POOL_ALIGNMENT      (64)
+/**
+ * The length of a huge page, in bytes, used to round up the size of a buffer pool created with
+ * CCD_SETUP_BUFFER_POOL_FLAG_HUGE_PAGE.
+ */
+#define CCD_SETUP_BUFFER_POOL_HUGE_PAGE_LENGTH (2*1024*1024)
+/**
+ * Buffer pool creation flag. Try to back the pool with huge pages (MAP_HUGETLB), falling back to asking the kernel
+ * for transparent huge pages (madvise(MADV_HUGEPAGE)) if no huge pages are reserved.
+ */
+#define CCD_SETUP_BUFFER_POOL_FLAG_HUGE_PAGE (1<<0)
+/**
+ * Buffer pool creation flag. Lock the pool's memory into RAM (mlock), so it is never paged out.
+ * Failing to lock the memory (e.g. due to RLIMIT_MEMLOCK) is logged but not an error.
+ */
+#define CCD_SETUP_BUFFER_POOL_FLAG_LOCK      (1<<1)
+
 /* structures */
 /**
  * @struct CCD_Setup_Window_Struct
@@ -32,6 +61,42 @@ struct CCD_Setup_Window_Struct
 	int Y_End;
 };
 
+/**
+ * Structure holding a pool of preallocated image buffers, all carved out of one contiguous mapping.
+ * The structure is allocated by the caller, and managed using the CCD_Setup_Buffer_Pool_* routines.
+ * <dl>
+ * <dt>Memory</dt> <dd>The address of the mapping holding the buffers.</dd>
+ * <dt>Memory_Length</dt> <dd>The length of the mapping in bytes.</dd>
+ * <dt>Buffer_Pixel_Count</dt> <dd>The number of pixels each buffer can hold.</dd>
+ * <dt>Buffer_Stride</dt> <dd>The distance between the start of each buffer in bytes, a multiple of
+ *     CCD_SETUP_BUFFER_POOL_ALIGNMENT.</dd>
+ * <dt>Buffer_Count</dt> <dd>The number of buffers in the pool.</dd>
+ * <dt>Free_List</dt> <dd>A stack of the indexes of the buffers not currently in use.</dd>
+ * <dt>Free_Count</dt> <dd>The number of entries in Free_List.</dd>
+ * <dt>Is_Huge_Page</dt> <dd>A boolean, TRUE if the mapping is backed by reserved huge pages (MAP_HUGETLB).</dd>
+ * <dt>Is_Locked</dt> <dd>A boolean, TRUE if the mapping is locked into RAM (mlock).</dd>
+ * <dt>Exhausted_Count</dt> <dd>The number of times CCD_Setup_Buffer_Pool_Get failed as all the buffers 
+ *     were in use.</dd>
+ * <dt>Mutex</dt> <dd>A mutex protecting Free_List, Free_Count and Exhausted_Count, so buffers can be
+ *     returned to the pool from any thread.</dd>
+ * </dl>
+ * @see #CCD_SETUP_BUFFER_POOL_ALIGNMENT
+ */
+struct CCD_Setup_Buffer_Pool_Struct
+{
+	void *Memory;
+	size_t Memory_Length;
+	size_t Buffer_Pixel_Count;
+	size_t Buffer_Stride;
+	int Buffer_Count;
+	int *Free_List;
+	int Free_Count;
+	int Is_Huge_Page;
+	int Is_Locked;
+	unsigned long long Exhausted_Count;
+	pthread_mutex_t Mutex;
+};
+
 extern int CCD_Setup_Config_Directory_Set(char *directory);
 extern int CCD_Setup_Startup(void);
 extern int CCD_Setup_Shutdown(void);
@@ -43,10 +108,15 @@ extern int CCD_Setup_Set_VS_Speed(int vs_speed_index);
 extern int CCD_Setup_Set_Pre_Amp_Gain(int pre_amp_gain_index);
 extern int CCD_Setup_Set_Flip_X(int flip_x);
 extern int CCD_Setup_Set_Flip_Y(int flip_y);
+extern int CCD_Setup_Set_Orientation(enum CCD_ORIENTATION orientation);
 extern int CCD_Setup_Set_Shutter_Open_Time(int opening_time_ms);
 extern int CCD_Setup_Set_Shutter_Close_Time(int closing_time_ms);
 extern int CCD_Setup_Get_NCols(void);
 extern int CCD_Setup_Get_NRows(void);
+extern int CCD_Setup_Get_Binned_NCols(void);
+extern int CCD_Setup_Get_Binned_NRows(void);
+extern int CCD_Setup_Get_Image_NCols(void);
+extern int CCD_Setup_Get_Image_NRows(void);
 extern int CCD_Setup_Get_Bin_X(void);
 extern int CCD_Setup_Get_Bin_Y(void);
 extern int CCD_Setup_Is_Window(void);
@@ -58,6 +128,7 @@ extern int CCD_Setup_Get_Detector_Pixel_Count_X(void);
 extern int CCD_Setup_Get_Detector_Pixel_Count_Y(void);
 extern int CCD_Setup_Get_Flip_X(void);
 extern int CCD_Setup_Get_Flip_Y(void);
+extern enum CCD_ORIENTATION CCD_Setup_Get_Orientation(void);
 extern int CCD_Setup_Get_Shutter_Open_Time(void);
 extern int CCD_Setup_Get_Shutter_Close_Time(void);
 extern int CCD_Setup_Get_Camera_Head_Model_Name(char *name,int name_length);
@@ -70,6 +141,14 @@ extern float CCD_Setup_Get_Pre_Amp_Gain(void);
 extern int CCD_Setup_Get_Pre_Amp_Gain_Index(void);
 extern int CCD_Setup_Get_Buffer_Length(size_t *buffer_length);
 extern int CCD_Setup_Allocate_Image_Buffer(void **buffer,size_t *buffer_length);
+extern void CCD_Setup_Buffer_Pool_Initialise(struct CCD_Setup_Buffer_Pool_Struct *pool);
+extern int CCD_Setup_Buffer_Pool_Create(struct CCD_Setup_Buffer_Pool_Struct *pool,int buffer_count,
+					size_t buffer_pixel_count,int flags);
+extern int CCD_Setup_Buffer_Pool_Get(struct CCD_Setup_Buffer_Pool_Struct *pool,unsigned short **buffer);
+extern int CCD_Setup_Buffer_Pool_Put(struct CCD_Setup_Buffer_Pool_Struct *pool,unsigned short *buffer);
+extern int CCD_Setup_Buffer_Pool_Free_Count_Get(struct CCD_Setup_Buffer_Pool_Struct *pool,int *free_count,
+						unsigned long long *exhausted_count);
+extern int CCD_Setup_Buffer_Pool_Destroy(struct CCD_Setup_Buffer_Pool_Struct *pool);
 extern int CCD_Setup_Get_Error_Number(void);
 extern void CCD_Setup_Error(void);
 extern void CCD_Setup_Error_String(char *error_string);
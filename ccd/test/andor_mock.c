@@ -0,0 +1,464 @@
+/* andor_mock.c
+** Mock Andor library, used to test the CCD library readout code without a camera.
+*/
+/**
+ * @file
+ * @brief andor_mock.c implements the subset of the Andor SDK used by the CCD library, without a camera.
+ *        <b>SetImage</b> records the readout area, and <b>GetAcquiredData16</b> / <b>GetOldestImage16</b>
+ *        check they were asked for exactly the number of binned pixels in that area (as the real library does),
+ *        and fill the buffer with a known pattern (see Andor_Mock_Pixel_Value).
+ *        Acquisitions complete immediately. Link this in place of the Andor library.
+ * @author Chris Mottram
+ * @version $Id$
+ */
+#include <stdio.h>
+#include <string.h>
+#include "atmcdLXd.h"
+#include "andor_mock.h"
+
+/* hash definitions */
+/**
+ * Default number of columns on the mock detector.
+ */
+#define DEFAULT_DETECTOR_NCOLS	(1024)
+/**
+ * Default number of rows on the mock detector.
+ */
+#define DEFAULT_DETECTOR_NROWS	(1024)
+
+/* data types */
+/**
+ * Structure holding the state of the mock camera.
+ * <dl>
+ * <dt>Detector_NCols</dt> <dd>The number of columns on the mock detector.</dd>
+ * <dt>Detector_NRows</dt> <dd>The number of rows on the mock detector.</dd>
+ * <dt>HBin</dt> <dd>The horizontal binning passed to the last SetImage.</dd>
+ * <dt>VBin</dt> <dd>The vertical binning passed to the last SetImage.</dd>
+ * <dt>HStart</dt> <dd>The first column (inclusive, starting at 1) passed to the last SetImage.</dd>
+ * <dt>HEnd</dt> <dd>The last column (inclusive) passed to the last SetImage.</dd>
+ * <dt>VStart</dt> <dd>The first row (inclusive, starting at 1) passed to the last SetImage.</dd>
+ * <dt>VEnd</dt> <dd>The last row (inclusive) passed to the last SetImage.</dd>
+ * <dt>Status</dt> <dd>The value GetStatus returns.</dd>
+ * <dt>Last_Pixel_Count</dt> <dd>The pixel count passed to the last GetAcquiredData16 / GetOldestImage16.</dd>
+ * <dt>Pixels_Transferred</dt> <dd>The total number of pixels successfully returned.</dd>
+ * <dt>Readout_Count</dt> <dd>The number of successful GetAcquiredData16 / GetOldestImage16 calls.</dd>
+ * <dt>Readout_Error_Count</dt> <dd>The number of GetAcquiredData16 / GetOldestImage16 calls that were asked
+ *     for the wrong number of pixels.</dd>
+ * </dl>
+ */
+struct Mock_Struct
+{
+	int Detector_NCols;
+	int Detector_NRows;
+	int HBin;
+	int VBin;
+	int HStart;
+	int HEnd;
+	int VStart;
+	int VEnd;
+	int Status;
+	size_t Last_Pixel_Count;
+	unsigned long long Pixels_Transferred;
+	int Readout_Count;
+	int Readout_Error_Count;
+};
+
+/* internal variables */
+/**
+ * Revision control system identifier.
+ */
+static char rcsid[] = "$Id$";
+/**
+ * The state of the mock camera. The readout area defaults to the full unbinned detector.
+ * @see #DEFAULT_DETECTOR_NCOLS
+ * @see #DEFAULT_DETECTOR_NROWS
+ */
+static struct Mock_Struct Mock_Data =
+{
+	DEFAULT_DETECTOR_NCOLS,DEFAULT_DETECTOR_NROWS,
+	1,1,1,DEFAULT_DETECTOR_NCOLS,1,DEFAULT_DETECTOR_NROWS,
+	DRV_IDLE,0,0ULL,0,0
+};
+
+/* internal functions */
+static unsigned int Mock_Read_Image(WORD *arr,at_u32 size);
+
+/* ----------------------------------------------------------------------------
+** 		mock test interface
+** ---------------------------------------------------------------------------- */
+/**
+ * Set the size of the mock detector, and reset the readout area to the full unbinned detector.
+ * @param ncols The number of columns on the detector.
+ * @param nrows The number of rows on the detector.
+ * @see #Mock_Data
+ */
+void Andor_Mock_Set_Detector(int ncols,int nrows)
+{
+	Mock_Data.Detector_NCols = ncols;
+	Mock_Data.Detector_NRows = nrows;
+	Mock_Data.HBin = 1;
+	Mock_Data.VBin = 1;
+	Mock_Data.HStart = 1;
+	Mock_Data.HEnd = ncols;
+	Mock_Data.VStart = 1;
+	Mock_Data.VEnd = nrows;
+}
+
+/**
+ * Return the pixel count the CCD library passed to the last GetAcquiredData16 / GetOldestImage16.
+ * @return The pixel count.
+ * @see #Mock_Data
+ */
+size_t Andor_Mock_Get_Last_Pixel_Count(void)
+{
+	return Mock_Data.Last_Pixel_Count;
+}
+
+/**
+ * Return the number of binned pixels in the readout area setup by the last SetImage.
+ * @return The number of binned pixels a readout should return.
+ * @see #Mock_Data
+ */
+size_t Andor_Mock_Get_Expected_Pixel_Count(void)
+{
+	return ((size_t)(((Mock_Data.HEnd-Mock_Data.HStart)+1)/Mock_Data.HBin))*
+		((size_t)(((Mock_Data.VEnd-Mock_Data.VStart)+1)/Mock_Data.VBin));
+}
+
+/**
+ * Return the total number of pixels successfully returned by GetAcquiredData16 / GetOldestImage16.
+ * @return The number of pixels.
+ * @see #Mock_Data
+ */
+unsigned long long Andor_Mock_Get_Pixels_Transferred(void)
+{
+	return Mock_Data.Pixels_Transferred;
+}
+
+/**
+ * Return the number of successful GetAcquiredData16 / GetOldestImage16 calls.
+ * @return The number of readouts.
+ * @see #Mock_Data
+ */
+int Andor_Mock_Get_Readout_Count(void)
+{
+	return Mock_Data.Readout_Count;
+}
+
+/**
+ * Return the number of GetAcquiredData16 / GetOldestImage16 calls that asked for the wrong number of pixels.
+ * @return The number of failed readouts.
+ * @see #Mock_Data
+ */
+int Andor_Mock_Get_Readout_Error_Count(void)
+{
+	return Mock_Data.Readout_Error_Count;
+}
+
+/**
+ * Return the value the mock camera reads out for the (unbinned) detector pixel at (x,y).
+ * A binned pixel takes the value of the first unbinned pixel in the bin. The value depends on
+ * the position, so a test can check the correct sub-window was read out.
+ * @param x The column of the pixel on the detector, starting at 1.
+ * @param y The row of the pixel on the detector, starting at 1.
+ * @return The pixel value.
+ */
+unsigned short Andor_Mock_Pixel_Value(int x,int y)
+{
+	return (unsigned short)(((x*3)+(y*5))&0xffff);
+}
+
+/* ----------------------------------------------------------------------------
+** 		mock Andor library
+** ---------------------------------------------------------------------------- */
+unsigned int AbortAcquisition(void)
+{
+	Mock_Data.Status = DRV_IDLE;
+	return DRV_SUCCESS;
+}
+
+unsigned int CancelWait(void)
+{
+	return DRV_SUCCESS;
+}
+
+unsigned int CoolerOFF(void)
+{
+	return DRV_SUCCESS;
+}
+
+unsigned int CoolerON(void)
+{
+	return DRV_SUCCESS;
+}
+
+unsigned int GetAcquiredData16(WORD *arr,at_u32 size)
+{
+	return Mock_Read_Image(arr,size);
+}
+
+unsigned int GetAcquisitionProgress(at_32 *acc,at_32 *series)
+{
+	(*acc) = 0;
+	(*series) = Mock_Data.Readout_Count;
+	return DRV_SUCCESS;
+}
+
+unsigned int GetAcquisitionTimings(float *exposure,float *accumulate,float *kinetic)
+{
+	(*exposure) = 0.0f;
+	(*accumulate) = 0.0f;
+	(*kinetic) = 0.0f;
+	return DRV_SUCCESS;
+}
+
+unsigned int GetAvailableCameras(at_32 *totalCameras)
+{
+	(*totalCameras) = 1;
+	return DRV_SUCCESS;
+}
+
+unsigned int GetCameraHandle(at_32 cameraIndex,at_32 *cameraHandle)
+{
+	(*cameraHandle) = cameraIndex;
+	return DRV_SUCCESS;
+}
+
+unsigned int GetCameraSerialNumber(int *number)
+{
+	(*number) = 0;
+	return DRV_SUCCESS;
+}
+
+unsigned int GetDetector(int *xpixels,int *ypixels)
+{
+	(*xpixels) = Mock_Data.Detector_NCols;
+	(*ypixels) = Mock_Data.Detector_NRows;
+	return DRV_SUCCESS;
+}
+
+unsigned int GetHeadModel(char *name)
+{
+	strcpy(name,"MOCK");
+	return DRV_SUCCESS;
+}
+
+unsigned int GetHSSpeed(int channel,int typ,int index,float *speed)
+{
+	(*speed) = 1.0f;
+	return DRV_SUCCESS;
+}
+
+unsigned int GetNumberADChannels(int *channels)
+{
+	(*channels) = 1;
+	return DRV_SUCCESS;
+}
+
+unsigned int GetNumberHSSpeeds(int channel,int typ,int *speeds)
+{
+	(*speeds) = 1;
+	return DRV_SUCCESS;
+}
+
+unsigned int GetNumberPreAmpGains(int *noGains)
+{
+	(*noGains) = 1;
+	return DRV_SUCCESS;
+}
+
+unsigned int GetNumberVSSpeeds(int *speeds)
+{
+	(*speeds) = 1;
+	return DRV_SUCCESS;
+}
+
+unsigned int GetOldestImage16(WORD *arr,at_u32 size)
+{
+	return Mock_Read_Image(arr,size);
+}
+
+unsigned int GetPreAmpGain(int index,float *gain)
+{
+	(*gain) = 1.0f;
+	return DRV_SUCCESS;
+}
+
+unsigned int GetStatus(int *status)
+{
+	(*status) = Mock_Data.Status;
+	return DRV_SUCCESS;
+}
+
+unsigned int GetTemperatureF(float *temperature)
+{
+	(*temperature) = -60.0f;
+	return DRV_TEMP_STABILIZED;
+}
+
+unsigned int GetVSSpeed(int index,float *speed)
+{
+	(*speed) = 1.0f;
+	return DRV_SUCCESS;
+}
+
+unsigned int Initialize(char *dir)
+{
+	return DRV_SUCCESS;
+}
+
+unsigned int SetAcquisitionMode(int mode)
+{
+	return DRV_SUCCESS;
+}
+
+unsigned int SetBaselineClamp(int state)
+{
+	return DRV_SUCCESS;
+}
+
+unsigned int SetCoolerMode(int mode)
+{
+	return DRV_SUCCESS;
+}
+
+unsigned int SetCurrentCamera(at_32 cameraHandle)
+{
+	return DRV_SUCCESS;
+}
+
+unsigned int SetExposureTime(float time)
+{
+	return DRV_SUCCESS;
+}
+
+unsigned int SetHSSpeed(int typ,int index)
+{
+	return DRV_SUCCESS;
+}
+
+/**
+ * Mock SetImage. We check the readout area is on the detector and a whole number of bins,
+ * and record it in Mock_Data.
+ * @see #Mock_Data
+ */
+unsigned int SetImage(int hbin,int vbin,int hstart,int hend,int vstart,int vend)
+{
+	if(hbin < 1)
+		return DRV_P1INVALID;
+	if(vbin < 1)
+		return DRV_P2INVALID;
+	if((hstart < 1)||(hstart > Mock_Data.Detector_NCols))
+		return DRV_P3INVALID;
+	if((hend < hstart)||(hend > Mock_Data.Detector_NCols)||((((hend-hstart)+1)%hbin) != 0))
+		return DRV_P4INVALID;
+	if((vstart < 1)||(vstart > Mock_Data.Detector_NRows))
+		return DRV_P5INVALID;
+	if((vend < vstart)||(vend > Mock_Data.Detector_NRows)||((((vend-vstart)+1)%vbin) != 0))
+		return DRV_P6INVALID;
+	Mock_Data.HBin = hbin;
+	Mock_Data.VBin = vbin;
+	Mock_Data.HStart = hstart;
+	Mock_Data.HEnd = hend;
+	Mock_Data.VStart = vstart;
+	Mock_Data.VEnd = vend;
+	return DRV_SUCCESS;
+}
+
+unsigned int SetKineticCycleTime(float time)
+{
+	return DRV_SUCCESS;
+}
+
+unsigned int SetNumberAccumulations(int number)
+{
+	return DRV_SUCCESS;
+}
+
+unsigned int SetNumberKinetics(int number)
+{
+	return DRV_SUCCESS;
+}
+
+unsigned int SetPreAmpGain(int index)
+{
+	return DRV_SUCCESS;
+}
+
+unsigned int SetReadMode(int mode)
+{
+	return DRV_SUCCESS;
+}
+
+unsigned int SetShutter(int typ,int mode,int closingtime,int openingtime)
+{
+	return DRV_SUCCESS;
+}
+
+unsigned int SetTemperature(int temperature)
+{
+	return DRV_SUCCESS;
+}
+
+unsigned int SetVSSpeed(int index)
+{
+	return DRV_SUCCESS;
+}
+
+unsigned int ShutDown(void)
+{
+	return DRV_SUCCESS;
+}
+
+/**
+ * Mock StartAcquisition. The acquisition completes immediately, so GetStatus always returns DRV_IDLE.
+ */
+unsigned int StartAcquisition(void)
+{
+	Mock_Data.Status = DRV_IDLE;
+	return DRV_SUCCESS;
+}
+
+unsigned int WaitForAcquisitionTimeOut(int iTimeOutMs)
+{
+	return DRV_SUCCESS;
+}
+
+/* ----------------------------------------------------------------------------
+** 		internal functions
+** ---------------------------------------------------------------------------- */
+/**
+ * Read out the mock image. As for the real Andor library, the caller must ask for exactly the number of binned
+ * pixels in the readout area, otherwise DRV_P2INVALID is returned. Each binned pixel is set to the
+ * value of the first unbinned pixel in the bin (Andor_Mock_Pixel_Value).
+ * @param arr The buffer to read the image into.
+ * @param size The number of pixels in the buffer.
+ * @return DRV_SUCCESS, or DRV_P2INVALID if size is wrong.
+ * @see #Mock_Data
+ * @see #Andor_Mock_Get_Expected_Pixel_Count
+ * @see #Andor_Mock_Pixel_Value
+ */
+static unsigned int Mock_Read_Image(WORD *arr,at_u32 size)
+{
+	int binned_ncols,binned_nrows,x,y;
+
+	Mock_Data.Last_Pixel_Count = size;
+	if(size != Andor_Mock_Get_Expected_Pixel_Count())
+	{
+		Mock_Data.Readout_Error_Count++;
+		return DRV_P2INVALID;
+	}
+	binned_ncols = ((Mock_Data.HEnd-Mock_Data.HStart)+1)/Mock_Data.HBin;
+	binned_nrows = ((Mock_Data.VEnd-Mock_Data.VStart)+1)/Mock_Data.VBin;
+	for(y = 0; y < binned_nrows; y++)
+	{
+		for(x = 0; x < binned_ncols; x++)
+		{
+			arr[(y*binned_ncols)+x] = Andor_Mock_Pixel_Value(Mock_Data.HStart+(x*Mock_Data.HBin),
+									 Mock_Data.VStart+(y*Mock_Data.VBin));
+		}
+	}
+	Mock_Data.Pixels_Transferred += size;
+	Mock_Data.Readout_Count++;
+	return DRV_SUCCESS;
+}
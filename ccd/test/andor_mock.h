@@ -0,0 +1,24 @@
+/* andor_mock.h
+** $Id$
+*/
+#ifndef ANDOR_MOCK_H
+#define ANDOR_MOCK_H
+/**
+ * @file
+ * @brief andor_mock.h declares the test interface to a mock Andor library, used to test the CCD library
+ *        readout code without a camera.
+ * @author Chris Mottram
+ * @version $Id$
+ */
+/* for size_t declaration */
+#include <stddef.h>
+
+extern void Andor_Mock_Set_Detector(int ncols,int nrows);
+extern size_t Andor_Mock_Get_Last_Pixel_Count(void);
+extern size_t Andor_Mock_Get_Expected_Pixel_Count(void);
+extern unsigned long long Andor_Mock_Get_Pixels_Transferred(void);
+extern int Andor_Mock_Get_Readout_Count(void);
+extern int Andor_Mock_Get_Readout_Error_Count(void);
+extern unsigned short Andor_Mock_Pixel_Value(int x,int y);
+
+#endif
@@ -0,0 +1,335 @@
+/* test_buffer_pool.c
+ * Test the CCD library image buffer pool against the mock Andor library.
+ */
+/**
+ * @file
+ * @brief This program tests the CCD library image buffer pool (CCD_Setup_Buffer_Pool_*). It checks the pool is sized
+ *        for the current binning and window, that the buffers are aligned and distinct, that running out of buffers
+ *        and returning foreign buffers are reported as errors, and that a series of bias readouts (against the mock
+ *        Andor library, andor_mock.c) into pool buffers causes no page faults. The page faults caused by
+ *        allocating a new buffer for each readout are reported for comparison.
+ *        Usage: test_buffer_pool [-huge_page] [-lock] [frame_count]
+ * @author Chris Mottram
+ * @version $Id$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/resource.h>
+#include "ccd_exposure.h"
+#include "ccd_general.h"
+#include "ccd_setup.h"
+#include "andor_mock.h"
+
+/* hash definitions */
+/**
+ * Number of columns on the mock detector.
+ */
+#define DETECTOR_NCOLS		(1024)
+/**
+ * Number of rows on the mock detector.
+ */
+#define DETECTOR_NROWS		(1024)
+/**
+ * The number of buffers in the test pool.
+ */
+#define BUFFER_COUNT		(4)
+/**
+ * Default number of bias readouts in the series.
+ */
+#define DEFAULT_FRAME_COUNT	(50)
+
+/* internal variables */
+/**
+ * Revision control system identifier.
+ */
+static char rcsid[] = "$Id$";
+/**
+ * Boolean, set to TRUE if any check fails.
+ */
+static int Test_Failed = FALSE;
+
+/* internal functions */
+static void Check(int condition,char *description);
+static int Test_Window_Sized_Pool(void);
+static int Test_Pool_Buffers(int flags);
+static int Test_Readout_Series(int flags,int frame_count);
+static long Get_Page_Fault_Count(void);
+
+/**
+ * Main program.
+ * <ul>
+ * <li>We parse the arguments, to get the pool creation flags and frame count.
+ * <li>We set the mock detector size using Andor_Mock_Set_Detector.
+ * <li>We call Test_Window_Sized_Pool, Test_Pool_Buffers and Test_Readout_Series.
+ * </ul>
+ * @param argc The number of arguments.
+ * @param argv The arguments. "-huge_page" and "-lock" set the pool creation flags. The optional last
+ *        argument is the number of readouts in the series.
+ * @return The program returns 0 if all the checks passed, and 1 if any failed.
+ * @see #Test_Window_Sized_Pool
+ * @see #Test_Pool_Buffers
+ * @see #Test_Readout_Series
+ */
+int main(int argc, char *argv[])
+{
+	int flags,frame_count,i;
+
+	flags = 0;
+	frame_count = DEFAULT_FRAME_COUNT;
+	for(i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i],"-huge_page") == 0)
+			flags |= CCD_SETUP_BUFFER_POOL_FLAG_HUGE_PAGE;
+		else if(strcmp(argv[i],"-lock") == 0)
+			flags |= CCD_SETUP_BUFFER_POOL_FLAG_LOCK;
+		else
+		{
+			frame_count = atoi(argv[i]);
+			if(frame_count < 1)
+			{
+				fprintf(stderr,"test_buffer_pool: Illegal frame count %s.\n",argv[i]);
+				return 1;
+			}
+		}
+	}
+	Andor_Mock_Set_Detector(DETECTOR_NCOLS,DETECTOR_NROWS);
+	CCD_Exposure_Initialise();
+	if(!Test_Window_Sized_Pool())
+		return 1;
+	if(!Test_Pool_Buffers(flags))
+		return 1;
+	if(!Test_Readout_Series(flags,frame_count))
+		return 1;
+	if(Test_Failed)
+	{
+		fprintf(stdout,"test_buffer_pool:FAILED\n");
+		return 1;
+	}
+	fprintf(stdout,"test_buffer_pool:PASSED\n");
+	return 0;
+}
+
+/**
+ * Report the result of a check, and set Test_Failed if it failed.
+ * @param condition The result of the check.
+ * @param description A description of the check.
+ * @see #Test_Failed
+ */
+static void Check(int condition,char *description)
+{
+	if(condition)
+		fprintf(stdout,"OK     : %s\n",description);
+	else
+	{
+		fprintf(stdout,"FAILED : %s\n",description);
+		Test_Failed = TRUE;
+	}
+}
+
+/**
+ * Check a pool created with a buffer pixel count of zero is sized for the current binning and window.
+ * @return The routine returns TRUE if the test could be run (the checks may still have failed),
+ *         and FALSE if an error occured.
+ * @see #Check
+ */
+static int Test_Window_Sized_Pool(void)
+{
+	struct CCD_Setup_Buffer_Pool_Struct pool;
+	struct CCD_Setup_Window_Struct window = {101,201,300,300};
+
+	if(!CCD_Setup_Dimensions(DETECTOR_NCOLS,DETECTOR_NROWS,2,2,TRUE,window))
+	{
+		CCD_General_Error();
+		return FALSE;
+	}
+	CCD_Setup_Buffer_Pool_Initialise(&pool);
+	if(!CCD_Setup_Buffer_Pool_Create(&pool,1,0,0))
+	{
+		CCD_General_Error();
+		return FALSE;
+	}
+	Check(pool.Buffer_Pixel_Count == (100*50),"Pool is sized for the binned window");
+	Check(CCD_Setup_Buffer_Pool_Destroy(&pool),"Destroy window sized pool");
+	return TRUE;
+}
+
+/**
+ * Check the buffers handed out by a full frame pool.
+ * <ul>
+ * <li>We create a pool of BUFFER_COUNT full frame buffers.
+ * <li>We take every buffer out of the pool, and check they are aligned to CCD_SETUP_BUFFER_POOL_ALIGNMENT and
+ *     do not overlap.
+ * <li>We check getting another buffer fails, and is counted as the pool being exhausted.
+ * <li>We check the pool cannot be destroyed whilst buffers are in use, and a buffer not from the pool
+ *     cannot be returned to it.
+ * <li>We return the buffers, check they are all free, and destroy the pool.
+ * </ul>
+ * @param flags The pool creation flags.
+ * @return The routine returns TRUE if the test could be run (the checks may still have failed),
+ *         and FALSE if an error occured.
+ * @see #BUFFER_COUNT
+ * @see #Check
+ */
+static int Test_Pool_Buffers(int flags)
+{
+	struct CCD_Setup_Buffer_Pool_Struct pool;
+	unsigned short *buffer_list[BUFFER_COUNT];
+	unsigned short *buffer = NULL;
+	unsigned long long exhausted_count;
+	size_t buffer_length;
+	int i,j,aligned,overlap,free_count;
+
+	CCD_Setup_Buffer_Pool_Initialise(&pool);
+	buffer_length = ((size_t)DETECTOR_NCOLS)*((size_t)DETECTOR_NROWS);
+	if(!CCD_Setup_Buffer_Pool_Create(&pool,BUFFER_COUNT,buffer_length,flags))
+	{
+		CCD_General_Error();
+		return FALSE;
+	}
+	fprintf(stdout,"Pool of %d buffers: %lu bytes, huge pages %d, locked %d.\n",pool.Buffer_Count,
+		(unsigned long)pool.Memory_Length,pool.Is_Huge_Page,pool.Is_Locked);
+	aligned = TRUE;
+	for(i = 0; i < BUFFER_COUNT; i++)
+	{
+		if(!CCD_Setup_Buffer_Pool_Get(&pool,&(buffer_list[i])))
+		{
+			CCD_General_Error();
+			return FALSE;
+		}
+		if((((uintptr_t)buffer_list[i]) % CCD_SETUP_BUFFER_POOL_ALIGNMENT) != 0)
+			aligned = FALSE;
+	}
+	overlap = FALSE;
+	for(i = 0; i < BUFFER_COUNT; i++)
+	{
+		for(j = 0; j < BUFFER_COUNT; j++)
+		{
+			if((i != j)&&(buffer_list[i] <= buffer_list[j])&&(buffer_list[j] < (buffer_list[i]+buffer_length)))
+				overlap = TRUE;
+		}
+	}
+	Check(aligned,"Buffers are aligned");
+	Check(!overlap,"Buffers do not overlap");
+	Check(CCD_Setup_Buffer_Pool_Get(&pool,&buffer) == FALSE,"Get fails when all buffers are in use");
+	Check(CCD_Setup_Buffer_Pool_Free_Count_Get(&pool,&free_count,&exhausted_count)&&(free_count == 0)&&
+	      (exhausted_count == 1),"Exhausted count is incremented");
+	Check(CCD_Setup_Buffer_Pool_Destroy(&pool) == FALSE,"Destroy fails whilst buffers are in use");
+	Check(CCD_Setup_Buffer_Pool_Put(&pool,buffer_list[0]+1) == FALSE,"Put fails for a buffer not in the pool");
+	for(i = 0; i < BUFFER_COUNT; i++)
+	{
+		if(!CCD_Setup_Buffer_Pool_Put(&pool,buffer_list[i]))
+		{
+			CCD_General_Error();
+			return FALSE;
+		}
+	}
+	Check(CCD_Setup_Buffer_Pool_Free_Count_Get(&pool,&free_count,NULL)&&(free_count == BUFFER_COUNT),
+	      "All buffers are free");
+	Check(CCD_Setup_Buffer_Pool_Put(&pool,buffer_list[0]) == FALSE,"Put fails when all buffers are free");
+	Check(CCD_Setup_Buffer_Pool_Destroy(&pool),"Destroy pool");
+	return TRUE;
+}
+
+/**
+ * Check a series of full frame bias readouts into pool buffers causes no page faults.
+ * <ul>
+ * <li>We setup a full frame unbinned readout using CCD_Setup_Dimensions.
+ * <li>We create a pool of BUFFER_COUNT full frame buffers, and do one readout so any code and library pages are
+ *     faulted in before we start counting.
+ * <li>We count the page faults whilst doing frame_count readouts, each into a buffer taken out of the pool and
+ *     then returned to it, and check there were none.
+ * <li>For comparison, we count the page faults whilst doing frame_count readouts each into a newly
+ *     allocated buffer.
+ * </ul>
+ * @param flags The pool creation flags.
+ * @param frame_count The number of readouts in the series.
+ * @return The routine returns TRUE if the test could be run (the checks may still have failed),
+ *         and FALSE if an error occured.
+ * @see #BUFFER_COUNT
+ * @see #Check
+ * @see #Get_Page_Fault_Count
+ */
+static int Test_Readout_Series(int flags,int frame_count)
+{
+	struct CCD_Setup_Buffer_Pool_Struct pool;
+	struct CCD_Setup_Window_Struct window = {0,0,0,0};
+	unsigned short *buffer = NULL;
+	size_t buffer_length;
+	long start_fault_count,pool_fault_count,malloc_fault_count;
+	int i;
+
+	if(!CCD_Setup_Dimensions(DETECTOR_NCOLS,DETECTOR_NROWS,1,1,FALSE,window))
+	{
+		CCD_General_Error();
+		return FALSE;
+	}
+	if(!CCD_Setup_Get_Buffer_Length(&buffer_length))
+	{
+		CCD_General_Error();
+		return FALSE;
+	}
+	CCD_Setup_Buffer_Pool_Initialise(&pool);
+	if(!CCD_Setup_Buffer_Pool_Create(&pool,BUFFER_COUNT,0,flags))
+	{
+		CCD_General_Error();
+		return FALSE;
+	}
+	/* warm up */
+	if((!CCD_Setup_Buffer_Pool_Get(&pool,&buffer))||(!CCD_Exposure_Bias(buffer,buffer_length))||
+	   (!CCD_Setup_Buffer_Pool_Put(&pool,buffer)))
+	{
+		CCD_General_Error();
+		return FALSE;
+	}
+	/* readout series into pool buffers */
+	start_fault_count = Get_Page_Fault_Count();
+	for(i = 0; i < frame_count; i++)
+	{
+		if((!CCD_Setup_Buffer_Pool_Get(&pool,&buffer))||(!CCD_Exposure_Bias(buffer,buffer_length))||
+		   (!CCD_Setup_Buffer_Pool_Put(&pool,buffer)))
+		{
+			CCD_General_Error();
+			return FALSE;
+		}
+	}
+	pool_fault_count = Get_Page_Fault_Count()-start_fault_count;
+	/* readout series into newly allocated buffers, for comparison */
+	start_fault_count = Get_Page_Fault_Count();
+	for(i = 0; i < frame_count; i++)
+	{
+		if(!CCD_Setup_Allocate_Image_Buffer((void **)&buffer,&buffer_length))
+		{
+			CCD_General_Error();
+			return FALSE;
+		}
+		buffer_length /= sizeof(unsigned short);
+		if(!CCD_Exposure_Bias(buffer,buffer_length))
+		{
+			CCD_General_Error();
+			free(buffer);
+			return FALSE;
+		}
+		free(buffer);
+	}
+	malloc_fault_count = Get_Page_Fault_Count()-start_fault_count;
+	fprintf(stdout,"%d readouts of %d x %d pixels: %ld page faults using the pool, "
+		"%ld page faults allocating a buffer per readout.\n",frame_count,DETECTOR_NCOLS,DETECTOR_NROWS,
+		pool_fault_count,malloc_fault_count);
+	Check(pool_fault_count == 0,"Readout series into pool buffers caused no page faults");
+	Check(CCD_Setup_Buffer_Pool_Destroy(&pool),"Destroy pool");
+	return TRUE;
+}
+
+/**
+ * Return the number of page faults (major and minor) this process has caused so far.
+ * @return The number of page faults.
+ */
+static long Get_Page_Fault_Count(void)
+{
+	struct rusage usage;
+
+	getrusage(RUSAGE_SELF,&usage);
+	return usage.ru_minflt+usage.ru_majflt;
+}
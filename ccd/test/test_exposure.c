@@ -92,6 +92,11 @@ static enum COMMAND_ID Command = COMMAND_ID_NONE;
  * If doing a dark or exposure, the exposure length.
  */
 static int Exposure_Length = 0;
+/**
+ * The number of frames to take. If this is greater than one, CCD_Exposure_Series is used to take
+ * a kinetic series of frames back to back.
+ */
+static int Exposure_Count = 1;
 /**
  * Filename to store resultant fits image in. 
  */
@@ -118,6 +123,7 @@ int main(int argc, char *argv[])
 	struct Fits_Header_Struct header;
 	struct timespec start_time;
 	unsigned short *image_buffer = NULL;
+	void **image_buffer_list = NULL;
 	size_t image_buffer_length = 0;
 	char command_buffer[256];
 	int i,retval,value;
@@ -160,37 +166,100 @@ int main(int argc, char *argv[])
 		fprintf(stderr,"Failed to allocate image buffer of length %ld.\n",image_buffer_length);
 		return 4;
 	}
+	/* allocate extra buffers for a kinetic series */
+	if(Exposure_Count > 1)
+	{
+		image_buffer_list = (void **)malloc(Exposure_Count*sizeof(void *));
+		if(image_buffer_list == NULL)
+		{
+			fprintf(stderr,"Failed to allocate image buffer list of length %d.\n",Exposure_Count);
+			return 4;
+		}
+		image_buffer_list[0] = image_buffer;
+		for(i=1; i < Exposure_Count; i++)
+		{
+			image_buffer_list[i] = malloc(image_buffer_length*sizeof(unsigned short));
+			if(image_buffer_list[i] == NULL)
+			{
+				fprintf(stderr,"Failed to allocate image buffer %d of length %ld.\n",i,
+					image_buffer_length);
+				return 4;
+			}
+		}
+	}
 /* do command */
 	start_time.tv_sec = 0;
 	start_time.tv_nsec = 0;
-	switch(Command)
+	if(Exposure_Count > 1)
 	{
-		case COMMAND_ID_BIAS:
-			fprintf(stdout,"Calling CCD_Exposure_Bias.\n");
-			retval = CCD_Exposure_Bias(image_buffer,image_buffer_length);
-			break;
-		case COMMAND_ID_DARK:
-			fprintf(stdout,"Calling CCD_Exposure_Expose with open_shutter FALSE.\n");
-			retval = CCD_Exposure_Expose(FALSE,start_time,Exposure_Length,
-						       image_buffer,image_buffer_length);
-			break;
-		case COMMAND_ID_EXPOSURE:
-			fprintf(stdout,"Calling CCD_Exposure_Expose with open_shutter TRUE.\n");
-			retval = CCD_Exposure_Expose(TRUE,start_time,Exposure_Length,
-						       image_buffer,image_buffer_length);
-			break;
-		case COMMAND_ID_NONE:
-			fprintf(stdout,"Please select a command to execute (-bias | -dark | -expose).\n");
-			Help();
-			return 5;
+		switch(Command)
+		{
+			case COMMAND_ID_BIAS:
+				fprintf(stdout,"Calling CCD_Exposure_Series with open_shutter FALSE, "
+					"exposure length 0 and count %d.\n",Exposure_Count);
+				retval = CCD_Exposure_Series(FALSE,0,Exposure_Count,image_buffer_list,
+							     image_buffer_length);
+				break;
+			case COMMAND_ID_DARK:
+				fprintf(stdout,"Calling CCD_Exposure_Series with open_shutter FALSE and count %d.\n",
+					Exposure_Count);
+				retval = CCD_Exposure_Series(FALSE,Exposure_Length,Exposure_Count,image_buffer_list,
+							     image_buffer_length);
+				break;
+			case COMMAND_ID_EXPOSURE:
+				fprintf(stdout,"Calling CCD_Exposure_Series with open_shutter TRUE and count %d.\n",
+					Exposure_Count);
+				retval = CCD_Exposure_Series(TRUE,Exposure_Length,Exposure_Count,image_buffer_list,
+							     image_buffer_length);
+				break;
+			case COMMAND_ID_NONE:
+				fprintf(stdout,"Please select a command to execute (-bias | -dark | -expose).\n");
+				Help();
+				return 5;
+		}
+		if(retval == FALSE)
+		{
+			fprintf(stdout,"CCD_Exposure_Series retrieved %d of %d frames.\n",CCD_Exposure_Index_Get(),
+				Exposure_Count);
+			CCD_General_Error();
+			return 6;
+		}
+		fprintf(stdout,"CCD_Exposure_Series retrieved %d frames (Andor series %d).\n",
+			CCD_Exposure_Index_Get(),CCD_Exposure_Series_Get());
+		/* save the last frame of the series */
+		image_buffer = (unsigned short*)(image_buffer_list[Exposure_Count-1]);
 	}
-	if(retval == FALSE)
+	else
 	{
-		CCD_General_Error();
-		return 6;
-	}
+		switch(Command)
+		{
+			case COMMAND_ID_BIAS:
+				fprintf(stdout,"Calling CCD_Exposure_Bias.\n");
+				retval = CCD_Exposure_Bias(image_buffer,image_buffer_length);
+				break;
+			case COMMAND_ID_DARK:
+				fprintf(stdout,"Calling CCD_Exposure_Expose with open_shutter FALSE.\n");
+				retval = CCD_Exposure_Expose(FALSE,start_time,Exposure_Length,
+							       image_buffer,image_buffer_length);
+				break;
+			case COMMAND_ID_EXPOSURE:
+				fprintf(stdout,"Calling CCD_Exposure_Expose with open_shutter TRUE.\n");
+				retval = CCD_Exposure_Expose(TRUE,start_time,Exposure_Length,
+							       image_buffer,image_buffer_length);
+				break;
+			case COMMAND_ID_NONE:
+				fprintf(stdout,"Please select a command to execute (-bias | -dark | -expose).\n");
+				Help();
+				return 5;
+		}
+		if(retval == FALSE)
+		{
+			CCD_General_Error();
+			return 6;
+		}
+	}/* end if Exposure_Count > 1 */
 	fprintf(stdout,"Command Completed.\n");
-	if(!Test_Save_Fits_Headers(Exposure_Length,CCD_Setup_Get_NCols(),CCD_Setup_Get_NRows(),Fits_Filename))
+	if(!Test_Save_Fits_Headers(Exposure_Length,CCD_Setup_Get_Binned_NCols(),CCD_Setup_Get_Binned_NRows(),Fits_Filename))
 	{
 		fprintf(stdout,"Saving FITS headers failed.\n");
 		return 4;
@@ -198,7 +267,7 @@ int main(int argc, char *argv[])
 	/* we arn't using the library FITS header routines here, so just create a blank header */
 	CCD_Fits_Header_Initialise(&header);
 	retval = CCD_Exposure_Save(Fits_Filename,image_buffer,image_buffer_length,
-				   CCD_Setup_Get_NCols(),CCD_Setup_Get_NRows(),header);
+				   CCD_Setup_Get_Binned_NCols(),CCD_Setup_Get_Binned_NRows(),header,NULL);
 	if(retval == FALSE)
 	{
 		CCD_General_Error();
@@ -226,6 +295,8 @@ static void Help(void)
 	fprintf(stdout,"Test Exposure:Help.\n");
 	fprintf(stdout,"This program calls CCD_Setup_Dimensions to set up the controller dimensions.\n");
 	fprintf(stdout,"It then calls either CCD_Exposure_Bias or CCD_Exposure_Expose to perform an exposure.\n");
+	fprintf(stdout,"If -count is greater than one, CCD_Exposure_Series is called to take a kinetic series,\n");
+	fprintf(stdout,"and the last frame of the series is saved.\n");
 	fprintf(stdout,"test_exposure \n");
 	fprintf(stdout,"\t[-co[nfig_dir] <directory>]\n");
 	fprintf(stdout,"\t[-l[og_level] <verbosity>][-h[elp]]\n");
@@ -235,6 +306,7 @@ static void Help(void)
 	fprintf(stdout,"\t[-w[indow] <xstart> <ystart> <xend> <yend>]\n");
 	fprintf(stdout,"\t[-f[its_filename] <filename>]\n");
 	fprintf(stdout,"\t[-b[ias]][-d[ark] <exposure length>][-e[xpose] <exposure length>]\n");
+	fprintf(stdout,"\t[-c[ount] <no. of frames>]\n");
 	fprintf(stdout,"\n");
 	fprintf(stdout,"\t-help prints out this message and stops the program.\n");
 	fprintf(stdout,"\n");
@@ -242,6 +314,7 @@ static void Help(void)
 	fprintf(stdout,"\t<temperature> should be a valid double, a temperature in degrees Celcius.\n");
 	fprintf(stdout,"\t<exposure length> is a positive integer in milliseconds.\n");
 	fprintf(stdout,"\t<no. of pixels> and <binning factor> is a positive integer.\n");
+	fprintf(stdout,"\t<no. of frames> is a positive integer.\n");
 }
 
 /**
@@ -258,6 +331,7 @@ static void Help(void)
  * @see #Window
  * @see #Command
  * @see #Exposure_Length
+ * @see #Exposure_Count
  * @see #Fits_Filename
  * @see #Config_Dir
  * @see ../cdocs/ccd_general.html#CCD_General_Set_Log_Filter_Function
@@ -286,6 +360,25 @@ static int Parse_Arguments(int argc, char *argv[])
 		{
 			Command = COMMAND_ID_BIAS;
 		}
+		else if((strcmp(argv[i],"-count")==0)||(strcmp(argv[i],"-c")==0))
+		{
+			if((i+1)<argc)
+			{
+				retval = sscanf(argv[i+1],"%d",&Exposure_Count);
+				if((retval != 1)||(Exposure_Count < 1))
+				{
+					fprintf(stderr,"Parse_Arguments:Parsing exposure count %s failed.\n",
+						argv[i+1]);
+					return FALSE;
+				}
+				i++;
+			}
+			else
+			{
+				fprintf(stderr,"Parse_Arguments:count requires a number of frames.\n");
+				return FALSE;
+			}
+		}
 		else if((strcmp(argv[i],"-dark")==0)||(strcmp(argv[i],"-d")==0))
 		{
 			Command = COMMAND_ID_DARK;
@@ -0,0 +1,450 @@
+/* test_fits_filename.c
+ * Test and benchmark the FITS filename run number journal.
+ */
+/**
+ * @file
+ * @brief This program tests the FITS filename run number journal, checking CCD_Fits_Filename_Initialise restores
+ *        the run number from the journal, and falls back to scanning the data directory when the journal is missing,
+ *        behind the images in the directory, or for another date. It then benchmarks CCD_Fits_Filename_Initialise
+ *        with and without the journal, in a directory containing a night's worth of images.
+ *        Usage: test_fits_filename [-directory &lt;directory&gt;] [-count &lt;file count&gt;]
+ * @author Chris Mottram
+ * @version $Id$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "ccd_fits_filename.h"
+#include "ccd_general.h"
+
+/* hash definitions */
+/**
+ * The default directory the test data directory structure is created in.
+ */
+#define DEFAULT_DIRECTORY	("/tmp")
+/**
+ * The default number of (empty) FITS images created in the data directory for the benchmark.
+ */
+#define DEFAULT_FILE_COUNT	(5000)
+/**
+ * The instrument code used for the test filenames.
+ */
+#define INSTRUMENT_CODE		("TST")
+/**
+ * The telescope component of the test data directory.
+ */
+#define DATA_DIR_TELESCOPE	("telescope")
+/**
+ * The instrument component of the test data directory.
+ */
+#define DATA_DIR_INSTRUMENT	("instrument")
+/**
+ * The number of times CCD_Fits_Filename_Initialise is timed for each benchmark.
+ */
+#define BENCHMARK_REPEAT_COUNT	(10)
+
+/* internal variables */
+/**
+ * Revision control system identifier.
+ */
+static char rcsid[] = "$Id$";
+/**
+ * The root of the test data directory structure.
+ */
+static char Data_Dir_Root[256];
+/**
+ * The data directory the FITS filename routines put images in, retrieved by Get_Data_Dir.
+ */
+static char Data_Dir[256];
+/**
+ * The run number journal filename in Data_Dir.
+ */
+static char Journal_Filename[512];
+/**
+ * Boolean, set to TRUE if any check fails.
+ */
+static int Test_Failed = FALSE;
+
+/* internal functions */
+static void Check(int condition,char *description);
+static int Initialise(void);
+static int Get_Data_Dir(void);
+static int Next_Image(void);
+static int Create_Image(void);
+static int Write_Journal(int date_offset,int run_number);
+static int Test_Journal(void);
+static int Benchmark(int file_count);
+static void Remove_Images(void);
+static double Time_Difference(struct timespec start_time,struct timespec end_time);
+
+/**
+ * Main program.
+ * @param argc The number of arguments.
+ * @param argv The arguments. "-directory" sets the directory the test data directory structure is created in,
+ *        and "-count" the number of images in the data directory for the benchmark.
+ * @return The program returns 0 if all the checks passed, and 1 if any failed.
+ * @see #Test_Journal
+ * @see #Benchmark
+ * @see #Remove_Images
+ */
+int main(int argc, char *argv[])
+{
+	char *directory = DEFAULT_DIRECTORY;
+	char dir_buff[512];
+	int file_count,i;
+
+	file_count = DEFAULT_FILE_COUNT;
+	for(i = 1; i < argc; i++)
+	{
+		if((strcmp(argv[i],"-directory") == 0)&&((i+1) < argc))
+		{
+			directory = argv[i+1];
+			i++;
+		}
+		else if((strcmp(argv[i],"-count") == 0)&&((i+1) < argc))
+		{
+			file_count = atoi(argv[i+1]);
+			if(file_count < 1)
+			{
+				fprintf(stderr,"test_fits_filename: Illegal file count %s.\n",argv[i+1]);
+				return 1;
+			}
+			i++;
+		}
+		else
+		{
+			fprintf(stderr,"test_fits_filename [-directory <directory>] [-count <file count>]\n");
+			return 1;
+		}
+	}
+	/* create the base of the data directory structure, which the FITS filename routines assume exists */
+	sprintf(Data_Dir_Root,"%s/test_fits_filename_%d",directory,(int)getpid());
+	mkdir(Data_Dir_Root,0777);
+	sprintf(dir_buff,"%s/%s",Data_Dir_Root,DATA_DIR_TELESCOPE);
+	mkdir(dir_buff,0777);
+	sprintf(dir_buff,"%s/%s/%s",Data_Dir_Root,DATA_DIR_TELESCOPE,DATA_DIR_INSTRUMENT);
+	if(mkdir(dir_buff,0777) != 0)
+	{
+		fprintf(stderr,"test_fits_filename: Failed to create directory %s.\n",dir_buff);
+		return 1;
+	}
+	if(!Test_Journal())
+	{
+		Remove_Images();
+		return 1;
+	}
+	if(!Benchmark(file_count))
+	{
+		Remove_Images();
+		return 1;
+	}
+	Remove_Images();
+	if(Test_Failed)
+	{
+		fprintf(stdout,"test_fits_filename:FAILED\n");
+		return 1;
+	}
+	fprintf(stdout,"test_fits_filename:PASSED\n");
+	return 0;
+}
+
+/**
+ * Report the result of a check, and set Test_Failed if it failed.
+ * @param condition The result of the check.
+ * @param description A description of the check.
+ * @see #Test_Failed
+ */
+static void Check(int condition,char *description)
+{
+	if(condition)
+		fprintf(stdout,"OK     : %s\n",description);
+	else
+	{
+		fprintf(stdout,"FAILED : %s\n",description);
+		Test_Failed = TRUE;
+	}
+}
+
+/**
+ * Initialise the FITS filename routines with the test data directory structure.
+ * @return The routine returns TRUE on success, and FALSE if an error occured.
+ * @see #Data_Dir_Root
+ */
+static int Initialise(void)
+{
+	if(!CCD_Fits_Filename_Initialise(INSTRUMENT_CODE,Data_Dir_Root,DATA_DIR_TELESCOPE,DATA_DIR_INSTRUMENT))
+	{
+		CCD_General_Error();
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Retrieve the data directory the FITS filename routines are using (from the current filename), and the
+ * run number journal filename in it.
+ * @return The routine returns TRUE on success, and FALSE if an error occured.
+ * @see #Data_Dir
+ * @see #Journal_Filename
+ */
+static int Get_Data_Dir(void)
+{
+	char *chptr = NULL;
+
+	if(!CCD_Fits_Filename_Get_Filename(Data_Dir,256))
+	{
+		CCD_General_Error();
+		return FALSE;
+	}
+	chptr = strrchr(Data_Dir,'/');
+	if(chptr == NULL)
+	{
+		fprintf(stderr,"test_fits_filename: No directory in filename %s.\n",Data_Dir);
+		return FALSE;
+	}
+	(*(chptr+1)) = '\0';
+	sprintf(Journal_Filename,"%s.%s.run",Data_Dir,INSTRUMENT_CODE);
+	return TRUE;
+}
+
+/**
+ * Allocate the next run number, and create an empty FITS image with the resulting filename.
+ * @return The routine returns TRUE on success, and FALSE if an error occured.
+ * @see #Create_Image
+ */
+static int Next_Image(void)
+{
+	if(!CCD_Fits_Filename_Next_Run())
+	{
+		CCD_General_Error();
+		return FALSE;
+	}
+	return Create_Image();
+}
+
+/**
+ * Create an empty FITS image with the current filename.
+ * @return The routine returns TRUE on success, and FALSE if an error occured.
+ */
+static int Create_Image(void)
+{
+	FILE *fp = NULL;
+	char filename[256];
+
+	if(!CCD_Fits_Filename_Get_Filename(filename,256))
+	{
+		CCD_General_Error();
+		return FALSE;
+	}
+	fp = fopen(filename,"w");
+	if(fp == NULL)
+	{
+		fprintf(stderr,"test_fits_filename: Failed to create %s.\n",filename);
+		return FALSE;
+	}
+	fclose(fp);
+	return TRUE;
+}
+
+/**
+ * Overwrite the run number journal.
+ * @param date_offset An offset added to the date number of the current filename, to write a journal for
+ *        another date.
+ * @param run_number The run number to put in the journal.
+ * @return The routine returns TRUE on success, and FALSE if an error occured.
+ * @see #Journal_Filename
+ */
+static int Write_Journal(int date_offset,int run_number)
+{
+	FILE *fp = NULL;
+	char filename[256];
+	char *chptr = NULL;
+	int date_number;
+
+	/* the date number is between the '_' and the '.' in the filename */
+	if(!CCD_Fits_Filename_Get_Filename(filename,256))
+	{
+		CCD_General_Error();
+		return FALSE;
+	}
+	chptr = strrchr(filename,'_');
+	if((chptr == NULL)||(sscanf(chptr+1,"%d",&date_number) != 1))
+	{
+		fprintf(stderr,"test_fits_filename: Failed to parse date number from %s.\n",filename);
+		return FALSE;
+	}
+	fp = fopen(Journal_Filename,"w");
+	if(fp == NULL)
+	{
+		fprintf(stderr,"test_fits_filename: Failed to open %s.\n",Journal_Filename);
+		return FALSE;
+	}
+	fprintf(fp,"%s %d %d\n",INSTRUMENT_CODE,date_number+date_offset,run_number);
+	fclose(fp);
+	return TRUE;
+}
+
+/**
+ * Test the run number journal.
+ * <ul>
+ * <li>We initialise with an empty data directory, and check the run number is 0 and a journal was written.
+ * <li>We create 3 images, and check re-initialising restores run number 3 from the journal.
+ * <li>We delete the journal, and check re-initialising recovers run number 3 by scanning the directory,
+ *     and writes a new journal.
+ * <li>We write a journal behind the images in the directory (run 1), and check run number 3 is recovered.
+ * <li>We write a journal for another date, and check run number 3 is recovered.
+ * <li>We write a journal ahead of the images in the directory (run 10), and check it is used.
+ * <li>We write a garbled journal, and check run number 3 is recovered.
+ * </ul>
+ * @return The routine returns TRUE if the test could be run (the checks may still have failed),
+ *         and FALSE if an error occured.
+ * @see #Initialise
+ * @see #Get_Data_Dir
+ * @see #Next_Image
+ * @see #Write_Journal
+ * @see #Check
+ */
+static int Test_Journal(void)
+{
+	FILE *fp = NULL;
+	int i;
+
+	if(!Initialise())
+		return FALSE;
+	if(!Get_Data_Dir())
+		return FALSE;
+	Check(CCD_Fits_Filename_Run_Get() == 0,"Empty data directory has run number 0.");
+	Check(access(Journal_Filename,F_OK) == 0,"Run number journal is created by initialise.");
+	for(i = 0; i < 3; i++)
+	{
+		if(!Next_Image())
+			return FALSE;
+	}
+	Check(CCD_Fits_Filename_Run_Get() == 3,"Run number is 3 after 3 images.");
+	if(!Initialise())
+		return FALSE;
+	Check(CCD_Fits_Filename_Run_Get() == 3,"Run number 3 is restored from the journal.");
+	remove(Journal_Filename);
+	if(!Initialise())
+		return FALSE;
+	Check(CCD_Fits_Filename_Run_Get() == 3,"Run number 3 is recovered by scanning when the journal is missing.");
+	Check(access(Journal_Filename,F_OK) == 0,"Run number journal is re-created after scanning.");
+	if(!Write_Journal(0,1))
+		return FALSE;
+	if(!Initialise())
+		return FALSE;
+	Check(CCD_Fits_Filename_Run_Get() == 3,"Run number 3 is recovered when the journal is behind the images.");
+	if(!Write_Journal(-1,7))
+		return FALSE;
+	if(!Initialise())
+		return FALSE;
+	Check(CCD_Fits_Filename_Run_Get() == 3,"Run number 3 is recovered when the journal is for another date.");
+	if(!Write_Journal(0,10))
+		return FALSE;
+	if(!Initialise())
+		return FALSE;
+	Check(CCD_Fits_Filename_Run_Get() == 10,"Run number 10 is restored from a journal ahead of the images.");
+	fp = fopen(Journal_Filename,"w");
+	if(fp != NULL)
+	{
+		fprintf(fp,"garbage\n");
+		fclose(fp);
+	}
+	if(!Initialise())
+		return FALSE;
+	Check(CCD_Fits_Filename_Run_Get() == 3,"Run number 3 is recovered when the journal is garbled.");
+	return TRUE;
+}
+
+/**
+ * Benchmark CCD_Fits_Filename_Initialise and CCD_Fits_Filename_Next_Run. We create images in the data directory
+ * until there are file_count, timing CCD_Fits_Filename_Next_Run. We then time CCD_Fits_Filename_Initialise
+ * with the journal, and with the journal deleted (so it has to scan the directory). We check the run
+ * number is file_count in both cases.
+ * @param file_count The number of images in the data directory.
+ * @return The routine returns TRUE if the benchmark could be run, and FALSE if an error occured.
+ * @see #Initialise
+ * @see #Create_Image
+ * @see #Check
+ * @see #Time_Difference
+ */
+static int Benchmark(int file_count)
+{
+	struct timespec start_time,end_time;
+	char description[256];
+	double next_run_time,journal_time,scan_time;
+	int i,run_count;
+
+	next_run_time = 0.0;
+	run_count = file_count-CCD_Fits_Filename_Run_Get();
+	while(CCD_Fits_Filename_Run_Get() < file_count)
+	{
+		clock_gettime(CLOCK_MONOTONIC,&start_time);
+		if(!CCD_Fits_Filename_Next_Run())
+		{
+			CCD_General_Error();
+			return FALSE;
+		}
+		clock_gettime(CLOCK_MONOTONIC,&end_time);
+		next_run_time += Time_Difference(start_time,end_time);
+		if(!Create_Image())
+			return FALSE;
+	}
+	journal_time = 0.0;
+	for(i = 0; i < BENCHMARK_REPEAT_COUNT; i++)
+	{
+		clock_gettime(CLOCK_MONOTONIC,&start_time);
+		if(!Initialise())
+			return FALSE;
+		clock_gettime(CLOCK_MONOTONIC,&end_time);
+		journal_time += Time_Difference(start_time,end_time);
+	}
+	sprintf(description,"Run number %d is restored from the journal.",file_count);
+	Check(CCD_Fits_Filename_Run_Get() == file_count,description);
+	scan_time = 0.0;
+	for(i = 0; i < BENCHMARK_REPEAT_COUNT; i++)
+	{
+		remove(Journal_Filename);
+		clock_gettime(CLOCK_MONOTONIC,&start_time);
+		if(!Initialise())
+			return FALSE;
+		clock_gettime(CLOCK_MONOTONIC,&end_time);
+		scan_time += Time_Difference(start_time,end_time);
+	}
+	sprintf(description,"Run number %d is recovered by scanning.",file_count);
+	Check(CCD_Fits_Filename_Run_Get() == file_count,description);
+	fprintf(stdout,"%d images: Next_Run %.3f ms, Initialise with journal %.3f ms, "
+		"Initialise scanning %.3f ms.\n",file_count,(next_run_time*1000.0)/((double)run_count),
+		(journal_time*1000.0)/((double)BENCHMARK_REPEAT_COUNT),
+		(scan_time*1000.0)/((double)BENCHMARK_REPEAT_COUNT));
+	return TRUE;
+}
+
+/**
+ * Remove the images, journal and directories created by the test.
+ * @see #Data_Dir
+ * @see #Data_Dir_Root
+ */
+static void Remove_Images(void)
+{
+	char command[1024];
+
+	sprintf(command,"rm -rf %s",Data_Dir_Root);
+	system(command);
+}
+
+/**
+ * Return the difference between two times, in seconds.
+ * @param start_time The start time.
+ * @param end_time The end time.
+ * @return The difference (end_time - start_time) in seconds.
+ */
+static double Time_Difference(struct timespec start_time,struct timespec end_time)
+{
+	return ((double)(end_time.tv_sec-start_time.tv_sec))+
+		(((double)(end_time.tv_nsec-start_time.tv_nsec))/1.0e9);
+}
@@ -0,0 +1,527 @@
+/* test_fits_header.c
+ * Test and benchmark the FITS header card list.
+ */
+/**
+ * @file
+ * @brief This program tests the FITS header card list routines (CCD_Fits_Header_*), checking cards are kept in
+ *        insertion order, can be found, updated and deleted by (case insensitive) keyword, copied, merged, and that the
+ *        string arena does not grow without bound when cards are repeatedly updated. It then benchmarks building,
+ *        searching, updating, copying and formatting headers of 50, 500 and 5000 cards.
+ *        Usage: test_fits_header [-count &lt;repeat count&gt;]
+ * @author Chris Mottram
+ * @version $Id$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "ccd_fits_header.h"
+#include "ccd_general.h"
+
+/* hash definitions */
+/**
+ * The default number of times each benchmark is repeated.
+ */
+#define DEFAULT_REPEAT_COUNT	(20)
+/**
+ * The number of times the string card is updated by Test_Arena.
+ */
+#define UPDATE_COUNT		(10000)
+
+/* internal variables */
+/**
+ * Revision control system identifier.
+ */
+static char rcsid[] = "$Id$";
+/**
+ * The header sizes (number of cards) benchmarked.
+ */
+static int Benchmark_Card_Count_List[] = {50,500,5000};
+/**
+ * The number of header sizes in Benchmark_Card_Count_List.
+ */
+static int Benchmark_Card_Count_Count = sizeof(Benchmark_Card_Count_List)/sizeof(Benchmark_Card_Count_List[0]);
+/**
+ * Boolean, set to TRUE if any check fails.
+ */
+static int Test_Failed = FALSE;
+
+/* internal functions */
+static void Check(int condition,char *description);
+static int Add_Cards(struct Fits_Header_Struct *header,int card_count,int value_offset);
+static int Record_Matches(struct Fits_Header_Struct header,int index,char *start);
+static int Test_Order_Find_Delete(void);
+static int Test_Copy(void);
+static int Test_Merge(void);
+static int Test_Arena(void);
+static int Benchmark(int card_count,int repeat_count);
+static double Time_Difference(struct timespec start_time,struct timespec end_time);
+
+/**
+ * Main program.
+ * @param argc The number of arguments.
+ * @param argv The arguments. "-count" sets the number of times each benchmark is repeated.
+ * @return The program returns 0 if all the checks passed, and 1 if any failed.
+ * @see #Test_Order_Find_Delete
+ * @see #Test_Copy
+ * @see #Test_Merge
+ * @see #Test_Arena
+ * @see #Benchmark
+ */
+int main(int argc, char *argv[])
+{
+	int repeat_count,i;
+
+	repeat_count = DEFAULT_REPEAT_COUNT;
+	for(i = 1; i < argc; i++)
+	{
+		if((strcmp(argv[i],"-count") == 0)&&((i+1) < argc))
+		{
+			repeat_count = atoi(argv[i+1]);
+			if(repeat_count < 1)
+			{
+				fprintf(stderr,"test_fits_header: Illegal repeat count %s.\n",argv[i+1]);
+				return 1;
+			}
+			i++;
+		}
+		else
+		{
+			fprintf(stderr,"test_fits_header [-count <repeat count>]\n");
+			return 1;
+		}
+	}
+	if(!Test_Order_Find_Delete())
+		return 1;
+	if(!Test_Copy())
+		return 1;
+	if(!Test_Merge())
+		return 1;
+	if(!Test_Arena())
+		return 1;
+	fprintf(stdout,"%-6s %12s %12s %12s %12s %12s\n","Cards","Build us","Find us","Update us","Copy us",
+		"Format us");
+	for(i = 0; i < Benchmark_Card_Count_Count; i++)
+	{
+		if(!Benchmark(Benchmark_Card_Count_List[i],repeat_count))
+			return 1;
+	}
+	if(Test_Failed)
+	{
+		fprintf(stdout,"test_fits_header:FAILED\n");
+		return 1;
+	}
+	fprintf(stdout,"test_fits_header:PASSED\n");
+	return 0;
+}
+
+/**
+ * Report the result of a check, and set Test_Failed if it failed.
+ * @param condition The result of the check.
+ * @param description A description of the check.
+ * @see #Test_Failed
+ */
+static void Check(int condition,char *description)
+{
+	if(condition)
+		fprintf(stdout,"OK     : %s\n",description);
+	else
+	{
+		fprintf(stdout,"FAILED : %s\n",description);
+		Test_Failed = TRUE;
+	}
+}
+
+/**
+ * Add cards to a header, cycling through the card types, with keywords K0000000, K0000001, ...
+ * The string and float cards have units, and every card has a comment.
+ * @param header The address of the header to add the cards to.
+ * @param card_count The number of cards to add.
+ * @param value_offset A number added to each card's value, so the cards can be updated with different values.
+ * @return The routine returns TRUE on success, and FALSE if an error occured.
+ */
+static int Add_Cards(struct Fits_Header_Struct *header,int card_count,int value_offset)
+{
+	char keyword[16];
+	char value[32];
+	int i,retval;
+
+	for(i = 0; i < card_count; i++)
+	{
+		sprintf(keyword,"K%07d",i);
+		switch(i%4)
+		{
+			case 0:
+				sprintf(value,"Value %d",i+value_offset);
+				retval = CCD_Fits_Header_Add_String(header,keyword,value,"A string card");
+				retval &= CCD_Fits_Header_Add_Units(header,keyword,"string");
+				break;
+			case 1:
+				retval = CCD_Fits_Header_Add_Int(header,keyword,i+value_offset,"An integer card");
+				break;
+			case 2:
+				retval = CCD_Fits_Header_Add_Float(header,keyword,(i+value_offset)/10.0,"A float card");
+				retval &= CCD_Fits_Header_Add_Units(header,keyword,"sec");
+				break;
+			default:
+				retval = CCD_Fits_Header_Add_Logical(header,keyword,(i+value_offset)%2,"A logical card");
+				break;
+		}
+		if(!retval)
+		{
+			CCD_General_Error();
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/**
+ * Format a header with CCD_Fits_Header_Write_To_Block, and check one of the records starts with a string.
+ * @param header The header.
+ * @param index The index of the record to check.
+ * @param start The string the record should start with.
+ * @return The routine returns TRUE if the record starts with the string, and FALSE if it does not (or the
+ *         header could not be formatted).
+ */
+static int Record_Matches(struct Fits_Header_Struct header,int index,char *start)
+{
+	char *block = NULL;
+	int retval;
+
+	if((index < 0)||(index >= header.Card_Count))
+		return FALSE;
+	block = (char *)malloc(header.Card_Count*CCD_FITS_HEADER_CARD_LENGTH);
+	if(block == NULL)
+		return FALSE;
+	retval = CCD_Fits_Header_Write_To_Block(header,block,header.Card_Count*CCD_FITS_HEADER_CARD_LENGTH);
+	if(retval)
+		retval = (strncmp(block+(index*CCD_FITS_HEADER_CARD_LENGTH),start,strlen(start)) == 0);
+	free(block);
+	return retval;
+}
+
+/**
+ * Check cards are kept in insertion order, and can be found, updated and deleted by keyword.
+ * <ul>
+ * <li>We add 100 cards (enough to grow the card list and hash index a few times), and check they are all there,
+ *     in the order they were added.
+ * <li>We update a card, using a lower case keyword, and check the card is updated in place, with it's units cleared.
+ * <li>We delete a card, check it can no longer be found, and the later cards have moved down one, and can still be
+ *     found.
+ * <li>We clear the header, and check it is empty, and can be refilled.
+ * </ul>
+ * @return The routine returns TRUE if the test could be run (the checks may still have failed),
+ *         and FALSE if an error occured.
+ * @see #Add_Cards
+ * @see #Record_Matches
+ * @see #Check
+ */
+static int Test_Order_Find_Delete(void)
+{
+	struct Fits_Header_Struct header;
+	char keyword[16];
+	char record[CCD_FITS_HEADER_CARD_LENGTH+1];
+	int i,in_order,found;
+
+	CCD_Fits_Header_Initialise(&header);
+	if(!Add_Cards(&header,100,0))
+		return FALSE;
+	Check(header.Card_Count == 100,"100 cards added.");
+	in_order = TRUE;
+	found = TRUE;
+	for(i = 0; i < 100; i++)
+	{
+		sprintf(keyword,"K%07d",i);
+		in_order &= Record_Matches(header,i,keyword);
+		found &= CCD_Fits_Header_Add_Comment(&header,keyword,"Found");
+	}
+	Check(in_order,"Cards are in insertion order.");
+	Check(found,"All cards found by keyword.");
+	sprintf(record,"%-8s= %-20s / %s","K0000000","'Value 0 '","[string] Found");
+	Check(Record_Matches(header,0,record),
+	      "String card formatted with it's units and updated comment.");
+	/* update a card with a lower case keyword */
+	if(!CCD_Fits_Header_Add_Int(&header,"k0000002",42,"Updated"))
+	{
+		CCD_General_Error();
+		return FALSE;
+	}
+	Check(header.Card_Count == 100,"Updating a card does not add a card.");
+	sprintf(record,"%-8s= %20d / %s","K0000002",42,"Updated");
+	Check(Record_Matches(header,2,record),"Card updated in place, with a new type and it's units cleared.");
+	/* delete a card */
+	if(!CCD_Fits_Header_Delete(&header,"K0000050"))
+	{
+		CCD_General_Error();
+		return FALSE;
+	}
+	Check(header.Card_Count == 99,"Deleting a card removes it from the list.");
+	Check(!CCD_Fits_Header_Add_Units(&header,"K0000050","sec"),"Deleted card cannot be found.");
+	Check(!CCD_Fits_Header_Delete(&header,"K0000050"),"Deleted card cannot be deleted again.");
+	Check(Record_Matches(header,50,"K0000051"),"Cards after the deleted card have moved down.");
+	found = TRUE;
+	for(i = 0; i < 100; i++)
+	{
+		if(i == 50)
+			continue;
+		sprintf(keyword,"K%07d",i);
+		found &= CCD_Fits_Header_Add_Comment(&header,keyword,"Found again");
+	}
+	Check(found,"All remaining cards found by keyword after a delete.");
+	/* clear the header, and refill it */
+	CCD_Fits_Header_Clear(&header);
+	Check(header.Card_Count == 0,"Cleared header is empty.");
+	Check(!CCD_Fits_Header_Add_Units(&header,"K0000001","sec"),"Cleared card cannot be found.");
+	if(!Add_Cards(&header,10,0))
+		return FALSE;
+	Check((header.Card_Count == 10)&&Record_Matches(header,9,"K0000009"),"Cleared header refilled.");
+	CCD_Fits_Header_Free(&header);
+	return TRUE;
+}
+
+/**
+ * Check a copy of a header formats the same as the original, is independent of it, and can be searched.
+ * We also check copying an empty header into a used one empties it.
+ * @return The routine returns TRUE if the test could be run (the checks may still have failed),
+ *         and FALSE if an error occured.
+ * @see #Add_Cards
+ * @see #Check
+ */
+static int Test_Copy(void)
+{
+	struct Fits_Header_Struct header,copy_header;
+	char *block = NULL;
+	char *copy_block = NULL;
+	size_t block_length;
+
+	CCD_Fits_Header_Initialise(&header);
+	CCD_Fits_Header_Initialise(&copy_header);
+	if(!Add_Cards(&copy_header,5,0))
+		return FALSE;
+	if(!Add_Cards(&header,300,0))
+		return FALSE;
+	if(!CCD_Fits_Header_Copy(&copy_header,header))
+	{
+		CCD_General_Error();
+		return FALSE;
+	}
+	block_length = header.Card_Count*CCD_FITS_HEADER_CARD_LENGTH;
+	block = (char *)malloc(block_length);
+	copy_block = (char *)malloc(block_length);
+	if((block == NULL)||(copy_block == NULL))
+	{
+		fprintf(stderr,"test_fits_header: Failed to allocate blocks.\n");
+		return FALSE;
+	}
+	Check(copy_header.Card_Count == header.Card_Count,"Copy has the same number of cards.");
+	CCD_Fits_Header_Write_To_Block(header,block,block_length);
+	CCD_Fits_Header_Write_To_Block(copy_header,copy_block,block_length);
+	Check(memcmp(block,copy_block,block_length) == 0,"Copy formats the same as the original.");
+	/* modify the original, the copy should not change */
+	if(!Add_Cards(&header,300,1000))
+		return FALSE;
+	CCD_Fits_Header_Write_To_Block(copy_header,block,block_length);
+	Check(memcmp(block,copy_block,block_length) == 0,"Copy is not changed by updating the original.");
+	Check(CCD_Fits_Header_Add_Comment(&copy_header,"K0000299","Found"),"Copy can be searched.");
+	/* copy an empty header */
+	CCD_Fits_Header_Clear(&header);
+	if(!CCD_Fits_Header_Copy(&copy_header,header))
+	{
+		CCD_General_Error();
+		return FALSE;
+	}
+	Check(copy_header.Card_Count == 0,"Copy of an empty header is empty.");
+	Check(!CCD_Fits_Header_Add_Units(&copy_header,"K0000001","sec"),"Copy of an empty header has no cards.");
+	free(block);
+	free(copy_block);
+	CCD_Fits_Header_Free(&header);
+	CCD_Fits_Header_Free(&copy_header);
+	return TRUE;
+}
+
+/**
+ * Check merging a header into another adds the new cards to the end of the destination, in order, with their
+ * units and comments, and updates the destination's cards with the same keyword in place.
+ * We also check a header cannot be merged into itself.
+ * @return The routine returns TRUE if the test could be run (the checks may still have failed),
+ *         and FALSE if an error occured.
+ * @see #Add_Cards
+ * @see #Record_Matches
+ * @see #Check
+ */
+static int Test_Merge(void)
+{
+	struct Fits_Header_Struct header,block_header;
+	char record[CCD_FITS_HEADER_CARD_LENGTH+1];
+	int retval;
+
+	CCD_Fits_Header_Initialise(&header);
+	CCD_Fits_Header_Initialise(&block_header);
+	if(!Add_Cards(&header,10,0))
+		return FALSE;
+	retval = CCD_Fits_Header_Add_Float(&block_header,"EXPTIME",1.5,"Exposure length");
+	retval &= CCD_Fits_Header_Add_Units(&block_header,"EXPTIME","s");
+	retval &= CCD_Fits_Header_Add_String(&block_header,"k0000001","Replaced","Replaced card");
+	retval &= CCD_Fits_Header_Add_Units(&block_header,"K0000001","adu");
+	retval &= CCD_Fits_Header_Add_Logical(&block_header,"FLIPX",TRUE,"Flipped");
+	retval &= CCD_Fits_Header_Merge(&header,block_header);
+	if(!retval)
+	{
+		CCD_General_Error();
+		return FALSE;
+	}
+	Check(header.Card_Count == 12,"Merged header has the new cards added.");
+	Check(Record_Matches(header,10,"EXPTIME = ")&&Record_Matches(header,11,"FLIPX   = "),
+	      "New cards added to the end of the header in order.");
+	sprintf(record,"%-8s= %-20s / %s","K0000001","'Replaced'","[adu] Replaced card");
+	Check(Record_Matches(header,1,record),"Card with the same keyword replaced in place, with the merged units.");
+	sprintf(record,"%-8s= %-20s / %s","K0000000","'Value 0 '","[string] A string card");
+	Check(Record_Matches(header,0,record),"Other cards unchanged by the merge.");
+	Check(CCD_Fits_Header_Add_Comment(&header,"FLIPX","Found"),"Merged card can be found.");
+	Check(!CCD_Fits_Header_Merge(&header,header),"Header cannot be merged into itself.");
+	CCD_Fits_Header_Free(&header);
+	CCD_Fits_Header_Free(&block_header);
+	return TRUE;
+}
+
+/**
+ * Check the string arena is reused, and does not grow without bound, when a header's cards are updated
+ * many times with string values and comments of different lengths.
+ * @return The routine returns TRUE if the test could be run (the checks may still have failed),
+ *         and FALSE if an error occured.
+ * @see #UPDATE_COUNT
+ * @see #Add_Cards
+ * @see #Record_Matches
+ * @see #Check
+ */
+static int Test_Arena(void)
+{
+	struct Fits_Header_Struct header;
+	char value[80];
+	char record[CCD_FITS_HEADER_CARD_LENGTH*2];
+	size_t max_arena_length;
+	int i;
+
+	CCD_Fits_Header_Initialise(&header);
+	if(!Add_Cards(&header,40,0))
+		return FALSE;
+	max_arena_length = 0;
+	for(i = 0; i < UPDATE_COUNT; i++)
+	{
+		sprintf(value,"%.*s",1+(i%60),"abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyzabcdefghijklmnop");
+		if(!CCD_Fits_Header_Add_String(&header,"K0000020",value,value+(i%7)))
+		{
+			CCD_General_Error();
+			return FALSE;
+		}
+		if(header.Allocated_Arena_Length > max_arena_length)
+			max_arena_length = header.Allocated_Arena_Length;
+	}
+	fprintf(stdout,"Arena grew to at most %lu bytes over %d updates.\n",(unsigned long)max_arena_length,
+		UPDATE_COUNT);
+	Check(max_arena_length <= 8192,"Updating a card does not grow the string arena without bound.");
+	sprintf(record,"K0000020= '%s' / %.25s",value,value+((UPDATE_COUNT-1)%7));
+	Check(Record_Matches(header,20,record),"Updated string card has the last value and comment.");
+	sprintf(record,"%-8s= %20s / %s","K0000039","T","A logical card");
+	Check(Record_Matches(header,39,record),"Other cards unchanged by the updates.");
+	CCD_Fits_Header_Free(&header);
+	return TRUE;
+}
+
+/**
+ * Benchmark the FITS header routines for a header with card_count cards. Each benchmark is repeated repeat_count
+ * times, and the mean time is printed in microseconds:
+ * <ul>
+ * <li>Build: Initialise a header and add the cards to it (using Add_Cards), then free it.
+ * <li>Find: Find every card by keyword (using CCD_Fits_Header_Add_Comment).
+ * <li>Update: Add every card again with a different value (using Add_Cards).
+ * <li>Copy: Copy the header into another header (as the FITS writer queue does for each image).
+ * <li>Format: Format the header into FITS records (using CCD_Fits_Header_Write_To_Block).
+ * </ul>
+ * @param card_count The number of cards in the header.
+ * @param repeat_count The number of times each benchmark is repeated.
+ * @return The routine returns TRUE on success, and FALSE if an error occured.
+ * @see #Add_Cards
+ * @see #Time_Difference
+ */
+static int Benchmark(int card_count,int repeat_count)
+{
+	struct Fits_Header_Struct header,copy_header;
+	struct timespec start_time,end_time;
+	double build_time,find_time,update_time,copy_time,format_time;
+	char keyword[16];
+	char *block = NULL;
+	size_t block_length;
+	int repeat,i,retval;
+
+	build_time = 0.0;
+	find_time = 0.0;
+	update_time = 0.0;
+	copy_time = 0.0;
+	format_time = 0.0;
+	block_length = card_count*CCD_FITS_HEADER_CARD_LENGTH;
+	block = (char *)malloc(block_length);
+	if(block == NULL)
+	{
+		fprintf(stderr,"test_fits_header: Failed to allocate block.\n");
+		return FALSE;
+	}
+	CCD_Fits_Header_Initialise(&copy_header);
+	for(repeat = 0; repeat < repeat_count; repeat++)
+	{
+		clock_gettime(CLOCK_MONOTONIC,&start_time);
+		CCD_Fits_Header_Initialise(&header);
+		retval = Add_Cards(&header,card_count,0);
+		CCD_Fits_Header_Free(&header);
+		clock_gettime(CLOCK_MONOTONIC,&end_time);
+		build_time += Time_Difference(start_time,end_time);
+		/* rebuild the header for the other benchmarks */
+		CCD_Fits_Header_Initialise(&header);
+		retval &= Add_Cards(&header,card_count,0);
+		clock_gettime(CLOCK_MONOTONIC,&start_time);
+		for(i = 0; i < card_count; i++)
+		{
+			sprintf(keyword,"K%07d",i);
+			retval &= CCD_Fits_Header_Add_Comment(&header,keyword,"Found");
+		}
+		clock_gettime(CLOCK_MONOTONIC,&end_time);
+		find_time += Time_Difference(start_time,end_time);
+		clock_gettime(CLOCK_MONOTONIC,&start_time);
+		retval &= Add_Cards(&header,card_count,repeat+1);
+		clock_gettime(CLOCK_MONOTONIC,&end_time);
+		update_time += Time_Difference(start_time,end_time);
+		clock_gettime(CLOCK_MONOTONIC,&start_time);
+		retval &= CCD_Fits_Header_Copy(&copy_header,header);
+		clock_gettime(CLOCK_MONOTONIC,&end_time);
+		copy_time += Time_Difference(start_time,end_time);
+		clock_gettime(CLOCK_MONOTONIC,&start_time);
+		retval &= CCD_Fits_Header_Write_To_Block(header,block,block_length);
+		clock_gettime(CLOCK_MONOTONIC,&end_time);
+		format_time += Time_Difference(start_time,end_time);
+		CCD_Fits_Header_Free(&header);
+		if(!retval)
+		{
+			CCD_General_Error();
+			return FALSE;
+		}
+	}
+	fprintf(stdout,"%-6d %12.1f %12.1f %12.1f %12.1f %12.1f\n",card_count,build_time*1.0e6/repeat_count,
+		find_time*1.0e6/repeat_count,update_time*1.0e6/repeat_count,copy_time*1.0e6/repeat_count,
+		format_time*1.0e6/repeat_count);
+	CCD_Fits_Header_Free(&copy_header);
+	free(block);
+	return TRUE;
+}
+
+/**
+ * Return the time between two timestamps, in seconds.
+ * @param start_time The earlier timestamp.
+ * @param end_time The later timestamp.
+ * @return The time difference in seconds.
+ */
+static double Time_Difference(struct timespec start_time,struct timespec end_time)
+{
+	return ((double)(end_time.tv_sec-start_time.tv_sec))+
+		(((double)(end_time.tv_nsec-start_time.tv_nsec))/1.0e9);
+}
@@ -0,0 +1,713 @@
+/* test_fits_writer.c
+ * Test and benchmark the native FITS writer against CFITSIO.
+ */
+/**
+ * @file
+ * @brief This program tests the native FITS writer (CCD_Fits_Writer_Save), by saving the same image and FITS headers
+ *        with CCD_Exposure_Save (which uses CFITSIO) and CCD_Fits_Writer_Save, reading both files back with CFITSIO,
+ *        and checking the image dimensions, pixel values and header keyword values, comments and units are the same.
+ *        It checks two threads can save images with CCD_Exposure_Save at once without corrupting each other's files.
+ *        It then benchmarks the save latency of both writers for 1024x1024 and 2048x2048 images.
+ *        Usage: test_fits_writer [-directory &lt;directory&gt;] [-count &lt;save count&gt;]
+ * @author Chris Mottram
+ * @version $Id$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "fitsio.h"
+#include "ccd_exposure.h"
+#include "ccd_fits_header.h"
+#include "ccd_fits_writer.h"
+#include "ccd_general.h"
+
+/* hash definitions */
+/**
+ * The default directory the test files are written into.
+ */
+#define DEFAULT_DIRECTORY	("/tmp")
+/**
+ * The default number of saves timed for each writer and image size.
+ */
+#define DEFAULT_SAVE_COUNT	(20)
+/**
+ * The number of keywords in the test FITS header.
+ */
+#define KEYWORD_COUNT		(10)
+/**
+ * The number of threads saving images at once in Test_Concurrent_Save.
+ */
+#define CONCURRENT_THREAD_COUNT	(2)
+/**
+ * The number of images each thread saves in Test_Concurrent_Save.
+ */
+#define CONCURRENT_SAVE_COUNT	(10)
+
+/* structures */
+/**
+ * Structure holding an image size.
+ * <dl>
+ * <dt>NCols</dt> <dd>The number of columns.</dd>
+ * <dt>NRows</dt> <dd>The number of rows.</dd>
+ * </dl>
+ */
+struct Image_Size_Struct
+{
+	int NCols;
+	int NRows;
+};
+
+/**
+ * Structure holding the work done by one of Test_Concurrent_Save's threads.
+ * <dl>
+ * <dt>Directory</dt> <dd>The directory to write the test files into.</dd>
+ * <dt>Thread_Index</dt> <dd>The index of the thread, used in the filenames, pixel values and THREADID keyword.</dd>
+ * <dt>Header</dt> <dd>The FITS headers to write, including the thread's THREADID keyword.</dd>
+ * <dt>Buffer</dt> <dd>The thread's image.</dd>
+ * <dt>NCols</dt> <dd>The number of columns in the image.</dd>
+ * <dt>NRows</dt> <dd>The number of rows in the image.</dd>
+ * <dt>Save_Count</dt> <dd>The number of images the thread saved successfully.</dd>
+ * </dl>
+ */
+struct Concurrent_Save_Struct
+{
+	char *Directory;
+	int Thread_Index;
+	struct Fits_Header_Struct Header;
+	unsigned short *Buffer;
+	int NCols;
+	int NRows;
+	int Save_Count;
+};
+
+/* internal variables */
+/**
+ * Revision control system identifier.
+ */
+static char rcsid[] = "$Id$";
+/**
+ * The keywords in the test FITS header, created by Create_Header.
+ * @see #Create_Header
+ */
+static char *Keyword_List[KEYWORD_COUNT] =
+{
+	"OBJECT","LONGSTR","EMPTYSTR","EXPTIME","CCDATEMP","RUNNUM","NEGINT","FLIPX","FLIPY","BIGFLOAT"
+};
+/**
+ * The image sizes checked by Test_Read_Back (an odd size, to test the SIMD pixel conversion tails, and a
+ * full frame).
+ */
+static struct Image_Size_Struct Check_Size_List[] = {{683,341},{1024,1024}};
+/**
+ * The number of image sizes in Check_Size_List.
+ */
+static int Check_Size_Count = sizeof(Check_Size_List)/sizeof(Check_Size_List[0]);
+/**
+ * The image sizes benchmarked.
+ */
+static struct Image_Size_Struct Benchmark_Size_List[] = {{1024,1024},{2048,2048}};
+/**
+ * The number of image sizes in Benchmark_Size_List.
+ */
+static int Benchmark_Size_Count = sizeof(Benchmark_Size_List)/sizeof(Benchmark_Size_List[0]);
+/**
+ * Boolean, set to TRUE if any check fails.
+ */
+static int Test_Failed = FALSE;
+
+/* internal functions */
+static void Check(int condition,char *description);
+static int Create_Header(struct Fits_Header_Struct *header);
+static unsigned short *Create_Image(int ncols,int nrows);
+static int Test_Read_Back(char *directory,struct Fits_Header_Struct header,int ncols,int nrows);
+static int Read_Image(char *filename,int ncols,int nrows,unsigned short *buffer);
+static int Compare_Keywords(char *cfitsio_filename,char *native_filename);
+static int Test_Concurrent_Save(char *directory,struct Fits_Header_Struct header,int ncols,int nrows);
+static void *Concurrent_Save_Thread(void *user_arg);
+static int Read_Thread_Id(char *filename,int *thread_id);
+static int Benchmark_Save(char *directory,struct Fits_Header_Struct header,int ncols,int nrows,int save_count);
+static double Time_Difference(struct timespec start_time,struct timespec end_time);
+
+/**
+ * Main program.
+ * @param argc The number of arguments.
+ * @param argv The arguments. "-directory" sets the directory the test files are written into, and "-count" the
+ *        number of saves timed for each writer and image size.
+ * @return The program returns 0 if all the checks passed, and 1 if any failed.
+ * @see #Create_Header
+ * @see #Test_Read_Back
+ * @see #Test_Concurrent_Save
+ * @see #Benchmark_Save
+ */
+int main(int argc, char *argv[])
+{
+	struct Fits_Header_Struct header;
+	char *directory = DEFAULT_DIRECTORY;
+	int save_count,i;
+
+	save_count = DEFAULT_SAVE_COUNT;
+	for(i = 1; i < argc; i++)
+	{
+		if((strcmp(argv[i],"-directory") == 0)&&((i+1) < argc))
+		{
+			directory = argv[i+1];
+			i++;
+		}
+		else if((strcmp(argv[i],"-count") == 0)&&((i+1) < argc))
+		{
+			save_count = atoi(argv[i+1]);
+			if(save_count < 1)
+			{
+				fprintf(stderr,"test_fits_writer: Illegal save count %s.\n",argv[i+1]);
+				return 1;
+			}
+			i++;
+		}
+		else
+		{
+			fprintf(stderr,"test_fits_writer [-directory <directory>] [-count <save count>]\n");
+			return 1;
+		}
+	}
+	if(!Create_Header(&header))
+		return 1;
+	for(i = 0; i < Check_Size_Count; i++)
+	{
+		if(!Test_Read_Back(directory,header,Check_Size_List[i].NCols,Check_Size_List[i].NRows))
+			return 1;
+	}
+	if(!Test_Concurrent_Save(directory,header,Check_Size_List[0].NCols,Check_Size_List[0].NRows))
+		return 1;
+	fprintf(stdout,"%-10s %-8s %10s %10s %10s\n","Size","Writer","Min ms","Mean ms","Max ms");
+	for(i = 0; i < Benchmark_Size_Count; i++)
+	{
+		if(!Benchmark_Save(directory,header,Benchmark_Size_List[i].NCols,Benchmark_Size_List[i].NRows,
+				   save_count))
+			return 1;
+	}
+	CCD_Fits_Header_Free(&header);
+	if(Test_Failed)
+	{
+		fprintf(stdout,"test_fits_writer:FAILED\n");
+		return 1;
+	}
+	fprintf(stdout,"test_fits_writer:PASSED\n");
+	return 0;
+}
+
+/**
+ * Report the result of a check, and set Test_Failed if it failed.
+ * @param condition The result of the check.
+ * @param description A description of the check.
+ * @see #Test_Failed
+ */
+static void Check(int condition,char *description)
+{
+	if(condition)
+		fprintf(stdout,"OK     : %s\n",description);
+	else
+	{
+		fprintf(stdout,"FAILED : %s\n",description);
+		Test_Failed = TRUE;
+	}
+}
+
+/**
+ * Create the test FITS header, containing a card of each type, with and without comments and units, and
+ * strings containing quotes or too long to fit in a card.
+ * @param header The address of the header to create.
+ * @return The routine returns TRUE on success, and FALSE if an error occured.
+ * @see #Keyword_List
+ */
+static int Create_Header(struct Fits_Header_Struct *header)
+{
+	int retval;
+
+	retval = CCD_Fits_Header_Initialise(header);
+	retval &= CCD_Fits_Header_Add_String(header,"OBJECT","M31 'core'","Object name");
+	retval &= CCD_Fits_Header_Add_String(header,"LONGSTR",
+			     "A string value that is too long to fit in a single FITS header card '''''",
+					     "Truncated");
+	retval &= CCD_Fits_Header_Add_String(header,"EMPTYSTR","",NULL);
+	retval &= CCD_Fits_Header_Add_Float(header,"EXPTIME",12.345678,"Exposure length");
+	retval &= CCD_Fits_Header_Add_Units(header,"EXPTIME","sec");
+	retval &= CCD_Fits_Header_Add_Float(header,"CCDATEMP",-60.25,NULL);
+	retval &= CCD_Fits_Header_Add_Units(header,"CCDATEMP","Celsius");
+	retval &= CCD_Fits_Header_Add_Int(header,"RUNNUM",42,"Run number");
+	retval &= CCD_Fits_Header_Add_Int(header,"NEGINT",-7,NULL);
+	retval &= CCD_Fits_Header_Add_Logical(header,"FLIPX",TRUE,"Camera readout flipped horizontally");
+	retval &= CCD_Fits_Header_Add_Logical(header,"FLIPY",FALSE,NULL);
+	retval &= CCD_Fits_Header_Add_Float(header,"BIGFLOAT",1.0e15,"A float with a long fixed point value, "
+					    "and a comment that is too long to fit");
+	if(!retval)
+	{
+		CCD_General_Error();
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Create a test image, containing every pixel value (including 0, 32767, 32768 and 65535).
+ * @param ncols The number of columns in the image.
+ * @param nrows The number of rows in the image.
+ * @return A pointer to the allocated image, or NULL if the allocation failed.
+ */
+static unsigned short *Create_Image(int ncols,int nrows)
+{
+	unsigned short *buffer = NULL;
+	size_t i;
+
+	buffer = (unsigned short *)malloc(((size_t)ncols)*((size_t)nrows)*sizeof(unsigned short));
+	if(buffer == NULL)
+	{
+		fprintf(stderr,"test_fits_writer: Failed to allocate %d x %d image.\n",ncols,nrows);
+		return NULL;
+	}
+	for(i = 0; i < ((size_t)ncols)*((size_t)nrows); i++)
+		buffer[i] = (unsigned short)((i*40503)&0xffff);
+	return buffer;
+}
+
+/**
+ * Save an image with CCD_Exposure_Save and CCD_Fits_Writer_Save, and check both files read back with CFITSIO
+ * give the same image (Read_Image) and keywords (Compare_Keywords). We also check the native file is a multiple
+ * of the FITS block length.
+ * @param directory The directory to write the test files into.
+ * @param header The FITS headers to write.
+ * @param ncols The number of columns in the image.
+ * @param nrows The number of rows in the image.
+ * @return The routine returns TRUE if the test could be run (the checks may still have failed),
+ *         and FALSE if an error occured.
+ * @see #Create_Image
+ * @see #Read_Image
+ * @see #Compare_Keywords
+ * @see #Check
+ */
+static int Test_Read_Back(char *directory,struct Fits_Header_Struct header,int ncols,int nrows)
+{
+	struct stat file_stat;
+	unsigned short *buffer = NULL;
+	unsigned short *read_buffer = NULL;
+	char cfitsio_filename[256];
+	char native_filename[256];
+	char description[256];
+	size_t pixel_count;
+
+	pixel_count = ((size_t)ncols)*((size_t)nrows);
+	buffer = Create_Image(ncols,nrows);
+	read_buffer = Create_Image(ncols,nrows);
+	if((buffer == NULL)||(read_buffer == NULL))
+		return FALSE;
+	sprintf(cfitsio_filename,"%s/test_fits_writer_cfitsio.fits",directory);
+	sprintf(native_filename,"%s/test_fits_writer_native.fits",directory);
+	unlink(cfitsio_filename);
+	if(!CCD_Exposure_Save(cfitsio_filename,buffer,pixel_count,ncols,nrows,header,NULL))
+	{
+		CCD_General_Error();
+		return FALSE;
+	}
+	if(!CCD_Fits_Writer_Save(native_filename,buffer,pixel_count,ncols,nrows,header,NULL))
+	{
+		CCD_General_Error();
+		return FALSE;
+	}
+	sprintf(description,"%d x %d: native file length is a multiple of %d",ncols,nrows,
+		CCD_FITS_HEADER_BLOCK_LENGTH);
+	Check((stat(native_filename,&file_stat) == 0)&&((file_stat.st_size % CCD_FITS_HEADER_BLOCK_LENGTH) == 0),
+	      description);
+	sprintf(description,"%d x %d: CFITSIO file pixels read back correctly",ncols,nrows);
+	Check(Read_Image(cfitsio_filename,ncols,nrows,read_buffer)&&
+	      (memcmp(buffer,read_buffer,pixel_count*sizeof(unsigned short)) == 0),description);
+	memset(read_buffer,0,pixel_count*sizeof(unsigned short));
+	sprintf(description,"%d x %d: native file pixels read back correctly",ncols,nrows);
+	Check(Read_Image(native_filename,ncols,nrows,read_buffer)&&
+	      (memcmp(buffer,read_buffer,pixel_count*sizeof(unsigned short)) == 0),description);
+	sprintf(description,"%d x %d: native file keywords match the CFITSIO file",ncols,nrows);
+	Check(Compare_Keywords(cfitsio_filename,native_filename),description);
+	unlink(cfitsio_filename);
+	unlink(native_filename);
+	free(buffer);
+	free(read_buffer);
+	return TRUE;
+}
+
+/**
+ * Read an image back using CFITSIO, checking it has one HDU, and the expected type and dimensions.
+ * @param filename The FITS filename.
+ * @param ncols The expected number of columns.
+ * @param nrows The expected number of rows.
+ * @param buffer A buffer of ncols x nrows pixels to read the image into.
+ * @return The routine returns TRUE if the image was read, and had the expected type and dimensions,
+ *         and FALSE otherwise.
+ */
+static int Read_Image(char *filename,int ncols,int nrows,unsigned short *buffer)
+{
+	fitsfile *fits_fp = NULL;
+	long axes[2];
+	int status = 0,hdu_count,bitpix,equivalent_type,naxis,anynul;
+
+	if(fits_open_file(&fits_fp,filename,READONLY,&status))
+	{
+		fits_report_error(stderr,status);
+		return FALSE;
+	}
+	fits_get_num_hdus(fits_fp,&hdu_count,&status);
+	fits_get_img_param(fits_fp,2,&bitpix,&naxis,axes,&status);
+	fits_get_img_equivtype(fits_fp,&equivalent_type,&status);
+	if(status != 0)
+	{
+		fits_report_error(stderr,status);
+		fits_close_file(fits_fp,&status);
+		return FALSE;
+	}
+	if((hdu_count != 1)||(bitpix != SHORT_IMG)||(equivalent_type != USHORT_IMG)||(naxis != 2)||
+	   (axes[0] != ncols)||(axes[1] != nrows))
+	{
+		fprintf(stdout,"%s: %d HDUs, BITPIX %d, equivalent type %d, %d axes %ld x %ld.\n",filename,hdu_count,
+			bitpix,equivalent_type,naxis,axes[0],axes[1]);
+		fits_close_file(fits_fp,&status);
+		return FALSE;
+	}
+	if(fits_read_img(fits_fp,TUSHORT,1,((long)ncols)*((long)nrows),NULL,buffer,&anynul,&status))
+	{
+		fits_report_error(stderr,status);
+		fits_close_file(fits_fp,&status);
+		return FALSE;
+	}
+	fits_close_file(fits_fp,&status);
+	return TRUE;
+}
+
+/**
+ * Compare the values, comments and units of the keywords in Keyword_List, read back from the CFITSIO and native
+ * files using CFITSIO. We then check the two headers have the same number of records, and that each native
+ * header record (including the mandatory records and the COMMENT records describing the FITS standard) is
+ * textually identical to the CFITSIO record in the same position.
+ * @param cfitsio_filename The file written by CCD_Exposure_Save.
+ * @param native_filename The file written by CCD_Fits_Writer_Save.
+ * @return The routine returns TRUE if all the keywords and records match, and FALSE if any differ or an error
+ *         occured.
+ * @see #Keyword_List
+ */
+static int Compare_Keywords(char *cfitsio_filename,char *native_filename)
+{
+	fitsfile *cfitsio_fp = NULL;
+	fitsfile *native_fp = NULL;
+	char cfitsio_value[FLEN_VALUE],native_value[FLEN_VALUE];
+	char cfitsio_comment[FLEN_COMMENT],native_comment[FLEN_COMMENT];
+	char cfitsio_units[FLEN_COMMENT],native_units[FLEN_COMMENT];
+	char cfitsio_record[FLEN_CARD],native_record[FLEN_CARD];
+	int status = 0,retval,i,cfitsio_record_count,native_record_count,identical_count,more_keys;
+
+	if(fits_open_file(&cfitsio_fp,cfitsio_filename,READONLY,&status))
+	{
+		fits_report_error(stderr,status);
+		return FALSE;
+	}
+	if(fits_open_file(&native_fp,native_filename,READONLY,&status))
+	{
+		fits_report_error(stderr,status);
+		fits_close_file(cfitsio_fp,&status);
+		return FALSE;
+	}
+	retval = TRUE;
+	for(i = 0; i < KEYWORD_COUNT; i++)
+	{
+		status = 0;
+		fits_read_keyword(cfitsio_fp,Keyword_List[i],cfitsio_value,cfitsio_comment,&status);
+		fits_read_key_unit(cfitsio_fp,Keyword_List[i],cfitsio_units,&status);
+		fits_read_keyword(native_fp,Keyword_List[i],native_value,native_comment,&status);
+		fits_read_key_unit(native_fp,Keyword_List[i],native_units,&status);
+		if(status != 0)
+		{
+			fits_report_error(stderr,status);
+			retval = FALSE;
+		}
+		else if((strcmp(cfitsio_value,native_value) != 0)||(strcmp(cfitsio_comment,native_comment) != 0)||
+			(strcmp(cfitsio_units,native_units) != 0))
+		{
+			fprintf(stdout,"%s differs: CFITSIO '%s' / '%s' [%s], native '%s' / '%s' [%s].\n",
+				Keyword_List[i],cfitsio_value,cfitsio_comment,cfitsio_units,native_value,
+				native_comment,native_units);
+			retval = FALSE;
+		}
+	}
+	/* compare the header records in order */
+	status = 0;
+	fits_get_hdrspace(cfitsio_fp,&cfitsio_record_count,&more_keys,&status);
+	fits_get_hdrspace(native_fp,&native_record_count,&more_keys,&status);
+	if(status != 0)
+	{
+		fits_report_error(stderr,status);
+		retval = FALSE;
+	}
+	else if(native_record_count != cfitsio_record_count)
+	{
+		fprintf(stdout,"The native header has %d records, CFITSIO's has %d.\n",native_record_count,
+			cfitsio_record_count);
+		retval = FALSE;
+	}
+	identical_count = 0;
+	for(i = 1; (i <= native_record_count)&&(i <= cfitsio_record_count)&&(status == 0); i++)
+	{
+		fits_read_record(native_fp,i,native_record,&status);
+		fits_read_record(cfitsio_fp,i,cfitsio_record,&status);
+		if(status != 0)
+		{
+			fits_report_error(stderr,status);
+			retval = FALSE;
+		}
+		else if(strcmp(native_record,cfitsio_record) == 0)
+			identical_count++;
+		else
+		{
+			fprintf(stdout,"Record %d differs:\nCFITSIO '%s'\nnative  '%s'\n",i,cfitsio_record,native_record);
+			retval = FALSE;
+		}
+	}
+	fprintf(stdout,"%d of %d native header records are identical to CFITSIO's (which has %d records).\n",
+		identical_count,native_record_count,cfitsio_record_count);
+	status = 0;
+	fits_close_file(cfitsio_fp,&status);
+	fits_close_file(native_fp,&status);
+	return retval;
+}
+
+/**
+ * Save images from CONCURRENT_THREAD_COUNT threads at once with CCD_Exposure_Save, and check every file reads back
+ * with it's own thread's pixels and THREADID keyword. Each thread saves a different image (Create_Image's pattern
+ * offset by the thread index), so a file written through another thread's CFITSIO file pointer is detected.
+ * If CFITSIO was not built reentrant (fits_is_reentrant), CCD_Exposure_Save cannot be used from several threads
+ * at once, and the test is skipped.
+ * @param directory The directory to write the test files into.
+ * @param header The FITS headers to write. A THREADID keyword is added to a copy for each thread.
+ * @param ncols The number of columns in the images.
+ * @param nrows The number of rows in the images.
+ * @return The routine returns TRUE if the test could be run (the checks may still have failed),
+ *         and FALSE if an error occured.
+ * @see #CONCURRENT_THREAD_COUNT
+ * @see #CONCURRENT_SAVE_COUNT
+ * @see #Concurrent_Save_Struct
+ * @see #Concurrent_Save_Thread
+ * @see #Create_Image
+ * @see #Read_Image
+ * @see #Read_Thread_Id
+ * @see #Check
+ */
+static int Test_Concurrent_Save(char *directory,struct Fits_Header_Struct header,int ncols,int nrows)
+{
+	struct Concurrent_Save_Struct save_list[CONCURRENT_THREAD_COUNT];
+	pthread_t thread_list[CONCURRENT_THREAD_COUNT];
+	unsigned short *read_buffer = NULL;
+	char filename[256];
+	char description[256];
+	size_t pixel_count,j;
+	int i,save_index,thread_id,files_ok;
+
+	if(fits_is_reentrant() == 0)
+	{
+		fprintf(stdout,"SKIPPED: CFITSIO is not reentrant, so CCD_Exposure_Save cannot be called from several "
+			"threads at once.\n");
+		return TRUE;
+	}
+	pixel_count = ((size_t)ncols)*((size_t)nrows);
+	read_buffer = Create_Image(ncols,nrows);
+	if(read_buffer == NULL)
+		return FALSE;
+	for(i = 0; i < CONCURRENT_THREAD_COUNT; i++)
+	{
+		save_list[i].Directory = directory;
+		save_list[i].Thread_Index = i;
+		save_list[i].NCols = ncols;
+		save_list[i].NRows = nrows;
+		save_list[i].Save_Count = 0;
+		save_list[i].Buffer = Create_Image(ncols,nrows);
+		if(save_list[i].Buffer == NULL)
+			return FALSE;
+		for(j = 0; j < pixel_count; j++)
+			save_list[i].Buffer[j] += i;
+		if((!CCD_Fits_Header_Initialise(&(save_list[i].Header)))||
+		   (!CCD_Fits_Header_Copy(&(save_list[i].Header),header)))
+		{
+			CCD_General_Error();
+			return FALSE;
+		}
+		if(!CCD_Fits_Header_Add_Int(&(save_list[i].Header),"THREADID",i,"Test thread"))
+		{
+			CCD_General_Error();
+			return FALSE;
+		}
+	}
+	for(i = 0; i < CONCURRENT_THREAD_COUNT; i++)
+	{
+		if(pthread_create(&(thread_list[i]),NULL,Concurrent_Save_Thread,&(save_list[i])) != 0)
+		{
+			fprintf(stderr,"test_fits_writer: Failed to create concurrent save thread %d.\n",i);
+			return FALSE;
+		}
+	}
+	for(i = 0; i < CONCURRENT_THREAD_COUNT; i++)
+		pthread_join(thread_list[i],NULL);
+	for(i = 0; i < CONCURRENT_THREAD_COUNT; i++)
+	{
+		sprintf(description,"Concurrent save thread %d saved %d of %d images",i,save_list[i].Save_Count,
+			CONCURRENT_SAVE_COUNT);
+		Check(save_list[i].Save_Count == CONCURRENT_SAVE_COUNT,description);
+		files_ok = TRUE;
+		for(save_index = 0; save_index < save_list[i].Save_Count; save_index++)
+		{
+			sprintf(filename,"%s/test_fits_writer_concurrent_%d_%d.fits",directory,i,save_index);
+			memset(read_buffer,0,pixel_count*sizeof(unsigned short));
+			if((!Read_Image(filename,ncols,nrows,read_buffer))||
+			   (memcmp(save_list[i].Buffer,read_buffer,pixel_count*sizeof(unsigned short)) != 0)||
+			   (!Read_Thread_Id(filename,&thread_id))||(thread_id != i))
+			{
+				fprintf(stdout,"%s does not contain thread %d's image and headers.\n",filename,i);
+				files_ok = FALSE;
+			}
+			unlink(filename);
+		}
+		sprintf(description,"Concurrent save thread %d's images read back correctly",i);
+		Check(files_ok,description);
+		CCD_Fits_Header_Free(&(save_list[i].Header));
+		free(save_list[i].Buffer);
+	}
+	free(read_buffer);
+	return TRUE;
+}
+
+/**
+ * Thread routine for Test_Concurrent_Save. Saves CONCURRENT_SAVE_COUNT copies of the thread's image with
+ * CCD_Exposure_Save, counting the successful saves in Save_Count.
+ * @param user_arg A pointer to the thread's Concurrent_Save_Struct.
+ * @return The routine returns NULL.
+ * @see #Concurrent_Save_Struct
+ * @see #CONCURRENT_SAVE_COUNT
+ */
+static void *Concurrent_Save_Thread(void *user_arg)
+{
+	struct Concurrent_Save_Struct *save = (struct Concurrent_Save_Struct *)user_arg;
+	char filename[256];
+	int save_index;
+
+	for(save_index = 0; save_index < CONCURRENT_SAVE_COUNT; save_index++)
+	{
+		sprintf(filename,"%s/test_fits_writer_concurrent_%d_%d.fits",save->Directory,save->Thread_Index,
+			save_index);
+		unlink(filename);
+		if(!CCD_Exposure_Save(filename,save->Buffer,((size_t)save->NCols)*((size_t)save->NRows),save->NCols,
+				      save->NRows,save->Header,NULL))
+		{
+			CCD_General_Error();
+			continue;
+		}
+		save->Save_Count++;
+	}
+	return NULL;
+}
+
+/**
+ * Read the THREADID keyword written by Test_Concurrent_Save back using CFITSIO.
+ * @param filename The FITS filename.
+ * @param thread_id The address of an integer to return the keyword value in.
+ * @return The routine returns TRUE if the keyword was read, and FALSE otherwise.
+ */
+static int Read_Thread_Id(char *filename,int *thread_id)
+{
+	fitsfile *fits_fp = NULL;
+	int status = 0;
+
+	if(fits_open_file(&fits_fp,filename,READONLY,&status))
+	{
+		fits_report_error(stderr,status);
+		return FALSE;
+	}
+	if(fits_read_key(fits_fp,TINT,"THREADID",thread_id,NULL,&status))
+	{
+		fits_report_error(stderr,status);
+		fits_close_file(fits_fp,&status);
+		return FALSE;
+	}
+	fits_close_file(fits_fp,&status);
+	return TRUE;
+}
+
+/**
+ * Time save_count saves of an image, with CCD_Exposure_Save and CCD_Fits_Writer_Save, and print the minimum,
+ * mean and maximum save latency for each.
+ * @param directory The directory to write the test files into.
+ * @param header The FITS headers to write.
+ * @param ncols The number of columns in the image.
+ * @param nrows The number of rows in the image.
+ * @param save_count The number of saves to time.
+ * @return The routine returns TRUE on success, and FALSE if an error occured.
+ * @see #Create_Image
+ * @see #Time_Difference
+ */
+static int Benchmark_Save(char *directory,struct Fits_Header_Struct header,int ncols,int nrows,int save_count)
+{
+	struct timespec start_time,end_time;
+	unsigned short *buffer = NULL;
+	char filename[256];
+	char size_string[32];
+	double latency,min_latency,max_latency,total_latency;
+	int writer,i,retval;
+
+	buffer = Create_Image(ncols,nrows);
+	if(buffer == NULL)
+		return FALSE;
+	sprintf(filename,"%s/test_fits_writer_benchmark.fits",directory);
+	sprintf(size_string,"%dx%d",ncols,nrows);
+	for(writer = 0; writer < 2; writer++)
+	{
+		min_latency = 1.0e10;
+		max_latency = 0.0;
+		total_latency = 0.0;
+		for(i = 0; i < save_count; i++)
+		{
+			/* CCD_Exposure_Save updates existing files, so always start with a new file */
+			unlink(filename);
+			clock_gettime(CLOCK_MONOTONIC,&start_time);
+			if(writer == 0)
+				retval = CCD_Exposure_Save(filename,buffer,((size_t)ncols)*((size_t)nrows),ncols,nrows,
+							   header,NULL);
+			else
+				retval = CCD_Fits_Writer_Save(filename,buffer,((size_t)ncols)*((size_t)nrows),ncols,nrows,
+							      header,NULL);
+			clock_gettime(CLOCK_MONOTONIC,&end_time);
+			if(retval == FALSE)
+			{
+				CCD_General_Error();
+				return FALSE;
+			}
+			latency = Time_Difference(start_time,end_time)*1000.0;
+			if(latency < min_latency)
+				min_latency = latency;
+			if(latency > max_latency)
+				max_latency = latency;
+			total_latency += latency;
+		}
+		fprintf(stdout,"%-10s %-8s %10.3f %10.3f %10.3f\n",size_string,(writer == 0) ? "cfitsio" : "native",
+			min_latency,total_latency/save_count,max_latency);
+	}
+	unlink(filename);
+	free(buffer);
+	return TRUE;
+}
+
+/**
+ * Return the time between two timestamps, in seconds.
+ * @param start_time The earlier timestamp.
+ * @param end_time The later timestamp.
+ * @return The time difference in seconds.
+ */
+static double Time_Difference(struct timespec start_time,struct timespec end_time)
+{
+	return ((double)(end_time.tv_sec-start_time.tv_sec))+
+		(((double)(end_time.tv_nsec-start_time.tv_nsec))/1.0e9);
+}
@@ -0,0 +1,504 @@
+/* test_orientation.c
+ * Test and benchmark the image orientation routines.
+ */
+/**
+ * @file
+ * @brief This program tests the image orientation routines (ccd_orientation.c), by checking every orientation
+ *        against a simple reference implementation for a range of image sizes (including sizes that are not a
+ *        multiple of the SIMD block size), using every kernel the CPU supports. It then benchmarks every
+ *        orientation and kernel on 1024x1024 and 2048x2048 images, and on binned sizes, and compares the flips
+ *        against the original two pass flip code.
+ *        Usage: test_orientation [megapixels]
+ * @author Chris Mottram
+ * @version $Id$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "ccd_general.h"
+#include "ccd_orientation.h"
+
+/* hash definitions */
+/**
+ * The default number of megapixels to re-orient when timing each orientation / kernel / image size.
+ */
+#define DEFAULT_BENCHMARK_MEGAPIXELS	(100)
+
+/* structures */
+/**
+ * Structure holding an image size.
+ * <dl>
+ * <dt>NCols</dt> <dd>The number of columns.</dd>
+ * <dt>NRows</dt> <dd>The number of rows.</dd>
+ * <dt>Description</dt> <dd>A description of the size.</dd>
+ * </dl>
+ */
+struct Image_Size_Struct
+{
+	int NCols;
+	int NRows;
+	char *Description;
+};
+
+/* internal variables */
+/**
+ * Revision control system identifier.
+ */
+static char rcsid[] = "$Id$";
+/**
+ * The image sizes checked against the reference implementation.
+ */
+static struct Image_Size_Struct Check_Size_List[] =
+{
+	{1,1,"1x1"},{7,5,"7x5"},{8,8,"8x8"},{13,29,"13x29"},{64,64,"64x64"},{100,37,"100x37"},{130,66,"130x66"},
+	{512,512,"512x512"}
+};
+/**
+ * The number of image sizes in Check_Size_List.
+ */
+static int Check_Size_Count = sizeof(Check_Size_List)/sizeof(Check_Size_List[0]);
+/**
+ * The image sizes benchmarked.
+ */
+static struct Image_Size_Struct Benchmark_Size_List[] =
+{
+	{1024,1024,"1024x1024"},{2048,2048,"2048x2048"},{512,512,"1024x1024 binned 2x2"},
+	{1024,1024,"2048x2048 binned 2x2"},{256,256,"1024x1024 binned 4x4"},{1024,512,"2048x1024 binned 2x2"}
+};
+/**
+ * The number of image sizes in Benchmark_Size_List.
+ */
+static int Benchmark_Size_Count = sizeof(Benchmark_Size_List)/sizeof(Benchmark_Size_List[0]);
+/**
+ * Boolean, set to TRUE if any check fails.
+ */
+static int Test_Failed = FALSE;
+
+/* internal functions */
+static void Check(int condition,char *description);
+static void Fill_Image(int ncols,int nrows,unsigned short *buffer);
+static void Reference_Orientation(enum CCD_ORIENTATION orientation,int ncols,int nrows,
+				  const unsigned short *input_buffer,unsigned short *output_buffer);
+static int Check_Orientations(void);
+static void Check_Source_Regions(void);
+static int Benchmark_Orientations(int megapixels);
+static void Two_Pass_Flip_X(int ncols,int nrows,unsigned short *exposure_data);
+static void Two_Pass_Flip_Y(int ncols,int nrows,unsigned short *exposure_data);
+static double Time_Difference(struct timespec start_time,struct timespec end_time);
+
+/**
+ * Main program.
+ * @param argc The number of arguments.
+ * @param argv The arguments. The optional first argument is the number of megapixels to re-orient when timing
+ *        each orientation / kernel / image size.
+ * @return The program returns 0 if all the checks passed, and 1 if any failed.
+ * @see #Check_Orientations
+ * @see #Check_Source_Regions
+ * @see #Benchmark_Orientations
+ */
+int main(int argc, char *argv[])
+{
+	int megapixels;
+
+	megapixels = DEFAULT_BENCHMARK_MEGAPIXELS;
+	if(argc > 1)
+		megapixels = atoi(argv[1]);
+	if(megapixels < 1)
+	{
+		fprintf(stderr,"test_orientation: Illegal megapixel count %s.\n",argv[1]);
+		return 1;
+	}
+	fprintf(stdout,"Default kernel: %s.\n",CCD_Orientation_Kernel_To_String(CCD_Orientation_Kernel_Get()));
+	if(!Check_Orientations())
+		return 1;
+	Check_Source_Regions();
+	if(!Benchmark_Orientations(megapixels))
+		return 1;
+	if(Test_Failed)
+	{
+		fprintf(stdout,"test_orientation:FAILED\n");
+		return 1;
+	}
+	fprintf(stdout,"test_orientation:PASSED\n");
+	return 0;
+}
+
+/**
+ * Report the result of a check, and set Test_Failed if it failed.
+ * @param condition The result of the check.
+ * @param description A description of the check.
+ * @see #Test_Failed
+ */
+static void Check(int condition,char *description)
+{
+	if(condition)
+		fprintf(stdout,"OK     : %s\n",description);
+	else
+	{
+		fprintf(stdout,"FAILED : %s\n",description);
+		Test_Failed = TRUE;
+	}
+}
+
+/**
+ * Fill an image with distinct pixel values.
+ * @param ncols The number of columns in the image.
+ * @param nrows The number of rows in the image.
+ * @param buffer The image.
+ */
+static void Fill_Image(int ncols,int nrows,unsigned short *buffer)
+{
+	size_t i;
+
+	for(i = 0; i < ((size_t)ncols)*((size_t)nrows); i++)
+		buffer[i] = (unsigned short)((i*7919)&0xffff);
+}
+
+/**
+ * A simple reference implementation of every orientation, one pixel at a time.
+ * @param orientation The orientation.
+ * @param ncols The number of columns in the input image.
+ * @param nrows The number of rows in the input image.
+ * @param input_buffer The input image.
+ * @param output_buffer The output image.
+ */
+static void Reference_Orientation(enum CCD_ORIENTATION orientation,int ncols,int nrows,
+				  const unsigned short *input_buffer,unsigned short *output_buffer)
+{
+	int x,y,output_x,output_y,output_ncols;
+
+	output_ncols = ncols;
+	if(CCD_ORIENTATION_SWAPS_AXES(orientation))
+		output_ncols = nrows;
+	for(y = 0; y < nrows; y++)
+	{
+		for(x = 0; x < ncols; x++)
+		{
+			switch(orientation)
+			{
+				case CCD_ORIENTATION_FLIP_X:
+					output_x = ncols-1-x;
+					output_y = y;
+					break;
+				case CCD_ORIENTATION_FLIP_Y:
+					output_x = x;
+					output_y = nrows-1-y;
+					break;
+				case CCD_ORIENTATION_ROTATE_180:
+					output_x = ncols-1-x;
+					output_y = nrows-1-y;
+					break;
+				case CCD_ORIENTATION_TRANSPOSE:
+					output_x = y;
+					output_y = x;
+					break;
+				case CCD_ORIENTATION_ROTATE_90:
+					output_x = nrows-1-y;
+					output_y = x;
+					break;
+				case CCD_ORIENTATION_ROTATE_270:
+					output_x = y;
+					output_y = ncols-1-x;
+					break;
+				case CCD_ORIENTATION_TRANSVERSE:
+					output_x = nrows-1-y;
+					output_y = ncols-1-x;
+					break;
+				case CCD_ORIENTATION_NONE:
+				default:
+					output_x = x;
+					output_y = y;
+					break;
+			}
+			output_buffer[(((size_t)output_y)*((size_t)output_ncols))+output_x] =
+				input_buffer[(((size_t)y)*((size_t)ncols))+x];
+		}
+	}
+}
+
+/**
+ * Check every orientation, for every image size in Check_Size_List, using every kernel the CPU supports.
+ * Each orientation is applied in place (CCD_Orientation_Apply) and into a second buffer
+ * (CCD_Orientation_Apply_Copy), and compared with Reference_Orientation. We also check the orientation names
+ * can be parsed, and the re-oriented dimensions.
+ * @return The routine returns TRUE if the checks could be run (they may still have failed),
+ *         and FALSE if an error occured.
+ * @see #Check_Size_List
+ * @see #Reference_Orientation
+ * @see #Check
+ */
+static int Check_Orientations(void)
+{
+	enum CCD_ORIENTATION orientation,parsed_orientation;
+	enum CCD_ORIENTATION_KERNEL kernel;
+	unsigned short *input_buffer = NULL;
+	unsigned short *in_place_buffer = NULL;
+	unsigned short *copy_buffer = NULL;
+	unsigned short *reference_buffer = NULL;
+	char description[256];
+	size_t pixel_count;
+	int i,ncols,nrows,oriented_ncols,oriented_nrows,in_place_ok,copy_ok;
+
+	for(orientation = CCD_ORIENTATION_NONE; orientation <= CCD_ORIENTATION_TRANSVERSE; orientation++)
+	{
+		sprintf(description,"Parse orientation %s",CCD_Orientation_To_String(orientation));
+		Check(CCD_Orientation_Parse(CCD_Orientation_To_String(orientation),&parsed_orientation)&&
+		      (parsed_orientation == orientation),description);
+	}
+	Check(CCD_Orientation_Parse("upside_down",&parsed_orientation) == FALSE,"Unknown orientation is rejected");
+	CCD_Orientation_Get_Dimensions(CCD_ORIENTATION_ROTATE_90,100,37,&oriented_ncols,&oriented_nrows);
+	Check((oriented_ncols == 37)&&(oriented_nrows == 100),"Rotating by 90 degrees swaps the dimensions");
+	for(kernel = CCD_ORIENTATION_KERNEL_SCALAR; kernel <= CCD_ORIENTATION_KERNEL_AVX2; kernel++)
+	{
+		if(!CCD_Orientation_Kernel_Set(kernel))
+		{
+			fprintf(stdout,"Kernel %s is not supported on this CPU.\n",CCD_Orientation_Kernel_To_String(kernel));
+			continue;
+		}
+		for(i = 0; i < Check_Size_Count; i++)
+		{
+			ncols = Check_Size_List[i].NCols;
+			nrows = Check_Size_List[i].NRows;
+			pixel_count = ((size_t)ncols)*((size_t)nrows);
+			input_buffer = (unsigned short *)malloc(pixel_count*sizeof(unsigned short));
+			in_place_buffer = (unsigned short *)malloc(pixel_count*sizeof(unsigned short));
+			copy_buffer = (unsigned short *)malloc(pixel_count*sizeof(unsigned short));
+			reference_buffer = (unsigned short *)malloc(pixel_count*sizeof(unsigned short));
+			if((input_buffer == NULL)||(in_place_buffer == NULL)||(copy_buffer == NULL)||
+			   (reference_buffer == NULL))
+			{
+				fprintf(stderr,"test_orientation: Failed to allocate buffers.\n");
+				return FALSE;
+			}
+			Fill_Image(ncols,nrows,input_buffer);
+			in_place_ok = TRUE;
+			copy_ok = TRUE;
+			for(orientation = CCD_ORIENTATION_NONE; orientation <= CCD_ORIENTATION_TRANSVERSE; orientation++)
+			{
+				Reference_Orientation(orientation,ncols,nrows,input_buffer,reference_buffer);
+				memcpy(in_place_buffer,input_buffer,pixel_count*sizeof(unsigned short));
+				if(!CCD_Orientation_Apply(orientation,ncols,nrows,in_place_buffer))
+				{
+					CCD_General_Error();
+					return FALSE;
+				}
+				if(memcmp(in_place_buffer,reference_buffer,pixel_count*sizeof(unsigned short)) != 0)
+				{
+					fprintf(stdout,"%s in place differs from the reference.\n",
+						CCD_Orientation_To_String(orientation));
+					in_place_ok = FALSE;
+				}
+				if(!CCD_Orientation_Apply_Copy(orientation,ncols,nrows,input_buffer,copy_buffer))
+				{
+					CCD_General_Error();
+					return FALSE;
+				}
+				if(memcmp(copy_buffer,reference_buffer,pixel_count*sizeof(unsigned short)) != 0)
+				{
+					fprintf(stdout,"%s copy differs from the reference.\n",
+						CCD_Orientation_To_String(orientation));
+					copy_ok = FALSE;
+				}
+			}
+			sprintf(description,"Kernel %s, %s: all orientations match the reference",
+				CCD_Orientation_Kernel_To_String(kernel),Check_Size_List[i].Description);
+			Check(in_place_ok&&copy_ok,description);
+			free(input_buffer);
+			free(in_place_buffer);
+			free(copy_buffer);
+			free(reference_buffer);
+		}
+	}
+	CCD_Orientation_Kernel_Set(CCD_ORIENTATION_KERNEL_AUTO);
+	return TRUE;
+}
+
+/**
+ * Check CCD_Orientation_Get_Source_Region for every orientation. We re-orient a 13x29 image, each pixel of which
+ * holds it's own index, using Reference_Orientation. For a region of the re-oriented image we then check the
+ * source region is the same size, and that every pixel in the region came from inside the source region.
+ * @see #Reference_Orientation
+ * @see #Check
+ */
+static void Check_Source_Regions(void)
+{
+	enum CCD_ORIENTATION orientation;
+	unsigned short input_buffer[13*29];
+	unsigned short output_buffer[13*29];
+	char description[256];
+	int i,x,y,ncols,nrows,oriented_ncols,input_x,input_y,source_x,source_y,source_width,source_height,region_ok;
+
+	ncols = 13;
+	nrows = 29;
+	for(i = 0; i < ncols*nrows; i++)
+		input_buffer[i] = (unsigned short)i;
+	for(orientation = CCD_ORIENTATION_NONE; orientation <= CCD_ORIENTATION_TRANSVERSE; orientation++)
+	{
+		Reference_Orientation(orientation,ncols,nrows,input_buffer,output_buffer);
+		CCD_Orientation_Get_Dimensions(orientation,ncols,nrows,&oriented_ncols,NULL);
+		/* the region from column 2 to 6, row 3 to 10 of the re-oriented image */
+		CCD_Orientation_Get_Source_Region(orientation,ncols,nrows,2,3,5,8,&source_x,&source_y,
+						  &source_width,&source_height);
+		region_ok = (source_width*source_height == 5*8);
+		for(y = 3; y < 3+8; y++)
+		{
+			for(x = 2; x < 2+5; x++)
+			{
+				input_x = output_buffer[(y*oriented_ncols)+x]%ncols;
+				input_y = output_buffer[(y*oriented_ncols)+x]/ncols;
+				if((input_x < source_x)||(input_x >= source_x+source_width)||
+				   (input_y < source_y)||(input_y >= source_y+source_height))
+					region_ok = FALSE;
+			}
+		}
+		sprintf(description,"%s: source region %d,%d %dx%d contains the re-oriented region",
+			CCD_Orientation_To_String(orientation),source_x,source_y,source_width,source_height);
+		Check(region_ok,description);
+	}
+}
+
+/**
+ * Benchmark every orientation and supported kernel, for every image size in Benchmark_Size_List. For the flips,
+ * the original two pass flip code (Two_Pass_Flip_X / Two_Pass_Flip_Y, with a 180 degree rotation done as
+ * a flip in X followed by a flip in Y) is also timed.
+ * @param megapixels The number of megapixels to re-orient when timing each orientation / kernel / image size.
+ * @return The routine returns TRUE if the benchmark could be run, and FALSE if an error occured.
+ * @see #Benchmark_Size_List
+ * @see #Two_Pass_Flip_X
+ * @see #Two_Pass_Flip_Y
+ */
+static int Benchmark_Orientations(int megapixels)
+{
+	enum CCD_ORIENTATION orientation;
+	enum CCD_ORIENTATION_KERNEL kernel;
+	struct timespec start_time,end_time;
+	unsigned short *buffer = NULL;
+	size_t pixel_count;
+	double elapsed_time;
+	int i,iteration,iteration_count,ncols,nrows;
+
+	fprintf(stdout,"%-22s %-12s %-12s %10s\n","Size","Orientation","Kernel","Mpixels/s");
+	for(i = 0; i < Benchmark_Size_Count; i++)
+	{
+		ncols = Benchmark_Size_List[i].NCols;
+		nrows = Benchmark_Size_List[i].NRows;
+		pixel_count = ((size_t)ncols)*((size_t)nrows);
+		iteration_count = (int)((((size_t)megapixels)*1000000)/pixel_count);
+		if(iteration_count < 1)
+			iteration_count = 1;
+		buffer = (unsigned short *)malloc(pixel_count*sizeof(unsigned short));
+		if(buffer == NULL)
+		{
+			fprintf(stderr,"test_orientation: Failed to allocate buffer.\n");
+			return FALSE;
+		}
+		Fill_Image(ncols,nrows,buffer);
+		for(orientation = CCD_ORIENTATION_FLIP_X; orientation <= CCD_ORIENTATION_TRANSVERSE; orientation++)
+		{
+			if(orientation <= CCD_ORIENTATION_ROTATE_180)
+			{
+				clock_gettime(CLOCK_MONOTONIC,&start_time);
+				for(iteration = 0; iteration < iteration_count; iteration++)
+				{
+					if((orientation == CCD_ORIENTATION_FLIP_X)||(orientation == CCD_ORIENTATION_ROTATE_180))
+						Two_Pass_Flip_X(ncols,nrows,buffer);
+					if((orientation == CCD_ORIENTATION_FLIP_Y)||(orientation == CCD_ORIENTATION_ROTATE_180))
+						Two_Pass_Flip_Y(ncols,nrows,buffer);
+				}
+				clock_gettime(CLOCK_MONOTONIC,&end_time);
+				elapsed_time = Time_Difference(start_time,end_time);
+				fprintf(stdout,"%-22s %-12s %-12s %10.1f\n",Benchmark_Size_List[i].Description,
+					CCD_Orientation_To_String(orientation),"original",
+					(((double)pixel_count)*iteration_count)/(elapsed_time*1.0e6));
+			}
+			for(kernel = CCD_ORIENTATION_KERNEL_SCALAR; kernel <= CCD_ORIENTATION_KERNEL_AVX2; kernel++)
+			{
+				if(!CCD_Orientation_Kernel_Set(kernel))
+					continue;
+				clock_gettime(CLOCK_MONOTONIC,&start_time);
+				for(iteration = 0; iteration < iteration_count; iteration++)
+				{
+					/* the transposing orientations swap the dimensions each time */
+					if(CCD_ORIENTATION_SWAPS_AXES(orientation)&&(iteration & 1))
+					{
+						if(!CCD_Orientation_Apply(orientation,nrows,ncols,buffer))
+						{
+							CCD_General_Error();
+							return FALSE;
+						}
+					}
+					else if(!CCD_Orientation_Apply(orientation,ncols,nrows,buffer))
+					{
+						CCD_General_Error();
+						return FALSE;
+					}
+				}
+				clock_gettime(CLOCK_MONOTONIC,&end_time);
+				elapsed_time = Time_Difference(start_time,end_time);
+				fprintf(stdout,"%-22s %-12s %-12s %10.1f\n",Benchmark_Size_List[i].Description,
+					CCD_Orientation_To_String(orientation),CCD_Orientation_Kernel_To_String(kernel),
+					(((double)pixel_count)*iteration_count)/(elapsed_time*1.0e6));
+			}
+		}
+		free(buffer);
+	}
+	CCD_Orientation_Kernel_Set(CCD_ORIENTATION_KERNEL_AUTO);
+	return TRUE;
+}
+
+/**
+ * The original (pre ccd_orientation.c) code used to flip the image data in the X direction, for comparison.
+ * @param ncols The number of columns on the CCD.
+ * @param nrows The number of rows on the CCD.
+ * @param exposure_data The image data received from the CCD. The data in this array is flipped in the X direction.
+ */
+static void Two_Pass_Flip_X(int ncols,int nrows,unsigned short *exposure_data)
+{
+	int x,y;
+	unsigned short int tempval;
+
+	for(y=0;y<nrows;y++)
+	{
+		for(x=0;x<(ncols/2);x++)
+		{
+			tempval = *(exposure_data+(y*ncols)+x);
+			*(exposure_data+(y*ncols)+x) = *(exposure_data+(y*ncols)+(ncols-(x+1)));
+			*(exposure_data+(y*ncols)+(ncols-(x+1))) = tempval;
+		}
+	}
+}
+
+/**
+ * The original (pre ccd_orientation.c) code used to flip the image data in the Y direction, for comparison.
+ * @param ncols The number of columns on the CCD.
+ * @param nrows The number of rows on the CCD.
+ * @param exposure_data The image data received from the CCD. The data in this array is flipped in the Y direction.
+ */
+static void Two_Pass_Flip_Y(int ncols,int nrows,unsigned short *exposure_data)
+{
+	int x,y;
+	unsigned short int tempval;
+
+	for(y=0;y<(nrows/2);y++)
+	{
+		for(x=0;x<ncols;x++)
+		{
+			tempval = *(exposure_data+(y*ncols)+x);
+			*(exposure_data+(y*ncols)+x) = *(exposure_data+(((nrows-(y+1))*ncols)+x));
+			*(exposure_data+(((nrows-(y+1))*ncols)+x)) = tempval;
+		}
+	}
+}
+
+/**
+ * Return the time between two timestamps, in seconds.
+ * @param start_time The earlier timestamp.
+ * @param end_time The later timestamp.
+ * @return The time difference in seconds.
+ */
+static double Time_Difference(struct timespec start_time,struct timespec end_time)
+{
+	return ((double)(end_time.tv_sec-start_time.tv_sec))+
+		(((double)(end_time.tv_nsec-start_time.tv_nsec))/1.0e9);
+}
@@ -0,0 +1,382 @@
+/* test_window_readout.c
+ * Test windowed / binned readouts against the mock Andor library.
+ */
+/**
+ * @file
+ * @brief This program tests the CCD library only reads out, and saves, the windowed and binned pixels, by
+ *        running bias readouts against the mock Andor library (andor_mock.c) with a series of readout areas.
+ *        For each readout area it checks the buffer length, the pixel count passed to GetAcquiredData16,
+ *        the pixel values, the timeline of the readout and save, and the dimensions of the saved FITS image,
+ *        and reports the readout throughput.
+ *        Usage: test_window_readout [frame_count]
+ * @author Chris Mottram
+ * @version $Id$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "fitsio.h"
+#include "ccd_exposure.h"
+#include "ccd_fits_header.h"
+#include "ccd_general.h"
+#include "ccd_setup.h"
+#include "andor_mock.h"
+
+/* hash definitions */
+/**
+ * Number of columns on the mock detector.
+ */
+#define DETECTOR_NCOLS		(1024)
+/**
+ * Number of rows on the mock detector.
+ */
+#define DETECTOR_NROWS		(1024)
+/**
+ * Default number of bias readouts to time for each readout area.
+ */
+#define DEFAULT_FRAME_COUNT	(20)
+/**
+ * The FITS filename each readout area is saved to.
+ */
+#define FITS_FILENAME		("/tmp/test_window_readout.fits")
+
+/* structures */
+/**
+ * Structure describing one readout area to test.
+ * <dl>
+ * <dt>Description</dt> <dd>A description of the readout area.</dd>
+ * <dt>Bin_X</dt> <dd>The horizontal binning.</dd>
+ * <dt>Bin_Y</dt> <dd>The vertical binning.</dd>
+ * <dt>Window_Flags</dt> <dd>Whether to use the window.</dd>
+ * <dt>Window</dt> <dd>The window (unbinned, inclusive, starting at 1).</dd>
+ * <dt>Binned_NCols</dt> <dd>The expected number of binned columns read out.</dd>
+ * <dt>Binned_NRows</dt> <dd>The expected number of binned rows read out.</dd>
+ * </dl>
+ */
+struct Readout_Area_Struct
+{
+	char *Description;
+	int Bin_X;
+	int Bin_Y;
+	int Window_Flags;
+	struct CCD_Setup_Window_Struct Window;
+	int Binned_NCols;
+	int Binned_NRows;
+};
+
+/* internal variables */
+/**
+ * Revision control system identifier.
+ */
+static char rcsid[] = "$Id$";
+/**
+ * The list of readout areas to test. The first must be the unbinned full frame, as the windowed throughput
+ * is compared to it.
+ */
+static struct Readout_Area_Struct Readout_Area_List[] =
+{
+	{"Full frame 1x1",1,1,FALSE,{0,0,0,0},1024,1024},
+	{"Full frame 2x2",2,2,FALSE,{0,0,0,0},512,512},
+	{"Window 200x100 1x1",1,1,TRUE,{101,201,300,300},200,100},
+	{"Window 200x100 2x2",2,2,TRUE,{101,201,300,300},100,50},
+	{"Window 64x32 4x4",4,4,TRUE,{1,1,64,32},16,8}
+};
+/**
+ * The number of readout areas in Readout_Area_List.
+ * @see #Readout_Area_List
+ */
+static int Readout_Area_Count = sizeof(Readout_Area_List)/sizeof(Readout_Area_List[0]);
+/**
+ * Boolean, set to TRUE if any check fails.
+ */
+static int Test_Failed = FALSE;
+
+/* internal functions */
+static void Check(int condition,char *description);
+static int Check_Pixels(struct Readout_Area_Struct *area,unsigned short *buffer);
+static int Test_Readout_Area(struct Readout_Area_Struct *area,int frame_count,double *frames_per_second);
+static int Check_Fits_Image(struct Readout_Area_Struct *area);
+static int Timeline_In_Order(struct CCD_Exposure_Timeline_Struct *timeline,enum CCD_EXPOSURE_TIMELINE_PHASE first,
+			     enum CCD_EXPOSURE_TIMELINE_PHASE last);
+static double Time_Difference(struct timespec start_time,struct timespec end_time);
+
+/**
+ * Main program.
+ * <ul>
+ * <li>We set the mock detector size using Andor_Mock_Set_Detector.
+ * <li>For each readout area in Readout_Area_List we call Test_Readout_Area.
+ * <li>We check the windowed readouts have a higher cadence than the unbinned full frame readout.
+ * </ul>
+ * @param argc The number of arguments.
+ * @param argv The arguments. The optional first argument is the number of readouts to time per readout area.
+ * @return The program returns 0 if all the checks passed, and 1 if any failed.
+ * @see #Readout_Area_List
+ * @see #Test_Readout_Area
+ */
+int main(int argc, char *argv[])
+{
+	double frames_per_second,full_frame_frames_per_second;
+	int frame_count,i;
+
+	frame_count = DEFAULT_FRAME_COUNT;
+	if(argc > 1)
+		frame_count = atoi(argv[1]);
+	if(frame_count < 1)
+	{
+		fprintf(stderr,"test_window_readout: Illegal frame count %s.\n",argv[1]);
+		return 1;
+	}
+	Andor_Mock_Set_Detector(DETECTOR_NCOLS,DETECTOR_NROWS);
+	CCD_Exposure_Initialise();
+	full_frame_frames_per_second = 0.0;
+	for(i = 0; i < Readout_Area_Count; i++)
+	{
+		if(!Test_Readout_Area(&(Readout_Area_List[i]),frame_count,&frames_per_second))
+			return 1;
+		if(i == 0)
+			full_frame_frames_per_second = frames_per_second;
+		else if(Readout_Area_List[i].Window_Flags)
+			Check(frames_per_second > full_frame_frames_per_second,
+			      "Windowed readout cadence is higher than the full frame cadence");
+	}
+	unlink(FITS_FILENAME);
+	if(Test_Failed)
+	{
+		fprintf(stdout,"test_window_readout:FAILED\n");
+		return 1;
+	}
+	fprintf(stdout,"test_window_readout:PASSED\n");
+	return 0;
+}
+
+/**
+ * Report the result of a check, and set Test_Failed if it failed.
+ * @param condition The result of the check.
+ * @param description A description of the check.
+ * @see #Test_Failed
+ */
+static void Check(int condition,char *description)
+{
+	if(condition)
+		fprintf(stdout,"OK     : %s\n",description);
+	else
+	{
+		fprintf(stdout,"FAILED : %s\n",description);
+		Test_Failed = TRUE;
+	}
+}
+
+/**
+ * Check the pixels in a read out buffer are the ones the mock camera generates for the readout area.
+ * @param area The readout area.
+ * @param buffer The read out pixels.
+ * @return TRUE if all the pixels match, FALSE otherwise.
+ * @see #Andor_Mock_Pixel_Value
+ */
+static int Check_Pixels(struct Readout_Area_Struct *area,unsigned short *buffer)
+{
+	int x_start,y_start,x,y;
+
+	x_start = 1;
+	y_start = 1;
+	if(area->Window_Flags)
+	{
+		x_start = area->Window.X_Start;
+		y_start = area->Window.Y_Start;
+	}
+	for(y = 0; y < area->Binned_NRows; y++)
+	{
+		for(x = 0; x < area->Binned_NCols; x++)
+		{
+			if(buffer[(y*area->Binned_NCols)+x] != Andor_Mock_Pixel_Value(x_start+(x*area->Bin_X),
+										      y_start+(y*area->Bin_Y)))
+				return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/**
+ * Test one readout area.
+ * <ul>
+ * <li>We call CCD_Setup_Dimensions to setup the readout area.
+ * <li>We check CCD_Setup_Get_Binned_NCols / CCD_Setup_Get_Binned_NRows / CCD_Setup_Get_Buffer_Length
+ *     return the binned window dimensions.
+ * <li>We allocate a buffer of that length, and time frame_count readouts using CCD_Exposure_Bias.
+ * <li>We check the mock Andor library was asked for exactly the binned window pixel count, and the
+ *     pixel values came from the window.
+ * <li>We check CCD_Exposure_Timeline_Get returns the setup to readout phases of the last readout, in order.
+ * <li>We save the image using CCD_Exposure_Save, check the save phases were time stamped in order,
+ *     and check the image using Check_Fits_Image.
+ * </ul>
+ * @param area The readout area to test.
+ * @param frame_count The number of readouts to time.
+ * @param frames_per_second The address of a double to store the measured readout cadence.
+ * @return The routine returns TRUE if the test could be run (the checks may still have failed),
+ *         and FALSE if an error occured.
+ * @see #Check
+ * @see #Check_Pixels
+ * @see #Check_Fits_Image
+ * @see #Timeline_In_Order
+ */
+static int Test_Readout_Area(struct Readout_Area_Struct *area,int frame_count,double *frames_per_second)
+{
+	struct Fits_Header_Struct header;
+	struct CCD_Exposure_Timeline_Struct timeline;
+	struct timespec start_time,end_time;
+	unsigned short *buffer = NULL;
+	size_t buffer_length,expected_length;
+	unsigned long long start_pixels_transferred,pixels_transferred;
+	double elapsed_time;
+	int i,readout_error_count;
+
+	fprintf(stdout,"%s:\n",area->Description);
+	if(!CCD_Setup_Dimensions(DETECTOR_NCOLS,DETECTOR_NROWS,area->Bin_X,area->Bin_Y,area->Window_Flags,
+				 area->Window))
+	{
+		CCD_General_Error();
+		return FALSE;
+	}
+	expected_length = ((size_t)area->Binned_NCols)*((size_t)area->Binned_NRows);
+	Check((CCD_Setup_Get_Binned_NCols() == area->Binned_NCols)&&
+	      (CCD_Setup_Get_Binned_NRows() == area->Binned_NRows),"Binned dimensions");
+	if(!CCD_Setup_Get_Buffer_Length(&buffer_length))
+	{
+		CCD_General_Error();
+		return FALSE;
+	}
+	Check(buffer_length == expected_length,"Buffer length is the binned window pixel count");
+	buffer = (unsigned short *)malloc(buffer_length*sizeof(unsigned short));
+	if(buffer == NULL)
+	{
+		fprintf(stderr,"test_window_readout: Failed to allocate buffer of %ld pixels.\n",buffer_length);
+		return FALSE;
+	}
+	/* time a series of readouts */
+	readout_error_count = Andor_Mock_Get_Readout_Error_Count();
+	start_pixels_transferred = Andor_Mock_Get_Pixels_Transferred();
+	clock_gettime(CLOCK_MONOTONIC,&start_time);
+	for(i = 0; i < frame_count; i++)
+	{
+		if(!CCD_Exposure_Bias(buffer,buffer_length))
+		{
+			CCD_General_Error();
+			free(buffer);
+			return FALSE;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC,&end_time);
+	elapsed_time = Time_Difference(start_time,end_time);
+	pixels_transferred = Andor_Mock_Get_Pixels_Transferred()-start_pixels_transferred;
+	Check((Andor_Mock_Get_Last_Pixel_Count() == expected_length)&&
+	      (Andor_Mock_Get_Readout_Error_Count() == readout_error_count),
+	      "GetAcquiredData16 asked for the binned window pixel count");
+	Check(pixels_transferred == (((unsigned long long)expected_length)*frame_count),
+	      "Pixels transferred is frame count x binned window pixel count");
+	Check(Check_Pixels(area,buffer),"Pixel values come from the window");
+	CCD_Exposure_Timeline_Clear(&timeline);
+	Check(CCD_Exposure_Timeline_Get(&timeline)&&
+	      Timeline_In_Order(&timeline,CCD_EXPOSURE_TIMELINE_SETUP,CCD_EXPOSURE_TIMELINE_READOUT),
+	      "Readout timeline is in order");
+	(*frames_per_second) = 0.0;
+	if(elapsed_time > 0.0)
+		(*frames_per_second) = ((double)frame_count)/elapsed_time;
+	fprintf(stdout,"%d readouts of %d x %d pixels took %.6f s: %.1f frames/s, %.2f Mpixels/s.\n",
+		frame_count,area->Binned_NCols,area->Binned_NRows,elapsed_time,(*frames_per_second),
+		(*frames_per_second)*((double)expected_length)/1.0e6);
+	/* save the last readout, and check the saved image dimensions */
+	unlink(FITS_FILENAME);
+	CCD_Fits_Header_Initialise(&header);
+	if(!CCD_Exposure_Save(FITS_FILENAME,buffer,buffer_length,CCD_Setup_Get_Binned_NCols(),
+			      CCD_Setup_Get_Binned_NRows(),header,&timeline))
+	{
+		CCD_General_Error();
+		free(buffer);
+		return FALSE;
+	}
+	free(buffer);
+	Check(Timeline_In_Order(&timeline,CCD_EXPOSURE_TIMELINE_READOUT,CCD_EXPOSURE_TIMELINE_READOUT)&&
+	      Timeline_In_Order(&timeline,CCD_EXPOSURE_TIMELINE_SAVE_OPEN,CCD_EXPOSURE_TIMELINE_SAVE_CLOSE)&&
+	      (Time_Difference(timeline.Phase_Time[CCD_EXPOSURE_TIMELINE_READOUT],
+			       timeline.Phase_Time[CCD_EXPOSURE_TIMELINE_SAVE_OPEN]) >= 0.0),"Save timeline is in order");
+	Check(Check_Fits_Image(area),"Saved FITS image has the binned window dimensions and pixels");
+	return TRUE;
+}
+
+/**
+ * Check the image saved to FITS_FILENAME has NAXIS1 = binned columns, NAXIS2 = binned rows,
+ * and contains the pixels from the window.
+ * @param area The readout area that was saved.
+ * @return TRUE if the image is correct, FALSE otherwise.
+ * @see #FITS_FILENAME
+ * @see #Check_Pixels
+ */
+static int Check_Fits_Image(struct Readout_Area_Struct *area)
+{
+	fitsfile *fits_fp = NULL;
+	unsigned short *buffer = NULL;
+	long axes[2];
+	int status = 0,naxis = 0,retval;
+
+	if(fits_open_file(&fits_fp,FITS_FILENAME,READONLY,&status))
+	{
+		fits_report_error(stderr,status);
+		return FALSE;
+	}
+	fits_get_img_dim(fits_fp,&naxis,&status);
+	fits_get_img_size(fits_fp,2,axes,&status);
+	if(status||(naxis != 2)||(axes[0] != area->Binned_NCols)||(axes[1] != area->Binned_NRows))
+	{
+		fprintf(stdout,"Saved image has NAXIS %d, NAXIS1 %ld, NAXIS2 %ld.\n",naxis,axes[0],axes[1]);
+		fits_close_file(fits_fp,&status);
+		return FALSE;
+	}
+	buffer = (unsigned short *)malloc(axes[0]*axes[1]*sizeof(unsigned short));
+	if(buffer == NULL)
+	{
+		fits_close_file(fits_fp,&status);
+		return FALSE;
+	}
+	fits_read_img(fits_fp,TUSHORT,1,axes[0]*axes[1],NULL,buffer,NULL,&status);
+	retval = (status == 0)&&Check_Pixels(area,buffer);
+	free(buffer);
+	fits_close_file(fits_fp,&status);
+	return retval;
+}
+
+/**
+ * Check a range of phases in a timeline have all been time stamped, and are in time order.
+ * @param timeline The timeline.
+ * @param first The first phase to check.
+ * @param last The last phase to check.
+ * @return TRUE if the phases are all time stamped and in order, FALSE otherwise.
+ * @see #Time_Difference
+ */
+static int Timeline_In_Order(struct CCD_Exposure_Timeline_Struct *timeline,enum CCD_EXPOSURE_TIMELINE_PHASE first,
+			     enum CCD_EXPOSURE_TIMELINE_PHASE last)
+{
+	int phase;
+
+	for(phase = first; phase <= last; phase++)
+	{
+		if((timeline->Phase_Time[phase].tv_sec == 0)&&(timeline->Phase_Time[phase].tv_nsec == 0))
+			return FALSE;
+		if((phase > first)&&(Time_Difference(timeline->Phase_Time[phase-1],timeline->Phase_Time[phase]) < 0.0))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Return the time between two timestamps, in seconds.
+ * @param start_time The earlier timestamp.
+ * @param end_time The later timestamp.
+ * @return The time difference in seconds.
+ */
+static double Time_Difference(struct timespec start_time,struct timespec end_time)
+{
+	return ((double)(end_time.tv_sec-start_time.tv_sec))+
+		(((double)(end_time.tv_nsec-start_time.tv_nsec))/1.0e9);
+}